@@ -31,11 +31,18 @@
 //   Fl_Html_View::add_block()       - Add a text block to the list.
 //   Fl_Html_View::add_link()        - Add a new link to the list.
 //   Fl_Html_View::add_target()      - Add a new target to the list.
+//   Fl_Html_View::add_op()          - Add a new op to the display list.
+//   Fl_Html_View::add_text_op()     - Add a text fragment to the display list.
+//   Fl_Html_View::build_display_list() - Resolve formatted blocks into
+//                                     display list ops.
 //   Fl_Html_View::compare_targets() - Compare two targets.
 //   Fl_Html_View::do_align()        - Compute the alignment for a line in
 //                                     a block.
 //   Fl_Html_View::draw()            - Draw the Fl_Html_View widget.
 //   Fl_Html_View::format()          - Format the help text.
+//   Fl_Html_View::format_step()     - Continue formatting the help text.
+//   Fl_Html_View::format_end()      - Finish a complete layout.
+//   Fl_Html_View::format_finish()   - Complete a pending layout right away.
 //   Fl_Html_View::format_table()    - Format a table...
 //   Fl_Html_View::free_data()       - Free memory used for the document.
 //   Fl_Html_View::get_align()       - Get an alignment attribute.
@@ -64,6 +71,7 @@
 #include <stdlib.h>
 #include <FL/fl_utf8.h>
 #include "flstring.h"
+#include "trace.h"
 #include <ctype.h>
 #include <errno.h>
 #include <math.h>
@@ -86,6 +94,11 @@
 
 #define MAX_COLUMNS	200
 
+// Documents larger than this are laid out incrementally (visible part first, the rest in idle
+// time), and reflow after a width change is deferred until the resize has settled
+#define FORMAT_STEP_SIZE	65536
+#define FORMAT_RESIZE_DELAY	0.2
+
 
 //
 // Typedef the C API sort function type the only way I know how...
@@ -198,6 +211,41 @@ struct fl_margins {
   }
 };
 
+
+//
+// Layout state of Fl_Html_View::format_step(), kept between incremental steps...
+//
+
+struct Fl_Html_Format_State
+{
+  int		started,	// Layout in progress?
+		load,		// initial_load value for this layout
+		len;		// Length of document
+  int		block;		// Current block (index, blocks_ may be reallocated)
+  int		cells[MAX_COLUMNS],
+				// Cells in the current row...
+		row;		// Current table row (block number)
+  const char	*ptr;		// Pointer into block
+  char		linkdest[1024];	// Link destination
+  int		xx, yy, ww, hh;	// Size of current text fragment
+  int		line;		// Current line in block
+  int		links;		// Links for current line
+  unsigned char	font, fsize;	// Current font and size
+  unsigned char	border;		// Draw border?
+  int		talign,		// Current alignment
+		newalign,	// New alignment
+		head,		// In the <HEAD> section?
+		pre,		// <PRE> text?
+		needspace;	// Do we need whitespace?
+  int		table_width,	// Width of table
+		table_offset;	// Offset of table
+  int		column,		// Current table column number
+		columns[MAX_COLUMNS];
+				// Column widths
+  Fl_Color	tc, rc;		// Table/row background color
+  fl_margins	margins;	// Left margin stack...
+};
+
 //
 // All the stuff needed to implement text selection in Fl_Html_View
 //
@@ -377,6 +425,79 @@ Fl_Html_View::add_link(const char *n,	// I - Name of link
 }
 
 
+//
+// 'Fl_Html_View::add_op()' - Add a new op to the display list.
+//
+
+Fl_Html_Op *				// O - Pointer to new op
+Fl_Html_View::add_op(uchar    type,	// I - Op type
+                     int      xx,	// I - X position of op
+		     int      yy,	// I - Y position of op
+		     Fl_Color c)	// I - Drawing color
+{
+  Fl_Html_Op	*temp;			// New op
+
+
+  if (nops_ >= aops_)
+  {
+    aops_ = aops_ ? aops_ * 2 : 256;
+
+    if (aops_ == 256)
+      ops_ = (Fl_Html_Op *)malloc(sizeof(Fl_Html_Op) * aops_);
+    else
+      ops_ = (Fl_Html_Op *)realloc(ops_, sizeof(Fl_Html_Op) * aops_);
+  }
+
+  temp = ops_ + nops_;
+  memset(temp, 0, sizeof(Fl_Html_Op));
+  temp->type        = type;
+  temp->x           = xx;
+  temp->y           = yy;
+  temp->color       = c;
+  temp->cull_top    = yy;
+  temp->cull_bottom = yy;
+  nops_ ++;
+
+  return (temp);
+}
+
+
+//
+// 'Fl_Html_View::add_text_op()' - Add a text fragment in the current font to the display list.
+//
+
+void
+Fl_Html_View::add_text_op(const char *t,	// I - Text
+                          int        xx,	// I - X position of text
+			  int        yy,	// I - Y position of text baseline
+			  int        pos,	// I - Selection position of text
+			  Fl_Color   c)		// I - Text color
+{
+  Fl_Html_Op	*temp;			// New op
+  int		len = (int)strlen(t) + 1;
+
+
+  if (ntext_ + len > atext_)
+  {
+    while (ntext_ + len > atext_)
+      atext_ = atext_ ? atext_ * 2 : 4096;
+
+    text_ = (char *)realloc(text_, atext_);
+  }
+
+  temp = add_op(OP_TEXT, xx, yy, c);
+  temp->font        = (uchar)fl_font();
+  temp->size        = (uchar)fl_size();
+  temp->pos         = pos;
+  temp->text        = ntext_;
+  temp->cull_top    = yy - fl_height();
+  temp->cull_bottom = yy + fl_descent();
+
+  memcpy(text_ + ntext_, t, len);
+  ntext_ += len;
+}
+
+
 //
 // 'Fl_Html_View::add_target()' - Add a new target to the list.
 //
@@ -469,22 +590,14 @@ Fl_Html_View::do_align(Fl_Html_Block *block,	// I - Block to add to
 void
 Fl_Html_View::draw()
 {
-	int			i;		// Looping var
+	int			i, j;		// Looping vars
 	const Fl_Html_Block	*block;		// Pointer to current block
-	const char		*ptr,		// Pointer to text in block
-		*attrs;		// Pointer to start of element attributes
-	char			*s,		// Pointer into buffer
-		buf[1024],	// Text buffer
-		attr[1024];	// Attribute buffer
-	int			xx, yy, ww, hh;	// Current positions and sizes
-	int			line;		// Current line
-	unsigned char		font, fsize;	// Current font and size
-	int			head, pre,	// Flags for text
-		needspace;	// Do we need whitespace?
+	const Fl_Html_Op	*op;		// Pointer to current op
+	int			ww, hh;		// Current sizes
+	int			lo, hi;		// Binary search range
 	Fl_Boxtype		b = box() ? box() : FL_DOWN_BOX;
 	// Box to draw...
-	int			underline,	// Underline text?
-		xtra_ww;        // Extra width for underlined space between words
+	int			font, fsize;	// Currently selected font and size
 
 
 	// Draw the scrollbar(s) and box first...
@@ -525,504 +638,630 @@ Fl_Html_View::draw()
 		ww - Fl::box_dw(b), hh - Fl::box_dh(b));
 	fl_color(textcolor_);
 
-	// Draw all visible blocks...
+	font  = -1;
+	fsize = -1;
+
+	// Replay the display list of all visible blocks...
 	for (i = 0, block = blocks_; i < nblocks_; i ++, block ++)
 	{
 		if ((block->y + block->h) >= topline_ && block->y < (topline_ + h()))
 		{
-			line      = 0;
-			xx        = block->line[line];
-			yy        = block->y - topline_;
-			hh        = 0;
-			pre       = 0;
-			head      = 0;
-			needspace = 0;
-			underline = 0;
-
-			initfont(font, fsize);
+			// Skip ops above the visible area (a single <PRE> block may hold an entire document)
+			lo = block->op_first;
+			hi = block->op_last;
+			while (lo < hi)
+			{
+				j = (lo + hi) / 2;
+				if (ops_[j].cull_bottom < topline_)
+					lo = j + 1;
+				else
+					hi = j;
+			}
 
-			for (ptr = block->start, s = buf; ptr < block->end;)
+			for (j = lo, op = ops_ + lo; j < block->op_last && op->cull_top < (topline_ + h()); j ++, op ++)
 			{
-				if ((*ptr == '<' || isspace((*ptr)&255)) && s > buf)
+				switch (op->type)
 				{
-					if (!head && !pre)
-					{
-						// Check width...
-						*s = '\0';
-						s  = buf;
-						ww = (int)fl_width(buf);
+				case OP_TEXT :
+					if (op->font != font || op->size != fsize)
+						fl_font(font = op->font, fsize = op->size);
 
-						if (needspace && xx > block->x)
-							xx += (int)fl_width(' ');
+					fl_color(op->color);
+					current_pos = op->pos;
+					hv_draw(text_ + op->text, op->x + x() - leftline_, op->y - topline_ + y());
+					break;
 
-						if ((xx + ww) > block->w)
-						{
-							if (line < 31)
-								line ++;
-							xx = block->line[line];
-							yy += hh;
-							hh = 0;
-						}
+				case OP_LINE :
+					fl_color(op->color);
+					fl_xyline(op->x + x() - leftline_, op->y - topline_ + y(), op->w + x() - leftline_);
+					break;
 
-						hv_draw(buf, xx + x() - leftline_, yy + y());
-						if (underline) {
-							xtra_ww = isspace((*ptr)&255)?(int)fl_width(' '):0;
-							fl_xyline(xx + x() - leftline_, yy + y() + 1,
-								xx + x() - leftline_ + ww + xtra_ww);
-						}
-						current_pos = ptr-value_;
+				case OP_HRULE :
+					fl_color(op->color);
+					fl_line(op->x + x(), op->y - topline_ + y(), op->w + x(), op->y - topline_ + y());
+					break;
 
-						xx += ww;
-						if ((fsize + 2) > hh)
-							hh = fsize + 2;
+				case OP_IMAGE :
+					op->img->draw(op->x + x() - leftline_, op->y - topline_ + y());
+					break;
 
-						needspace = 0;
-					}
-					else if (pre)
+				case OP_BOX :
 					{
-						while (isspace((*ptr)&255))
-						{
-							if (*ptr == '\n')
-							{
-								*s = '\0';
-								s = buf;
-
-								hv_draw(buf, xx + x() - leftline_, yy + y());
-								if (underline) fl_xyline(xx + x() - leftline_, yy + y() + 1,
-									xx + x() - leftline_ +
-									(int)fl_width(buf));
-
-								current_pos = ptr-value_;
-								if (line < 31)
-									line ++;
-								xx = block->line[line];
-								yy += hh;
-								hh = fsize + 2;
-							}
-							else if (*ptr == '\t')
-							{
-								// Do tabs every 8 columns...
-								while (((s - buf) & 7))
-									*s++ = ' ';
-							}
-							else
-								*s++ = ' ';
+						int tx, ty, tw, th;
 
-							if ((fsize + 2) > hh)
-								hh = fsize + 2;
+						tx = op->x - leftline_;
+						ty = op->y - topline_;
+						tw = op->w;
+						th = op->h;
 
-							ptr ++;
+						if (tx < 0)
+						{
+							tw += tx;
+							tx  = 0;
 						}
 
-						if (s > buf)
+						if (ty < 0)
 						{
-							*s = '\0';
-							s = buf;
-
-							hv_draw(buf, xx + x() - leftline_, yy + y());
-							ww = (int)fl_width(buf);
-							if (underline) fl_xyline(xx + x() - leftline_, yy + y() + 1,
-								xx + x() - leftline_ + ww);
-							xx += ww;
-							current_pos = ptr-value_;
+							th += ty;
+							ty  = 0;
 						}
 
-						needspace = 0;
-					}
-					else
-					{
-						s = buf;
+						tx += x();
+						ty += y();
+
+						if (op->fill != bgcolor_)
+						{
+							fl_color(op->fill);
+							fl_rectf(tx, ty, tw, th);
+						}
 
-						while (isspace((*ptr)&255))
-							ptr ++;
-						current_pos = ptr-value_;
+						fl_color(op->color);
+						if (op->border)
+							fl_rect(tx, ty, tw, th);
 					}
+					break;
 				}
+			}
+		}
+	}
 
-				if (*ptr == '<')
-				{
-					ptr ++;
+	fl_pop_clip();
+}
 
-					if (strncmp(ptr, "!--", 3) == 0)
-					{
-						// Comment...
-						ptr += 3;
-						if ((ptr = strstr(ptr, "-->")) != NULL)
-						{
-							ptr += 3;
-							continue;
-						}
-						else
-							break;
-					}
 
-					while (*ptr && *ptr != '>' && !isspace((*ptr)&255))
-						if (s < (buf + sizeof(buf) - 1))
-							*s++ = *ptr++;
-						else
-							ptr ++;
+//
+// 'Fl_Html_View::build_display_list()' - Resolve the markup of formatted blocks into display list ops.
+//
 
-					*s = '\0';
-					s = buf;
+void
+Fl_Html_View::build_display_list(int nb)	// I - Number of (final) blocks to resolve
+{
+	int			i;		// Looping var
+	Fl_Html_Block		*block;		// Pointer to current block
+	const char		*ptr,		// Pointer to text in block
+		*attrs;		// Pointer to start of element attributes
+	char			*s,		// Pointer into buffer
+		buf[1024],	// Text buffer
+		attr[1024];	// Attribute buffer
+	int			xx, yy, ww, hh;	// Current positions and sizes
+	int			line;		// Current line
+	unsigned char		font, fsize;	// Current font and size
+	int			head, pre,	// Flags for text
+		needspace;	// Do we need whitespace?
+	int			underline,	// Underline text?
+		xtra_ww;        // Extra width for underlined space between words
+	int			j;		// Looping var
+	int			pos;		// Selection position of next text fragment
+	Fl_Color		color;		// Current text color
+	Fl_Html_Op		*op;		// Last added op
+	char			save_initial_load = initial_load;
+	int			save_nfonts = nfonts_;
+	uchar			save_fonts[100][2];
 
-					attrs = ptr;
-					while (*ptr && *ptr != '>')
-						ptr ++;
 
-					if (*ptr == '>')
-						ptr ++;
+	// Blocks before dl_blocks_ have been resolved by a previous call (incremental layout)
+	if (dl_blocks_ == 0)
+	{
+		nops_     = 0;
+		ntext_    = 0;
+		dl_color_ = textcolor_;
+		dl_pos_   = 0;
+	}
+
+	// Images were loaded by format(), only look them up here...
+	initial_load = 0;
 
-					// end of command reached, set the supposed start of printed eord here
-					current_pos = ptr-value_;
-					if (strcasecmp(buf, "HEAD") == 0)
-						head = 1;
-					else if (strcasecmp(buf, "BR") == 0)
+	// Don't disturb the font stack of a suspended layout...
+	memcpy(save_fonts, fonts_, sizeof(save_fonts));
+
+	color = dl_color_;
+	pos   = dl_pos_;
+
+	for (i = dl_blocks_, block = blocks_ + i; i < nb; i ++, block ++)
+	{
+		block->op_first = nops_;
+
+		line      = 0;
+		xx        = block->line[line];
+		yy        = block->y;
+		hh        = 0;
+		pre       = 0;
+		head      = 0;
+		needspace = 0;
+		underline = 0;
+		ww        = 0;
+
+		initfont(font, fsize);
+
+		for (ptr = block->start, s = buf; ptr < block->end;)
+		{
+			if ((*ptr == '<' || isspace((*ptr)&255)) && s > buf)
+			{
+				if (!head && !pre)
+				{
+					// Check width...
+					*s = '\0';
+					s  = buf;
+					ww = (int)fl_width(buf);
+
+					if (needspace && xx > block->x)
+						xx += (int)fl_width(' ');
+
+					if ((xx + ww) > block->w)
 					{
 						if (line < 31)
 							line ++;
 						xx = block->line[line];
-						if (!hh) hh = fsize + 2;// Fl_Html_View mod: make <br> tags work for empty lines
 						yy += hh;
 						hh = 0;
 					}
-					else if (strcasecmp(buf, "HR") == 0)
-					{
-						fl_line(block->x + x(), yy + y(), block->w + x(),
-							yy + y());
 
-						if (line < 31)
-							line ++;
-						xx = block->line[line];
-						yy += 2 * hh;
-						hh = 0;
+					add_text_op(buf, xx, yy, pos, color);
+					if (underline) {
+						xtra_ww = isspace((*ptr)&255)?(int)fl_width(' '):0;
+						op = add_op(OP_LINE, xx, yy + 1, color);
+						op->w = xx + ww + xtra_ww;
 					}
-					else if (strcasecmp(buf, "CENTER") == 0 ||
-						strcasecmp(buf, "P") == 0 ||
-						strcasecmp(buf, "H1") == 0 ||
-						strcasecmp(buf, "H2") == 0 ||
-						strcasecmp(buf, "H3") == 0 ||
-						strcasecmp(buf, "H4") == 0 ||
-						strcasecmp(buf, "H5") == 0 ||
-						strcasecmp(buf, "H6") == 0 ||
-						strcasecmp(buf, "UL") == 0 ||
-						strcasecmp(buf, "OL") == 0 ||
-						strcasecmp(buf, "DL") == 0 ||
-						strcasecmp(buf, "LI") == 0 ||
-						strcasecmp(buf, "DD") == 0 ||
-						strcasecmp(buf, "DT") == 0 ||
-						strcasecmp(buf, "PRE") == 0)
+					pos = ptr-value_;
+
+					xx += ww;
+					if ((fsize + 2) > hh)
+						hh = fsize + 2;
+
+					needspace = 0;
+				}
+				else if (pre)
+				{
+					while (isspace((*ptr)&255))
 					{
-						if (tolower(buf[0]) == 'h')
-						{
-							font  = FL_HELVETICA_BOLD;
-							fsize = (uchar)(textsize_ + '7' - buf[1]);
-						}
-						else if (strcasecmp(buf, "DT") == 0)
+						if (*ptr == '\n')
 						{
-							font  = (uchar)(textfont_ | FL_ITALIC);
-							fsize = textsize_;
+							*s = '\0';
+							s = buf;
+
+							add_text_op(buf, xx, yy, pos, color);
+							if (underline) {
+								op = add_op(OP_LINE, xx, yy + 1, color);
+								op->w = xx + (int)fl_width(buf);
+							}
+
+							pos = ptr-value_;
+							if (line < 31)
+								line ++;
+							xx = block->line[line];
+							yy += hh;
+							hh = fsize + 2;
 						}
-						else if (strcasecmp(buf, "PRE") == 0)
+						else if (*ptr == '\t')
 						{
-							font  = FL_COURIER;
-							fsize = textsize_;
-							pre   = 1;
+							// Do tabs every 8 columns...
+							while (((s - buf) & 7))
+								*s++ = ' ';
 						}
+						else
+							*s++ = ' ';
 
-						if (strcasecmp(buf, "LI") == 0)
-						{
-/*#ifdef __APPLE_QUARTZ__
-							fl_font(FL_SYMBOL, fsize); 
-							hv_draw("\245", xx - fsize + x() - leftline_, yy + y());
-#else
-							fl_font(FL_SYMBOL, fsize);
-							hv_draw("\267", xx - fsize + x() - leftline_, yy + y());
-#endif*/
-//							fl_font(FL_SYMBOL, fsize); // The default SYMBOL font on my XP box is not Unicode...
-							char buf[8];
-							wchar_t b[] = {0x2022, 0x0};
-//							buf[fl_unicode2utf(b, 1, buf)] = 0;
-							unsigned dstlen = fl_utf8fromwc(buf, 8, b, 1);
-							buf[dstlen] = 0;
-							hv_draw(buf, xx - fsize + x() - leftline_, yy + y());
-						}
+						if ((fsize + 2) > hh)
+							hh = fsize + 2;
 
-						pushfont(font, fsize);
+						ptr ++;
 					}
-					else if (strcasecmp(buf, "A") == 0 &&
-						get_attr(attrs, "HREF", attr, sizeof(attr)) != NULL)
+
+					if (s > buf)
 					{
-						// Fl_Html_View mod: allow to customize color per link
-						if (get_attr(attrs, "COLOR", attr, sizeof(attr)) != NULL) {
-							fl_color(get_color(attr, linkcolor_));
-						}
-						else
+						*s = '\0';
+						s = buf;
 
-						fl_color(linkcolor_);
-						underline = 1;
+						add_text_op(buf, xx, yy, pos, color);
+						ww = (int)fl_width(buf);
+						if (underline) {
+							op = add_op(OP_LINE, xx, yy + 1, color);
+							op->w = xx + ww;
+						}
+						xx += ww;
+						pos = ptr-value_;
 					}
-					else if (strcasecmp(buf, "/A") == 0)
+
+					needspace = 0;
+				}
+				else
+				{
+					s = buf;
+
+					while (isspace((*ptr)&255))
+						ptr ++;
+					pos = ptr-value_;
+				}
+			}
+
+			if (*ptr == '<')
+			{
+				ptr ++;
+
+				if (strncmp(ptr, "!--", 3) == 0)
+				{
+					// Comment...
+					ptr += 3;
+					if ((ptr = strstr(ptr, "-->")) != NULL)
 					{
-						fl_color(textcolor_);
-						underline = 0;
+						ptr += 3;
+						continue;
 					}
-					else if (strcasecmp(buf, "FONT") == 0)
-					{
-						if (get_attr(attrs, "COLOR", attr, sizeof(attr)) != NULL) {
-							fl_color(get_color(attr, textcolor_));
-						}
+					else
+						break;
+				}
 
-						if (get_attr(attrs, "FACE", attr, sizeof(attr)) != NULL) {
-							if (!strncasecmp(attr, "helvetica", 9) ||
-								!strncasecmp(attr, "arial", 5) ||
-								!strncasecmp(attr, "sans", 4)) font = FL_HELVETICA;
-							else if (!strncasecmp(attr, "times", 5) ||
-								!strncasecmp(attr, "serif", 5)) font = FL_TIMES;
-							else if (!strncasecmp(attr, "symbol", 6)) font = FL_SYMBOL;
-							else font = FL_COURIER;
-						}
+				while (*ptr && *ptr != '>' && !isspace((*ptr)&255))
+					if (s < (buf + sizeof(buf) - 1))
+						*s++ = *ptr++;
+					else
+						ptr ++;
 
-						if (get_attr(attrs, "SIZE", attr, sizeof(attr)) != NULL) {
-							if (isdigit(attr[0] & 255)) {
-								// Absolute size
-								fsize = (int)(textsize_ * pow(1.2, atof(attr) - 3.0));
-							} else {
-								// Relative size
-								fsize = (int)(fsize * pow(1.2, atof(attr) - 3.0));
-							}
-						}
+				*s = '\0';
+				s = buf;
+
+				attrs = ptr;
+				while (*ptr && *ptr != '>')
+					ptr ++;
+
+				if (*ptr == '>')
+					ptr ++;
+
+				// end of command reached, set the supposed start of printed eord here
+				pos = ptr-value_;
+				if (strcasecmp(buf, "HEAD") == 0)
+					head = 1;
+				else if (strcasecmp(buf, "BR") == 0)
+				{
+					if (line < 31)
+						line ++;
+					xx = block->line[line];
+					if (!hh) hh = fsize + 2;// Fl_Html_View mod: make <br> tags work for empty lines
+					yy += hh;
+					hh = 0;
+				}
+				else if (strcasecmp(buf, "HR") == 0)
+				{
+					op = add_op(OP_HRULE, block->x, yy, color);
+					op->w = block->w;
 
-						pushfont(font, fsize);
+					if (line < 31)
+						line ++;
+					xx = block->line[line];
+					yy += 2 * hh;
+					hh = 0;
+				}
+				else if (strcasecmp(buf, "CENTER") == 0 ||
+					strcasecmp(buf, "P") == 0 ||
+					strcasecmp(buf, "H1") == 0 ||
+					strcasecmp(buf, "H2") == 0 ||
+					strcasecmp(buf, "H3") == 0 ||
+					strcasecmp(buf, "H4") == 0 ||
+					strcasecmp(buf, "H5") == 0 ||
+					strcasecmp(buf, "H6") == 0 ||
+					strcasecmp(buf, "UL") == 0 ||
+					strcasecmp(buf, "OL") == 0 ||
+					strcasecmp(buf, "DL") == 0 ||
+					strcasecmp(buf, "LI") == 0 ||
+					strcasecmp(buf, "DD") == 0 ||
+					strcasecmp(buf, "DT") == 0 ||
+					strcasecmp(buf, "PRE") == 0)
+				{
+					if (tolower(buf[0]) == 'h')
+					{
+						font  = FL_HELVETICA_BOLD;
+						fsize = (uchar)(textsize_ + '7' - buf[1]);
 					}
-					else if (strcasecmp(buf, "/FONT") == 0)
+					else if (strcasecmp(buf, "DT") == 0)
 					{
-						fl_color(textcolor_);
-						popfont(font, fsize);
+						font  = (uchar)(textfont_ | FL_ITALIC);
+						fsize = textsize_;
 					}
-					else if (strcasecmp(buf, "U") == 0)
-						underline = 1;
-					else if (strcasecmp(buf, "/U") == 0)
-						underline = 0;
-					else if (strcasecmp(buf, "B") == 0 ||
-						strcasecmp(buf, "STRONG") == 0)
-						pushfont(font |= FL_BOLD, fsize);
-					else if (strcasecmp(buf, "TD") == 0 ||
-						strcasecmp(buf, "TH") == 0)
+					else if (strcasecmp(buf, "PRE") == 0)
 					{
-						int tx, ty, tw, th;
+						font  = FL_COURIER;
+						fsize = textsize_;
+						pre   = 1;
+					}
 
-						if (tolower(buf[1]) == 'h')
-							pushfont(font |= FL_BOLD, fsize);
-						else
-							pushfont(font = textfont_, fsize);
+					if (strcasecmp(buf, "LI") == 0)
+					{
+//						fl_font(FL_SYMBOL, fsize); // The default SYMBOL font on my XP box is not Unicode...
+						char buf[8];
+						wchar_t b[] = {0x2022, 0x0};
+						unsigned dstlen = fl_utf8fromwc(buf, 8, b, 1);
+						buf[dstlen] = 0;
+						add_text_op(buf, xx - fsize, yy, pos, color);
+					}
 
-						tx = block->x - 4 - leftline_;
-						ty = block->y - topline_ - fsize - 3;
-						tw = block->w - block->x + 7;
-						th = block->h + fsize - 5;
+					pushfont(font, fsize);
+				}
+				else if (strcasecmp(buf, "A") == 0 &&
+					get_attr(attrs, "HREF", attr, sizeof(attr)) != NULL)
+				{
+					// Fl_Html_View mod: allow to customize color per link
+					if (get_attr(attrs, "COLOR", attr, sizeof(attr)) != NULL)
+						color = get_color(attr, linkcolor_);
+					else
+						color = linkcolor_;
+					underline = 1;
+				}
+				else if (strcasecmp(buf, "/A") == 0)
+				{
+					color = textcolor_;
+					underline = 0;
+				}
+				else if (strcasecmp(buf, "FONT") == 0)
+				{
+					if (get_attr(attrs, "COLOR", attr, sizeof(attr)) != NULL) {
+						color = get_color(attr, textcolor_);
+					}
 
-						if (tx < 0)
-						{
-							tw += tx;
-							tx  = 0;
-						}
+					if (get_attr(attrs, "FACE", attr, sizeof(attr)) != NULL) {
+						if (!strncasecmp(attr, "helvetica", 9) ||
+							!strncasecmp(attr, "arial", 5) ||
+							!strncasecmp(attr, "sans", 4)) font = FL_HELVETICA;
+						else if (!strncasecmp(attr, "times", 5) ||
+							!strncasecmp(attr, "serif", 5)) font = FL_TIMES;
+						else if (!strncasecmp(attr, "symbol", 6)) font = FL_SYMBOL;
+						else font = FL_COURIER;
+					}
 
-						if (ty < 0)
-						{
-							th += ty;
-							ty  = 0;
+					if (get_attr(attrs, "SIZE", attr, sizeof(attr)) != NULL) {
+						if (isdigit(attr[0] & 255)) {
+							// Absolute size
+							fsize = (int)(textsize_ * pow(1.2, atof(attr) - 3.0));
+						} else {
+							// Relative size
+							fsize = (int)(fsize * pow(1.2, atof(attr) - 3.0));
 						}
+					}
 
-						tx += x();
-						ty += y();
+					pushfont(font, fsize);
+				}
+				else if (strcasecmp(buf, "/FONT") == 0)
+				{
+					color = textcolor_;
+					popfont(font, fsize);
+				}
+				else if (strcasecmp(buf, "U") == 0)
+					underline = 1;
+				else if (strcasecmp(buf, "/U") == 0)
+					underline = 0;
+				else if (strcasecmp(buf, "B") == 0 ||
+					strcasecmp(buf, "STRONG") == 0)
+					pushfont(font |= FL_BOLD, fsize);
+				else if (strcasecmp(buf, "TD") == 0 ||
+					strcasecmp(buf, "TH") == 0)
+				{
+					if (tolower(buf[1]) == 'h')
+						pushfont(font |= FL_BOLD, fsize);
+					else
+						pushfont(font = textfont_, fsize);
 
-						if (block->bgcolor != bgcolor_)
-						{
-							fl_color(block->bgcolor);
-							fl_rectf(tx, ty, tw, th);
-							fl_color(textcolor_);
-						}
+					// box is clipped against the top/left view edges when drawn
+					op = add_op(OP_BOX, block->x - 4, block->y - fsize - 3, color);
+					op->w = block->w - block->x + 7;
+					op->h = block->h + fsize - 5;
+					op->fill = block->bgcolor;
+					op->border = block->border;
+					op->cull_bottom = op->y + op->h;
 
-						if (block->border)
-							fl_rect(tx, ty, tw, th);
-					}
-					else if (strcasecmp(buf, "I") == 0 ||
-						strcasecmp(buf, "EM") == 0)
-						pushfont(font |= FL_ITALIC, fsize);
-					else if (strcasecmp(buf, "CODE") == 0 ||
-						strcasecmp(buf, "TT") == 0)
-						pushfont(font = FL_COURIER, fsize);
-					else if (strcasecmp(buf, "KBD") == 0)
-						pushfont(font = FL_COURIER_BOLD, fsize);
-					else if (strcasecmp(buf, "VAR") == 0)
-						pushfont(font = FL_COURIER_ITALIC, fsize);
-					else if (strcasecmp(buf, "/HEAD") == 0)
-						head = 0;
-					else if (strcasecmp(buf, "/H1") == 0 ||
-						strcasecmp(buf, "/H2") == 0 ||
-						strcasecmp(buf, "/H3") == 0 ||
-						strcasecmp(buf, "/H4") == 0 ||
-						strcasecmp(buf, "/H5") == 0 ||
-						strcasecmp(buf, "/H6") == 0 ||
-						strcasecmp(buf, "/B") == 0 ||
-						strcasecmp(buf, "/STRONG") == 0 ||
-						strcasecmp(buf, "/I") == 0 ||
-						strcasecmp(buf, "/EM") == 0 ||
-						strcasecmp(buf, "/CODE") == 0 ||
-						strcasecmp(buf, "/TT") == 0 ||
-						strcasecmp(buf, "/KBD") == 0 ||
-						strcasecmp(buf, "/VAR") == 0)
-						popfont(font, fsize);
-					else if (strcasecmp(buf, "/PRE") == 0)
+					if (block->bgcolor != bgcolor_)
 					{
-						popfont(font, fsize);
-						pre = 0;
+						op->color = textcolor_;
+						color = textcolor_;
 					}
-					else if (strcasecmp(buf, "IMG") == 0)
-					{
-						Fl_Image *img = 0;
-						int		width, height;
-						char	wattr[8], hattr[8];
-
+				}
+				else if (strcasecmp(buf, "I") == 0 ||
+					strcasecmp(buf, "EM") == 0)
+					pushfont(font |= FL_ITALIC, fsize);
+				else if (strcasecmp(buf, "CODE") == 0 ||
+					strcasecmp(buf, "TT") == 0)
+					pushfont(font = FL_COURIER, fsize);
+				else if (strcasecmp(buf, "KBD") == 0)
+					pushfont(font = FL_COURIER_BOLD, fsize);
+				else if (strcasecmp(buf, "VAR") == 0)
+					pushfont(font = FL_COURIER_ITALIC, fsize);
+				else if (strcasecmp(buf, "/HEAD") == 0)
+					head = 0;
+				else if (strcasecmp(buf, "/H1") == 0 ||
+					strcasecmp(buf, "/H2") == 0 ||
+					strcasecmp(buf, "/H3") == 0 ||
+					strcasecmp(buf, "/H4") == 0 ||
+					strcasecmp(buf, "/H5") == 0 ||
+					strcasecmp(buf, "/H6") == 0 ||
+					strcasecmp(buf, "/B") == 0 ||
+					strcasecmp(buf, "/STRONG") == 0 ||
+					strcasecmp(buf, "/I") == 0 ||
+					strcasecmp(buf, "/EM") == 0 ||
+					strcasecmp(buf, "/CODE") == 0 ||
+					strcasecmp(buf, "/TT") == 0 ||
+					strcasecmp(buf, "/KBD") == 0 ||
+					strcasecmp(buf, "/VAR") == 0)
+					popfont(font, fsize);
+				else if (strcasecmp(buf, "/PRE") == 0)
+				{
+					popfont(font, fsize);
+					pre = 0;
+				}
+				else if (strcasecmp(buf, "IMG") == 0)
+				{
+					Fl_Image *img = 0;
+					int		width, height;
+					char	wattr[8], hattr[8];
 
-						get_attr(attrs, "WIDTH", wattr, sizeof(wattr));
-						get_attr(attrs, "HEIGHT", hattr, sizeof(hattr));
-						width  = get_length(wattr);
-						height = get_length(hattr);
 
-						if (get_attr(attrs, "SRC", attr, sizeof(attr))) {
-							img = get_image(attr, width, height);
-							if (!width) width = img->w();
-							if (!height) height = img->h();
-						}
+					get_attr(attrs, "WIDTH", wattr, sizeof(wattr));
+					get_attr(attrs, "HEIGHT", hattr, sizeof(hattr));
+					width  = get_length(wattr);
+					height = get_length(hattr);
 
-						if (!width || !height) {
-							if (get_attr(attrs, "ALT", attr, sizeof(attr)) == NULL) {
-								strcpy(attr, "IMG");
-							}
-						}
+					if (get_attr(attrs, "SRC", attr, sizeof(attr))) {
+						img = get_image(attr, width, height);
+						if (!width) width = img->w();
+						if (!height) height = img->h();
+					}
 
-						ww = width;
+					ww = width;
 
-						if (needspace && xx > block->x)
-							xx += (int)fl_width(' ');
+					if (needspace && xx > block->x)
+						xx += (int)fl_width(' ');
 
-						if ((xx + ww) > block->w)
-						{
-							if (line < 31)
-								line ++;
+					if ((xx + ww) > block->w)
+					{
+						if (line < 31)
+							line ++;
 
-							xx = block->line[line];
-							yy += hh;
-							hh = 0;
-						}
+						xx = block->line[line];
+						yy += hh;
+						hh = 0;
+					}
 
-						if (img) {
-							img->draw(xx + x() - leftline_,
-								yy + y() - fl_height() + fl_descent() + 2);
-						}
+					if (img) {
+						op = add_op(OP_IMAGE, xx, yy - fl_height() + fl_descent() + 2, color);
+						op->img = img;
+						op->cull_bottom = op->y + img->h();
+					}
 
-						xx += ww;
-						if ((height + 2) > hh)
-							hh = height + 2;
+					xx += ww;
+					if ((height + 2) > hh)
+						hh = height + 2;
 
-						needspace = 0;
-					}
+					needspace = 0;
 				}
-				else if (*ptr == '\n' && pre)
-				{
-					*s = '\0';
-					s = buf;
+			}
+			else if (*ptr == '\n' && pre)
+			{
+				*s = '\0';
+				s = buf;
 
-					hv_draw(buf, xx + x() - leftline_, yy + y());
+				add_text_op(buf, xx, yy, pos, color);
 
-					if (line < 31)
-						line ++;
-					xx = block->line[line];
-					yy += hh;
-					hh = fsize + 2;
-					needspace = 0;
+				if (line < 31)
+					line ++;
+				xx = block->line[line];
+				yy += hh;
+				hh = fsize + 2;
+				needspace = 0;
 
-					ptr ++;
-					current_pos = ptr-value_;
-				}
-				else if (isspace((*ptr)&255))
+				ptr ++;
+				pos = ptr-value_;
+			}
+			else if (isspace((*ptr)&255))
+			{
+				if (pre)
 				{
-					if (pre)
+					if (*ptr == ' ')
+						*s++ = ' ';
+					else
 					{
-						if (*ptr == ' ')
+						// Do tabs every 8 columns...
+						while (((s - buf) & 7))
 							*s++ = ' ';
-						else
-						{
-							// Do tabs every 8 columns...
-							while (((s - buf) & 7))
-								*s++ = ' ';
-						}
 					}
-
-					ptr ++;
-					if (!pre) current_pos = ptr-value_;
-					needspace = 1;
 				}
-				else if (*ptr == '&')
-				{
-					ptr ++;
 
-					int qch = quote_char(ptr);
-
-					if (qch < 0)
-						*s++ = '&';
-					else {
-						//*s++ = qch;
-						int l;
-						l = fl_utf8encode((unsigned int) qch, s);
-						if (l < 1) l = 1;
-						s += l;
-						ptr = strchr(ptr, ';') + 1;
-					}
+				ptr ++;
+				if (!pre) pos = ptr-value_;
+				needspace = 1;
+			}
+			else if (*ptr == '&')
+			{
+				ptr ++;
 
-					if ((fsize + 2) > hh)
-						hh = fsize + 2;
-				}
-				else
-				{
-					*s++ = *ptr++;
+				int qch = quote_char(ptr);
 
-					if ((fsize + 2) > hh)
-						hh = fsize + 2;
+				if (qch < 0)
+					*s++ = '&';
+				else {
+					int l;
+					l = fl_utf8encode((unsigned int) qch, s);
+					if (l < 1) l = 1;
+					s += l;
+					ptr = strchr(ptr, ';') + 1;
 				}
+
+				if ((fsize + 2) > hh)
+					hh = fsize + 2;
 			}
+			else
+			{
+				*s++ = *ptr++;
 
-			*s = '\0';
+				if ((fsize + 2) > hh)
+					hh = fsize + 2;
+			}
+		}
 
-			if (s > buf && !pre && !head)
-			{
-				ww = (int)fl_width(buf);
+		*s = '\0';
 
-				if (needspace && xx > block->x)
-					xx += (int)fl_width(' ');
+		if (s > buf && !pre && !head)
+		{
+			ww = (int)fl_width(buf);
 
-				if ((xx + ww) > block->w)
-				{
-					if (line < 31)
-						line ++;
-					xx = block->line[line];
-					yy += hh;
-					hh = 0;
-				}
-			}
+			if (needspace && xx > block->x)
+				xx += (int)fl_width(' ');
 
-			if (s > buf && !head)
+			if ((xx + ww) > block->w)
 			{
-				hv_draw(buf, xx + x() - leftline_, yy + y());
-				if (underline) fl_xyline(xx + x() - leftline_, yy + y() + 1,
-					xx + x() - leftline_ + ww);
-				current_pos = ptr-value_;
+				if (line < 31)
+					line ++;
+				xx = block->line[line];
+				yy += hh;
+				hh = 0;
+			}
+		}
+
+		if (s > buf && !head)
+		{
+			add_text_op(buf, xx, yy, pos, color);
+			if (underline) {
+				op = add_op(OP_LINE, xx, yy + 1, color);
+				op->w = xx + ww;
 			}
+			pos = ptr-value_;
 		}
+
+		block->op_last = nops_;
+
+		// Running vertical extents, so draw() can binary search the first visible op of a block
+		for (j = block->op_first + 1; j < block->op_last; j ++)
+			if (ops_[j].cull_bottom < ops_[j - 1].cull_bottom)
+				ops_[j].cull_bottom = ops_[j - 1].cull_bottom;
+		for (j = block->op_last - 2; j >= block->op_first; j --)
+			if (ops_[j].cull_top > ops_[j + 1].cull_top)
+				ops_[j].cull_top = ops_[j + 1].cull_top;
 	}
 
-	fl_pop_clip();
+	if (nb > dl_blocks_)
+		dl_blocks_ = nb;
+	dl_color_ = color;
+	dl_pos_   = pos;
+
+	memcpy(fonts_, save_fonts, sizeof(save_fonts));
+	nfonts_      = save_nfonts;
+	initial_load = save_initial_load;
 }
 
 
@@ -1045,6 +1284,8 @@ Fl_Html_View::find(const char *s,		// I - String to find
   // Range check input and value...
   if (!s || !value_) return -1;
 
+  format_finish();
+
   if (p < 0 || p >= (int)strlen(value_)) p = 0;
   else if (p > 0) p ++;
 
@@ -1095,89 +1336,171 @@ Fl_Html_View::find(const char *s,		// I - String to find
 void
 Fl_Html_View::format()
 {
+	TRACE_SCOPE("HtmlFormat");
+	STAT_TIME_SCOPE(STAT_HtmlFormat);
+	Fl_Boxtype	b = box() ? box() : FL_DOWN_BOX;
+	// Box to draw...
+
+
+	Fl::remove_idle(format_idle_cb, this);
+	Fl::remove_timeout(reflow_timeout_cb, this);
+
+	// Remember what the layout was made for, so resize() can reuse it...
+	fmt_w_        = w();
+	fmt_textfont_ = textfont_;
+	fmt_textsize_ = textsize_;
+
+	// Reset document width...
+	hsize_ = w() - Fl::scrollbar_size() - Fl::box_dw(b);
+
+	// Keep loading images if the previous layout of this document was interrupted
+	if (!fmt_->started || !fmt_->load)
+		fmt_->load = initial_load;
+	fmt_->started = 0;
+	fmt_->len     = value_ ? (int)strlen(value_) : 0;
+
+	// Lay out the visible part of large documents first and finish in idle time...
+	if (format_step(fmt_->len > FORMAT_STEP_SIZE ? topline_ + h() : -1, 0))
+		format_end();
+	else
+	{
+		update_scrollbars();
+		Fl::add_idle(format_idle_cb, this);
+	}
+}
+
+
+//
+// 'Fl_Html_View::format_step()' - Continue formatting the help text.
+//
+
+int					// O - 1 if layout is complete, 0 if suspended
+Fl_Html_View::format_step(int ymax,	// I - Suspend once this position is laid out (-1 = no limit)
+                          int nbytes)	// I - Suspend after this much text (0 = no limit)
+{
+	TRACE_SCOPE("HtmlFormatStep");
+	Fl_Html_Format_State &st = *fmt_;	// Layout state
 	int		i;		// Looping var
-	int		done;		// Are we done yet?
+	int		done,		// Are we done yet?
+		resume;		// Continue a suspended layout?
 	Fl_Html_Block	*block,		// Current block
 		*cell;		// Current table cell
-	int		cells[MAX_COLUMNS],
+	int		(&cells)[MAX_COLUMNS] = st.cells,
 		// Cells in the current row...
-		row;		// Current table row (block number)
-	const char	*ptr,		// Pointer into block
+		&row = st.row;	// Current table row (block number)
+	const char	*&ptr = st.ptr,	// Pointer into block
 		*start,		// Pointer to start of element
-		*attrs;		// Pointer to start of element attributes
+		*attrs,		// Pointer to start of element attributes
+		*pause;		// Suspend position
 	char		*s,		// Pointer into buffer
 		buf[1024],	// Text buffer
 		attr[1024],	// Attribute buffer
 		wattr[1024],	// Width attribute buffer
 		hattr[1024],	// Height attribute buffer
-		linkdest[1024];	// Link destination
-	int		xx, yy, ww, hh;	// Size of current text fragment
-	int		line;		// Current line in block
-	int		links;		// Links for current line
-	unsigned char	font, fsize;	// Current font and size
-	unsigned char	border;		// Draw border?
-	int		talign,		// Current alignment
-		newalign,	// New alignment
-		head,		// In the <HEAD> section?
-		pre,		// <PRE> text?
-		needspace;	// Do we need whitespace?
-	int		table_width,	// Width of table
-		table_offset;	// Offset of table
-	int		column,		// Current table column number
-		columns[MAX_COLUMNS];
+		(&linkdest)[1024] = st.linkdest;	// Link destination
+	int		&xx = st.xx, &yy = st.yy, &ww = st.ww, &hh = st.hh;	// Size of current text fragment
+	int		&line = st.line;	// Current line in block
+	int		&links = st.links;	// Links for current line
+	unsigned char	&font = st.font, &fsize = st.fsize;	// Current font and size
+	unsigned char	&border = st.border;	// Draw border?
+	int		&talign = st.talign,	// Current alignment
+		&newalign = st.newalign,	// New alignment
+		&head = st.head,	// In the <HEAD> section?
+		&pre = st.pre,	// <PRE> text?
+		&needspace = st.needspace;	// Do we need whitespace?
+	int		&table_width = st.table_width,	// Width of table
+		&table_offset = st.table_offset;	// Offset of table
+	int		&column = st.column,	// Current table column number
+		(&columns)[MAX_COLUMNS] = st.columns;
 	// Column widths
-	Fl_Color	tc, rc;		// Table/row background color
-	Fl_Boxtype	b = box() ? box() : FL_DOWN_BOX;
-	// Box to draw...
-	fl_margins	margins;	// Left margin stack...
+	Fl_Color	&tc = st.tc, &rc = st.rc;	// Table/row background color
+	fl_margins	&margins = st.margins;	// Left margin stack...
+	char		save_initial_load = initial_load;
 
 
-	// Reset document width...
-	hsize_ = w() - Fl::scrollbar_size() - Fl::box_dw(b);
+	initial_load = (char)st.load;
+
+	resume = st.started;
 
 	done = 0;
 	while (!done)
 	{
-		// Reset state variables...
-		done       = 1;
-		nblocks_   = 0;
-		nlinks_    = 0;
-		ntargets_  = 0;
-		size_      = 0;
-		bgcolor_   = color();
-		textcolor_ = textcolor();
-		linkcolor_ = fl_contrast(FL_BLUE, color());
-
-		tc = rc = bgcolor_;
+		if (resume)
+		{
+			// Resume where the previous step was suspended...
+			resume = 0;
+			done   = 1;
+			block = blocks_ + st.block;
+			fl_font(fonts_[nfonts_][0], fonts_[nfonts_][1]);
+		}
+		else
+		{
+			// Reset state variables...
+			done       = 1;
+			nblocks_   = 0;
+			nlinks_    = 0;
+			ntargets_  = 0;
+			nops_      = 0;
+			ntext_     = 0;
+			dl_blocks_ = 0;
+			size_      = 0;
+			bgcolor_   = color();
+			textcolor_ = textcolor();
+			linkcolor_ = fl_contrast(FL_BLUE, color());
+
+			tc = rc = bgcolor_;
+
+			strcpy(title_, "Untitled");
+
+			if (!value_)
+			{
+				initial_load = save_initial_load;
+				return 1;
+			}
 
-		strcpy(title_, "Untitled");
+			// Setup for formatting...
+			initfont(font, fsize);
 
-		if (!value_)
-			return;
+			line         = 0;
+			links        = 0;
+			xx           = margins.clear();
+			yy           = fsize + 2;
+			ww           = 0;
+			column       = 0;
+			border       = 0;
+			hh           = 0;
+			block        = add_block(value_, xx, yy, hsize_, 0);
+			row          = 0;
+			head         = 0;
+			pre          = 0;
+			talign       = LEFT;
+			newalign     = LEFT;
+			needspace    = 0;
+			linkdest[0]  = '\0';
+			table_offset = 0;
+			ptr          = value_;
+			st.started   = 1;
+		}
 
-		// Setup for formatting...
-		initfont(font, fsize);
+		pause = nbytes > 0 ? ptr + nbytes : NULL;
 
-		line         = 0;
-		links        = 0;
-		xx           = margins.clear();
-		yy           = fsize + 2;
-		ww           = 0;
-		column       = 0;
-		border       = 0;
-		hh           = 0;
-		block        = add_block(value_, xx, yy, hsize_, 0);
-		row          = 0;
-		head         = 0;
-		pre          = 0;
-		talign       = LEFT;
-		newalign     = LEFT;
-		needspace    = 0;
-		linkdest[0]  = '\0';
-		table_offset = 0;
-
-		for (ptr = value_, s = buf; *ptr;)
+		for (s = buf; *ptr;)
 		{
+			// Suspend between words outside of tables, once enough has been laid out (all
+			// blocks but the current one are final at this point)
+			if (s == buf && !row && ptr > value_ && ((ymax >= 0 && yy > ymax) || (pause && ptr >= pause)))
+			{
+				st.block     = block - blocks_;
+				initial_load = save_initial_load;
+
+				build_display_list(nblocks_ - 1);
+
+				// Estimate document length from the progress made so far...
+				size_ = (int)((double)(yy + hh) * st.len / (ptr - value_));
+
+				return 0;
+			}
+
 			if ((*ptr == '<' || isspace((*ptr)&255)) && s > buf)
 			{
 				// Get width...
@@ -1344,6 +1667,23 @@ Fl_Html_View::format()
 					block->h += hh;
 					yy       += hh;
 					hh       = 0;
+
+					// Fl_Html_View mod: continue long runs of <br> separated lines (converted plain text)
+					// in a new block once the line alignment table is full, as long as draw() starts the
+					// new block in the same state (keeps blocks small for drawing and incremental layout)
+					if (line >= 31 && !row && !pre && !head && !linkdest[0])
+					{
+						for (i = 0; i <= nfonts_; i ++)
+							if (fonts_[i][0] != textfont_ || fonts_[i][1] != textsize_)
+								break;
+
+						if (i > nfonts_)
+						{
+							block->end = ptr;
+							block      = add_block(ptr, xx, yy, block->w, 0);
+							line       = 0;
+						}
+					}
 				}
 				else if (strcasecmp(buf, "CENTER") == 0 ||
 					strcasecmp(buf, "P") == 0 ||
@@ -1869,12 +2209,90 @@ Fl_Html_View::format()
 		size_      = yy + hh;
 	}
 
+	st.started   = 0;
+	st.load      = 0;
+	initial_load = save_initial_load;
+
+	// Resolve the formatted blocks once, so draw() doesn't have to re-parse the markup on every repaint
+	build_display_list(nblocks_);
+
 	//  printf("margins.depth_=%d\n", margins.depth_);
 
+	return 1;
+}
+
+
+//
+// 'Fl_Html_View::format_end()' - Finish a complete layout.
+//
+
+void
+Fl_Html_View::format_end()
+{
+	Fl::remove_idle(format_idle_cb, this);
+
 	if (ntargets_ > 1)
 		qsort(targets_, ntargets_, sizeof(Fl_Html_Target),
 		(compare_func_t)compare_targets);
 
+	update_scrollbars();
+}
+
+
+//
+// 'Fl_Html_View::format_finish()' - Complete a pending incremental layout right away.
+//
+
+void
+Fl_Html_View::format_finish()
+{
+	if (fmt_->started)
+	{
+		format_step(-1, 0);
+		format_end();
+	}
+}
+
+
+//
+// 'Fl_Html_View::format_idle_cb()' - Continue a pending incremental layout in idle time.
+//
+
+void
+Fl_Html_View::format_idle_cb(void *p)	// I - Help view
+{
+	Fl_Html_View *v = (Fl_Html_View *)p;
+
+	if (v->format_step(-1, FORMAT_STEP_SIZE))
+		v->format_end();
+	else
+		v->update_scrollbars();
+
+	v->redraw();
+}
+
+
+//
+// 'Fl_Html_View::reflow_timeout_cb()' - Reflow after a deferred width change.
+//
+
+void
+Fl_Html_View::reflow_timeout_cb(void *p)	// I - Help view
+{
+	((Fl_Html_View *)p)->format();
+}
+
+
+//
+// 'Fl_Html_View::update_scrollbars()' - Update scrollbars for the current document size.
+//
+
+void
+Fl_Html_View::update_scrollbars()
+{
+	Fl_Boxtype	b = box() ? box() : FL_DOWN_BOX;
+	// Box to draw...
+
 	int dx = Fl::box_dw(b) - Fl::box_dx(b);
 	int dy = Fl::box_dh(b) - Fl::box_dy(b);
 	int ss = Fl::scrollbar_size();
@@ -2389,6 +2807,15 @@ bool Fl_Html_View::is_shared_image(Fl_Image *img) const
 
 void
 Fl_Html_View::free_data() {
+  // Stop any pending layout...
+  Fl::remove_idle(format_idle_cb, this);
+  Fl::remove_timeout(reflow_timeout_cb, this);
+
+  fmt_->started = 0;
+  fmt_->load    = 0;
+  fmt_w_        = -1;
+  dl_blocks_    = 0;
+
   // Release all images...
   if (value_) {
     const char	*ptr,		// Pointer into block
@@ -2487,6 +2914,22 @@ Fl_Html_View::free_data() {
     ntargets_ = 0;
     targets_  = 0;
   }
+
+  if (aops_) {
+    free(ops_);
+
+    aops_ = 0;
+    nops_ = 0;
+    ops_  = 0;
+  }
+
+  if (atext_) {
+    free(text_);
+
+    atext_ = 0;
+    ntext_ = 0;
+    text_  = 0;
+  }
 }
 
 //
@@ -3193,6 +3636,26 @@ Fl_Html_View::Fl_Html_View(int        xx,	// I - Left position
   ntargets_     = 0;
   targets_      = (Fl_Html_Target *)0;
 
+  aops_         = 0;
+  nops_         = 0;
+  ops_          = (Fl_Html_Op *)0;
+
+  atext_        = 0;
+  ntext_        = 0;
+  text_         = (char *)0;
+
+  dl_blocks_    = 0;
+  dl_color_     = FL_FOREGROUND_COLOR;
+  dl_pos_       = 0;
+
+  fmt_          = new Fl_Html_Format_State;
+  fmt_->started = 0;
+  fmt_->load    = 0;
+  fmt_->len     = 0;
+  fmt_w_        = -1;
+  fmt_textfont_ = 0;
+  fmt_textsize_ = 0;
+
   directory_[0] = '\0';
   filename_[0]  = '\0';
 
@@ -3229,6 +3692,7 @@ Fl_Html_View::~Fl_Html_View()
 {
   clear_selection();
   free_data();
+  delete fmt_;
 }
 
 
@@ -3358,6 +3822,20 @@ Fl_Html_View::resize(int xx,	// I - New left position
                      y() + h() - ss - Fl::box_dh(b) + Fl::box_dy(b),
                      w() - ss - Fl::box_dw(b), ss);
 
+  // Fl_Html_View mod: layout only depends on the width, reuse it if that didn't change
+  if (value_ && fmt_w_ == w() && fmt_textfont_ == textfont_ && fmt_textsize_ == textsize_) {
+    update_scrollbars();
+    return;
+  }
+
+  // Fl_Html_View mod: defer reflow of large documents until an interactive resize has settled
+  if (value_ && nblocks_ && fmt_->len > FORMAT_STEP_SIZE) {
+    Fl::remove_timeout(reflow_timeout_cb, this);
+    Fl::add_timeout(FORMAT_RESIZE_DELAY, reflow_timeout_cb, this);
+    update_scrollbars();
+    return;
+  }
+
   format();
 }
 
@@ -3373,6 +3851,9 @@ Fl_Html_View::topline(const char *n)	// I - Target name
 		*target;		// Pointer to matching target
 
 
+  // targets below the part laid out so far are still unknown
+  format_finish();
+
   if (ntargets_ == 0)
     return;
 
@@ -40,6 +40,15 @@ int Fl_Table_Row::row_selected(int row) const {
   return(_rowselect[row]);
 }
 
+// Number of selected rows
+int Fl_Table_Row::num_rows_selected() const {
+  int count = 0;
+  for ( int row=0; row<rows(); row++ ) {
+    if ( _rowselect[row] ) count++;
+  }
+  return(count);
+}
+
 // Change row selection type
 void Fl_Table_Row::type(TableRowSelectMode val) {
   _selectmode = val;
@@ -67,6 +76,7 @@ void Fl_Table_Row::type(TableRowSelectMode val) {
       break;
     }
     case SELECT_MULTI:
+    case SELECT_MULTI_PERSIST:
       break;
   }
 }
@@ -113,6 +123,7 @@ int Fl_Table_Row::select_row(int row, int flag) {
     }
 
     case SELECT_MULTI:
+    case SELECT_MULTI_PERSIST:
     {
       int oldval = _rowselect[row];
       if ( flag == 2 ) { _rowselect[row] ^= 1; }
@@ -141,6 +152,7 @@ void Fl_Table_Row::select_all_rows(int flag) {
       //FALLTHROUGH
 
     case SELECT_MULTI:
+    case SELECT_MULTI_PERSIST:
     {
       char changed = 0;
       if ( flag == 2 ) {
@@ -205,7 +217,9 @@ int Fl_Table_Row::handle(int event) {
 	    case FL_CTRL:
 			if (_selectmode != SELECT_SINGLE_PERSIST)
 			{
-				select_row(R, 2);		// toggle
+				// don't allow deselecting the last selected row
+				if (_selectmode != SELECT_MULTI_PERSIST || !row_selected(R) || num_rows_selected() > 1)
+					select_row(R, 2);		// toggle
 				break;
 			}
 			// fall through
@@ -227,7 +241,7 @@ int Fl_Table_Row::handle(int event) {
 			}
 			// fall through
 	   default:
-	     if (_selectmode == SELECT_MULTI) select_all_rows(0);	// clear all previous selections
+	     if (_selectmode == SELECT_MULTI || _selectmode == SELECT_MULTI_PERSIST) select_all_rows(0);	// clear all previous selections
 	     select_row(R, 1);
 	     break;
 	  }
@@ -273,7 +287,8 @@ int Fl_Table_Row::handle(int event) {
 	  switch ( shiftstate ) {
 	    case FL_CTRL:
 	      if (_selectmode != SELECT_SINGLE_PERSIST && R != _last_row ) {		// toggle if dragged to new row
-			  select_row(R, 2);		// 2=toggle
+			  if (_selectmode != SELECT_MULTI_PERSIST || !row_selected(R) || num_rows_selected() > 1)
+				  select_row(R, 2);		// 2=toggle
 	      }
 	      break;
 
@@ -303,7 +318,7 @@ int Fl_Table_Row::handle(int event) {
       if ( Fl::event_button() == FL_LEFT_MOUSE ) {
 	_dragging_select = 0;
 	ret = 1;			// release handled
-	if (_selectmode == SELECT_SINGLE_PERSIST)
+	if (_selectmode == SELECT_SINGLE_PERSIST || _selectmode == SELECT_MULTI_PERSIST)
 		break;
 	// Clicked off edges of data table? 
 	//    A way for user to clear the current selection.
@@ -13,12 +13,15 @@
 #include "archive.h"
 #include "os.h"
 #include "lang.h"
+#include "trace.h"
 #include <FL/fl_ask.H>
+#include <FL/filename.H>
 #include <FL/fl_utf8.h>
 #include <algorithm>
 #include <cstring>
 #include <errno.h>
 #include <fstream>
+#include <set>
 
 #include <bit7z/bitarchiveitem.hpp>
 #include <bit7z/bitarchivereader.hpp>
@@ -31,15 +34,19 @@
 #define ERR_7ZINIT()	if (ppErrMsg) *ppErrMsg = $("failed to init 7z")
 #define ERR_NOFILE()	if (ppErrMsg) *ppErrMsg = $("file not found")
 #define ERR_FWRITE()	if (ppErrMsg) *ppErrMsg = $("failed to write file")
+#define ERR_CANCEL()	if (ppErrMsg) *ppErrMsg = $("cancelled by user")
 
 
 void ShowBusyCursor(BOOL bShow);
 
-void InitProgress(int nSteps, const char *label);
-void TermProgress();
-int RunProgress();
-void SetProgress(int nStep);
-void EndProgress(int result);
+struct ProgressJob;
+ProgressJob* InitProgress(int nSteps, const char *label);
+void TermProgress(ProgressJob *job);
+int RunProgress(ProgressJob *job, BOOL *pbCancelled = NULL);
+void SetProgress(ProgressJob *job, int nStep);
+void SetProgressSize(ProgressJob *job, unsigned __int64 bytes);
+BOOL IsProgressCancelled(ProgressJob *job);
+void EndProgress(ProgressJob *job, int result);
 
 
 static bit7z::Bit7zLibrary *g_p7zLib = NULL;
@@ -60,13 +67,13 @@ public:
 
 struct ArchiveReadContext
 {
-	ArchiveReadContext(const char *name) : archname(name), archive(*g_p7zLib,name), userdata(NULL)
+	ArchiveReadContext(const char *name) : archname(name), archive(*g_p7zLib,name)
 	{
+		AddStat(STAT_ArchiveOpens);
 	}
 
 	std::string archname;
 	bit7z::BitArchiveReader archive;
-	const void *userdata;
 };
 
 struct ArchiveWriteContext
@@ -85,7 +92,7 @@ struct ArchiveWriteContext
 class ProgressCallbackHandler
 {
 public:
-	ProgressCallbackHandler(bit7z::BitAbstractArchiveHandler& h) : handler(h), totalbytes(0)
+	ProgressCallbackHandler(bit7z::BitAbstractArchiveHandler& h, ProgressJob *j) : handler(h), job(j), totalbytes(0)
 	{
 		handler.setTotalCallback(std::bind(&ProgressCallbackHandler::OnTotal, this, std::placeholders::_1));
 		handler.setProgressCallback(std::bind(&ProgressCallbackHandler::OnProgress, this, std::placeholders::_1));
@@ -101,17 +108,20 @@ private:
 	void OnTotal(uint64_t totalbytes)
 	{
 		this->totalbytes = totalbytes;
+		SetProgressSize(job, totalbytes);
 	}
 
+	// returning false makes bit7z abort the operation
 	bool OnProgress(uint64_t curbytes)
 	{
 		if (totalbytes)
-			SetProgress(static_cast<int>(static_cast<double>(curbytes) / static_cast<double>(totalbytes) * 1000.0));
+			SetProgress(job, static_cast<int>(static_cast<double>(curbytes) / static_cast<double>(totalbytes) * 1000.0));
 
-		return true;
+		return !IsProgressCancelled(job);
 	}
 
 	bit7z::BitAbstractArchiveHandler& handler;
+	ProgressJob *job;
 	uint64_t totalbytes;
 };
 
@@ -148,6 +158,21 @@ static void GetExtractErrorString(const std::error_code &err, const char *&pErrM
 static ArchiveReadContext *g_pReadArchive = NULL;
 static ArchiveWriteContext *g_pWriteArchive = NULL;
 
+// make 'archname' the cached read archive, reopening it only if a different archive is currently open (or 'nocache')
+static void OpenReadArchive(const char *archname, bool nocache = false)
+{
+	if (!nocache && g_pReadArchive && g_pReadArchive->archname == archname)
+	{
+		AddStat(STAT_ArchiveCacheHits);
+		return;
+	}
+
+	delete g_pReadArchive;
+	g_pReadArchive = NULL;
+
+	g_pReadArchive = new ArchiveReadContext(archname);
+}
+
 static bool InitArchiveLib(BOOL bSilent = FALSE)
 {
 	if (!g_p7zLib && !g_bFailed7z)
@@ -175,6 +200,11 @@ static bool InitArchiveLib(BOOL bSilent = FALSE)
 	return g_p7zLib != NULL;
 }
 
+bool InitArchiveSystem()
+{
+	return InitArchiveLib();
+}
+
 void TermArchiveSystem()
 {
 	if (g_pReadArchive)
@@ -207,6 +237,7 @@ bool IsArchiveFormatSupported(const char *ext)
 
 bool GetUnpackedArchiveSize(const char *archname, unsigned __int64 &sz, unsigned int &numfiles, bool nocache)
 {
+	TRACE_SCOPE("GetUnpackedArchiveSize", archname);
 	if ( !InitArchiveLib() )
 		return false;
 
@@ -214,13 +245,7 @@ bool GetUnpackedArchiveSize(const char *archname, unsigned __int64 &sz, unsigned
 
 	try
 	{
-		if (nocache || !g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname, nocache);
 
 		sz = g_pReadArchive->archive.size();
 		numfiles = g_pReadArchive->archive.filesCount();
@@ -233,13 +258,73 @@ bool GetUnpackedArchiveSize(const char *archname, unsigned __int64 &sz, unsigned
 	return true;
 }
 
+bool ReopenArchive(const char *archname)
+{
+	TRACE_SCOPE("ReopenArchive", archname);
+	if ( !InitArchiveLib() )
+		return false;
+
+	BUSY_CURSOR();
+
+	try
+	{
+		OpenReadArchive(archname, true);
+	}
+	catch (const bit7z::BitException& e)
+	{
+		return false;
+	}
+
+	return true;
+}
+
 int ListFilesInArchiveRoot(const char *archname, std::vector<std::string> &list, std::vector<time_t> *timestamps)
 {
 	return ListFilesInArchivePruned(archname, 0, list, timestamps);
 }
 
+// append the files in 'archive' that are within 'maxdepth' to 'list' (and their times to 'timestamps'), throws on errors
+static void ListArchiveItems(const bit7z::BitArchiveReader &archive, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps, time_t arch_ftime)
+{
+	for (const bit7z::BitArchiveItem& item : archive.items())
+	{
+		if (item.isDir() || item.isEncrypted())
+			continue;
+
+		const std::string path = item.path();
+
+		int depth = std::count(path.begin(), path.end(), '/')
+			+ std::count(path.begin(), path.end(), '\\');
+
+		if (depth > maxdepth)
+			continue;
+
+		list.push_back(path);
+
+		if (timestamps)
+		{
+			time_t tm = arch_ftime;
+
+			bit7z::BitPropVariant val = item.itemProperty(bit7z::BitProperty::MTime);
+			if (val.isFileTime())
+			{
+				tm = std::chrono::system_clock::to_time_t(val.getTimePoint());
+			}
+			else
+			{
+				val = item.itemProperty(bit7z::BitProperty::CTime);
+				if (val.isFileTime())
+					tm = std::chrono::system_clock::to_time_t(val.getTimePoint());
+			}
+
+			timestamps->push_back(tm);
+		}
+	}
+}
+
 int ListFilesInArchivePruned(const char *archname, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps)
 {
+	TRACE_SCOPE("ListFilesInArchive", archname);
 	if ( !InitArchiveLib() )
 		return -2;
 
@@ -250,13 +335,7 @@ int ListFilesInArchivePruned(const char *archname, unsigned int maxdepth, std::v
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 	}
 	catch (const bit7z::BitException& e)
 	{
@@ -265,43 +344,31 @@ int ListFilesInArchivePruned(const char *archname, unsigned int maxdepth, std::v
 
 	try
 	{
-		for (const bit7z::BitArchiveItem& item : g_pReadArchive->archive.items())
-		{
-			if (item.isDir() || item.isEncrypted())
-				continue;
-
-			const std::string path = item.path();
-
-			int depth = std::count(path.begin(), path.end(), '/')
-				+ std::count(path.begin(), path.end(), '\\');
-
-			if (depth > maxdepth)
-				continue;
+		ListArchiveItems(g_pReadArchive->archive, maxdepth, list, timestamps, arch_ftime);
+	}
+	catch (const bit7z::BitException& e)
+	{
+	}
 
-			list.push_back(path);
+	return (int) list.size();
+}
 
-			if (timestamps)
-			{
-				time_t tm = arch_ftime;
+int ListFilesInArchivePrunedMT(const char *archname, unsigned int maxdepth, std::vector<std::string> &list)
+{
+	TRACE_SCOPE("ListFilesInArchiveMT", archname);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
+		return -2;
 
-				bit7z::BitPropVariant val = item.itemProperty(bit7z::BitProperty::MTime);
-				if (val.isFileTime())
-				{
-					tm = std::chrono::system_clock::to_time_t(val.getTimePoint());
-				}
-				else
-				{
-					val = item.itemProperty(bit7z::BitProperty::CTime);
-					if (val.isFileTime())
-						tm = std::chrono::system_clock::to_time_t(val.getTimePoint());
-				}
+	try
+	{
+		ArchiveReadContext ctxt(archname);
 
-				timestamps->push_back(tm);
-			}
-		}
+		ListArchiveItems(ctxt.archive, maxdepth, list, NULL, 0);
 	}
 	catch (const bit7z::BitException& e)
 	{
+		return list.empty() ? -1 : (int) list.size();
 	}
 
 	return (int) list.size();
@@ -316,13 +383,7 @@ bool IsFileInArchive(const char *archname, const char *fname)
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 
 		return g_pReadArchive->archive.contains(fname);
 	}
@@ -334,6 +395,7 @@ bool IsFileInArchive(const char *archname, const char *fname)
 
 bool ExtractFileFromArchive(const char *archname, const char *fname, const char *destfile, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFileFromArchive", fname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -344,13 +406,7 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, const char
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 
 		const bit7z::BitInputArchive::ConstIterator it = g_pReadArchive->archive.find(fname);
 		if (it != g_pReadArchive->archive.cend())
@@ -369,6 +425,9 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, const char
 			}
 
 			fclose(f);
+
+			AddStat(STAT_FilesExtracted);
+			AddStat(STAT_BytesExtracted, buffer.size());
 		}
 		else
 		{
@@ -389,6 +448,7 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, const char
 
 bool ExtractFileFromArchive(const char *archname, const char *fname, void *&pFileData, int &nFileSize, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFileFromArchive", fname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -399,13 +459,7 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, void *&pFil
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 
 		const bit7z::BitInputArchive::ConstIterator it = g_pReadArchive->archive.find(fname);
 		if (it != g_pReadArchive->archive.cend())
@@ -423,6 +477,9 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, void *&pFil
 
 			pFileData = data;
 			nFileSize = n;
+
+			AddStat(STAT_FilesExtracted);
+			AddStat(STAT_BytesExtracted, n);
 		}
 		else
 		{
@@ -441,26 +498,376 @@ bool ExtractFileFromArchive(const char *archname, const char *fname, void *&pFil
 	return true;
 }
 
+bool ExtractFileFromArchiveMT(const char *archname, const char *fname, void *&pFileData, int &nFileSize)
+{
+	TRACE_SCOPE("ExtractFileFromArchiveMT", fname);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
+		return false;
+
+	try
+	{
+		ArchiveReadContext ctxt(archname);
+
+		const bit7z::BitInputArchive::ConstIterator it = ctxt.archive.find(fname);
+		if (it == ctxt.archive.cend())
+			return false;
+
+		bit7z::buffer_t buffer;
+		ctxt.archive.extractTo(buffer, it->index());
+
+		size_t n = buffer.size();
+		char *data = new char[n+2];
+
+		memcpy(data, reinterpret_cast<const char*>(buffer.data()), n);
+
+		data[n] = 0;
+		data[n+1] = 0;
+
+		pFileData = data;
+		nFileSize = n;
+
+		AddStat(STAT_FilesExtracted);
+		AddStat(STAT_BytesExtracted, n);
+	}
+	catch (const bit7z::BitException& e)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+static bool MatchesAnyPattern(const char *path, const std::vector<std::string> &patterns)
+{
+	for (const std::string &pattern : patterns)
+		if ( fl_filename_match(path, pattern.c_str()) )
+			return true;
+
+	return false;
+}
+
+int ExtractFilesFromArchive(const char *archname, const std::vector<std::string> &patterns, std::vector<std::string> &names, std::vector<std::string> &data, const char *tmpdir, const char **ppErrMsg)
+{
+	TRACE_SCOPE("ExtractFilesFromArchive", archname);
+	names.clear();
+	data.clear();
+
+	if ( !InitArchiveLib() )
+	{
+		ERR_7ZINIT();
+		return -1;
+	}
+
+	BUSY_CURSOR();
+
+	try
+	{
+		OpenReadArchive(archname);
+
+		std::vector<uint32_t> indices;
+
+		for (const bit7z::BitArchiveItem& item : g_pReadArchive->archive.items())
+		{
+			if (item.isDir() || item.isEncrypted())
+				continue;
+
+			const std::string path = item.path();
+
+			if ( MatchesAnyPattern(path.c_str(), patterns) )
+			{
+				indices.push_back(item.index());
+				names.push_back(path);
+			}
+		}
+
+		if ( indices.empty() )
+			return 0;
+
+		data.resize(indices.size());
+
+		// extracting a single item from a solid block decompresses the block up to that item, so with several items
+		// from a solid archive extract them all in one call to a staging dir and read them back from there
+		bool bSinglePass = false;
+		if (indices.size() > 1 && tmpdir && *tmpdir)
+		{
+			const bit7z::BitPropVariant solid = g_pReadArchive->archive.archiveProperty(bit7z::BitProperty::Solid);
+			bSinglePass = solid.isBool() && solid.getBool();
+		}
+
+		if (!bSinglePass)
+		{
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				bit7z::buffer_t buffer;
+				g_pReadArchive->archive.extractTo(buffer, indices[i]);
+
+				data[i].assign(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+			}
+		}
+		else
+		{
+			g_pReadArchive->archive.extractTo(tmpdir, indices);
+
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				const std::string fname = tmpdir + names[i];
+
+				FILE *f = fl_fopen(fname.c_str(), "rb");
+				if (!f)
+				{
+					ERR_NOFILE();
+					names.clear();
+					data.clear();
+					return -1;
+				}
+
+				char buf[16384];
+				size_t n;
+				while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+					data[i].append(buf, n);
+
+				fclose(f);
+			}
+		}
+	}
+	catch (const bit7z::BitException& e)
+	{
+		if (ppErrMsg)
+			GetExtractErrorString(e.code(), *ppErrMsg);
+
+		names.clear();
+		data.clear();
+		return -1;
+	}
+
+	uint64_t bytes = 0;
+	for (const std::string &d : data)
+		bytes += d.size();
+
+	AddStat(STAT_FilesExtracted, names.size());
+	AddStat(STAT_BytesExtracted, bytes);
+
+	return (int) names.size();
+}
+
+struct ExtractFullContext
+{
+	ArchiveReadContext *context;
+	const char *dest;
+	ProgressJob *job;
+};
+
 static void* ExtractFullThread(void *p)
 {
+	TRACE_SCOPE("ExtractFullThread");
+	ExtractFullContext &ctxt = *(ExtractFullContext*)p;
+
 	try
 	{
-		ArchiveReadContext &context = *(ArchiveReadContext*)p;
+		ctxt.context->archive.extractTo(ctxt.dest);
+
+		EndProgress(ctxt.job, 1);
+	}
+	catch (const bit7z::BitException& e)
+	{
+		EndProgress(ctxt.job, 0);
+	}
+
+	return 0;
+}
+
+// parallel extraction of non-solid archives (zip), where each item can be decompressed independently. the items are
+// split between a few workers, each extracting its share with its own archive reader
+
+#define PARALLEL_EXTRACT_MAX_THREADS	4
+#define PARALLEL_EXTRACT_MIN_FILES		16
+#define PARALLEL_EXTRACT_MIN_SIZE		(4*1024*1024)
+
+struct ExtractWorker
+{
+	ExtractWorker() : dest(NULL), job(NULL), packsize(0), curbytes(0), result(0) {}
+
+	std::string archname;
+	const char *dest;
+	ProgressJob *job;
+	std::vector<uint32_t> indices;
+	// compressed size of the assigned items, used to balance the workload
+	uint64_t packsize;
+
+	volatile uint64_t curbytes;
+	// 1 = ok, 2 = some files failed, 0 = failed
+	volatile int result;
+	std::error_code err;
+};
+
+struct ParallelExtractContext
+{
+	ParallelExtractContext() : totalbytes(0), job(NULL), result(0) {}
+
+	std::vector<ExtractWorker> workers;
+	uint64_t totalbytes;
+	// progress job or NULL if there's no progress display
+	ProgressJob *job;
+
+	int result;
+	std::error_code err;
+};
+
+// determine if 'archive' qualifies for parallel extraction and if so distribute its items among workers
+static bool PlanParallelExtract(const bit7z::BitArchiveReader &archive, const char *archname, const char *dest, ParallelExtractContext &ctxt)
+{
+	const int nThreads = std::min(GetNumCPUsOS(), PARALLEL_EXTRACT_MAX_THREADS);
+
+	if (nThreads < 2
+		|| archive.filesCount() < PARALLEL_EXTRACT_MIN_FILES
+		|| archive.size() < PARALLEL_EXTRACT_MIN_SIZE)
+		return false;
+
+	const bit7z::BitPropVariant solid = archive.archiveProperty(bit7z::BitProperty::Solid);
+	if (solid.isBool() && solid.getBool())
+		return false;
 
-		context.archive.extractTo(static_cast<const char *>(context.userdata));
+	std::vector<bit7z::BitArchiveItemInfo> items;
+	std::set<std::string> dirs;
 
-		EndProgress(1);
+	for (const bit7z::BitArchiveItemInfo& item : archive.items())
+	{
+		const std::string path = item.path();
+
+		if ( item.isDir() )
+		{
+			dirs.insert(path);
+			continue;
+		}
+
+		const std::string::size_type pos = path.find_last_of("/\\");
+		if (pos != std::string::npos)
+			dirs.insert(path.substr(0, pos));
+
+		items.push_back(item);
+	}
+
+	// largest items first, each going to the worker with the least compressed data so far
+	std::sort(items.begin(), items.end(), [](const bit7z::BitArchiveItemInfo &a, const bit7z::BitArchiveItemInfo &b)
+		{ return a.packSize() > b.packSize(); });
+
+	ctxt.workers.resize(nThreads);
+	ctxt.totalbytes = 0;
+
+	for (const bit7z::BitArchiveItemInfo& item : items)
+	{
+		ExtractWorker *w = &ctxt.workers[0];
+		for (ExtractWorker &cand : ctxt.workers)
+			if (cand.packsize < w->packsize)
+				w = &cand;
+
+		w->indices.push_back(item.index());
+		w->packsize += item.packSize();
+
+		ctxt.totalbytes += item.size();
+	}
+
+	for (ExtractWorker &w : ctxt.workers)
+	{
+		w.archname = archname;
+		w.dest = dest;
+	}
+
+	// create all dirs up front so the workers don't race each other creating them
+	std::string dir;
+	for (const std::string &d : dirs)
+	{
+		dir = dest;
+		dir += DIRSEP_STR;
+		dir += d;
+		MkDirParentsOS(dir.c_str());
+	}
+
+	return true;
+}
+
+static void* ParallelExtractWorkerThread(void *p)
+{
+	TRACE_SCOPE("ParallelExtractWorkerThread");
+	ExtractWorker &w = *(ExtractWorker*)p;
+
+	try
+	{
+		ArchiveReadContext context(w.archname.c_str());
+
+		context.archive.setProgressCallback([&w](uint64_t curbytes) { w.curbytes = curbytes; return !IsProgressCancelled(w.job); });
+		context.archive.extractTo(w.dest, w.indices);
+
+		w.result = 1;
 	}
 	catch (const bit7z::BitException& e)
 	{
-		EndProgress(0);
+		w.err = e.code();
+		w.result = e.failedFiles().empty() ? 0 : 2;
 	}
 
 	return 0;
 }
 
+static void RunParallelExtract(ParallelExtractContext &ctxt)
+{
+	SetProgressSize(ctxt.job, ctxt.totalbytes);
+
+	TaskGroupOS *group = CreateTaskGroupOS();
+
+	for (ExtractWorker &w : ctxt.workers)
+	{
+		w.job = ctxt.job;
+
+		if (w.indices.empty())
+			w.result = 1;
+		else if ( !SubmitTaskOS(group, ParallelExtractWorkerThread, &w) )
+			ParallelExtractWorkerThread(&w);
+	}
+
+	// wait for workers and report their combined progress
+	for (;;)
+	{
+		const bool bDone = WaitTaskGroupOS(group, 20);
+
+		uint64_t curbytes = 0;
+		for (const ExtractWorker &w : ctxt.workers)
+			curbytes += w.curbytes;
+
+		if (ctxt.job && ctxt.totalbytes)
+			SetProgress(ctxt.job, static_cast<int>(static_cast<double>(curbytes) / static_cast<double>(ctxt.totalbytes) * 1000.0));
+
+		if (bDone)
+			break;
+	}
+
+	DestroyTaskGroupOS(group);
+
+	ctxt.result = 1;
+
+	for (const ExtractWorker &w : ctxt.workers)
+		if (w.result != 1 && ctxt.result != 0)
+		{
+			ctxt.result = w.result;
+			ctxt.err = w.err;
+		}
+}
+
+static void* ParallelExtractThread(void *p)
+{
+	ParallelExtractContext &ctxt = *(ParallelExtractContext*)p;
+
+	RunParallelExtract(ctxt);
+
+	EndProgress(ctxt.job, ctxt.result);
+
+	return 0;
+}
+
 int ExtractFullArchive(const char *archname, const char *dest, const char *progress_label, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFullArchive", archname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -470,16 +877,11 @@ int ExtractFullArchive(const char *archname, const char *dest, const char *progr
 	BUSY_CURSOR();
 
 	int ret = 1;
+	BOOL bCancelled = FALSE;
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 
 		// make sure the leaf dir exists
 		if (fl_mkdir(dest, DEF_DIR_MODE) && errno != EEXIST)
@@ -488,27 +890,49 @@ int ExtractFullArchive(const char *archname, const char *dest, const char *progr
 			ERR_FWRITE();
 			return 0;
 		}
-	
-		if (progress_label)
+
+		ParallelExtractContext parallel;
+		if ( PlanParallelExtract(g_pReadArchive->archive, archname, dest, parallel) )
 		{
-			ProgressCallbackHandler callbackHandler(g_pReadArchive->archive);
+			if (progress_label)
+			{
+				parallel.job = InitProgress(1000 /* percentage with tenths */, progress_label);
 
-			InitProgress(1000 /* percentage with tenths */, progress_label);
+				if ( !SubmitTaskOS(NULL, ParallelExtractThread, &parallel) )
+				{
+					TermProgress(parallel.job);
+					parallel.job = NULL;
+					RunParallelExtract(parallel);
+					ret = parallel.result;
+				}
+				else
+					ret = RunProgress(parallel.job, &bCancelled);
+			}
+			else
+			{
+				RunParallelExtract(parallel);
+				ret = parallel.result;
+			}
 
-			g_pReadArchive->userdata = dest;
+			if (ret != 1 && ppErrMsg)
+				GetExtractErrorString(parallel.err, *ppErrMsg);
+		}
+		else if (progress_label)
+		{
+			ExtractFullContext ctxt = { g_pReadArchive, dest, InitProgress(1000 /* percentage with tenths */, progress_label) };
 
-			if ( !CreateThreadOS(ExtractFullThread, g_pReadArchive) )
+			ProgressCallbackHandler callbackHandler(g_pReadArchive->archive, ctxt.job);
+
+			if ( !SubmitTaskOS(NULL, ExtractFullThread, &ctxt) )
 			{
-				// if thread creation fails then do non-threaded extraction (without progress bar), shouldn't normally happen
-				TermProgress();
+				// if the thread pool can't be started then do non-threaded extraction (without progress bar), shouldn't normally happen
+				TermProgress(ctxt.job);
 				goto unthreaded_install;
 			}
 			else
 			{
-				ret = RunProgress();
+				ret = RunProgress(ctxt.job, &bCancelled);
 			}
-
-			g_pReadArchive->userdata = NULL;
 		}
 		else
 		{
@@ -516,6 +940,17 @@ int ExtractFullArchive(const char *archname, const char *dest, const char *progr
 unthreaded_install:
 			g_pReadArchive->archive.extractTo(dest);
 		}
+
+		if (bCancelled)
+		{
+			ERR_CANCEL();
+			ret = 0;
+		}
+		else if (ret == 1)
+		{
+			AddStat(STAT_FilesExtracted, g_pReadArchive->archive.filesCount());
+			AddStat(STAT_BytesExtracted, g_pReadArchive->archive.size());
+		}
 	}
 	catch (const bit7z::BitException& e)
 	{
@@ -528,24 +963,87 @@ unthreaded_install:
 	return ret;
 }
 
-bool EnumFullArchive(const char *archname, bool (*pEnumCallback)(const char*,void*), void *pCallbackData, const char **ppErrMsg)
+int ExtractFullArchiveMT(const char *archname, const char *dest, ProgressJob *job, const char **ppErrMsg)
 {
-	if ( !InitArchiveLib() )
+	TRACE_SCOPE("ExtractFullArchiveMT", archname);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
 	{
 		ERR_7ZINIT();
-		return false;
+		return 0;
 	}
 
+	int ret = 1;
+
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
+		ArchiveReadContext context(archname);
+
+		// make sure the leaf dir exists
+		if (fl_mkdir(dest, DEF_DIR_MODE) && errno != EEXIST)
 		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
+			ERR_FWRITE();
+			return 0;
+		}
+
+		ParallelExtractContext parallel;
+		if ( PlanParallelExtract(context.archive, archname, dest, parallel) )
+		{
+			parallel.job = job;
+			RunParallelExtract(parallel);
+			ret = parallel.result;
+
+			if (ret != 1 && ppErrMsg)
+				GetExtractErrorString(parallel.err, *ppErrMsg);
+		}
+		else
+		{
+			ProgressCallbackHandler callbackHandler(context.archive, job);
+
+			context.archive.extractTo(dest);
+		}
 
-			g_pReadArchive = new ArchiveReadContext(archname);
+		if ( IsProgressCancelled(job) )
+		{
+			ERR_CANCEL();
+			ret = 0;
+		}
+		else if (ret == 1)
+		{
+			AddStat(STAT_FilesExtracted, context.archive.filesCount());
+			AddStat(STAT_BytesExtracted, context.archive.size());
+		}
+	}
+	catch (const bit7z::BitException& e)
+	{
+		if ( IsProgressCancelled(job) )
+		{
+			ERR_CANCEL();
+			return 0;
 		}
 
+		if (ppErrMsg)
+			GetExtractErrorString(e.code(), *ppErrMsg);
+
+		return e.failedFiles().empty() ? 0 : 2;
+	}
+
+	return ret;
+}
+
+bool EnumFullArchive(const char *archname, bool (*pEnumCallback)(const char*,void*), void *pCallbackData, const char **ppErrMsg)
+{
+	TRACE_SCOPE("EnumFullArchive", archname);
+	if ( !InitArchiveLib() )
+	{
+		ERR_7ZINIT();
+		return false;
+	}
+
+	try
+	{
+		OpenReadArchive(archname);
+
 		for (const bit7z::BitArchiveItem& item : g_pReadArchive->archive.items())
 		{
 			if (item.isDir() || item.isEncrypted())
@@ -568,6 +1066,7 @@ bool EnumFullArchive(const char *archname, bool (*pEnumCallback)(const char*,voi
 
 bool EnumFullArchiveEx(const char *archname, bool (*pEnumCallback)(const char*,unsigned __int64,time_t,void*), void *pCallbackData, const char **ppErrMsg)
 {
+	TRACE_SCOPE("EnumFullArchive", archname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -579,13 +1078,7 @@ bool EnumFullArchiveEx(const char *archname, bool (*pEnumCallback)(const char*,u
 
 	try
 	{
-		if (!g_pReadArchive || g_pReadArchive->archname != archname)
-		{
-			delete g_pReadArchive;
-			g_pReadArchive = NULL;
-
-			g_pReadArchive = new ArchiveReadContext(archname);
-		}
+		OpenReadArchive(archname);
 
 		for (const bit7z::BitArchiveItem& item : g_pReadArchive->archive.items())
 		{
@@ -20,6 +20,10 @@
 #include <time.h>
 
 
+struct ProgressJob;
+
+// initialize archive library (otherwise done on first use), must have succeeded before ExtractFileFromArchiveMT is used
+bool InitArchiveSystem();
 void TermArchiveSystem();
 
 // check if file type is a supported archive format ('ext' is "ZIP" etc.)
@@ -28,12 +32,18 @@ bool IsArchiveFormatSupported(const char *ext);
 // get total size of unpacked files
 bool GetUnpackedArchiveSize(const char *archive, unsigned __int64 &sz, unsigned int &numfiles, bool nocache = false);
 
+// (re)open 'archive' as the cached archive even if it's the one already open, for archives that may have been
+// rewritten since (like backup archives)
+bool ReopenArchive(const char *archive);
+
 // get a list of files, fl_filename_list counterpart for archives, only looks for files in the archive root since
 // that's all we care about, optionally returns list with file timestamps (1:1 indexing with 'list')
 int ListFilesInArchiveRoot(const char *archive, std::vector<std::string> &list, std::vector<time_t> *timestamps = NULL);
 
 // generalized version of ListFilesInArchiveRoot, which looks for files while pruning at the specified depth (root being depth 0)
 int ListFilesInArchivePruned(const char *archive, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps = NULL);
+// thread safe version of the above for worker threads (without timestamps), opens its own instance of the archive
+int ListFilesInArchivePrunedMT(const char *archive, unsigned int maxdepth, std::vector<std::string> &list);
 
 // check if sepcified file exists in archive (if 'fname' contains dirs then it's assumed to use OS specific separators)
 bool IsFileInArchive(const char *archive, const char *fname);
@@ -43,11 +53,25 @@ bool ExtractFileFromArchive(const char *archive, const char *fname, const char *
 
 // extract a single file from archive to memory buffer, caller must 'delete' it
 bool ExtractFileFromArchive(const char *archive, const char *fname, void *&pFileData, int &nFileSize, const char **ppErrMsg = NULL);
+// thread safe version of the above for worker threads, opens its own instance of the archive instead of using the
+// cached one and doesn't touch the UI, caller must 'delete' the buffer
+bool ExtractFileFromArchiveMT(const char *archive, const char *fname, void *&pFileData, int &nFileSize);
+
+// extract all files matching any of the 'patterns' to memory in one go, meant for probing several small files at once
+// (patterns are fl_filename_match patterns matched against the file path using OS specific separators, so a plain
+// file name only matches that file in the archive root), solid archives are decompressed in a single pass instead
+// of once per file, for that the bit7z backend needs 'tmpdir' (an empty dir private to the call, with trailing
+// separator) to stage the files in, the staged files are left in it for the caller to remove along with the dir
+// 'names' and 'data' receive the extracted files (1:1 indexing), returns the number of files or -1 on failure
+int ExtractFilesFromArchive(const char *archive, const std::vector<std::string> &patterns, std::vector<std::string> &names, std::vector<std::string> &data, const char *tmpdir = NULL, const char **ppErrMsg = NULL);
 
 // extract archive to destination path, if the leaf dir in the dest path doesn't exist then it attempts to create it
 // if progress_label is NULL then no progress dialog will be shown
 // returns 0 on failure, 1 on success and 2 if some files failed to extract correctly
 int ExtractFullArchive(const char *archive, const char *dest, const char *progress_label = "Extracting...", const char **ppErrMsg = NULL);
+// thread safe version of the above for worker threads, opens its own instance of the archive and doesn't touch the UI,
+// progress goes to 'job' (may be NULL) and extraction stops early if the job gets cancelled
+int ExtractFullArchiveMT(const char *archive, const char *dest, ProgressJob *job, const char **ppErrMsg = NULL);
 
 // enumerate all files in archive (callback returns 'false' when it wants to stop enumeration)
 bool EnumFullArchive(const char *archive, bool (*pEnumCallback)(const char*,void*), void *pCallbackData, const char **ppErrMsg = NULL);
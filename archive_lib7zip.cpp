@@ -13,11 +13,13 @@
 #include "archive.h"
 #include "os.h"
 #include "lang.h"
+#include "trace.h"
 #include <lib7zip.h>
 #include <FL/fl_ask.H>
 #include <FL/filename.H>
 #include <FL/fl_utf8.h>
 #include <cstring>
+#include <algorithm>
 #include <stdarg.h>
 #include <errno.h>
 #ifdef _WIN32
@@ -54,21 +56,29 @@
 #define ERR_NOFILE()	if (ppErrMsg) *ppErrMsg = $("file not found")
 #define ERR_FCREATE()	if (ppErrMsg) *ppErrMsg = $("failed to create file, check write access")
 #define ERR_WRITE()		if (ppErrMsg) *ppErrMsg = $("write error, disk possibly full")
+#define ERR_CANCEL()	if (ppErrMsg) *ppErrMsg = $("cancelled by user")
 
 
 void ShowBusyCursor(BOOL bShow);
 
-void InitProgress(int nSteps, const char *label);
-void TermProgress();
-int RunProgress();
-void StepProgress(int nSteps);
-void EndProgress(int result);
+struct ProgressJob;
+ProgressJob* InitProgress(int nSteps, const char *label);
+void TermProgress(ProgressJob *job);
+int RunProgress(ProgressJob *job, BOOL *pbCancelled = NULL);
+void StepProgress(ProgressJob *job, int nSteps);
+void SetProgressSteps(ProgressJob *job, int nSteps);
+void SetProgress(ProgressJob *job, int nStep);
+void SetProgressSize(ProgressJob *job, unsigned __int64 bytes);
+BOOL IsProgressCancelled(ProgressJob *job);
+void EndProgress(ProgressJob *job, int result);
 
 static BOOL CreateAllSubDirs(char *filepath, int subdir_start, int subdir_end);
 
 
 static C7ZipLibrary *g_p7zLib = NULL;
 static int g_bFailed7z = 0;
+// serializes g_p7zLib->OpenArchive, see OpenArchive7z
+static LockOS *g_pOpenArchiveLock = NULL;
 
 
 /////////////////////////////////////////////////////////////////////
@@ -489,6 +499,8 @@ protected:
 
 	BOOL m_bWriteError;
 
+	ProgressJob *m_pJob;
+
 public:
 	FileOutStreamFactory(C7ZipArchive *pArchive, const std::string &dest, std::string &tmp, time_t arch_mtime)
 		: m_pArchive(pArchive),
@@ -496,19 +508,30 @@ public:
 		m_dest(dest),
 		m_tmp(tmp),
 		m_tmFiletimeFallback(arch_mtime),
-		m_bWriteError(FALSE)
+		m_bWriteError(FALSE),
+		m_pJob(NULL)
 	{
 	}
 
 	C7ZipArchive* GetArchive() { return m_pArchive; }
 
+	ProgressJob* GetProgressJob() { return m_pJob; }
+	void SetProgressJob(ProgressJob *job) { m_pJob = job; }
+
 	BOOL Failed() const { return m_bFailed; }
 
 	BOOL WriteError() const { return m_bWriteError; }
 
 	virtual C7ZipOutStream* GetStream(C7ZipArchiveItem * pItem)
 	{
-		StepProgress(1);
+		StepProgress(m_pJob, 1);
+
+		// cancelled by user, returning no stream aborts the extraction
+		if ( IsProgressCancelled(m_pJob) )
+		{
+			m_bFailed = TRUE;
+			return NULL;
+		}
 
 		// we don't handle dirs so return a dummy stream object (it won't actually be used for anything)
 		if ( pItem->IsDir() )
@@ -548,6 +571,55 @@ public:
 
 //
 
+// collects selected items to memory during a full extraction pass, aborts the pass once all of them are extracted
+class MemOutStreamFactory : public C7ZipOutStreamFactory
+{
+protected:
+	const std::vector<int> &m_slots;
+	std::vector<std::string> &m_data;
+	int m_nRemaining;
+
+	NullOutStream m_null;
+
+public:
+	MemOutStreamFactory(const std::vector<int> &slots, std::vector<std::string> &data)
+		: m_slots(slots),
+		m_data(data),
+		m_nRemaining((int)data.size())
+	{
+	}
+
+	BOOL Done() const { return m_nRemaining <= 0; }
+
+	virtual C7ZipOutStream* GetStream(C7ZipArchiveItem * pItem)
+	{
+		// everything we want has been extracted, returning NULL stops the pass so the rest isn't decompressed
+		if (m_nRemaining <= 0)
+			return NULL;
+
+		const unsigned int i = pItem->GetArchiveIndex();
+		if (i >= m_slots.size() || m_slots[i] < 0)
+			return &m_null;
+
+		m_nRemaining--;
+
+		std::string &s = m_data[m_slots[i]];
+		s.resize((size_t)pItem->GetSize());
+		if ( s.empty() )
+			return &m_null;
+
+		return new MemOutStream(&s[0], (int)s.size());
+	}
+
+	virtual void CloseStream(C7ZipOutStream * pStream)
+	{
+		if (pStream != &m_null)
+			delete (MemOutStream*)pStream;
+	}
+};
+
+//
+
 struct ArchiveContext
 {
 public:
@@ -563,17 +635,33 @@ public:
 // cache currently open archive so that subsequent accesses are faster
 static ArchiveContext *g_pArchive = NULL;
 
+// open 'ctxt' through the shared library object, the MT functions open their own archives on worker threads and
+// C7ZipLibrary isn't documented as thread-safe, so all opens (the main thread's included) are serialized
+static bool OpenArchive7z(ArchiveContext &ctxt)
+{
+	EnterLockOS(g_pOpenArchiveLock);
+	const bool bOk = g_p7zLib->OpenArchive(&ctxt.stream, &ctxt.pArchive) && ctxt.pArchive;
+	LeaveLockOS(g_pOpenArchiveLock);
+
+	return bOk;
+}
+
 static C7ZipArchive* OpenArchive(const char *archive, time_t *mtime = NULL)
 {
 	if (g_pArchive && g_pArchive->name == archive)
+	{
+		AddStat(STAT_ArchiveCacheHits);
 		return g_pArchive->pArchive;
+	}
 
 	if (g_pArchive)
 		delete g_pArchive;
 
 	g_pArchive = new ArchiveContext(archive);
 
-	if (!g_p7zLib->OpenArchive(&g_pArchive->stream, &g_pArchive->pArchive) || !g_pArchive->pArchive)
+	AddStat(STAT_ArchiveOpens);
+
+	if ( !OpenArchive7z(*g_pArchive) )
 	{
 		delete g_pArchive;
 		g_pArchive = NULL;
@@ -913,6 +1001,8 @@ static bool InitArchiveLib(BOOL bSilent = FALSE)
 			return false;
 		}
 
+		g_pOpenArchiveLock = CreateLockOS();
+
 		/*WStringArray extensions;
 		if ( !g_p7zLib->GetSupportedExts(extensions) )
 		{
@@ -935,6 +1025,11 @@ static bool InitArchiveLib(BOOL bSilent = FALSE)
 	return g_p7zLib != NULL;
 }
 
+bool InitArchiveSystem()
+{
+	return InitArchiveLib();
+}
+
 void TermArchiveSystem()
 {
 	ASSERT(!g_pZipOutContext);
@@ -951,6 +1046,12 @@ void TermArchiveSystem()
 		delete g_p7zLib;
 		g_p7zLib = NULL;
 	}
+
+	if (g_pOpenArchiveLock)
+	{
+		DestroyLockOS(g_pOpenArchiveLock);
+		g_pOpenArchiveLock = NULL;
+	}
 }
 
 
@@ -966,6 +1067,7 @@ bool IsArchiveFormatSupported(const char *ext)
 
 bool GetUnpackedArchiveSize(const char *archive, unsigned __int64 &sz, unsigned int &numfiles, bool nocache)
 {
+	TRACE_SCOPE("GetUnpackedArchiveSize", archive);
 	if ( !InitArchiveLib() )
 		return false;
 
@@ -1016,38 +1118,34 @@ bool GetUnpackedArchiveSize(const char *archive, unsigned __int64 &sz, unsigned
 	return ret;
 }
 
-int ListFilesInArchiveRoot(const char *archive, std::vector<std::string> &list, std::vector<time_t> *timestamps)
-{
-	return ListFilesInArchivePruned(archive, 0, list, timestamps);
-}
-
-int ListFilesInArchivePruned(const char *archive, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps)
+bool ReopenArchive(const char *archive)
 {
+	TRACE_SCOPE("ReopenArchive", archive);
 	if ( !InitArchiveLib() )
-		return -2;
+		return false;
 
 	BUSY_CURSOR();
 
-	time_t arch_ftime;
+	if (g_pArchive)
+	{
+		delete g_pArchive;
+		g_pArchive = NULL;
+	}
 
-	C7ZipArchive *pArchive = OpenArchive(archive, &arch_ftime);
-	if (!pArchive)
-		return -1;
+	return OpenArchive(archive) != NULL;
+}
 
+int ListFilesInArchiveRoot(const char *archive, std::vector<std::string> &list, std::vector<time_t> *timestamps)
+{
+	return ListFilesInArchivePruned(archive, 0, list, timestamps);
+}
+
+// append the files in 'pArchive' that are within 'maxdepth' to 'list' (and their times to 'timestamps')
+static void ListArchiveItems(C7ZipArchive *pArchive, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps, time_t arch_ftime)
+{
 	unsigned int nItems = 0;
 	pArchive->GetItemCount(&nItems);
 
-	if (!nItems)
-	{
-		CloseArchive(pArchive);
-		return 0;
-	}
-
-#ifdef _WIN32
-	// convert FILETIME to time_t
-	arch_ftime = (arch_ftime / (unsigned __int64)10000000) - (unsigned __int64)11644473600;
-#endif
-
 	std::string itempath;
 
 	for (unsigned int i=0; i<nItems; i++)
@@ -1090,12 +1188,54 @@ int ListFilesInArchivePruned(const char *archive, unsigned int maxdepth, std::ve
 			timestamps->push_back(tm);
 		}
 	}
+}
+
+int ListFilesInArchivePruned(const char *archive, unsigned int maxdepth, std::vector<std::string> &list, std::vector<time_t> *timestamps)
+{
+	TRACE_SCOPE("ListFilesInArchive", archive);
+	if ( !InitArchiveLib() )
+		return -2;
+
+	BUSY_CURSOR();
+
+	time_t arch_ftime;
+
+	C7ZipArchive *pArchive = OpenArchive(archive, &arch_ftime);
+	if (!pArchive)
+		return -1;
+
+#ifdef _WIN32
+	// convert FILETIME to time_t
+	arch_ftime = (arch_ftime / (unsigned __int64)10000000) - (unsigned __int64)11644473600;
+#endif
+
+	ListArchiveItems(pArchive, maxdepth, list, timestamps, arch_ftime);
 
 	CloseArchive(pArchive);
 
 	return list.size();
 }
 
+int ListFilesInArchivePrunedMT(const char *archive, unsigned int maxdepth, std::vector<std::string> &list)
+{
+	TRACE_SCOPE("ListFilesInArchiveMT", archive);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
+		return -2;
+
+	// private archive context, g_pArchive belongs to the main thread
+	ArchiveContext ctxt(archive);
+
+	AddStat(STAT_ArchiveOpens);
+
+	if ( !OpenArchive7z(ctxt) )
+		return -1;
+
+	ListArchiveItems(ctxt.pArchive, maxdepth, list, NULL, 0);
+
+	return list.size();
+}
+
 bool IsFileInArchive(const char *archive, const char *fname)
 {
 	if ( !InitArchiveLib() )
@@ -1116,6 +1256,7 @@ bool IsFileInArchive(const char *archive, const char *fname)
 
 bool ExtractFileFromArchive(const char *archive, const char *fname, const char *destfile, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFileFromArchive", fname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -1163,11 +1304,18 @@ bool ExtractFileFromArchive(const char *archive, const char *fname, const char *
 		return false;
 	}
 
+	if (ret)
+	{
+		AddStat(STAT_FilesExtracted);
+		AddStat(STAT_BytesExtracted, pFile->GetSize());
+	}
+
 	return ret;
 }
 
 bool ExtractFileFromArchive(const char *archive, const char *fname, void *&pFileData, int &nFileSize, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFileFromArchive", fname);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -1205,6 +1353,9 @@ bool ExtractFileFromArchive(const char *archive, const char *fname, void *&pFile
 
 		pFileData = data;
 		nFileSize = n;
+
+		AddStat(STAT_FilesExtracted);
+		AddStat(STAT_BytesExtracted, n);
 	}
 	else
 		delete[] data;
@@ -1217,19 +1368,447 @@ bool ExtractFileFromArchive(const char *archive, const char *fname, void *&pFile
 	return ret;
 }
 
+bool ExtractFileFromArchiveMT(const char *archive, const char *fname, void *&pFileData, int &nFileSize)
+{
+	TRACE_SCOPE("ExtractFileFromArchiveMT", fname);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
+		return false;
+
+	// private archive context, g_pArchive belongs to the main thread
+	ArchiveContext ctxt(archive);
+
+	AddStat(STAT_ArchiveOpens);
+
+	if ( !OpenArchive7z(ctxt) )
+		return false;
+
+	C7ZipArchiveItem *pFile = FindArchiveItem(ctxt.pArchive, fname);
+	if (!pFile)
+		return false;
+
+	int n = (int) pFile->GetSize();
+	char *data = new char[n+2];
+
+	MemOutStream memOutFile(data, n);
+
+	if ( !ctxt.pArchive->Extract(pFile, &memOutFile) )
+	{
+		delete[] data;
+		return false;
+	}
+
+	data[n] = 0;
+	data[n+1] = 0;
+
+	pFileData = data;
+	nFileSize = n;
+
+	AddStat(STAT_FilesExtracted);
+	AddStat(STAT_BytesExtracted, n);
+
+	return true;
+}
+
+int ExtractFilesFromArchive(const char *archive, const std::vector<std::string> &patterns, std::vector<std::string> &names, std::vector<std::string> &data, const char *, const char **ppErrMsg)
+{
+	TRACE_SCOPE("ExtractFilesFromArchive", archive);
+	names.clear();
+	data.clear();
+
+	if ( !InitArchiveLib() )
+	{
+		ERR_7ZINIT();
+		return -1;
+	}
+
+	BUSY_CURSOR();
+
+	C7ZipArchive *pArchive = OpenArchive(archive);
+	if (!pArchive)
+	{
+		ERR_OPENARCH();
+		return -1;
+	}
+
+	unsigned int nItems = 0;
+	pArchive->GetItemCount(&nItems);
+
+	// slot in 'names'/'data' for each archive item, -1 for items that aren't wanted
+	std::vector<int> slots(nItems, -1);
+	std::vector<C7ZipArchiveItem*> items;
+
+	for (unsigned int i=0; i<nItems; i++)
+	{
+		C7ZipArchiveItem *pArchiveItem = NULL;
+
+		if ( !pArchive->GetItemInfo(i, &pArchiveItem) )
+			continue;
+
+		if (pArchiveItem->IsDir() || pArchiveItem->IsEncrypted())
+			continue;
+
+		const std::string itempath = NarrowStrOS(pArchiveItem->GetFullPath().c_str());
+
+		for (unsigned int j=0; j<patterns.size(); j++)
+			if ( fl_filename_match(itempath.c_str(), patterns[j].c_str()) )
+			{
+				slots[i] = (int) names.size();
+				names.push_back(itempath);
+				items.push_back(pArchiveItem);
+				break;
+			}
+	}
+
+	if ( names.empty() )
+	{
+		CloseArchive(pArchive);
+		return 0;
+	}
+
+	data.resize(names.size());
+
+	// extracting a single item from a solid block decompresses the block up to that item, so with several items
+	// from a solid archive do one pass over the archive and pick out the wanted items
+	bool bSolid = false;
+	if (items.size() > 1 && !pArchive->GetBoolProperty(lib7zip::kpidSolid, bSolid))
+		bSolid = false;
+
+	bool ret = true;
+
+	if (bSolid)
+	{
+		MemOutStreamFactory factory(slots, data);
+
+		// ExtractAll reports failure when the factory aborts the pass after the last wanted item
+		ret = pArchive->ExtractAll(&factory) || factory.Done();
+	}
+	else
+	{
+		for (unsigned int i=0; i<items.size() && ret; i++)
+		{
+			std::string &s = data[i];
+			s.resize((size_t)items[i]->GetSize());
+			if ( s.empty() )
+				continue;
+
+			MemOutStream memOutFile(&s[0], (int)s.size());
+
+			ret = pArchive->Extract(items[i], &memOutFile);
+		}
+	}
+
+	if (!ret)
+	{
+		if (ppErrMsg)
+			GetExtractErrorString(pArchive->GetExtractError(), *ppErrMsg);
+
+		names.clear();
+		data.clear();
+	}
+	else
+	{
+		unsigned __int64 bytes = 0;
+		for (unsigned int i=0; i<data.size(); i++)
+			bytes += data[i].size();
+
+		AddStat(STAT_FilesExtracted, names.size());
+		AddStat(STAT_BytesExtracted, bytes);
+	}
+
+	CloseArchive(pArchive);
+
+	return ret ? (int) names.size() : -1;
+}
+
+// parallel extraction of non-solid archives (zip), where each item can be decompressed independently. the items are
+// split between a few workers, each extracting its share with its own archive instance
+
+#define PARALLEL_EXTRACT_MAX_THREADS	4
+#define PARALLEL_EXTRACT_MIN_FILES		16
+#define PARALLEL_EXTRACT_MIN_SIZE		(4*1024*1024)
+
+struct ExtractWorker
+{
+	ExtractWorker() : job(NULL), arch_ftime(0), packsize(0), curkb(0), result(0), err(lib7zip::kxerrNone), bWriteError(FALSE) {}
+
+	std::string archive;
+	// slash-terminated
+	std::string dest;
+	ProgressJob *job;
+	time_t arch_ftime;
+	std::vector<unsigned int> indices;
+	// compressed size of the assigned items, used to balance the workload
+	unsigned __int64 packsize;
+
+	// unpacked KB extracted so far
+	volatile unsigned int curkb;
+	// 1 = ok, 2 = some files failed, 0 = failed
+	volatile int result;
+	int err;
+	BOOL bWriteError;
+};
+
+struct ParallelExtractContext
+{
+	ParallelExtractContext() : totalkb(0), job(NULL), result(0), err(lib7zip::kxerrNone), bWriteError(FALSE) {}
+
+	std::vector<ExtractWorker> workers;
+	unsigned int totalkb;
+	// progress job or NULL if there's no progress display
+	ProgressJob *job;
+
+	int result;
+	int err;
+	BOOL bWriteError;
+};
+
+static bool compare_packsize(const std::pair<unsigned __int64,unsigned int> &a, const std::pair<unsigned __int64,unsigned int> &b)
+{
+	return a.first > b.first;
+}
+
+// determine if 'pArchive' qualifies for parallel extraction and if so distribute its items among workers
+static bool PlanParallelExtract(C7ZipArchive *pArchive, unsigned int nItems, const char *archive, const std::string &dest, time_t arch_ftime, ParallelExtractContext &ctxt)
+{
+	int nThreads = GetNumCPUsOS();
+	if (nThreads > PARALLEL_EXTRACT_MAX_THREADS)
+		nThreads = PARALLEL_EXTRACT_MAX_THREADS;
+
+	if (nThreads < 2 || nItems < PARALLEL_EXTRACT_MIN_FILES)
+		return false;
+
+	bool bSolid = false;
+	if (pArchive->GetBoolProperty(lib7zip::kpidSolid, bSolid) && bSolid)
+		return false;
+
+	// (compressed size, item index) of all files
+	std::vector< std::pair<unsigned __int64,unsigned int> > items;
+	items.reserve(nItems);
+
+	unsigned __int64 totalsize = 0;
+
+	for (unsigned int i=0; i<nItems; i++)
+	{
+		C7ZipArchiveItem *pArchiveItem = NULL;
+
+		if ( !pArchive->GetItemInfo(i, &pArchiveItem) )
+			continue;
+
+		if ( pArchiveItem->IsDir() )
+			continue;
+
+		// the regular path aborts on encrypted items, leave those archives to it
+		if ( pArchiveItem->IsEncrypted() )
+			return false;
+
+		unsigned __int64 packsize = 0;
+		if ( !pArchiveItem->GetUInt64Property(lib7zip::kpidPackSize, packsize) )
+			packsize = pArchiveItem->GetSize();
+
+		items.push_back( std::pair<unsigned __int64,unsigned int>(packsize, i) );
+
+		totalsize += pArchiveItem->GetSize();
+	}
+
+	if (totalsize < PARALLEL_EXTRACT_MIN_SIZE)
+		return false;
+
+	// largest items first, each going to the worker with the least compressed data so far
+	std::sort(items.begin(), items.end(), compare_packsize);
+
+	ctxt.workers.resize(nThreads);
+	ctxt.totalkb = (unsigned int)(totalsize >> 10);
+
+	for (unsigned int i=0; i<items.size(); i++)
+	{
+		ExtractWorker *w = &ctxt.workers[0];
+		for (int j=1; j<nThreads; j++)
+			if (ctxt.workers[j].packsize < w->packsize)
+				w = &ctxt.workers[j];
+
+		w->indices.push_back(items[i].second);
+		w->packsize += items[i].first;
+	}
+
+	for (int j=0; j<nThreads; j++)
+	{
+		ctxt.workers[j].archive = archive;
+		ctxt.workers[j].dest = dest;
+		ctxt.workers[j].arch_ftime = arch_ftime;
+	}
+
+	return true;
+}
+
+static void* ParallelExtractWorkerThread(void *p)
+{
+	TRACE_SCOPE("ParallelExtractWorkerThread");
+	ExtractWorker &w = *(ExtractWorker*)p;
+
+	// private archive context, g_pArchive belongs to the main thread
+	ArchiveContext ctxt(w.archive.c_str());
+
+	AddStat(STAT_ArchiveOpens);
+
+	if ( !OpenArchive7z(ctxt) )
+	{
+		w.result = 0;
+		return 0;
+	}
+
+	std::string tmp;
+	unsigned __int64 done = 0;
+	unsigned int nFailed = 0;
+
+	w.result = 1;
+
+	for (unsigned int i=0; i<w.indices.size(); i++)
+	{
+		if ( IsProgressCancelled(w.job) )
+		{
+			w.result = 0;
+			break;
+		}
+
+		C7ZipArchiveItem *pArchiveItem = NULL;
+
+		if ( !ctxt.pArchive->GetItemInfo(w.indices[i], &pArchiveItem) )
+		{
+			nFailed++;
+			continue;
+		}
+
+		FileOutStream outFile(w.dest, NarrowStrOS(pArchiveItem->GetFullPath().c_str()), tmp, pArchiveItem, w.arch_ftime);
+		if ( !outFile.IsValid() )
+		{
+			// failed to create file, same as the regular path this fails the entire extraction
+			w.result = 0;
+			break;
+		}
+
+		if ( !ctxt.pArchive->Extract(pArchiveItem, &outFile) )
+		{
+			w.err |= ctxt.pArchive->GetExtractError();
+			nFailed++;
+		}
+
+		if ( outFile.WriteError() )
+		{
+			w.bWriteError = TRUE;
+			w.result = 0;
+			break;
+		}
+
+		done += pArchiveItem->GetSize();
+		w.curkb = (unsigned int)(done >> 10);
+	}
+
+	if (w.result && nFailed)
+		w.result = (nFailed < w.indices.size()) ? 2 : 0;
+
+	return 0;
+}
+
+static void RunParallelExtract(ParallelExtractContext &ctxt)
+{
+	unsigned int i;
+
+	SetProgressSize(ctxt.job, (unsigned __int64)ctxt.totalkb << 10);
+
+	TaskGroupOS *group = CreateTaskGroupOS();
+
+	for (i=0; i<ctxt.workers.size(); i++)
+	{
+		ExtractWorker &w = ctxt.workers[i];
+		w.job = ctxt.job;
+
+		if ( w.indices.empty() )
+			w.result = 1;
+		else if ( !SubmitTaskOS(group, ParallelExtractWorkerThread, &w) )
+			ParallelExtractWorkerThread(&w);
+	}
+
+	// wait for workers and report their combined progress
+	for (;;)
+	{
+		const BOOL bDone = WaitTaskGroupOS(group, 20);
+
+		unsigned int curkb = 0;
+		for (i=0; i<ctxt.workers.size(); i++)
+			curkb += ctxt.workers[i].curkb;
+
+		if (ctxt.job && ctxt.totalkb)
+			SetProgress(ctxt.job, (int)((double)curkb / (double)ctxt.totalkb * 1000.0));
+
+		if (bDone)
+			break;
+	}
+
+	DestroyTaskGroupOS(group);
+
+	ctxt.result = 1;
+
+	for (i=0; i<ctxt.workers.size(); i++)
+	{
+		const ExtractWorker &w = ctxt.workers[i];
+
+		if (w.result != 1 && ctxt.result != 0)
+			ctxt.result = w.result;
+
+		ctxt.err |= w.err;
+
+		if (w.bWriteError)
+			ctxt.bWriteError = TRUE;
+	}
+}
+
+static void* ParallelExtractThread(void *p)
+{
+	ParallelExtractContext &ctxt = *(ParallelExtractContext*)p;
+
+	RunParallelExtract(ctxt);
+
+	EndProgress(ctxt.job, ctxt.result);
+
+	return 0;
+}
+
 static void* ExtractFullThread(void *p)
 {
+	TRACE_SCOPE("ExtractFullThread");
 	FileOutStreamFactory &factory = *(FileOutStreamFactory*)p;
 	if ( factory.GetArchive()->ExtractAll(&factory) )
-		EndProgress(1);
+		EndProgress(factory.GetProgressJob(), 1);
 	else
-		EndProgress(0);
+		EndProgress(factory.GetProgressJob(), 0);
 
 	return 0;
 }
 
+// add the files and unpacked bytes of a fully extracted archive to the stats
+static void AddFullExtractStats(C7ZipArchive *pArchive, unsigned int nItems)
+{
+	unsigned __int64 files = 0, bytes = 0;
+
+	for (unsigned int i=0; i<nItems; i++)
+	{
+		C7ZipArchiveItem *pArchiveItem = NULL;
+
+		if (pArchive->GetItemInfo(i, &pArchiveItem) && !pArchiveItem->IsDir())
+		{
+			files++;
+			bytes += pArchiveItem->GetSize();
+		}
+	}
+
+	AddStat(STAT_FilesExtracted, files);
+	AddStat(STAT_BytesExtracted, bytes);
+}
+
 int ExtractFullArchive(const char *archive, const char *dest, const char *progress_label, const char **ppErrMsg)
 {
+	TRACE_SCOPE("ExtractFullArchive", archive);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -1274,21 +1853,69 @@ int ExtractFullArchive(const char *archive, const char *dest, const char *progre
 	sdest.append(DIRSEP_STR);
 
 	int ret;
+	BOOL bCancelled = FALSE;
+
+	ParallelExtractContext parallel;
+	if ( PlanParallelExtract(pArchive, nItems, archive, sdest, arch_ftime, parallel) )
+	{
+		if (progress_label)
+		{
+			parallel.job = InitProgress(1000 /* percentage with tenths */, progress_label);
+
+			if ( !SubmitTaskOS(NULL, ParallelExtractThread, &parallel) )
+			{
+				TermProgress(parallel.job);
+				parallel.job = NULL;
+				RunParallelExtract(parallel);
+				ret = parallel.result;
+			}
+			else
+				ret = RunProgress(parallel.job, &bCancelled);
+		}
+		else
+		{
+			RunParallelExtract(parallel);
+			ret = parallel.result;
+		}
+
+		if (ret == 1 && !parallel.bWriteError)
+			AddFullExtractStats(pArchive, nItems);
+
+		CloseArchive(pArchive);
+
+		if (bCancelled)
+		{
+			ERR_CANCEL();
+			return 0;
+		}
+
+		if (parallel.bWriteError)
+		{
+			ERR_WRITE();
+			return 0;
+		}
+
+		if (ret != 1 && ppErrMsg)
+			GetExtractErrorString(parallel.err, *ppErrMsg);
+
+		return ret;
+	}
 
 	FileOutStreamFactory factory(pArchive, sdest, stmp, arch_ftime);
 
 	if (progress_label)
 	{
-		InitProgress(nItems, progress_label);
+		factory.SetProgressJob( InitProgress(nItems, progress_label) );
 
-		if ( !CreateThreadOS(ExtractFullThread, &factory) )
+		if ( !SubmitTaskOS(NULL, ExtractFullThread, &factory) )
 		{
-			// if thread creation fails then do non-threaded extraction (without progress bar), shouldn't normally happen
-			TermProgress();
+			// if the thread pool can't be started then do non-threaded extraction (without progress bar), shouldn't normally happen
+			TermProgress( factory.GetProgressJob() );
+			factory.SetProgressJob(NULL);
 			goto unthreaded_install;
 		}
 		else
-			ret = RunProgress() && !factory.Failed();
+			ret = RunProgress(factory.GetProgressJob(), &bCancelled) && !factory.Failed();
 	}
 	else
 	{
@@ -1308,8 +1935,126 @@ unthreaded_install:
 		ret = 2;
 	}
 
+	if (ret == 1 && !factory.WriteError())
+		AddFullExtractStats(pArchive, nItems);
+
 	CloseArchive(pArchive);
 
+	if (bCancelled)
+	{
+		ERR_CANCEL();
+		return 0;
+	}
+
+	if ( factory.WriteError() )
+	{
+		ERR_WRITE();
+		return 0;
+	}
+
+	return ret;
+}
+
+int ExtractFullArchiveMT(const char *archive, const char *dest, ProgressJob *job, const char **ppErrMsg)
+{
+	TRACE_SCOPE("ExtractFullArchiveMT", archive);
+	// lib must have been initialized by main thread
+	if (!g_p7zLib)
+	{
+		ERR_7ZINIT();
+		return 0;
+	}
+
+	// private archive context, g_pArchive belongs to the main thread
+	ArchiveContext ctxt(archive);
+
+	AddStat(STAT_ArchiveOpens);
+
+	if ( !OpenArchive7z(ctxt) )
+	{
+		ERR_OPENARCH();
+		return 0;
+	}
+
+	const time_t arch_ftime = ctxt.stream.GetMTime();
+
+	// make sure the leaf dir exists
+	if (fl_mkdir(dest, DEF_DIR_MODE) && errno != EEXIST)
+	{
+		ERR_WRITE();
+		return 0;
+	}
+
+	unsigned int nItems = 0;
+
+	ctxt.pArchive->GetItemCount(&nItems);
+
+	if (!nItems)
+		return 1;
+
+	std::string sdest = dest;
+	std::string stmp;
+
+	sdest.append(DIRSEP_STR);
+
+	int ret;
+
+	ParallelExtractContext parallel;
+	if ( PlanParallelExtract(ctxt.pArchive, nItems, archive, sdest, arch_ftime, parallel) )
+	{
+		parallel.job = job;
+		RunParallelExtract(parallel);
+		ret = parallel.result;
+
+		if (ret == 1 && !parallel.bWriteError)
+			AddFullExtractStats(ctxt.pArchive, nItems);
+
+		if ( IsProgressCancelled(job) )
+		{
+			ERR_CANCEL();
+			return 0;
+		}
+
+		if (parallel.bWriteError)
+		{
+			ERR_WRITE();
+			return 0;
+		}
+
+		if (ret != 1 && ppErrMsg)
+			GetExtractErrorString(parallel.err, *ppErrMsg);
+
+		return ret;
+	}
+
+	FileOutStreamFactory factory(ctxt.pArchive, sdest, stmp, arch_ftime);
+
+	// the factory steps the progress once per item
+	SetProgressSteps(job, nItems);
+	factory.SetProgressJob(job);
+
+	ret = ctxt.pArchive->ExtractAll(&factory) && !factory.Failed();
+
+	if ( IsProgressCancelled(job) )
+	{
+		ERR_CANCEL();
+		return 0;
+	}
+
+	if (!ret && ppErrMsg)
+		GetExtractErrorString(ctxt.pArchive->GetExtractError(), *ppErrMsg);
+
+	// check for partial failure (not all files failed)
+	if (ret && ctxt.pArchive->GetExtractError() != lib7zip::kxerrNone)
+	{
+		if (ppErrMsg)
+			GetExtractErrorString(ctxt.pArchive->GetExtractError(), *ppErrMsg);
+		ret = 2;
+	}
+
+	if (ret == 1 && !factory.WriteError())
+		AddFullExtractStats(ctxt.pArchive, nItems);
+
 	if ( factory.WriteError() )
 	{
 		ERR_WRITE();
@@ -1321,6 +2066,7 @@ unthreaded_install:
 
 bool EnumFullArchive(const char *archive, bool (*pEnumCallback)(const char*,void*), void *pCallbackData, const char **ppErrMsg)
 {
+	TRACE_SCOPE("EnumFullArchive", archive);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -1370,6 +2116,7 @@ bool EnumFullArchive(const char *archive, bool (*pEnumCallback)(const char*,void
 
 bool EnumFullArchiveEx(const char *archive, bool (*pEnumCallback)(const char*,unsigned __int64,time_t,void*), void *pCallbackData, const char **ppErrMsg)
 {
+	TRACE_SCOPE("EnumFullArchive", archive);
 	if ( !InitArchiveLib() )
 	{
 		ERR_7ZINIT();
@@ -12,6 +12,7 @@
 
 #include "fmsel.h"
 #include "os.h"
+#include "trace.h"
 #include "archive.h"
 #include "lang.h"
 #if defined(T3_SUPPORT) || defined(GLML_SUPPORT)
@@ -49,6 +50,7 @@
 #include <FL/Fl_Pixmap.H>
 #include <FL/Fl_Menu_Window.H>
 #include <FL/Fl_Browser_.H>
+#include <FL/Fl_Scrollbar.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <FL/Fl_Progress.H>
 #include <FL/Fl_Shared_Image.H>
@@ -75,16 +77,19 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 using std::vector;
 using std::string;
 #if defined(_MSC_VER) && _MSC_VER <= 1500
 using std::tr1::unordered_map;
+using std::tr1::unordered_set;
 using std::tr1::hash;
 using std::tr1::unordered_multimap;
 #else
 #include <list>
 using std::unordered_map;
+using std::unordered_set;
 using std::hash;
 using std::unordered_multimap;
 #endif
@@ -245,6 +250,19 @@ static BOOL g_bRunningThief3 = FALSE;
 static eFMSelReturn g_appReturn = kSelFMRet_ExitGame;
 static sFMSelectorData *g_pFMSelData = NULL;
 
+// resident mode (see SetFMSelResident), db and archive caches are kept between SelectFM calls, 'g_sResidentKey'
+// identifies the root path and game the kept db belongs to (empty if no db is kept)
+static BOOL g_bResident = FALSE;
+static string g_sResidentKey;
+
+// batch mode (see BatchFMSel), set while running headless batch commands, message boxes and progress windows are
+// replaced by output through this callback
+static void (*g_pBatchReport)(const char *msg) = NULL;
+
+// set while the install queue (see RunInstallQueue) works on an FM, messages for that FM are collected here for the
+// queue summary instead of being shown, and questions are answered like in batch mode
+static vector<string> *g_pMessageLog = NULL;
+
 #if _WIN32
 static string g_sRootPath;
 static const char *GetRootPath()
@@ -264,7 +282,11 @@ static string g_sTempDirAbs;
 
 
 static void InvalidateTagDb();
+static void SyncHotFields(const FMEntry *fm);
+static void InvalidateHotFields();
 static void RefreshFilteredDb(BOOL bUpdateListControl = TRUE, BOOL bReSortOnly = FALSE);
+static void RefreshFilteredDbAsync();
+static void CancelAsyncFilter(BOOL bRestart = TRUE);
 static void InvalidateTagFilterHash();
 static void AddTagFilter(const char *tagfilter, int op, BOOL bLoading = FALSE);
 static BOOL CleanTag(char *tag, BOOL bFilter);
@@ -272,6 +294,8 @@ const char* $tag(const char *tag);
 
 static BOOL FmFileExists(const FMEntry *fm, const char *fname);
 static BOOL FmReadFileToBuffer(const FMEntry *fm, const char *fname, char *&data, int &len);
+static void FmBeginFileBatch(const FMEntry *fm, const char **patterns, int count);
+static void FmEndFileBatch();
 
 static string Trimmed(const char *s, int leftright = 3);
 #ifdef _WIN32
@@ -291,8 +315,9 @@ static BOOL AutoScanReleaseDate(FMEntry *fm, BOOL bSkipFmIni);
 static void AutoScanReleaseDates();
 static BOOL ApplyFmIni(FMEntry *fm, BOOL bFallbackModIni = TRUE);
 static BOOL FmDelTree(FMEntry *fm);
+static BOOL DelTree(const string &path);
 static BOOL InstallFM(FMEntry *fm);
-static BOOL UninstallFM(FMEntry *fm);
+static BOOL UninstallFM(FMEntry *fm, int backup = 0);
 static void ConfigArchivePath(BOOL bStartupConfig = FALSE);
 
 static void UpdateFilterControls();
@@ -307,6 +332,7 @@ static const char* GenericHtmlTextPopup(const char *caption, const char *text, i
 static const char* GenericHtmlTextPopupFull(const char *caption, const char *html_body, int W = 800, int H = 800, BOOL scale = TRUE);
 static void ViewAbout();
 static string TextToHtml(const char *text);
+static void TextFilePopup(const char *caption, char *data, int len);
 static string GetListName(const FMEntry *fm);
 #if defined(T3_SUPPORT) || defined(GLML_SUPPORT)
 static void GetNiceNameFromGlml(FMEntry *fm);
@@ -314,12 +340,20 @@ static void GetNiceNameFromGlml(FMEntry *fm);
 
 static int DoImportBatchFmIniDialog();
 
-void InitProgress(int nSteps, const char *label);
-void TermProgress();
-int RunProgress();
-void StepProgress(int nSteps);
-void SetProgress(int nStep);
-void EndProgress(int result);
+struct ProgressJob;
+ProgressJob* InitProgress(int nSteps, const char *label);
+void TermProgress(ProgressJob *job);
+int RunProgress(ProgressJob *job, BOOL *pbCancelled = NULL);
+void SetProgressForeground(ProgressJob *job, BOOL bForeground);
+void StepProgress(ProgressJob *job, int nSteps);
+void SetProgressSteps(ProgressJob *job, int nSteps);
+void SetProgress(ProgressJob *job, int nStep);
+void SetProgressSize(ProgressJob *job, unsigned __int64 bytes);
+BOOL IsProgressCancelled(ProgressJob *job);
+void EndProgress(ProgressJob *job, int result);
+void CancelProgress(ProgressJob *job);
+BOOL IsProgressDone(ProgressJob *job);
+unsigned __int64 GetProgressBytes(ProgressJob *job);
 
 static void DoTagEditor(FMEntry *fm, int page = TABPAGE_TAGS);
 static void OnTagEdAddTag(Fl_Button *o, void *p);
@@ -411,6 +445,8 @@ enum ListColumns
 	COL_DirName,
 	COL_Archive,
 
+	COL_Thumb,
+
 	COL_NUM_COLS
 };
 
@@ -592,6 +628,24 @@ struct FMSelConfig
 	BOOL bWrapDescrEditor;
 	BOOL bWrapNotesEditor;
 
+	// show plain text info files in the built-in text viewer instead of the associated app
+	BOOL bViewTextInternally;
+
+	// show thumbnail column in FM list (applied on restart)
+	BOOL bThumbColumn;
+
+	// show FM list on startup right away and scan FM dir and archive repo in the background
+	BOOL bBackgroundScan;
+
+	// write a performance trace (fmsel_trace.json in the FM root) for each session, no UI for this, it's only meant
+	// to be enabled when investigating performance problems (can also be enabled with the FMSEL_TRACE env var)
+	BOOL bTrace;
+
+	// number of FMs installed at the same time when installing several at once (0 = automatic), and the disk
+	// throughput in MB/s above which no further installs are started (0 = no limit), no UI for these either
+	int nInstallSlots;
+	int nInstallMBps;
+
 	// optional directory for archive repository (if none is specified then archive support is disabled)
 	string archiveRepo;
 
@@ -620,6 +674,28 @@ protected:
 
 public:
 	FMSelConfig()
+	{
+		Defaults();
+	}
+
+	~FMSelConfig()
+	{
+		DestroyTagFilters();
+	}
+
+	// restore default settings (LoadDb only sets the values found in the [Config] section)
+	void Reset()
+	{
+		DestroyTagFilters();
+		lastfm.clear();
+		filtName.clear();
+		archiveRepo.clear();
+		browserApp.clear();
+		Defaults();
+	}
+
+protected:
+	void Defaults()
 	{
 		datefmt = DATEFMT_CurLocale;
 		bWindowMax = FALSE;
@@ -660,15 +736,17 @@ public:
 		bAutoRefreshFilteredDb = TRUE;
 		bWrapDescrEditor = TRUE;
 		bWrapNotesEditor = TRUE;
+		bViewTextInternally = TRUE;
+		bThumbColumn = FALSE;
+		bBackgroundScan = FALSE;
+		bTrace = FALSE;
+		nInstallSlots = 0;
+		nInstallMBps = 0;
 		bSaveNewDbEntriesWithFmIni = TRUE;
 		bRepoOK = FALSE;
 	}
 
-	~FMSelConfig()
-	{
-		DestroyTagFilters();
-	}
-
+public:
 	void OnModified()
 	{
 		g_bDbModified = TRUE;
@@ -794,7 +872,7 @@ public:
 			{
 				filtName = s;
 				OnModified();
-				RefreshFilteredDb();
+				RefreshFilteredDbAsync();
 			}
 		}
 		else
@@ -803,7 +881,7 @@ public:
 			{
 				filtName.clear();
 				OnModified();
-				RefreshFilteredDb();
+				RefreshFilteredDbAsync();
 			}
 		}
 	}
@@ -951,6 +1029,12 @@ public:
 		if (!bAutoRefreshFilteredDb) fprintf(f, "AutoRefreshList=%d\n", bAutoRefreshFilteredDb);
 		if (!bWrapDescrEditor) fprintf(f, "WrapDescrEdit=%d\n", bWrapDescrEditor);
 		if (!bWrapNotesEditor) fprintf(f, "WrapNotesEdit=%d\n", bWrapNotesEditor);
+		if (!bViewTextInternally) fprintf(f, "ViewTextInternally=%d\n", bViewTextInternally);
+		if (bThumbColumn) fprintf(f, "ThumbColumn=%d\n", bThumbColumn);
+		if (bBackgroundScan) fprintf(f, "BackgroundScan=%d\n", bBackgroundScan);
+		if (bTrace) fprintf(f, "Trace=%d\n", bTrace);
+		if (nInstallSlots) fprintf(f, "InstallSlots=%d\n", nInstallSlots);
+		if (nInstallMBps) fprintf(f, "InstallMBps=%d\n", nInstallMBps);
 		if (dwLastProcessID) fprintf(f, "LastPID=%d\n", dwLastProcessID);
 
 		return !ferror(f);
@@ -1118,6 +1202,25 @@ public:
 			bWrapDescrEditor = !!atoi(val);
 		else if ( !_stricmp(valname, "WrapNotesEdit") )
 			bWrapNotesEditor = !!atoi(val);
+		else if ( !_stricmp(valname, "ViewTextInternally") )
+			bViewTextInternally = !!atoi(val);
+		else if ( !_stricmp(valname, "ThumbColumn") )
+			bThumbColumn = !!atoi(val);
+		else if ( !_stricmp(valname, "BackgroundScan") )
+			bBackgroundScan = !!atoi(val);
+		else if ( !_stricmp(valname, "Trace") )
+			bTrace = !!atoi(val);
+		else if ( !_stricmp(valname, "InstallSlots") )
+		{
+			nInstallSlots = atoi(val);
+			if (nInstallSlots < 0) nInstallSlots = 0;
+			else if (nInstallSlots > 16) nInstallSlots = 16;
+		}
+		else if ( !_stricmp(valname, "InstallMBps") )
+		{
+			nInstallMBps = atoi(val);
+			if (nInstallMBps < 0) nInstallMBps = 0;
+		}
 		else if ( !_stricmp(valname, "LastPID") )
 			dwLastProcessID = atoi(val);
 		else
@@ -1136,6 +1239,339 @@ parse_err:
 static FMSelConfig g_cfg;
 
 
+/////////////////////////////////////////////////////////////////////
+// DB MEMORY
+
+// block based bump allocator, memory can only be released all at once
+class DbArena
+{
+	enum
+	{
+		BLOCK_SIZE = 64*1024,
+	};
+
+	vector<char*> m_blocks;
+	char *m_cur;
+	size_t m_left;
+	size_t m_used;
+	size_t m_reserved;
+
+public:
+	DbArena() : m_cur(NULL), m_left(0), m_used(0), m_reserved(0) {}
+	~DbArena() { Reset(); }
+
+	void* Alloc(size_t n)
+	{
+		// keep allocations pointer aligned
+		n = (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+		if (n > m_left)
+		{
+			const size_t blocksize = (n > BLOCK_SIZE) ? n : BLOCK_SIZE;
+			m_cur = (char*)malloc(blocksize);
+			if (!m_cur)
+			{
+				m_left = 0;
+				return NULL;
+			}
+			m_blocks.push_back(m_cur);
+			m_left = blocksize;
+			m_reserved += blocksize;
+		}
+
+		void *p = m_cur;
+		m_cur += n;
+		m_left -= n;
+		m_used += n;
+		return p;
+	}
+
+	void Reset()
+	{
+		for (int i=0; i<(int)m_blocks.size(); i++)
+			free(m_blocks[i]);
+		m_blocks.clear();
+		m_cur = NULL;
+		m_left = m_used = m_reserved = 0;
+	}
+
+	void Swap(DbArena &other)
+	{
+		m_blocks.swap(other.m_blocks);
+		std::swap(m_cur, other.m_cur);
+		std::swap(m_left, other.m_left);
+		std::swap(m_used, other.m_used);
+		std::swap(m_reserved, other.m_reserved);
+	}
+
+	size_t BytesUsed() const { return m_used; }
+	size_t BytesReserved() const { return m_reserved; }
+};
+
+// pool of fixed size objects allocated from an arena, freed objects are recycled through a free list
+// (not thread-safe, objects may only be allocated and freed by the main thread)
+class DbObjectPool
+{
+	DbArena m_arena;
+	void *m_freelist;
+	size_t m_objsize;
+	int m_count;
+
+public:
+	DbObjectPool() : m_freelist(NULL), m_objsize(0), m_count(0) {}
+
+	void* Alloc(size_t n)
+	{
+		ASSERT(!m_objsize || n == m_objsize);
+		ASSERT( IsMainThreadOS() );
+		m_objsize = n;
+		m_count++;
+
+		if (m_freelist)
+		{
+			void *p = m_freelist;
+			m_freelist = *(void**)p;
+			return p;
+		}
+
+		return m_arena.Alloc(n < sizeof(void*) ? sizeof(void*) : n);
+	}
+
+	void Free(void *p)
+	{
+		if (!p)
+			return;
+		ASSERT( IsMainThreadOS() );
+		*(void**)p = m_freelist;
+		m_freelist = p;
+		m_count--;
+	}
+
+	// release all objects (destructors must already have been called)
+	void Reset()
+	{
+		ASSERT( IsMainThreadOS() );
+		m_arena.Reset();
+		m_freelist = NULL;
+		m_count = 0;
+	}
+
+	int Count() const { return m_count; }
+	size_t BytesReserved() const { return m_arena.BytesReserved(); }
+};
+
+// pool of interned (unique and immutable) strings, for strings that are frequently duplicated across FMs
+// like tags, strings stay valid until the pool is reset (by TermDb) or rebuilt (by CompactDbStrings)
+// (not thread-safe, strings may only be interned by the main thread, worker threads must not read pooled strings
+// either since TermDb may reset the pool at any time, they have to work on copies)
+class DbStringPool
+{
+#if __cplusplus >= 201103L
+	struct StrHash
+#else
+	struct StrHash : public std::unary_function<const char*, size_t>
+#endif
+	{
+		size_t operator()(const char *s) const
+		{
+			size_t h = 2166136261U;
+			for (; *s; s++)
+				h = 16777619U * h ^ (size_t)(unsigned char)*s;
+			return h;
+		}
+	};
+
+	struct StrEq
+	{
+		bool operator()(const char *a, const char *b) const { return !strcmp(a, b); }
+	};
+
+	typedef unordered_set<const char*, StrHash, StrEq> tStrSet;
+
+	DbArena m_arena;
+	tStrSet m_strings;
+	int m_nRequests;
+	size_t m_nRequestedBytes;
+
+public:
+	DbStringPool() : m_nRequests(0), m_nRequestedBytes(0) {}
+
+	const char* Intern(const char *s)
+	{
+		ASSERT(s != NULL);
+		ASSERT( IsMainThreadOS() );
+
+		m_nRequests++;
+		const size_t len = strlen(s) + 1;
+		m_nRequestedBytes += len;
+
+		tStrSet::iterator it = m_strings.find(s);
+		if (it != m_strings.end())
+			return *it;
+
+		char *p = (char*)m_arena.Alloc(len);
+		if (!p)
+			return "";
+		memcpy(p, s, len);
+		m_strings.insert(p);
+		return p;
+	}
+
+	void Reset()
+	{
+		ASSERT( IsMainThreadOS() );
+		m_strings.clear();
+		m_arena.Reset();
+		m_nRequests = 0;
+		m_nRequestedBytes = 0;
+	}
+
+	void Swap(DbStringPool &other)
+	{
+		m_arena.Swap(other.m_arena);
+		m_strings.swap(other.m_strings);
+		std::swap(m_nRequests, other.m_nRequests);
+		std::swap(m_nRequestedBytes, other.m_nRequestedBytes);
+	}
+
+	int Count() const { return (int)m_strings.size(); }
+	int Requests() const { return m_nRequests; }
+	size_t BytesRequested() const { return m_nRequestedBytes; }
+	size_t BytesUsed() const { return m_arena.BytesUsed(); }
+	size_t BytesReserved() const { return m_arena.BytesReserved(); }
+};
+
+// storage for FMEntry objects
+static DbObjectPool g_dbEntryPool;
+// interned tag and tag category strings
+static DbStringPool g_dbStrPool;
+
+// heap for the variable length FMEntry strings (see dbstring), blocks are carved from an arena in power of two size
+// classes and recycled through a free list per class, larger blocks are allocated with malloc
+// (not thread-safe, entry strings may only be created, changed and destroyed by the main thread, worker threads have
+// to work on copies)
+class DbStringHeap
+{
+	enum
+	{
+		MIN_BLOCK_SHIFT = 4,	// smallest block is 16 bytes
+		NUM_CLASSES = 7,		// largest pooled block is 1 KB
+	};
+
+	DbArena m_arena;
+	void *m_freelist[NUM_CLASSES];
+	int m_count;
+
+	static int GetSizeClass(size_t n)
+	{
+		int c = 0;
+		while (c < NUM_CLASSES && n > ((size_t)1 << (MIN_BLOCK_SHIFT + c)))
+			c++;
+		return c;
+	}
+
+public:
+	DbStringHeap() : m_count(0) { memset(m_freelist, 0, sizeof(m_freelist)); }
+
+	void* Alloc(size_t n)
+	{
+		ASSERT( IsMainThreadOS() );
+		m_count++;
+
+		const int c = GetSizeClass(n);
+		if (c == NUM_CLASSES)
+			return malloc(n);
+
+		if (m_freelist[c])
+		{
+			void *p = m_freelist[c];
+			m_freelist[c] = *(void**)p;
+			return p;
+		}
+
+		return m_arena.Alloc((size_t)1 << (MIN_BLOCK_SHIFT + c));
+	}
+
+	void Free(void *p, size_t n)
+	{
+		if (!p)
+			return;
+		ASSERT( IsMainThreadOS() );
+		m_count--;
+
+		const int c = GetSizeClass(n);
+		if (c == NUM_CLASSES)
+		{
+			free(p);
+			return;
+		}
+
+		*(void**)p = m_freelist[c];
+		m_freelist[c] = p;
+	}
+
+	// release all pooled blocks at once (all strings must already have been destroyed)
+	void Reset()
+	{
+		ASSERT( IsMainThreadOS() );
+		m_arena.Reset();
+		memset(m_freelist, 0, sizeof(m_freelist));
+		m_count = 0;
+	}
+
+	int Count() const { return m_count; }
+	size_t BytesReserved() const { return m_arena.BytesReserved(); }
+};
+
+// storage for the strings of FMEntry objects
+static DbStringHeap g_dbStrHeap;
+
+// allocator for strings stored in FMEntry, allocates from g_dbStrHeap
+template <class T>
+class DbStrAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <class U> struct rebind { typedef DbStrAllocator<U> other; };
+
+	DbStrAllocator() {}
+	template <class U> DbStrAllocator(const DbStrAllocator<U> &) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		void *p = g_dbStrHeap.Alloc(n * sizeof(T));
+		if (!p)
+			throw std::bad_alloc();
+		return (pointer)p;
+	}
+
+	void deallocate(pointer p, size_type n) { g_dbStrHeap.Free(p, n * sizeof(T)); }
+
+	size_type max_size() const { return (size_type)-1 / sizeof(T); }
+
+	void construct(pointer p, const T &val) { new((void*)p) T(val); }
+	void destroy(pointer p) { p->~T(); }
+
+	template <class U> bool operator ==(const DbStrAllocator<U> &) const { return true; }
+	template <class U> bool operator !=(const DbStrAllocator<U> &) const { return false; }
+};
+
+// string type of the variable length FMEntry fields
+typedef std::basic_string<char, std::char_traits<char>, DbStrAllocator<char> > dbstring;
+
+static void CleanDirSlashes(dbstring &s);
+
+
 /////////////////////////////////////////////////////////////////////
 // DB
 
@@ -1153,6 +1589,121 @@ static __inline bool compare_tags(const char *a, const char *b)
 	return fl_utf_strcasecmp(a, b) < 0;
 }
 
+// incremented to invalidate all cached FM summaries (when html colors or date format change)
+static unsigned int g_nSummaryGen = 1;
+
+// incremented when db entries are deleted, so that summary prefetch results for entries that may no longer exist
+// are dropped
+static unsigned int g_nSummaryPrefetchGen = 1;
+
+static void InvalidateSummaryPrefetch()
+{
+	if (!++g_nSummaryPrefetchGen)
+		g_nSummaryPrefetchGen = 1;
+}
+
+// max number of cached FM summaries, the least recently used ones are dropped beyond that
+#define MAX_CACHED_SUMMARIES 64
+
+struct FMSummaryCache;
+
+// cached summaries, most recently used first
+static FMSummaryCache *g_pSummaryLruHead = NULL;
+static FMSummaryCache *g_pSummaryLruTail = NULL;
+static int g_nCachedSummaries = 0;
+
+// position independent part of an FM's html summary as generated by GenerateHtmlSummaryBody, cached in the FMEntry
+// so that re-opening or paging through summaries doesn't have to list and extract files from the archive again
+struct FMSummaryCache
+{
+	string html;
+	vector<string> infoList;	// info file list that the "/info/<n>" links in 'html' refer to
+	unsigned int gen;			// g_nSummaryGen when generated
+	size_t inputHash;			// SummaryInputHash when generated
+	time_t archiveMTime;		// mtime of the FM archive when generated (0 if the FM is installed)
+
+	FMEntry *fm;				// owner
+	FMSummaryCache *prev;		// LRU list links
+	FMSummaryCache *next;
+
+	FMSummaryCache(FMEntry *owner) : gen(0), inputHash(0), archiveMTime(0), fm(owner), prev(NULL), next(NULL)
+	{
+		Link();
+		g_nCachedSummaries++;
+	}
+
+	~FMSummaryCache()
+	{
+		Unlink();
+		g_nCachedSummaries--;
+	}
+
+	// move to the front of the LRU list
+	void Touch()
+	{
+		if (g_pSummaryLruHead != this)
+		{
+			Unlink();
+			Link();
+		}
+	}
+
+private:
+	void Link()
+	{
+		prev = NULL;
+		next = g_pSummaryLruHead;
+		if (next)
+			next->prev = this;
+		else
+			g_pSummaryLruTail = this;
+		g_pSummaryLruHead = this;
+	}
+
+	void Unlink()
+	{
+		if (prev)
+			prev->next = next;
+		else
+			g_pSummaryLruHead = next;
+		if (next)
+			next->prev = prev;
+		else
+			g_pSummaryLruTail = prev;
+		prev = next = NULL;
+	}
+};
+
+// incremented to invalidate all cached list rows (on db wide changes and changes to date or name format)
+static unsigned int g_nRowCacheGen = 1;
+
+static void InvalidateRowCache()
+{
+	if (!++g_nRowCacheGen)
+		g_nRowCacheGen = 1;
+}
+
+// strings and tag layout used by Fl_FM_List::draw_cell, cached in the FMEntry so that drawing the list doesn't
+// have to format any dates or names or measure and wrap tags
+struct FMRowCache
+{
+	struct TagLine
+	{
+		int start;
+		int len;
+	};
+
+	unsigned int gen;			// g_nRowCacheGen when generated
+	string name;				// GetListName
+	string lastPlayed;
+	string releaseDate;
+	unsigned char stars[5];		// imgStars index of each rating star
+
+	int tagW;					// width (and font size) that 'tagLines' were wrapped for, -1 if not wrapped yet
+	int tagFontSize;
+	vector<TagLine> tagLines;	// lines of 'tagsUI'
+};
+
 
 struct FMEntry
 {
@@ -1160,6 +1711,9 @@ struct FMEntry
 	{
 		FLAG_UnverifiedRelDate	= (1<<0),	// automatically determined release date (not quite accurate but better than nothing)
 		FLAG_NoInfoFile			= (1<<1),	// set if we have scanned this FM for info file but found none
+		FLAG_LastInstalled		= (1<<2),	// FM dir was present when db was last saved (used for the startup background scan)
+
+		FLAG_AvailUnverified	= (1<<25),	// temp flag during startup background scan, Installed/Archived flags are from db
 
 		FLAG_CachedInfoFiles	= (1<<26),	// infoFilesCache is valid
 		FLAG_ArchiveUnverified	= (1<<27),	// temp flag during loading/init that indicates that 'archive' hasn't been verified yet
@@ -1170,7 +1724,7 @@ struct FMEntry
 
 		// flags that aren't saved
 		FLAG_NoSaveMask			= FLAG_Installed|FLAG_UnmodifiedNew|FLAG_Archived|FLAG_PendingInfoFile
-									|FLAG_ArchiveUnverified|FLAG_CachedInfoFiles,
+									|FLAG_ArchiveUnverified|FLAG_CachedInfoFiles|FLAG_AvailUnverified,
 	};
 
 	enum
@@ -1186,8 +1740,8 @@ public:
 #else
 	char name[32];			// dir name (30 is max storage name len supported by resource manager in dark)
 #endif
-	string nicename;		// optional nicely formatted name displayed in list
-	string archive;			// optional archive filename
+	dbstring nicename;		// optional nicely formatted name displayed in list
+	dbstring archive;			// optional archive filename
 	unsigned int flags;
 	int status;
 	time_t tmReleaseDate;
@@ -1196,27 +1750,49 @@ public:
 	int nCompleteCount;
 	int rating;				// 0 to 10, -1 for unrated
 	int priority;			// priority level can be assigned to maintain a ranked todo list
-	string tags;			// comma separated tag list (no space after comma)
-	string notes;
-	string modexclude;		// mod/ubermod exclude paths (+ separated like the mod_path config var)
-	string infofile;		// filename of FMs info/readme
-	string descr;			// mission description/summary (unlike the info file this is handled and displayed natively)
+	dbstring tags;			// comma separated tag list (no space after comma)
+	dbstring notes;
+	dbstring modexclude;		// mod/ubermod exclude paths (+ separated like the mod_path config var)
+	dbstring infofile;		// filename of FMs info/readme
+	dbstring descr;			// mission description/summary (unlike the info file this is handled and displayed natively)
 
-	string filtername;		// lower case version of GetFriendlyName used for filtering and sorting
-	vector<const char*> taglist;// individual tags extracted from 'tags' and alphabetically sorted
-	string tagsUI;			// 'tags' pre-formatted for list control drawing
+	dbstring filtername;		// lower case version of GetFriendlyName used for filtering and sorting
+	vector<const char*> taglist;// individual tags extracted from 'tags' and alphabetically sorted (interned in g_dbStrPool)
+	dbstring tagsUI;			// 'tags' pre-formatted for list control drawing
 
-	vector<string> infoFilesCache;// cached info file list for archived FM
+	vector<dbstring> infoFilesCache;// cached info file list for archived FM
+	FMSummaryCache *summary;	// cached html summary, NULL if not generated or invalidated
+	mutable FMRowCache *rowCache;// cached list row strings, NULL if not generated or invalidated
+
+	int dbIndex;			// slot of this entry in g_db (and the filter hot-field arrays), -1 if not in db
+	int filtIndex;			// row of this entry in g_dbFiltered, only valid if 'filtGen' matches g_nFilteredGen
+	unsigned int filtGen;
 
 protected:
 	void DestroyTaglist()
 	{
-		for (int i=0; i<(int)taglist.size(); i++)
-			free((void*)taglist[i]);
+		// a pending async filter refresh result is based on the old tag list
+		CancelAsyncFilter();
+
+		// strings are owned by g_dbStrPool
 		taglist.clear();
 	}
 
 public:
+	// entries are allocated from g_dbEntryPool (all entry memory is released at once by TermDb)
+	static void* operator new(size_t n)
+	{
+		void *p = g_dbEntryPool.Alloc(n);
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	static void operator delete(void *p)
+	{
+		g_dbEntryPool.Free(p);
+	}
+
 	FMEntry()
 	{
 		memset(name, 0, sizeof(name));
@@ -1228,11 +1804,18 @@ public:
 		nCompleteCount = 0;
 		rating = -1;
 		priority = 0;
+		dbIndex = -1;
+		filtIndex = -1;
+		filtGen = 0;
+		summary = NULL;
+		rowCache = NULL;
 	}
 
 	~FMEntry()
 	{
 		DestroyTaglist();
+		DropSummary();
+		DropRowCache();
 	}
 
 	void InitName(const char *s)
@@ -1254,7 +1837,7 @@ public:
 	{
 		ASSERT(!g_cfg.archiveRepo.empty() && !archive.empty());
 
-		string s = g_cfg.archiveRepo + DIRSEP_STR + archive;
+		string s = g_cfg.archiveRepo + DIRSEP_STR + archive.c_str();
 		CleanDirSlashes(s);
 		return s;
 	}
@@ -1284,8 +1867,27 @@ public:
 
 	void OnModified()
 	{
+		// entry is about to change, discard any pending async filter refresh result
+		CancelAsyncFilter();
+
 		flags &= ~(FLAG_UnmodifiedNew|FLAG_PendingInfoFile);
 		g_bDbModified = TRUE;
+		SyncHotFields(this);
+
+		DropSummary();
+		DropRowCache();
+	}
+
+	void DropSummary()
+	{
+		delete summary;
+		summary = NULL;
+	}
+
+	void DropRowCache() const
+	{
+		delete rowCache;
+		rowCache = NULL;
 	}
 
 	void OnStart(BOOL bSetInProgress = FALSE)
@@ -1306,6 +1908,7 @@ public:
 		status = STATUS_Completed;
 		nCompleteCount++;
 		time(&tmLastCompleted);
+		SyncHotFields(this);
 	}
 
 	void SetStatus(int n)
@@ -1314,6 +1917,7 @@ public:
 		{
 			OnModified();
 			status = n;
+			SyncHotFields(this);
 		}
 	}
 
@@ -1323,6 +1927,7 @@ public:
 		{
 			OnModified();
 			rating = n;
+			SyncHotFields(this);
 		}
 	}
 
@@ -1332,6 +1937,7 @@ public:
 		{
 			OnModified();
 			priority = n;
+			SyncHotFields(this);
 		}
 	}
 
@@ -1408,14 +2014,19 @@ public:
 
 	void OnUpdateName()
 	{
+		CancelAsyncFilter();
+
 		char s[512*3];
 		tolower_utf(GetFriendlyName(), sizeof(s), s);
 		filtername = s;
+
+		DropRowCache();
 	}
 
 	void OnUpdatedTags(BOOL bOnLoad = FALSE)
 	{
 		DestroyTaglist();
+		DropRowCache();
 		tagsUI.clear();
 
 		if ( !tags.empty() )
@@ -1432,14 +2043,16 @@ public:
 					s = next + 1;
 
 					if (!bOnLoad || CleanTag(tag, FALSE))
-						taglist.push_back(tag);
+						taglist.push_back( g_dbStrPool.Intern(tag) );
+					free(tag);
 				}
 				else
 				{
 					char *tag = _strdup(s);
 
 					if (!bOnLoad || CleanTag(tag, FALSE))
-						taglist.push_back(tag);
+						taglist.push_back( g_dbStrPool.Intern(tag) );
+					free(tag);
 					break;
 				}
 			}
@@ -1464,15 +2077,15 @@ public:
 					{
 						ASSERT(localization_initialized);
 
-						// split category and tag into two strings and localize each
+						// split category and tag into two strings and localize each (tag strings are shared
+						// so they must not be modified, not even temporarily)
 						char loctag[2048];
 						const char *colon = strchr(taglist[i], ':');
-						*(char*)colon = 0;
+						const string cat(taglist[i], colon - taglist[i]);
 						if (colon[1])
-							sprintf(loctag, "%s:%s", $tag(taglist[i]), $tag(colon+1));
+							sprintf(loctag, "%s:%s", $tag(cat.c_str()), $tag(colon+1));
 						else
-							sprintf(loctag, "%s:", $tag(taglist[i]));
-						*(char*)colon = ':';
+							sprintf(loctag, "%s:", $tag(cat.c_str()));
 
 						tagsUI.append(loctag);
 					}
@@ -1612,6 +2225,16 @@ static __inline tIStrHashKey KEY(const char *s)
 	return tIStrHashKey(buf);
 }
 
+// ASCII-only case insensitive key (same as comparing with _stricmp)
+static __inline tIStrHashKey AKEY(const char *s)
+{
+	tIStrHashKey key(s);
+	for (size_t i=0; i<key.length(); i++)
+		key[i] = (char)tolower((unsigned char)key[i]);
+
+	return key;
+}
+
 // filname based key (case insensitive on Windows, otherwise case sensitive)
 #ifdef _WIN32
 #define FKEY(_x) KEY(_x)
@@ -1648,6 +2271,13 @@ static tFMHash g_dbHash;
 static tFMHash g_dbUnverifiedArchiveHash;
 
 static vector<FMEntry*> g_dbFiltered;
+// incremented every time g_dbFiltered is rebuilt, invalidating all FMEntry::filtIndex
+static unsigned int g_nFilteredGen = 1;
+
+// lookup db based on archive name without sub-dir (as returned by GetArchiveNameOnly), for archived FMs,
+// built on demand by FindFmFromArchiveNameOnly (keyed by AKEY, to match names like _stricmp)
+static tFMHash g_dbArchiveNameHash;
+static BOOL g_bArchiveNameHashValid = FALSE;
 
 // list of FM dirs that were ignored becuase they had names that dark couldn't handle (ie. too long)
 // may contain entries after calling ScanFmDir
@@ -1670,39 +2300,98 @@ static __inline FMEntry* GetFM(const char *name)
 
 static int GetDbIndex(FMEntry *fm)
 {
-	for (int i=0; i<(int)g_db.size(); i++)
-		if (g_db[i] == fm)
-			return i;
+	const int i = fm->dbIndex;
+	if (i >= 0 && i < (int)g_db.size() && g_db[i] == fm)
+		return i;
 
+	ASSERT(i == -1);
 	return -1;
 }
 
+static void AddDbEntry(FMEntry *fm, const tIStrHashKey &key)
+{
+	fm->dbIndex = (int)g_db.size();
+	g_db.push_back(fm);
+	g_dbHash[key] = fm;
+}
 
-static FMEntry* GetFMByUnverifiedArchive(const tIStrHashKey &key)
+static void RemoveDbEntries(const vector<FMEntry*> &list)
 {
-	tFMHash::iterator dataIter = g_dbUnverifiedArchiveHash.find(key);
-	if (dataIter != g_dbUnverifiedArchiveHash.end())
-		return dataIter->second;
+	int first = (int)g_db.size();
 
-	return NULL;
-}
+	for (int i=0; i<(int)list.size(); i++)
+	{
+		FMEntry *fm = list[i];
 
+		const int n = GetDbIndex(fm);
+		if (n < 0)
+			continue;
 
-static FMEntry* FindFmFromArchiveNameOnly(const char *archname)
-{
-	for (int i=0; i<(int)g_db.size(); i++)
+		g_dbHash.erase( KEY(fm->name) );
+		fm->dbIndex = -1;
+
+		if (n < first)
+			first = n;
+	}
+
+	// compact the remaining entries in one pass and fix up their slots
+	int j = first;
+	for (int i=first; i<(int)g_db.size(); i++)
 	{
 		FMEntry *fm = g_db[i];
+		if (fm->dbIndex < 0)
+			continue;
 
-		if (fm->IsArchived() && !_stricmp(fm->GetArchiveNameOnly(), archname))
-			return fm;
+		fm->dbIndex = j;
+		g_db[j++] = fm;
 	}
 
-	return NULL;
+	g_db.resize(j);
 }
 
 
-static BOOL SaveInstallInfo(FMEntry *fm, const char *path = NULL)
+static FMEntry* GetFMByUnverifiedArchive(const tIStrHashKey &key)
+{
+	tFMHash::iterator dataIter = g_dbUnverifiedArchiveHash.find(key);
+	if (dataIter != g_dbUnverifiedArchiveHash.end())
+		return dataIter->second;
+
+	return NULL;
+}
+
+
+static void InvalidateArchiveNameHash()
+{
+	g_bArchiveNameHashValid = FALSE;
+	g_dbArchiveNameHash.clear();
+}
+
+static FMEntry* FindFmFromArchiveNameOnly(const char *archname)
+{
+	if (!g_bArchiveNameHashValid)
+	{
+		for (int i=0; i<(int)g_db.size(); i++)
+		{
+			FMEntry *fm = g_db[i];
+
+			// insert() doesn't replace existing entries, so the first match in db order wins like it
+			// would with a linear search
+			if ( fm->IsArchived() )
+				g_dbArchiveNameHash.insert( tFMHash::value_type(AKEY( fm->GetArchiveNameOnly() ), fm) );
+		}
+
+		g_bArchiveNameHashValid = TRUE;
+	}
+
+	tFMHash::iterator dataIter = g_dbArchiveNameHash.find( AKEY(archname) );
+	if (dataIter != g_dbArchiveNameHash.end())
+		return dataIter->second;
+
+	return NULL;
+}
+
+
+static BOOL SaveInstallInfo(FMEntry *fm, const char *path = NULL)
 {
 	char fname[MAX_PATH_BUF];
 	int r;
@@ -1987,6 +2676,8 @@ static void GenerateArchiveInstallName(const char *name, FMEntry *fm)
 
 static void EnumFmArchive(const char *name_raw)
 {
+	TRACE_SCOPE("EnumFmArchive", name_raw);
+
 	string name = name_raw;
 	CleanDirSlashes(name);
 
@@ -1999,7 +2690,18 @@ static void EnumFmArchive(const char *name_raw)
 
 		GenerateArchiveInstallName(name.c_str(), fm);
 		fm->flags |= FMEntry::FLAG_Archived;
-		fm->archive = name;
+		fm->archive = name.c_str();
+
+		// extract the files probed below in one go, so solid archives only get decompressed once
+		const char *probe[3];
+		int nProbe = 0;
+		probe[nProbe++] = "fm.ini";
+		if (g_bRunningShock)
+			probe[nProbe++] = "mod.ini";
+#if defined(T3_SUPPORT) || defined(GLML_SUPPORT)
+		probe[nProbe++] = "*.glml";
+#endif
+		FmBeginFileBatch(fm, probe, nProbe);
 
 		ApplyFmIni(fm, g_bRunningShock);
 		AutoScanReleaseDate(fm, TRUE);
@@ -2008,24 +2710,29 @@ static void EnumFmArchive(const char *name_raw)
 		GetNiceNameFromGlml(fm);
 #endif
 
+		FmEndFileBatch();
+
 		fm->OnUpdateName();
 
-		g_db.push_back(fm);
-		g_dbHash[KEY(fm->name)] = fm;
+		AddDbEntry(fm, KEY(fm->name));
 	}
 	else
 	{
 		fm->flags |= FMEntry::FLAG_Archived;
-		fm->archive = name;
+		fm->archive = name.c_str();
 	}
 
 	fm->flags &= ~FMEntry::FLAG_ArchiveUnverified;
 }
 
-static void ScanArchiveRepo(const char *subdirname = NULL, int depth = 0)
+// list archives in repo dir and its subdirs, 'list' receives their paths relative to the repo and the optional
+// 'subdirs' the (slash-terminated) subdirs (only does file system access, so it can run on a worker thread)
+static void ListArchiveRepo(const string &repo, vector<string> &list, vector<string> *subdirs = NULL, const char *subdirname = NULL, int depth = 0)
 {
+	TRACE_SCOPE("ListArchiveRepo", subdirname);
+
 	// 'depth' is a dumb infinite recursion stopper, in case file system contains cyclic hard-links
-	if (!g_cfg.bRepoOK || depth > 99)
+	if (depth > 99)
 		return;
 
 	// recursively scan repo dir
@@ -2033,13 +2740,13 @@ static void ScanArchiveRepo(const char *subdirname = NULL, int depth = 0)
 	string sdir;
 	if (subdirname)
 	{
-		sdir = g_cfg.archiveRepo;
+		sdir = repo;
 		sdir.append("/");
 		sdir.append(subdirname);
 	}
 
 	dirent **files;
-	int nFiles = fl_filename_list(subdirname ? sdir.c_str() : g_cfg.archiveRepo.c_str(), &files, NULL);
+	int nFiles = fl_filename_list(subdirname ? sdir.c_str() : repo.c_str(), &files, NULL);
 	if (nFiles <= 0)
 		return;
 
@@ -2059,10 +2766,16 @@ static void ScanArchiveRepo(const char *subdirname = NULL, int depth = 0)
 					sdir = subdirname;
 					sdir.append(name);
 
-					ScanArchiveRepo(sdir.c_str(), depth+1);
+					if (subdirs)
+						subdirs->push_back(sdir);
+					ListArchiveRepo(repo, list, subdirs, sdir.c_str(), depth+1);
 				}
 				else
-					ScanArchiveRepo(name.c_str(), depth+1);
+				{
+					if (subdirs)
+						subdirs->push_back(name);
+					ListArchiveRepo(repo, list, subdirs, name.c_str(), depth+1);
+				}
 			}
 			else
 			{
@@ -2073,17 +2786,16 @@ static void ScanArchiveRepo(const char *subdirname = NULL, int depth = 0)
 					int k = len - 1;
 					while (k >= 0 && !isdirsep(f->d_name[k])) k--;
 					k++;
-					string name = f->d_name+k;
 
 					// prepend subdir name if inside one
 					if (!subdirname)
-						EnumFmArchive(name.c_str());
+						list.push_back(f->d_name+k);
 					else
 					{
 						sdir = subdirname;
 						sdir.append(f->d_name);
 
-						EnumFmArchive( sdir.c_str() );
+						list.push_back(sdir);
 					}
 				}
 			}
@@ -2095,6 +2807,8 @@ static void ScanArchiveRepo(const char *subdirname = NULL, int depth = 0)
 
 static void EnumFmDir(const char *name)
 {
+	TRACE_SCOPE("EnumFmDir", name);
+
 #ifdef T3_SUPPORT
 	if (strlen(name) > (size_t)(g_bRunningThief3 ? 260 : 30))
 #else
@@ -2122,8 +2836,7 @@ static void EnumFmDir(const char *name)
 
 		fm->OnUpdateName();
 
-		g_db.push_back(fm);
-		g_dbHash[key] = fm;
+		AddDbEntry(fm, key);
 	}
 	else
 		fm->flags |= FMEntry::FLAG_Installed;
@@ -2138,38 +2851,48 @@ static void EnumFmDir(const char *name)
 	}
 }
 
-static void ScanFmDir()
+// list FM dirs in the FM root (only does file system access, so it can run on a worker thread)
+static void ListFmDirs(const char *root, vector<string> &list)
 {
-	g_invalidDirs.clear();
-
-	// scan for installed FMs
+	TRACE_SCOPE("ListFmDirs");
 
 	dirent **files;
-	int nFiles = fl_filename_list(GetRootPath(), &files, NULL);
-	if (nFiles > 0)
+	int nFiles = fl_filename_list(root, &files, NULL);
+	if (nFiles <= 0)
+		return;
+
+	for (int i=0; i<nFiles; i++)
 	{
-		for (int i=0; i<nFiles; i++)
-		{
-			dirent *f = files[i];
+		dirent *f = files[i];
 
-			int len = strlen(f->d_name);
-			if (isdirsep(f->d_name[len-1]) && f->d_name[0] != '.')
-			{
-				// extract FM dir name
-				f->d_name[len-1] = 0;
-				int k = len - 2;
-				while (k >= 0 && !isdirsep(f->d_name[k])) k--;
-				k++;
-				const string name = f->d_name+k;
+		int len = strlen(f->d_name);
+		if (isdirsep(f->d_name[len-1]) && f->d_name[0] != '.')
+		{
+			// extract FM dir name
+			f->d_name[len-1] = 0;
+			int k = len - 2;
+			while (k >= 0 && !isdirsep(f->d_name[k])) k--;
+			k++;
 
-				EnumFmDir(name.c_str());
-			}
+			list.push_back(f->d_name+k);
 		}
-
-		fl_filename_free_list(&files, nFiles);
 	}
 
-	// add all non-installed db entries with archive defined to archive hash (so ScanArchiveRepo can find them)
+	fl_filename_free_list(&files, nFiles);
+}
+
+// update db with the FM dirs and archives found by ListFmDirs and ListArchiveRepo
+static void ApplyFmScan(const vector<string> &dirs, const vector<string> &archives)
+{
+	TRACE_SCOPE("ApplyFmScan");
+
+	g_invalidDirs.clear();
+
+	// installed FMs
+	for (size_t i=0; i<dirs.size(); i++)
+		EnumFmDir( dirs[i].c_str() );
+
+	// add all non-installed db entries with archive defined to archive hash (so EnumFmArchive can find them)
 	for (int i=0; i<(int)g_db.size(); i++)
 	{
 		FMEntry *fm = g_db[i];
@@ -2177,164 +2900,603 @@ static void ScanFmDir()
 			g_dbUnverifiedArchiveHash[KEY( fm->archive.c_str() )] = fm;
 	}
 
-	// scan for archived FMs
-	ScanArchiveRepo();
+	// archived FMs
+	for (size_t i=0; i<archives.size(); i++)
+		EnumFmArchive( archives[i].c_str() );
 
 	g_dbUnverifiedArchiveHash.clear();
+
+	// availability flags of many entries may have changed
+	InvalidateHotFields();
+	InvalidateArchiveNameHash();
 }
 
+// FM root and archive repo watch (see DirWatchCallback)
+static void *g_pDirWatch = NULL;
+// watched repo subdirs (the dir watch also watches the FM root and the repo dir itself)
+static vector<string> g_watchRepoSubdirs;
+static volatile BOOL g_bWatchRootChanged = FALSE;
+static volatile BOOL g_bWatchRepoChanged = FALSE;
 
-static BOOL SaveDb()
+static void StartDirWatch();
+static void StopDirWatch();
+static void RestartDirWatch();
+
+static void ScanFmDir()
 {
-	if (!g_bDbModified)
-		return TRUE;
+	TRACE_SCOPE("ScanFmDir");
+	STAT_TIME_SCOPE(STAT_FmScan);
 
-	char fname[MAX_PATH_BUF];
-	if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.ini", GetRootPath()) == -1)
-		return FALSE;
+	vector<string> dirs, archives;
 
-	char bakfname[MAX_PATH_BUF];
-	_snprintf_s(bakfname, sizeof(bakfname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.bak", GetRootPath());
+	ListFmDirs(GetRootPath(), dirs);
+	g_watchRepoSubdirs.clear();
+	if (g_cfg.bRepoOK)
+		ListArchiveRepo(g_cfg.archiveRepo, archives, &g_watchRepoSubdirs);
 
-	unlink_forced(bakfname);
-	fl_rename(fname, bakfname);
+	ApplyFmScan(dirs, archives);
+}
 
-	FILE *f = fl_fopen(fname, "w");
-	if (!f)
+// background scan of FM dir and archive repo on startup. until it's done the list shows FMs with the availability
+// they had when the db was last saved (marked by FLAG_AvailUnverified), the worker thread only lists directories,
+// the result is applied to the db on the main thread. anything that relies on the real availability of FMs
+// (install, uninstall, play etc.) must call FinishStartupScan first
+struct StartupScanJob
+{
+	string root;
+	string repo;	// empty if there's no archive repo
+
+	vector<string> dirs;
+	vector<string> archives;
+	vector<string> subdirs;	// repo subdirs
+
+	// group of the scan task, the job is deleted by the task continuation (OnStartupScanDone)
+	TaskGroupOS *group;
+};
+
+static StartupScanJob *g_pStartupScanJob = NULL;
+
+void ShowBusyCursor(BOOL bShow);
+static void ShowBadDirWarning();
+
+static void ApplyStartupScan()
+{
+	StartupScanJob *job = g_pStartupScanJob;
+	g_pStartupScanJob = NULL;
+
+	// a pending async filter refresh result is based on the old db
+	CancelAsyncFilter(FALSE);
+
+	// drop the availability assumed from db, the scan result replaces it
+	for (int i=0; i<(int)g_db.size(); i++)
 	{
-		ASSERT(FALSE);
-		fl_rename(bakfname, fname);
-		return FALSE;
+		FMEntry *fm = g_db[i];
+		if (fm->flags & FMEntry::FLAG_AvailUnverified)
+			fm->flags &= ~(FMEntry::FLAG_AvailUnverified|FMEntry::FLAG_Installed|FMEntry::FLAG_Archived);
 	}
 
-	// save config
-	fprintf(f, "[Config]\n");
-	if ( !g_cfg.Write(f) )
+	ApplyFmScan(job->dirs, job->archives);
+
+	// watch the repo subdirs that were found
+	if (job->subdirs != g_watchRepoSubdirs)
 	{
-save_failed:
-		fclose(f);
+		g_watchRepoSubdirs.swap(job->subdirs);
+		if (g_pDirWatch)
+			RestartDirWatch();
+	}
 
-		ASSERT(FALSE);
+	// refresh list with the changes, keeping the selection
+	RefreshFilteredDb();
 
-		// remove faulty file and restore backup
-		unlink_forced(fname);
-		fl_rename(bakfname, fname);
+	ShowBadDirWarning();
+}
+
+// called in main thread (as task continuation) when the scan has finished, unless FinishStartupScan already
+// applied or discarded it
+static void OnStartupScanDone(void *p)
+{
+	StartupScanJob *job = (StartupScanJob*)p;
+
+	if (job == g_pStartupScanJob)
+		ApplyStartupScan();
+
+	DestroyTaskGroupOS(job->group);
+	delete job;
+}
+
+static void* StartupScanThread(void *p)
+{
+	TRACE_SCOPE("StartupScan");
+	STAT_TIME_SCOPE(STAT_FmScan);
+
+	StartupScanJob *job = (StartupScanJob*)p;
+
+	ListFmDirs(job->root.c_str(), job->dirs);
+	if ( !job->repo.empty() )
+		ListArchiveRepo(job->repo, job->archives, &job->subdirs);
+
+	return 0;
+}
+
+// start background scan, returns FALSE if that failed and a regular ScanFmDir has to be done instead
+static BOOL BeginStartupScan()
+{
+	StartupScanJob *job = new StartupScanJob;
+	job->root = GetRootPath();
+	if (g_cfg.bRepoOK)
+		job->repo = g_cfg.archiveRepo;
+	job->group = CreateTaskGroupOS();
 
+	if ( !SubmitTaskOS(job->group, StartupScanThread, job, OnStartupScanDone) )
+	{
+		DestroyTaskGroupOS(job->group);
+		delete job;
 		return FALSE;
 	}
-	fprintf(f, "\n");
 
-	// save db
-	for (unsigned int i=0; i<g_db.size(); i++)
+	g_pStartupScanJob = job;
+
+	// assume FMs are still available as they were when the db was saved
+	for (int i=0; i<(int)g_db.size(); i++)
 	{
 		FMEntry *fm = g_db[i];
 
-		if (fm->flags & FMEntry::FLAG_UnmodifiedNew)
-			continue;
+		unsigned int f = 0;
+		if (fm->flags & FMEntry::FLAG_LastInstalled)
+			f |= FMEntry::FLAG_Installed;
+		if (g_cfg.bRepoOK && !fm->archive.empty())
+			f |= FMEntry::FLAG_Archived;
 
-		fprintf(f, "[FM=%s]\n", fm->name);
+		if (f)
+			fm->flags |= f | FMEntry::FLAG_AvailUnverified;
+	}
 
-		if ( !fm->Write(f) )
-			goto save_failed;
+	InvalidateHotFields();
 
-		if (fprintf(f, "\n") <= 0)
-			goto save_failed;
-	}
+	return TRUE;
+}
 
-	fclose(f);
+// wait for a pending background scan and apply it (or discard it if bApply is FALSE)
+static void FinishStartupScan(BOOL bApply = TRUE)
+{
+	if (!g_pStartupScanJob)
+		return;
 
-	g_bDbModified = FALSE;
+	if ( !WaitTaskGroupOS(g_pStartupScanJob->group, 0) )
+	{
+		ShowBusyCursor(TRUE);
 
-	return TRUE;
+		JoinTaskGroupOS(g_pStartupScanJob->group);
+
+		ShowBusyCursor(FALSE);
+	}
+
+	// (the job itself is deleted by the continuation)
+	if (bApply)
+		ApplyStartupScan();
+	else
+		g_pStartupScanJob = NULL;
 }
 
-static BOOL LoadDb()
+
+// watch FM root and archive repo for FMs being added/removed while the selector is open (like archives dropped into
+// the repo by a download tool), changes are applied incrementally, only new dirs/archives get enumerated. the watch
+// callback only sets a flag, everything else is done on the main thread once there haven't been any new changes for
+// DIR_WATCH_DELAY secs (and no modal dialog, like an install in progress, is open)
+
+#define DIR_WATCH_DELAY 1.0
+// don't pick up archives modified more recently than this (may still be in the process of being written)
+#define DIR_WATCH_MIN_ARCHIVE_AGE 2
+
+// update installed state of FMs from the current FM root contents, returns TRUE if anything changed
+static BOOL UpdateInstalledFms()
 {
-	g_db.reserve(2048);
+	vector<string> dirs;
+	ListFmDirs(GetRootPath(), dirs);
 
-	char fname[MAX_PATH_BUF];
-	if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.ini", GetRootPath()) == -1)
-		return FALSE;
+	tFMHash gone;
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		FMEntry *fm = g_db[i];
+		if ( fm->IsInstalled() )
+			gone[KEY(fm->name)] = fm;
+	}
 
-	FILE *f = fl_fopen(fname, "r");
-	if (!f)
-		return 2;
+	BOOL bChanged = FALSE;
 
-	char line[8192];
-	int state = 0;
-	FMEntry *fm = NULL;
+	// EnumFmDir adds new FMs with an unverified archive to g_dbUnverifiedArchiveHash, those entries are only
+	// needed by a full scan (UpdateArchivedFms gathers its own), so they're kept apart from the rest of the hash
+	tFMHash unverified;
+	unverified.swap(g_dbUnverifiedArchiveHash);
 
-	for (;;)
+	for (size_t i=0; i<dirs.size(); i++)
 	{
-		if ( !fgets(line, sizeof(line)-1, f) )
-			break;
+		const tIStrHashKey key = KEY( dirs[i].c_str() );
+		if ( gone.erase(key) )
+			continue;
 
-		line[sizeof(line)-1] = 0;
-		int len = strlen(line);
-		while (len && isspace_(line[len-1]))
+		// ignored dir that was already reported
+		if (std::find(g_invalidDirs.begin(), g_invalidDirs.end(), dirs[i]) != g_invalidDirs.end())
+			continue;
+
+		if (!bChanged)
 		{
-			len--;
-			line[len] = 0;
+			CancelAsyncFilter(FALSE);
+			bChanged = TRUE;
 		}
 
-		if (!len)
-			continue;
+		EnumFmDir( dirs[i].c_str() );
+	}
 
-		char *s = line;
-		while ( isspace_(*s) )
+	g_dbUnverifiedArchiveHash.swap(unverified);
+
+	// FM dirs that were removed
+	for (tFMHash::iterator it=gone.begin(); it!=gone.end(); ++it)
+	{
+		if (!bChanged)
 		{
-			s++;
-			len--;
+			CancelAsyncFilter(FALSE);
+			bChanged = TRUE;
 		}
 
-		ASSERT(len > 0);
+		it->second->flags &= ~FMEntry::FLAG_Installed;
+	}
 
-		if (*s == ';')
+	return bChanged;
+}
+
+// update archived state of FMs from the current archive repo contents, returns TRUE if anything changed, 'bRetry'
+// is set to TRUE if there are new archives that have to be checked again later
+static BOOL UpdateArchivedFms(BOOL &bRetry)
+{
+	vector<string> archives, subdirs;
+	ListArchiveRepo(g_cfg.archiveRepo, archives, &subdirs);
+
+	tFMHash gone;
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		FMEntry *fm = g_db[i];
+		if ( fm->IsArchived() )
+			gone[KEY( fm->archive.c_str() )] = fm;
+	}
+
+	const time_t tmNow = time(NULL);
+
+	BOOL bChanged = FALSE;
+
+	// the unverified archive entries gathered below are only for this update, the rest of the hash is left alone
+	tFMHash unverified;
+	unverified.swap(g_dbUnverifiedArchiveHash);
+
+	for (size_t i=0; i<archives.size(); i++)
+	{
+		string name = archives[i];
+		CleanDirSlashes(name);
+
+		if ( gone.erase(KEY( name.c_str() )) )
 			continue;
 
-		if (state)
+		// skip archives that may still be being written
+		time_t tm;
+		const string fname = g_cfg.archiveRepo + DIRSEP_STR + name;
+		if (GetFileMTimeOS(fname.c_str(), tm) && tmNow - tm < DIR_WATCH_MIN_ARCHIVE_AGE)
 		{
-			if (*s == '[')
-			{
-				fm = NULL;
-				goto new_block;
-			}
+			bRetry = TRUE;
+			continue;
+		}
 
-			char *q = strchr(s, '=');
-			if (!q)
+		if (!bChanged)
+		{
+			CancelAsyncFilter(FALSE);
+			bChanged = TRUE;
+
+			// add all db entries with unverified archive to archive hash (so EnumFmArchive can find them)
+			for (int j=0; j<(int)g_db.size(); j++)
 			{
-				TRACE("parse error, unknown token: %s", s);
-				ASSERT(FALSE);
-				continue;
+				FMEntry *fm = g_db[j];
+				if (fm->flags & FMEntry::FLAG_ArchiveUnverified)
+					g_dbUnverifiedArchiveHash[KEY( fm->archive.c_str() )] = fm;
 			}
+		}
 
-			if (!q[1])
-				continue;
+		EnumFmArchive( archives[i].c_str() );
+	}
 
-			*q = 0;
-			char *val = q + 1;
+	g_dbUnverifiedArchiveHash.swap(unverified);
 
-			if (state == 1)
-			{
-				// [Config]
-				g_cfg.ParseVal(s, val);
-			}
-			else //if (state == 2)
-			{
-				// [FM=...]
-				ASSERT(fm != NULL);
-				fm->ParseVal(s, val);
-			}
-		}
-		else
+	// archives that were removed
+	for (tFMHash::iterator it=gone.begin(); it!=gone.end(); ++it)
+	{
+		if (!bChanged)
 		{
-new_block:
-			if ( !_stricmp(s, "[Config]") )
-			{
-				state = 1;
-			}
-			else if ( !_strnicmp(s, "[FM=", 4) )
-			{
+			CancelAsyncFilter(FALSE);
+			bChanged = TRUE;
+		}
+
+		// (archive field is kept, so the entry is found again if the archive comes back)
+		it->second->flags &= ~FMEntry::FLAG_Archived;
+		it->second->flags |= FMEntry::FLAG_ArchiveUnverified;
+	}
+
+	// watch new subdirs too
+	if (subdirs != g_watchRepoSubdirs)
+	{
+		g_watchRepoSubdirs = subdirs;
+		RestartDirWatch();
+	}
+
+	return bChanged;
+}
+
+static void ApplyDirWatchChanges(void *)
+{
+	if (!g_pDirWatch)
+		return;
+
+	// try again later if it's not a good time
+	if (Fl::modal() || g_pStartupScanJob)
+	{
+		Fl::add_timeout(DIR_WATCH_DELAY, ApplyDirWatchChanges);
+		return;
+	}
+
+	BOOL bChanged = FALSE;
+	BOOL bRetry = FALSE;
+
+	// (flags are cleared before listing, so changes during the listing aren't lost)
+	if (g_bWatchRootChanged)
+	{
+		g_bWatchRootChanged = FALSE;
+		if ( UpdateInstalledFms() )
+			bChanged = TRUE;
+	}
+
+	if (g_bWatchRepoChanged && g_cfg.bRepoOK)
+	{
+		g_bWatchRepoChanged = FALSE;
+		if ( UpdateArchivedFms(bRetry) )
+			bChanged = TRUE;
+	}
+
+	if (bRetry)
+	{
+		g_bWatchRepoChanged = TRUE;
+		Fl::add_timeout(DIR_WATCH_DELAY, ApplyDirWatchChanges);
+	}
+
+	if (bChanged)
+	{
+		InvalidateHotFields();
+		InvalidateArchiveNameHash();
+
+		RefreshFilteredDb();
+		RedrawListControl(TRUE);
+	}
+}
+
+static void OnDirWatchChange(void *)
+{
+	// restart delay on every change
+	Fl::remove_timeout(ApplyDirWatchChanges);
+	Fl::add_timeout(DIR_WATCH_DELAY, ApplyDirWatchChanges);
+}
+
+static void DirWatchCallback(void *, int index)
+{
+	// (called from watch thread)
+
+	volatile BOOL &bChanged = index ? g_bWatchRepoChanged : g_bWatchRootChanged;
+	bChanged = TRUE;
+
+	Fl::awake(OnDirWatchChange, NULL);
+}
+
+static void StartDirWatch()
+{
+	vector<string> dirs;
+	dirs.push_back( GetRootPath() );
+	if (g_cfg.bRepoOK)
+	{
+		dirs.push_back(g_cfg.archiveRepo);
+		for (size_t i=0; i<g_watchRepoSubdirs.size(); i++)
+			dirs.push_back(g_cfg.archiveRepo + DIRSEP_STR + g_watchRepoSubdirs[i]);
+	}
+
+	g_pDirWatch = StartDirWatchOS(dirs, DirWatchCallback, NULL);
+}
+
+static void StopDirWatch()
+{
+	if (!g_pDirWatch)
+		return;
+
+	StopDirWatchOS(g_pDirWatch);
+	g_pDirWatch = NULL;
+
+	Fl::remove_timeout(ApplyDirWatchChanges);
+}
+
+// restart the watch with the current set of dirs, changes made while no watch was active (and ones still waiting
+// for DIR_WATCH_DELAY) would be missed, so everything is rescanned once
+static void RestartDirWatch()
+{
+	StopDirWatch();
+	StartDirWatch();
+
+	g_bWatchRootChanged = TRUE;
+	g_bWatchRepoChanged = TRUE;
+	OnDirWatchChange(NULL);
+}
+
+
+static BOOL SaveDb()
+{
+	TRACE_SCOPE("SaveDb");
+	STAT_TIME_SCOPE(STAT_DbSave);
+
+	// remember which FMs are installed, so the list can be shown before the FM dir is scanned on next startup
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		FMEntry *fm = g_db[i];
+		if (!fm->IsInstalled() != !(fm->flags & FMEntry::FLAG_LastInstalled))
+		{
+			fm->flags ^= FMEntry::FLAG_LastInstalled;
+			g_bDbModified = TRUE;
+		}
+	}
+
+	if (!g_bDbModified)
+		return TRUE;
+
+	char fname[MAX_PATH_BUF];
+	if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.ini", GetRootPath()) == -1)
+		return FALSE;
+
+	char bakfname[MAX_PATH_BUF];
+	_snprintf_s(bakfname, sizeof(bakfname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.bak", GetRootPath());
+
+	unlink_forced(bakfname);
+	fl_rename(fname, bakfname);
+
+	FILE *f = fl_fopen(fname, "w");
+	if (!f)
+	{
+		ASSERT(FALSE);
+		fl_rename(bakfname, fname);
+		return FALSE;
+	}
+
+	// save config
+	fprintf(f, "[Config]\n");
+	if ( !g_cfg.Write(f) )
+	{
+save_failed:
+		fclose(f);
+
+		ASSERT(FALSE);
+
+		// remove faulty file and restore backup
+		unlink_forced(fname);
+		fl_rename(bakfname, fname);
+
+		return FALSE;
+	}
+	fprintf(f, "\n");
+
+	// save db
+	for (unsigned int i=0; i<g_db.size(); i++)
+	{
+		FMEntry *fm = g_db[i];
+
+		if (fm->flags & FMEntry::FLAG_UnmodifiedNew)
+			continue;
+
+		fprintf(f, "[FM=%s]\n", fm->name);
+
+		if ( !fm->Write(f) )
+			goto save_failed;
+
+		if (fprintf(f, "\n") <= 0)
+			goto save_failed;
+	}
+
+	fclose(f);
+
+	g_bDbModified = FALSE;
+
+	return TRUE;
+}
+
+static BOOL LoadDb()
+{
+	TRACE_SCOPE("LoadDb");
+	STAT_TIME_SCOPE(STAT_DbLoad);
+
+	g_db.reserve(2048);
+
+	char fname[MAX_PATH_BUF];
+	if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "fmsel.ini", GetRootPath()) == -1)
+		return FALSE;
+
+	FILE *f = fl_fopen(fname, "r");
+	if (!f)
+		return 2;
+
+	char line[8192];
+	int state = 0;
+	FMEntry *fm = NULL;
+
+	for (;;)
+	{
+		if ( !fgets(line, sizeof(line)-1, f) )
+			break;
+
+		line[sizeof(line)-1] = 0;
+		int len = strlen(line);
+		while (len && isspace_(line[len-1]))
+		{
+			len--;
+			line[len] = 0;
+		}
+
+		if (!len)
+			continue;
+
+		char *s = line;
+		while ( isspace_(*s) )
+		{
+			s++;
+			len--;
+		}
+
+		ASSERT(len > 0);
+
+		if (*s == ';')
+			continue;
+
+		if (state)
+		{
+			if (*s == '[')
+			{
+				fm = NULL;
+				goto new_block;
+			}
+
+			char *q = strchr(s, '=');
+			if (!q)
+			{
+				TRACE("parse error, unknown token: %s", s);
+				ASSERT(FALSE);
+				continue;
+			}
+
+			if (!q[1])
+				continue;
+
+			*q = 0;
+			char *val = q + 1;
+
+			if (state == 1)
+			{
+				// [Config]
+				g_cfg.ParseVal(s, val);
+			}
+			else //if (state == 2)
+			{
+				// [FM=...]
+				ASSERT(fm != NULL);
+				fm->ParseVal(s, val);
+			}
+		}
+		else
+		{
+new_block:
+			if ( !_stricmp(s, "[Config]") )
+			{
+				state = 1;
+			}
+			else if ( !_strnicmp(s, "[FM=", 4) )
+			{
 				if (s[len-1] != ']')
 				{
 					TRACE("parse error, unknown token: %s", s);
@@ -2367,8 +3529,7 @@ new_block:
 				fm = new FMEntry;
 				fm->InitName(s+4);
 				fm->flags &= ~FMEntry::FLAG_UnmodifiedNew;
-				g_db.push_back(fm);
-				g_dbHash[KEY(fm->name)] = fm;
+				AddDbEntry(fm, KEY(fm->name));
 
 				state = 2;
 			}
@@ -2426,6 +3587,20 @@ static tTagHash g_dbTagHash;
 static vector<const char*> g_tagNameList;
 // list of tag names without categories
 static vector<const char*> g_tagNameListNoCat;
+// (strings in both lists are interned in g_dbStrPool)
+
+// auto-completion index over tag names (with and without category) and stand-alone category names, sorted by
+// case-folded name so that all entries matching a prefix form a contiguous range that can be binary searched
+struct TagCompletionEntry
+{
+	tIStrHashKey key;	// case-folded name
+	const char *name;	// name as displayed (original case, interned in g_dbStrPool)
+	int count;			// number of FMs using tag/category (from g_dbTagCountHash)
+	BOOL bCat;			// stand-alone category name ("cat:")
+
+	bool operator <(const TagCompletionEntry &other) const { return key < other.key; }
+};
+static vector<TagCompletionEntry> g_tagCompletionIndex;
 
 // db that contains tag filters that are currently added to filter list (for quick lookups if a tag filter is added or not)
 typedef unordered_map<tIStrHashKey, char, KeyHash> tTagFilterHash;
@@ -2435,13 +3610,11 @@ static tTagFilterHash g_dbTagFilterHash;
 
 static void DestroyTagNamelists()
 {
-	for (int i=0; i<(int)g_tagNameList.size(); i++)
-		free((void*)g_tagNameList[i]);
+	// strings are owned by g_dbStrPool
 	g_tagNameList.clear();
-
-	for (int i=0; i<(int)g_tagNameListNoCat.size(); i++)
-		free((void*)g_tagNameListNoCat[i]);
 	g_tagNameListNoCat.clear();
+
+	g_tagCompletionIndex.clear();
 }
 
 
@@ -2575,53 +3748,184 @@ static __inline BOOL tagfltcmp(const char *tag, const char *filter)
 struct FilterContext
 {
 	const char *filterName;
+	const vector<const char*> *tagFilterList;	// array of FOP_NUM_OPS lists
 };
 
-// return TRUE if fm is visible
-static BOOL DoFilter(FMEntry *fm, const FilterContext &ctxt)
+// structure-of-arrays mirror of the FMEntry fields that are evaluated by the basic (non-name/tag) filters,
+// indexed by FMEntry::dbIndex (the g_db slot), so that the filter kernel can run over tightly
+// packed arrays instead of chasing an FMEntry pointer per FM
+struct FMHotFields
 {
-	int i, j;
+	vector<unsigned char> state;	// HOT_* bits
+	vector<signed char> rating;
+	vector<signed char> priority;
+	vector<time_t> tmReleaseDate;
+};
 
-	if (g_cfg.filtShow & FSHOW_NotAvail)
-	{
-		if (!fm->IsInstalled()
-			&& !(g_cfg.filtShow & FSHOW_ArchivedOnly) && fm->IsArchived())
-			return FALSE;
-	}
-	else if (g_cfg.filtShow & FSHOW_ArchivedOnly)
-	{
-		if ( !fm->IsAvail() )
-			return FALSE;
-	}
-	else if ( !fm->IsInstalled() )
-		return FALSE;
+enum
+{
+	HOT_Archived		= (1<<0),
+	HOT_Installed		= (1<<1),
+	HOT_StatusShift		= 2,		// 2 bits of FMEntry::status
+	HOT_CompletedOnce	= (1<<4),	// nCompleteCount > 0
 
-	if (!(g_cfg.filtShow & FSHOW_NotPlayed) && fm->status == FMEntry::STATUS_NotPlayed)
-		return FALSE;
-	if (!(g_cfg.filtShow & FSHOW_Completed) && fm->status == FMEntry::STATUS_Completed)
-		return FALSE;
-	// when showing completed also show completed ones that are in progress
-	if (!(g_cfg.filtShow & FSHOW_InProgress) && fm->status == FMEntry::STATUS_InProgress
-		&& (!(g_cfg.filtShow & FSHOW_Completed) || !fm->nCompleteCount))
-		return FALSE;
+	HOT_NUM_STATES		= (1<<5),
+};
 
-	if (fm->rating < g_cfg.filtMinRating || fm->priority < g_cfg.filtMinPrio)
-		return FALSE;
+static FMHotFields g_dbHot;
+static BOOL g_bHotFieldsValid = FALSE;
 
-	if (ctxt.filterName && !strstr(fm->GetFilterName(), ctxt.filterName))
-		return FALSE;
+static __inline unsigned char MakeHotState(const FMEntry *fm)
+{
+	return (unsigned char)((fm->IsArchived() ? HOT_Archived : 0)
+		| (fm->IsInstalled() ? HOT_Installed : 0)
+		| (fm->status << HOT_StatusShift)
+		| (fm->nCompleteCount > 0 ? HOT_CompletedOnce : 0));
+}
 
-	if (fm->tmReleaseDate < g_cfg.filtReleaseMinTime || fm->tmReleaseDate > g_cfg.filtReleaseMaxTime)
-		return FALSE;
+static void InvalidateHotFields()
+{
+	g_bHotFieldsValid = FALSE;
 
-	// apply FOP_OR tag filters (fm must only match on of the filters)
-	if ( !g_cfg.tagFilterList[FOP_OR].empty() )
-	{
-		for (i=0; i<(int)g_cfg.tagFilterList[FOP_OR].size(); i++)
-		{
-			const char *filter = g_cfg.tagFilterList[FOP_OR][i];
-			for (j=0; j<(int)fm->taglist.size(); j++)
-				if ( tagfltcmp(fm->taglist[j], filter) )
+	InvalidateRowCache();
+}
+
+// update hot fields for a single entry (called after any of the mirrored fields has been changed)
+static void SyncHotFields(const FMEntry *fm)
+{
+	// the list row strings are derived from the same fields
+	fm->DropRowCache();
+
+	if (!g_bHotFieldsValid)
+		return;
+
+	// entries that aren't in the db yet (or temp entries) are handled by the rebuild in FilterHotFields
+	const int i = fm->dbIndex;
+	if (i < 0)
+		return;
+
+	if (i >= (int)g_db.size() || g_db[i] != fm)
+	{
+		// entry was added/removed since last rebuild, rebuild all when needed
+		g_bHotFieldsValid = FALSE;
+		return;
+	}
+
+	g_dbHot.state[i] = MakeHotState(fm);
+	g_dbHot.rating[i] = (signed char)fm->rating;
+	g_dbHot.priority[i] = (signed char)fm->priority;
+	g_dbHot.tmReleaseDate[i] = fm->tmReleaseDate;
+}
+
+static void RebuildHotFields()
+{
+	const int n = (int)g_db.size();
+
+	g_dbHot.state.resize(n);
+	g_dbHot.rating.resize(n);
+	g_dbHot.priority.resize(n);
+	g_dbHot.tmReleaseDate.resize(n);
+
+	for (int i=0; i<n; i++)
+	{
+		FMEntry *fm = g_db[i];
+		ASSERT(fm->dbIndex == i);
+
+		g_dbHot.state[i] = MakeHotState(fm);
+		g_dbHot.rating[i] = (signed char)fm->rating;
+		g_dbHot.priority[i] = (signed char)fm->priority;
+		g_dbHot.tmReleaseDate[i] = fm->tmReleaseDate;
+	}
+
+	g_bHotFieldsValid = TRUE;
+}
+
+// returns TRUE if an FM with the given availability/status state passes the show filters
+static BOOL IsHotStateVisible(int state)
+{
+	const BOOL bInstalled = !!(state & HOT_Installed);
+	const BOOL bArchived = !!(state & HOT_Archived);
+	const int status = (state >> HOT_StatusShift) & 3;
+
+	if (g_cfg.filtShow & FSHOW_NotAvail)
+	{
+		if (!bInstalled
+			&& !(g_cfg.filtShow & FSHOW_ArchivedOnly) && bArchived)
+			return FALSE;
+	}
+	else if (g_cfg.filtShow & FSHOW_ArchivedOnly)
+	{
+		if (!bInstalled && !bArchived)
+			return FALSE;
+	}
+	else if (!bInstalled)
+		return FALSE;
+
+	if (!(g_cfg.filtShow & FSHOW_NotPlayed) && status == FMEntry::STATUS_NotPlayed)
+		return FALSE;
+	if (!(g_cfg.filtShow & FSHOW_Completed) && status == FMEntry::STATUS_Completed)
+		return FALSE;
+	// when showing completed also show completed ones that are in progress
+	if (!(g_cfg.filtShow & FSHOW_InProgress) && status == FMEntry::STATUS_InProgress
+		&& (!(g_cfg.filtShow & FSHOW_Completed) || !(state & HOT_CompletedOnce)))
+		return FALSE;
+
+	return TRUE;
+}
+
+// evaluate show, rating, priority and release date filters for the entire db, sets mask[i] to 1 for each
+// g_db[i] that passes (name and tag filters have to be applied afterwards by DoFilterRefine)
+static void FilterHotFields(vector<unsigned char> &mask)
+{
+	if (!g_bHotFieldsValid || g_dbHot.state.size() != g_db.size())
+		RebuildHotFields();
+
+	const int n = (int)g_db.size();
+	mask.resize(n);
+	if (!n)
+		return;
+
+	// show filters depend only on the state bits, so resolve them to a lookup table up-front
+	unsigned char stateVisible[HOT_NUM_STATES];
+	for (int i=0; i<HOT_NUM_STATES; i++)
+		stateVisible[i] = IsHotStateVisible(i) ? 1 : 0;
+
+	const signed char minRating = (signed char)g_cfg.filtMinRating;
+	const signed char minPrio = (signed char)g_cfg.filtMinPrio;
+	const time_t tmMin = g_cfg.filtReleaseMinTime;
+	const time_t tmMax = g_cfg.filtReleaseMaxTime;
+
+	const unsigned char *state = &g_dbHot.state[0];
+	const signed char *rating = &g_dbHot.rating[0];
+	const signed char *prio = &g_dbHot.priority[0];
+	const time_t *reldate = &g_dbHot.tmReleaseDate[0];
+	unsigned char *m = &mask[0];
+
+	// range checks first as a branch-free loop over the packed arrays (lets the compiler vectorize it),
+	// then apply the state table
+	for (int i=0; i<n; i++)
+		m[i] = (unsigned char)((rating[i] >= minRating) & (prio[i] >= minPrio) & (reldate[i] >= tmMin) & (reldate[i] <= tmMax));
+
+	for (int i=0; i<n; i++)
+		m[i] &= stateVisible[state[i]];
+}
+
+// apply the name and tag filters on an entry that passed FilterHotFields, return TRUE if fm is visible
+static BOOL DoFilterRefine(FMEntry *fm, const FilterContext &ctxt)
+{
+	int i, j;
+
+	if (ctxt.filterName && !strstr(fm->GetFilterName(), ctxt.filterName))
+		return FALSE;
+
+	// apply FOP_OR tag filters (fm must only match on of the filters)
+	if ( !ctxt.tagFilterList[FOP_OR].empty() )
+	{
+		for (i=0; i<(int)ctxt.tagFilterList[FOP_OR].size(); i++)
+		{
+			const char *filter = ctxt.tagFilterList[FOP_OR][i];
+			for (j=0; j<(int)fm->taglist.size(); j++)
+				if ( tagfltcmp(fm->taglist[j], filter) )
 					goto found_or_match;
 		}
 		// found no match
@@ -2630,9 +3934,9 @@ found_or_match:;
 	}
 
 	// apply FOP_AND tag filters (fm must match all of the filters)
-	for (i=0; i<(int)g_cfg.tagFilterList[FOP_AND].size(); i++)
+	for (i=0; i<(int)ctxt.tagFilterList[FOP_AND].size(); i++)
 	{
-		const char *filter = g_cfg.tagFilterList[FOP_AND][i];
+		const char *filter = ctxt.tagFilterList[FOP_AND][i];
 		for (j=0; j<(int)fm->taglist.size(); j++)
 			if ( tagfltcmp(fm->taglist[j], filter) )
 				goto found_and_match;
@@ -2642,9 +3946,9 @@ found_and_match:;
 	}
 
 	// apply FOP_NOT tag filters (fm must match none of the filters)
-	for (i=0; i<(int)g_cfg.tagFilterList[FOP_NOT].size(); i++)
+	for (i=0; i<(int)ctxt.tagFilterList[FOP_NOT].size(); i++)
 	{
-		const char *filter = g_cfg.tagFilterList[FOP_NOT][i];
+		const char *filter = ctxt.tagFilterList[FOP_NOT][i];
 		for (j=0; j<(int)fm->taglist.size(); j++)
 			if ( tagfltcmp(fm->taglist[j], filter) )
 				return FALSE;
@@ -2656,23 +3960,81 @@ found_and_match:;
 
 static int GetFilteredDbIndex(FMEntry *fm)
 {
+	if (fm->filtGen != g_nFilteredGen)
+		return -1;
+
+	ASSERT(fm->filtIndex >= 0 && fm->filtIndex < (int)g_dbFiltered.size() && g_dbFiltered[fm->filtIndex] == fm);
+	return fm->filtIndex;
+}
+
+// assign filtered row indices after g_dbFiltered has been rebuilt or re-sorted
+static void UpdateFilteredDbIndices()
+{
+	if (!++g_nFilteredGen)
+		g_nFilteredGen = 1;
+
 	for (int i=0; i<(int)g_dbFiltered.size(); i++)
-		if (g_dbFiltered[i] == fm)
-			return i;
-	return -1;
+	{
+		FMEntry *fm = g_dbFiltered[i];
+		fm->filtIndex = i;
+		fm->filtGen = g_nFilteredGen;
+	}
+}
+
+typedef bool (*FMSortFunc)(FMEntry*, FMEntry*);
+
+static FMSortFunc GetSortFunc(int sortmode)
+{
+	switch (sortmode)
+	{
+	case SORT_Rating: return sort_rating;
+	case SORT_Priority: return sort_prio;
+	case SORT_Status: return sort_status;
+	case SORT_LastPlayed: return sort_lastplayed;
+	case SORT_ReleaseDate: return sort_released;
+	case SORT_DirName: return sort_dirname;
+	case SORT_Archive: return sort_archive;
+
+	case -SORT_Name: return sort_rev_name;
+	case -SORT_Rating: return sort_rev_rating;
+	case -SORT_Priority: return sort_rev_prio;
+	case -SORT_Status: return sort_rev_status;
+	case -SORT_LastPlayed: return sort_rev_lastplayed;
+	case -SORT_ReleaseDate: return sort_rev_released;
+	case -SORT_DirName: return sort_rev_dirname;
+	case -SORT_Archive: return sort_rev_archive;
+	}
+
+	return sort_name;
+}
+
+static void SortFilteredDb(vector<FMEntry*> &list, int sortmode)
+{
+	TRACE_SCOPE("SortFilteredDb");
+	STAT_TIME_SCOPE(STAT_Sort);
+
+	if ( !list.empty() )
+		std::sort(list.begin(), list.end(), GetSortFunc(sortmode));
 }
 
 static void RefreshFilteredDb(BOOL bUpdateListControl, BOOL bReSortOnly)
 {
+	TRACE_SCOPE("RefreshFilteredDb");
+
 	static BOOL bRefreshing = FALSE;
 
 	if (bRefreshing)
 		return;
 
+	// a synchronous refresh supersedes any pending async refresh
+	CancelAsyncFilter(FALSE);
+
 	FMEntry *pCurSel = GetCurSelFM();
 
 	if (!bReSortOnly)
 	{
+		STAT_TIME_SCOPE(STAT_Filter);
+
 		g_dbFiltered.clear();
 		g_dbFiltered.reserve( g_db.size() );
 
@@ -2684,6 +4046,7 @@ static void RefreshFilteredDb(BOOL bUpdateListControl, BOOL bReSortOnly)
 		else
 		{
 			FilterContext ctxt;
+			ctxt.tagFilterList = g_cfg.tagFilterList;
 
 			// lower case name filter string
 			string s;
@@ -2694,48 +4057,234 @@ static void RefreshFilteredDb(BOOL bUpdateListControl, BOOL bReSortOnly)
 				ctxt.filterName = s.c_str();
 			}
 
+			// evaluate the basic filters over the hot-field arrays first, then refine the remaining
+			// entries with the name and tag filters
+			static vector<unsigned char> mask;
+			FilterHotFields(mask);
+
 			for (int i=0; i<(int)g_db.size(); i++)
 			{
-				FMEntry *fm = g_db[i];
-				if ( DoFilter(fm, ctxt) )
-					g_dbFiltered.push_back(fm);
+				if ( mask[i] && DoFilterRefine(g_db[i], ctxt) )
+					g_dbFiltered.push_back(g_db[i]);
 			}
 		}
 	}
 
-	if ( !g_dbFiltered.empty() )
+	SortFilteredDb(g_dbFiltered, g_cfg.sortmode);
+	UpdateFilteredDbIndices();
+
+	if (bUpdateListControl)
 	{
-		switch (g_cfg.sortmode)
-		{
-		case SORT_Rating: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rating); break;
-		case SORT_Priority: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_prio); break;
-		case SORT_Status: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_status); break;
-		case SORT_LastPlayed: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_lastplayed); break;
-		case SORT_ReleaseDate: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_released); break;
-		case SORT_DirName: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_dirname); break;
-		case SORT_Archive: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_archive); break;
+		bRefreshing = TRUE;
 
-		case -SORT_Name: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_name); break;
-		case -SORT_Rating: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_rating); break;
-		case -SORT_Priority: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_prio); break;
-		case -SORT_Status: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_status); break;
-		case -SORT_LastPlayed: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_lastplayed); break;
-		case -SORT_ReleaseDate: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_released); break;
-		case -SORT_DirName: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_dirname); break;
-		case -SORT_Archive: std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_rev_archive); break;
+		RefreshListControl(pCurSel, bReSortOnly);
 
-		default:
-			std::sort(g_dbFiltered.begin(), g_dbFiltered.end(), sort_name);
+		bRefreshing = FALSE;
+	}
+}
+
+// async filter refresh, used when the name filter changes (while typing) so that filtering a large db doesn't
+// stall the UI. the worker only reads the FMEntry fields used by the name/tag filters and sorting, any
+// modification of an entry or of the db first calls CancelAsyncFilter which bumps the generation and joins
+// the filter task group, so the worker has bailed out before the main thread touches anything it reads.
+// each request is stamped with a generation number, results of superseded requests are discarded
+
+// min db size for async filtering, for smaller dbs a synchronous refresh is fast enough
+#define ASYNC_FILTER_MIN_DB_SIZE 2000
+// number of entries sorted at a time by the worker, the generation is checked between chunks and merges
+#define ASYNC_FILTER_SORT_CHUNK 4096
+
+struct AsyncFilterJob
+{
+	long generation;
+	int sortmode;
+	string filterName;
+	vector<string> tagFilters[FOP_NUM_OPS];
+	vector<FMEntry*> candidates;	// entries that passed FilterHotFields
+	vector<FMEntry*> result;
+	BOOL bCancelled;
+};
+
+static volatile long g_nFilterGeneration = 0;
+// number of jobs that haven't been published or discarded yet (only touched by the main thread, the continuation
+// is run through Fl::awake or by TermThreadPoolOS)
+static int g_nFilterJobsPending = 0;
+// group of the submitted filter jobs, joined by CancelAsyncFilter
+static TaskGroupOS *g_pFilterGroup = NULL;
+
+static void RestartAsyncFilter(void *)
+{
+	RefreshFilteredDbAsync();
+}
+
+// abort any running async filter refresh and wait until worker no longer accesses the db,
+// if 'bRestart' is TRUE then a new async refresh will be started (from the main loop) if one was aborted
+static void CancelAsyncFilter(BOOL bRestart)
+{
+	if (!g_nFilterJobsPending)
+		return;
+
+	AtomicAddOS(&g_nFilterGeneration, 1);
+
+	// the group is gone if only the continuations of finished jobs are pending (after TermAsyncFilter)
+	if (g_pFilterGroup)
+		JoinTaskGroupOS(g_pFilterGroup);
+
+	if (bRestart)
+		Fl::add_timeout(0.0, RestartAsyncFilter);
+	else
+		Fl::remove_timeout(RestartAsyncFilter);
+}
+
+static void TermAsyncFilter()
+{
+	CancelAsyncFilter(FALSE);
+
+	if (g_pFilterGroup)
+	{
+		DestroyTaskGroupOS(g_pFilterGroup);
+		g_pFilterGroup = NULL;
+	}
+}
+
+// called in main thread (as task continuation) when worker has finished a job
+static void OnAsyncFilterDone(void *p)
+{
+	AsyncFilterJob *job = (AsyncFilterJob*)p;
+
+	g_nFilterJobsPending--;
+
+	if (!job->bCancelled && job->generation == g_nFilterGeneration && pMainWnd && pMainWnd->visible())
+	{
+		FMEntry *pCurSel = GetCurSelFM();
+
+		g_dbFiltered.swap(job->result);
+		UpdateFilteredDbIndices();
+
+		RefreshListControl(pCurSel, FALSE);
+	}
+
+	delete job;
+}
+
+static __inline BOOL IsAsyncFilterSuperseded(AsyncFilterJob *job)
+{
+	if (job->generation != g_nFilterGeneration)
+		job->bCancelled = TRUE;
+
+	return job->bCancelled;
+}
+
+// same order as SortFilteredDb, but sorted in chunks that are then merged so that a superseded job can bail out
+static void SortAsyncFilterResult(AsyncFilterJob *job)
+{
+	TRACE_SCOPE("SortFilteredDb");
+	STAT_TIME_SCOPE(STAT_Sort);
+
+	vector<FMEntry*> &list = job->result;
+	const FMSortFunc cmp = GetSortFunc(job->sortmode);
+	const int n = (int)list.size();
+
+	for (int i=0; i<n; i+=ASYNC_FILTER_SORT_CHUNK)
+	{
+		if ( IsAsyncFilterSuperseded(job) )
+			return;
+
+		std::sort(list.begin() + i, list.begin() + std::min(i + ASYNC_FILTER_SORT_CHUNK, n), cmp);
+	}
+
+	for (int w=ASYNC_FILTER_SORT_CHUNK; w<n; w*=2)
+		for (int i=0; i+w<n; i+=w*2)
+		{
+			if ( IsAsyncFilterSuperseded(job) )
+				return;
+
+			std::inplace_merge(list.begin() + i, list.begin() + i + w, list.begin() + std::min(i + w*2, n), cmp);
 		}
+}
+
+static void* AsyncFilterThread(void *p)
+{
+	TRACE_SCOPE("AsyncFilter");
+
+	AsyncFilterJob *job = (AsyncFilterJob*)p;
+
+	vector<const char*> tagFilterList[FOP_NUM_OPS];
+	for (int i=0; i<FOP_NUM_OPS; i++)
+		for (int j=0; j<(int)job->tagFilters[i].size(); j++)
+			tagFilterList[i].push_back( job->tagFilters[i][j].c_str() );
+
+	FilterContext ctxt;
+	ctxt.tagFilterList = tagFilterList;
+	ctxt.filterName = job->filterName.empty() ? NULL : job->filterName.c_str();
+
+	job->result.reserve( job->candidates.size() );
+
+	const double startms = GetTimeMsOS();
+
+	for (int i=0; i<(int)job->candidates.size(); i++)
+	{
+		// check for abort every now and then
+		if ( !(i & 1023) && IsAsyncFilterSuperseded(job) )
+			return 0;
+
+		if ( DoFilterRefine(job->candidates[i], ctxt) )
+			job->result.push_back( job->candidates[i] );
 	}
 
-	if (bUpdateListControl)
+	AddStatTime(STAT_Filter, GetTimeMsOS() - startms);
+
+	SortAsyncFilterResult(job);
+
+	// last check before the result gets published
+	IsAsyncFilterSuperseded(job);
+
+	return 0;
+}
+
+static void RefreshFilteredDbAsync()
+{
+	// supersede any previous request
+	CancelAsyncFilter(FALSE);
+
+	if ((int)g_db.size() < ASYNC_FILTER_MIN_DB_SIZE || !g_cfg.HasFilters() || !pMainWnd || !pMainWnd->visible())
 	{
-		bRefreshing = TRUE;
+		RefreshFilteredDb();
+		return;
+	}
 
-		RefreshListControl(pCurSel, bReSortOnly);
+	if (!g_pFilterGroup)
+		g_pFilterGroup = CreateTaskGroupOS();
 
-		bRefreshing = FALSE;
+	AsyncFilterJob *job = new AsyncFilterJob;
+	job->generation = AtomicAddOS(&g_nFilterGeneration, 1);
+	job->sortmode = g_cfg.sortmode;
+	job->bCancelled = FALSE;
+
+	if ( !g_cfg.filtName.empty() )
+		job->filterName = KEY( g_cfg.filtName.c_str() );
+
+	for (int i=0; i<FOP_NUM_OPS; i++)
+		for (int j=0; j<(int)g_cfg.tagFilterList[i].size(); j++)
+			job->tagFilters[i].push_back( g_cfg.tagFilterList[i][j] );
+
+	// basic filters are fast, evaluate them here so the worker doesn't need to access hot-fields
+	static vector<unsigned char> mask;
+	FilterHotFields(mask);
+
+	job->candidates.reserve( g_db.size() );
+	for (int i=0; i<(int)g_db.size(); i++)
+		if ( mask[i] )
+			job->candidates.push_back( g_db[i] );
+
+	g_nFilterJobsPending++;
+
+	if ( !SubmitTaskOS(g_pFilterGroup, AsyncFilterThread, job, OnAsyncFilterDone) )
+	{
+		g_nFilterJobsPending--;
+		delete job;
+
+		RefreshFilteredDb();
 	}
 }
 
@@ -2746,11 +4295,55 @@ static void InvalidateTagDb()
 	g_bTagDbValid = FALSE;
 }
 
+static void AddTagCompletionEntry(const char *name, const tIStrHashKey &key, BOOL bCat)
+{
+	g_tagCompletionIndex.push_back( TagCompletionEntry() );
+
+	TagCompletionEntry &e = g_tagCompletionIndex.back();
+	e.key = key;
+	e.name = g_dbStrPool.Intern(name);
+	e.bCat = bCat;
+
+	tTagCountHash::iterator dataIter = g_dbTagCountHash.find(key);
+	e.count = (dataIter != g_dbTagCountHash.end()) ? dataIter->second : 0;
+}
+
+static void BuildTagCompletionIndex()
+{
+	g_tagCompletionIndex.clear();
+	g_tagCompletionIndex.reserve(g_tagNameList.size() + g_tagNameListNoCat.size() + 64);
+
+	string lastCat;
+
+	for (int i=0; i<(int)g_tagNameList.size(); i++)
+	{
+		const char *tag = g_tagNameList[i];
+
+		// g_tagNameList is sorted so all tags of a category are adjacent, add a stand-alone
+		// entry for each new category encountered
+		if (lastCat.empty() || strncasecmp_utf_b(tag, lastCat.c_str(), lastCat.length()))
+		{
+			const char *colon = strchr(tag, ':');
+			lastCat.assign(tag, colon - tag + 1);
+			AddTagCompletionEntry(lastCat.c_str(), KEY(lastCat.c_str()), TRUE);
+		}
+
+		AddTagCompletionEntry(tag, KEY(tag), FALSE);
+	}
+
+	for (int i=0; i<(int)g_tagNameListNoCat.size(); i++)
+		AddTagCompletionEntry(g_tagNameListNoCat[i], KEY(g_tagNameListNoCat[i]), FALSE);
+
+	std::sort(g_tagCompletionIndex.begin(), g_tagCompletionIndex.end());
+}
+
 static void RefreshTagDb()
 {
 	if (g_bTagDbValid)
 		return;
 
+	TRACE_SCOPE("RefreshTagDb");
+
 	g_bTagDbValid = TRUE;
 
 	g_dbTagCountHash.clear();
@@ -2779,10 +4372,9 @@ static void RefreshTagDb()
 
 			if (cat)
 			{
-				char c = cat[1];
-				(char&)cat[1] = 0;
-				tIStrHashKey ckey = KEY(tag);
-				(char&)cat[1] = c;
+				// (tag strings are shared, so don't modify in place)
+				const string catname(tag, cat - tag + 1);
+				tIStrHashKey ckey = KEY( catname.c_str() );
 
 #ifdef USE_TAG_FM_XREF_DB
 				g_dbTagHash.insert( std::make_pair<tIStrHashKey,FMEntry*>(ckey,fm) );
@@ -2800,7 +4392,7 @@ static void RefreshTagDb()
 				// new tag entry
 				g_dbTagCountHash[key] = 1;
 				g_dbTagCountHash[ckey]++;
-				g_tagNameList.push_back( _strdup(tag) );
+				g_tagNameList.push_back(tag);
 			}
 			else
 			{
@@ -2814,13 +4406,65 @@ static void RefreshTagDb()
 
 				// new tag entry
 				g_dbTagCountHash[key] = 1;
-				g_tagNameListNoCat.push_back( _strdup(tag) );
+				g_tagNameListNoCat.push_back(tag);
 			}
 		}
 	}
 
 	std::sort(g_tagNameList.begin(), g_tagNameList.end(), compare_tags);
 	std::sort(g_tagNameListNoCat.begin(), g_tagNameListNoCat.end(), compare_tags);
+
+	BuildTagCompletionIndex();
+}
+
+static __inline bool compare_tag_completion_rank(const TagCompletionEntry *a, const TagCompletionEntry *b)
+{
+	// most used first, alphabetical for equal counts
+	if (a->count != b->count)
+		return a->count > b->count;
+	return a->key < b->key;
+}
+
+// get up to 'maxCount' tags/categories that start with 'prefix' (case insensitive), ranked by usage count
+static int GetTagSuggestions(const char *prefix, BOOL bIncludeCats, int maxCount, vector<const char*> &out)
+{
+	out.clear();
+
+	RefreshTagDb();
+
+	if (!prefix || !*prefix || g_tagCompletionIndex.empty())
+		return 0;
+
+	TagCompletionEntry k;
+	k.key = KEY(prefix);
+
+	// binary search the range of entries starting with prefix, the end of the range is the lower bound
+	// of the prefix's successor key (prefix with trailing 0xFF bytes dropped and the last byte incremented)
+	vector<TagCompletionEntry>::const_iterator first = std::lower_bound(g_tagCompletionIndex.begin(), g_tagCompletionIndex.end(), k);
+	vector<TagCompletionEntry>::const_iterator last = g_tagCompletionIndex.end();
+
+	while (!k.key.empty() && (unsigned char)k.key[k.key.length()-1] == 0xFF)
+		k.key.erase(k.key.length()-1);
+	if ( !k.key.empty() )
+	{
+		k.key[k.key.length()-1]++;
+		last = std::lower_bound(first, last, k);
+	}
+
+	vector<const TagCompletionEntry*> matches;
+	matches.reserve(last - first);
+	for (; first != last; ++first)
+		if (bIncludeCats || !first->bCat)
+			matches.push_back(&*first);
+
+	const int n = std::min(maxCount, (int)matches.size());
+	std::partial_sort(matches.begin(), matches.begin()+n, matches.end(), compare_tag_completion_rank);
+
+	out.reserve(n);
+	for (int i=0; i<n; i++)
+		out.push_back( matches[i]->name );
+
+	return n;
 }
 
 static BOOL IsTagInFilterList(const char *tagfilter)
@@ -3119,6 +4763,8 @@ static void TrimTrailingSlashFromPath(string &path, BOOL bTrimRoot)
 
 static void TermDb()
 {
+	TermAsyncFilter();
+
 	for (unsigned int i=0; i<g_db.size(); i++)
 	{
 		FMEntry *fm = g_db[i];
@@ -3138,8 +4784,52 @@ static void TermDb()
 	g_dbUnverifiedArchiveHash.clear();
 	g_dbFiltered.clear();
 	g_dbFiltered.resize(0);
+	UpdateFilteredDbIndices();
 
 	g_invalidDirs.clear();
+
+	InvalidateTagDb();
+	InvalidateHotFields();
+	InvalidateArchiveNameHash();
+	InvalidateSummaryPrefetch();
+
+	// release all entry and interned string memory at once, unless an entry is still alive (a temp entry that wasn't
+	// deleted, which is a bug), it would be left dangling so the memory is kept then
+	if (g_dbEntryPool.Count() || g_dbStrHeap.Count())
+	{
+		TRACE("TermDb: %d entries and %d entry strings still alive, db memory not released", g_dbEntryPool.Count(), g_dbStrHeap.Count());
+		ASSERT(FALSE);
+		return;
+	}
+
+	g_dbEntryPool.Reset();
+	g_dbStrHeap.Reset();
+	g_dbStrPool.Reset();
+}
+
+// rebuild g_dbStrPool with only the strings still referenced by the db, tags that were removed from all FMs
+// otherwise stay in the pool until it's reset by TermDb (which for a resident db is never)
+static void CompactDbStrings()
+{
+	TRACE_SCOPE("CompactDbStrings");
+
+	// pending async filter jobs read the tag lists
+	CancelAsyncFilter(FALSE);
+
+	DbStringPool pool;
+
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		vector<const char*> &taglist = g_db[i]->taglist;
+		for (int j=0; j<(int)taglist.size(); j++)
+			taglist[j] = pool.Intern(taglist[j]);
+	}
+
+	// tag name lists and the completion index also point into the pool, they get rebuilt when needed
+	DestroyTagNamelists();
+	InvalidateTagDb();
+
+	g_dbStrPool.Swap(pool);
 }
 
 
@@ -3251,7 +4941,7 @@ static BOOL ReadModIni(FMEntry *fm, const FMEntry *realfm)
 			}
 			while (*nextline && *nextline != '[');
 
-			fm->descr = Trimmed(fm->descr.c_str(), 2);
+			fm->descr = Trimmed(fm->descr.c_str(), 2).c_str();
 		}
 		else if ( !_stricmp(s, "[modHomepage]") )
 		{
@@ -3302,14 +4992,14 @@ static BOOL ReadModIni(FMEntry *fm, const FMEntry *realfm)
 			fm->descr.append("...");
 		}
 
-		fm->descr.append(str);
+		fm->descr.append( str.c_str() );
 	}
 	else if (fm->descr.size() > MAX_DESCR_LEN)
 	{
 		fm->descr = fm->descr.substr(0, MAX_DESCR_LEN - 3);
 		fm->descr.append("...");
 	}
-	fm->descr = EscapeString( fm->descr.c_str() );
+	fm->descr = EscapeString( fm->descr.c_str() ).c_str();
 
 	delete[] data;
 
@@ -3357,16 +5047,82 @@ static std::list<FileQ> g_backupList;
 static int g_nBusyCursorCount = 0;
 
 
-void ShowBusyCursor(BOOL bShow)
+// output a line in batch mode
+static void BatchReport(const char *fmt, ...)
 {
-	if (bShow)
-	{
-		if (!g_nBusyCursorCount)
-			fl_cursor(FL_CURSOR_WAIT);
-		g_nBusyCursorCount++;
-	}
-	else
-	{
+	if (!g_pBatchReport)
+		return;
+
+	char msg[2048];
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf_s(msg, sizeof(msg), _TRUNCATE, fmt, ap);
+	va_end(ap);
+
+	g_pBatchReport(msg);
+}
+
+// fl_alert for code that also runs in batch mode, where the message is output instead
+static void FmAlert(const char *fmt, ...)
+{
+	char msg[2048];
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf_s(msg, sizeof(msg), _TRUNCATE, fmt, ap);
+	va_end(ap);
+
+	if (g_pMessageLog)
+	{
+		g_pMessageLog->push_back(msg);
+		return;
+	}
+
+	if (g_pBatchReport)
+	{
+		g_pBatchReport(msg);
+		return;
+	}
+
+	fl_message_position(pMainWnd);
+	fl_alert("%s", msg);
+}
+
+// fl_choice for code that also runs in batch mode, where the question is output and answered with 'batchchoice'
+static int FmChoice(int batchchoice, const char *fmt, const char *b0, const char *b1, const char *b2, ...)
+{
+	char msg[2048];
+
+	va_list ap;
+	va_start(ap, b2);
+	vsnprintf_s(msg, sizeof(msg), _TRUNCATE, fmt, ap);
+	va_end(ap);
+
+	if (g_pMessageLog)
+		return batchchoice;
+
+	if (g_pBatchReport)
+	{
+		const char *answer = (batchchoice == 0) ? b0 : ((batchchoice == 1) ? b1 : b2);
+		BatchReport("%s -> %s", msg, answer ? answer : "");
+		return batchchoice;
+	}
+
+	fl_message_position(pMainWnd);
+	return fl_choice("%s", b0, b1, b2, msg);
+}
+
+void ShowBusyCursor(BOOL bShow)
+{
+	if (bShow)
+	{
+		if (!g_nBusyCursorCount)
+			fl_cursor(FL_CURSOR_WAIT);
+		g_nBusyCursorCount++;
+	}
+	else
+	{
 		ASSERT(g_nBusyCursorCount > 0);
 		g_nBusyCursorCount--;
 		if (!g_nBusyCursorCount)
@@ -3401,6 +5157,11 @@ static void CleanDirSlashes(string &s)
 	std::transform(s.begin(), s.end(), s.begin(), dirslashify);
 }
 
+static void CleanDirSlashes(dbstring &s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), dirslashify);
+}
+
 static void CleanDirSlashes(char *s)
 {
 	if (!s || !*s)
@@ -3459,6 +5220,123 @@ static BOOL GetTempFile(const char *fname, string &tmpfile, int bReturnWithPath)
 }
 
 
+// files of an archived (not installed) FM extracted to memory in one batch, while a batch is active FmFileExists and
+// FmReadFileToBuffer answer requests for file names that match the batch patterns from here instead of the archive
+struct FmFileBatch
+{
+	const FMEntry *fm;
+	vector<string> patterns;
+	vector<string> names;
+	vector<string> data;
+};
+
+static FmFileBatch *g_pFmFileBatch = NULL;
+// batch prepared by a summary prefetch task, taken over by the next matching FmBeginFileBatch call
+static FmFileBatch *g_pFmFilePrefetch = NULL;
+
+// create an empty, uniquely named dir in the temp dir, 'dir' receives the path with trailing separator (the caller
+// has to remove it with DelTree when done)
+static BOOL MakeTempStagingDir(string &dir)
+{
+	static unsigned int nStageDir = 0;
+
+	if ( g_sTempDir.empty() )
+		return FALSE;
+
+	char buf[32];
+
+	for (int i=0; i<100; i++)
+	{
+		sprintf(buf, ".stage%u", ++nStageDir);
+		dir = g_sTempDir + buf;
+
+		if ( !fl_mkdir(dir.c_str(), DEF_DIR_MODE) )
+		{
+			dir += DIRSEP_STR;
+			return TRUE;
+		}
+
+		// name is taken (by a dir left over from a crash or another instance), try the next one
+		if (errno != EEXIST)
+			break;
+	}
+
+	dir.clear();
+	return FALSE;
+}
+
+// extract all files of 'fm' matching 'patterns' (see ExtractFilesFromArchive) for the FmFileExists/FmReadFileToBuffer
+// calls that follow, until FmEndFileBatch is called. does nothing if 'fm' isn't an archived FM or isn't installed
+static void FmBeginFileBatch(const FMEntry *fm, const char **patterns, int count)
+{
+	FmEndFileBatch();
+
+	if (fm->IsInstalled() || !fm->IsArchived())
+		return;
+
+	if (g_pFmFilePrefetch && g_pFmFilePrefetch->fm == fm && g_pFmFilePrefetch->patterns == vector<string>(patterns, patterns + count))
+	{
+		g_pFmFileBatch = g_pFmFilePrefetch;
+		g_pFmFilePrefetch = NULL;
+		return;
+	}
+
+	FmFileBatch *batch = new FmFileBatch;
+	batch->fm = fm;
+	batch->patterns.assign(patterns, patterns + count);
+
+	// files from solid archives are staged in a dir of their own, which is removed again with everything that got
+	// extracted into it (including subdirs) whatever the outcome
+	string stagedir;
+	MakeTempStagingDir(stagedir);
+
+	const char *pErrMsg = NULL;
+	const int ret = ExtractFilesFromArchive(fm->GetArchiveFilePath().c_str(), batch->patterns, batch->names, batch->data,
+		stagedir.empty() ? NULL : stagedir.c_str(), &pErrMsg);
+
+	if ( !stagedir.empty() )
+		DelTree( stagedir.substr(0, stagedir.length()-1) );
+
+	if (ret < 0)
+	{
+		// leave it to the regular per file calls
+		TRACE("Failed to batch extract from \"%s\": %s", fm->archive.c_str(), pErrMsg ? pErrMsg : "unknown error");
+		delete batch;
+		return;
+	}
+
+	g_pFmFileBatch = batch;
+}
+
+static void FmEndFileBatch()
+{
+	delete g_pFmFileBatch;
+	g_pFmFileBatch = NULL;
+}
+
+// look up 'fname' in the active batch, returns FALSE if the batch doesn't cover that file name, otherwise TRUE
+// with 'file' set to the file data or NULL if the file doesn't exist in the archive
+static BOOL FmGetBatchFile(const FMEntry *fm, const char *fname, const string *&file)
+{
+	file = NULL;
+
+	if (!g_pFmFileBatch || g_pFmFileBatch->fm != fm)
+		return FALSE;
+
+	for (size_t i=0; i<g_pFmFileBatch->names.size(); i++)
+		if ( !fl_utf_strcasecmp(fname, g_pFmFileBatch->names[i].c_str()) )
+		{
+			file = &g_pFmFileBatch->data[i];
+			return TRUE;
+		}
+
+	for (size_t i=0; i<g_pFmFileBatch->patterns.size(); i++)
+		if ( fl_filename_match(fname, g_pFmFileBatch->patterns[i].c_str()) )
+			return TRUE;
+
+	return FALSE;
+}
+
 static BOOL FmFileExists(const FMEntry *fm, const char *fname)
 {
 	if (!fname || !*fname)
@@ -3466,6 +5344,10 @@ static BOOL FmFileExists(const FMEntry *fm, const char *fname)
 
 	if ( !fm->IsInstalled() )
 	{
+		const string *file;
+		if ( FmGetBatchFile(fm, fname, file) )
+			return file != NULL;
+
 		if ( fm->IsArchived() )
 			return IsFileInArchive(fm->GetArchiveFilePath().c_str(), fname);
 
@@ -3487,6 +5369,23 @@ static BOOL FmReadFileToBuffer(const FMEntry *fm, const char *fname, char *&data
 
 	if ( !fm->IsInstalled() )
 	{
+		const string *file;
+		if ( FmGetBatchFile(fm, fname, file) )
+		{
+			if (!file)
+				return FALSE;
+
+			const int n = (int) file->size();
+
+			data = new char[n+2];
+			memcpy(data, file->data(), n);
+			data[n] = 0;
+			data[n+1] = 0;
+			len = n;
+
+			return TRUE;
+		}
+
 		if ( fm->IsArchived() )
 			if ( ExtractFileFromArchive(fm->GetArchiveFilePath().c_str(), fname, (void*&)data, len) )
 				return TRUE;
@@ -3566,11 +5465,29 @@ static BOOL FmGetPhysicalFileFromArchive(FMEntry *fm, const char *filename, stri
 	return TRUE;
 }
 
+static BOOL IsPlainTextFile(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+	return ext && !_stricmp(ext+1, "txt");
+}
+
 static BOOL FmOpenFileWithAssociatedApp(FMEntry *fm, const char *filename)
 {
 	if ( !fm->IsAvail() )
 		return FALSE;
 
+	// plain text files are shown in the built-in viewer, read straight from the archive if the FM isn't installed
+	if (g_cfg.bViewTextInternally && IsPlainTextFile(filename))
+	{
+		char *data;
+		int len;
+		if ( FmReadFileToBuffer(fm, filename, data, len) )
+		{
+			TextFilePopup(filename, data, len);
+			return TRUE;
+		}
+	}
+
 	char pathname[MAX_PATH_BUF];
 
 	if ( !fm->IsInstalled() )
@@ -3658,34 +5575,22 @@ static BOOL ExportFmIni(FMEntry *fm, BOOL bSaveTitle = FALSE)
 	return TRUE;
 }
 
-static BOOL ExportBatchFmIni()
+// write a batched fm.ini for the archived FMs in 'list', returns the number of FMs written or -1 on failure
+// (the file is removed if there were no archived FMs)
+static int WriteBatchFmIni(const char *fname, const vector<FMEntry*> &list)
 {
-	char fname[MAX_PATH_BUF];
-	strcpy(fname, "fm_batch.ini");
-
-	const char *pattern[] =
-	{
-		$("Batch FM Ini File"), "fm_batch.ini",
-		NULL,
-	};
-
-	if ( !FileDialog(pMainWnd, TRUE, $("Export FM_BATCH.INI"), pattern, "ini", fname, fname, sizeof(fname)) )
-		return FALSE;
-
 	FILE *f = fl_fopen(fname, "wb");
 	if (!f)
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Failed to open file \"%s\" for writing."), fname);
-		return FALSE;
+		FmAlert($("Failed to open file \"%s\" for writing."), fname);
+		return -1;
 	}
 
 	int count = 0;
 
-	// export all archived FMs in filtered list
-	for (int i=0; i<(int)g_dbFiltered.size(); i++)
+	for (int i=0; i<(int)list.size(); i++)
 	{
-		FMEntry *fm = g_dbFiltered[i];
+		FMEntry *fm = list[i];
 
 		if ( !fm->IsArchived() )
 			continue;
@@ -3705,8 +5610,32 @@ static BOOL ExportBatchFmIni()
 	fclose(f);
 
 	if (!count)
-	{
 		remove(fname);
+
+	return count;
+}
+
+static BOOL ExportBatchFmIni()
+{
+	char fname[MAX_PATH_BUF];
+	strcpy(fname, "fm_batch.ini");
+
+	const char *pattern[] =
+	{
+		$("Batch FM Ini File"), "fm_batch.ini",
+		NULL,
+	};
+
+	if ( !FileDialog(pMainWnd, TRUE, $("Export FM_BATCH.INI"), pattern, "ini", fname, fname, sizeof(fname)) )
+		return FALSE;
+
+	// export all archived FMs in filtered list
+	const int count = WriteBatchFmIni(fname, g_dbFiltered);
+	if (count < 0)
+		return FALSE;
+
+	if (!count)
+	{
 		fl_message_position(pMainWnd);
 		fl_message("%s", $("The current list contained no archived FMs to export a batched fm.ini for"));
 	}
@@ -3814,7 +5743,7 @@ static BOOL ApplyImportedData(FMEntry *fm, const FMEntry *data, int mode)
 			{
 				// add tags that aran't already added
 				BOOL bAdded = FALSE;
-				string tags = fm->tags;
+				string tags = fm->tags.c_str();
 				for (int i=0; i<(int)data->taglist.size(); i++)
 				{
 					if ( !fm->HasTag(data->taglist[i]) )
@@ -3844,32 +5773,15 @@ static BOOL ApplyImportedData(FMEntry *fm, const FMEntry *data, int mode)
 	return bModified;
 }
 
-static BOOL ImportBatchFmIni()
+// apply the data of a batched fm.ini to matching FMs in the db ('mode' is a combination of ImportMode flags),
+// returns the number of FMs that were modified or -1 if the file couldn't be opened
+static int ReadBatchFmIni(const char *fname, int mode)
 {
-	char fname[MAX_PATH_BUF];
-	strcpy(fname, "fm_batch.ini");
-
-	const char *pattern[] =
-	{
-		$("Batch FM Ini File"), "*.ini",
-		NULL,
-	};
-
-	if ( !FileDialog(pMainWnd, FALSE, $("Import FM_BATCH.INI"), pattern, "ini", fname, fname, sizeof(fname)) )
-		return FALSE;
-
-	// show import dialog (user can select what to import, tags, release dates etc., and how to apply it,
-	// like merge tags with existing, replace existing data, or only import of local data isn't specified)
-	int mode = DoImportBatchFmIniDialog();
-	if (!mode)
-		return FALSE;
-
 	FILE *f = fl_fopen(fname, "rb");
 	if (!f)
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Failed to open file \"%s\"."), fname);
-		return FALSE;
+		FmAlert($("Failed to open file \"%s\"."), fname);
+		return -1;
 	}
 
 	char line[8192];
@@ -3982,16 +5894,46 @@ new_block:
 
 	fclose(f);
 
-	fl_message_position(pMainWnd);
-
 	if (count)
 	{
 		InvalidateTagDb();
 
 		if (mode & IMP_ModeOverwrite)
 			// tags may have been removed during this process
-			RemoveDeadTagFilters();
+			RemoveDeadTagFilters(FALSE);
+	}
+
+	return count;
+}
+
+static BOOL ImportBatchFmIni()
+{
+	char fname[MAX_PATH_BUF];
+	strcpy(fname, "fm_batch.ini");
+
+	const char *pattern[] =
+	{
+		$("Batch FM Ini File"), "*.ini",
+		NULL,
+	};
+
+	if ( !FileDialog(pMainWnd, FALSE, $("Import FM_BATCH.INI"), pattern, "ini", fname, fname, sizeof(fname)) )
+		return FALSE;
+
+	// show import dialog (user can select what to import, tags, release dates etc., and how to apply it,
+	// like merge tags with existing, replace existing data, or only import of local data isn't specified)
+	int mode = DoImportBatchFmIniDialog();
+	if (!mode)
+		return FALSE;
 
+	const int count = ReadBatchFmIni(fname, mode);
+	if (count < 0)
+		return FALSE;
+
+	fl_message_position(pMainWnd);
+
+	if (count)
+	{
 		RefreshFilteredDb();
 
 		fl_message($("Imported data for %d FMs."), count);
@@ -4100,6 +6042,7 @@ static BOOL ApplyFmIni(FMEntry *fm, BOOL bFallbackModIni)
 
 	fm->nicename = ini->nicename;
 	fm->tmReleaseDate = ini->tmReleaseDate;
+	SyncHotFields(fm);
 	fm->SetTags( ini->tags.c_str() );
 	fm->infofile = ini->infofile;
 	fm->SetDescr( ini->descr.c_str() );
@@ -4408,26 +6351,32 @@ static BOOL AutoScanReleaseDate(FMEntry *fm, BOOL bSkipFmIni)
 }
 
 // automatically try to determine release dates of FMs that currently don't have any set
-static void AutoScanReleaseDates()
+// detect release dates for FMs in 'list' that don't have one, returns the number of FMs that got a date
+static int ScanReleaseDates(const vector<FMEntry*> &list)
 {
-	BOOL bModified = FALSE;
+	int count = 0;
 
 	time_t tmMin, tmMax;
 	InitValidMinMaxDate(tmMin, tmMax);
 
-	// use filtered db so thee user has a convenient way to limit which FMs to process
-	for (int i=0; i<(int)g_dbFiltered.size(); i++)
+	for (int i=0; i<(int)list.size(); i++)
 	{
-		FMEntry *fm = g_dbFiltered[i];
+		FMEntry *fm = list[i];
 
 		if (fm->tmReleaseDate != 0 || !fm->IsAvail())
 			continue;
 
 		if ( ScanReleaseDate(fm, tmMin, tmMax) )
-			bModified = TRUE;
+			count++;
 	}
 
-	if (bModified)
+	return count;
+}
+
+static void AutoScanReleaseDates()
+{
+	// use filtered db so thee user has a convenient way to limit which FMs to process
+	if ( ScanReleaseDates(g_dbFiltered) )
 		RefreshFilteredDb();
 }
 
@@ -4599,26 +6548,19 @@ static __inline bool compare_docfiles(const char *a, const char *b)
 	return (ascore != bscore) ? (ascore > bscore) : (_stricmp(a, b) < 0);
 }
 
-static BOOL GetDocFilesFromArch(FMEntry *fm, vector<string> &list)
-{
-	if (fm->flags & FMEntry::FLAG_CachedInfoFiles)
-	{
-		list = fm->infoFilesCache;
-		return !list.empty();
-	}
-
-	int i;
-	vector<string> files;
-
 #ifdef T3_SUPPORT
-	// look in the archive root and all first level directories to allow for various spellings of
-	// garrettloader's "fan mission extras" directory
-	int nFiles = ListFilesInArchivePruned(fm->GetArchiveFilePath().c_str(), 1, files);
+// look in the archive root and all first level directories to allow for various spellings of
+// garrettloader's "fan mission extras" directory
+#define DOC_FILE_ARCHIVE_DEPTH 1
 #else
-	int nFiles = ListFilesInArchiveRoot(fm->GetArchiveFilePath().c_str(), files);
+#define DOC_FILE_ARCHIVE_DEPTH 0
 #endif
-	if (nFiles <= 0)
-		return FALSE;
+
+// pick the info files from the archive file list 'files' and cache them in the entry
+static void SetArchDocFiles(FMEntry *fm, const vector<string> &files, vector<string> &list)
+{
+	int i;
+	const int nFiles = (int)files.size();
 
 	const int nTypes = sizeof(g_doctypes)/sizeof(g_doctypes[0]);
 
@@ -4653,21 +6595,42 @@ static BOOL GetDocFilesFromArch(FMEntry *fm, vector<string> &list)
 	for (i=0; i<(int)tmplist.size(); i++)
 		list.push_back(tmplist[i]);
 
-	fm->infoFilesCache = list;
+	fm->infoFilesCache.resize( list.size() );
+	for (i=0; i<(int)list.size(); i++)
+		fm->infoFilesCache[i] = list[i].c_str();
 	fm->flags |= FMEntry::FLAG_CachedInfoFiles;
-
-	return !list.empty();
 }
 
-static BOOL GetDocFiles(FMEntry *fm, vector<string> &list)
+static BOOL GetDocFilesFromArch(FMEntry *fm, vector<string> &list)
 {
-	int i;
-	char fname[MAX_PATH_BUF];
-
-	if ( !fm->IsInstalled() )
+	if (fm->flags & FMEntry::FLAG_CachedInfoFiles)
 	{
-		if ( fm->IsArchived() )
-			return GetDocFilesFromArch(fm, list);
+		list.resize( fm->infoFilesCache.size() );
+		for (int i=0; i<(int)list.size(); i++)
+			list[i] = fm->infoFilesCache[i].c_str();
+		return !list.empty();
+	}
+
+	vector<string> files;
+
+	int nFiles = ListFilesInArchivePruned(fm->GetArchiveFilePath().c_str(), DOC_FILE_ARCHIVE_DEPTH, files);
+	if (nFiles <= 0)
+		return FALSE;
+
+	SetArchDocFiles(fm, files, list);
+
+	return !list.empty();
+}
+
+static BOOL GetDocFiles(FMEntry *fm, vector<string> &list)
+{
+	int i;
+	char fname[MAX_PATH_BUF];
+
+	if ( !fm->IsInstalled() )
+	{
+		if ( fm->IsArchived() )
+			return GetDocFilesFromArch(fm, list);
 
 		return FALSE;
 	}
@@ -4925,6 +6888,7 @@ static BOOL FmDelTree(FMEntry *fm)
 	}
 
 	fm->flags &= ~FMEntry::FLAG_Installed;
+	SyncHotFields(fm);
 
 	// we don't care if delete fails, it's in the trash already
 	DelTree( tmpdir.c_str() );
@@ -5017,16 +6981,18 @@ static BOOL BackupOptDirToArchive(FMEntry *fm, const char *dirname)
 	return bRet;
 }
 
-static void* BackupSavesThread(void *)
+static void* BackupSavesThread(void *p)
 {
-	for (std::list<FileQ>::iterator it=g_backupList.begin(); it!=g_backupList.end(); it++, StepProgress(1))
-		if ( !AddFileToArchive(it->fname, it->fname_rel) )
+	ProgressJob *job = (ProgressJob*)p;
+
+	for (std::list<FileQ>::iterator it=g_backupList.begin(); it!=g_backupList.end(); it++, StepProgress(job, 1))
+		if (IsProgressCancelled(job) || !AddFileToArchive(it->fname, it->fname_rel))
 		{
-			EndProgress(0);
+			EndProgress(job, 0);
 			return 0;
 		}
 
-	EndProgress(1);
+	EndProgress(job, 1);
 
 	return (void*)1;
 }
@@ -5118,16 +7084,17 @@ static BOOL BackupSavesToArchive(FMEntry *fm)
 	if ( !BeginCreateArchive( bakarchive.c_str() ) )
 		goto abort;
 
-	InitProgress(g_backupList.size(), $("Archiving backup..."));
+	ProgressJob *job;
+	job = InitProgress(g_backupList.size(), $("Archiving backup..."));
 
-	if ( !CreateThreadOS(BackupSavesThread, NULL) )
+	if ( !SubmitTaskOS(NULL, BackupSavesThread, job) )
 	{
-		// if thread creation fails then run non-threaded (without progress bar), shouldn't normally happen
-		TermProgress();
+		// if the thread pool can't be started then run non-threaded (without progress bar), shouldn't normally happen
+		TermProgress(job);
 		bRes = (BackupSavesThread(NULL) != NULL);
 	}
 	else
-		bRes = RunProgress();
+		bRes = RunProgress(job);
 
 	bRes = EndCreateArchive(!bRes);
 
@@ -5157,16 +7124,18 @@ struct BackupDiffSetContext
 {
 	FMEntry *fm;
 	vector<const FileDiffInfo*> *changed;
+	ProgressJob *job;
 };
 static void* BackupDiffSetThread(void *p)
 {
 	BackupDiffSetContext *ctxt = (BackupDiffSetContext*)p;
 	vector<const FileDiffInfo*> &changed = *ctxt->changed;
+	ProgressJob *job = ctxt->job;
 
-	for (int i=0; i<(int)changed.size(); i++, StepProgress(1))
-		if ( !AddFileToArchive(changed[i]->fname, changed[i]->fname_rel) )
+	for (int i=0; i<(int)changed.size(); i++, StepProgress(job, 1))
+		if (IsProgressCancelled(job) || !AddFileToArchive(changed[i]->fname, changed[i]->fname_rel))
 		{
-			EndProgress(0);
+			EndProgress(job, 0);
 			return 0;
 		}
 
@@ -5191,10 +7160,10 @@ static void* BackupDiffSetThread(void *p)
 			}
 		}
 
-		StepProgress(1);
+		StepProgress(job, 1);
 	}
 
-	EndProgress(1);
+	EndProgress(job, 1);
 
 	return (void*)1;
 }
@@ -5220,8 +7189,8 @@ static BOOL BackupDiffSet(FMEntry *fm)
 		changed.push_back(&it->second);
 	std::sort(changed.begin(), changed.end(), compare_diffinfo_relname);
 
-	// optionally review changes
-	if (g_cfg.bReviewDiffBackup)
+	// optionally review changes (not in batch mode)
+	if (g_cfg.bReviewDiffBackup && !g_pBatchReport && !g_pMessageLog)
 	{
 		string html;
 
@@ -5263,27 +7232,25 @@ static BOOL BackupDiffSet(FMEntry *fm)
 
 	//
 
-	InitProgress(changed.size() + (g_removedFiles.empty() ? 0 : 1), $("Archiving backup..."));
-
 	BackupDiffSetContext ctxt;
 	ctxt.fm = fm;
 	ctxt.changed = &changed;
+	ctxt.job = InitProgress(changed.size() + (g_removedFiles.empty() ? 0 : 1), $("Archiving backup..."));
 
-	if ( !CreateThreadOS(BackupDiffSetThread, &ctxt) )
+	if ( !SubmitTaskOS(NULL, BackupDiffSetThread, &ctxt) )
 	{
-		// if thread creation fails then run non-threaded (without progress bar), shouldn't normally happen
-		TermProgress();
+		// if the thread pool can't be started then run non-threaded (without progress bar), shouldn't normally happen
+		TermProgress(ctxt.job);
+		ctxt.job = NULL;
 		bRes = (BackupDiffSetThread(&ctxt) != NULL);
 	}
 	else
-		bRes = RunProgress();
+		bRes = RunProgress(ctxt.job);
 
 abort:
 	if ( !EndCreateArchive(!bRes) )
 		bRes = FALSE;
 
-	TermProgress();
-
 	return bRes;
 }
 
@@ -5341,54 +7308,168 @@ static bool RemoveEnumeratedArchiveFile(const char *fname, void *p)
 }
 
 #ifdef AUDIO_SUPPORT
-static bool EnumAudioFiles(const char *fname, void *p)
+// get CMPSND_ type of a file that is converted to WAV during install, or -1 if it's not a compressed audio file
+static int GetCompressedAudioType(const char *fname)
 {
-	ASSERT(p != NULL);
-
-	std::list<std::pair<string,int>> *list = (std::list<std::pair<string,int>>*)p;
-
 	const int n = strlen(fname);
 	if (n > 4)
 	{
 #ifdef MP3_SUPPORT
 		if ( !_stricmp(fname+n-4, ".mp3") )
-		{
-			list->push_back(std::pair<string,int>(fname,CMPSND_MP3));
-			return true;
-		}
+			return CMPSND_MP3;
 #endif
 #ifdef OGG_SUPPORT
 		if ( !_stricmp(fname+n-4, ".ogg") )
-		{
-			list->push_back(std::pair<string,int>(fname,CMPSND_OGG));
-			return true;
-		}
+			return CMPSND_OGG;
 #endif
 #ifdef OPUS_SUPPORT
 		if ( !_stricmp(fname+n-4, ".opus") )
-		{
-			list->push_back(std::pair<string,int>(fname,CMPSND_OPUS));
-			return true;
-		}
+			return CMPSND_OPUS;
 #endif
 #ifdef FLAC_SUPPORT
 		if ( !_stricmp(fname+n-4, ".flac") || !_stricmp(fname+n-4, ".oga") )
-		{
-			list->push_back(std::pair<string,int>(fname,CMPSND_FLAC));
-			return true;
-		}
+			return CMPSND_FLAC;
 #endif
 	}
 
-	return true;
+	return -1;
 }
 #endif
 
+// headers of all files in an FM archive gathered in a single pass, shared by install, uninstall (differential backup),
+// language detection and the archive contents view instead of each of them enumerating the archive again
+struct ArchiveManifestFile
+{
+	string name;
+	unsigned __int64 size;
+	time_t mtime;
+#ifdef AUDIO_SUPPORT
+	int audio;	// CMPSND_ type or -1
+#endif
+};
+
+struct ArchiveManifest
+{
+	string archive;
+	// size and mtime of the archive file when the manifest was generated, to detect if it has to be regenerated
+	unsigned __int64 archiveSize;
+	time_t archiveMTime;
+
+	vector<ArchiveManifestFile> files;
+	unsigned __int64 totalSize;
+};
+
+#define MANIFEST_CACHE_MAX	16
+
+// manifests of recently accessed FM archives, most recently used last
+static vector<ArchiveManifest*> g_manifestCache;
+
+static bool AddManifestFile(const char *fname, unsigned __int64 fsize, time_t ftime, void *p)
+{
+	ASSERT(p != NULL);
+
+	ArchiveManifest *m = (ArchiveManifest*)p;
+
+	ArchiveManifestFile f;
+	f.name = fname;
+	f.size = fsize;
+	f.mtime = ftime;
+#ifdef AUDIO_SUPPORT
+	f.audio = GetCompressedAudioType(fname);
+#endif
+
+	m->files.push_back(f);
+	m->totalSize += fsize;
+
+	return true;
+}
+
+// generate manifest for 'archive', caller must delete it. if bReopen is set then the archive is reopened even if it's
+// the one currently open in the archive backend (for archives that may have been rewritten, like backup archives)
+static ArchiveManifest* BuildArchiveManifest(const char *archive, BOOL bReopen, const char **ppErrMsg = NULL)
+{
+	ArchiveManifest *m = new ArchiveManifest;
+	m->archive = archive;
+	m->archiveSize = 0;
+	m->archiveMTime = 0;
+	m->totalSize = 0;
+
+	if ( !GetFileSizeAndMTimeOS(archive, m->archiveSize, m->archiveMTime) )
+	{
+		delete m;
+		return NULL;
+	}
+
+	if (bReopen)
+		ReopenArchive(archive);
+
+	if ( !EnumFullArchiveEx(archive, AddManifestFile, m, ppErrMsg) )
+	{
+		delete m;
+		return NULL;
+	}
+
+	return m;
+}
+
+// get manifest for an FM archive, from cache if the archive hasn't changed since it was generated. the returned
+// object belongs to the cache and shouldn't be held on to across other GetArchiveManifest calls. bReopen is
+// passed on to BuildArchiveManifest if the manifest has to be generated
+static const ArchiveManifest* GetArchiveManifest(const char *archive, BOOL bReopen = FALSE, const char **ppErrMsg = NULL)
+{
+	unsigned __int64 sz = 0;
+	time_t tm = 0;
+	const BOOL bStatOk = GetFileSizeAndMTimeOS(archive, sz, tm);
+
+	for (int i=(int)g_manifestCache.size()-1; i>=0; i--)
+	{
+		ArchiveManifest *m = g_manifestCache[i];
+		if (m->archive != archive)
+			continue;
+
+		g_manifestCache.erase(g_manifestCache.begin() + i);
+
+		if (!bStatOk || m->archiveSize != sz || m->archiveMTime != tm)
+		{
+			// archive has changed
+			delete m;
+			break;
+		}
+
+		g_manifestCache.push_back(m);
+
+		return m;
+	}
+
+	ArchiveManifest *m = BuildArchiveManifest(archive, bReopen, ppErrMsg);
+	if (!m)
+		return NULL;
+
+	if (g_manifestCache.size() >= MANIFEST_CACHE_MAX)
+	{
+		delete g_manifestCache.front();
+		g_manifestCache.erase( g_manifestCache.begin() );
+	}
+
+	g_manifestCache.push_back(m);
+
+	return m;
+}
+
+static void FreeArchiveManifests()
+{
+	for (size_t i=0; i<g_manifestCache.size(); i++)
+		delete g_manifestCache[i];
+
+	g_manifestCache.clear();
+}
+
 #if AUDIO_SUPPORT
 struct AudioContext
 {
 	std::list<std::pair<string,int>> *audiofiles;
 	const char *installdir;
+	ProgressJob *job;
 };
 
 static void* AudioThread(void *p)
@@ -5401,8 +7482,14 @@ static void* AudioThread(void *p)
 	string cmp, wav;
 	BOOL bOK = TRUE;
 
-	for (std::list<std::pair<string,int>>::iterator it=audiofiles.begin(); it!=audiofiles.end(); it++, StepProgress(1))
+	for (std::list<std::pair<string,int>>::iterator it=audiofiles.begin(); it!=audiofiles.end(); it++, StepProgress(ctx->job, 1))
 	{
+		if ( IsProgressCancelled(ctx->job) )
+		{
+			bOK = FALSE;
+			break;
+		}
+
 		cmp = installdir;
 		cmp += DIRSEP_STR;
 		cmp += it->first;
@@ -5456,11 +7543,11 @@ static void* AudioThread(void *p)
 
 	if (!bOK)
 	{
-		EndProgress(0);
+		EndProgress(ctx->job, 0);
 		return 0;
 	}
 
-	EndProgress(1);
+	EndProgress(ctx->job, 1);
 
 	return (void*)1;
 }
@@ -5469,29 +7556,32 @@ static void* AudioThread(void *p)
 #ifdef AUDIO_SUPPORT
 static BOOL ConvertAudioFiles(std::list<std::pair<string,int>> &audiofiles, const char *installdir)
 {
+	TRACE_SCOPE("ConvertAudioFiles", installdir);
+
 	if ( audiofiles.empty() )
 		return TRUE;
 
-	InitProgress(audiofiles.size(), $("Converting Audio..."));
+	BOOL bRes, bCancelled = FALSE;
 
-	BOOL bRes;
+	AudioContext ctx = { &audiofiles, installdir, InitProgress(audiofiles.size(), $("Converting Audio...")) };
 
-	AudioContext ctx = { &audiofiles, installdir };
-
-	if ( !CreateThreadOS(AudioThread, &ctx) )
+	if ( !SubmitTaskOS(NULL, AudioThread, &ctx) )
 	{
-		// if thread creation fails then run non-threaded (without progress bar), shouldn't normally happen
-		TermProgress();
+		// if the thread pool can't be started then run non-threaded (without progress bar), shouldn't normally happen
+		TermProgress(ctx.job);
+		ctx.job = NULL;
 		bRes = (AudioThread(&ctx) != NULL);
 	}
 	else
-		bRes = RunProgress();
+		bRes = RunProgress(ctx.job, &bCancelled);
+
+	// cancelled by user, abort install
+	if (bCancelled)
+		return FALSE;
 
 	if (!bRes)
 	{
-		fl_message_position(pMainWnd);
-
-		if ( !fl_choice("%s", fl_cancel, fl_ok, NULL, $("Audio conversion failed partially or completely, proceed anyway?")) )
+		if ( !FmChoice(0, "%s", fl_cancel, fl_ok, NULL, $("Audio conversion failed partially or completely, proceed anyway?")) )
 			return FALSE;
 	}
 
@@ -5515,10 +7605,8 @@ static BOOL rename_instdir_safe(const char *src, const char *dst)
 				if ( fl_rename(src, dst) )
 				{
 retry:
-					fl_message_position(pMainWnd);
-
 					// notify user and allow one user-invoked retry
-					const int ret = fl_choice(
+					const int ret = FmChoice(0,
 						$("Failed to move the FM directory from the temp extraction location to the FM path:\n"
 						"\"%s\" -> \"%s\"\n"
 						"\n"
@@ -5658,15 +7746,13 @@ static void CheckMissionFlags(const char *installdir)
 	}
 	else if (_snprintf_s(fpath, sizeof(fpath), _TRUNCATE, "%s" DIRSEP_STR "strings", installdir) == -1 || fl_mkdir(fpath, DEF_DIR_MODE))
 	{
-		fl_message_position(pMainWnd);
-		fl_alert("%s", $("Failed to create \"strings\" directory for mission flags."));
+		FmAlert("%s", $("Failed to create \"strings\" directory for mission flags."));
 		return;
 	}
 
 	if (strlen(fpath)+14 > MAX_PATH_BUF)
 	{
-		fl_message_position(pMainWnd);
-		fl_alert("%s", $("Failed to generate mission flags, path too long."));
+		FmAlert("%s", $("Failed to generate mission flags, path too long."));
 		return;
 	}
 	strcat(fpath, DIRSEP_STR "missflag.str");
@@ -5676,8 +7762,7 @@ static void CheckMissionFlags(const char *installdir)
 	FILE *f = fl_fopen(fpath, "wb");
 	if (!f)
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Failed to open file \"%s\" for writing."), fpath);
+		FmAlert($("Failed to open file \"%s\" for writing."), fpath);
 		return;
 	}
 
@@ -5699,82 +7784,165 @@ static void CheckMissionFlags(const char *installdir)
 }
 
 
-static BOOL InstallFM(FMEntry *fm)
+// state of an install from the checks before extraction to moving the extracted FM to its final location, shared
+// by InstallFM and the install queue
+struct InstallContext
+{
+	FMEntry *fm;
+	string archivepath;
+	string bakarchive;
+	BOOL bHasBak;
+	// temp dir the FM is extracted to
+	string tmpdir;
+	char installdir[MAX_PATH_BUF];
+
+	// size of unpacked archive and backup files (the manifests themselves aren't kept, see GetArchiveManifest)
+	BOOL szOk;
+	BOOL szBakOk;
+	unsigned __int64 sz;
+	unsigned __int64 szBak;
+
+#ifdef AUDIO_SUPPORT
+	std::list<std::pair<string,int>> compressedSndFiles;
+#endif
+};
+
+// check if 'fm' can be installed and gather what the install needs, returns FALSE (after FmAlert) if it can't
+static BOOL PrepareInstall(FMEntry *fm, InstallContext &ctx)
 {
-	ASSERT( !fm->IsInstalled() );
+	// (may have turned out to be installed after all if a startup scan was pending)
+	if ( fm->IsInstalled() )
+		return FALSE;
 
 	if ( g_sTempDir.empty() )
 	{
 		// shouldn't get here
-		fl_message_position(pMainWnd);
-		fl_alert("%s", $("No temp/cache directory available, cannot install."));
+		FmAlert("%s", $("No temp/cache directory available, cannot install."));
 		return FALSE;
 	}
 
 	if ( !IsSafeFmDir(fm) )
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("FM directory name \"%s\" is invalid, cannot install."), fm->name);
+		FmAlert($("FM directory name \"%s\" is invalid, cannot install."), fm->name);
 		return FALSE;
 	}
 
-	string archivepath = fm->GetArchiveFilePath();
-	string bakarchive = fm->GetBakArchiveFilePath();
+	ctx.fm = fm;
+	ctx.archivepath = fm->GetArchiveFilePath();
+	ctx.bakarchive = fm->GetBakArchiveFilePath();
 
 	// make sure the archive is available
 	struct stat st = {};
-	if (fl_stat(archivepath.c_str(), &st) || !(st.st_mode & S_IREAD))
+	if (fl_stat(ctx.archivepath.c_str(), &st) || !(st.st_mode & S_IREAD))
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Failed to find archive file \"%s\"."), archivepath.c_str());
+		FmAlert($("Failed to find archive file \"%s\"."), ctx.archivepath.c_str());
 		return FALSE;
 	}
 
-	char installdir[MAX_PATH_BUF];
-	if (_snprintf_s(installdir, sizeof(installdir), _TRUNCATE, "%s" DIRSEP_STR "%s", GetRootPath(), fm->name) == -1)
+	if (_snprintf_s(ctx.installdir, sizeof(ctx.installdir), _TRUNCATE, "%s" DIRSEP_STR "%s", GetRootPath(), fm->name) == -1)
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Cannot install, path too long \"%s\"."), installdir);
+		FmAlert($("Cannot install, path too long \"%s\"."), ctx.installdir);
 		return FALSE;
 	}
 
 	// ensure that install dir is gone (if there is one and it isn't an install of this fm, which it can't be if we
 	// end up in this install function, then something is very screwy)
-	if ( !fl_stat(installdir, &st) )
+	if ( !fl_stat(ctx.installdir, &st) )
 	{
-		fl_message_position(pMainWnd);
-		fl_alert($("Cannot install, there already is a directory \"%s\"."), installdir);
+		FmAlert($("Cannot install, there already is a directory \"%s\"."), ctx.installdir);
 		return FALSE;
 	}
 
 	// generate tmp dir to extract to
-	string tmpdir;
-	if ( !GetTempFile(fm->name, tmpdir, TRUE) )
+	if ( !GetTempFile(fm->name, ctx.tmpdir, TRUE) )
 	{
 		// uninstall failed, could not get tmp dir name (should never happen)
 		ASSERT(FALSE);
 		return FALSE;
 	}
 
+	ctx.bHasBak = !fl_stat(ctx.bakarchive.c_str(), &st);
+
+	// scan archive headers once, everything up to the extraction works off of the manifest
+	const ArchiveManifest *manifest = GetArchiveManifest( ctx.archivepath.c_str() );
+	const ArchiveManifest *bakManifest = ctx.bHasBak ? GetArchiveManifest(ctx.bakarchive.c_str(), TRUE) : NULL;
+
 	// get list of compressed audio files
 #ifdef AUDIO_SUPPORT
-	std::list<std::pair<string,int>> compressedSndFiles;
+	ctx.compressedSndFiles.clear();
 #endif
 #ifdef T3_SUPPORT
 	if (!g_bRunningThief3)
 	{
 #endif
 #ifdef AUDIO_SUPPORT
-	if (g_cfg.bDecompressAudio)
-		EnumFullArchive(archivepath.c_str(), EnumAudioFiles, &compressedSndFiles);
+	if (g_cfg.bDecompressAudio && manifest)
+	{
+		for (size_t i=0; i<manifest->files.size(); i++)
+			if (manifest->files[i].audio >= 0)
+				ctx.compressedSndFiles.push_back( std::pair<string,int>(manifest->files[i].name, manifest->files[i].audio) );
+	}
 #endif
 #ifdef T3_SUPPORT
 	}
 #endif
 
+	// determine size of unpacked archive and backup files
+	ctx.szOk = manifest != NULL;
+	ctx.szBakOk = bakManifest != NULL;
+	ctx.sz = ctx.szOk ? manifest->totalSize : 0;
+	ctx.szBak = ctx.szBakOk ? bakManifest->totalSize : 0;
+
+	return TRUE;
+}
+
+// generate Thief mission flags for an extracted FM, if enabled
+static void GenerateMissionFlags(const char *dir)
+{
+#ifdef T3_SUPPORT
+	if (!g_bRunningShock && !g_bRunningThief3 && g_cfg.bGenerateMissFlags)
+#else
+	if (!g_bRunningShock && g_cfg.bGenerateMissFlags)
+#endif
+		CheckMissionFlags(dir);
+}
+
+// final step of an install, moves the extracted FM from the temp dir to the FM path to "go live"
+static BOOL CommitInstall(InstallContext &ctx)
+{
+	if ( !SaveInstallInfo(ctx.fm, ctx.tmpdir.c_str()) )
+	{
+		ASSERT(FALSE);
+		// TODO: should we handle if this fails? a bit lame to fail an install because of that, there is after all
+		//       redundancy for the contained information in the main db
+	}
+
+	if ( !rename_instdir_safe(ctx.tmpdir.c_str(), ctx.installdir) )
+	{
+		DelTree( ctx.tmpdir.c_str() );
+		FmAlert("%s", $("Failed to move install dir to final location, install aborted."));
+		return FALSE;
+	}
+
+	ctx.fm->flags |= FMEntry::FLAG_Installed;
+	SyncHotFields(ctx.fm);
+
+	return TRUE;
+}
+
+static BOOL InstallFM(FMEntry *fm)
+{
+	TRACE_SCOPE("InstallFM", fm->name);
+
+	FinishStartupScan();
+
+	InstallContext ctx;
+	if ( !PrepareInstall(fm, ctx) )
+		return FALSE;
+
 	// get list of language packs
 	/*std::list<string> langpacks;
-	const BOOL bHasLangPacks = GetLanguagePacks(archivepath.c_str(), langpacks);*/
+	const BOOL bHasLangPacks = GetLanguagePacks(ctx.archivepath.c_str(), langpacks);*/
 
 	//
 
@@ -5782,29 +7950,24 @@ static BOOL InstallFM(FMEntry *fm)
 	const unsigned __int64 MIN_FREE_MB = 16;
 	const unsigned __int64 MIN_PROGRESS_MB = 10;
 
-	unsigned __int64 sz = 0, szBak = 0, disk = 0;
-	unsigned int foo;
-	// determine size of unpacked archive
-	const BOOL szOk = GetUnpackedArchiveSize(archivepath.c_str(), sz, foo);
-	// determine size of unpacked backup files
-	const BOOL szBakOk = GetUnpackedArchiveSize(bakarchive.c_str(), szBak, foo, true);
+	unsigned __int64 disk = 0;
 	// determine free disk size
 	const BOOL bDiskOk = GetFreeDiskSpaceOS(GetRootPath(), disk);
 
 	// skip progress bar for install when (unpacked) archive size is very small
-	const BOOL bShowProgress = !szOk || sz >= (MIN_PROGRESS_MB * MB);
-	const BOOL bShowBakProgress = !szBakOk || szBak >= (MIN_PROGRESS_MB * MB);
+	const BOOL bShowProgress = !ctx.szOk || ctx.sz >= (MIN_PROGRESS_MB * MB);
+	const BOOL bShowBakProgress = !ctx.szBakOk || ctx.szBak >= (MIN_PROGRESS_MB * MB);
 
 	char s1[256], s2[64];
-	FormatFileSizeValue(s1, sz+szBak);
+	FormatFileSizeValue(s1, ctx.sz+ctx.szBak);
 	if (bDiskOk)
 		FormatFileSizeValue(s2, disk * MB);
 	else
 		strcpy(s2, $("N/A"));
 
 #ifdef AUDIO_SUPPORT
-	if ( !compressedSndFiles.empty() )
-		sprintf(s1+strlen(s1), $(" + %d compressed audio file(s), size unknown"), compressedSndFiles.size());
+	if ( !ctx.compressedSndFiles.empty() )
+		sprintf(s1+strlen(s1), $(" + %d compressed audio file(s), size unknown"), ctx.compressedSndFiles.size());
 #endif
 
 	// TODO: if bHasLangPacks then display a fancier install dialog with a droplist of available lang packs (and "None"),
@@ -5812,12 +7975,10 @@ static BOOL InstallFM(FMEntry *fm)
 	//       needs to check for MP3 files there too, and differential backups need to make sure files don't belong to
 	//       the language pack, ick!)
 
-	fl_message_position(pMainWnd);
-
-	if (bDiskOk && szOk && disk < ((sz+szBak)/MB) + MIN_FREE_MB)
+	if (bDiskOk && ctx.szOk && disk < ((ctx.sz+ctx.szBak)/MB) + MIN_FREE_MB)
 	{
 		// low diskspace warning
-		if ( !fl_choice(
+		if ( !FmChoice(0,
 			$("WARNING: You will/may run out of disk space!\n"
 			"\n"
 			"Install/Extract FM from archive anyway?\n"
@@ -5829,7 +7990,7 @@ static BOOL InstallFM(FMEntry *fm)
 	}
 	else
 	{
-		if ( !fl_choice(
+		if ( !FmChoice(1,
 			$("Install/Extract FM from archive?\n"
 			"\n"
 			"Est. install size  : %s\n"
@@ -5840,76 +8001,73 @@ static BOOL InstallFM(FMEntry *fm)
 
 	//
 
+	const char *tmpdir = ctx.tmpdir.c_str();
 	const char *pErrMsg = NULL;
 
-	fl_message_position(pMainWnd);
-
-	BOOL bRet = ExtractFullArchive(archivepath.c_str(), tmpdir.c_str(), bShowProgress ? $("Installing...") : NULL, &pErrMsg);
+	BOOL bRet = ExtractFullArchive(ctx.archivepath.c_str(), tmpdir, bShowProgress ? $("Installing...") : NULL, &pErrMsg);
 	if (!bRet)
 	{
-		DelTree( tmpdir.c_str() );
+		DelTree(tmpdir);
 
-		fl_message_position(pMainWnd);
-		fl_alert($("Failed to extract FM archive, install aborted.\n\nError: %s"), pErrMsg ? pErrMsg : $("unknown error"));
+		FmAlert($("Failed to extract FM archive, install aborted.\n\nError: %s"), pErrMsg ? pErrMsg : $("unknown error"));
 
 		return FALSE;
 	}
 	else if (bRet == 2)
 	{
 		// partial failure, ask if user wants to risk it anyway
-		if ( !fl_choice(
+		if ( !FmChoice(0,
 			$("Partially failed to extract FM archive.\n\nError: %s\nInstall FM anyway?"),
 			fl_no, fl_yes, NULL, pErrMsg ? pErrMsg : $("unknown error")) )
 		{
-			DelTree( tmpdir.c_str() );
+			DelTree(tmpdir);
 			return FALSE;
 		}
 	}
 
 #ifdef AUDIO_SUPPORT
 	// convert compressed audio to WAVs
-	if ( !ConvertAudioFiles(compressedSndFiles, tmpdir.c_str()) )
+	if ( !ConvertAudioFiles(ctx.compressedSndFiles, tmpdir) )
 	{
-		DelTree( tmpdir.c_str() );
+		DelTree(tmpdir);
 
 		return FALSE;
 	}
 #endif
 
-	// generate Thief mission flags
-#ifdef T3_SUPPORT
-	if (!g_bRunningShock && !g_bRunningThief3 && g_cfg.bGenerateMissFlags)
-#else
-	if (!g_bRunningShock && g_cfg.bGenerateMissFlags)
-#endif
-		CheckMissionFlags(tmpdir.c_str());
+	GenerateMissionFlags(tmpdir);
 
 	// restore savegames/screenshots
-	if ( !fl_stat(bakarchive.c_str(), &st) )
+	if (ctx.bHasBak)
 	{
 		pErrMsg = NULL;
 
 		// make sure there's no fmsel.inf in the main FM archive (with potentially malicious content to remove files
 		// outside of install dir)
-		const BOOL bInstallInfoSafe = !unlink_forced( (tmpdir + DIRSEP_STR "fmsel.inf").c_str() ) || errno == ENOENT;
+		const BOOL bInstallInfoSafe = !unlink_forced( (ctx.tmpdir + DIRSEP_STR "fmsel.inf").c_str() ) || errno == ENOENT;
 
-		if (ExtractFullArchive(bakarchive.c_str(), tmpdir.c_str(), bShowBakProgress ? $("Restoring backup...") : NULL, &pErrMsg) != 1)
+		if (ExtractFullArchive(ctx.bakarchive.c_str(), tmpdir, bShowBakProgress ? $("Restoring backup...") : NULL, &pErrMsg) != 1)
 		{
-			fl_message_position(pMainWnd);
-
 			// extraction failed completely or partially
-			if ( fl_choice(
+			if ( FmChoice(1,
 				$("Failed to restore backed up file (savegames, screenshots and possibly more).\n"
 				"If you proceed the install may be broken and the backed up files may be lost during next uninstall.\n"
 				"Continue anyway?\n\nError: %s"),
 				fl_yes, fl_no, NULL, pErrMsg ? pErrMsg : $("unknown error")) )
 			{
-				DelTree( tmpdir.c_str() );
+				DelTree(tmpdir);
 				return FALSE;
 			}
 
 			// delete saves and screenshots that were partially restored (for differential backups this could end badly)
-			EnumFullArchive(bakarchive.c_str(), RemoveEnumeratedArchiveFile, installdir);
+			const ArchiveManifest *bakManifest = GetArchiveManifest(ctx.bakarchive.c_str(), TRUE);
+			if (bakManifest)
+			{
+				for (size_t i=0; i<bakManifest->files.size(); i++)
+					RemoveEnumeratedArchiveFile(bakManifest->files[i].name.c_str(), ctx.installdir);
+			}
+			else
+				EnumFullArchive(ctx.bakarchive.c_str(), RemoveEnumeratedArchiveFile, ctx.installdir);
 		}
 		else if (bInstallInfoSafe)
 		{
@@ -5918,23 +8076,8 @@ static BOOL InstallFM(FMEntry *fm)
 		}
 	}
 
-	if ( !SaveInstallInfo(fm, tmpdir.c_str()) )
-	{
-		ASSERT(FALSE);
-		// TODO: should we handle if this fails? a bit lame to fail an install because of that, there is after all
-		//       redundancy for the contained information in the main db
-	}
-
-	// install successful, the final step now is to move the temp dir to the actual location to "go live"
-	if ( rename_instdir_safe(tmpdir.c_str(), installdir) )
-		fm->flags |= FMEntry::FLAG_Installed;
-	else
-	{
-		DelTree( tmpdir.c_str() );
-		fl_message_position(pMainWnd);
-		fl_alert("%s", $("Failed to move install dir to final location, install aborted."));
+	if ( !CommitInstall(ctx) )
 		return FALSE;
-	}
 
 	RedrawListControl(TRUE);
 
@@ -6083,29 +8226,47 @@ static bool ClearDiffInfoFileEntry(const char *fname)
 	return false;
 }
 
-static BOOL UninstallFM(FMEntry *fm)
+// question asked before deleting the install dir of an FM
+static const char* GetUninstallConfirmMsg(BOOL bBackupSaves, BOOL bDiffBackup)
 {
-	fl_message_position(pMainWnd);
+	if (bDiffBackup)
+		return $("All files in the install dir will be deleted, any modified/added/removed files are backed up.\nProceed with uninstall?");
+
+	return bBackupSaves
+		? $("All files in the install dir will be deleted, any modified/added files,\nexcept savegames and screenshots, will be lost.\nProceed with uninstall?")
+		: $("All files in the install dir will be deleted, any modified/added files,\nsavegames and screenshots will be lost!\nProceed with uninstall?");
+}
+
+// 'backup' is the answer to the backup question if it was already asked (1 = backup, 2 = no backup)
+static BOOL UninstallFM(FMEntry *fm, int backup)
+{
+	TRACE_SCOPE("UninstallFM", fm->name);
+
+	FinishStartupScan();
+
+	if ( !fm->IsInstalled() )
+		return FALSE;
 
 	if ( g_sTempDir.empty() )
 	{
 		// shouldn't get here
-		fl_alert("%s", $("No temp/cache directory available, cannot uninstall."));
+		FmAlert("%s", $("No temp/cache directory available, cannot uninstall."));
 		return FALSE;
 	}
 
 	if ( !IsSafeFmDir(fm) )
 	{
-		fl_alert($("FM directory name \"%s\" is invalid, cannot uninstall."), fm->name);
+		FmAlert($("FM directory name \"%s\" is invalid, cannot uninstall."), fm->name);
 		return FALSE;
 	}
 
-	const int backup = fl_choice(
-		"%s", fl_cancel, fl_yes, fl_no,
-		g_cfg.bDiffBackups
-			? $("Backup all modified/added/removed files (including savegames and screenshots)?")
-			: $("Backup savegames and screenshots?")
-		);
+	if (!backup)
+		backup = FmChoice(1,
+			"%s", fl_cancel, fl_yes, fl_no,
+			g_cfg.bDiffBackups
+				? $("Backup all modified/added/removed files (including savegames and screenshots)?")
+				: $("Backup savegames and screenshots?")
+			);
 	if (!backup)
 		return FALSE;
 
@@ -6118,11 +8279,7 @@ static BOOL UninstallFM(FMEntry *fm)
 	{
 		// differential backup (backs up all added files and files that differ in mtime or size from FM archive)
 
-		const char *msg = $("All files in the install dir will be deleted, any modified/added/removed files are backed up.\nProceed with uninstall?");
-
-		fl_message_position(pMainWnd);
-
-		if ( !fl_choice("%s", fl_cancel, fl_ok, NULL, msg) )
+		if ( !FmChoice(1, "%s", fl_cancel, fl_ok, NULL, GetUninstallConfirmMsg(bBackupSaves, bDiffBackup)) )
 			return FALSE;
 
 		// do backup first, only if that succeeded we do a "deltree"
@@ -6130,8 +8287,7 @@ static BOOL UninstallFM(FMEntry *fm)
 		char installdir[MAX_PATH_BUF];
 		if (_snprintf_s(installdir, sizeof(installdir), _TRUNCATE, "%s" DIRSEP_STR "%s", GetRootPath(), fm->name) == -1)
 		{
-			fl_message_position(pMainWnd);
-			fl_alert("%s", $("Path too long, uninstall aborted."));
+			FmAlert("%s", $("Path too long, uninstall aborted."));
 			return FALSE;
 		}
 
@@ -6145,22 +8301,28 @@ static BOOL UninstallFM(FMEntry *fm)
 		// enumerate all files in the install dir with mtime and size into
 		if ( !EnumFileDiffInfo(installdir, strlen(installdir)) )
 		{
-			fl_message_position(pMainWnd);
-			fl_alert("%s", $("Failed to scan files to make backup, uninstall aborted."));
+			FmAlert("%s", $("Failed to scan files to make backup, uninstall aborted."));
 			bRet = FALSE;
 		}
 		else
 		{
-			// remove all files from g_fileDiffInfoMap that are identical to FM archive
+			// remove all files from g_fileDiffInfoMap that are identical to FM archive (normally the manifest is
+			// still cached from the install)
 			const char *pErrMsg = NULL;
-			if ( !EnumFullArchiveEx(fm->GetArchiveFilePath().c_str(), ClearIdenticalEnumeratedArchiveFile, installdir, &pErrMsg) )
+			const ArchiveManifest *manifest = GetArchiveManifest(fm->GetArchiveFilePath().c_str(), FALSE, &pErrMsg);
+			if (!manifest)
 			{
-				fl_message_position(pMainWnd);
-				fl_alert($("Failed to determine changed files for backup, uninstall aborted\n\nArchive Error: %s"), pErrMsg ? pErrMsg : "unknown error");
+				FmAlert($("Failed to determine changed files for backup, uninstall aborted\n\nArchive Error: %s"), pErrMsg ? pErrMsg : "unknown error");
 				bRet = FALSE;
 			}
 			else
 			{
+				for (size_t i=0; i<manifest->files.size(); i++)
+				{
+					const ArchiveManifestFile &f = manifest->files[i];
+					ClearIdenticalEnumeratedArchiveFile(f.name.c_str(), f.size, f.mtime, installdir);
+				}
+
 				// remove install info from backup set
 				ClearDiffInfoFileEntry("fmsel.inf");
 				// remove thief checkpoint save
@@ -6174,8 +8336,7 @@ static BOOL UninstallFM(FMEntry *fm)
 				// backup all files remaining in g_fileDiffInfoMap
 				if ( !BackupDiffSet(fm) )
 				{
-					fl_message_position(pMainWnd);
-					fl_alert("%s", $("Failed to backup changed files, uninstall aborted."));
+					FmAlert("%s", $("Failed to backup changed files, uninstall aborted."));
 
 					bRet = FALSE;
 				}
@@ -6185,8 +8346,7 @@ static BOOL UninstallFM(FMEntry *fm)
 
 					if (!bRet)
 					{
-						fl_message_position(pMainWnd);
-						fl_alert("%s", bBackupSaves
+						FmAlert("%s", bBackupSaves
 							? $("Failed to delete install directory, uninstall aborted (backup archive was still created/updated).")
 							: $("Failed to delete install directory, uninstall aborted."));
 					}
@@ -6201,26 +8361,20 @@ static BOOL UninstallFM(FMEntry *fm)
 	}
 	else
 	{
-		const char *msg = bBackupSaves
-			? $("All files in the install dir will be deleted, any modified/added files,\nexcept savegames and screenshots, will be lost.\nProceed with uninstall?")
-			: $("All files in the install dir will be deleted, any modified/added files,\nsavegames and screenshots will be lost!\nProceed with uninstall?");
-
-		fl_message_position(pMainWnd);
-
-		if ( !fl_choice("%s", fl_cancel, fl_ok, NULL, msg) )
+		if ( !FmChoice(1, "%s", fl_cancel, fl_ok, NULL, GetUninstallConfirmMsg(bBackupSaves, bDiffBackup)) )
 			return FALSE;
 
 		// do backup first, only if that succeeded we do a "deltree"
 		if (bBackupSaves && !BackupSavesToArchive(fm))
 		{
-			fl_alert("%s", $("Failed to backup savegames and screenshots, uninstall aborted."));
+			FmAlert("%s", $("Failed to backup savegames and screenshots, uninstall aborted."));
 			return FALSE;
 		}
 
 		bRet = FmDelTree(fm);
 
 		if (!bRet)
-			fl_alert("%s", bBackupSaves
+			FmAlert("%s", bBackupSaves
 				? $("Failed to delete install directory, uninstall aborted (backup archive was still created/updated)")
 				: $("Failed to delete install directory, uninstall aborted"));
 	}
@@ -6231,524 +8385,1188 @@ static BOOL UninstallFM(FMEntry *fm)
 }
 
 
-static BOOL DeleteFM(FMEntry *fm)
-{
-	if (!fm)
-	{
-		ASSERT(FALSE);
-		return FALSE;
-	}
-
-	// select next (or previous if last) list entry before removing the old
-	if (GetCurSelFM() == fm)
-		SelectNeighborFM();
+// installing/uninstalling several FMs in one go (multi-selection in the FM list, or "install *" in batch mode).
+// extraction, audio conversion and backup restore of up to 'g_cfg.nInstallSlots' FMs run at the same time on the
+// thread pool, each with its own job in the jobs panel, while the main thread does the checks before and the final
+// steps after. with a throughput budget ('g_cfg.nInstallMBps') another install is only started when the measured
+// disk throughput leaves room for it. instead of a message box for each failure the outcome of every FM is collected
+// and shown in a summary at the end
+//
+// uninstalls are done one FM at a time, creating the backup archive relies on global state
 
-	InvalidateTagDb();
+#define INSTALL_QUEUE_MAX_AUTO_SLOTS	4
 
-	g_bDbModified = TRUE;
+// queue item state
+enum
+{
+	IQ_Pending,
+	IQ_Running,
+	IQ_Done,
+	IQ_Failed,
+	IQ_Cancelled,
+};
 
-	g_dbHash.erase( KEY(fm->name) );
-	g_db.erase(g_db.begin() + GetDbIndex(fm));
+// install steps done by the worker that can fail
+enum
+{
+	IQF_None,
+	IQF_Extract,
+	IQF_PartialExtract,
+	IQF_Audio,
+	IQF_Restore,
+};
 
-	delete fm;
+struct InstallQueueItem
+{
+	FMEntry *fm;
+	int state;
+	double tmStart;
+	double tmEnd;
+	// FmAlert messages while working on this FM
+	vector<string> messages;
+
+	// installs only
+	InstallContext ctx;
+	ProgressJob *job;
+	// set by the worker
+	int nFailStep;
+	const char *pErrMsg;
+	BOOL bInstallInfoSafe;
+
+	InstallQueueItem()
+	{
+		fm = NULL;
+		state = IQ_Pending;
+		tmStart = tmEnd = 0;
+		job = NULL;
+		nFailStep = IQF_None;
+		pErrMsg = NULL;
+		bInstallInfoSafe = FALSE;
+	}
+};
 
-	RefreshFilteredDb();
+// the part of an install that runs on a worker thread, same steps as in InstallFM except that anything that would
+// ask the user there aborts the install
+static void* InstallQueueThread(void *p)
+{
+	InstallQueueItem &item = *(InstallQueueItem*)p;
+	InstallContext &ctx = item.ctx;
 
-	RemoveDeadTagFilters();
+	TRACE_SCOPE("InstallQueueThread", item.fm->name);
 
-	return TRUE;
-}
+	const int ret = ExtractFullArchiveMT(ctx.archivepath.c_str(), ctx.tmpdir.c_str(), item.job, &item.pErrMsg);
+	if (ret != 1)
+	{
+		item.nFailStep = ret ? IQF_PartialExtract : IQF_Extract;
+		EndProgress(item.job, 0);
+		return 0;
+	}
 
+#ifdef AUDIO_SUPPORT
+	// convert compressed audio to WAVs
+	if ( !ctx.compressedSndFiles.empty() && !IsProgressCancelled(item.job) )
+	{
+		AudioContext actx = { &ctx.compressedSndFiles, ctx.tmpdir.c_str(), NULL };
+		if ( !AudioThread(&actx) )
+		{
+			item.nFailStep = IQF_Audio;
+			EndProgress(item.job, 0);
+			return 0;
+		}
+	}
+#endif
 
-// purge the database of all entries for deleted fms
-static void CleanDb()
-{
-	unsigned int i = 0;
-	while (i<g_db.size())
+	// restore savegames/screenshots
+	if (ctx.bHasBak && !IsProgressCancelled(item.job))
 	{
-		if (!g_db[i]->IsArchived() && !g_db[i]->IsInstalled())
-			DeleteFM(g_db[i]);
-		else
-			i++;
+		// make sure there's no fmsel.inf in the main FM archive (see InstallFM)
+		item.bInstallInfoSafe = !unlink_forced( (ctx.tmpdir + DIRSEP_STR "fmsel.inf").c_str() ) || errno == ENOENT;
+
+		item.pErrMsg = NULL;
+
+		if (ExtractFullArchiveMT(ctx.bakarchive.c_str(), ctx.tmpdir.c_str(), NULL, &item.pErrMsg) != 1)
+		{
+			item.nFailStep = IQF_Restore;
+			EndProgress(item.job, 0);
+			return 0;
+		}
 	}
+
+	EndProgress(item.job, !IsProgressCancelled(item.job));
+
+	return (void*)1;
 }
 
-static bool ListEnumeratedArchiveFile(const char *fname, void *p)
+static void StartQueuedInstall(InstallQueueItem &item)
 {
-	ASSERT(p != NULL);
+	item.state = IQ_Running;
+	item.tmStart = GetTimeMsOS();
 
-	vector<string> &list = *(vector<string>*)p;
-	list.push_back(fname);
+	item.job = InitProgress(1000 /* percentage with tenths */, item.fm->GetFriendlyName());
+	SetProgressSize(item.job, item.ctx.sz);
 
-	return true;
+	if ( !SubmitTaskOS(NULL, InstallQueueThread, &item) )
+		// if the thread pool can't be started then install non-threaded, shouldn't normally happen
+		InstallQueueThread(&item);
 }
 
-static __inline bool compare_relfname(const char *a, const char *b)
+// final steps of a queued install after the worker is done (or failed)
+static void FinishQueuedInstall(InstallQueueItem &item, int result, BOOL bCancelled)
 {
-	// root files last
-	if ( !strchr(a, DIRSEP) )
+	InstallContext &ctx = item.ctx;
+
+	g_pMessageLog = &item.messages;
+
+	if (bCancelled)
 	{
-		if ( strchr(b, DIRSEP) )
-			return false;
+		DelTree( ctx.tmpdir.c_str() );
+		item.state = IQ_Cancelled;
 	}
-	else if ( !strchr(b, DIRSEP) )
-		return true;
-
-	return _stricmp(a, b) < 0;
-}
+	else if (result != 1)
+	{
+		DelTree( ctx.tmpdir.c_str() );
+		item.state = IQ_Failed;
 
-static void ListArchiveFiles(const char *archive, string &html)
-{
-	char buf[MAX_PATH_BUF];
+		const char *err = item.pErrMsg ? item.pErrMsg : $("unknown error");
 
-	unsigned __int64 sz = 0;
-	unsigned int filecount = 0;
-	GetUnpackedArchiveSize(archive, sz, filecount);
+		switch (item.nFailStep)
+		{
+		case IQF_Extract:
+			FmAlert($("Failed to extract FM archive, install aborted.\n\nError: %s"), err);
+			break;
+		case IQF_PartialExtract:
+			FmAlert($("Partially failed to extract FM archive, install aborted.\n\nError: %s"), err);
+			break;
+		case IQF_Audio:
+			FmAlert("%s", $("Audio conversion failed partially or completely, install aborted."));
+			break;
+		case IQF_Restore:
+			FmAlert($("Failed to restore backed up file (savegames, screenshots and possibly more), install aborted.\n\nError: %s"), err);
+			break;
+		}
+	}
+	else
+	{
+		GenerateMissionFlags( ctx.tmpdir.c_str() );
 
-	vector<string> list;
-	list.reserve(filecount);
+		// check if backup data contained an install info file with list of files to delete
+		if (ctx.bHasBak && item.bInstallInfoSafe)
+			LoadRemoveFileInfo(item.fm);
 
-	if ( !EnumFullArchive(archive, ListEnumeratedArchiveFile, &list) )
-		return;
+		item.state = CommitInstall(ctx) ? IQ_Done : IQ_Failed;
+	}
 
-	int i;
+	g_pMessageLog = NULL;
 
-	// sort file list
-	vector<const char*> sorted;
-	sorted.reserve( list.size() );
-	for (i=0; i<(int)list.size(); i++)
-		sorted.push_back( list[i].c_str() );
-	std::sort(sorted.begin(), sorted.end(), compare_relfname);
+	item.tmEnd = GetTimeMsOS();
+}
 
-	for (i=0; i<(int)sorted.size(); i++)
+// output outcome of an FM in batch mode
+static void ReportQueueItem(const InstallQueueItem &item)
+{
+	if (item.state == IQ_Done)
 	{
-		html.append( TextToHtml(sorted[i]) );
-		html.append("<br>");
+		BatchReport("  %s (%.0f ms)", item.fm->name, item.tmEnd - item.tmStart);
+		return;
 	}
 
-	if (sz)
-	{
-		char s[64];
-		FormatFileSizeValue(s, sz);
+	BatchReport("  %s: %s", item.fm->name, item.state == IQ_Cancelled ? $("cancelled") : $("failed"));
 
-		_snprintf_s(buf, sizeof(buf), _TRUNCATE, "<br><b><font color=\"%s\">%s: </font>%s </b>(%d %s)", DARKEN_HTML() ? "#4A86AF" : "#87C5F0",
-			$("Estimated install size"), s, filecount, $("files"));
-		html.append(buf);
+	for (size_t i=0; i<item.messages.size(); i++)
+		BatchReport("    %s", item.messages[i].c_str());
+}
+
+// wait a bit for workers while running the UI (or just waiting in batch mode)
+static void WaitInstallQueue()
+{
+	if (g_pBatchReport)
+		WaitOS(50);
+	else
+	{
+		Fl_Widget *o = Fl::readqueue();
+		if (!o) Fl::wait(50.0/1000.0);
 	}
 }
 
-static void ViewArchiveContents(FMEntry *fm)
+static BOOL RunQueuedInstalls(vector<InstallQueueItem> &items)
 {
-	if ( !fm->IsArchived() )
-		return;
+	// the worker threads need the archive lib, which has to be initialized by the main thread
+	if ( !InitArchiveSystem() )
+	{
+		FmAlert("%s", $("Failed to initialize archive library, cannot install."));
+		return FALSE;
+	}
 
-	string html;
-	char buf[MAX_PATH_BUF];
+	// checks and preparations for all FMs up front, FMs that can't be installed end up in the summary
+	unsigned __int64 sz = 0;
+	int nAudio = 0;
+	int nReady = 0;
 
-	ListArchiveFiles(fm->GetArchiveFilePath().c_str(), html);
+	ShowBusyCursor(TRUE);
 
-	// list backup archive contents if available
-	string bakarchive = fm->GetBakArchiveFilePath();
-	struct stat st = {};
-	if ( !fl_stat(bakarchive.c_str(), &st) )
+	for (size_t i=0; i<items.size(); i++)
 	{
-		html.append("<br><br><br><b><u>");
-		html.append($("Backup archive"));
-		html.append(":</u></b><br>");
+		InstallQueueItem &item = items[i];
 
-		ListArchiveFiles(bakarchive.c_str(), html);
-	}
+		g_pMessageLog = &item.messages;
 
-	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "%s \"%s\"", $("Contents of"), fm->archive.c_str());
+		if ( PrepareInstall(item.fm, item.ctx) )
+		{
+			sz += item.ctx.sz + item.ctx.szBak;
+#ifdef AUDIO_SUPPORT
+			nAudio += (int)item.ctx.compressedSndFiles.size();
+#endif
+			nReady++;
+		}
+		else
+		{
+			item.state = IQ_Failed;
+			ReportQueueItem(item);
+		}
 
-	GenericHtmlTextPopup(buf, html.c_str());
-}
+		g_pMessageLog = NULL;
+	}
 
+	ShowBusyCursor(FALSE);
 
-struct LangEnumContext
-{
-	vector<const char*> langsToFind;
-	vector<const char*> langsFound;
-	const char *lpszEarlyOutOn;
-};
+	if (!nReady)
+		return TRUE;
 
-static bool EnumLanguages(const char *fname, void *p)
-{
-	ASSERT(p != NULL);
+	const unsigned __int64 MB = (unsigned __int64)1024 * (unsigned __int64)1024;
+	const unsigned __int64 MIN_FREE_MB = 16;
 
-	// must contain subdir
-	if ( !strchr(fname, DIRSEP) )
-		return true;
+	unsigned __int64 disk = 0;
+	const BOOL bDiskOk = GetFreeDiskSpaceOS(GetRootPath(), disk);
 
-	LangEnumContext &ctxt = *(LangEnumContext*)p;
+	char s1[256], s2[64];
+	FormatFileSizeValue(s1, sz);
+	if (bDiskOk)
+		FormatFileSizeValue(s2, disk * MB);
+	else
+		strcpy(s2, $("N/A"));
 
-	for (int i=0; i<(int)ctxt.langsToFind.size(); i++)
-		if ( stristr(fname, ctxt.langsToFind[i]) )
-		{
-			const char *lpszLang = ctxt.langsToFind[i];
+	if (nAudio)
+		sprintf(s1+strlen(s1), $(" + %d compressed audio file(s), size unknown"), nAudio);
 
-			// move language to found list
-			ctxt.langsFound.push_back(lpszLang);
-			ctxt.langsToFind.erase(ctxt.langsToFind.begin() + i);
+	if (bDiskOk && disk < (sz/MB) + MIN_FREE_MB)
+	{
+		// low diskspace warning
+		if ( !FmChoice(0,
+			$("WARNING: You will/may run out of disk space!\n"
+			"\n"
+			"Install/Extract %d FMs from archives anyway?\n"
+			"\n"
+			"Est. install size  : %s\n"
+			"Free disk space: %s (!)"),
+			fl_cancel, fl_ok, NULL, nReady, s1, s2) )
+				return FALSE;
+	}
+	else
+	{
+		if ( !FmChoice(1,
+			$("Install/Extract %d FMs from archives?\n"
+			"\n"
+			"Est. install size  : %s\n"
+			"Free disk space: %s"),
+			fl_cancel, fl_ok, NULL, nReady, s1, s2) )
+				return FALSE;
+	}
 
-			if (ctxt.lpszEarlyOutOn && !strcmp(lpszLang, ctxt.lpszEarlyOutOn))
-				return false;
+	//
 
-			i--;
-		}
+	const int nSlots = g_cfg.nInstallSlots ? g_cfg.nInstallSlots : std::max(1, std::min(GetNumCPUsOS() / 2, INSTALL_QUEUE_MAX_AUTO_SLOTS));
+	const double budget = (double)g_cfg.nInstallMBps * (double)MB;
 
-	return true;
-}
+	char label[128];
+	_snprintf_s(label, sizeof(label), _TRUNCATE, $("Installing %d FMs..."), nReady);
 
-static void ScanDirForLanguage(const char *subdirname, LangEnumContext &ctxt, int depth = 0)
-{
-	ASSERT(subdirname != NULL);
+	ProgressJob *queuejob = InitProgress(nReady, label);
+	// the queue is waited for below, escape cancels it (and with it the running installs, which are background jobs)
+	SetProgressForeground(queuejob, TRUE);
 
-	// 'depth' is a dumb infinite recursion stopper, in case file system contains cyclic hard-links
-	if (depth > 99)
-		return;
+	if (!g_pBatchReport)
+		fl_cursor(FL_CURSOR_WAIT);
 
-	string sdir;
+	size_t next = 0;
+	int nRunning = 0;
 
-	dirent **files;
-	int nFiles = fl_filename_list(subdirname, &files, NULL);
-	if (nFiles <= 0)
-		return;
+	// throughput is measured over samples of about a second, from the progress of the running installs plus the
+	// unpacked size of the finished ones
+	unsigned __int64 nDoneBytes = 0;
+	unsigned __int64 nSampleBytes = 0;
+	double tmSample = GetTimeMsOS();
+	double tmLastStart = 0;
+	double rate = 0;
 
-	for (int i=0; i<nFiles; i++)
+	for (;;)
 	{
-		dirent *f = files[i];
+		const double tm = GetTimeMsOS();
 
-		if (f->d_name[0] != '.')
+		unsigned __int64 bytes = nDoneBytes;
+		for (size_t i=0; i<items.size(); i++)
+			if (items[i].state == IQ_Running)
+				bytes += GetProgressBytes(items[i].job);
+
+		if (tm - tmSample >= 1000.0)
 		{
-			int len = strlen(f->d_name);
-			if ( isdirsep(f->d_name[len-1]) )
-			{
-				// recurse into subdir
+			rate = bytes > nSampleBytes ? (double)(bytes - nSampleBytes) * 1000.0 / (tm - tmSample) : 0;
+			nSampleBytes = bytes;
+			tmSample = tm;
+		}
 
-				BOOL bRecurse = TRUE;
+		if ( IsProgressCancelled(queuejob) )
+		{
+			// cancel running installs and drop the ones that haven't started
+			for (size_t i=0; i<items.size(); i++)
+			{
+				InstallQueueItem &item = items[i];
 
-				// don't check for language dirs in the root
-				if (depth)
+				if (item.state == IQ_Running)
+					CancelProgress(item.job);
+				else if (item.state == IQ_Pending)
 				{
-					int j;
-
-					for (j=0; j<(int)ctxt.langsToFind.size(); j++)
-						if ( !_stricmp(f->d_name, ctxt.langsToFind[j]) )
-						{
-							const char *lpszLang = ctxt.langsToFind[j];
+					item.state = IQ_Cancelled;
+					ReportQueueItem(item);
+				}
+			}
 
-							// move language to found list
-							ctxt.langsFound.push_back(lpszLang);
-							ctxt.langsToFind.erase(ctxt.langsToFind.begin() + j);
+			next = items.size();
+		}
 
-							if (ctxt.lpszEarlyOutOn && !strcmp(lpszLang, ctxt.lpszEarlyOutOn))
-							{
-								// we're done, free data and return
-								fl_filename_free_list(&files, nFiles);
-								return;
-							}
+		// start more installs while there are free slots and the throughput budget allows it, judged by the average
+		// throughput of the running installs once it had a couple of seconds to settle after the last start
+		while (next < items.size() && nRunning < nSlots)
+		{
+			InstallQueueItem &item = items[next];
 
-							// don't recurse inside language dirs
-							bRecurse = FALSE;
+			if (item.state != IQ_Pending)
+			{
+				next++;
+				continue;
+			}
 
-							break;
-						}
+			if (budget > 0 && nRunning > 0
+				&& (tm - tmLastStart < 2000.0 || rate * (nRunning + 1) / nRunning > budget))
+				break;
 
-					// don't recurse inside language dirs, check if the current dir is an already enumerated lang dir
-					if (bRecurse)
-					{
-						for (j=0; j<(int)ctxt.langsFound.size(); j++)
-							if ( !_stricmp(f->d_name, ctxt.langsFound[j]) )
-							{
-								bRecurse = FALSE;
-								break;
-							}
-					}
-				}
+			StartQueuedInstall(item);
 
-				if (bRecurse)
-				{
-					sdir = subdirname;
-					sdir.append(f->d_name);
-					ScanDirForLanguage(sdir.c_str(), ctxt, depth+1);
-				}
-			}
+			nRunning++;
+			next++;
+			tmLastStart = tm;
 		}
-	}
 
-	fl_filename_free_list(&files, nFiles);
-}
+		// finish installs whose worker is done
+		for (size_t i=0; i<items.size(); i++)
+		{
+			InstallQueueItem &item = items[i];
 
-static BOOL GetLanguages(FMEntry *fm, std::list<string> &langlist, BOOL bEarlyOutOnEnglish = FALSE)
-{
-	if ( !fm->IsAvail() )
-		return FALSE;
+			if (item.state != IQ_Running || !IsProgressDone(item.job))
+				continue;
 
-	char langdirs[NUM_LANGUAGES][16];
-	LangEnumContext ctxt;
-	ctxt.langsToFind.reserve(NUM_LANGUAGES);
+			BOOL bCancelled = FALSE;
+			const int result = RunProgress(item.job, &bCancelled);
+			item.job = NULL;
 
-	// prefer searching archive if available, it's faster and easier to enumerate files there
-	if ( fm->IsArchived() )
-	{
-		for (int i=0; i<NUM_LANGUAGES; i++)
-		{
-			sprintf(langdirs[i], DIRSEP_STR "%s" DIRSEP_STR, g_languages[i]);
-			ctxt.langsToFind.push_back(langdirs[i]);
-		}
+			nRunning--;
+			nDoneBytes += item.ctx.sz;
 
-		ctxt.lpszEarlyOutOn = bEarlyOutOnEnglish ? langdirs[0] : NULL;
+			FinishQueuedInstall(item, result, bCancelled);
 
-		EnumFullArchive(fm->GetArchiveFilePath().c_str(), EnumLanguages, &ctxt);
-	}
-	else
-	{
-		for (int i=0; i<NUM_LANGUAGES; i++)
-		{
-			sprintf(langdirs[i], "%s/", g_languages[i]);
-			ctxt.langsToFind.push_back(langdirs[i]);
-		}
+			ReportQueueItem(item);
 
-		char installdir[MAX_PATH_BUF];
-		if (_snprintf_s(installdir, sizeof(installdir), _TRUNCATE, "%s" DIRSEP_STR "%s" DIRSEP_STR, GetRootPath(), fm->name) == -1)
-			return FALSE;
+			StepProgress(queuejob, 1);
+		}
 
-		ctxt.lpszEarlyOutOn = bEarlyOutOnEnglish ? langdirs[0] : NULL;
+		if (!nRunning && next >= items.size())
+			break;
 
-		ScanDirForLanguage(installdir, ctxt);
+		WaitInstallQueue();
 	}
 
-	if ( ctxt.langsFound.empty() )
-		return FALSE;
-
-	// handle if caller only wants english reported, if it's available
-	if (bEarlyOutOnEnglish)
-		for (int i=0; i<(int)ctxt.langsFound.size(); i++)
-		{
-			if ( !strcmp(ctxt.langsFound[i], langdirs[0]) )
-			{
-				langlist.push_back(g_languages[0]);
-				return TRUE;
-			}
-		}
+	TermProgress(queuejob);
 
-	// list all available languages (sorted in the same order as g_languages)
-	for (int i=0; i<(int)ctxt.langsFound.size(); i++)
-		for (int j=0; j<NUM_LANGUAGES; j++)
-			if ( !strcmp(ctxt.langsFound[i], langdirs[j]) )
-			{
-				langlist.push_back(g_languages[j]);
-				break;
-			}
+	if (!g_pBatchReport)
+		fl_cursor(FL_CURSOR_DEFAULT);
 
 	return TRUE;
 }
 
-static BOOL GetFallbackLanguage(FMEntry *fm, string &lang)
+static BOOL RunQueuedUninstalls(vector<InstallQueueItem> &items)
 {
-	// determine if FM has languages defined, if it does and english is among them, then english is the fallback
-	// if english is not among them then pick another, if no languages are found then no fallback language will
-	// be defined
+	// ask the questions of UninstallFM once for all FMs
+	const int backup = FmChoice(1,
+		$("Uninstall %d FMs.\n\n%s"), fl_cancel, fl_yes, fl_no, (int)items.size(),
+		g_cfg.bDiffBackups
+			? $("Backup all modified/added/removed files (including savegames and screenshots)?")
+			: $("Backup savegames and screenshots?")
+		);
+	if (!backup)
+		return FALSE;
 
-	std::list<string> languages;
+	const BOOL bBackupSaves = (backup != 2);
 
-	if ( !GetLanguages(fm, languages, TRUE) )
+	if ( !FmChoice(1, "%s", fl_cancel, fl_ok, NULL, GetUninstallConfirmMsg(bBackupSaves, bBackupSaves && g_cfg.bDiffBackups)) )
 		return FALSE;
 
-	// return first available language (which will be english if english is available)
-	lang = languages.front();
+	char label[128];
+	_snprintf_s(label, sizeof(label), _TRUNCATE, $("Uninstalling %d FMs..."), (int)items.size());
 
-	return TRUE;
-}
+	ProgressJob *queuejob = InitProgress((int)items.size(), label);
+	SetProgressForeground(queuejob, TRUE);
 
-static BOOL IsLanguageInList(std::list<string> &langlist, const char *lang)
-{
-	for (std::list<string>::iterator it=langlist.begin(); it!=langlist.end(); it++)
-		if ( !_stricmp(it->c_str(), lang) )
-			return TRUE;
+	for (size_t i=0; i<items.size(); i++)
+	{
+		InstallQueueItem &item = items[i];
 
-	return FALSE;
-}
+		if ( IsProgressCancelled(queuejob) )
+			item.state = IQ_Cancelled;
+		else
+		{
+			item.tmStart = GetTimeMsOS();
 
+			g_pMessageLog = &item.messages;
+			item.state = UninstallFM(item.fm, backup) ? IQ_Done : IQ_Failed;
+			g_pMessageLog = NULL;
 
-/////////////////////////////////////////////////////////////////////
-// Custom Widgets
+			item.tmEnd = GetTimeMsOS();
+		}
 
-//
-// FM_Return_Button (hides return icon when disabled)
-//
+		ReportQueueItem(item);
 
-static int fl_return_arrow(int x, int y, int w, int h) {
-	int size = w; if (h<size) size = h;
-	int d = (size+2)/4; if (d<3) d = 3;
-	int t = (size+9)/12; if (t<1) t = 1;
-	int x0 = x+(w-2*d-2*t-1)/2;
-	int x1 = x0+d;
-	int y0 = y+h/2;
-	fl_color(FL_LIGHT3);
-	fl_line(x0, y0, x1, y0+d);
-	fl_yxline(x1, y0+d, y0+t, x1+d+2*t, y0-d);
-	fl_yxline(x1, y0-t, y0-d);
-	fl_color(fl_gray_ramp(0));
-	fl_line(x0, y0, x1, y0-d);
-	fl_color(FL_DARK3);
-	fl_xyline(x1+1, y0-t, x1+d, y0-d, x1+d+2*t);
-	return 1;
+		StepProgress(queuejob, 1);
+
+		// keep the jobs panel responsive between FMs (for uninstalls without backup there's no other job)
+		if (!g_pBatchReport)
+			Fl::check();
+	}
+
+	TermProgress(queuejob);
+
+	return TRUE;
 }
 
-class Fl_FM_Return_Button : public Fl_Return_Button
+// show the outcome of a queue run, returns the number of FMs that failed or were cancelled
+static int ShowInstallQueueSummary(const vector<InstallQueueItem> &items, BOOL bInstall)
 {
-protected:
-	virtual void draw()
+	int nDone = 0, nFailed = 0, nCancelled = 0;
+
+	for (size_t i=0; i<items.size(); i++)
 	{
-		if (type() == FL_HIDDEN_BUTTON) return;
-		draw_box(value() ? (down_box()?down_box():fl_down(box())) : box(),
-			value() ? selection_color() : color());
-		int W = h();
-		if (w()/3 < W) W = w()/3;
-		if ( active_r() ) fl_return_arrow(x()+w()-W-4, y(), W, h());
+		if (items[i].state == IQ_Done)
+			nDone++;
+		else if (items[i].state == IQ_Cancelled)
+			nCancelled++;
+		else
+			nFailed++;
+	}
 
-		int XX = x()+Fl::box_dx(box());
-		int WW = w()-Fl::box_dw(box())-((W+4)/2);
-		if (WW > 11 && align()&(FL_ALIGN_LEFT|FL_ALIGN_RIGHT)) {XX += 3; WW -= 6;}
-		draw_label(XX, y()+Fl::box_dy(box()), WW, h()-Fl::box_dh(box()));
+	char buff[512];
+	_snprintf_s(buff, sizeof(buff), _TRUNCATE,
+		bInstall ? $("%d installed, %d failed, %d cancelled") : $("%d uninstalled, %d failed, %d cancelled"),
+		nDone, nFailed, nCancelled);
 
-		if (Fl::focus() == this) draw_focus();
+	if (g_pBatchReport)
+	{
+		BatchReport("%s", buff);
+		return nFailed + nCancelled;
 	}
-public:
-	Fl_FM_Return_Button(int X, int Y, int W, int H, const char *l=0)
-		: Fl_Return_Button(X,Y,W,H,l) {}
-};
-
 
-//
-// FM_Menu_Button
-//
+	string html = "<b>";
+	html.append(buff);
+	html.append("</b><br>");
 
-class Fl_FM_Menu_Button : public Fl_Menu_Button
-{
-protected:
-	virtual int handle(int e)
+	if (nFailed)
 	{
-		if (e == FL_PUSH)
-		{
-			if (!box()) {
-				if (Fl::event_button() != 3) return 0;
-			} else if (type()) {
-				if (!(type() & (1 << (Fl::event_button()-1)))) return 0;
-			}
-			if (Fl::visible_focus()) Fl::focus(this);
-			DoPopup();
-			return 1;
-		}
+		html.append("<br><b><u>");
+		html.append($("Failed"));
+		html.append(":</u></b><br><br>");
 
-		return Fl_Menu_Button::handle(e);
-	}
+		for (size_t i=0; i<items.size(); i++)
+		{
+			const InstallQueueItem &item = items[i];
+			if (item.state == IQ_Done || item.state == IQ_Cancelled)
+				continue;
 
-public:
-	Fl_FM_Menu_Button(int X, int Y, int W, int H, const char *l=0)
-		: Fl_Menu_Button(X,Y,W,H,l) {}
+			html.append("<b>");
+			html.append( TextToHtml(item.fm->GetFriendlyName()) );
+			html.append("</b><br>");
 
-	virtual void DoPopup() = 0;
-};
+			if ( item.messages.empty() )
+			{
+				html.append( $("unknown error") );
+				html.append("<br>");
+			}
 
+			for (size_t j=0; j<item.messages.size(); j++)
+			{
+				html.append( TextToHtml(item.messages[j].c_str()) );
+				html.append("<br>");
+			}
 
-//
-// FM_Filter_Button
-//
+			html.append("<br>");
+		}
+	}
 
-class Fl_FM_Filter_Button : public Fl_Button
-{
-protected:
-	virtual void draw()
+	for (int pass=0; pass<2; pass++)
 	{
-		Fl_Image *img = image();
-		if ( !value() )
-			image( deimage() );
+		const int state = pass ? IQ_Cancelled : IQ_Done;
+		if ( !(pass ? nCancelled : nDone) )
+			continue;
 
-		Fl_Button::draw();
+		html.append("<br><b><u>");
+		html.append(pass ? $("Cancelled") : (bInstall ? $("Installed") : $("Uninstalled")));
+		html.append(":</u></b><br><br>");
 
-		image(img);
+		for (size_t i=0; i<items.size(); i++)
+			if (items[i].state == state)
+			{
+				html.append( TextToHtml(items[i].fm->GetFriendlyName()) );
+				html.append("<br>");
+			}
 	}
 
-public:
-	Fl_FM_Filter_Button(int X, int Y, int W, int H, const char *l=0)
-		: Fl_Button(X,Y,W,H,l) {}
-};
-
+	GenericHtmlTextPopup(bInstall ? $("Install Summary") : $("Uninstall Summary"), html.c_str());
 
-//
-// FM_Config_Button
-//
+	return nFailed + nCancelled;
+}
 
-class Fl_FM_Config_Button : public Fl_FM_Menu_Button
+// install or uninstall all FMs in 'list', returns the number of FMs that failed or were cancelled, or -1 if the
+// user cancelled before anything was done
+static int RunInstallQueue(const vector<FMEntry*> &list, BOOL bInstall)
 {
-public:
-	Fl_FM_Config_Button(int X, int Y, int W, int H, const char *l=0)
-		: Fl_FM_Menu_Button(X,Y,W,H,l) {}
+	TRACE_SCOPE("RunInstallQueue", bInstall ? "install" : "uninstall");
 
-	virtual void DoPopup()
-	{
-		FMEntry *fm = GetCurSelFM();
+	if ( list.empty() )
+		return 0;
 
-		enum
-		{
-			CMD_NONE,
+	FinishStartupScan();
 
-			CMD_DateFmt0,
-			CMD_DateFmtLast = CMD_DateFmt0+DATEFMT_NUM_FORMATS-1,
+	vector<InstallQueueItem> items( list.size() );
+	for (size_t i=0; i<list.size(); i++)
+		items[i].fm = list[i];
 
-			CMD_TagRows0,
-			CMD_TagRowsLast = CMD_TagRows0+4,
-			CMD_ToggleVarSizeRows,
+	if ( !(bInstall ? RunQueuedInstalls(items) : RunQueuedUninstalls(items)) )
+		return -1;
 
-			CMD_WidgetScheme0,
-			CMD_WidgetSchemeLast = CMD_WidgetScheme0+MAX_WIDGET_SCHEMES-1,
-			CMD_WidgetColors0,
-			CMD_WidgetColorsLast = CMD_WidgetColors0+MAX_WIDGET_COLORS-1,
-			CMD_DarkenHTML,
+	RedrawListControl(TRUE);
 
-			CMD_FontSizeNormal,
-			CMD_FontSizeLarge,
+	return ShowInstallQueueSummary(items, bInstall);
+}
 
-			CMD_NameSortNormal,
-			CMD_NameSortStrip,
-			CMD_NameSortMove,
 
-			CMD_ToggleWrapDescrEdit,
-			CMD_ToggleWrapNotesEdit,
+static void DeleteFMs(const vector<FMEntry*> &list)
+{
+	if ( list.empty() )
+		return;
 
-			CMD_ToggleAutoRefresh,
+	InvalidateTagDb();
 
-			CMD_DebriefNever,
-			CMD_DebriefAfterFM,
-			CMD_DebriefAlways,
+	g_bDbModified = TRUE;
 
-			CMD_BackupSaves,
-			CMD_BackupDiff,
-			CMD_BackupReview,
+	RemoveDbEntries(list);
+	InvalidateHotFields();
+	InvalidateArchiveNameHash();
+	InvalidateSummaryPrefetch();
 
-			CMD_ConvertAudio,
-			CMD_GenerateMissFlags,
+	// select next (or previous if last) remaining list entry before deleting the old
+	FMEntry *pCurSel = GetCurSelFM();
+	if (pCurSel && GetDbIndex(pCurSel) < 0)
+		SelectNeighborFM();
 
-			CMD_ArchivePath,
+	for (int i=0; i<(int)list.size(); i++)
+		delete list[i];
 
-			CMD_SaveDb,
-			CMD_CleanDb,
+	RefreshFilteredDb();
 
-			CMD_AutoScanDates,
-			CMD_ExportIni,
-			CMD_CreateIni,
-			CMD_ExportBatchIni,
-			CMD_ImportBatchIni,
+	RemoveDeadTagFilters();
+}
 
-			CMD_About,
-		};
+static BOOL DeleteFM(FMEntry *fm)
+{
+	if (!fm)
+	{
+		ASSERT(FALSE);
+		return FALSE;
+	}
 
-		const BOOL bAdvanced = !!(Fl::event_state() & FL_CTRL);
+	DeleteFMs( vector<FMEntry*>(1, fm) );
 
-		#define MENU_DATEFMT(_n) MENU_RITEM(dateformats[_n], CMD_DateFmt0+(_n), g_cfg.datefmt == (_n))
+	return TRUE;
+}
+
+
+// purge the database of all entries for deleted fms
+static void CleanDb()
+{
+	// availability has to be known before removing entries
+	FinishStartupScan();
+
+	vector<FMEntry*> list;
+	for (int i=0; i<(int)g_db.size(); i++)
+		if (!g_db[i]->IsArchived() && !g_db[i]->IsInstalled())
+			list.push_back(g_db[i]);
+
+	DeleteFMs(list);
+}
+
+template <class S>
+static size_t GetStringHeapSize(const S &s)
+{
+	// (ignores any small string optimization)
+	return s.capacity() ? s.capacity() + 1 : 0;
+}
+
+// display a report of memory used by the db (to get an idea of the requirements for very large collections)
+static void ViewDbMemoryReport()
+{
+	size_t strbytes = 0;
+	size_t tagbytes = 0;
+	size_t ntags = 0;
+	size_t sumbytes = 0;
+	int nsummaries = 0;
+
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		const FMEntry *fm = g_db[i];
+
+		strbytes += GetStringHeapSize(fm->nicename) + GetStringHeapSize(fm->archive) + GetStringHeapSize(fm->tags)
+			+ GetStringHeapSize(fm->notes) + GetStringHeapSize(fm->modexclude) + GetStringHeapSize(fm->infofile)
+			+ GetStringHeapSize(fm->descr) + GetStringHeapSize(fm->filtername) + GetStringHeapSize(fm->tagsUI);
+
+		for (int j=0; j<(int)fm->infoFilesCache.size(); j++)
+			strbytes += GetStringHeapSize(fm->infoFilesCache[j]);
+		strbytes += fm->infoFilesCache.capacity() * sizeof(string);
+
+		tagbytes += fm->taglist.capacity() * sizeof(const char*);
+		ntags += fm->taglist.size();
+
+		if (fm->summary)
+		{
+			sumbytes += sizeof(FMSummaryCache) + GetStringHeapSize(fm->summary->html)
+				+ fm->summary->infoList.capacity() * sizeof(string);
+			for (int j=0; j<(int)fm->summary->infoList.size(); j++)
+				sumbytes += GetStringHeapSize(fm->summary->infoList[j]);
+			nsummaries++;
+		}
+	}
+
+	RefreshTagDb();
+
+	size_t idxbytes = (g_tagNameList.capacity() + g_tagNameListNoCat.capacity()) * sizeof(const char*)
+		+ g_tagCompletionIndex.capacity() * sizeof(TagCompletionEntry);
+	for (int i=0; i<(int)g_tagCompletionIndex.size(); i++)
+		idxbytes += GetStringHeapSize(g_tagCompletionIndex[i].key);
+
+	const int nFMs = (int)g_db.size();
+	const size_t total = g_dbEntryPool.BytesReserved() + strbytes + tagbytes + g_dbStrPool.BytesReserved() + idxbytes
+		+ sumbytes + g_db.capacity() * sizeof(FMEntry*);
+
+	string html;
+	char buff[512];
+
+	#define MEM_REPORT_LINE(_label, _fmt, _val) \
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b>%s:</b> " _fmt "<br>", _label, _val); \
+		html.append(buff);
+
+	MEM_REPORT_LINE($("FMs"), "%d", nFMs);
+	MEM_REPORT_LINE($("Entry size"), "%u", (unsigned int)sizeof(FMEntry));
+	MEM_REPORT_LINE($("Entry pool"), "%u", (unsigned int)g_dbEntryPool.BytesReserved());
+	MEM_REPORT_LINE($("Entry strings"), "%u", (unsigned int)strbytes);
+	MEM_REPORT_LINE($("Entry string heap"), "%u", (unsigned int)g_dbStrHeap.BytesReserved());
+	MEM_REPORT_LINE($("Tag lists"), "%u", (unsigned int)tagbytes);
+	html.append("<br>");
+	MEM_REPORT_LINE($("Tag references"), "%u", (unsigned int)ntags);
+	MEM_REPORT_LINE($("Interned strings"), "%d", g_dbStrPool.Count());
+	MEM_REPORT_LINE($("Intern requests"), "%d", g_dbStrPool.Requests());
+	MEM_REPORT_LINE($("Interning ratio"), "%.2f", g_dbStrPool.Count() ? (double)g_dbStrPool.Requests() / g_dbStrPool.Count() : 0.0);
+	MEM_REPORT_LINE($("String pool"), "%u", (unsigned int)g_dbStrPool.BytesReserved());
+	MEM_REPORT_LINE($("String bytes saved"), "%d", (int)g_dbStrPool.BytesRequested() - (int)g_dbStrPool.BytesUsed());
+	MEM_REPORT_LINE($("Tag index"), "%u", (unsigned int)idxbytes);
+	MEM_REPORT_LINE($("Cached summaries"), "%d", nsummaries);
+	MEM_REPORT_LINE($("Summary cache"), "%u", (unsigned int)sumbytes);
+	html.append("<br>");
+	MEM_REPORT_LINE($("Total"), "%u", (unsigned int)total);
+	MEM_REPORT_LINE($("Bytes per FM"), "%u", nFMs ? (unsigned int)(total / nFMs) : 0);
+
+	#undef MEM_REPORT_LINE
+
+	GenericHtmlTextPopup($("Db Memory Report"), html.c_str(), (g_cfg.bLargeFont ? 500 : 400), (g_cfg.bLargeFont ? 610 : 500));
+}
+
+static __inline bool compare_relfname(const char *a, const char *b)
+{
+	// root files last
+	if ( !strchr(a, DIRSEP) )
+	{
+		if ( strchr(b, DIRSEP) )
+			return false;
+	}
+	else if ( !strchr(b, DIRSEP) )
+		return true;
+
+	return _stricmp(a, b) < 0;
+}
+
+static void ListArchiveFiles(const char *archive, string &html, BOOL bReopen = FALSE)
+{
+	char buf[MAX_PATH_BUF];
+
+	const ArchiveManifest *manifest = GetArchiveManifest(archive, bReopen);
+	if (!manifest)
+		return;
+
+	const unsigned __int64 sz = manifest->totalSize;
+	const int filecount = (int) manifest->files.size();
+
+	int i;
+
+	// sort file list
+	vector<const char*> sorted;
+	sorted.reserve(filecount);
+	for (i=0; i<filecount; i++)
+		sorted.push_back( manifest->files[i].name.c_str() );
+	std::sort(sorted.begin(), sorted.end(), compare_relfname);
+
+	for (i=0; i<(int)sorted.size(); i++)
+	{
+		html.append( TextToHtml(sorted[i]) );
+		html.append("<br>");
+	}
+
+	if (sz)
+	{
+		char s[64];
+		FormatFileSizeValue(s, sz);
+
+		_snprintf_s(buf, sizeof(buf), _TRUNCATE, "<br><b><font color=\"%s\">%s: </font>%s </b>(%d %s)", DARKEN_HTML() ? "#4A86AF" : "#87C5F0",
+			$("Estimated install size"), s, filecount, $("files"));
+		html.append(buf);
+	}
+}
+
+static void ViewArchiveContents(FMEntry *fm)
+{
+	if ( !fm->IsArchived() )
+		return;
+
+	string html;
+	char buf[MAX_PATH_BUF];
+
+	ListArchiveFiles(fm->GetArchiveFilePath().c_str(), html);
+
+	// list backup archive contents if available
+	string bakarchive = fm->GetBakArchiveFilePath();
+	struct stat st = {};
+	if ( !fl_stat(bakarchive.c_str(), &st) )
+	{
+		html.append("<br><br><br><b><u>");
+		html.append($("Backup archive"));
+		html.append(":</u></b><br>");
+
+		ListArchiveFiles(bakarchive.c_str(), html, TRUE);
+	}
+
+	_snprintf_s(buf, sizeof(buf), _TRUNCATE, "%s \"%s\"", $("Contents of"), fm->archive.c_str());
+
+	GenericHtmlTextPopup(buf, html.c_str());
+}
+
+
+struct LangEnumContext
+{
+	vector<const char*> langsToFind;
+	vector<const char*> langsFound;
+	const char *lpszEarlyOutOn;
+};
+
+static bool EnumLanguages(const char *fname, void *p)
+{
+	ASSERT(p != NULL);
+
+	// must contain subdir
+	if ( !strchr(fname, DIRSEP) )
+		return true;
+
+	LangEnumContext &ctxt = *(LangEnumContext*)p;
+
+	for (int i=0; i<(int)ctxt.langsToFind.size(); i++)
+		if ( stristr(fname, ctxt.langsToFind[i]) )
+		{
+			const char *lpszLang = ctxt.langsToFind[i];
+
+			// move language to found list
+			ctxt.langsFound.push_back(lpszLang);
+			ctxt.langsToFind.erase(ctxt.langsToFind.begin() + i);
+
+			if (ctxt.lpszEarlyOutOn && !strcmp(lpszLang, ctxt.lpszEarlyOutOn))
+				return false;
+
+			i--;
+		}
+
+	return true;
+}
+
+static void ScanDirForLanguage(const char *subdirname, LangEnumContext &ctxt, int depth = 0)
+{
+	ASSERT(subdirname != NULL);
+
+	// 'depth' is a dumb infinite recursion stopper, in case file system contains cyclic hard-links
+	if (depth > 99)
+		return;
+
+	string sdir;
+
+	dirent **files;
+	int nFiles = fl_filename_list(subdirname, &files, NULL);
+	if (nFiles <= 0)
+		return;
+
+	for (int i=0; i<nFiles; i++)
+	{
+		dirent *f = files[i];
+
+		if (f->d_name[0] != '.')
+		{
+			int len = strlen(f->d_name);
+			if ( isdirsep(f->d_name[len-1]) )
+			{
+				// recurse into subdir
+
+				BOOL bRecurse = TRUE;
+
+				// don't check for language dirs in the root
+				if (depth)
+				{
+					int j;
+
+					for (j=0; j<(int)ctxt.langsToFind.size(); j++)
+						if ( !_stricmp(f->d_name, ctxt.langsToFind[j]) )
+						{
+							const char *lpszLang = ctxt.langsToFind[j];
+
+							// move language to found list
+							ctxt.langsFound.push_back(lpszLang);
+							ctxt.langsToFind.erase(ctxt.langsToFind.begin() + j);
+
+							if (ctxt.lpszEarlyOutOn && !strcmp(lpszLang, ctxt.lpszEarlyOutOn))
+							{
+								// we're done, free data and return
+								fl_filename_free_list(&files, nFiles);
+								return;
+							}
+
+							// don't recurse inside language dirs
+							bRecurse = FALSE;
+
+							break;
+						}
+
+					// don't recurse inside language dirs, check if the current dir is an already enumerated lang dir
+					if (bRecurse)
+					{
+						for (j=0; j<(int)ctxt.langsFound.size(); j++)
+							if ( !_stricmp(f->d_name, ctxt.langsFound[j]) )
+							{
+								bRecurse = FALSE;
+								break;
+							}
+					}
+				}
+
+				if (bRecurse)
+				{
+					sdir = subdirname;
+					sdir.append(f->d_name);
+					ScanDirForLanguage(sdir.c_str(), ctxt, depth+1);
+				}
+			}
+		}
+	}
+
+	fl_filename_free_list(&files, nFiles);
+}
+
+static BOOL GetLanguages(FMEntry *fm, std::list<string> &langlist, BOOL bEarlyOutOnEnglish = FALSE)
+{
+	if ( !fm->IsAvail() )
+		return FALSE;
+
+	char langdirs[NUM_LANGUAGES][16];
+	LangEnumContext ctxt;
+	ctxt.langsToFind.reserve(NUM_LANGUAGES);
+
+	// prefer searching archive if available, it's faster and easier to enumerate files there
+	if ( fm->IsArchived() )
+	{
+		for (int i=0; i<NUM_LANGUAGES; i++)
+		{
+			sprintf(langdirs[i], DIRSEP_STR "%s" DIRSEP_STR, g_languages[i]);
+			ctxt.langsToFind.push_back(langdirs[i]);
+		}
+
+		ctxt.lpszEarlyOutOn = bEarlyOutOnEnglish ? langdirs[0] : NULL;
+
+		const ArchiveManifest *manifest = GetArchiveManifest( fm->GetArchiveFilePath().c_str() );
+		if (manifest)
+		{
+			for (size_t i=0; i<manifest->files.size(); i++)
+				if ( !EnumLanguages(manifest->files[i].name.c_str(), &ctxt) )
+					break;
+		}
+	}
+	else
+	{
+		for (int i=0; i<NUM_LANGUAGES; i++)
+		{
+			sprintf(langdirs[i], "%s/", g_languages[i]);
+			ctxt.langsToFind.push_back(langdirs[i]);
+		}
+
+		char installdir[MAX_PATH_BUF];
+		if (_snprintf_s(installdir, sizeof(installdir), _TRUNCATE, "%s" DIRSEP_STR "%s" DIRSEP_STR, GetRootPath(), fm->name) == -1)
+			return FALSE;
+
+		ctxt.lpszEarlyOutOn = bEarlyOutOnEnglish ? langdirs[0] : NULL;
+
+		ScanDirForLanguage(installdir, ctxt);
+	}
+
+	if ( ctxt.langsFound.empty() )
+		return FALSE;
+
+	// handle if caller only wants english reported, if it's available
+	if (bEarlyOutOnEnglish)
+		for (int i=0; i<(int)ctxt.langsFound.size(); i++)
+		{
+			if ( !strcmp(ctxt.langsFound[i], langdirs[0]) )
+			{
+				langlist.push_back(g_languages[0]);
+				return TRUE;
+			}
+		}
+
+	// list all available languages (sorted in the same order as g_languages)
+	for (int i=0; i<(int)ctxt.langsFound.size(); i++)
+		for (int j=0; j<NUM_LANGUAGES; j++)
+			if ( !strcmp(ctxt.langsFound[i], langdirs[j]) )
+			{
+				langlist.push_back(g_languages[j]);
+				break;
+			}
+
+	return TRUE;
+}
+
+static BOOL GetFallbackLanguage(FMEntry *fm, string &lang)
+{
+	// determine if FM has languages defined, if it does and english is among them, then english is the fallback
+	// if english is not among them then pick another, if no languages are found then no fallback language will
+	// be defined
+
+	std::list<string> languages;
+
+	if ( !GetLanguages(fm, languages, TRUE) )
+		return FALSE;
+
+	// return first available language (which will be english if english is available)
+	lang = languages.front();
+
+	return TRUE;
+}
+
+static BOOL IsLanguageInList(std::list<string> &langlist, const char *lang)
+{
+	for (std::list<string>::iterator it=langlist.begin(); it!=langlist.end(); it++)
+		if ( !_stricmp(it->c_str(), lang) )
+			return TRUE;
+
+	return FALSE;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Custom Widgets
+
+//
+// FM_Return_Button (hides return icon when disabled)
+//
+
+static int fl_return_arrow(int x, int y, int w, int h) {
+	int size = w; if (h<size) size = h;
+	int d = (size+2)/4; if (d<3) d = 3;
+	int t = (size+9)/12; if (t<1) t = 1;
+	int x0 = x+(w-2*d-2*t-1)/2;
+	int x1 = x0+d;
+	int y0 = y+h/2;
+	fl_color(FL_LIGHT3);
+	fl_line(x0, y0, x1, y0+d);
+	fl_yxline(x1, y0+d, y0+t, x1+d+2*t, y0-d);
+	fl_yxline(x1, y0-t, y0-d);
+	fl_color(fl_gray_ramp(0));
+	fl_line(x0, y0, x1, y0-d);
+	fl_color(FL_DARK3);
+	fl_xyline(x1+1, y0-t, x1+d, y0-d, x1+d+2*t);
+	return 1;
+}
+
+class Fl_FM_Return_Button : public Fl_Return_Button
+{
+protected:
+	virtual void draw()
+	{
+		if (type() == FL_HIDDEN_BUTTON) return;
+		draw_box(value() ? (down_box()?down_box():fl_down(box())) : box(),
+			value() ? selection_color() : color());
+		int W = h();
+		if (w()/3 < W) W = w()/3;
+		if ( active_r() ) fl_return_arrow(x()+w()-W-4, y(), W, h());
+
+		int XX = x()+Fl::box_dx(box());
+		int WW = w()-Fl::box_dw(box())-((W+4)/2);
+		if (WW > 11 && align()&(FL_ALIGN_LEFT|FL_ALIGN_RIGHT)) {XX += 3; WW -= 6;}
+		draw_label(XX, y()+Fl::box_dy(box()), WW, h()-Fl::box_dh(box()));
+
+		if (Fl::focus() == this) draw_focus();
+	}
+public:
+	Fl_FM_Return_Button(int X, int Y, int W, int H, const char *l=0)
+		: Fl_Return_Button(X,Y,W,H,l) {}
+};
+
+
+//
+// FM_Menu_Button
+//
+
+class Fl_FM_Menu_Button : public Fl_Menu_Button
+{
+protected:
+	virtual int handle(int e)
+	{
+		if (e == FL_PUSH)
+		{
+			if (!box()) {
+				if (Fl::event_button() != 3) return 0;
+			} else if (type()) {
+				if (!(type() & (1 << (Fl::event_button()-1)))) return 0;
+			}
+			if (Fl::visible_focus()) Fl::focus(this);
+			DoPopup();
+			return 1;
+		}
+
+		return Fl_Menu_Button::handle(e);
+	}
+
+public:
+	Fl_FM_Menu_Button(int X, int Y, int W, int H, const char *l=0)
+		: Fl_Menu_Button(X,Y,W,H,l) {}
+
+	virtual void DoPopup() = 0;
+};
+
+
+//
+// FM_Filter_Button
+//
+
+class Fl_FM_Filter_Button : public Fl_Button
+{
+protected:
+	virtual void draw()
+	{
+		Fl_Image *img = image();
+		if ( !value() )
+			image( deimage() );
+
+		Fl_Button::draw();
+
+		image(img);
+	}
+
+public:
+	Fl_FM_Filter_Button(int X, int Y, int W, int H, const char *l=0)
+		: Fl_Button(X,Y,W,H,l) {}
+};
+
+
+//
+// FM_Config_Button
+//
+
+class Fl_FM_Config_Button : public Fl_FM_Menu_Button
+{
+public:
+	Fl_FM_Config_Button(int X, int Y, int W, int H, const char *l=0)
+		: Fl_FM_Menu_Button(X,Y,W,H,l) {}
+
+	virtual void DoPopup()
+	{
+		FMEntry *fm = GetCurSelFM();
+
+		enum
+		{
+			CMD_NONE,
+
+			CMD_DateFmt0,
+			CMD_DateFmtLast = CMD_DateFmt0+DATEFMT_NUM_FORMATS-1,
+
+			CMD_TagRows0,
+			CMD_TagRowsLast = CMD_TagRows0+4,
+			CMD_ToggleVarSizeRows,
+
+			CMD_WidgetScheme0,
+			CMD_WidgetSchemeLast = CMD_WidgetScheme0+MAX_WIDGET_SCHEMES-1,
+			CMD_WidgetColors0,
+			CMD_WidgetColorsLast = CMD_WidgetColors0+MAX_WIDGET_COLORS-1,
+			CMD_DarkenHTML,
+
+			CMD_FontSizeNormal,
+			CMD_FontSizeLarge,
+
+			CMD_NameSortNormal,
+			CMD_NameSortStrip,
+			CMD_NameSortMove,
+
+			CMD_ToggleWrapDescrEdit,
+			CMD_ToggleWrapNotesEdit,
+			CMD_ToggleViewTextInternally,
+			CMD_ToggleThumbColumn,
+			CMD_ToggleBackgroundScan,
+
+			CMD_ToggleAutoRefresh,
+
+			CMD_DebriefNever,
+			CMD_DebriefAfterFM,
+			CMD_DebriefAlways,
+
+			CMD_BackupSaves,
+			CMD_BackupDiff,
+			CMD_BackupReview,
+
+			CMD_ConvertAudio,
+			CMD_GenerateMissFlags,
+
+			CMD_ArchivePath,
+
+			CMD_SaveDb,
+			CMD_CleanDb,
+			CMD_DbMemoryReport,
+
+			CMD_AutoScanDates,
+			CMD_ExportIni,
+			CMD_CreateIni,
+			CMD_ExportBatchIni,
+			CMD_ImportBatchIni,
+
+			CMD_About,
+		};
+
+		const BOOL bAdvanced = !!(Fl::event_state() & FL_CTRL);
+
+		#define MENU_DATEFMT(_n) MENU_RITEM(dateformats[_n], CMD_DateFmt0+(_n), g_cfg.datefmt == (_n))
 
 		int i, j;
 		char dateformats[DATEFMT_NUM_FORMATS][64];
@@ -6760,3294 +9578,4937 @@ public:
 		strcat_s(dateformats[0], sizeof(dateformats[0]), $("(cur locale)"));
 		dateformats[0][sizeof(dateformats[0])-1] = 0;
 
-		const int MAX_MENU_ITEMS = 256;
-		int menu_items = 0;
+		const int MAX_MENU_ITEMS = 256;
+		int menu_items = 0;
+
+		Fl_Menu_Item menu[MAX_MENU_ITEMS];
+
+		MENU_SUB($("Tag Rows"));
+			MENU_RITEM($("Hide Tags"), CMD_TagRows0, g_cfg.tagrows == 0);
+			MENU_RITEM("1", CMD_TagRows0+1, g_cfg.tagrows == 1);
+			MENU_RITEM("2", CMD_TagRows0+2, g_cfg.tagrows == 2);
+			MENU_RITEM("3", CMD_TagRows0+3, g_cfg.tagrows == 3);
+			MENU_RITEM("4", CMD_TagRows0+4, g_cfg.tagrows == 4);
+			MENU_MOD_DIV();
+			MENU_TITEM($("Variable Height"), CMD_ToggleVarSizeRows, g_cfg.bVarSizeList);
+			MENU_MOD_DISABLE(g_cfg.tagrows == 0);
+			MENU_END();
+		MENU_SUB($("Date Format"));
+			for (i=0; i<DATEFMT_NUM_FORMATS; i++)
+				MENU_DATEFMT(i);
+			MENU_END();
+		MENU_SUB($("UI Theme"));
+			for (i=0; i<Fl_Scheme::num_schemes() && i<MAX_WIDGET_SCHEMES; i++)
+				MENU_RITEM(Fl_Scheme::names()[i], CMD_WidgetScheme0+i, g_cfg.uitheme == i);
+#ifndef NO_FLEET
+			for (j=i,i=0; i<fle_num_schemes() && i<MAX_WIDGET_SCHEMES; i++,j++)
+				MENU_RITEM(fle_scheme_name(i), CMD_WidgetScheme0+j, g_cfg.uitheme == j);
+#endif
+			MENU_END();
+		MENU_SUB($("UI Colors"));
+#ifndef NO_FLEET
+			for (i=0; i<fle_num_colors() && i<MAX_WIDGET_COLORS; i++)
+				MENU_RITEM(fle_colors_name(i), CMD_WidgetColors0+i, g_cfg.uicolors == i);
+			MENU_MOD_DIV();
+#endif
+			MENU_TITEM($("Darken HTML"), CMD_DarkenHTML, g_cfg.bDarkHTMLColors);
+			MENU_END();
+		MENU_SUB($("UI Font Size"));
+			MENU_RITEM($("Normal"), CMD_FontSizeNormal, g_cfg.bLargeFont == 0);
+			MENU_RITEM($("Large"), CMD_FontSizeLarge, g_cfg.bLargeFont != 0);
+			MENU_END();
+		MENU_SUB($("Misc")); MENU_MOD_DIV();
+			MENU_TITEM($("Word Wrap Descr Editor"), CMD_ToggleWrapDescrEdit, g_cfg.bWrapDescrEditor);
+			MENU_TITEM($("Word Wrap Notes Editor"), CMD_ToggleWrapNotesEdit, g_cfg.bWrapNotesEditor);
+			MENU_TITEM($("Built-in Text File Viewer"), CMD_ToggleViewTextInternally, g_cfg.bViewTextInternally);
+			MENU_TITEM($("Thumbnail Column"), CMD_ToggleThumbColumn, g_cfg.bThumbColumn);
+			MENU_TITEM($("Scan FMs in Background on Startup"), CMD_ToggleBackgroundScan, g_cfg.bBackgroundScan);
+			MENU_END();
+		MENU_SUB($("Name Format")); MENU_MOD_DIV();
+			MENU_RITEM($("Keep Leading Article"), CMD_NameSortNormal, g_cfg.namemode == NSM_Normal);
+			MENU_RITEM($("Ignore Leading Article"), CMD_NameSortStrip, g_cfg.namemode == NSM_Strip);
+			MENU_RITEM($("Move Leading Article"), CMD_NameSortMove, g_cfg.namemode == NSM_Move);
+			MENU_END();
+		if (bAdvanced)
+		{
+			MENU_TITEM($("No Auto-refresh"), CMD_ToggleAutoRefresh, !g_cfg.bAutoRefreshFilteredDb);
+			MENU_MOD_DIV();
+		}
+		MENU_SUB($("Return to FMSel")); MENU_MOD_DIV();
+			MENU_RITEM($("Never"), CMD_DebriefNever, g_cfg.returnAfterGame[g_bRunningEditor] == RET_NEVER);
+			MENU_RITEM($("After FM"), CMD_DebriefAfterFM, g_cfg.returnAfterGame[g_bRunningEditor] == RET_FM);
+			MENU_RITEM($("Always"), CMD_DebriefAlways, g_cfg.returnAfterGame[g_bRunningEditor] == RET_ALWAYS);
+			MENU_END();
+		MENU_ITEM($("FM Archive Path..."), CMD_ArchivePath);
+		MENU_SUB($("Backup Type")); MENU_MOD_DISABLE(!g_cfg.bRepoOK);
+			MENU_RITEM($("Only Saves and Shots"), CMD_BackupSaves, !g_cfg.bDiffBackups);
+			MENU_RITEM($("All Changed Files"), CMD_BackupDiff, g_cfg.bDiffBackups);
+			MENU_MOD_DIV();
+			MENU_TITEM($("Review Before Backup"), CMD_BackupReview, !g_cfg.bReviewDiffBackup);
+			MENU_END();
+#ifdef T3_SUPPORT
+#ifdef AUDIO_SUPPORT
+		if (!g_bRunningThief3)
+#else
+		if (!g_bRunningShock || !g_bRunningThief3)
+#endif
+#elif !defined(AUDIO_SUPPORT)
+		if (!g_bRunningShock)
+#endif
+		{
+		MENU_SUB($("Install Options")); MENU_MOD_DISABLE(!g_cfg.bRepoOK); MENU_MOD_DIV();
+#ifdef AUDIO_SUPPORT
+			MENU_TITEM($("Convert Audio to WAV"), CMD_ConvertAudio, g_cfg.bDecompressAudio);
+			if (!g_bRunningShock)
+#endif
+			MENU_TITEM($("Generate Mission Flags"), CMD_GenerateMissFlags, g_cfg.bGenerateMissFlags);
+			MENU_END();
+		}
+		MENU_SUB($("Tasks")); MENU_MOD_DIV();
+			MENU_ITEM($("Auto-fill Release Dates"), CMD_AutoScanDates);
+			MENU_MOD_DIV();
+			MENU_ITEM($("Export FM.INI from FM..."), CMD_ExportIni);
+			MENU_MOD_DISABLE(!fm);
+			MENU_ITEM($("Create New FM.INI..."), CMD_CreateIni);
+			MENU_MOD_DIV();
+			MENU_ITEM($("Export Batched FM.INI..."), CMD_ExportBatchIni);
+			MENU_ITEM($("Import Batched FM.INI..."), CMD_ImportBatchIni);
+			MENU_END();
+		if (bAdvanced)
+		{
+			MENU_ITEM($("Save Db Now"), CMD_SaveDb);
+			MENU_ITEM($("Clean Db"), CMD_CleanDb);
+			MENU_ITEM($("Db Memory Report"), CMD_DbMemoryReport);
+		}
+		MENU_MOD_DIV();
+		MENU_ITEM($("About"), CMD_About);
+		MENU_END();
+
+		const Fl_Menu_Item *m = menu->pulldown(x(), y(), w(), h(), 0, this);
+		if (!m || !m->user_data())
+			return;
+
+		const int cmd_id = (intptr_t)m->user_data();
+		switch (cmd_id)
+		{
+		case CMD_ToggleVarSizeRows:
+			g_cfg.bVarSizeList = !g_cfg.bVarSizeList;
+			g_cfg.OnModified();
+			RefreshListControlRowSize();
+			break;
+
+		case CMD_DarkenHTML:
+			g_cfg.bDarkHTMLColors = !g_cfg.bDarkHTMLColors;
+			g_cfg.OnModified();
+			if (!++g_nSummaryGen)
+				g_nSummaryGen = 1;
+			break;
+
+		case CMD_FontSizeNormal:
+		case CMD_FontSizeLarge:
+			fl_message_position(pMainWnd);
+			if ( fl_choice("%s", fl_cancel, fl_ok, NULL, $("Restart is required to change font size. Change size and exit?")) )
+			{
+				g_cfg.bLargeFont = (cmd_id == CMD_FontSizeLarge);
+				g_cfg.OnModified();
+				OnExit(NULL, NULL);
+			}
+			break;
+
+		case CMD_ToggleWrapDescrEdit:
+			g_cfg.bWrapDescrEditor = !g_cfg.bWrapDescrEditor;
+			g_cfg.OnModified();
+			break;
+		case CMD_ToggleWrapNotesEdit:
+			g_cfg.bWrapNotesEditor = !g_cfg.bWrapNotesEditor;
+			g_cfg.OnModified();
+			break;
+		case CMD_ToggleViewTextInternally:
+			g_cfg.bViewTextInternally = !g_cfg.bViewTextInternally;
+			g_cfg.OnModified();
+			break;
+		case CMD_ToggleThumbColumn:
+			fl_message_position(pMainWnd);
+			if ( fl_choice("%s", fl_cancel, fl_ok, NULL, $("Restart is required to show or hide the thumbnail column. Change setting and exit?")) )
+			{
+				g_cfg.bThumbColumn = !g_cfg.bThumbColumn;
+				g_cfg.OnModified();
+				OnExit(NULL, NULL);
+			}
+			break;
+		case CMD_ToggleBackgroundScan:
+			g_cfg.bBackgroundScan = !g_cfg.bBackgroundScan;
+			g_cfg.OnModified();
+			break;
+
+		case CMD_NameSortNormal:
+		case CMD_NameSortStrip:
+		case CMD_NameSortMove:
+			g_cfg.namemode = cmd_id-CMD_NameSortNormal;
+			g_cfg.OnModified();
+			InvalidateRowCache();
+			RefreshFilteredDb(TRUE, TRUE);
+			break;
+
+		case CMD_ToggleAutoRefresh:
+			g_cfg.bAutoRefreshFilteredDb = !g_cfg.bAutoRefreshFilteredDb;
+			g_cfg.OnModified();
+			break;
+
+		case CMD_DebriefNever:
+			g_cfg.returnAfterGame[g_bRunningEditor] = RET_NEVER;
+			g_cfg.OnModified();
+			break;
+		case CMD_DebriefAfterFM:
+			g_cfg.returnAfterGame[g_bRunningEditor] = RET_FM;
+			g_cfg.OnModified();
+			break;
+		case CMD_DebriefAlways:
+			g_cfg.returnAfterGame[g_bRunningEditor] = RET_ALWAYS;
+			g_cfg.OnModified();
+			break;
+
+		case CMD_BackupSaves:
+			g_cfg.bDiffBackups = FALSE;
+			g_cfg.OnModified();
+			break;
+		case CMD_BackupDiff:
+			g_cfg.bDiffBackups = TRUE;
+			g_cfg.OnModified();
+			break;
+		case CMD_BackupReview:
+			g_cfg.bReviewDiffBackup = !g_cfg.bReviewDiffBackup;
+			g_cfg.OnModified();
+			break;
+
+#ifdef AUDIO_SUPPORT
+		case CMD_ConvertAudio:
+			g_cfg.bDecompressAudio = !g_cfg.bDecompressAudio;
+			g_cfg.OnModified();
+			break;
+#endif
+		case CMD_GenerateMissFlags:
+			g_cfg.bGenerateMissFlags = !g_cfg.bGenerateMissFlags;
+			g_cfg.OnModified();
+			break;
+
+		case CMD_ArchivePath:
+			ConfigArchivePath();
+			break;
+
+		case CMD_SaveDb:
+			if ( !SaveDb() )
+			{
+				fl_message_position(pMainWnd);
+				fl_alert("%s", $("Failed to save \"fmsel.ini\"."));
+			}
+			break;
+		case CMD_CleanDb:
+			fl_message_position(pMainWnd);
+			if ( fl_choice("%s", fl_no, fl_yes, NULL, $("Are you sure you want to clean all\nobsolete entries from the database?")) )
+				CleanDb();
+			break;
+		case CMD_DbMemoryReport:
+			ViewDbMemoryReport();
+			break;
+
+		case CMD_AutoScanDates:
+			AutoScanReleaseDates();
+			break;
+		case CMD_ExportIni:
+			ExportFmIni(fm);
+			break;
+		case CMD_CreateIni:
+			CreateStandaloneFmIni();
+			break;
+		case CMD_ExportBatchIni:
+			ExportBatchFmIni();
+			break;
+		case CMD_ImportBatchIni:
+			ImportBatchFmIni();
+			break;
+
+		case CMD_About:
+			ViewAbout();
+			break;
+
+		default:
+			if (cmd_id >= CMD_DateFmt0 && cmd_id <= CMD_DateFmtLast)
+			{
+				g_cfg.SetDatFmt(cmd_id-CMD_DateFmt0);
+				if (!++g_nSummaryGen)
+					g_nSummaryGen = 1;
+				InvalidateRowCache();
+				((Fl_Widget*)pFMList)->redraw();
+			}
+			else if (cmd_id >= CMD_TagRows0 && cmd_id <= CMD_TagRowsLast)
+			{
+				g_cfg.tagrows = cmd_id-CMD_TagRows0;
+				g_cfg.OnModified();
+				RefreshListControlRowSize();
+			}
+			else if (cmd_id >= CMD_WidgetScheme0 && cmd_id <= CMD_WidgetSchemeLast)
+			{
+				g_cfg.uitheme = cmd_id-CMD_WidgetScheme0;
+				g_cfg.OnModified();
+				if (g_cfg.uitheme >= 0 && g_cfg.uitheme < Fl_Scheme::num_schemes())
+				{
+					Fl::scheme(Fl_Scheme::names()[g_cfg.uitheme]);
+
+					pMainWnd->redraw();
+				}
+#ifndef NO_FLEET
+				else
+				{
+					int i = g_cfg.uitheme - Fl_Scheme::num_schemes();
+					if (i >= 0 && i < fle_num_schemes())
+					{
+						fle_set_scheme(fle_scheme_name(i));
+
+						pMainWnd->redraw();
+					}
+				}
+#endif
+			}
+#ifndef NO_FLEET
+			else if (cmd_id >= CMD_WidgetColors0 && cmd_id <= CMD_WidgetColorsLast)
+			{
+				fl_message_position(pMainWnd);
+				if ( fl_choice("%s", fl_cancel, fl_ok, NULL, $("Restart is required to change color scheme. Change colors and exit?")) )
+				{
+					g_cfg.uicolors = cmd_id-CMD_WidgetColors0;
+					g_cfg.OnModified();
+					OnExit(NULL, NULL);
+				}
+			}
+#endif
+		}
+	}
+};
+
+
+//
+// FM_Filter_Input (pressing tab always changes to next control instead of moving cursor to end of text if all selected)
+//
+
+class Fl_FM_Filter_Input : public Fl_Input
+{
+protected:
+	BOOL m_bEnterOrFocus;
+
+protected:
+	virtual int handle(int e)
+	{
+		m_bEnterOrFocus = FALSE;
+
+		if (e == FL_UNFOCUS)
+			m_bEnterOrFocus = TRUE;
+		else if (e == FL_KEYBOARD)
+		{
+			const int key = Fl::event_key();
+			const int _XK_ISO_Left_Tab = 0xfe20;
+
+			if (key == FL_Tab || key == _XK_ISO_Left_Tab)
+				return parent()->Fl_Group::handle(e);
+
+			if (key == FL_Enter || key == FL_KP_Enter)
+				m_bEnterOrFocus = TRUE;
+		}
+
+		return Fl_Input::handle(e);
+	}
+
+public:
+	Fl_FM_Filter_Input(int X, int Y, int W, int H, const char *l=0)
+		: Fl_Input(X,Y,W,H,l)
+	{
+		m_bEnterOrFocus = FALSE;
+	}
+
+	// returns TRUE if callback was called during text edit and not due to losing focus or pressing enter
+	// (useful for WHEN_CHANGED to know why the callback was called)
+	BOOL callback_reason_edit() const { return !m_bEnterOrFocus; }
+};
+
+
+//
+// FM_Tag_Input (custom tag input control)
+//
+
+class Fl_FM_Tag_Input : public Fl_Input
+{
+	enum
+	{
+		MAX_SUGGESTION_ROWS = 16,
+		// max number of suggestions in list (when there are more matches only the most used tags are listed)
+		MAX_SUGGESTIONS = 256,
+	};
+
+protected:
+	Fl_Callback *m_tagcb;
+
+protected:
+	//
+	// ListWidget
+	//
+
+	class ListWidget : public Fl_Browser_
+	{
+	public:
+		enum
+		{
+			ROW_HEIGHT = 14,
+		};
+
+	protected:
+		Fl_Font m_prefixfont;
+		string m_prefix;
+		int m_prefixW;
+
+		vector<string> m_suggestions;
+
+	protected:
+		friend class ListWnd;
+
+		virtual int item_width(void *) const { return w() - Fl::scrollbar_size(); }
+		virtual int item_height(void *) const { return ROW_HEIGHT; }
+
+		virtual void *item_first() const
+		{
+			return m_suggestions.empty() ? 0 : (void*)1;
+		}
+
+		virtual void *item_next(void *p) const
+		{
+			return ((intptr_t)p < (int)m_suggestions.size()) ? (void*)((intptr_t)p + 1) : 0;
+		}
+
+		virtual void *item_prev(void *p) const
+		{
+			return (intptr_t)p ? (void*)((intptr_t)p - 1) : 0;
+		}
+
+		virtual void item_draw(void *p, int X, int Y, int W, int H) const
+		{
+			const char *str = m_suggestions[(intptr_t)p - 1].c_str();
+			const int prefixlen = m_prefix.length();
+			int prefixW = m_prefixW;
+
+			X++;
+			Y++;
+			W -= 2;
+			H -= 2;
+
+			fl_color( labelcolor() );
+
+			// prefix (ie. the matching substring)
+			fl_font(m_prefixfont, labelsize());
+#if 0
+			fl_draw(m_prefix.c_str(), X, Y, W, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
+#else
+			// draw the prefix using the suggestion string so that case is preserved
+			char ch = str[prefixlen];
+			(char&)str[prefixlen] = 0;
+			prefixW = (int)fl_width(str);
+			fl_draw(str, X, Y, W, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
+			(char&)str[prefixlen] = ch;
+#endif
+
+			// the remainder of the string
+			str += prefixlen;
+			if (*str)
+			{
+				fl_font(labelfont(), labelsize());
+				fl_draw(str, X+prefixW, Y, W-prefixW, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
+			}
+		}
+
+		void EnumSuggestion(const char *suggestion, const char *prefix)
+		{
+			// don't add suggestions that match entered value 100%
+			if ( strcmp(suggestion, prefix) )
+				m_suggestions.push_back(suggestion);
+		}
+
+	public:
+		ListWidget(int W, int H)
+			: Fl_Browser_(0, 0, W, H)
+		{
+#if 0
+			// bold prefix
+			labelfont(FL_HELVETICA);
+			m_prefixfont = FL_HELVETICA_BOLD;
+#else
+			// bold suffix (ala google)
+			labelfont(FL_HELVETICA_BOLD);
+			m_prefixfont = FL_HELVETICA;
+#endif
+
+			labelsize(12);
+			labelcolor(FL_FOREGROUND_COLOR);
+			color(FL_BACKGROUND2_COLOR);
+			selection_color(FL_GRAY0+18);
+			box(COMPLETION_LIST_BOX);
+			has_scrollbar(VERTICAL);
+			type(FL_SELECT_BROWSER);
+			when(FL_WHEN_RELEASE | FL_WHEN_NOT_CHANGED);
+
+			m_suggestions.reserve(64);
+		}
+
+		int PopulateSuggestions(const char *s)
+		{
+			m_suggestions.clear();
+			m_prefix = s;
+
+			// only suggest stand-alone category names while no category has been entered
+			const BOOL bHasCat = (strchr(s, ':') != NULL);
+
+			// generate suggestions (most used tags first)
+			vector<const char*> list;
+			GetTagSuggestions(s, !bHasCat, MAX_SUGGESTIONS, list);
+			for (int i=0; i<(int)list.size(); i++)
+				EnumSuggestion(list[i], s);
+
+			new_list();
+
+			if ( !m_suggestions.empty() )
+			{
+				fl_font(m_prefixfont, labelsize());
+				m_prefixW = (int)fl_width(s);
+			}
+
+			return (int)m_suggestions.size();
+		}
+
+		const char* value() const
+		{
+			return selection() ? m_suggestions[(intptr_t)selection() - 1].c_str() : NULL;
+		}
+
+		const char* first_value() const
+		{
+			return m_suggestions.empty() ? NULL : m_suggestions[0].c_str();
+		}
+
+		void move_selection(int rows)
+		{
+			if (!rows)
+				return;
+
+			if ( !selection() )
+			{
+				// nothing selected, select first
+				select_first();
+				return;
+			}
+
+			if (rows == 1)
+			{
+				void *p = item_next( selection() );
+				if (p)
+					select_only(p);
+				return;
+			}
+			else if (rows == -1)
+			{
+				void *p = item_prev( selection() );
+				if (p)
+					select_only(p);
+				return;
+			}
+
+			if (rows > 0)
+			{
+				void *p = item_next( selection() );
+				if (!p)
+					return;
+
+				for (int i=0; i<rows; i++)
+				{
+					void *q = item_next(p);
+					if (!q)
+						break;
+					p = q;
+				}
+
+				select_only(p);
+			}
+			else
+			{
+				void *p = item_prev( selection() );
+				if (!p)
+					return;
+
+				rows = -rows;
+
+				for (int i=0; i<rows; i++)
+				{
+					void *q = item_prev(p);
+					if (!q)
+						break;
+					p = q;
+				}
+
+				select_only(p);
+			}
+		}
+
+		void select_first()
+		{
+			if ( !m_suggestions.empty() )
+				select_only((void*)1);
+		}
+
+		void select_last()
+		{
+			select_only( (void*)m_suggestions.size() );
+		}
+
+		int count() const
+		{
+			return m_suggestions.size();
+		}
+	};
+
+	//
+	// ListWnd
+	//
+
+	class ListWnd : public Fl_Double_Window
+	{
+	protected:
+		ListWidget *m_pList;
+
+		Fl_FM_Tag_Input *m_pOuter;
+
+		int m_listrows;
+
+	protected:
+		virtual int handle(int e)
+		{
+			switch (e)
+			{
+			case FL_HIDE:
+				((Fl_Widget*)pTagEdGroup)->activate();
+				break;
+			case FL_SHOW:
+				((Fl_Widget*)pTagEdGroup)->deactivate();
+				break;
+
+			case FL_KEYBOARD:
+				switch ( Fl::event_key() )
+				{
+				case FL_Escape:
+					hide();
+					return 1;
+				}
+				break;
+			}
+
+			return Fl_Double_Window::handle(e);
+		}
+
+		static void selchange_cb(ListWidget *, void *p)
+		{
+			((ListWnd*)p)->handle_list_key(FL_Enter);
+		}
+
+	public:
+		ListWnd(Fl_FM_Tag_Input *p)
+			: Fl_Double_Window(p->x(), p->y()+p->h(), p->w(), ListWidget::ROW_HEIGHT)
+		{
+			m_pOuter = p;
+			m_listrows = 0;
+
+			box(FL_NO_BOX);
+			clear_border();
+			clear_visible();
+
+			m_pList = new ListWidget(w(), h());
+
+			m_pList->callback((Fl_Callback*)selchange_cb, this);
+
+			end();
+
+			resizable(m_pList);
+
+			p->window()->add(this);
+		}
+
+		void Suggest(const char *s)
+		{
+			int rows = m_pList->PopulateSuggestions(s);
+			if (rows)
+			{
+				const int max_fit_rows = ((parent()->h() - y() - 8) - Fl::box_dh( m_pList->box() )) / ListWidget::ROW_HEIGHT;
+				const int max_rows = std::min((int)MAX_SUGGESTION_ROWS, max_fit_rows);
+				if (rows > max_rows)
+					rows = max_rows;
+
+				m_listrows = rows;
+
+				resize(x(), y(), w(), ListWidget::ROW_HEIGHT * rows + Fl::box_dh( m_pList->box() ));
+
+				show();
+			}
+			else
+				hide();
+		}
+
+		int handle_list_key(int key)
+		{
+			const int _XK_ISO_Left_Tab = 0xfe20;
+
+			const char *s;
+
+			switch (key)
+			{
+			case FL_Tab:
+				// tab complete (or if nothing is selected in list then select first row)
+				s = m_pList->value();
+				if (s)
+				{
+					m_pOuter->value( m_pList->value() );
+					return 1;
+				}
+				else if (m_pList->count() == 1)
+				{
+					m_pOuter->value( m_pList->first_value() );
+					hide();
+					return 1;
+				}
+				// fall through
+			case _XK_ISO_Left_Tab:
+				// if nothing is selected in list then select first row
+				if ( !m_pList->value() )
+					m_pList->select_first();
+				return 1;
+
+			case FL_Enter:
+			case FL_KP_Enter:
+				s = m_pList->value();
+				if (s)
+				{
+					m_pOuter->value( m_pList->value() );
+					hide();
+					return 1;
+				}
+				else if (m_pList->count() == 1)
+				{
+					m_pOuter->value( m_pList->first_value() );
+					hide();
+					return 1;
+				}
+				break;
+
+			case FL_Home:
+				m_pList->select_first();
+				return 1;
+			case FL_End:
+				m_pList->select_last();
+				return 1;
+
+			case FL_Up:
+				m_pList->move_selection(-1);
+				return 1;
+			case FL_Down:
+				m_pList->move_selection(1);
+				return 1;
+			case FL_Page_Up:
+				m_pList->move_selection(-(m_listrows-1));
+				return 1;
+			case FL_Page_Down:
+				m_pList->move_selection(m_listrows-1);
+				return 1;
+			}
+
+			return 0;
+		}
+	};
+
+	//
+
+protected:
+	ListWnd *m_pList;
+
+protected:
+	virtual int handle(int e)
+	{
+		switch (e)
+		{
+		case FL_KEYBOARD:
+			{
+			const int _XK_ISO_Left_Tab = 0xfe20;
+
+			if (m_pList && m_pList->visible())
+				if ( m_pList->handle_list_key( Fl::event_key() ) )
+					return 1;
+
+			switch ( Fl::event_key() )
+			{
+			case FL_Tab:
+			case _XK_ISO_Left_Tab:
+				return parent()->Fl_Group::handle(e);
+
+			case FL_Left:
+			case FL_Right:
+				if (m_pList && m_pList->visible())
+				{
+					// allow cursor navigation but not switching widget
+					Fl_Input::handle(e);
+					return 1;
+				}
+				break;
+
+			case FL_Enter:
+			case FL_KP_Enter:
+				HideSuggestions();
+				if (m_tagcb)
+					m_tagcb(this, NULL);
+				return 1;
+
+			case FL_Escape:
+				if (m_pList && m_pList->visible())
+				{
+					HideSuggestions();
+					return 1;
+				}
+				break;
+			}
+			}
+			break;
+		}
+
+		return Fl_Input::handle(e);
+	}
+
+	static void change_cb(Fl_Widget *o, void *) { ((Fl_FM_Tag_Input*)o)->OnChange(); }
+
+	void HideSuggestions()
+	{
+		m_pList->hide();
+	}
+
+	void ShowSuggestions(const char *s)
+	{
+		m_pList->Suggest(s);
+	}
+
+	static void draw_frame(int x, int y, int w, int h, Fl_Color c)
+	{
+		fl_color(c);
+		fl_rectf(x, y, w, h);
+		fl_color(FL_FOREGROUND_COLOR);
+		fl_rect(x, y, w, h);
+	}
+
+public:
+	Fl_FM_Tag_Input(int X, int Y, int W, int H, const char *l=0)
+		: Fl_Input(X,Y,W,H,l)
+	{
+		m_tagcb = NULL;
+		m_pList = new ListWnd(this);
+
+		when(FL_WHEN_CHANGED);
+		callback(change_cb);
+	}
+
+	void tag_callback(Fl_Callback *cb)
+	{
+		m_tagcb = cb;
+	}
+
+	void OnChange()
+	{
+		const char *s = value();
+
+		while (s && isspace_(*s)) s++;
+
+		if (s && *s)
+		{
+			pTagEdAddTag->activate();
+			ShowSuggestions(s);
+		}
+		else
+		{
+			pTagEdAddTag->deactivate();
+			HideSuggestions();
+		}
+	}
+
+	// workaround to check for event that should result in list being hidden
+	void check_listhide_event(int e)
+	{
+		if (!m_pList || !m_pList->visible())
+			return;
+
+		switch (e)
+		{
+		case FL_PUSH:
+			// clicking anywhere outside the input or list widget closes list
+			if ( !Fl::event_inside(x(), y(), x()+w(), y()+h()+m_pList->h()) )
+				HideSuggestions();
+			break;
+
+		case FL_FOCUS:
+			{
+			Fl_Widget *o = Fl::focus();
+			if (o != this && o != m_pList && m_pList->find(o) != m_pList->children())
+				HideSuggestions();
+			}
+			break;
+		}
+	}
+
+	static void static_init()
+	{
+		Fl::set_boxtype(COMPLETION_LIST_BOX, draw_frame, 1, 1, 2, 2);
+	}
+};
+
+
+//
+// ThumbCache
+//
+
+// persistent cache of downscaled FM thumbnails (fmthumb.jpg) for the optional thumbnail column in the FM list.
+// thumbnails are extracted, decoded and scaled by a worker thread and their pixels are packed into one RGB buffer
+// (the atlas) that is saved along with the entries to "fmsel.thumbs" in the FM root. entries are keyed by the
+// thumbnail source (FM archive or install dir) and regenerated when the mtime of the source changes. only rows
+// that get drawn request thumbnails, drawing a row that already has one doesn't do any file I/O
+
+#define THUMB_MAX_W			48
+#define THUMB_MAX_H			36
+
+#define THUMB_FILE_MAGIC	"FMSTHUMB"
+#define THUMB_FILE_VERSION	1
+
+struct ThumbEntry
+{
+	time_t mtime;			// mtime of the source when the thumbnail was generated, -1 if not generated yet
+	unsigned int offset;	// offset of RGB pixels in g_thumbAtlas
+	unsigned short w, h;	// 0 if source has no thumbnail
+	BOOL bVerified;			// source mtime has been checked this session
+	BOOL bQueued;			// requested from worker
+};
+
+typedef unordered_map<string, ThumbEntry, KeyHash> tThumbHash;
+
+struct ThumbJobItem
+{
+	string key;
+	string src;				// archive or image file
+	BOOL bArchive;
+	time_t mtime;			// in: mtime of cached thumbnail (-1 if none), out: mtime of source
+	BOOL bChanged;			// out: thumbnail was (re)generated
+	int w, h;
+	vector<unsigned char> pixels;
+};
+
+struct ThumbJob
+{
+	vector<ThumbJobItem> items;
+};
+
+static tThumbHash g_thumbHash;
+static vector<unsigned char> g_thumbAtlas;
+static BOOL g_bThumbCacheModified = FALSE;
+static BOOL g_bThumbCacheLoaded = FALSE;
+
+// requests that are batched into the next job when worker is idle
+static vector<ThumbJobItem> g_thumbPending;
+// job being processed by worker (only one at a time)
+static ThumbJob *g_pThumbJob = NULL;
+// group of the thumb job task, cancelled and joined by TermThumbCache
+static TaskGroupOS *g_pThumbGroup = NULL;
+
+static BOOL GetThumbCacheFilename(char *fname, int len)
+{
+	return _snprintf_s(fname, len, _TRUNCATE, "%s" DIRSEP_STR "fmsel.thumbs", GetRootPath()) != -1;
+}
+
+// get cache key of the thumbnail source of an FM, returns FALSE if FM has no source
+static BOOL GetThumbKey(const FMEntry *fm, string &key)
+{
+	if ( fm->IsArchived() )
+	{
+		key = "A";
+		key += fm->archive.c_str();
+	}
+	else if ( fm->IsInstalled() )
+	{
+		key = "D";
+		key += fm->name;
+	}
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+// box filter 'src' (with 'sd' bytes per pixel) down to 'dw' x 'dh' RGB pixels
+static void ScaleThumbnail(const unsigned char *src, int sw, int sh, int sd, int sld, int dw, int dh, unsigned char *dst)
+{
+	for (int y=0; y<dh; y++)
+	{
+		const int y0 = y * sh / dh;
+		const int y1 = std::max(y0+1, (y+1) * sh / dh);
+
+		for (int x=0; x<dw; x++)
+		{
+			const int x0 = x * sw / dw;
+			const int x1 = std::max(x0+1, (x+1) * sw / dw);
+
+			unsigned int r = 0, g = 0, b = 0;
+
+			for (int yy=y0; yy<y1; yy++)
+			{
+				const unsigned char *p = src + yy*sld + x0*sd;
+				for (int xx=x0; xx<x1; xx++, p+=sd)
+				{
+					// grayscale images have 1 or 2 (with alpha) channels
+					if (sd >= 3)
+					{
+						r += p[0];
+						g += p[1];
+						b += p[2];
+					}
+					else
+					{
+						r += p[0];
+						g += p[0];
+						b += p[0];
+					}
+				}
+			}
+
+			const unsigned int n = (y1-y0) * (x1-x0);
+			*dst++ = (unsigned char)(r / n);
+			*dst++ = (unsigned char)(g / n);
+			*dst++ = (unsigned char)(b / n);
+		}
+	}
+}
+
+// FLTK images aren't meant to be created from several threads at once, thumbnails are decoded on worker threads
+// (several at once when rebuilding the cache) and the html view loads jpegs on the main thread, so creating and
+// deleting jpeg images is serialized with this lock (created by InitFLTK, or by RebuildThumbCache in batch mode)
+static LockOS *g_pJpegLock = NULL;
+
+// scale decoded 'img' down to fit THUMB_MAX_W x THUMB_MAX_H
+static BOOL MakeThumbnail(const Fl_JPEG_Image &img, ThumbJobItem &item)
+{
+	const int sw = img.w();
+	const int sh = img.h();
+	const int sd = img.d();
+
+	if (sw <= 0 || sh <= 0 || sd <= 0 || img.count() < 1 || !img.data()[0])
+		return FALSE;
+
+	int dw = sw;
+	int dh = sh;
+	if (dw > THUMB_MAX_W)
+	{
+		dh = std::max(1, dh * THUMB_MAX_W / dw);
+		dw = THUMB_MAX_W;
+	}
+	if (dh > THUMB_MAX_H)
+	{
+		dw = std::max(1, dw * THUMB_MAX_H / dh);
+		dh = THUMB_MAX_H;
+	}
+
+	item.w = dw;
+	item.h = dh;
+	item.pixels.resize(dw * dh * 3);
+
+	ScaleThumbnail((const unsigned char*)img.data()[0], sw, sh, sd, img.ld() ? img.ld() : sw*sd, dw, dh, &item.pixels[0]);
+
+	return TRUE;
+}
+
+// decode jpeg in 'data' and make a thumbnail of it (called by worker thread)
+static BOOL MakeThumbnail(const char *data, ThumbJobItem &item)
+{
+	EnterLockOS(g_pJpegLock);
+	Fl_JPEG_Image *img = new Fl_JPEG_Image("fmthumb.jpg", (const unsigned char*)data);
+	LeaveLockOS(g_pJpegLock);
+
+	const BOOL bOk = MakeThumbnail(*img, item);
+
+	EnterLockOS(g_pJpegLock);
+	delete img;
+	LeaveLockOS(g_pJpegLock);
+
+	return bOk;
+}
+
+static void* ThumbWorkerThread(void *p);
+static void OnThumbJobDone(void *p);
+
+static void StartThumbJob(void *)
+{
+	if (g_pThumbJob || g_thumbPending.empty() || !g_pThumbGroup)
+		return;
+
+	ThumbJob *job = new ThumbJob;
+	job->items.swap(g_thumbPending);
+
+	g_pThumbJob = job;
+
+	if ( !SubmitTaskOS(g_pThumbGroup, ThumbWorkerThread, job, OnThumbJobDone) )
+	{
+		// complete job without results so the entries aren't requested again this session
+		for (int i=0; i<(int)job->items.size(); i++)
+			job->items[i].bChanged = FALSE;
+
+		OnThumbJobDone(job);
+	}
+}
+
+// regenerate the thumbnail of a job item if its source has changed (called by worker threads)
+static void UpdateThumbJobItem(ThumbJobItem &item)
+{
+	time_t mtime = 0;
+	GetFileMTimeOS(item.src.c_str(), mtime);
+
+	if (mtime == item.mtime)
+	{
+		item.bChanged = FALSE;
+		return;
+	}
+
+	item.mtime = mtime;
+	item.bChanged = TRUE;
+	item.w = item.h = 0;
+
+	void *data = NULL;
+	int n = 0;
+
+	if (item.bArchive)
+	{
+		if ( !ExtractFileFromArchiveMT(item.src.c_str(), "fmthumb.jpg", data, n) )
+			return;
+	}
+	else
+	{
+		FILE *f = fl_fopen(item.src.c_str(), "rb");
+		if (!f)
+			return;
+
+		n = GetFILESizeOS(f);
+		if (n > 0)
+		{
+			data = new char[n+2];
+			if ((int)fread(data, 1, n, f) != n)
+			{
+				delete[] (char*)data;
+				data = NULL;
+			}
+		}
+		fclose(f);
+
+		if (!data)
+			return;
+	}
+
+	if ( !MakeThumbnail((const char*)data, item) )
+		item.w = item.h = 0;
+
+	delete[] (char*)data;
+}
+
+static void* ThumbWorkerThread(void *p)
+{
+	ThumbJob *job = (ThumbJob*)p;
+
+	for (int i=0; i<(int)job->items.size(); i++)
+	{
+		if ( IsTaskGroupCancelledOS(g_pThumbGroup) )
+			break;
+
+		UpdateThumbJobItem(job->items[i]);
+	}
+
+	return 0;
+}
+
+// called in main thread (as task continuation) when worker has finished a job
+static void OnThumbJobDone(void *p)
+{
+	ThumbJob *job = (ThumbJob*)p;
+
+	if (job == g_pThumbJob)
+		g_pThumbJob = NULL;
+
+	// thumb cache was terminated
+	if (!g_pThumbGroup)
+	{
+		delete job;
+		return;
+	}
+
+	for (int i=0; i<(int)job->items.size(); i++)
+	{
+		ThumbJobItem &item = job->items[i];
+
+		tThumbHash::iterator it = g_thumbHash.find(item.key);
+		if (it == g_thumbHash.end())
+			continue;
+
+		ThumbEntry &t = it->second;
+		t.bQueued = FALSE;
+		t.bVerified = TRUE;
+
+		if (item.bChanged)
+		{
+			// old pixels of a regenerated thumbnail remain in the atlas until it's saved
+			t.mtime = item.mtime;
+			t.w = (unsigned short)item.w;
+			t.h = (unsigned short)item.h;
+			t.offset = (unsigned int)g_thumbAtlas.size();
+			g_thumbAtlas.insert(g_thumbAtlas.end(), item.pixels.begin(), item.pixels.end());
+
+			g_bThumbCacheModified = TRUE;
+		}
+	}
+
+	delete job;
+
+	if (pFMList)
+		((Fl_Widget*)pFMList)->redraw();
+
+	StartThumbJob(NULL);
+}
+
+static void InitThumbJobItem(const FMEntry *fm, const string &key, time_t mtime, ThumbJobItem &item)
+{
+	item.key = key;
+	item.bArchive = fm->IsArchived();
+	item.mtime = mtime;
+	item.bChanged = FALSE;
+	item.w = item.h = 0;
+
+	if (item.bArchive)
+		item.src = fm->GetArchiveFilePath();
+	else
+	{
+		item.src = GetRootPath();
+		item.src += DIRSEP_STR;
+		item.src += fm->name;
+		item.src += DIRSEP_STR "fmthumb.jpg";
+	}
+}
+
+// get cached thumbnail for an FM, if it's missing or hasn't been verified yet this session then it's requested
+// from the worker (a cached but unverified thumbnail is still returned). returns NULL if there's no thumbnail
+static const ThumbEntry* GetThumbnail(const FMEntry *fm)
+{
+	if (!g_bThumbCacheLoaded)
+		return NULL;
+
+	string key;
+	if ( !GetThumbKey(fm, key) )
+		return NULL;
+
+	tThumbHash::iterator it = g_thumbHash.find(key);
+	if (it == g_thumbHash.end())
+	{
+		ThumbEntry t = {};
+		t.mtime = -1;
+		it = g_thumbHash.insert( tThumbHash::value_type(key, t) ).first;
+	}
+
+	ThumbEntry &t = it->second;
+
+	if (!t.bVerified && !t.bQueued)
+	{
+		t.bQueued = TRUE;
+
+		ThumbJobItem item;
+		InitThumbJobItem(fm, key, t.mtime, item);
+
+		// the archive lib has to be initialized by the main thread
+		if (item.bArchive && !InitArchiveSystem())
+		{
+			t.bQueued = FALSE;
+			t.bVerified = TRUE;
+		}
+		else
+		{
+			if ( g_thumbPending.empty() )
+				Fl::add_timeout(0.0, StartThumbJob);
+			g_thumbPending.push_back(item);
+		}
+	}
+
+	return t.w ? &t : NULL;
+}
+
+static void InitThumbCache()
+{
+	if (!g_cfg.bThumbColumn)
+		return;
+
+	g_pThumbGroup = CreateTaskGroupOS();
+	g_bThumbCacheLoaded = TRUE;
+
+	char fname[MAX_PATH_BUF];
+	if ( !GetThumbCacheFilename(fname, sizeof(fname)) )
+		return;
+
+	FILE *f = fl_fopen(fname, "rb");
+	if (!f)
+		return;
+
+	vector<unsigned char> data( GetFILESizeOS(f) );
+	if ( data.empty() || fread(&data[0], 1, data.size(), f) != data.size() )
+	{
+		fclose(f);
+		return;
+	}
+	fclose(f);
+
+	// parse file, layout is magic, version and count followed by entries of
+	// key len, key, mtime (64-bit), width and height (16-bit) and RGB pixels
+
+	const unsigned char *s = &data[0];
+	const unsigned char *end = s + data.size();
+	unsigned int version, count;
+
+	#define THUMB_READ(_p, _n) \
+		if (end - s < (ptrdiff_t)(_n)) \
+			goto corrupt; \
+		memcpy(_p, s, _n); \
+		s += _n;
+
+	char magic[8];
+	THUMB_READ(magic, 8);
+	THUMB_READ(&version, sizeof(version));
+	THUMB_READ(&count, sizeof(count));
+
+	if (memcmp(magic, THUMB_FILE_MAGIC, 8) || version != THUMB_FILE_VERSION)
+	{
+		TRACE("discarding thumbnail cache with unknown version");
+		return;
+	}
+
+	g_thumbAtlas.reserve(data.size());
+
+	for (unsigned int i=0; i<count; i++)
+	{
+		unsigned int keylen;
+		__int64 mtime;
+		ThumbEntry t = {};
+
+		THUMB_READ(&keylen, sizeof(keylen));
+		if (end - s < (ptrdiff_t)keylen)
+			goto corrupt;
+		const string key((const char*)s, keylen);
+		s += keylen;
+
+		THUMB_READ(&mtime, sizeof(mtime));
+		THUMB_READ(&t.w, sizeof(t.w));
+		THUMB_READ(&t.h, sizeof(t.h));
+
+		const size_t n = t.w * t.h * 3;
+		if ((size_t)(end - s) < n)
+			goto corrupt;
+
+		t.mtime = (time_t)mtime;
+		t.offset = (unsigned int)g_thumbAtlas.size();
+		g_thumbAtlas.insert(g_thumbAtlas.end(), s, s + n);
+		s += n;
+
+		g_thumbHash[key] = t;
+	}
+
+	#undef THUMB_READ
+
+	return;
+
+corrupt:
+	TRACE("discarding corrupt thumbnail cache");
+	g_thumbHash.clear();
+	g_thumbAtlas.clear();
+}
+
+// stop worker and save cache (if modified), must be called before TermDb
+static void TermThumbCache()
+{
+	if (g_pThumbGroup)
+	{
+		CancelTaskGroupOS(g_pThumbGroup);
+		DestroyTaskGroupOS(g_pThumbGroup);
+		g_pThumbGroup = NULL;
+	}
+
+	// (a running job is deleted by its continuation)
+	g_pThumbJob = NULL;
+
+	Fl::remove_timeout(StartThumbJob);
+	g_thumbPending.clear();
+
+	if (!g_bThumbCacheLoaded)
+		return;
+
+	// drop entries of sources that no longer exist in the db
+	unordered_set<string> live;
+	string key;
+	for (int i=0; i<(int)g_db.size(); i++)
+		if ( GetThumbKey(g_db[i], key) )
+			live.insert(key);
+
+	unsigned int count = 0;
+	for (tThumbHash::iterator it=g_thumbHash.begin(); it!=g_thumbHash.end(); )
+	{
+		if (it->second.mtime == -1 || live.find(it->first) == live.end())
+		{
+			if (it->second.mtime != -1)
+				g_bThumbCacheModified = TRUE;
+
+			tThumbHash::iterator next = it;
+			++next;
+			g_thumbHash.erase(it);
+			it = next;
+		}
+		else
+		{
+			count++;
+			++it;
+		}
+	}
+
+	if (g_bThumbCacheModified)
+	{
+		char fname[MAX_PATH_BUF];
+		FILE *f = GetThumbCacheFilename(fname, sizeof(fname)) ? fl_fopen(fname, "wb") : NULL;
+		if (f)
+		{
+			const unsigned int version = THUMB_FILE_VERSION;
+
+			fwrite(THUMB_FILE_MAGIC, 1, 8, f);
+			fwrite(&version, sizeof(version), 1, f);
+			fwrite(&count, sizeof(count), 1, f);
+
+			// (pixels of replaced thumbnails are left out, compacting the atlas)
+			for (tThumbHash::iterator it=g_thumbHash.begin(); it!=g_thumbHash.end(); ++it)
+			{
+				const ThumbEntry &t = it->second;
+				const unsigned int keylen = (unsigned int)it->first.length();
+				const __int64 mtime = t.mtime;
+
+				fwrite(&keylen, sizeof(keylen), 1, f);
+				fwrite(it->first.c_str(), 1, keylen, f);
+				fwrite(&mtime, sizeof(mtime), 1, f);
+				fwrite(&t.w, sizeof(t.w), 1, f);
+				fwrite(&t.h, sizeof(t.h), 1, f);
+				if (t.w && t.h)
+					fwrite(&g_thumbAtlas[t.offset], 1, t.w * t.h * 3, f);
+			}
+
+			if ( ferror(f) )
+				TRACE("failed to write thumbnail cache %s", fname);
+
+			fclose(f);
+		}
+	}
+
+	g_thumbHash.clear();
+	g_thumbAtlas.clear();
+	g_bThumbCacheLoaded = FALSE;
+}
+
+// regenerate the thumbnails of all FMs and save the cache (for batch mode), each FM is a task for the thread pool,
+// returns the number of FMs that have a thumbnail
+
+static void* ThumbRebuildTask(void *p)
+{
+	UpdateThumbJobItem(*(ThumbJobItem*)p);
+
+	return 0;
+}
+
+static int RebuildThumbCache()
+{
+	TRACE_SCOPE("RebuildThumbCache");
+
+	g_thumbHash.clear();
+	g_thumbAtlas.clear();
+	g_bThumbCacheLoaded = TRUE;
+	g_bThumbCacheModified = TRUE;
+
+	// the archive lib has to be initialized by the main thread
+	const BOOL bArchivesOk = InitArchiveSystem();
+
+	vector<ThumbJobItem> items;
+	items.reserve( g_db.size() );
+
+	string key;
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		FMEntry *fm = g_db[i];
+
+		if (!GetThumbKey(fm, key) || (fm->IsArchived() && !bArchivesOk))
+			continue;
+
+		items.push_back( ThumbJobItem() );
+		InitThumbJobItem(fm, key, -1, items.back());
+	}
+
+	// batch mode doesn't go through InitFLTK
+	const BOOL bOwnJpegLock = !g_pJpegLock;
+	if (bOwnJpegLock)
+		g_pJpegLock = CreateLockOS();
+
+	TaskGroupOS *group = CreateTaskGroupOS();
+
+	for (int i=0; i<(int)items.size(); i++)
+		if ( !SubmitTaskOS(group, ThumbRebuildTask, &items[i]) )
+			ThumbRebuildTask(&items[i]);
+
+	DestroyTaskGroupOS(group);
+
+	if (bOwnJpegLock)
+	{
+		DestroyLockOS(g_pJpegLock);
+		g_pJpegLock = NULL;
+	}
+
+	int count = 0;
+
+	for (int i=0; i<(int)items.size(); i++)
+	{
+		const ThumbJobItem &item = items[i];
+
+		ThumbEntry t = {};
+		t.mtime = item.mtime;
+		t.w = (unsigned short)item.w;
+		t.h = (unsigned short)item.h;
+		t.offset = (unsigned int)g_thumbAtlas.size();
+		t.bVerified = TRUE;
+		g_thumbAtlas.insert(g_thumbAtlas.end(), item.pixels.begin(), item.pixels.end());
+
+		g_thumbHash[item.key] = t;
+
+		if (t.w)
+			count++;
+	}
+
+	TermThumbCache();
+
+	return count;
+}
+
+
+//
+// FM_List
+//
+
+class Fl_FM_List : public Fl_Table_Row
+{
+	struct ColDef
+	{
+		const char *name;
+		int width;
+		int minwidth;
+		int width2;		// alt size when using large font
+		BOOL visible;
+		int sortid;
+
+		int ui_col_index;
+	};
+
+	static ColDef s_columns[COL_NUM_COLS];
+	static int s_column_idx[COL_NUM_COLS]; // map ui col index to s_columns index
+
+	int m_font;
+	int m_fontsize;
+	int m_tagfontsize;
+	Fl_Align m_tagalign;
+
+	int m_noTagH;
+	int m_minRowH;	// min row height (to fit thumbnails)
+
+	int m_topH;
+	int m_tagY;
+	int m_tagRowH;
+
+	int m_nPendingRclickRow;
+
+private:
+	static void event_callback(Fl_Widget*, void *data)
+	{
+		Fl_FM_List *o = (Fl_FM_List*)data;
+		o->OnCallback();
+	}
+	void OnCallback();
+
+	// get the cached row strings of an FM, (re)generating them if they were invalidated
+	FMRowCache* row_cache(const FMEntry *fm) const
+	{
+		FMRowCache *rc = fm->rowCache;
+		if (rc && rc->gen == g_nRowCacheGen)
+			return rc;
+
+		if (!rc)
+			rc = fm->rowCache = new FMRowCache;
+
+		char s[64];
 
-		Fl_Menu_Item menu[MAX_MENU_ITEMS];
+		rc->gen = g_nRowCacheGen;
+		rc->name = GetListName(fm);
 
-		MENU_SUB($("Tag Rows"));
-			MENU_RITEM($("Hide Tags"), CMD_TagRows0, g_cfg.tagrows == 0);
-			MENU_RITEM("1", CMD_TagRows0+1, g_cfg.tagrows == 1);
-			MENU_RITEM("2", CMD_TagRows0+2, g_cfg.tagrows == 2);
-			MENU_RITEM("3", CMD_TagRows0+3, g_cfg.tagrows == 3);
-			MENU_RITEM("4", CMD_TagRows0+4, g_cfg.tagrows == 4);
-			MENU_MOD_DIV();
-			MENU_TITEM($("Variable Height"), CMD_ToggleVarSizeRows, g_cfg.bVarSizeList);
-			MENU_MOD_DISABLE(g_cfg.tagrows == 0);
-			MENU_END();
-		MENU_SUB($("Date Format"));
-			for (i=0; i<DATEFMT_NUM_FORMATS; i++)
-				MENU_DATEFMT(i);
-			MENU_END();
-		MENU_SUB($("UI Theme"));
-			for (i=0; i<Fl_Scheme::num_schemes() && i<MAX_WIDGET_SCHEMES; i++)
-				MENU_RITEM(Fl_Scheme::names()[i], CMD_WidgetScheme0+i, g_cfg.uitheme == i);
-#ifndef NO_FLEET
-			for (j=i,i=0; i<fle_num_schemes() && i<MAX_WIDGET_SCHEMES; i++,j++)
-				MENU_RITEM(fle_scheme_name(i), CMD_WidgetScheme0+j, g_cfg.uitheme == j);
-#endif
-			MENU_END();
-		MENU_SUB($("UI Colors"));
-#ifndef NO_FLEET
-			for (i=0; i<fle_num_colors() && i<MAX_WIDGET_COLORS; i++)
-				MENU_RITEM(fle_colors_name(i), CMD_WidgetColors0+i, g_cfg.uicolors == i);
-			MENU_MOD_DIV();
-#endif
-			MENU_TITEM($("Darken HTML"), CMD_DarkenHTML, g_cfg.bDarkHTMLColors);
-			MENU_END();
-		MENU_SUB($("UI Font Size"));
-			MENU_RITEM($("Normal"), CMD_FontSizeNormal, g_cfg.bLargeFont == 0);
-			MENU_RITEM($("Large"), CMD_FontSizeLarge, g_cfg.bLargeFont != 0);
-			MENU_END();
-		MENU_SUB($("Misc")); MENU_MOD_DIV();
-			MENU_TITEM($("Word Wrap Descr Editor"), CMD_ToggleWrapDescrEdit, g_cfg.bWrapDescrEditor);
-			MENU_TITEM($("Word Wrap Notes Editor"), CMD_ToggleWrapNotesEdit, g_cfg.bWrapNotesEditor);
-			MENU_END();
-		MENU_SUB($("Name Format")); MENU_MOD_DIV();
-			MENU_RITEM($("Keep Leading Article"), CMD_NameSortNormal, g_cfg.namemode == NSM_Normal);
-			MENU_RITEM($("Ignore Leading Article"), CMD_NameSortStrip, g_cfg.namemode == NSM_Strip);
-			MENU_RITEM($("Move Leading Article"), CMD_NameSortMove, g_cfg.namemode == NSM_Move);
-			MENU_END();
-		if (bAdvanced)
-		{
-			MENU_TITEM($("No Auto-refresh"), CMD_ToggleAutoRefresh, !g_cfg.bAutoRefreshFilteredDb);
-			MENU_MOD_DIV();
-		}
-		MENU_SUB($("Return to FMSel")); MENU_MOD_DIV();
-			MENU_RITEM($("Never"), CMD_DebriefNever, g_cfg.returnAfterGame[g_bRunningEditor] == RET_NEVER);
-			MENU_RITEM($("After FM"), CMD_DebriefAfterFM, g_cfg.returnAfterGame[g_bRunningEditor] == RET_FM);
-			MENU_RITEM($("Always"), CMD_DebriefAlways, g_cfg.returnAfterGame[g_bRunningEditor] == RET_ALWAYS);
-			MENU_END();
-		MENU_ITEM($("FM Archive Path..."), CMD_ArchivePath);
-		MENU_SUB($("Backup Type")); MENU_MOD_DISABLE(!g_cfg.bRepoOK);
-			MENU_RITEM($("Only Saves and Shots"), CMD_BackupSaves, !g_cfg.bDiffBackups);
-			MENU_RITEM($("All Changed Files"), CMD_BackupDiff, g_cfg.bDiffBackups);
-			MENU_MOD_DIV();
-			MENU_TITEM($("Review Before Backup"), CMD_BackupReview, !g_cfg.bReviewDiffBackup);
-			MENU_END();
-#ifdef T3_SUPPORT
-#ifdef AUDIO_SUPPORT
-		if (!g_bRunningThief3)
-#else
-		if (!g_bRunningShock || !g_bRunningThief3)
-#endif
-#elif !defined(AUDIO_SUPPORT)
-		if (!g_bRunningShock)
-#endif
+		rc->lastPlayed.clear();
+		if (fm->tmLastStarted)
 		{
-		MENU_SUB($("Install Options")); MENU_MOD_DISABLE(!g_cfg.bRepoOK); MENU_MOD_DIV();
-#ifdef AUDIO_SUPPORT
-			MENU_TITEM($("Convert Audio to WAV"), CMD_ConvertAudio, g_cfg.bDecompressAudio);
-			if (!g_bRunningShock)
-#endif
-			MENU_TITEM($("Generate Mission Flags"), CMD_GenerateMissFlags, g_cfg.bGenerateMissFlags);
-			MENU_END();
+			FormatDbDate(fm->tmLastStarted, s, sizeof(s), TRUE);
+			rc->lastPlayed = s;
 		}
-		MENU_SUB($("Tasks")); MENU_MOD_DIV();
-			MENU_ITEM($("Auto-fill Release Dates"), CMD_AutoScanDates);
-			MENU_MOD_DIV();
-			MENU_ITEM($("Export FM.INI from FM..."), CMD_ExportIni);
-			MENU_MOD_DISABLE(!fm);
-			MENU_ITEM($("Create New FM.INI..."), CMD_CreateIni);
-			MENU_MOD_DIV();
-			MENU_ITEM($("Export Batched FM.INI..."), CMD_ExportBatchIni);
-			MENU_ITEM($("Import Batched FM.INI..."), CMD_ImportBatchIni);
-			MENU_END();
-		if (bAdvanced)
+
+		rc->releaseDate.clear();
+		if (fm->tmReleaseDate)
 		{
-			MENU_ITEM($("Save Db Now"), CMD_SaveDb);
-			MENU_ITEM($("Clean Db"), CMD_CleanDb);
+			FormatDbDate(fm->tmReleaseDate, s, sizeof(s), FALSE);
+			rc->releaseDate = s;
 		}
-		MENU_MOD_DIV();
-		MENU_ITEM($("About"), CMD_About);
-		MENU_END();
 
-		const Fl_Menu_Item *m = menu->pulldown(x(), y(), w(), h(), 0, this);
-		if (!m || !m->user_data())
-			return;
-
-		const int cmd_id = (intptr_t)m->user_data();
-		switch (cmd_id)
-		{
-		case CMD_ToggleVarSizeRows:
-			g_cfg.bVarSizeList = !g_cfg.bVarSizeList;
-			g_cfg.OnModified();
-			RefreshListControlRowSize();
-			break;
+		const int full = fm->rating >> 1;
+		for (int i=0; i<5; i++)
+			rc->stars[i] = (i < full) ? 2 : ((i == full && (fm->rating & 1)) ? 1 : 0);
 
-		case CMD_DarkenHTML:
-			g_cfg.bDarkHTMLColors = !g_cfg.bDarkHTMLColors;
-			g_cfg.OnModified();
-			break;
+		rc->tagW = -1;
+		rc->tagLines.clear();
 
-		case CMD_FontSizeNormal:
-		case CMD_FontSizeLarge:
-			fl_message_position(pMainWnd);
-			if ( fl_choice("%s", fl_cancel, fl_ok, NULL, $("Restart is required to change font size. Change size and exit?")) )
-			{
-				g_cfg.bLargeFont = (cmd_id == CMD_FontSizeLarge);
-				g_cfg.OnModified();
-				OnExit(NULL, NULL);
-			}
-			break;
+		return rc;
+	}
 
-		case CMD_ToggleWrapDescrEdit:
-			g_cfg.bWrapDescrEditor = !g_cfg.bWrapDescrEditor;
-			g_cfg.OnModified();
-			break;
-		case CMD_ToggleWrapNotesEdit:
-			g_cfg.bWrapNotesEditor = !g_cfg.bWrapNotesEditor;
-			g_cfg.OnModified();
-			break;
+	// word wrap the tags of an FM to width 'W' (unless already cached for that width), the tag font must be
+	// selected, returns the wrapped lines
+	const vector<FMRowCache::TagLine>& wrap_tags(const FMEntry *fm, int W) const
+	{
+		FMRowCache *rc = row_cache(fm);
+		if (rc->tagW == W && rc->tagFontSize == m_tagfontsize)
+			return rc->tagLines;
 
-		case CMD_NameSortNormal:
-		case CMD_NameSortStrip:
-		case CMD_NameSortMove:
-			g_cfg.namemode = cmd_id-CMD_NameSortNormal;
-			g_cfg.OnModified();
-			RefreshFilteredDb(TRUE, TRUE);
-			break;
+		rc->tagW = W;
+		rc->tagFontSize = m_tagfontsize;
+		rc->tagLines.clear();
 
-		case CMD_ToggleAutoRefresh:
-			g_cfg.bAutoRefreshFilteredDb = !g_cfg.bAutoRefreshFilteredDb;
-			g_cfg.OnModified();
-			break;
+		// break lines at the last space that fits (like fl_draw with FL_ALIGN_WRAP), a word wider than W gets
+		// a line of its own
+		const char *text = fm->tagsUI.c_str();
+		const int len = (int)fm->tagsUI.length();
 
-		case CMD_DebriefNever:
-			g_cfg.returnAfterGame[g_bRunningEditor] = RET_NEVER;
-			g_cfg.OnModified();
-			break;
-		case CMD_DebriefAfterFM:
-			g_cfg.returnAfterGame[g_bRunningEditor] = RET_FM;
-			g_cfg.OnModified();
-			break;
-		case CMD_DebriefAlways:
-			g_cfg.returnAfterGame[g_bRunningEditor] = RET_ALWAYS;
-			g_cfg.OnModified();
-			break;
+		int start = 0;
+		while (start < len)
+		{
+			int end = start;
+			while (end < len)
+			{
+				int next = end;
+				while (next < len && text[next] == ' ')
+					next++;
+				while (next < len && text[next] != ' ')
+					next++;
 
-		case CMD_BackupSaves:
-			g_cfg.bDiffBackups = FALSE;
-			g_cfg.OnModified();
-			break;
-		case CMD_BackupDiff:
-			g_cfg.bDiffBackups = TRUE;
-			g_cfg.OnModified();
-			break;
-		case CMD_BackupReview:
-			g_cfg.bReviewDiffBackup = !g_cfg.bReviewDiffBackup;
-			g_cfg.OnModified();
-			break;
+				if (end > start && W > 0 && fl_width(text+start, next-start) > W)
+					break;
 
-#ifdef AUDIO_SUPPORT
-		case CMD_ConvertAudio:
-			g_cfg.bDecompressAudio = !g_cfg.bDecompressAudio;
-			g_cfg.OnModified();
-			break;
-#endif
-		case CMD_GenerateMissFlags:
-			g_cfg.bGenerateMissFlags = !g_cfg.bGenerateMissFlags;
-			g_cfg.OnModified();
-			break;
+				end = next;
+			}
 
-		case CMD_ArchivePath:
-			ConfigArchivePath();
-			break;
+			FMRowCache::TagLine line = { start, end - start };
+			rc->tagLines.push_back(line);
 
-		case CMD_SaveDb:
-			if ( !SaveDb() )
-			{
-				fl_message_position(pMainWnd);
-				fl_alert("%s", $("Failed to save \"fmsel.ini\"."));
-			}
-			break;
-		case CMD_CleanDb:
-			fl_message_position(pMainWnd);
-			if ( fl_choice("%s", fl_no, fl_yes, NULL, $("Are you sure you want to clean all\nobsolete entries from the database?")) )
-				CleanDb();
-			break;
+			start = end;
+			while (start < len && text[start] == ' ')
+				start++;
+		}
 
-		case CMD_AutoScanDates:
-			AutoScanReleaseDates();
-			break;
-		case CMD_ExportIni:
-			ExportFmIni(fm);
-			break;
-		case CMD_CreateIni:
-			CreateStandaloneFmIni();
-			break;
-		case CMD_ExportBatchIni:
-			ExportBatchFmIni();
-			break;
-		case CMD_ImportBatchIni:
-			ImportBatchFmIni();
-			break;
+		return rc->tagLines;
+	}
 
-		case CMD_About:
-			ViewAbout();
-			break;
+protected:
+	virtual void draw_cell(TableContext context, int R=0, int C=0, int X=0, int Y=0, int W=0, int H=0);
 
-		default:
-			if (cmd_id >= CMD_DateFmt0 && cmd_id <= CMD_DateFmtLast)
-			{
-				g_cfg.SetDatFmt(cmd_id-CMD_DateFmt0);
-				((Fl_Widget*)pFMList)->redraw();
-			}
-			else if (cmd_id >= CMD_TagRows0 && cmd_id <= CMD_TagRowsLast)
-			{
-				g_cfg.tagrows = cmd_id-CMD_TagRows0;
-				g_cfg.OnModified();
-				RefreshListControlRowSize();
-			}
-			else if (cmd_id >= CMD_WidgetScheme0 && cmd_id <= CMD_WidgetSchemeLast)
+	virtual int handle(int e)
+	{
+		switch (e)
+		{
+		case FL_PUSH:
+			if (Fl::event_button() == FL_RIGHT_MOUSE)
 			{
-				g_cfg.uitheme = cmd_id-CMD_WidgetScheme0;
-				g_cfg.OnModified();
-				if (g_cfg.uitheme >= 0 && g_cfg.uitheme < Fl_Scheme::num_schemes())
-				{
-					Fl::scheme(Fl_Scheme::names()[g_cfg.uitheme]);
-
-					pMainWnd->redraw();
-				}
-#ifndef NO_FLEET
-				else
-				{
-					int i = g_cfg.uitheme - Fl_Scheme::num_schemes();
-					if (i >= 0 && i < fle_num_schemes())
-					{
-						fle_set_scheme(fle_scheme_name(i));
+				int R, C;
+				ResizeFlag resizeflag;
+				TableContext context = cursor2rowcol(R, C, resizeflag);
+				m_nPendingRclickRow = -1;
+				if (context == CONTEXT_CELL)
+				{
+					m_nPendingRclickRow = R;
+					// keep a multi-selection when right-clicking one of its rows
+					if ( row_selected(R) )
+						set_current_row(R);
+					else
+						select_row_ex(R);
+				}
 
-						pMainWnd->redraw();
-					}
+				return 1;
+			}
+			else if (Fl::event_button() == FL_LEFT_MOUSE && Fl::event_clicks() > 0)
+			{
+				int R, C;
+				ResizeFlag resizeflag;
+				TableContext context = cursor2rowcol(R, C, resizeflag);
+				m_nPendingRclickRow = -1;
+				if (context == CONTEXT_CELL)
+				{
+					select_row_ex(R);
+					OnDblClick();
 				}
-#endif
+				return 1;
 			}
-#ifndef NO_FLEET
-			else if (cmd_id >= CMD_WidgetColors0 && cmd_id <= CMD_WidgetColorsLast)
+			break;
+
+		case FL_RELEASE:
+			if (Fl::event_button() == FL_RIGHT_MOUSE)
 			{
-				fl_message_position(pMainWnd);
-				if ( fl_choice("%s", fl_cancel, fl_ok, NULL, $("Restart is required to change color scheme. Change colors and exit?")) )
+				if (m_nPendingRclickRow >= 0)
 				{
-					g_cfg.uicolors = cmd_id-CMD_WidgetColors0;
-					g_cfg.OnModified();
-					OnExit(NULL, NULL);
+					DoContextMenu();
+					m_nPendingRclickRow = -1;
 				}
+				return 1;
 			}
-#endif
-		}
-	}
-};
+			break;
 
+		case FL_KEYBOARD:
+			switch( Fl::event_key() )
+			{
+			case FL_Enter:
+			case FL_KP_Enter: OnDblClick(); break;
+			case FL_Home: move_selection(-1000000, 0); break;
+			case FL_End: move_selection(1000000, 0); break;
+			case FL_Page_Up: move_selection(-(botrow - toprow - 1), 0); break;
+			case FL_Page_Down: move_selection(botrow - toprow - 1 , 0); break;
+			case FL_Up: move_selection(-1, 0); break;
+			case FL_Down: move_selection(1, 0); break;
+			case FL_Left: scroll_horz(-50); break;
+			case FL_Right: scroll_horz(50); break;
+			default:
+				return Fl_Table_Row::handle(e);
+			}
+			return 1;
 
-//
-// FM_Filter_Input (pressing tab always changes to next control instead of moving cursor to end of text if all selected)
-//
+		case FL_FOCUS:
+		case FL_UNFOCUS:
+			redraw();
+			break;
+		}
 
-class Fl_FM_Filter_Input : public Fl_Input
-{
-protected:
-	BOOL m_bEnterOrFocus;
+		return Fl_Table_Row::handle(e);
+	}
 
-protected:
-	virtual int handle(int e)
+	// make R the only selected row
+	void select_row_ex(int R)
 	{
-		m_bEnterOrFocus = FALSE;
+		if ( !row_selected(R) || num_rows_selected() > 1 )
+		{
+			select_all_rows(0);
+			select_row(R);
+			this->Fl_Table::select_row = current_row = R;
+			do_callback(CONTEXT_CELL, R, 0);
+		}
+	}
 
-		if (e == FL_UNFOCUS)
-			m_bEnterOrFocus = TRUE;
-		else if (e == FL_KEYBOARD)
+	// make the (already selected) row R the one that selected() returns
+	void set_current_row(int R)
+	{
+		if (this->Fl_Table::select_row != R)
 		{
-			const int key = Fl::event_key();
-			const int _XK_ISO_Left_Tab = 0xfe20;
+			this->Fl_Table::select_row = current_row = R;
+			do_callback(CONTEXT_CELL, R, 0);
+		}
+	}
 
-			if (key == FL_Tab || key == _XK_ISO_Left_Tab)
-				return parent()->Fl_Group::handle(e);
+	void move_selection(int R, int C)
+	{
+		if ( move_cursor(R, C, true) )
+			select_row_ex(current_row);
+	}
 
-			if (key == FL_Enter || key == FL_KP_Enter)
-				m_bEnterOrFocus = TRUE;
-		}
+	void scroll_horz(int dx)
+	{
+		int newleft = hscrollbar->value() + dx;
+		if (newleft < 0)
+			newleft = 0;
+		else if (newleft > hscrollbar->maximum())
+			newleft = (int)hscrollbar->maximum();
+		hscrollbar->Fl_Slider::value(newleft);
+		table_scrolled();
+		redraw();
+	}
 
-		return Fl_Input::handle(e);
+	void OnDblClick()
+	{
+		FMEntry *fm = selected();
+		if (!fm)
+			return;
+
+		if ( fm->IsInstalled() )
+			OnPlayFM(NULL, NULL);
+		else if ( fm->IsArchived() )
+			InstallFM(fm);
 	}
 
 public:
-	Fl_FM_Filter_Input(int X, int Y, int W, int H, const char *l=0)
-		: Fl_Input(X,Y,W,H,l)
+	Fl_FM_List(int x, int y, int w, int h, const char *l=0)
+		: Fl_Table_Row(x,y,w,h,l)
 	{
-		m_bEnterOrFocus = FALSE;
-	}
+		m_font = FL_HELVETICA;
+		m_fontsize = FL_NORMAL_SIZE;
+		m_tagfontsize = m_tagRowH = FL_NORMAL_SIZE-1;
+		m_tagY = m_topH = m_noTagH = m_fontsize + 2;// dummy value, will be recalced in post_init
+		m_minRowH = 0;
+		m_tagalign = FL_ALIGN_TOP_LEFT;// can alternatively be FL_ALIGN_BOTTOM_LEFT if not doing automatic row height
+		m_nPendingRclickRow = -1;
+		end();
 
-	// returns TRUE if callback was called during text edit and not due to losing focus or pressing enter
-	// (useful for WHEN_CHANGED to know why the callback was called)
-	BOOL callback_reason_edit() const { return !m_bEnterOrFocus; }
-};
+		// ctrl/shift-click selects several FMs (to install/uninstall them in one go)
+		type(SELECT_MULTI_PERSIST);
+		always_show_vscroll(1);
 
+		callback(event_callback, (void*)this);
+	}
 
-//
-// FM_Tag_Input (custom tag input control)
-//
+	virtual ~Fl_FM_List()
+	{
+	}
 
-class Fl_FM_Tag_Input : public Fl_Input
-{
-	enum
+	// post-create initializtion
+	void post_init_header()
 	{
-		MAX_SUGGESTION_ROWS = 16,
-	};
+		int i;
+		int num_cols = 0;
 
-protected:
-	Fl_Callback *m_tagcb;
+		ASSERT(g_cfg.colvis & (1<<COL_Name));
 
-protected:
-	//
-	// ListWidget
-	//
+		if (g_cfg.colvis & (1<<COL_DirName))
+			s_columns[COL_DirName].visible = TRUE;
+		if (g_cfg.colvis & (1<<COL_Archive))
+			s_columns[COL_Archive].visible = TRUE;
+		if (g_cfg.bThumbColumn)
+		{
+			s_columns[COL_Thumb].visible = TRUE;
+			m_minRowH = THUMB_MAX_H + 2;
+		}
 
-	class ListWidget : public Fl_Browser_
-	{
-	public:
-		enum
+		for (i=0; i<COL_NUM_COLS; i++)
 		{
-			ROW_HEIGHT = 14,
-		};
+			s_columns[i].ui_col_index = -1;
 
-	protected:
-		Fl_Font m_prefixfont;
-		string m_prefix;
-		int m_prefixW;
+			// apply col default sizes of large font if necessary
+			if (g_cfg.bLargeFont && s_columns[i].width2)
+				s_columns[i].width = s_columns[i].width2;
 
-		vector<string> m_suggestions;
+			// count visible columns and init column index mapping table
+			if (s_columns[i].visible)
+			{
+				s_columns[i].ui_col_index = num_cols;
+				s_column_idx[num_cols] = i;
+				num_cols++;
+			}
+		}
 
-	protected:
-		friend class ListWnd;
+		cols(num_cols);
+		int totw = Fl::scrollbar_size();
+		col_minwidth(0, s_columns[0].minwidth);
+		for (i=1; i<COL_NUM_COLS; i++)
+		{
+			if (s_columns[i].visible)
+			{
+				totw += s_columns[i].width;
+				col_width(s_columns[i].ui_col_index, s_columns[i].width);
+				col_minwidth(s_columns[i].ui_col_index, s_columns[i].minwidth);
+			}
+		}
+		col_width(0, std::max(s_columns[0].width, w()-totw));
 
-		virtual int item_width(void *) const { return w() - Fl::scrollbar_size(); }
-		virtual int item_height(void *) const { return ROW_HEIGHT; }
+		col_header(1);
+		col_resize(1);
 
-		virtual void *item_first() const
+		// init col sizes from config
+		for (i=0; i<COL_NUM_COLS; i++)
+			if (s_columns[i].visible && g_cfg.colsizes[i] != -1 && s_columns[i].minwidth != -1)
+				col_width(s_columns[i].ui_col_index, g_cfg.colsizes[i]);
+	}
+
+	// post-create initializtion
+	void post_init()
+	{
+		rows( (int)g_dbFiltered.size() );
+
+		refresh_rowsize();
+	}
+
+	void refresh_rowsize()
+	{
+		const int notag_tophalf = std::max(imgStar.h(), imgProgress.h()) + 2;
+		const int min_tophalf = g_cfg.tagrows > 0 ? imgStar.h() : notag_tophalf;
+
+		fl_font(m_font, m_fontsize);
+		const int fheight = fl_height();
+
+		const int tophalf = m_topH = std::max(fheight, min_tophalf) + 2;
+		fl_font(FL_HELVETICA, m_tagfontsize);
+		m_tagRowH = fheight;
+		m_noTagH = std::max(fheight, notag_tophalf) + 2;
+		const int bottomhalf = g_cfg.tagrows > 0 ? m_tagRowH * g_cfg.tagrows + 2 : 0;
+
+		m_tagY = m_topH;
+
+		if (g_cfg.tagrows <= 0 || !g_cfg.bVarSizeList)
+			row_height_all(std::max(m_minRowH, tophalf + bottomhalf));
+		else
 		{
-			return m_suggestions.empty() ? 0 : (void*)1;
-		}
+			const int maxH = tophalf + bottomhalf;
+
+			const int W = col_width(0);
+			const int X = 0;
+			const int XX = X+4;
+			const int WW = (X+W) - XX - 2;
 
-		virtual void *item_next(void *p) const
-		{
-			return ((intptr_t)p < (int)m_suggestions.size()) ? (void*)((intptr_t)p + 1) : 0;
-		}
+			for (int r=0; r<rows(); r++)
+			{
+				FMEntry *fm = g_dbFiltered[r];
 
-		virtual void *item_prev(void *p) const
-		{
-			return (intptr_t)p ? (void*)((intptr_t)p - 1) : 0;
+				if ( fm->tagsUI.empty() )
+					row_height(r, std::max(m_minRowH, std::min(maxH, m_noTagH)));
+				else
+				{
+					const int lh = (int)wrap_tags(fm, WW).size() * fl_height();
+
+					const int bottomhalf2 = lh + 2;
+					row_height(r, std::max(m_minRowH, std::min(maxH, tophalf + bottomhalf2)));
+				}
+			}
 		}
+	}
 
-		virtual void item_draw(void *p, int X, int Y, int W, int H) const
+	void refresh_rowsize(FMEntry *fm)
+	{
+		if (g_cfg.tagrows <= 0 || !g_cfg.bVarSizeList)
+			;
+		else
 		{
-			const char *str = m_suggestions[(intptr_t)p - 1].c_str();
-			const int prefixlen = m_prefix.length();
-			int prefixW = m_prefixW;
+			int r = GetFilteredDbIndex(fm);
+			if (r < 0)
+				return;
 
-			X++;
-			Y++;
-			W -= 2;
-			H -= 2;
+			const int tophalf = m_topH;
+			const int bottomhalf = g_cfg.tagrows > 0 ? m_tagRowH * g_cfg.tagrows + 2 : 0;
 
-			fl_color( labelcolor() );
+			const int maxH = tophalf + bottomhalf;
 
-			// prefix (ie. the matching substring)
-			fl_font(m_prefixfont, labelsize());
-#if 0
-			fl_draw(m_prefix.c_str(), X, Y, W, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
-#else
-			// draw the prefix using the suggestion string so that case is preserved
-			char ch = str[prefixlen];
-			(char&)str[prefixlen] = 0;
-			prefixW = (int)fl_width(str);
-			fl_draw(str, X, Y, W, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
-			(char&)str[prefixlen] = ch;
-#endif
+			const int W = col_width(0);
+			const int X = 0;
+			const int XX = X+4;
+			const int WW = (X+W) - XX - 2;
 
-			// the remainder of the string
-			str += prefixlen;
-			if (*str)
+			if ( fm->tagsUI.empty() )
+				row_height(r, std::max(m_minRowH, std::min(maxH, m_noTagH)));
+			else
 			{
-				fl_font(labelfont(), labelsize());
-				fl_draw(str, X+prefixW, Y, W-prefixW, H, (Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_CLIP), 0, 0);
+				fl_font(FL_HELVETICA, m_tagfontsize);
+
+				const int lh = (int)wrap_tags(fm, WW).size() * fl_height();
+
+				const int bottomhalf2 = lh + 2;
+				row_height(r, std::max(m_minRowH, std::min(maxH, tophalf + bottomhalf2)));
 			}
 		}
+	}
 
-		static void ExtractCat(const char *s, string &out)
-		{
-			char *q = (char*) strchr(s, ':') + 1;
-			char ch = *q;
-			*q = 0;
-			out = s;
-			*q = ch;
-		}
+	void refresh(FMEntry *selection)
+	{
+		RefreshFilteredDb();
+		rows( (int)g_dbFiltered.size() );
+		refresh_rowsize();
 
-		void EnumSuggestion(const char *suggestion, const char *prefix)
+		int R = 0;
+
+		if (selection)
 		{
-			// don't add suggestions that match entered value 100%
-			if ( strcmp(suggestion, prefix) )
-				m_suggestions.push_back(suggestion);
+			R = GetFilteredDbIndex(selection);
+			if (R == -1)
+				R = 0;
 		}
 
-	public:
-		ListWidget(int W, int H)
-			: Fl_Browser_(0, 0, W, H)
-		{
-#if 0
-			// bold prefix
-			labelfont(FL_HELVETICA);
-			m_prefixfont = FL_HELVETICA_BOLD;
-#else
-			// bold suffix (ala google)
-			labelfont(FL_HELVETICA_BOLD);
-			m_prefixfont = FL_HELVETICA;
-#endif
+		select_row_ex(R);
+		ensure_visible(R, 2);
 
-			labelsize(12);
-			labelcolor(FL_FOREGROUND_COLOR);
-			color(FL_BACKGROUND2_COLOR);
-			selection_color(FL_GRAY0+18);
-			box(COMPLETION_LIST_BOX);
-			has_scrollbar(VERTICAL);
-			type(FL_SELECT_BROWSER);
-			when(FL_WHEN_RELEASE | FL_WHEN_NOT_CHANGED);
+		FMEntry *newsel = selected();
+		if (newsel != selection)
+			OnListSelChange(newsel);
 
-			m_suggestions.reserve(64);
-		}
+		redraw();
+	}
 
-		int PopulateSuggestions(const char *s)
-		{
-			int i;
+	void refresh_order(FMEntry *selection)
+	{
+		pFMList->select(selection, TRUE);
 
-			m_suggestions.clear();
-			m_prefix = s;
+		// recalc row heights if var size list entries is enabled
+		if (g_cfg.tagrows > 0 && g_cfg.bVarSizeList)
+			refresh_rowsize();
 
-			const BOOL bHasCat = (strchr(s, ':') != NULL);
+		pFMList->redraw();
 
-			// generate suggestions
-			if (!bHasCat && !g_tagNameList.empty())
-			{
-				// also suggest stand-alone category names
-				string lastCat;
-				for (i=0; i<(int)g_tagNameList.size(); i++)
-				{
-					const char *tag = g_tagNameList[i];
-					if ( !strncasecmp_utf_b(tag, s, m_prefix.length()) )
-					{
-						if (lastCat.empty() || strncasecmp_utf_b(g_tagNameList[i], lastCat.c_str(), lastCat.length()))
-						{
-							// we've come across a new category
-							ExtractCat(tag, lastCat);
-							EnumSuggestion(lastCat.c_str(), s);
-						}
-						EnumSuggestion(tag, s);
-					}
-				}
-			}
-			else
-			{
-				for (i=0; i<(int)g_tagNameList.size(); i++)
-				{
-					const char *tag = g_tagNameList[i];
-					if ( !strncasecmp_utf_b(tag, s, m_prefix.length()) )
-						EnumSuggestion(tag, s);
-				}
-			}
-			for (i=0; i<(int)g_tagNameListNoCat.size(); i++)
-			{
-				const char *tag = g_tagNameListNoCat[i];
-				if ( !strncasecmp_utf_b(tag, s, m_prefix.length()) )
-					EnumSuggestion(tag, s);
-			}
+		int R = GetFilteredDbIndex(selection);
+		if (R != -1)
+			ensure_visible(R, 2);
+	}
 
-			new_list();
+	void refresh_formatting()
+	{
+		// recalc row heights if var size list entries is enabled
+		if (g_cfg.tagrows > 0 && g_cfg.bVarSizeList)
+		{
+			refresh_rowsize();
+			pFMList->redraw();
+		}
+	}
 
-			if ( !m_suggestions.empty() )
+	FMEntry* selected() const
+	{
+		if ( row_selected(this->Fl_Table::select_row) )
+			return g_dbFiltered[this->Fl_Table::select_row];
+
+		for (int i=0; i<rows(); i++)
+		{
+			if ( row_selected(i) )
 			{
-				fl_font(m_prefixfont, labelsize());
-				m_prefixW = (int)fl_width(s);
+				ASSERT((unsigned int)i < g_dbFiltered.size());
+				return g_dbFiltered[i];
 			}
-
-			return (int)m_suggestions.size();
 		}
 
-		const char* value() const
-		{
-			return selection() ? m_suggestions[(intptr_t)selection() - 1].c_str() : NULL;
-		}
+		return NULL;
+	}
 
-		const char* first_value() const
+	// get all selected FMs in list order
+	void get_selection(vector<FMEntry*> &sel) const
+	{
+		sel.clear();
+
+		for (int i=0; i<rows(); i++)
+			if ( row_selected(i) )
+				sel.push_back(g_dbFiltered[i]);
+	}
+
+	void select(FMEntry *fm, BOOL bCenterSel = FALSE)
+	{
+		if (this->Fl_Table::select_row < 0)
+			bCenterSel = TRUE;
+
+		int R = 0;
+
+		if (fm)
 		{
-			return m_suggestions.empty() ? NULL : m_suggestions[0].c_str();
+			int r = GetFilteredDbIndex(fm);
+			if (r != -1)
+				R = r;
 		}
 
-		void move_selection(int rows)
-		{
-			if (!rows)
-				return;
+		select_row_ex(R);
+		ensure_visible(R, bCenterSel);
+	}
 
-			if ( !selection() )
-			{
-				// nothing selected, select first
-				select_first();
-				return;
-			}
+	void DoContextMenu()
+	{
+		FMEntry *fm = selected();
+		if (!fm)
+			return;
 
-			if (rows == 1)
-			{
-				void *p = item_next( selection() );
-				if (p)
-					select_only(p);
-				return;
-			}
-			else if (rows == -1)
-			{
-				void *p = item_prev( selection() );
-				if (p)
-					select_only(p);
-				return;
-			}
+		// auto-check for info file if none is set an none has been looked for
+		if (fm->infofile.empty() && !(fm->flags & FMEntry::FLAG_NoInfoFile))
+			AutoSelectInfoFile(fm);
 
-			if (rows > 0)
-			{
-				void *p = item_next( selection() );
-				if (!p)
-					return;
+		enum
+		{
+			CMD_NONE,
 
-				for (int i=0; i<rows; i++)
-				{
-					void *q = item_next(p);
-					if (!q)
-						break;
-					p = q;
-				}
+			CMD_Play,
+			CMD_StartPlay,
 
-				select_only(p);
-			}
-			else
-			{
-				void *p = item_prev( selection() );
-				if (!p)
-					return;
+			CMD_Install,
+			CMD_Uninstall,
+			CMD_InstallSelected,
+			CMD_UninstallSelected,
 
-				rows = -rows;
+			CMD_InProgress,
+			CMD_Completed,
 
-				for (int i=0; i<rows; i++)
-				{
-					void *q = item_prev(p);
-					if (!q)
-						break;
-					p = q;
-				}
+			CMD_PrioNormal,
+			CMD_PrioHigh,
+			CMD_PrioUrgent,
+			CMD_PrioCrit,
 
-				select_only(p);
-			}
-		}
+			CMD_RemoveRating,
+			CMD_Rating0,
+			CMD_Rating10 = CMD_Rating0+10,
 
-		void select_first()
-		{
-			if ( !m_suggestions.empty() )
-				select_only((void*)1);
-		}
+			CMD_Delete,
 
-		void select_last()
-		{
-			select_only( (void*)m_suggestions.size() );
-		}
+			CMD_Edit,
+			CMD_EditTags,
 
-		int count() const
-		{
-			return m_suggestions.size();
-		}
-	};
+			CMD_ViewInfo,
+			CMD_ViewSummary,
+			CMD_ViewArchContent,
+		};
 
-	//
-	// ListWnd
-	//
+		Fl_Image *imgGray = NULL;
 
-	class ListWnd : public Fl_Double_Window
-	{
-	protected:
-		ListWidget *m_pList;
+		const BOOL bAdvanced = !!(Fl::event_state() & FL_CTRL);
 
-		Fl_FM_Tag_Input *m_pOuter;
+		#define MENU_RATE(_name, _val) MENU_RITEM(_name, CMD_Rating0+_val, fm->rating==_val)
+		#define MENU_PRIO(_val, _id) \
+			MENU_ITEM("", _id); \
+			if (fm->priority == (_val)+1) \
+			{ \
+				imgGray = imgPrio[_val]->copy(); \
+				imgGray->inactive(); \
+				menu[menu_items-1].image(imgGray); \
+				menu[menu_items-1].deactivate(); \
+			} \
+			else \
+				menu[menu_items-1].image(imgPrio[_val])
 
-		int m_listrows;
+		const int MAX_MENU_ITEMS = 48;
+		int menu_items = 0;
 
-	protected:
-		virtual int handle(int e)
+		Fl_Menu_Item menu[MAX_MENU_ITEMS];
+
+		if (fm->IsInstalled() || !fm->IsArchived())
 		{
-			switch (e)
+			if (!g_bRunningEditor)
 			{
-			case FL_HIDE:
-				((Fl_Widget*)pTagEdGroup)->activate();
-				break;
-			case FL_SHOW:
-				((Fl_Widget*)pTagEdGroup)->deactivate();
-				break;
-
-			case FL_KEYBOARD:
-				switch ( Fl::event_key() )
-				{
-				case FL_Escape:
-					hide();
-					return 1;
-				}
-				break;
+				MENU_ITEM($("Play"), CMD_Play);
+				MENU_MOD_DISABLE( !fm->IsInstalled() );
+				MENU_ITEM($("Start Playthrough"), CMD_StartPlay);
+				MENU_MOD_DISABLE(!fm->IsInstalled() || (fm->status == FMEntry::STATUS_InProgress));
+			}
+			else
+			{
+				MENU_ITEM($("Select"), CMD_Play);
+				MENU_MOD_DISABLE( !fm->IsInstalled() );
 			}
-
-			return Fl_Double_Window::handle(e);
 		}
-
-		static void selchange_cb(ListWidget *, void *p)
+		else
 		{
-			((ListWnd*)p)->handle_list_key(FL_Enter);
+			MENU_ITEM($("Install"), CMD_Install);
+			MENU_MOD_DISABLE( g_sTempDir.empty() );
 		}
-
-	public:
-		ListWnd(Fl_FM_Tag_Input *p)
-			: Fl_Double_Window(p->x(), p->y()+p->h(), p->w(), ListWidget::ROW_HEIGHT)
+		if (fm->IsInstalled() && fm->IsArchived())
 		{
-			m_pOuter = p;
-			m_listrows = 0;
-
-			box(FL_NO_BOX);
-			clear_border();
-			clear_visible();
-
-			m_pList = new ListWidget(w(), h());
-
-			m_pList->callback((Fl_Callback*)selchange_cb, this);
-
-			end();
+			MENU_MOD_DIV();
+			MENU_ITEM($("Uninstall"), CMD_Uninstall);
+			MENU_MOD_DISABLE( g_sTempDir.empty() );
+		}
 
-			resizable(m_pList);
+		// multi-selection, install/uninstall all selected FMs at once
+		vector<FMEntry*> sel;
+		get_selection(sel);
 
-			p->window()->add(this);
-		}
+		vector<FMEntry*> installable, uninstallable;
+		char szInstallSel[128], szUninstallSel[128];
 
-		void Suggest(const char *s)
+		if (sel.size() > 1)
 		{
-			int rows = m_pList->PopulateSuggestions(s);
-			if (rows)
+			for (int i=0; i<(int)sel.size(); i++)
 			{
-				const int max_fit_rows = ((parent()->h() - y() - 8) - Fl::box_dh( m_pList->box() )) / ListWidget::ROW_HEIGHT;
-				const int max_rows = std::min((int)MAX_SUGGESTION_ROWS, max_fit_rows);
-				if (rows > max_rows)
-					rows = max_rows;
+				if (!sel[i]->IsArchived())
+					continue;
 
-				m_listrows = rows;
+				if ( sel[i]->IsInstalled() )
+					uninstallable.push_back(sel[i]);
+				else
+					installable.push_back(sel[i]);
+			}
 
-				resize(x(), y(), w(), ListWidget::ROW_HEIGHT * rows + Fl::box_dh( m_pList->box() ));
+			_snprintf_s(szInstallSel, sizeof(szInstallSel), _TRUNCATE, $("Install Selected (%d)"), (int)installable.size());
+			_snprintf_s(szUninstallSel, sizeof(szUninstallSel), _TRUNCATE, $("Uninstall Selected (%d)"), (int)uninstallable.size());
 
-				show();
-			}
-			else
-				hide();
+			MENU_MOD_DIV();
+			MENU_ITEM(szInstallSel, CMD_InstallSelected);
+			MENU_MOD_DISABLE(installable.empty() || g_sTempDir.empty());
+			MENU_ITEM(szUninstallSel, CMD_UninstallSelected);
+			MENU_MOD_DISABLE(uninstallable.empty() || g_sTempDir.empty());
 		}
-
-		int handle_list_key(int key)
+		if (bAdvanced)
 		{
-			const int _XK_ISO_Left_Tab = 0xfe20;
+			MENU_MOD_DIV();
+			MENU_ITEM($("Delete from Db"), CMD_Delete);
+		}
+		MENU_MOD_DIV();
+		MENU_SUB($("Status"));
+			MENU_ITEM(fm->status==FMEntry::STATUS_InProgress?$("Abort Playthrough"):$("Playing"), CMD_InProgress);
+			MENU_ITEM($("Completed"), CMD_Completed);
+			MENU_END();
+		MENU_SUB($("Priority"));
+			MENU_ITEM("", CMD_PrioNormal);
+			MENU_PRIO(0, CMD_PrioHigh);
+			MENU_PRIO(1, CMD_PrioUrgent);
+			MENU_PRIO(2, CMD_PrioCrit);
+			MENU_END();
+		MENU_SUB($("Rating")); MENU_MOD_DIV();
+			MENU_RITEM($("None"), CMD_RemoveRating, fm->rating == -1);
+			MENU_RATE("0", 0); MENU_RATE("0.5", 1);
+			MENU_RATE("1", 2); MENU_RATE("1.5", 3);
+			MENU_RATE("2", 4); MENU_RATE("2.5", 5);
+			MENU_RATE("3", 6); MENU_RATE("3.5", 7);
+			MENU_RATE("4", 8); MENU_RATE("4.5", 9);
+			MENU_RATE("5", 10);
+			MENU_END();
+		MENU_ITEM($("Edit..."), CMD_Edit);
+		MENU_ITEM($("Edit Tags..."), CMD_EditTags);
+		MENU_MOD_DIV();
+		if (bAdvanced && fm->IsArchived())
+		{
+			MENU_ITEM($("View Archive Contents..."), CMD_ViewArchContent);
+		}
+		MENU_ITEM($("View Info File..."), CMD_ViewInfo);
+		MENU_MOD_DISABLE(!fm->IsAvail() || fm->infofile.empty());
+		MENU_ITEM($("View Summary..."), CMD_ViewSummary);
+		MENU_END();
 
-			const char *s;
+		// bold text for double-click item
+		menu[0].labelfont(FL_HELVETICA_BOLD);
+		//menu[0].labelsize(11);
 
-			switch (key)
-			{
-			case FL_Tab:
-				// tab complete (or if nothing is selected in list then select first row)
-				s = m_pList->value();
-				if (s)
-				{
-					m_pOuter->value( m_pList->value() );
-					return 1;
-				}
-				else if (m_pList->count() == 1)
-				{
-					m_pOuter->value( m_pList->first_value() );
-					hide();
-					return 1;
-				}
-				// fall through
-			case _XK_ISO_Left_Tab:
-				// if nothing is selected in list then select first row
-				if ( !m_pList->value() )
-					m_pList->select_first();
-				return 1;
+		const Fl_Menu_Item *m = menu->popup(Fl::event_x(), Fl::event_y(), 0, 0, 0);
 
-			case FL_Enter:
-			case FL_KP_Enter:
-				s = m_pList->value();
-				if (s)
-				{
-					m_pOuter->value( m_pList->value() );
-					hide();
-					return 1;
-				}
-				else if (m_pList->count() == 1)
-				{
-					m_pOuter->value( m_pList->first_value() );
-					hide();
-					return 1;
-				}
-				break;
+		if (imgGray)
+			delete imgGray;
 
-			case FL_Home:
-				m_pList->select_first();
-				return 1;
-			case FL_End:
-				m_pList->select_last();
-				return 1;
+		if (!m || !m->user_data())
+			return;
+
+		const int cmd_id = (intptr_t)m->user_data();
+		switch (cmd_id)
+		{
+		case CMD_Play:
+			OnPlayFM(NULL, NULL);
+			break;
+		case CMD_StartPlay:
+			OnStartFM(NULL, NULL);
+			break;
+
+		case CMD_Install:
+			InstallFM(fm);
+			break;
+		case CMD_Uninstall:
+			UninstallFM(fm);
+			break;
+		case CMD_InstallSelected:
+			RunInstallQueue(installable, TRUE);
+			break;
+		case CMD_UninstallSelected:
+			RunInstallQueue(uninstallable, FALSE);
+			break;
 
-			case FL_Up:
-				m_pList->move_selection(-1);
-				return 1;
-			case FL_Down:
-				m_pList->move_selection(1);
-				return 1;
-			case FL_Page_Up:
-				m_pList->move_selection(-(m_listrows-1));
-				return 1;
-			case FL_Page_Down:
-				m_pList->move_selection(m_listrows-1);
-				return 1;
+		case CMD_InProgress:
+			if (fm->status == FMEntry::STATUS_InProgress)
+				fm->SetStatus(fm->nCompleteCount>0 ? FMEntry::STATUS_Completed : FMEntry::STATUS_NotPlayed);
+			else
+				fm->SetStatus(FMEntry::STATUS_InProgress);
+			RedrawListControl(TRUE);
+			break;
+		case CMD_Completed:
+			fl_message_position(pMainWnd);
+			if ( fl_choice($("Completed \"%s\"?"), fl_no, fl_yes, NULL, fm->GetFriendlyName()) )
+			{
+				fm->OnCompleted();
+				RedrawListControl(TRUE);
 			}
+			break;
 
-			return 0;
-		}
-	};
-
-	//
+		case CMD_RemoveRating:
+			fm->SetRating(-1);
+			RedrawListControl();
+			break;
 
-protected:
-	ListWnd *m_pList;
+		case CMD_Delete:
+			fl_message_position(pMainWnd);
+			if ( fl_choice($("Are you sure you want to delete \"%s\" from the database?"), fl_no, fl_yes, NULL, fm->GetFriendlyName()) )
+				DeleteFM(fm);
+			break;
 
-protected:
-	virtual int handle(int e)
-	{
-		switch (e)
-		{
-		case FL_KEYBOARD:
-			{
-			const int _XK_ISO_Left_Tab = 0xfe20;
+		case CMD_Edit:
+			DoTagEditor(fm, TABPAGE_MISC);
+			break;
 
-			if (m_pList && m_pList->visible())
-				if ( m_pList->handle_list_key( Fl::event_key() ) )
-					return 1;
+		case CMD_EditTags:
+			DoTagEditor(fm);
+			break;
 
-			switch ( Fl::event_key() )
+		case CMD_ViewInfo:
+			if ( !fm->infofile.empty() )
 			{
-			case FL_Tab:
-			case _XK_ISO_Left_Tab:
-				return parent()->Fl_Group::handle(e);
+				if ( !FmFileExists(fm, fm->infofile.c_str()) )
+					if ( !AutoSelectInfoFile(fm) )
+					{
+						fl_message_position(pMainWnd);
+						fl_alert("%s", $("Couldn't find any info file."));
+						break;
+					}
 
-			case FL_Left:
-			case FL_Right:
-				if (m_pList && m_pList->visible())
+				if ( !FmOpenFileWithAssociatedApp(fm, fm->infofile.c_str()) )
 				{
-					// allow cursor navigation but not switching widget
-					Fl_Input::handle(e);
-					return 1;
+					fl_message_position(pMainWnd);
+					fl_alert($("Failed to view info file \"%s\"."), fm->infofile.c_str());
 				}
-				break;
+			}
+			break;
 
-			case FL_Enter:
-			case FL_KP_Enter:
-				HideSuggestions();
-				if (m_tagcb)
-					m_tagcb(this, NULL);
-				return 1;
+		case CMD_ViewSummary:
+			ViewSummary(fm);
+			break;
 
-			case FL_Escape:
-				if (m_pList && m_pList->visible())
-				{
-					HideSuggestions();
-					return 1;
-				}
-				break;
-			}
-			}
+		case CMD_ViewArchContent:
+			ViewArchiveContents(fm);
 			break;
+
+		default:
+			if (cmd_id >= CMD_Rating0 && cmd_id <= CMD_Rating10)
+				fm->SetRating(cmd_id - CMD_Rating0);
+			else if (cmd_id >= CMD_PrioNormal && cmd_id <= CMD_PrioCrit)
+				fm->SetPriority(cmd_id - CMD_PrioNormal);
 		}
 
-		return Fl_Input::handle(e);
+		redraw();
 	}
 
-	static void change_cb(Fl_Widget *o, void *) { ((Fl_FM_Tag_Input*)o)->OnChange(); }
+	// for fluid generated code
+	void textfont(int n) { m_font = n; }
+	void textsize(int n) { m_fontsize = n; }
+	int textsize() { return m_fontsize; }
 
-	void HideSuggestions()
+	BOOL save_col_state(int *cols)
 	{
-		m_pList->hide();
+		BOOL bChanged = FALSE;
+		for (int i=0; i<COL_NUM_COLS; i++)
+		{
+			if (s_columns[i].ui_col_index != -1)
+			{
+				const int n = col_width(s_columns[i].ui_col_index);
+				if (cols[i] != n)
+				{
+					cols[i] = n;
+					bChanged = TRUE;
+				}
+			}
+		}
+		return bChanged;
 	}
 
-	void ShowSuggestions(const char *s)
+	static void static_init()
 	{
-		m_pList->Suggest(s);
+#ifdef LOCALIZATION_SUPPORT
+		// localization of column labels
+		for (int i=0; i<COL_NUM_COLS; i++)
+			s_columns[i].name = $(s_columns[i].name);
+#endif
 	}
+};
 
-	static void draw_frame(int x, int y, int w, int h, Fl_Color c)
-	{
-		fl_color(c);
-		fl_rectf(x, y, w, h);
-		fl_color(FL_FOREGROUND_COLOR);
-		fl_rect(x, y, w, h);
-	}
 
-public:
-	Fl_FM_Tag_Input(int X, int Y, int W, int H, const char *l=0)
-		: Fl_Input(X,Y,W,H,l)
-	{
-		m_tagcb = NULL;
-		m_pList = new ListWnd(this);
+Fl_FM_List::ColDef Fl_FM_List::s_columns[COL_NUM_COLS] =
+{
+	{"Name", 364, 150, 0, TRUE, SORT_Name, 0},
+	{"Pri", 30, -1, 26, TRUE, SORT_Priority, 0},
+	{"Status", 50, -1, 0, TRUE, SORT_Status, 0},
+	{"Last Played", 80, 60, 90, TRUE, SORT_LastPlayed, 0},
+	{"Release Date", 80, 60, 90, TRUE, SORT_ReleaseDate, 0},
+	{"Directory", 170, 60, 90, FALSE, SORT_DirName, 0},
+	{"Archive", 230, 60, 90, FALSE, SORT_Archive, 0},
+	{"Thumbnail", THUMB_MAX_W+8, -1, 0, FALSE, SORT_None, 0}
+};
 
-		when(FL_WHEN_CHANGED);
-		callback(change_cb);
-	}
+int Fl_FM_List::s_column_idx[COL_NUM_COLS] = {};
 
-	void tag_callback(Fl_Callback *cb)
-	{
-		m_tagcb = cb;
-	}
 
-	void OnChange()
+void Fl_FM_List::draw_cell(TableContext context, int R, int C, int X, int Y, int W, int H)
+{
+	int i;
+	char s[64];
+
+	const FMEntry *fm = (R < (int)g_dbFiltered.size()) ? g_dbFiltered[R] : NULL;
+
+	switch (context)
 	{
-		const char *s = value();
+	case CONTEXT_STARTPAGE:
+		fl_font(m_font, m_fontsize);
+		return;
 
-		while (s && isspace_(*s)) s++;
+	case CONTEXT_ROW_HEADER:
+		fl_color(FL_RED);
+		fl_rectf(X, Y, W, H);
+		return;
 
-		if (s && *s)
-		{
-			pTagEdAddTag->activate();
-			ShowSuggestions(s);
-		}
-		else
+	case CONTEXT_COL_HEADER:
+		fl_push_clip(X, Y, W, H);
+		fl_draw_box(FL_THIN_UP_BOX, X, Y, W, H, Fl::focus()==this ? fl_themed_rgb_color(180,180,200) : fl_themed_rgb_color(203,203,203));
+		if (C < COL_NUM_COLS)
 		{
-			pTagEdAddTag->deactivate();
-			HideSuggestions();
-		}
-	}
+			C = s_column_idx[C];
 
-	// workaround to check for event that should result in list being hidden
-	void check_listhide_event(int e)
-	{
-		if (!m_pList || !m_pList->visible())
-			return;
+			int XX = X+3;
+			const char *label = s_columns[C].name;
 
-		switch (e)
-		{
-		case FL_PUSH:
-			// clicking anywhere outside the input or list widget closes list
-			if ( !Fl::event_inside(x(), y(), x()+w(), y()+h()+m_pList->h()) )
-				HideSuggestions();
-			break;
+			fl_font(labelfont(), labelsize());
+			fl_color( labelcolor() );
+			fl_draw(label, XX, Y, W-3, H, FL_ALIGN_LEFT, 0, 0);
 
-		case FL_FOCUS:
+			// pseudo-column for rating (so it's possible to sort on rating)
+			if (!C)
 			{
-			Fl_Widget *o = Fl::focus();
-			if (o != this && o != m_pList && m_pList->find(o) != m_pList->children())
-				HideSuggestions();
+				fl_draw(RATING_COL_LABEL, X+W-(5*16)-2, Y, W, H, FL_ALIGN_LEFT, 0, 0);
+
+				if (abs(g_cfg.sortmode) == SORT_Rating)
+				{
+					XX = X+W-(5*16)-2;
+					label = RATING_COL_LABEL;
+					goto draw_sortarrow;
+				}
+			}
+
+			// sort arrow
+			if (s_columns[C].sortid == abs(g_cfg.sortmode))
+			{
+draw_sortarrow:
+				int lw = 0, lh = 0;
+				fl_measure(label, lw, lh);
+				XX += lw+2;
+				fl_color( fl_themed_rgb_color(95,95,95) );
+				if (g_cfg.sortmode >= 0)
+				{
+					// down
+					fl_yxline(XX, Y+(H>>1), Y+H-3);
+					fl_xyline(XX-2, Y+H-3-2, XX+2);
+					fl_xyline(XX-1, Y+H-3-1, XX+1);
+				}
+				else
+				{
+					// up
+					fl_yxline(XX, Y+2, Y+(H>>1)-1);
+					fl_xyline(XX-1, Y+2+1, XX+1);
+					fl_xyline(XX-2, Y+2+2, XX+2);
+				}
 			}
-			break;
 		}
-	}
-
-	static void static_init()
-	{
-		Fl::set_boxtype(COMPLETION_LIST_BOX, draw_frame, 1, 1, 2, 2);
-	}
-};
-
+		fl_pop_clip();
+		return;
 
-//
-// FM_List
-//
+	case CONTEXT_CELL:
+		fl_push_clip(X, Y, W, H);
+		{
+			// bg
+			if ( fm->IsInstalled() )
+				fl_color(row_selected(R) ? selection_color() : ((R & 1) ? fl_themed_rgb_color(245,245,255) : FL_WHITE));
+			else if ( fm->IsAvail() )
+				fl_color(row_selected(R) ? fl_themed_rgb_color(192,239,250) : ((R & 1) ? fl_themed_rgb_color(232,232,240) : fl_themed_rgb_color(240,240,240)));
+			else
+				fl_color(row_selected(R) ? fl_themed_rgb_color(206,238,250) : ((R & 1) ? fl_themed_rgb_color(219,219,225) : fl_themed_rgb_color(225,225,225)));
+			fl_rectf(X, Y, W, H);
 
-class Fl_FM_List : public Fl_Table_Row
-{
-	struct ColDef
-	{
-		const char *name;
-		int width;
-		int minwidth;
-		int width2;		// alt size when using large font
-		BOOL visible;
-		int sortid;
+			if (fm)
+			{
+				C = s_column_idx[C];
 
-		int ui_col_index;
-	};
+				switch (C)
+				{
+				case COL_Name:
+					{
+					const FMRowCache *rc = row_cache(fm);
 
-	static ColDef s_columns[COL_NUM_COLS];
-	static int s_column_idx[COL_NUM_COLS]; // map ui col index to s_columns index
+					// rating (first so name can be drawn over it if column is too small
+					if (fm->rating >= 0)
+					{
+						const int XX = X + W - 5*16 - 2;
+						const int YY = (H > m_noTagH) ? Y + 1 : Y + ((H - imgStar.h()) >> 1);
+						for (i=0; i<5; i++)
+							imgStars[rc->stars[i]]->draw(XX+i*16, YY);
+					}
 
-	int m_font;
-	int m_fontsize;
-	int m_tagfontsize;
-	Fl_Align m_tagalign;
+					// name
+					int iw = 0;
+					if ( !fm->IsInstalled() )
+					{
+						if ( fm->IsAvail() )
+						{
+							if (fm->status == FMEntry::STATUS_NotPlayed)
+							{
+								fl_color( fl_themed_rgb_color(70,70,250) );
+								if (fm->tmLastStarted)
+									fl_font(FL_HELVETICA_ITALIC, m_fontsize);
+								else
+									fl_font(FL_HELVETICA_BOLD_ITALIC, m_fontsize);
+							}
+							else if (fm->status == FMEntry::STATUS_InProgress)
+							{
+								fl_color( fl_themed_rgb_color(243,135,75) );
+								fl_font(FL_HELVETICA_BOLD_ITALIC, m_fontsize);
+							}
+							else
+							{
+								fl_color(FL_FOREGROUND_COLOR);
+								fl_font(FL_HELVETICA_ITALIC, m_fontsize);
+							}
+						}
+						else
+						{
+							fl_color( fl_themed_rgb_color(83,83,83) );
+							fl_font(FL_HELVETICA_ITALIC, m_fontsize);
+						}
 
-	int m_noTagH;
+						Fl_Pixmap *pix = fm->IsArchived() ? &imgArchived : &imgNotAvail;
+						pix->draw(X+1, Y+1+std::max(0, ((m_topH-pix->h())>>1)));
 
-	int m_topH;
-	int m_tagY;
-	int m_tagRowH;
+						iw = pix->w() + 2;
+					}
+					else
+					{
+						if ( fm->IsArchived() )
+						{
+							Fl_Pixmap *pix = &imgArchiveInstalled;
+							pix->draw(X+1, Y+1+std::max(0, ((m_topH-pix->h())>>1)));
 
-	int m_nPendingRclickRow;
+							iw = pix->w() + 2;
+						}
 
-private:
-	static void event_callback(Fl_Widget*, void *data)
-	{
-		Fl_FM_List *o = (Fl_FM_List*)data;
-		o->OnCallback();
-	}
-	void OnCallback();
+						if (fm->status == FMEntry::STATUS_NotPlayed)
+						{
+							fl_color(FL_BLUE);
+							if (fm->tmLastStarted)
+								fl_font(FL_HELVETICA, m_fontsize);
+							else
+								fl_font(FL_HELVETICA_BOLD, m_fontsize);
+						}
+						else if (fm->status == FMEntry::STATUS_InProgress)
+						{
+							fl_color( fl_themed_rgb_color(255,92,3) );
+							fl_font(FL_HELVETICA_BOLD, m_fontsize);
+						}
+						else
+						{
+							fl_color(FL_FOREGROUND_COLOR);
+							fl_font(FL_HELVETICA, m_fontsize);
+						}
+					}
+					// dim FMs whose availability hasn't been verified by the startup scan yet
+					if (fm->flags & FMEntry::FLAG_AvailUnverified)
+						fl_color( fl_inactive(fl_color()) );
+					fl_draw(rc->name.c_str(), X+2+iw, Y, W-(fm->rating>=0 ? 5*16+4 : 0)-iw, H, (H>m_noTagH)?FL_ALIGN_TOP_LEFT:FL_ALIGN_LEFT);
 
-protected:
-	virtual void draw_cell(TableContext context, int R=0, int C=0, int X=0, int Y=0, int W=0, int H=0);
+					// tags (pre-wrapped, so lines are drawn directly at their baseline)
+					if (!fm->tagsUI.empty() && (H>m_noTagH))
+					{
+						const int XX = X+4;
+						const int YY = Y+m_tagY;
+						const int WW = (X+W) - XX - 2;
+						const int HH = H-m_tagY-2;
 
-	virtual int handle(int e)
-	{
-		switch (e)
-		{
-		case FL_PUSH:
-			if (Fl::event_button() == FL_RIGHT_MOUSE)
-			{
-				int R, C;
-				ResizeFlag resizeflag;
-				TableContext context = cursor2rowcol(R, C, resizeflag);
-				m_nPendingRclickRow = -1;
-				if (context == CONTEXT_CELL)
-				{
-					m_nPendingRclickRow = R;
-					select_row_ex(R);
-				}
+						fl_font(FL_HELVETICA, m_tagfontsize);
 
-				return 1;
-			}
-			else if (Fl::event_button() == FL_LEFT_MOUSE && Fl::event_clicks() > 0)
-			{
-				int R, C;
-				ResizeFlag resizeflag;
-				TableContext context = cursor2rowcol(R, C, resizeflag);
-				m_nPendingRclickRow = -1;
-				if (context == CONTEXT_CELL)
-				{
-					select_row_ex(R);
-					OnDblClick();
-				}
-				return 1;
-			}
-			break;
+						const vector<FMRowCache::TagLine> &lines = wrap_tags(fm, WW);
+						const char *text = fm->tagsUI.c_str();
+						const int lh = fl_height();
 
-		case FL_RELEASE:
-			if (Fl::event_button() == FL_RIGHT_MOUSE)
-			{
-				if (m_nPendingRclickRow >= 0)
-				{
-					DoContextMenu();
-					m_nPendingRclickRow = -1;
-				}
-				return 1;
-			}
-			break;
+						int yy = (m_tagalign & FL_ALIGN_BOTTOM) ? YY+HH-(int)lines.size()*lh : YY;
+						yy += lh - fl_descent();
 
-		case FL_KEYBOARD:
-			switch( Fl::event_key() )
-			{
-			case FL_Enter:
-			case FL_KP_Enter: OnDblClick(); break;
-			case FL_Home: move_selection(-1000000, 0); break;
-			case FL_End: move_selection(1000000, 0); break;
-			case FL_Page_Up: move_selection(-(botrow - toprow - 1), 0); break;
-			case FL_Page_Down: move_selection(botrow - toprow - 1 , 0); break;
-			case FL_Up: move_selection(-1, 0); break;
-			case FL_Down: move_selection(1, 0); break;
-			case FL_Left: scroll_horz(-50); break;
-			case FL_Right: scroll_horz(50); break;
-			default:
-				return Fl_Table_Row::handle(e);
-			}
-			return 1;
+						fl_push_clip(XX, YY, WW, HH);
+						fl_color( fl_themed_rgb_color(181,181,181) );
+						fl_draw(TAGS_LABEL, XX+1, yy);
+						fl_color( fl_themed_rgb_color(83,83,83) );
+						for (i=0; i<(int)lines.size() && yy-lh < YY+HH; i++, yy+=lh)
+							fl_draw(text + lines[i].start, lines[i].len, XX, yy);
+						fl_pop_clip();
+					}
+					}
+					break;
 
-		case FL_FOCUS:
-		case FL_UNFOCUS:
-			redraw();
-			break;
-		}
+				case COL_Status:
+					if (fm->status)
+					{
+						int XX = X+((W-24)>>1);
+						int YY = Y+((H-20)>>1);
 
-		return Fl_Table_Row::handle(e);
-	}
+						switch (fm->status)
+						{
+						case FMEntry::STATUS_InProgress:
+							imgProgress.draw(XX, YY);
+							break;
+						case FMEntry::STATUS_Completed:
+							imgCheck.draw(XX, YY);
+							break;
+						}
 
-	void select_row_ex(int R)
-	{
-		if ( !row_selected(R) )
-		{
-			select_row(R);
-			this->Fl_Table::select_row = current_row = R;
-			do_callback(CONTEXT_CELL, R, 0);
-		}
-	}
+						if (fm->nCompleteCount > 1
+							|| (fm->nCompleteCount == 1 && fm->status == FMEntry::STATUS_InProgress))
+						{
+							if (H > m_noTagH)
+							{
+								XX += 24+4;
+								YY += 20-6;
+							}
+							else
+							{
+								XX = X+W-4;
+								YY = Y+3;
+							}
+							sprintf(s, "%d", fm->nCompleteCount);
+							fl_font(FL_HELVETICA, FL_NORMAL_SIZE-3);
+							fl_color(FL_BACKGROUND2_COLOR);
+							fl_draw(s, XX+1, YY+1, 0, 0, FL_ALIGN_TOP_RIGHT);
+							fl_draw(s, XX-1, YY-1, 0, 0, FL_ALIGN_TOP_RIGHT);
+							fl_color(FL_FOREGROUND_COLOR);
+							fl_draw(s, XX, YY, 0, 0, FL_ALIGN_TOP_RIGHT);
+						}
+					}
+					break;
 
-	void move_selection(int R, int C)
-	{
-		if ( move_cursor(R, C, true) )
-			select_row_ex(current_row);
-	}
+				case COL_Thumb:
+					{
+					const ThumbEntry *t = GetThumbnail(fm);
+					if (t)
+						fl_draw_image(&g_thumbAtlas[t->offset], X+((W-t->w)>>1), Y+((H-t->h)>>1), t->w, t->h, 3);
+					}
+					break;
 
-	void scroll_horz(int dx)
-	{
-		int newleft = hscrollbar->value() + dx;
-		if (newleft < 0)
-			newleft = 0;
-		else if (newleft > hscrollbar->maximum())
-			newleft = (int)hscrollbar->maximum();
-		hscrollbar->Fl_Slider::value(newleft);
-		table_scrolled();
-		redraw();
-	}
+				case COL_Priority:
+					if (fm->priority)
+					{
+						const int XX = X+((W-15)>>1);
+						const int YY = Y+((H-15)>>1);
+						imgPrio[fm->priority-1]->draw(XX, YY);
+					}
+					break;
 
-	void OnDblClick()
-	{
-		FMEntry *fm = selected();
-		if (!fm)
-			return;
+				case COL_LastPlayed:
+					if (fm->tmLastStarted)
+					{
+						fl_font(FL_HELVETICA, m_fontsize);
+						fl_color(FL_FOREGROUND_COLOR);
+						fl_draw(row_cache(fm)->lastPlayed.c_str(), X, Y, W, H, FL_ALIGN_CENTER);
+					}
+					break;
 
-		if ( fm->IsInstalled() )
-			OnPlayFM(NULL, NULL);
-		else if ( fm->IsArchived() )
-			InstallFM(fm);
-	}
+				case COL_ReleaseDate:
+					if (fm->tmReleaseDate)
+					{
+						const FMRowCache *rc = row_cache(fm);
 
-public:
-	Fl_FM_List(int x, int y, int w, int h, const char *l=0)
-		: Fl_Table_Row(x,y,w,h,l)
-	{
-		m_font = FL_HELVETICA;
-		m_fontsize = FL_NORMAL_SIZE;
-		m_tagfontsize = m_tagRowH = FL_NORMAL_SIZE-1;
-		m_tagY = m_topH = m_noTagH = m_fontsize + 2;// dummy value, will be recalced in post_init
-		m_tagalign = FL_ALIGN_TOP_LEFT;// can alternatively be FL_ALIGN_BOTTOM_LEFT if not doing automatic row height
-		m_nPendingRclickRow = -1;
-		end();
+						if (fm->flags & FMEntry::FLAG_UnverifiedRelDate)
+						{
+							fl_font(FL_HELVETICA_ITALIC, m_fontsize);
+							fl_color( fl_themed_rgb_color(117,117,117) );
+						}
+						else
+						{
+							fl_font(FL_HELVETICA, m_fontsize);
+							fl_color(FL_FOREGROUND_COLOR);
+						}
+						fl_draw(rc->releaseDate.c_str(), X, Y, W, H, FL_ALIGN_CENTER);
+					}
+					break;
 
-		type(SELECT_SINGLE_PERSIST);
-		always_show_vscroll(1);
+				case COL_DirName:
+					fl_font(FL_HELVETICA, m_fontsize);
+					fl_color(FL_FOREGROUND_COLOR);
+					fl_draw(fm->name, X+2, Y, W-4, H, FL_ALIGN_LEFT);
+					break;
 
-		callback(event_callback, (void*)this);
-	}
+				case COL_Archive:
+					if ( fm->IsArchived() )
+					{
+						fl_font(FL_HELVETICA, m_fontsize);
+						fl_color(FL_FOREGROUND_COLOR);
+						fl_draw(fm->archive.c_str(), X+2, Y, W-4, H, FL_ALIGN_LEFT);
+					}
+					break;
+				}
+			}
 
-	virtual ~Fl_FM_List()
-	{
-	}
+			// border
+			fl_color(FL_GRAY);
+			//fl_rect(X, Y, W, H);
+			fl_xyline(X, Y+H-1, X+W-1);
 
-	// post-create initializtion
-	void post_init_header()
-	{
-		int i;
-		int num_cols = 0;
+			fl_color( fl_themed_rgb_color(220,220,220) );
+			fl_line_style(FL_DOT);
+			fl_yxline(X+W-1, Y, Y+H-1);
+			fl_line_style(FL_SOLID);
+		}
+		fl_pop_clip();
+		return;
 
-		ASSERT(g_cfg.colvis & (1<<COL_Name));
+	case CONTEXT_ENDPAGE:
+	case CONTEXT_RC_RESIZE:
+	case CONTEXT_RC_RESIZED:
+	case CONTEXT_NONE:
+	case CONTEXT_TABLE:
+		return;
+	}
+}
 
-		if (g_cfg.colvis & (1<<COL_DirName))
-			s_columns[COL_DirName].visible = TRUE;
-		if (g_cfg.colvis & (1<<COL_Archive))
-			s_columns[COL_Archive].visible = TRUE;
+void Fl_FM_List::OnCallback()
+{
+	int /*R = callback_row(),*/ Ci = callback_col();
+	int C = s_column_idx[Ci];
 
-		for (i=0; i<COL_NUM_COLS; i++)
-		{
-			s_columns[i].ui_col_index = -1;
+	TableContext context = callback_context();
 
-			// apply col default sizes of large font if necessary
-			if (g_cfg.bLargeFont && s_columns[i].width2)
-				s_columns[i].width = s_columns[i].width2;
+	switch (context)
+	{
+	case CONTEXT_COL_HEADER:
+		if (Fl::event() == FL_RELEASE && Fl::event_button() == 1)
+		{
+			int sortid = s_columns[C].sortid;
+			if (sortid == SORT_None)
+				break;
 
-			// count visible columns and init column index mapping table
-			if (s_columns[i].visible)
+			// check for pseudo column "Rating"
+			if (!C)
 			{
-				s_columns[i].ui_col_index = num_cols;
-				s_column_idx[num_cols] = i;
-				num_cols++;
+				const int X = pFMList->x();
+				const int W = pFMList->col_width(Ci);
+				if (Fl::event_x() >= (X+W-(5*16)-2))
+					sortid = SORT_Rating;
 			}
-		}
 
-		cols(num_cols);
-		int totw = Fl::scrollbar_size();
-		col_minwidth(0, s_columns[0].minwidth);
-		for (i=1; i<COL_NUM_COLS; i++)
-		{
-			if (s_columns[i].visible)
+			if (sortid == abs(g_cfg.sortmode))
 			{
-				totw += s_columns[i].width;
-				col_width(s_columns[i].ui_col_index, s_columns[i].width);
-				col_minwidth(s_columns[i].ui_col_index, s_columns[i].minwidth);
+				// flip sort order
+				g_cfg.SetSortMode(-g_cfg.sortmode);
+			}
+			else
+			{
+				g_cfg.SetSortMode(sortid);
 			}
 		}
-		col_width(0, std::max(s_columns[0].width, w()-totw));
-
-		col_header(1);
-		col_resize(1);
+		break;
 
-		// init col sizes from config
-		for (i=0; i<COL_NUM_COLS; i++)
-			if (s_columns[i].visible && g_cfg.colsizes[i] != -1 && s_columns[i].minwidth != -1)
-				col_width(s_columns[i].ui_col_index, g_cfg.colsizes[i]);
-	}
+	case CONTEXT_CELL:
+		OnListSelChange( selected() );
+		break;
 
-	// post-create initializtion
-	void post_init()
-	{
-		rows( (int)g_dbFiltered.size() );
+	case CONTEXT_RC_RESIZED:
+		refresh_formatting();
+		break;
 
-		refresh_rowsize();
+	case CONTEXT_STARTPAGE:
+	case CONTEXT_ENDPAGE:
+	case CONTEXT_ROW_HEADER:
+	case CONTEXT_TABLE:
+	case CONTEXT_RC_RESIZE:
+	case CONTEXT_NONE:
+		break;
 	}
+}
 
-	void refresh_rowsize()
-	{
-		const int notag_tophalf = std::max(imgStar.h(), imgProgress.h()) + 2;
-		const int min_tophalf = g_cfg.tagrows > 0 ? imgStar.h() : notag_tophalf;
-
-		fl_font(m_font, m_fontsize);
-		const int fheight = fl_height();
-
-		const int tophalf = m_topH = std::max(fheight, min_tophalf) + 2;
-		fl_font(FL_HELVETICA, m_tagfontsize);
-		m_tagRowH = fheight;
-		m_noTagH = std::max(fheight, notag_tophalf) + 2;
-		const int bottomhalf = g_cfg.tagrows > 0 ? m_tagRowH * g_cfg.tagrows + 2 : 0;
-
-		m_tagY = m_topH;
-
-		if (g_cfg.tagrows <= 0 || !g_cfg.bVarSizeList)
-			row_height_all(tophalf + bottomhalf);
-		else
-		{
-			const int maxH = tophalf + bottomhalf;
-
-			const int W = col_width(0);
-			const int X = 0;
-			const int XX = X+4;
-			const int WW = (X+W) - XX - 2;
-
-			for (int r=0; r<rows(); r++)
-			{
-				FMEntry *fm = g_dbFiltered[r];
 
-				if ( fm->tagsUI.empty() )
-					row_height(r, std::min(maxH, m_noTagH));
-				else
-				{
-					int lw = WW, lh = 0;
-					fl_measure(fm->tagsUI.c_str(), lw, lh, 0);
+static FMEntry* GetCurSelFM()
+{
+	return pFMList->selected();
+}
 
-					const int bottomhalf2 = lh + 2;
-					row_height(r, std::min(maxH, tophalf + bottomhalf2));
-				}
-			}
-		}
-	}
+static void RefreshListControl(FMEntry *pPrevSel, BOOL bOnlyChangedOrder)
+{
+	if (bOnlyChangedOrder)
+		pFMList->refresh_order(pPrevSel);
+	else
+		pFMList->refresh(pPrevSel);
+}
 
-	void refresh_rowsize(FMEntry *fm)
-	{
-		if (g_cfg.tagrows <= 0 || !g_cfg.bVarSizeList)
-			;
-		else
-		{
-			int r = GetFilteredDbIndex(fm);
-			if (r < 0)
-				return;
+static void RefreshListControlRowSize()
+{
+	pFMList->refresh_rowsize();
+	pFMList->redraw();
+}
 
-			const int tophalf = m_topH;
-			const int bottomhalf = g_cfg.tagrows > 0 ? m_tagRowH * g_cfg.tagrows + 2 : 0;
+static void RedrawListControl(BOOL bUpdateButtons)
+{
+	// (no list in batch mode)
+	if (!pFMList)
+		return;
 
-			const int maxH = tophalf + bottomhalf;
+	pFMList->redraw();
 
-			const int W = col_width(0);
-			const int X = 0;
-			const int XX = X+4;
-			const int WW = (X+W) - XX - 2;
+	if (bUpdateButtons)
+		OnListSelChange( pFMList->selected() );
+}
 
-			if ( fm->tagsUI.empty() )
-				row_height(r, std::min(maxH, m_noTagH));
-			else
-			{
-				fl_font(FL_HELVETICA, m_tagfontsize);
+static void SelectNeighborFM()
+{
+	// select next FM, or previous if current selection is last (called after FM entries were removed from the db
+	// but before g_dbFiltered is refreshed, entries that were removed are skipped)
 
-				int lw = WW, lh = 0;
-				fl_measure(fm->tagsUI.c_str(), lw, lh, 0);
+	FMEntry *fm = pFMList->selected();
+	if (!fm)
+		return;
 
-				const int bottomhalf2 = lh + 2;
-				row_height(r, std::min(maxH, tophalf + bottomhalf2));
-			}
-		}
-	}
+	int i = GetFilteredDbIndex(fm);
+	if (i < 0)
+		return;
 
-	void refresh(FMEntry *selection)
+	int n;
+
+	// select next
+	for (n=i+1; n<(int)g_dbFiltered.size() && GetDbIndex(g_dbFiltered[n]) < 0; n++)
+		;
+	if (n >= (int)g_dbFiltered.size())
 	{
-		RefreshFilteredDb();
-		rows( (int)g_dbFiltered.size() );
-		refresh_rowsize();
+		// select previous
+		for (n=i-1; n>=0 && GetDbIndex(g_dbFiltered[n]) < 0; n--)
+			;
+		if (n < 0)
+			return;
+	}
 
-		int R = 0;
+	fm = g_dbFiltered[n];
 
-		if (selection)
-		{
-			R = GetFilteredDbIndex(selection);
-			if (R == -1)
-				R = 0;
-		}
+	pFMList->select(fm);
+	OnListSelChange(fm);
+}
 
-		select_row_ex(R);
-		ensure_visible(R, 2);
 
-		FMEntry *newsel = selected();
-		if (newsel != selection)
-			OnListSelChange(newsel);
+//
+// FM_Link_Button
+//
 
-		redraw();
-	}
+class Fl_Link_Button : public Fl_Button
+{
+protected:
+	Fl_Color m_hoverclr;
+	int m_underlineY;
+	int m_underlineW;
 
-	void refresh_order(FMEntry *selection)
+protected:
+	virtual void draw()
 	{
-		pFMList->select(selection, TRUE);
+		if (type() == FL_HIDDEN_BUTTON) return;
+		draw_box(box(), parent()->color());
 
-		// recalc row heights if var size list entries is enabled
-		if (g_cfg.tagrows > 0 && g_cfg.bVarSizeList)
-			refresh_rowsize();
+		int clr = labelcolor();
+		if (Fl::belowmouse() == this)
+			labelcolor(m_hoverclr);
 
-		pFMList->redraw();
+		draw_label(x(), y(), w(), h());
+		// underline
+		fl_xyline(x(), y()+m_underlineY+2-fl_descent(), x()+m_underlineW);
 
-		int R = GetFilteredDbIndex(selection);
-		if (R != -1)
-			ensure_visible(R, 2);
+		labelcolor(clr);
+		if (Fl::focus() == this) draw_focus();
 	}
 
-	void refresh_formatting()
+	virtual int handle(int e)
 	{
-		// recalc row heights if var size list entries is enabled
-		if (g_cfg.tagrows > 0 && g_cfg.bVarSizeList)
+		switch (e)
 		{
-			refresh_rowsize();
-			pFMList->redraw();
+		case FL_ENTER:
+			fl_cursor(FL_CURSOR_HAND);
+			redraw();
+			break;
+		case FL_LEAVE:
+			fl_cursor(FL_CURSOR_DEFAULT);
+			redraw();
+			break;
 		}
+
+		return Fl_Button::handle(e);
 	}
 
-	FMEntry* selected() const
+	void autosize_to_label()
 	{
-		if ( row_selected(this->Fl_Table::select_row) )
-			return g_dbFiltered[this->Fl_Table::select_row];
+		// auto-size
+		int lw = 0, lh = 0;
+		fl_font(labelfont(), labelsize());
+		fl_measure(label(), lw, lh);
+		m_underlineY = lh;
+		m_underlineW = lw;
+		size(lw, lh+2);
+	}
 
-		for (int i=0; i<rows(); i++)
-		{
-			if ( row_selected(i) )
-			{
-				ASSERT((unsigned int)i < g_dbFiltered.size());
-				return g_dbFiltered[i];
-			}
-		}
+public:
+	Fl_Link_Button(int X, int Y, const char *l,
+		Fl_Color clr = fl_themed_rgb_color(50,90,200), Fl_Color hoverclr = fl_themed_rgb_color(30,50,80),
+		Fl_Font font = FL_HELVETICA_BOLD, int fontsize = FL_NORMAL_SIZE)
+		: Fl_Button(X,Y,1,1,l)
+	{
+		box(FL_FLAT_BOX);
+		down_box(FL_FLAT_BOX);
+		labelfont(font);
+		labelsize(fontsize);
+		labelcolor(clr);
+		align(FL_ALIGN_TOP_LEFT | FL_ALIGN_INSIDE);
 
-		return NULL;
+		m_hoverclr = hoverclr;
+
+		if (l)
+			autosize_to_label();
 	}
+};
 
-	void select(FMEntry *fm, BOOL bCenterSel = FALSE)
+
+//
+// Fl_AddTagFilter_Button
+//
+
+class Fl_AddTagFilter_Button : public Fl_Link_Button
+{
+	string m_label;
+
+public:
+	Fl_AddTagFilter_Button(int X, int Y, BOOL bNoFilter = FALSE)
+		: Fl_Link_Button(X,Y,NULL,fl_themed_rgb_color(50,90,200),fl_themed_rgb_color(30,50,80),FL_HELVETICA_BOLD,FL_NORMAL_SIZE)
 	{
-		if (this->Fl_Table::select_row < 0)
-			bCenterSel = TRUE;
+		m_label = bNoFilter ? $("Add Tag") : $("Add Tag Filter");
 
-		int R = 0;
+		// underline width (excludes " »")
+		fl_font(labelfont(), labelsize());
+		const int underlineW = (int)fl_width( m_label.c_str() ) - 1;
 
-		if (fm)
-		{
-			int r = GetFilteredDbIndex(fm);
-			if (r != -1)
-				R = r;
-		}
+		// append " »" to label
+		m_label += " »";
+		label( m_label.c_str() );
+		autosize_to_label();
 
-		select_row_ex(R);
-		ensure_visible(R, bCenterSel);
+		m_underlineW = underlineW;
+
+		tooltip(bNoFilter ? $("Select a tag from list to add") : $("Select a tag from list to add to tag filters"));
 	}
+};
 
-	void DoContextMenu()
-	{
-		FMEntry *fm = selected();
-		if (!fm)
-			return;
 
-		// auto-check for info file if none is set an none has been looked for
-		if (fm->infofile.empty() && !(fm->flags & FMEntry::FLAG_NoInfoFile))
-			AutoSelectInfoFile(fm);
+//
+// FM_Html_Popup
+//
 
-		enum
-		{
-			CMD_NONE,
+class Fl_FM_Html_Popup : public Fl_Double_Window
+{
+protected:
+	BOOL m_bDone;
+	BOOL m_bClickedLink;
+	Fl_Widget *m_pushed;
 
-			CMD_Play,
-			CMD_StartPlay,
+	static char s_retlink[256];
 
-			CMD_Install,
-			CMD_Uninstall,
+protected:
+	virtual int handle(int e)
+	{
+		switch (e)
+		{
+		case FL_KEYBOARD:
+			switch ( Fl::event_key() )
+			{
+			case FL_Escape:
+				m_bDone = TRUE;
+				return 1;
+			}
+			break;
 
-			CMD_InProgress,
-			CMD_Completed,
+		case FL_PUSH:
+			if (m_bDone)
+				return 1;
+			{
+			// close if clicked outside of popup
+			int mx = Fl::event_x_root();
+			int my = Fl::event_y_root();
+			if (mx < x_root() || mx >= x_root()+w() || my < y_root() || my >= y_root()+h())
+			{
+				m_bDone = TRUE;
+				return 1;
+			}
+			}
+			// workaround for release events not reaching child widgets (ie scrollbar buttons) when grab is enabled
+			e = Fl_Double_Window::handle(e);
+			m_pushed = Fl::pushed();
+			if (m_pushed == child(0))
+				m_pushed = NULL;
+			return e;
 
-			CMD_PrioNormal,
-			CMD_PrioHigh,
-			CMD_PrioUrgent,
-			CMD_PrioCrit,
+		// workaround for release events not reaching child widgets (ie scrollbar buttons) when grab is enabled
+		case FL_RELEASE:
+			if (m_pushed && !Fl::pushed())
+			{
+				m_pushed->handle(e);
+				m_pushed = NULL;
+				return 1;
+			}
+			m_pushed = NULL;
+			break;
+		}
+
+		return Fl_Double_Window::handle(e);
+	}
 
-			CMD_RemoveRating,
-			CMD_Rating0,
-			CMD_Rating10 = CMD_Rating0+10,
+	static const char *link_cb(Fl_Widget *o, const char *url)
+	{
+		Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)((Fl_Html_View*)o)->user_data2();
+		ASSERT(w != NULL);
 
-			CMD_Delete,
+		BOOL bClose = TRUE;
 
-			CMD_Edit,
-			CMD_EditTags,
+		if (w->callback() != (Fl_Callback*)default_callback)
+		{
+			bClose = ((BOOL (*)(Fl_Widget*,void*))w->callback())(o, (void*)url);
+			w->clear_changed();
+		}
+		else
+			w->ReturnLink(url);
 
-			CMD_ViewInfo,
-			CMD_ViewSummary,
-			CMD_ViewArchContent,
-		};
+		w->m_bDone = !!bClose;
 
-		Fl_Image *imgGray = NULL;
+		return NULL;
+	}
 
-		const BOOL bAdvanced = !!(Fl::event_state() & FL_CTRL);
+	static void draw_frame(int x, int y, int w, int h, Fl_Color c)
+	{
+		fl_color(c);
+		fl_rectf(x+4, y+4, w-8, h-8);
+		fl_color(FL_FOREGROUND_COLOR);
+		fl_rect(x, y, w, h);
+		//fl_color( fl_rgb_color(130,120,115) );
+		fl_color( fl_themed_rgb_color(150,185,220) );
+		fl_rectf(x+1, y+1, w-2, 3);
+		fl_rectf(x+1, y+4, 3, h-8);
+		fl_rectf(x+w-4, y+4, 3, h-8);
+		fl_rectf(x+1, y+h-4, w-2, 3);
+	}
 
-		#define MENU_RATE(_name, _val) MENU_RITEM(_name, CMD_Rating0+_val, fm->rating==_val)
-		#define MENU_PRIO(_val, _id) \
-			MENU_ITEM("", _id); \
-			if (fm->priority == (_val)+1) \
-			{ \
-				imgGray = imgPrio[_val]->copy(); \
-				imgGray->inactive(); \
-				menu[menu_items-1].image(imgGray); \
-				menu[menu_items-1].deactivate(); \
-			} \
-			else \
-				menu[menu_items-1].image(imgPrio[_val])
+public:
+	Fl_FM_Html_Popup(int X, int Y, int W, int H)
+		: Fl_Double_Window(X,Y,W,H,0)
+	{
+		m_bDone = FALSE;
+		m_bClickedLink = FALSE;
+		m_pushed = NULL;
 
-		const int MAX_MENU_ITEMS = 48;
-		int menu_items = 0;
+		end();
+		set_modal();
+		clear_border();
+		box(FL_NO_BOX);
+	}
 
-		Fl_Menu_Item menu[MAX_MENU_ITEMS];
+	virtual ~Fl_FM_Html_Popup()
+	{
+		hide();
+	}
 
-		if (fm->IsInstalled() || !fm->IsArchived())
-		{
-			if (!g_bRunningEditor)
-			{
-				MENU_ITEM($("Play"), CMD_Play);
-				MENU_MOD_DISABLE( !fm->IsInstalled() );
-				MENU_ITEM($("Start Playthrough"), CMD_StartPlay);
-				MENU_MOD_DISABLE(!fm->IsInstalled() || (fm->status == FMEntry::STATUS_InProgress));
-			}
-			else
-			{
-				MENU_ITEM($("Select"), CMD_Play);
-				MENU_MOD_DISABLE( !fm->IsInstalled() );
-			}
-		}
-		else
-		{
-			MENU_ITEM($("Install"), CMD_Install);
-			MENU_MOD_DISABLE( g_sTempDir.empty() );
-		}
-		if (fm->IsInstalled() && fm->IsArchived())
-		{
-			MENU_MOD_DIV();
-			MENU_ITEM($("Uninstall"), CMD_Uninstall);
-			MENU_MOD_DISABLE( g_sTempDir.empty() );
-		}
-		if (bAdvanced)
-		{
-			MENU_MOD_DIV();
-			MENU_ITEM($("Delete from Db"), CMD_Delete);
-		}
-		MENU_MOD_DIV();
-		MENU_SUB($("Status"));
-			MENU_ITEM(fm->status==FMEntry::STATUS_InProgress?$("Abort Playthrough"):$("Playing"), CMD_InProgress);
-			MENU_ITEM($("Completed"), CMD_Completed);
-			MENU_END();
-		MENU_SUB($("Priority"));
-			MENU_ITEM("", CMD_PrioNormal);
-			MENU_PRIO(0, CMD_PrioHigh);
-			MENU_PRIO(1, CMD_PrioUrgent);
-			MENU_PRIO(2, CMD_PrioCrit);
-			MENU_END();
-		MENU_SUB($("Rating")); MENU_MOD_DIV();
-			MENU_RITEM($("None"), CMD_RemoveRating, fm->rating == -1);
-			MENU_RATE("0", 0); MENU_RATE("0.5", 1);
-			MENU_RATE("1", 2); MENU_RATE("1.5", 3);
-			MENU_RATE("2", 4); MENU_RATE("2.5", 5);
-			MENU_RATE("3", 6); MENU_RATE("3.5", 7);
-			MENU_RATE("4", 8); MENU_RATE("4.5", 9);
-			MENU_RATE("5", 10);
-			MENU_END();
-		MENU_ITEM($("Edit..."), CMD_Edit);
-		MENU_ITEM($("Edit Tags..."), CMD_EditTags);
-		MENU_MOD_DIV();
-		if (bAdvanced && fm->IsArchived())
-		{
-			MENU_ITEM($("View Archive Contents..."), CMD_ViewArchContent);
-		}
-		MENU_ITEM($("View Info File..."), CMD_ViewInfo);
-		MENU_MOD_DISABLE(!fm->IsAvail() || fm->infofile.empty());
-		MENU_ITEM($("View Summary..."), CMD_ViewSummary);
-		MENU_END();
+	void DeferredClose()
+	{
+		m_bDone = TRUE;
+	}
 
-		// bold text for double-click item
-		menu[0].labelfont(FL_HELVETICA_BOLD);
-		//menu[0].labelsize(11);
+	void ReturnLink(const char *url)
+	{
+		m_bClickedLink = TRUE;
+		strcpy_safe(s_retlink, sizeof(s_retlink), url);
+	}
 
-		const Fl_Menu_Item *m = menu->popup(Fl::event_x(), Fl::event_y(), 0, 0, 0);
+	void do_popup()
+	{
+		m_bDone = FALSE;
+		m_bClickedLink = FALSE;
 
-		if (imgGray)
-			delete imgGray;
+		fl_cursor(FL_CURSOR_DEFAULT);
 
-		if (!m || !m->user_data())
-			return;
+		show();
 
-		const int cmd_id = (intptr_t)m->user_data();
-		switch (cmd_id)
-		{
-		case CMD_Play:
-			OnPlayFM(NULL, NULL);
-			break;
-		case CMD_StartPlay:
-			OnStartFM(NULL, NULL);
-			break;
+		Fl::grab(this);
 
-		case CMD_Install:
-			InstallFM(fm);
-			break;
-		case CMD_Uninstall:
-			UninstallFM(fm);
-			break;
+		while (!m_bDone)
+		{
+			Fl_Widget *o = Fl::readqueue();
+			if (!o) Fl::wait();
+		}
 
-		case CMD_InProgress:
-			if (fm->status == FMEntry::STATUS_InProgress)
-				fm->SetStatus(fm->nCompleteCount>0 ? FMEntry::STATUS_Completed : FMEntry::STATUS_NotPlayed);
-			else
-				fm->SetStatus(FMEntry::STATUS_InProgress);
-			RedrawListControl(TRUE);
-			break;
-		case CMD_Completed:
-			fl_message_position(pMainWnd);
-			if ( fl_choice($("Completed \"%s\"?"), fl_no, fl_yes, NULL, fm->GetFriendlyName()) )
-			{
-				fm->OnCompleted();
-				RedrawListControl(TRUE);
-			}
-			break;
+		Fl::release();
 
-		case CMD_RemoveRating:
-			fm->SetRating(-1);
-			RedrawListControl();
-			break;
+		hide();
+	}
 
-		case CMD_Delete:
-			fl_message_position(pMainWnd);
-			if ( fl_choice($("Are you sure you want to delete \"%s\" from the database?"), fl_no, fl_yes, NULL, fm->GetFriendlyName()) )
-				DeleteFM(fm);
-			break;
+	// if linkcb is NULL then popup will close after clicking a link and the link name will be returned
+	// otherwise the linkcb controls when the popup closes and the return value is always NULL
+	static const char* popup(int X, int Y, int W, int H, const char *html, BOOL (*linkcb)(Fl_Html_View*, const char*) = NULL)
+	{
+		if (!html)
+		{
+			ASSERT(FALSE);
+			return NULL;
+		}
 
-		case CMD_Edit:
-			DoTagEditor(fm, TABPAGE_MISC);
-			break;
+		X += Fl::event_x_root() - Fl::event_x();
+		Y += Fl::event_y_root() - Fl::event_y();
 
-		case CMD_EditTags:
-			DoTagEditor(fm);
-			break;
+		Fl_FM_Html_Popup w(X,Y,W,H);
 
-		case CMD_ViewInfo:
-			if ( !fm->infofile.empty() )
-			{
-				if ( !FmFileExists(fm, fm->infofile.c_str()) )
-					if ( !AutoSelectInfoFile(fm) )
-					{
-						fl_message_position(pMainWnd);
-						fl_alert("%s", $("Couldn't find any info file."));
-						break;
-					}
+		if (linkcb)
+			w.callback((Fl_Callback*)linkcb);
 
-				if ( !FmOpenFileWithAssociatedApp(fm, fm->infofile.c_str()) )
-				{
-					fl_message_position(pMainWnd);
-					fl_alert($("Failed to view info file \"%s\"."), fm->infofile.c_str());
-				}
-			}
-			break;
+		Fl_Html_View *o = new Fl_Html_View(0, 0, w.w(), w.h());
+		w.resizable(o);
 
-		case CMD_ViewSummary:
-			ViewSummary(fm);
-			break;
+		o->user_data2(&w);
+		o->box(HTML_POPUP_BOX);
+		o->color( fl_themed_rgb_color(60,120,180) );
+		//o->textfont(FL_HELVETICA_BOLD);
+		o->textfont(FL_HELVETICA);
+		o->textsize(FL_NORMAL_SIZE);
+		//o->textcolor( fl_rgb_color(200,230,250) );
+		o->textcolor( fl_rgb_color(220,220,220) );
+		o->link(link_cb);
+		o->include_anchor_to_cb();
 
-		case CMD_ViewArchContent:
-			ViewArchiveContents(fm);
-			break;
+		o->value(html);
 
-		default:
-			if (cmd_id >= CMD_Rating0 && cmd_id <= CMD_Rating10)
-				fm->SetRating(cmd_id - CMD_Rating0);
-			else if (cmd_id >= CMD_PrioNormal && cmd_id <= CMD_PrioCrit)
-				fm->SetPriority(cmd_id - CMD_PrioNormal);
+		// shrink height to fit document if document is smaller
+		if (o->size() < o->h() - Fl::box_dh( o->box() ))
+		{
+			// bypass resize of Fl_Html_View to avoid a complete re-parse for the html code
+			o->Fl_Widget::resize(o->x(), o->y(), o->w(), o->size());
+			w.size(w.w(), o->h());
 		}
 
-		redraw();
-	}
+		w.add(o);
 
-	// for fluid generated code
-	void textfont(int n) { m_font = n; }
-	void textsize(int n) { m_fontsize = n; }
-	int textsize() { return m_fontsize; }
+		w.do_popup();
 
-	BOOL save_col_state(int *cols)
-	{
-		BOOL bChanged = FALSE;
-		for (int i=0; i<COL_NUM_COLS; i++)
-		{
-			if (s_columns[i].ui_col_index != -1)
-			{
-				const int n = col_width(s_columns[i].ui_col_index);
-				if (cols[i] != n)
-				{
-					cols[i] = n;
-					bChanged = TRUE;
-				}
-			}
-		}
-		return bChanged;
+		return (linkcb || !w.m_bClickedLink) ? NULL : s_retlink;
 	}
 
 	static void static_init()
 	{
-#ifdef LOCALIZATION_SUPPORT
-		// localization of column labels
-		for (int i=0; i<COL_NUM_COLS; i++)
-			s_columns[i].name = $(s_columns[i].name);
-#endif
+		Fl::set_boxtype(HTML_POPUP_BOX, draw_frame, 4, 4, 8, 8);
 	}
 };
 
+char Fl_FM_Html_Popup::s_retlink[256];
 
-Fl_FM_List::ColDef Fl_FM_List::s_columns[COL_NUM_COLS] =
-{
-	{"Name", 364, 150, 0, TRUE, SORT_Name, 0},
-	{"Pri", 30, -1, 26, TRUE, SORT_Priority, 0},
-	{"Status", 50, -1, 0, TRUE, SORT_Status, 0},
-	{"Last Played", 80, 60, 90, TRUE, SORT_LastPlayed, 0},
-	{"Release Date", 80, 60, 90, TRUE, SORT_ReleaseDate, 0},
-	{"Directory", 170, 60, 90, FALSE, SORT_DirName, 0},
-	{"Archive", 230, 60, 90, FALSE, SORT_Archive, 0}
-};
-
-int Fl_FM_List::s_column_idx[COL_NUM_COLS] = {};
 
+//
+// FM_TagFilter_Button
+//
 
-void Fl_FM_List::draw_cell(TableContext context, int R, int C, int X, int Y, int W, int H)
+class Fl_FM_TagFilter_Button : public Fl_Widget
 {
-	int i;
-	char s[64];
+	int m_nicelabelX;
+	string m_nicelabel;
+	string m_category;
 
-	const FMEntry *fm = (R < (int)g_dbFiltered.size()) ? g_dbFiltered[R] : NULL;
+	BOOL m_bHilightedX;
 
-	switch (context)
+protected:
+	enum
 	{
-	case CONTEXT_STARTPAGE:
-		fl_font(m_font, m_fontsize);
-		return;
-
-	case CONTEXT_ROW_HEADER:
-		fl_color(FL_RED);
-		fl_rectf(X, Y, W, H);
-		return;
+		XBUTTON_WIDTH = 17,//16,
+		LABEL_MARGIN_LEFT = 4,
+		LABEL_MARGIN_RIGHT = 4,
+	};
 
-	case CONTEXT_COL_HEADER:
-		fl_push_clip(X, Y, W, H);
-		fl_draw_box(FL_THIN_UP_BOX, X, Y, W, H, Fl::focus()==this ? fl_themed_rgb_color(180,180,200) : fl_themed_rgb_color(203,203,203));
-		if (C < COL_NUM_COLS)
-		{
-			C = s_column_idx[C];
+	virtual void draw()
+	{
+		const BOOL bFocus = (Fl::focus() == this);
 
-			int XX = X+3;
-			const char *label = s_columns[C].name;
+		fl_color( color() );
+		fl_rectf(x()+1, y()+1, w()-XBUTTON_WIDTH-1, h()-2);
 
-			fl_font(labelfont(), labelsize());
-			fl_color( labelcolor() );
-			fl_draw(label, XX, Y, W-3, H, FL_ALIGN_LEFT, 0, 0);
+		// X button
+		const int X = x()+w()-XBUTTON_WIDTH;
+		const BOOL bMouseOverX = m_bHilightedX = (Fl::belowmouse() == this && Fl::event_x() >= X);
+		fl_color(bMouseOverX ? fl_themed_rgb_color(145,200,245) : fl_themed_rgb_color(130,170,200));
+		fl_rectf(X, y()+1, XBUTTON_WIDTH, h()-2);
+		imgTagX.draw(X+4, y()+4);
 
-			// pseudo-column for rating (so it's possible to sort on rating)
-			if (!C)
-			{
-				fl_draw(RATING_COL_LABEL, X+W-(5*16)-2, Y, W, H, FL_ALIGN_LEFT, 0, 0);
+		fl_color(bFocus ? FL_FOREGROUND_COLOR : fl_themed_rgb_color(105,135,160));
+		fl_xyline(x()+1, y(), x()+w()-2);
+		fl_xyline(x()+1, y()+h()-1, x()+w()-2);
+		fl_yxline(x(), y()+1, y()+h()-2);
+		fl_yxline(x()+w()-1, y()+1, y()+h()-2);
 
-				if (abs(g_cfg.sortmode) == SORT_Rating)
-				{
-					XX = X+W-(5*16)-2;
-					label = RATING_COL_LABEL;
-					goto draw_sortarrow;
-				}
-			}
+		fl_yxline(X, y()+2, y()+h()-3);
+		fl_xyline(X-1, y()+1, X-1);
+		fl_xyline(X-1, y()+h()-2, X-1);
 
-			// sort arrow
-			if (s_columns[C].sortid == abs(g_cfg.sortmode))
-			{
-draw_sortarrow:
-				int lw = 0, lh = 0;
-				fl_measure(label, lw, lh);
-				XX += lw+2;
-				fl_color( fl_themed_rgb_color(95,95,95) );
-				if (g_cfg.sortmode >= 0)
-				{
-					// down
-					fl_yxline(XX, Y+(H>>1), Y+H-3);
-					fl_xyline(XX-2, Y+H-3-2, XX+2);
-					fl_xyline(XX-1, Y+H-3-1, XX+1);
-				}
-				else
-				{
-					// up
-					fl_yxline(XX, Y+2, Y+(H>>1)-1);
-					fl_xyline(XX-1, Y+2+1, XX+1);
-					fl_xyline(XX-2, Y+2+2, XX+2);
-				}
-			}
-		}
-		fl_pop_clip();
-		return;
+		fl_color(FL_FOREGROUND_COLOR);
+		fl_font(labelfont(), labelsize());
+		fl_draw(m_nicelabel.c_str(),
+			x()+LABEL_MARGIN_LEFT+m_nicelabelX, y()+2,
+			w()-XBUTTON_WIDTH-(LABEL_MARGIN_LEFT+LABEL_MARGIN_RIGHT)-m_nicelabelX, h()-4,
+			(Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_INSIDE|FL_ALIGN_CLIP), 0, 0);
 
-	case CONTEXT_CELL:
-		fl_push_clip(X, Y, W, H);
+		if ( !m_category.empty() )
 		{
-			// bg
-			if ( fm->IsInstalled() )
-				fl_color(row_selected(R) ? selection_color() : ((R & 1) ? fl_themed_rgb_color(245,245,255) : FL_WHITE));
-			else if ( fm->IsAvail() )
-				fl_color(row_selected(R) ? fl_themed_rgb_color(192,239,250) : ((R & 1) ? fl_themed_rgb_color(232,232,240) : fl_themed_rgb_color(240,240,240)));
-			else
-				fl_color(row_selected(R) ? fl_themed_rgb_color(206,238,250) : ((R & 1) ? fl_themed_rgb_color(219,219,225) : fl_themed_rgb_color(225,225,225)));
-			fl_rectf(X, Y, W, H);
-
-			if (fm)
-			{
-				C = s_column_idx[C];
-
-				switch (C)
-				{
-				case COL_Name:
-					{
-					// rating (first so name can be drawn over it if column is too small
-					if (fm->rating >= 0)
-					{
-						const int XX = X + W - 5*16 - 2;
-						const int YY = (H > m_noTagH) ? Y + 1 : Y + ((H - imgStar.h()) >> 1);
-						for (i=0; i<fm->rating>>1; i++)
-							imgStars[2]->draw(XX+i*16, YY);
-						if (fm->rating & 1)
-						{
-							imgStars[1]->draw(XX+i*16, YY);
-							i++;
-						}
-						for (; i<5; i++)
-							imgStars[0]->draw(XX+i*16, YY);
-					}
-
-					// name
-					int iw = 0;
-					if ( !fm->IsInstalled() )
-					{
-						if ( fm->IsAvail() )
-						{
-							if (fm->status == FMEntry::STATUS_NotPlayed)
-							{
-								fl_color( fl_themed_rgb_color(70,70,250) );
-								if (fm->tmLastStarted)
-									fl_font(FL_HELVETICA_ITALIC, m_fontsize);
-								else
-									fl_font(FL_HELVETICA_BOLD_ITALIC, m_fontsize);
-							}
-							else if (fm->status == FMEntry::STATUS_InProgress)
-							{
-								fl_color( fl_themed_rgb_color(243,135,75) );
-								fl_font(FL_HELVETICA_BOLD_ITALIC, m_fontsize);
-							}
-							else
-							{
-								fl_color(FL_FOREGROUND_COLOR);
-								fl_font(FL_HELVETICA_ITALIC, m_fontsize);
-							}
-						}
-						else
-						{
-							fl_color( fl_themed_rgb_color(83,83,83) );
-							fl_font(FL_HELVETICA_ITALIC, m_fontsize);
-						}
-
-						Fl_Pixmap *pix = fm->IsArchived() ? &imgArchived : &imgNotAvail;
-						pix->draw(X+1, Y+1+std::max(0, ((m_topH-pix->h())>>1)));
-
-						iw = pix->w() + 2;
-					}
-					else
-					{
-						if ( fm->IsArchived() )
-						{
-							Fl_Pixmap *pix = &imgArchiveInstalled;
-							pix->draw(X+1, Y+1+std::max(0, ((m_topH-pix->h())>>1)));
-
-							iw = pix->w() + 2;
-						}
-
-						if (fm->status == FMEntry::STATUS_NotPlayed)
-						{
-							fl_color(FL_BLUE);
-							if (fm->tmLastStarted)
-								fl_font(FL_HELVETICA, m_fontsize);
-							else
-								fl_font(FL_HELVETICA_BOLD, m_fontsize);
-						}
-						else if (fm->status == FMEntry::STATUS_InProgress)
-						{
-							fl_color( fl_themed_rgb_color(255,92,3) );
-							fl_font(FL_HELVETICA_BOLD, m_fontsize);
-						}
-						else
-						{
-							fl_color(FL_FOREGROUND_COLOR);
-							fl_font(FL_HELVETICA, m_fontsize);
-						}
-					}
-					fl_draw(GetListName(fm).c_str(), X+2+iw, Y, W-(fm->rating>=0 ? 5*16+4 : 0)-iw, H, (H>m_noTagH)?FL_ALIGN_TOP_LEFT:FL_ALIGN_LEFT);
+			fl_color( fl_themed_rgb_color(95,95,100) );
+			fl_draw(m_category.c_str(),
+				x()+LABEL_MARGIN_LEFT, y()+2,
+				w()-XBUTTON_WIDTH-(LABEL_MARGIN_LEFT+LABEL_MARGIN_RIGHT), h()-4,
+				(Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_INSIDE|FL_ALIGN_CLIP), 0, 0);
+		}
+	}
 
-					// tags
-					if (!fm->tagsUI.empty() && (H>m_noTagH))
-					{
-						int XX = X+4;
-						int YY = Y+m_tagY;
-						int WW = (X+W) - XX - 2;
-						int HH = H-m_tagY-2;
+	virtual int handle(int e)
+	{
+		switch (e)
+		{
+		case FL_FOCUS:
+		case FL_UNFOCUS:
+			redraw();
+			return 1;
 
-						fl_font(FL_HELVETICA, m_tagfontsize);
-						fl_color( fl_themed_rgb_color(181,181,181) );
-						fl_draw(TAGS_LABEL, XX+1, YY, WW, HH, (Fl_Align)(m_tagalign|FL_ALIGN_CLIP|FL_ALIGN_WRAP));
-						fl_color( fl_themed_rgb_color(83,83,83) );
-						fl_draw(fm->tagsUI.c_str(), XX, YY, WW, HH, (Fl_Align)(m_tagalign|FL_ALIGN_CLIP|FL_ALIGN_WRAP));
-					}
-					}
-					break;
+		case FL_MOVE:
+			{
+			const int X = x()+w()-XBUTTON_WIDTH;
+			const BOOL bMouseOverX = (Fl::belowmouse() == this && Fl::event_x() >= X);
+			if (m_bHilightedX != bMouseOverX)
+				redraw();
+			}
+			break;
 
-				case COL_Status:
-					if (fm->status)
-					{
-						int XX = X+((W-24)>>1);
-						int YY = Y+((H-20)>>1);
+		case FL_PUSH:
+			if (Fl::visible_focus() && handle(FL_FOCUS))
+				Fl::focus(this);
+			return 1;
 
-						switch (fm->status)
-						{
-						case FMEntry::STATUS_InProgress:
-							imgProgress.draw(XX, YY);
-							break;
-						case FMEntry::STATUS_Completed:
-							imgCheck.draw(XX, YY);
-							break;
-						}
+		case FL_RELEASE:
+			{
+			const int X = x()+w()-XBUTTON_WIDTH;
+			const BOOL bMouseOverX = (Fl::belowmouse() == this && Fl::event_x() >= X);
+			if (bMouseOverX)
+				OnDelete();
+			}
+			return 1;
 
-						if (fm->nCompleteCount > 1
-							|| (fm->nCompleteCount == 1 && fm->status == FMEntry::STATUS_InProgress))
-						{
-							if (H > m_noTagH)
-							{
-								XX += 24+4;
-								YY += 20-6;
-							}
-							else
-							{
-								XX = X+W-4;
-								YY = Y+3;
-							}
-							sprintf(s, "%d", fm->nCompleteCount);
-							fl_font(FL_HELVETICA, FL_NORMAL_SIZE-3);
-							fl_color(FL_BACKGROUND2_COLOR);
-							fl_draw(s, XX+1, YY+1, 0, 0, FL_ALIGN_TOP_RIGHT);
-							fl_draw(s, XX-1, YY-1, 0, 0, FL_ALIGN_TOP_RIGHT);
-							fl_color(FL_FOREGROUND_COLOR);
-							fl_draw(s, XX, YY, 0, 0, FL_ALIGN_TOP_RIGHT);
-						}
-					}
-					break;
+		case FL_ENTER:
+			//fl_cursor(FL_CURSOR_HAND);
+			redraw();
+			return 1;
+		case FL_LEAVE:
+			//fl_cursor(FL_CURSOR_DEFAULT);
+			redraw();
+			return 1;
 
-				case COL_Priority:
-					if (fm->priority)
-					{
-						const int XX = X+((W-15)>>1);
-						const int YY = Y+((H-15)>>1);
-						imgPrio[fm->priority-1]->draw(XX, YY);
-					}
-					break;
+		case FL_KEYBOARD:
+			if (Fl::event_key() == ' ')
+			{
+				OnDelete();
+				return 1;
+			}
+			break;
+		}
 
-				case COL_LastPlayed:
-					if (fm->tmLastStarted)
-					{
-						FormatDbDate(fm->tmLastStarted, s, sizeof(s), TRUE);
+		return Fl_Widget::handle(e);
+	}
 
-						fl_font(FL_HELVETICA, m_fontsize);
-						fl_color(FL_FOREGROUND_COLOR);
-						fl_draw(s, X, Y, W, H, FL_ALIGN_CENTER);
-					}
-					break;
+	void OnDelete();
 
-				case COL_ReleaseDate:
-					if (fm->tmReleaseDate)
-					{
-						FormatDbDate(fm->tmReleaseDate, s, sizeof(s), FALSE);
+public:
+	Fl_FM_TagFilter_Button(int X, int Y, int H, const char *l, int op, int maxW)
+		: Fl_Widget(X,Y,1,1,l)
+	{
+		m_bHilightedX = FALSE;
 
-						if (fm->flags & FMEntry::FLAG_UnverifiedRelDate)
-						{
-							fl_font(FL_HELVETICA_ITALIC, m_fontsize);
-							fl_color( fl_themed_rgb_color(117,117,117) );
-						}
-						else
-						{
-							fl_font(FL_HELVETICA, m_fontsize);
-							fl_color(FL_FOREGROUND_COLOR);
-						}
-						fl_draw(s, X, Y, W, H, FL_ALIGN_CENTER);
-					}
-					break;
+		box(FL_FLAT_BOX);
+		switch (op)
+		{
+		case FOP_AND: color( fl_themed_rgb_color(205,220,205) ); break;
+		case FOP_NOT: color( fl_themed_rgb_color(220,205,205) ); break;
+		default:
+			color( fl_themed_rgb_color(205,210,220) );
+		}
+		labelfont(FL_HELVETICA);
+		labelsize(FL_NORMAL_SIZE);
+		set_visible_focus();
 
-				case COL_DirName:
-					fl_font(FL_HELVETICA, m_fontsize);
-					fl_color(FL_FOREGROUND_COLOR);
-					fl_draw(fm->name, X+2, Y, W-4, H, FL_ALIGN_LEFT);
-					break;
+		const int margin = XBUTTON_WIDTH + LABEL_MARGIN_LEFT + LABEL_MARGIN_RIGHT;
 
-				case COL_Archive:
-					if ( fm->IsArchived() )
-					{
-						fl_font(FL_HELVETICA, m_fontsize);
-						fl_color(FL_FOREGROUND_COLOR);
-						fl_draw(fm->archive.c_str(), X+2, Y, W-4, H, FL_ALIGN_LEFT);
-					}
-					break;
-				}
-			}
+		m_nicelabelX = 0;
+		// make label a bit more display friendly (and localized)
+		const char *colon = strchr(l, ':');
+		if (colon)
+		{
+			*(char*)colon = 0;
+			m_category = $tag(l);
+			*(char*)colon = ':';
+			m_category += ":";
+			// don't run "*" through localization, it's a reserved wildcard tag
+			m_nicelabel = (colon[1]=='*' && !colon[2]) ? (colon+1) : $tag(colon+1);
+		}
+		else
+			m_nicelabel = $tag(l);
 
-			// border
-			fl_color(FL_GRAY);
-			//fl_rect(X, Y, W, H);
-			fl_xyline(X, Y+H-1, X+W-1);
+		maxW -= margin;
 
-			fl_color( fl_themed_rgb_color(220,220,220) );
-			fl_line_style(FL_DOT);
-			fl_yxline(X+W-1, Y, Y+H-1);
-			fl_line_style(FL_SOLID);
+		// auto-size
+		int lw = 0, lh = 0;
+		fl_font(labelfont(), labelsize());
+		if (colon)
+		{
+			fl_measure(m_category.c_str(), lw, lh);
+			m_nicelabelX = lw + 2;
+			lw = lh = 0;
+			fl_measure(m_nicelabel.c_str(), lw, lh);
+			lw += m_nicelabelX;
+		}
+		else
+			fl_measure(m_nicelabel.c_str(), lw, lh);
+		if (lw > maxW)
+		{
+			lw = maxW;
+			// TODO: render clipped text with "..." at end ?, allthough this is very low prio since in practice should never happen
 		}
-		fl_pop_clip();
-		return;
 
-	case CONTEXT_ENDPAGE:
-	case CONTEXT_RC_RESIZE:
-	case CONTEXT_RC_RESIZED:
-	case CONTEXT_NONE:
-	case CONTEXT_TABLE:
-		return;
+		lw += margin;
+
+		size(lw, H);
 	}
-}
+};
 
-void Fl_FM_List::OnCallback()
+
+//
+// FM_Ellipsis_Label
+//
+
+class FM_Ellipsis_Label : public Fl_Box
 {
-	int /*R = callback_row(),*/ Ci = callback_col();
-	int C = s_column_idx[Ci];
+public:
+	FM_Ellipsis_Label(int X, int Y, int H)
+		: Fl_Box(X,Y,1,1,"...")
+	{
+		box(FL_NO_BOX);
+		labelfont(FL_HELVETICA_BOLD);
+		labelsize(14);
 
-	TableContext context = callback_context();
+		// auto-size
+		int lw = 0, lh = 0;
+		fl_font(labelfont(), labelsize());
+		fl_measure(label(), lw, lh);
+		size(lw, H);
+	}
+};
 
-	switch (context)
+
+//
+// FM_TagFilter_Group
+//
+
+class Fl_FM_TagFilter_Group : public Fl_Group
+{
+protected:
+	enum
 	{
-	case CONTEXT_COL_HEADER:
-		if (Fl::event() == FL_RELEASE && Fl::event_button() == 1)
-		{
-			int sortid = s_columns[C].sortid;
-			if (sortid == SORT_None)
-				break;
+		BORDER_WIDTH = 3,	// border margin (on one side)
+		BUTTON_SPACING = 4,	// spacing between tag buttons
+		BUTTON_HEIGHT = 17,
+		ROW_SPACING = 3,
+	};
 
-			// check for pseudo column "Rating"
-			if (!C)
-			{
-				const int X = pFMList->x();
-				const int W = pFMList->col_width(Ci);
-				if (Fl::event_x() >= (X+W-(5*16)-2))
-					sortid = SORT_Rating;
-			}
+	// this widget can also be used to edit tags for an FMEntry
+	BOOL m_bTagEdit;
 
-			if (sortid == abs(g_cfg.sortmode))
-			{
-				// flip sort order
-				g_cfg.SetSortMode(-g_cfg.sortmode);
-			}
-			else
-			{
-				g_cfg.SetSortMode(sortid);
-			}
-		}
-		break;
+protected:
+	static void addtag_cb(Fl_Widget *, void *p) { ((Fl_FM_TagFilter_Group*)p)->OnAddTagFilter(); }
 
-	case CONTEXT_CELL:
-		OnListSelChange( selected() );
-		break;
+	virtual BOOL IsTagAdded(const char *tag) const
+	{
+		return IsTagInFilterList(tag);
+	}
 
-	case CONTEXT_RC_RESIZED:
-		refresh_formatting();
-		break;
+	virtual BOOL HasTags() const { return FALSE; }
 
-	case CONTEXT_STARTPAGE:
-	case CONTEXT_ENDPAGE:
-	case CONTEXT_ROW_HEADER:
-	case CONTEXT_TABLE:
-	case CONTEXT_RC_RESIZE:
-	case CONTEXT_NONE:
-		break;
-	}
-}
+	virtual void OnClickLink(const char *link)
+	{
+		int op = FOP_OR;
+		if (Fl::event_state() & FL_SHIFT)
+			op = FOP_AND;
+		else if (Fl::event_state() & (FL_ALT|FL_CTRL))
+			op = FOP_NOT;
 
+		if ( !strcmp(link, "*") )
+			// special reset "command"
+			g_cfg.ResetTagFilters();
+		else
+			AddTagFilter(link, op);
 
-static FMEntry* GetCurSelFM()
-{
-	return pFMList->selected();
-}
+		OnFilterChanged();
+	}
 
-static void RefreshListControl(FMEntry *pPrevSel, BOOL bOnlyChangedOrder)
-{
-	if (bOnlyChangedOrder)
-		pFMList->refresh_order(pPrevSel);
-	else
-		pFMList->refresh(pPrevSel);
-}
+public:
+	Fl_FM_TagFilter_Group(int X, int Y, int W, int H,const char *l=0)
+		: Fl_Group(X,Y,W,H,l)
+	{
+		m_bTagEdit = FALSE;
 
-static void RefreshListControlRowSize()
-{
-	pFMList->refresh_rowsize();
-	pFMList->redraw();
-}
+		end();
+		resizable(NULL);
+	}
 
-static void RedrawListControl(BOOL bUpdateButtons)
-{
-	pFMList->redraw();
+	void init()
+	{
+		Fl_AddTagFilter_Button *o = new Fl_AddTagFilter_Button(x()+BORDER_WIDTH, y()+BORDER_WIDTH, m_bTagEdit);
+		o->callback(addtag_cb, this);
+		add(o);
 
-	if (bUpdateButtons)
-		OnListSelChange( pFMList->selected() );
-}
+		FM_Ellipsis_Label *ellipsis = new FM_Ellipsis_Label(x()+BORDER_WIDTH, y()+BORDER_WIDTH, BUTTON_HEIGHT);
+		ellipsis->hide();
+		add(ellipsis);
+	}
 
-static void SelectNeighborFM()
-{
-	// select next FM, or previous if current selection is last (called before an FM entry is removed)
+	// add tag filter from other places than the add filter popup, uses current ALT/SHIFT/CTRL key state to determine op
+	void ExternalFilterAdd(const char *tag)
+	{
+		OnClickLink(tag);
+	}
 
-	FMEntry *fm = pFMList->selected();
-	if (!fm)
-		return;
+	void OnAddTagFilter()
+	{
+		int X = x() + 10;
+		int Y = y() + child(0)->h() + 10;
+		int W = w() - 40;
+		int H = (m_bTagEdit ? std::max(pMainWnd->h(), ((Fl_Widget*)pTagEdWnd)->h()) : pMainWnd->h()) - Y - 20;
 
-	int i = GetFilteredDbIndex(fm);
-	if (i < 0)
-		return;
+		const int MAX_W = g_cfg.bLargeFont ? 770 : 630;
+		const int MAX_H = g_cfg.bLargeFont ? 980 : 800;
 
-	if (g_dbFiltered.size() <= 1)
-		return;
+		if (W >= MAX_W)
+			W = MAX_W;
+		if (H >= MAX_H)
+			H = MAX_H;
 
-	if (!i || i < ((int)g_dbFiltered.size()-1))
-		// select next
-		fm = g_dbFiltered[i+1];
-	else if (i > 0)
-		// select previous
-		fm = g_dbFiltered[i-1];
+		string html = GenerateHtml();
 
-	pFMList->select(fm);
-	OnListSelChange(fm);
-}
+		if ( html.empty() )
+			return;
 
+		const char *link = Fl_FM_Html_Popup::popup(X, Y, W, H, html.c_str());
+		if (!link)
+			return;
 
-//
-// FM_Link_Button
-//
+		// strip leading slash (used to trick Fl_Html_View into delivering the link as-is to the callback)
+		ASSERT(link[0] == '/');
+		link++;
 
-class Fl_Link_Button : public Fl_Button
-{
-protected:
-	Fl_Color m_hoverclr;
-	int m_underlineY;
-	int m_underlineW;
+		OnClickLink(link);
+	}
 
-protected:
-	virtual void draw()
+	// remove handler called when clicking X on a filter button
+	virtual void OnTagFilterRemove(const char *tagfilter)
 	{
-		if (type() == FL_HIDDEN_BUTTON) return;
-		draw_box(box(), parent()->color());
-
-		int clr = labelcolor();
-		if (Fl::belowmouse() == this)
-			labelcolor(m_hoverclr);
+		ASSERT(tagfilter != NULL);
 
-		draw_label(x(), y(), w(), h());
-		// underline
-		fl_xyline(x(), y()+m_underlineY+2-fl_descent(), x()+m_underlineW);
+		RemoveTagFilter(tagfilter);
 
-		labelcolor(clr);
-		if (Fl::focus() == this) draw_focus();
+		OnFilterChanged();
 	}
 
-	virtual int handle(int e)
+	virtual void OnFilterChanged()
 	{
-		switch (e)
+		// delete any existing tag buttons (the first button is our Add button and second the ellipsis label)
+		while (children() > 2)
 		{
-		case FL_ENTER:
-			fl_cursor(FL_CURSOR_HAND);
-			redraw();
-			break;
-		case FL_LEAVE:
-			fl_cursor(FL_CURSOR_DEFAULT);
-			redraw();
-			break;
+			Fl_Widget *o = child(2);
+			remove(o);
+			delete o;
 		}
 
-		return Fl_Button::handle(e);
-	}
+		const int maxw = w() - BORDER_WIDTH*2;
 
-	void autosize_to_label()
-	{
-		// auto-size
-		int lw = 0, lh = 0;
-		fl_font(labelfont(), labelsize());
-		fl_measure(label(), lw, lh);
-		m_underlineY = lh;
-		m_underlineW = lw;
-		size(lw, lh+2);
+		// create all tag buttons (their placement will be updated after)
+		for (int j=0; j<FOP_NUM_OPS; j++)
+			for (int i=0; i<(int)g_cfg.tagFilterList[j].size(); i++)
+				insert(*new Fl_FM_TagFilter_Button(x(), y(), BUTTON_HEIGHT, g_cfg.tagFilterList[j][i], j, maxw), children());
+
+		RearrangeButtons();
 	}
 
-public:
-	Fl_Link_Button(int X, int Y, const char *l,
-		Fl_Color clr = fl_themed_rgb_color(50,90,200), Fl_Color hoverclr = fl_themed_rgb_color(30,50,80),
-		Fl_Font font = FL_HELVETICA_BOLD, int fontsize = FL_NORMAL_SIZE)
-		: Fl_Button(X,Y,1,1,l)
+	void RearrangeButtons()
 	{
-		box(FL_FLAT_BOX);
-		down_box(FL_FLAT_BOX);
-		labelfont(font);
-		labelsize(fontsize);
-		labelcolor(clr);
-		align(FL_ALIGN_TOP_LEFT | FL_ALIGN_INSIDE);
-
-		m_hoverclr = hoverclr;
+		const int maxw = w() - BORDER_WIDTH*2;
+		const int listbottom = m_bTagEdit ? y() + h() : pFMList->y() + pFMList->h();
 
-		if (l)
-			autosize_to_label();
-	}
-};
+		int X = BORDER_WIDTH;
+		int Y = BORDER_WIDTH;
+		int rows = 1;
 
+		// Fl_AddTagFilter_Button
+		X += child(0)->x() + child(0)->w() - x() + 2;
 
-//
-// Fl_AddTagFilter_Button
-//
+		const int GROUP_LIST_SPACE = 8;
+		const int MIN_LIST_HEIGHT = 160;
+		const int max_group_bottom = m_bTagEdit ? listbottom : ((listbottom - MIN_LIST_HEIGHT) - GROUP_LIST_SPACE);
+		const int maxrows = (((max_group_bottom - y()) - (BORDER_WIDTH * 2 + BUTTON_HEIGHT)) / (BUTTON_HEIGHT + ROW_SPACING)) + 1;
 
-class Fl_AddTagFilter_Button : public Fl_Link_Button
-{
-	string m_label;
+		// hide ellipsis
+		Fl_Widget *ellipsis = child(1);
+		ellipsis->clear_visible();
 
-public:
-	Fl_AddTagFilter_Button(int X, int Y, BOOL bNoFilter = FALSE)
-		: Fl_Link_Button(X,Y,NULL,fl_themed_rgb_color(50,90,200),fl_themed_rgb_color(30,50,80),FL_HELVETICA_BOLD,FL_NORMAL_SIZE)
-	{
-		m_label = bNoFilter ? $("Add Tag") : $("Add Tag Filter");
+		const int n = children() - 2;
+		for (int i=0; i<n; i++)
+		{
+			Fl_Widget *o = child(i+2);
 
-		// underline width (excludes " »")
-		fl_font(labelfont(), labelsize());
-		const int underlineW = (int)fl_width( m_label.c_str() ) - 1;
+			o->set_visible();
 
-		// append " »" to label
-		m_label += " »";
-		label( m_label.c_str() );
-		autosize_to_label();
+			// check if button fits on current row
+			if ((X + o->w()) > maxw)
+			{
+				if (rows >= maxrows)
+				{
+					// can't fit any more controls, add "..." label
 
-		m_underlineW = underlineW;
+					// hide  remaining buttons that don't fit
+					for (; i<n; i++)
+						child(i+2)->clear_visible();
+					o = child(i+1);
 
-		tooltip(bNoFilter ? $("Select a tag from list to add") : $("Select a tag from list to add to tag filters"));
-	}
-};
+					// show ellipsis
+					ellipsis->position(x()+X+BUTTON_SPACING, y()+Y);
+					ellipsis->set_visible();
 
+					// check if ellipsis fits after the last fitting button, if not then delete than one too
+					if (ellipsis->x()+ellipsis->w() > x()+w()-BORDER_WIDTH)
+					{
+						ellipsis->position(o->x(), ellipsis->y());
+						child(i+1)->clear_visible();
+					}
 
-//
-// FM_Html_Popup
-//
+					break;
+				}
+				rows++;
+				Y += BUTTON_HEIGHT + ROW_SPACING;
+				X = BORDER_WIDTH;
+			}
 
-class Fl_FM_Html_Popup : public Fl_Double_Window
-{
-protected:
-	BOOL m_bDone;
-	BOOL m_bClickedLink;
-	Fl_Widget *m_pushed;
+			o->position(x() + X, y() + Y);
 
-	static char s_retlink[256];
+			X += o->w() + BUTTON_SPACING;
+		}
 
-protected:
-	virtual int handle(int e)
-	{
-		switch (e)
+		if (!m_bTagEdit)
 		{
-		case FL_KEYBOARD:
-			switch ( Fl::event_key() )
-			{
-			case FL_Escape:
-				m_bDone = TRUE;
-				return 1;
-			}
-			break;
-
-		case FL_PUSH:
-			if (m_bDone)
-				return 1;
-			{
-			// close if clicked outside of popup
-			int mx = Fl::event_x_root();
-			int my = Fl::event_y_root();
-			if (mx < x_root() || mx >= x_root()+w() || my < y_root() || my >= y_root()+h())
+			int newh = BORDER_WIDTH * 2 + BUTTON_HEIGHT + (rows - 1) * (BUTTON_HEIGHT + ROW_SPACING);
+			if (newh != h())
 			{
-				m_bDone = TRUE;
-				return 1;
-			}
-			}
-			// workaround for release events not reaching child widgets (ie scrollbar buttons) when grab is enabled
-			e = Fl_Double_Window::handle(e);
-			m_pushed = Fl::pushed();
-			if (m_pushed == child(0))
-				m_pushed = NULL;
-			return e;
+				Fl_Group::resize(x(), y(), w(), newh);
 
-		// workaround for release events not reaching child widgets (ie scrollbar buttons) when grab is enabled
-		case FL_RELEASE:
-			if (m_pushed && !Fl::pushed())
-			{
-				m_pushed->handle(e);
-				m_pushed = NULL;
-				return 1;
+				const int newy = y() + h() + GROUP_LIST_SPACE;
+				pFMList->resize(pFMList->x(), newy, pFMList->w(), listbottom - newy);
 			}
-			m_pushed = NULL;
-			break;
 		}
 
-		return Fl_Double_Window::handle(e);
+		parent()->redraw();
 	}
 
-	static const char *link_cb(Fl_Widget *o, const char *url)
+	virtual void resize(int xx, int yy, int ww, int hh)
 	{
-		Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)((Fl_Html_View*)o)->user_data2();
-		ASSERT(w != NULL);
+		Fl_Group::resize(xx, yy, ww, hh);
 
-		BOOL bClose = TRUE;
+		if ( children() )
+			RearrangeButtons();
+	}
 
-		if (w->callback() != (Fl_Callback*)default_callback)
+	string GenerateHtml()
+	{
+		string html;
+		int i, j;
+		char buff[1024];
+		char buff2[2048];
+
+		RefreshTagDb();
+
+		const int COLS = 3;
+		#define TABLE_COLS_STR "3"
+
+		// color of generic text in group/category headers
+		//#define GROUP_LABEL_CLR "#FFFFFF"
+		#define GROUP_LABEL_CLR "#87C5F0"
+		#define GROUP_LABEL_CLR_DARK "#4A86AF"
+		// color of "disabled" link for already added tags
+		#define TAG_ADDED_CLR "#74ABE2"
+		#define TAG_ADDED_CLR_DARK "#386EA1"
+		// same as above but for tag categories
+		//#define CAT_ADDED_CLR "#87C5F0"
+		#define CAT_ADDED_CLR "#9BC1DB"
+		#define CAT_ADDED_CLR_DARK "#5F839B"
+
+		const char *header;
+		string headerstr;
+		if (!m_bTagEdit)
 		{
-			bClose = ((BOOL (*)(Fl_Widget*,void*))w->callback())(o, (void*)url);
-			w->clear_changed();
+			headerstr = "<html><body bgcolor=\"";
+			headerstr.append(DARKEN_HTML() ? "#003E75\" link=\"#89A6B9\">" : "#3C78B4\" link=\"#C8E6FA\">");
+			headerstr.append(
+				"<table width=\"98%%\"><tr>"
+				"<td width=\"20%%\"><font size=\"2.7\" color=\"");
+			headerstr.append(DARKEN_HTML() ? "#000019" : "#18426C");
+			headerstr.append(
+				"\"><b>&lt;" $mid("SHIFT") "&gt; :</b> " $mid("AND filter") "</font></td>"
+				"<td width=\"2%%\"></td>"
+				"<td width=\"20%%\"><font size=\"2.7\" color=\"");
+			headerstr.append(DARKEN_HTML() ? "#000019" : "#18426C");
+			headerstr.append(
+				"\"><b>&lt;" $mid("ALT") "&gt; :</b> " $mid("NOT filter") "</font></td>"
+				"<td width=\"57%%\" align=\"right\"><b>%s</b></td>"
+				"<td width=\"1%%\"></td>"
+			"</tr></table>");
 		}
 		else
-			w->ReturnLink(url);
+		{
+			headerstr = "<html><body bgcolor=\"";
+			headerstr.append(DARKEN_HTML() ? "#003E75\" link=\"#89A6B9" : "#3C78B4\" link=\"#C8E6FA");
+			headerstr.append(
+				"\">"
+			"<table width=\"98%%\"><tr>"
+				"<td width=\"99%%\" align=\"right\"><b>%s</b></td>"
+				"<td width=\"1%%\"></td>"
+			"</tr></table>");
+		}
 
-		w->m_bDone = !!bClose;
+		header = headerstr.c_str();
 
-		return NULL;
-	}
+		const char *footer =
+			"</body></html>";
 
-	static void draw_frame(int x, int y, int w, int h, Fl_Color c)
-	{
-		fl_color(c);
-		fl_rectf(x+4, y+4, w-8, h-8);
-		fl_color(FL_FOREGROUND_COLOR);
-		fl_rect(x, y, w, h);
-		//fl_color( fl_rgb_color(130,120,115) );
-		fl_color( fl_themed_rgb_color(150,185,220) );
-		fl_rectf(x+1, y+1, w-2, 3);
-		fl_rectf(x+1, y+4, 3, h-8);
-		fl_rectf(x+w-4, y+4, 3, h-8);
-		fl_rectf(x+1, y+h-4, w-2, 3);
-	}
+		const char *table_header =
+			"<center><table width=\"98%%\">"
+				"<tr bgcolor=\"%s\">"
+					"<td colspan=\"" TABLE_COLS_STR "\">%s</td>"
+				"</tr>"
+				"<tr>";
 
-public:
-	Fl_FM_Html_Popup(int X, int Y, int W, int H)
-		: Fl_Double_Window(X,Y,W,H,0)
-	{
-		m_bDone = FALSE;
-		m_bClickedLink = FALSE;
-		m_pushed = NULL;
+		const char *table_footer =
+				"</tr>"
+			"</table></center><br>";
 
-		end();
-		set_modal();
-		clear_border();
-		box(FL_NO_BOX);
-	}
+		if (!m_bTagEdit)
+		{
+			if ( g_cfg.HasTagFilters() )
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<a color=\"%s\" href=\"/*\">%s</a>", DARKEN_HTML() ? "#948700" : "#D2C62A", $("Reset Tag Filters"));
+			else
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<font color=\"%s\">%s</font>", DARKEN_HTML() ? "#25629C" : "#629FDD", $("Reset Tag Filters"));
 
-	virtual ~Fl_FM_Html_Popup()
-	{
-		hide();
-	}
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, header, buff2);
+		}
+		else
+		{
+			if ( HasTags() )
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<a color=\"%s\" href=\"/*\">%s</a>", DARKEN_HTML() ? "#948700" : "#D2C62A" , $("Remove All Tags"));
+			else
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<font color=\"%s\">%s</font>", DARKEN_HTML() ? "#25629C" : "#629FDD", $("Remove All Tags"));
 
-	void DeferredClose()
-	{
-		m_bDone = TRUE;
-	}
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, header, buff2);
+		}
+		html.append(buff);
 
-	void ReturnLink(const char *url)
-	{
-		m_bClickedLink = TRUE;
-		strcpy_safe(s_retlink, sizeof(s_retlink), url);
-	}
+		const char *sCategory = $("Category");
+
+		// tag categories
+		for (i=0; i<(int)g_tagNameList.size();)
+		{
+			const char *cat = g_tagNameList[i];
+			ASSERT( strchr(cat,':') );
+			const int cat_len = strchr(cat,':') - cat + 1;
+
+			// determine if category should be display as a html link or not (in tag editor it's always a link,
+			// otherwise only link if not already added as a filter)
+#ifdef _WIN32
+			strncpy_s(buff, sizeof(buff), cat, cat_len);
+#else
+			memset(buff, 0, sizeof(buff));
+			strncpy(buff, cat, sizeof(buff) > (size_t)cat_len ? cat_len : sizeof(buff)-1);
+#endif
+			const int cat_fm_count = g_dbTagCountHash[KEY(buff)];
+			buff[cat_len] = '*'; buff[cat_len+1] = 0;
+			const BOOL cat_is_filtered = !m_bTagEdit && IsTagInFilterList(buff);
+			buff[cat_len-1] = 0;
+			if (!cat_is_filtered)
+			{
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s:</font> <a href=\"/%s:*\">%s</a></b> (%d)",
+					DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, sCategory, buff, $tag(buff), cat_fm_count);
+			}
+			else
+			{
+				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s:</font> </b><font color=\"%s\"><b>%s</b> (%d)</font>",
+					DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, sCategory, DARKEN_HTML() ? CAT_ADDED_CLR_DARK : CAT_ADDED_CLR, $tag(buff), cat_fm_count);
+			}
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, table_header, DARKEN_HTML() ? "#035493" : "#4C90D4" , buff2);
+			html.append(buff);
 
-	void do_popup()
-	{
-		m_bDone = FALSE;
-		m_bClickedLink = FALSE;
+			// count number of tags in current category
+			int num_in_cat = 1;
+			for (j=i+1; j<(int)g_tagNameList.size() && !strncasecmp_utf_b(g_tagNameList[j],cat,cat_len); j++, num_in_cat++);
 
-		fl_cursor(FL_CURSOR_DEFAULT);
+			const int ROWS = (num_in_cat + (COLS-1)) / COLS;
 
-		show();
+			// add (3 columns of) tags in current category
+			for (j=0; j<3; j++)
+			{
+				html.append(j ? "<td width=\"33%\">" : "<td width=\"34%\">");
+				for (int k=0; k<ROWS && num_in_cat; i++, k++, num_in_cat--)
+				{
+					if ( !IsTagAdded(g_tagNameList[i]) )
+					{
+						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b><a href=\"/%s\">%s</a></b> (%d)<br>",
+							g_tagNameList[i], $tag(g_tagNameList[i]+cat_len), g_dbTagCountHash[KEY(g_tagNameList[i])]);
+					}
+					else
+					{
+						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<font color=\"%s\"><b>%s</b> (%d)<font><br>",
+							DARKEN_HTML() ? TAG_ADDED_CLR_DARK : TAG_ADDED_CLR, $tag(g_tagNameList[i]+cat_len), g_dbTagCountHash[KEY(g_tagNameList[i])]);
+					}
 
-		Fl::grab(this);
+					html.append(buff);
+				}
+				html.append("</td>");
+			}
 
-		while (!m_bDone)
-		{
-			Fl_Widget *o = Fl::readqueue();
-			if (!o) Fl::wait();
+			html.append(table_footer);
 		}
 
-		Fl::release();
-
-		hide();
-	}
-
-	// if linkcb is NULL then popup will close after clicking a link and the link name will be returned
-	// otherwise the linkcb controls when the popup closes and the return value is always NULL
-	static const char* popup(int X, int Y, int W, int H, const char *html, BOOL (*linkcb)(Fl_Html_View*, const char*) = NULL)
-	{
-		if (!html)
+		// uncategorized tags
+		if ( !g_tagNameListNoCat.empty() )
 		{
-			ASSERT(FALSE);
-			return NULL;
-		}
-
-		X += Fl::event_x_root() - Fl::event_x();
-		Y += Fl::event_y_root() - Fl::event_y();
-
-		Fl_FM_Html_Popup w(X,Y,W,H);
-
-		if (linkcb)
-			w.callback((Fl_Callback*)linkcb);
+			const int ROWS = (g_tagNameListNoCat.size() + (COLS-1)) / COLS;
 
-		Fl_Html_View *o = new Fl_Html_View(0, 0, w.w(), w.h());
-		w.resizable(o);
+			_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s</font></b>", DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, $("Misc Tags"));
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, table_header, DARKEN_HTML() ? "#035493" : "#4C90D4" , buff2);
+			html.append(buff);
 
-		o->user_data2(&w);
-		o->box(HTML_POPUP_BOX);
-		o->color( fl_themed_rgb_color(60,120,180) );
-		//o->textfont(FL_HELVETICA_BOLD);
-		o->textfont(FL_HELVETICA);
-		o->textsize(FL_NORMAL_SIZE);
-		//o->textcolor( fl_rgb_color(200,230,250) );
-		o->textcolor( fl_rgb_color(220,220,220) );
-		o->link(link_cb);
-		o->include_anchor_to_cb();
+			i = 0;
+			for (j=0; j<3; j++)
+			{
+				html.append(j ? "<td width=\"33%\">" : "<td width=\"34%\">");
+				for (int k=0; k<ROWS && i<(int)g_tagNameListNoCat.size(); i++, k++)
+				{
+					if ( !IsTagAdded(g_tagNameListNoCat[i]) )
+					{
+						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b><a href=\"/%s\">%s</a></b> (%d)<br>",
+							g_tagNameListNoCat[i], $tag(g_tagNameListNoCat[i]), g_dbTagCountHash[KEY(g_tagNameListNoCat[i])]);
+					}
+					else
+					{
+						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<font color=\"%s\"><b>%s</b> (%d)</font><br>",
+							DARKEN_HTML() ? TAG_ADDED_CLR_DARK : TAG_ADDED_CLR, $tag(g_tagNameListNoCat[i]), g_dbTagCountHash[KEY(g_tagNameListNoCat[i])]);
+					}
 
-		o->value(html);
+					html.append(buff);
+				}
+				html.append("</td>");
+			}
 
-		// shrink height to fit document if document is smaller
-		if (o->size() < o->h() - Fl::box_dh( o->box() ))
-		{
-			// bypass resize of Fl_Html_View to avoid a complete re-parse for the html code
-			o->Fl_Widget::resize(o->x(), o->y(), o->w(), o->size());
-			w.size(w.w(), o->h());
+			html.append(table_footer);
 		}
 
-		w.add(o);
+		if (g_tagNameList.empty() && g_tagNameListNoCat.empty())
+		{
+			string notags =
+			"<br><br><table width=\"98%\"><tr>"
+				"<td width=\"99%\" align=\"left\"><font color=\"";
+			notags.append(DARKEN_HTML() ? "#BEBEBE" : "#FFFFFF");
+			notags.append(
+				"\"><b>" $mid("No tags defined") ".</b></font></td>"
+				"<td width=\"1%\"></td>"
+			"</tr></table><br><br>");
 
-		w.do_popup();
+			html.append(notags);
+		}
 
-		return (linkcb || !w.m_bClickedLink) ? NULL : s_retlink;
-	}
+		html.append(footer);
 
-	static void static_init()
-	{
-		Fl::set_boxtype(HTML_POPUP_BOX, draw_frame, 4, 4, 8, 8);
+		return html;
 	}
 };
 
-char Fl_FM_Html_Popup::s_retlink[256];
+
+void Fl_FM_TagFilter_Button::OnDelete()
+{
+	((Fl_FM_TagFilter_Group*)parent())->OnTagFilterRemove( label() );
+}
 
 
 //
-// FM_TagFilter_Button
+// Fl_FM_Tag_Group
 //
 
-class Fl_FM_TagFilter_Button : public Fl_Widget
+class Fl_FM_Tag_Group : public Fl_FM_TagFilter_Group
 {
-	int m_nicelabelX;
-	string m_nicelabel;
-	string m_category;
-
-	BOOL m_bHilightedX;
+protected:
+	FMEntry *m_pFM;
+	vector<string> m_taglist;
 
 protected:
-	enum
+	virtual BOOL IsTagAdded(const char *tag) const
 	{
-		XBUTTON_WIDTH = 17,//16,
-		LABEL_MARGIN_LEFT = 4,
-		LABEL_MARGIN_RIGHT = 4,
-	};
+		for (int i=0; i<(int)m_taglist.size(); i++)
+			if ( !fl_utf_strcasecmp(m_taglist[i].c_str(), tag) )
+				return TRUE;
+		return FALSE;
+	}
 
-	virtual void draw()
+	virtual BOOL HasTags() const
 	{
-		const BOOL bFocus = (Fl::focus() == this);
-
-		fl_color( color() );
-		fl_rectf(x()+1, y()+1, w()-XBUTTON_WIDTH-1, h()-2);
-
-		// X button
-		const int X = x()+w()-XBUTTON_WIDTH;
-		const BOOL bMouseOverX = m_bHilightedX = (Fl::belowmouse() == this && Fl::event_x() >= X);
-		fl_color(bMouseOverX ? fl_themed_rgb_color(145,200,245) : fl_themed_rgb_color(130,170,200));
-		fl_rectf(X, y()+1, XBUTTON_WIDTH, h()-2);
-		imgTagX.draw(X+4, y()+4);
-
-		fl_color(bFocus ? FL_FOREGROUND_COLOR : fl_themed_rgb_color(105,135,160));
-		fl_xyline(x()+1, y(), x()+w()-2);
-		fl_xyline(x()+1, y()+h()-1, x()+w()-2);
-		fl_yxline(x(), y()+1, y()+h()-2);
-		fl_yxline(x()+w()-1, y()+1, y()+h()-2);
+		return !m_taglist.empty();
+	}
 
-		fl_yxline(X, y()+2, y()+h()-3);
-		fl_xyline(X-1, y()+1, X-1);
-		fl_xyline(X-1, y()+h()-2, X-1);
+	virtual void OnClickLink(const char *link)
+	{
+		if ( !strcmp(link, "*") )
+			// special reset "command"
+			m_taglist.clear();
+		else if ( strstr(link, ":*") )
+		{
+			// put category in input field (like tag presets does)
 
-		fl_color(FL_FOREGROUND_COLOR);
-		fl_font(labelfont(), labelsize());
-		fl_draw(m_nicelabel.c_str(),
-			x()+LABEL_MARGIN_LEFT+m_nicelabelX, y()+2,
-			w()-XBUTTON_WIDTH-(LABEL_MARGIN_LEFT+LABEL_MARGIN_RIGHT)-m_nicelabelX, h()-4,
-			(Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_INSIDE|FL_ALIGN_CLIP), 0, 0);
+			const char *s = strstr(link, ":*");
+			char buf[256];
+			int n = (int)(s-link+1);
+			memcpy(buf, link, n);
+			buf[n] = 0;
 
-		if ( !m_category.empty() )
-		{
-			fl_color( fl_themed_rgb_color(95,95,100) );
-			fl_draw(m_category.c_str(),
-				x()+LABEL_MARGIN_LEFT, y()+2,
-				w()-XBUTTON_WIDTH-(LABEL_MARGIN_LEFT+LABEL_MARGIN_RIGHT), h()-4,
-				(Fl_Align)(FL_ALIGN_LEFT|FL_ALIGN_INSIDE|FL_ALIGN_CLIP), 0, 0);
+			SetAddTagInputText(buf);
 		}
+		else
+			m_taglist.push_back(link);
+
+		OnFilterChanged();
 	}
 
 	virtual int handle(int e)
 	{
-		switch (e)
+		if ( !active() )
 		{
-		case FL_FOCUS:
-		case FL_UNFOCUS:
-			redraw();
-			return 1;
-
-		case FL_MOVE:
-			{
-			const int X = x()+w()-XBUTTON_WIDTH;
-			const BOOL bMouseOverX = (Fl::belowmouse() == this && Fl::event_x() >= X);
-			if (m_bHilightedX != bMouseOverX)
-				redraw();
-			}
-			break;
-
-		case FL_PUSH:
-			if (Fl::visible_focus() && handle(FL_FOCUS))
-				Fl::focus(this);
-			return 1;
-
-		case FL_RELEASE:
-			{
-			const int X = x()+w()-XBUTTON_WIDTH;
-			const BOOL bMouseOverX = (Fl::belowmouse() == this && Fl::event_x() >= X);
-			if (bMouseOverX)
-				OnDelete();
-			}
-			return 1;
-
-		case FL_ENTER:
-			//fl_cursor(FL_CURSOR_HAND);
-			redraw();
-			return 1;
-		case FL_LEAVE:
-			//fl_cursor(FL_CURSOR_DEFAULT);
-			redraw();
-			return 1;
-
-		case FL_KEYBOARD:
-			if (Fl::event_key() == ' ')
+			switch (e)
 			{
-				OnDelete();
-				return 1;
+			case FL_KEYBOARD:
+			case FL_MOVE:
+			case FL_DRAG:
+			case FL_PUSH:
+			case FL_RELEASE:
+				return 0;
 			}
-			break;
 		}
 
-		return Fl_Widget::handle(e);
+		return Fl_FM_TagFilter_Group::handle(e);
 	}
 
-	void OnDelete();
-
 public:
-	Fl_FM_TagFilter_Button(int X, int Y, int H, const char *l, int op, int maxW)
-		: Fl_Widget(X,Y,1,1,l)
+	Fl_FM_Tag_Group(int X, int Y, int W, int H,const char *l=0)
+		: Fl_FM_TagFilter_Group(X,Y,W,H,l)
 	{
-		m_bHilightedX = FALSE;
+		m_bTagEdit = TRUE;
+		m_pFM = NULL;
+	}
 
-		box(FL_FLAT_BOX);
-		switch (op)
-		{
-		case FOP_AND: color( fl_themed_rgb_color(205,220,205) ); break;
-		case FOP_NOT: color( fl_themed_rgb_color(220,205,205) ); break;
-		default:
-			color( fl_themed_rgb_color(205,210,220) );
-		}
-		labelfont(FL_HELVETICA);
-		labelsize(FL_NORMAL_SIZE);
-		set_visible_focus();
+	void init(FMEntry *fm)
+	{
+		ASSERT(fm != NULL);
+		m_pFM = fm;
 
-		const int margin = XBUTTON_WIDTH + LABEL_MARGIN_LEFT + LABEL_MARGIN_RIGHT;
+		// make copy of tag list (so edit can be cancelled)
+		m_taglist.clear();
+		m_taglist.reserve( m_pFM->taglist.size() );
+		for (int i=0; i<(int)m_pFM->taglist.size(); i++)
+			m_taglist.push_back(m_pFM->taglist[i]);
 
-		m_nicelabelX = 0;
-		// make label a bit more display friendly (and localized)
-		const char *colon = strchr(l, ':');
-		if (colon)
-		{
-			*(char*)colon = 0;
-			m_category = $tag(l);
-			*(char*)colon = ':';
-			m_category += ":";
-			// don't run "*" through localization, it's a reserved wildcard tag
-			m_nicelabel = (colon[1]=='*' && !colon[2]) ? (colon+1) : $tag(colon+1);
-		}
-		else
-			m_nicelabel = $tag(l);
+		Fl_FM_TagFilter_Group::init();
 
-		maxW -= margin;
+		OnFilterChanged();
+	}
 
-		// auto-size
-		int lw = 0, lh = 0;
-		fl_font(labelfont(), labelsize());
-		if (colon)
-		{
-			fl_measure(m_category.c_str(), lw, lh);
-			m_nicelabelX = lw + 2;
-			lw = lh = 0;
-			fl_measure(m_nicelabel.c_str(), lw, lh);
-			lw += m_nicelabelX;
-		}
-		else
-			fl_measure(m_nicelabel.c_str(), lw, lh);
-		if (lw > maxW)
+	virtual void OnTagFilterRemove(const char *tag)
+	{
+		ASSERT(tag != NULL);
+
+		for (int i=0; i<(int)m_taglist.size(); i++)
+			if ( !fl_utf_strcasecmp(m_taglist[i].c_str(), tag) )
+			{
+				m_taglist.erase(m_taglist.begin() + i);
+				OnFilterChanged();
+				break;
+			}
+	}
+
+	virtual void OnFilterChanged()
+	{
+		// delete any existing tag buttons (the first button is our Add button and second the ellipsis label)
+		while (children() > 2)
 		{
-			lw = maxW;
-			// TODO: render clipped text with "..." at end ?, allthough this is very low prio since in practice should never happen
+			Fl_Widget *o = child(2);
+			remove(o);
+			delete o;
 		}
 
-		lw += margin;
+		const int maxw = w() - BORDER_WIDTH*2;
 
-		size(lw, H);
+		// create all tag buttons (their placement will be updated after)
+		for (int i=0; i<(int)m_taglist.size(); i++)
+			insert(*new Fl_FM_TagFilter_Button(x(), y(), BUTTON_HEIGHT, m_taglist[i].c_str(), 0, maxw), children());
+
+		RearrangeButtons();
 	}
-};
 
+	void add_custom_tag(const char *tag)
+	{
+		if ( IsTagAdded(tag) )
+			return;
 
-//
-// FM_Ellipsis_Label
-//
+		m_taglist.push_back(tag);
 
-class FM_Ellipsis_Label : public Fl_Box
-{
-public:
-	FM_Ellipsis_Label(int X, int Y, int H)
-		: Fl_Box(X,Y,1,1,"...")
+		OnFilterChanged();
+	}
+
+	BOOL has_changes()
 	{
-		box(FL_NO_BOX);
-		labelfont(FL_HELVETICA_BOLD);
-		labelsize(14);
+		if (m_taglist.size() != m_pFM->taglist.size())
+			return TRUE;
 
-		// auto-size
-		int lw = 0, lh = 0;
-		fl_font(labelfont(), labelsize());
-		fl_measure(label(), lw, lh);
-		size(lw, H);
+		for (int i=0; i<(int)m_pFM->taglist.size(); i++)
+			if ( strcmp(m_pFM->taglist[i], m_taglist[i].c_str()) )
+				return TRUE;
+
+		return FALSE;
+	}
+
+	BOOL apply_changes()
+	{
+		if ( !has_changes() )
+			return FALSE;
+
+		string s;
+		s.reserve(2048);
+		for (int i=0; i<(int)m_taglist.size(); i++)
+		{
+			if (i)
+				s.append(",");
+			s.append( m_taglist[i].c_str() );
+		}
+
+		m_pFM->SetTags(s.empty() ? NULL : s.c_str());
+
+		return TRUE;
 	}
 };
 
 
 //
-// FM_TagFilter_Group
+// FM Description Popup
 //
 
-class Fl_FM_TagFilter_Group : public Fl_Group
+class Fl_FM_Descr_Popup : public Fl_FM_Html_Popup
 {
+public:
+	static FMEntry *s_pShowNext;
+	static vector<string> s_infoList;
+
 protected:
-	enum
+	virtual int handle(int e)
 	{
-		BORDER_WIDTH = 3,	// border margin (on one side)
-		BUTTON_SPACING = 4,	// spacing between tag buttons
-		BUTTON_HEIGHT = 17,
-		ROW_SPACING = 3,
-	};
+		switch (e)
+		{
+		// workaround for some annoying issue probably because popup is opened in response to the context menu
+		// which messes up some internal FLTK stuff so the html view never receives move message
+		case FL_MOVE:
+			if ( child(0)->handle(e) )
+				return 1;
+			break;
 
-	// this widget can also be used to edit tags for an FMEntry
-	BOOL m_bTagEdit;
+		case FL_KEYBOARD:
+			switch ( Fl::event_key() )
+			{
+			case FL_Left:
+				// go to previous FM in list
+				{
+				FMEntry *fm = pFMList->selected();
+				int n = GetFilteredDbIndex(fm);
+				if (n > 0)
+				{
+					s_pShowNext = g_dbFiltered[n-1];
+					DeferredClose();
+				}
+				}
+				return 1;
+			case FL_Right:
+				// go to next FM in list
+				{
+				FMEntry *fm = pFMList->selected();
+				int n = GetFilteredDbIndex(fm);
+				if (n < (int)g_dbFiltered.size()-1)
+				{
+					s_pShowNext = g_dbFiltered[n+1];
+					DeferredClose();
+				}
+				}
+				return 1;
+			}
+			break;
+		}
 
-protected:
-	static void addtag_cb(Fl_Widget *, void *p) { ((Fl_FM_TagFilter_Group*)p)->OnAddTagFilter(); }
+		return Fl_FM_Html_Popup::handle(e);
+	}
 
-	virtual BOOL IsTagAdded(const char *tag) const
+	static BOOL OnLink(Fl_Html_View *o, const char *url)
 	{
-		return IsTagInFilterList(tag);
-	}
+		if ( _strnicmp(url, "http", 4) )
+		{
+			Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)o->user_data2();
+			w->ReturnLink(url);
+			return TRUE;
+		}
 
-	virtual BOOL HasTags() const { return FALSE; }
+		OpenUrlWithAssociatedApp(url, g_cfg.browserApp.empty() ? NULL : g_cfg.browserApp.c_str());
 
-	virtual void OnClickLink(const char *link)
+		return FALSE;
+	}
+
+	static const char *link_cb2(Fl_Widget *o, const char *url)
 	{
-		int op = FOP_OR;
-		if (Fl::event_state() & FL_SHIFT)
-			op = FOP_AND;
-		else if (Fl::event_state() & (FL_ALT|FL_CTRL))
-			op = FOP_NOT;
+		if ( !strncmp(url, "/img/", 5) )
+			// return raw filename (ie. image file url)
+			return url+5;
+		else if ( !strncmp(url, "/info/", 6) )
+		{
+			// view info file
+			FMEntry *fm = pFMList->selected();
+			ASSERT(fm != NULL);
+			if (fm)
+			{
+				const char *filename = url[6] ? s_infoList[ atoi(url+6) ].c_str() : fm->infofile.c_str();
 
-		if ( !strcmp(link, "*") )
-			// special reset "command"
-			g_cfg.ResetTagFilters();
-		else
-			AddTagFilter(link, op);
+				ASSERT(*filename);
+				if ( !FmOpenFileWithAssociatedApp(fm, filename) )
+				{
+					fl_message_position(pMainWnd);
+					fl_alert($("Failed to view file \"%s\"."), filename);
+				}
+			}
+			return NULL;
+		}
+		else if ( !strncmp(url, "/tag/", 5) )
+		{
+			InvokeAddTagFilter(url+5);
 
-		OnFilterChanged();
-	}
+			// close summary after adding filter
+			Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)((Fl_Html_View*)o)->user_data2();
+			ASSERT(w != NULL);
+			w->DeferredClose();
 
-public:
-	Fl_FM_TagFilter_Group(int X, int Y, int W, int H,const char *l=0)
-		: Fl_Group(X,Y,W,H,l)
-	{
-		m_bTagEdit = FALSE;
+			return NULL;
+		}
 
-		end();
-		resizable(NULL);
+		return link_cb(o, url);
 	}
 
-	void init()
+	static Fl_Image* native_image_cb(const char *name)
 	{
-		Fl_AddTagFilter_Button *o = new Fl_AddTagFilter_Button(x()+BORDER_WIDTH, y()+BORDER_WIDTH, m_bTagEdit);
-		o->callback(addtag_cb, this);
-		add(o);
+		if ( !strcmp(name, "star") )
+			return &imgStar;
+		else if ( !strcmp(name, "starhalf") )
+			return &imgStarHalf;
+		else if ( !strcmp(name, "stargray") )
+			return &imgStarGray;
+		else if ( !strcmp(name, "completed") )
+			return &imgCheck;
+		else if ( !strcmp(name, "inprogress") )
+			return &imgProgress;
 
-		FM_Ellipsis_Label *ellipsis = new FM_Ellipsis_Label(x()+BORDER_WIDTH, y()+BORDER_WIDTH, BUTTON_HEIGHT);
-		ellipsis->hide();
-		add(ellipsis);
+		ASSERT(FALSE);
+		return NULL;
 	}
 
-	// add tag filter from other places than the add filter popup, uses current ALT/SHIFT/CTRL key state to determine op
-	void ExternalFilterAdd(const char *tag)
+public:
+	Fl_FM_Descr_Popup(int X, int Y, int W, int H)
+		: Fl_FM_Html_Popup(X,Y,W,H)
 	{
-		OnClickLink(tag);
 	}
 
-	void OnAddTagFilter()
+	static const char* popup(Fl_Window *parent, int W, int H, const char *html)
 	{
-		int X = x() + 10;
-		int Y = y() + child(0)->h() + 10;
-		int W = w() - 40;
-		int H = (m_bTagEdit ? std::max(pMainWnd->h(), ((Fl_Widget*)pTagEdWnd)->h()) : pMainWnd->h()) - Y - 20;
-
-		const int MAX_W = g_cfg.bLargeFont ? 770 : 630;
-		const int MAX_H = g_cfg.bLargeFont ? 980 : 800;
-
-		if (W >= MAX_W)
-			W = MAX_W;
-		if (H >= MAX_H)
-			H = MAX_H;
-
-		string html = GenerateHtml();
-
-		if ( html.empty() )
-			return;
+		if (!html)
+		{
+			ASSERT(FALSE);
+			return NULL;
+		}
 
-		const char *link = Fl_FM_Html_Popup::popup(X, Y, W, H, html.c_str());
-		if (!link)
-			return;
+		int X = parent->x();
+		int Y = parent->y();
 
-		// strip leading slash (used to trick Fl_Html_View into delivering the link as-is to the callback)
-		ASSERT(link[0] == '/');
-		link++;
+		Fl_FM_Descr_Popup w(X,Y,W,H);
 
-		OnClickLink(link);
-	}
+		w.callback((Fl_Callback*)OnLink);
 
-	// remove handler called when clicking X on a filter button
-	virtual void OnTagFilterRemove(const char *tagfilter)
-	{
-		ASSERT(tagfilter != NULL);
+		Fl_Html_View *o = new Fl_Html_View(0, 0, w.w(), w.h());
+		w.resizable(o);
 
-		RemoveTagFilter(tagfilter);
+		o->user_data2(&w);
+		o->box(HTML_POPUP_BOX);
+		o->color( fl_themed_rgb_color(60,120,180) );
+		//o->textfont(FL_HELVETICA_BOLD);
+		o->textfont(FL_HELVETICA);
+		o->textsize(FL_NORMAL_SIZE);
+		o->textcolor(DARKEN_HTML() ? fl_rgb_color(180, 180, 180) : fl_rgb_color(255,255,255));
+		o->link(link_cb2);
+		o->image_callback(native_image_cb);
+		o->include_anchor_to_cb();
 
-		OnFilterChanged();
-	}
+		o->value(html);
 
-	virtual void OnFilterChanged()
-	{
-		// delete any existing tag buttons (the first button is our Add button and second the ellipsis label)
-		while (children() > 2)
+		// shrink height to fit document if document is smaller
+		if (o->size() < o->h() - Fl::box_dh( o->box() ))
 		{
-			Fl_Widget *o = child(2);
-			remove(o);
-			delete o;
+			// bypass resize of Fl_Html_View to avoid a complete re-parse for the html code
+			o->Fl_Widget::resize(o->x(), o->y(), o->w(), o->size());
+			w.size(w.w(), o->h());
 		}
 
-		const int maxw = w() - BORDER_WIDTH*2;
+		// center to parent window
+		w.position(
+			parent->x() + ((parent->w() - w.w()) / 2),
+			parent->y() + ((parent->h() - w.h()) / 2)
+			);
 
-		// create all tag buttons (their placement will be updated after)
-		for (int j=0; j<FOP_NUM_OPS; j++)
-			for (int i=0; i<(int)g_cfg.tagFilterList[j].size(); i++)
-				insert(*new Fl_FM_TagFilter_Button(x(), y(), BUTTON_HEIGHT, g_cfg.tagFilterList[j][i], j, maxw), children());
+		w.add(o);
 
-		RearrangeButtons();
+		w.do_popup();
+
+		return w.m_bClickedLink ? s_retlink : NULL;
 	}
+};
 
-	void RearrangeButtons()
-	{
-		const int maxw = w() - BORDER_WIDTH*2;
-		const int listbottom = m_bTagEdit ? y() + h() : pFMList->y() + pFMList->h();
 
-		int X = BORDER_WIDTH;
-		int Y = BORDER_WIDTH;
-		int rows = 1;
+FMEntry *Fl_FM_Descr_Popup::s_pShowNext = NULL;
+vector<string> Fl_FM_Descr_Popup::s_infoList;
 
-		// Fl_AddTagFilter_Button
-		X += child(0)->x() + child(0)->w() - x() + 2;
 
-		const int GROUP_LIST_SPACE = 8;
-		const int MIN_LIST_HEIGHT = 160;
-		const int max_group_bottom = m_bTagEdit ? listbottom : ((listbottom - MIN_LIST_HEIGHT) - GROUP_LIST_SPACE);
-		const int maxrows = (((max_group_bottom - y()) - (BORDER_WIDTH * 2 + BUTTON_HEIGHT)) / (BUTTON_HEIGHT + ROW_SPACING)) + 1;
+//
+// FM_Text_View
+//
 
-		// hide ellipsis
-		Fl_Widget *ellipsis = child(1);
-		ellipsis->clear_visible();
+// plain text viewer for (potentially large) readme files, unlike Fl_Html_View it doesn't convert and lay out the
+// whole document up front, it only indexes the line starts and word wraps the lines that are actually displayed
 
-		const int n = children() - 2;
-		for (int i=0; i<n; i++)
-		{
-			Fl_Widget *o = child(i+2);
+class Fl_FM_Text_View : public Fl_Group
+{
+	enum
+	{
+		MARGIN = 6,
+		TAB_SIZE = 8
+	};
 
-			o->set_visible();
+	struct UrlHit
+	{
+		int x, y, w, h;
+		int start, len;
+	};
 
-			// check if button fits on current row
-			if ((X + o->w()) > maxw)
-			{
-				if (rows >= maxrows)
-				{
-					// can't fit any more controls, add "..." label
+protected:
+	// text data (owned, allocated with new[] and null terminated)
+	char *m_data;
+	int m_len;
 
-					// hide  remaining buttons that don't fit
-					for (; i<n; i++)
-						child(i+2)->clear_visible();
-					o = child(i+1);
+	// start offset of each line plus a sentinel at m_len
+	vector<int> m_lines;
+	// number of wrapped rows for each line at the current wrap width (0 = not determined yet)
+	vector<int> m_rows;
+	int m_wrapW;
+	int m_tabW;
 
-					// show ellipsis
-					ellipsis->position(x()+X+BUTTON_SPACING, y()+Y);
-					ellipsis->set_visible();
+	// scroll position (first visible line and the wrapped row within it), and first line past the visible area
+	int m_topLine;
+	int m_topRow;
+	int m_endLine;
 
-					// check if ellipsis fits after the last fitting button, if not then delete than one too
-					if (ellipsis->x()+ellipsis->w() > x()+w()-BORDER_WIDTH)
-					{
-						ellipsis->position(o->x(), ellipsis->y());
-						child(i+1)->clear_visible();
-					}
+	// last find match
+	int m_selStart;
+	int m_selLen;
 
-					break;
-				}
-				rows++;
-				Y += BUTTON_HEIGHT + ROW_SPACING;
-				X = BORDER_WIDTH;
-			}
+	// urls in the visible area (updated by draw)
+	vector<UrlHit> m_hits;
 
-			o->position(x() + X, y() + Y);
+	Fl_Scrollbar *m_scroll;
 
-			X += o->w() + BUTTON_SPACING;
-		}
+	Fl_Font m_font;
+	Fl_Fontsize m_size;
+	Fl_Color m_textcolor;
+	Fl_Color m_linkcolor;
 
-		if (!m_bTagEdit)
-		{
-			int newh = BORDER_WIDTH * 2 + BUTTON_HEIGHT + (rows - 1) * (BUTTON_HEIGHT + ROW_SPACING);
-			if (newh != h())
-			{
-				Fl_Group::resize(x(), y(), w(), newh);
+protected:
+	int NumLines() const { return (int)m_lines.size() - 1; }
 
-				const int newy = y() + h() + GROUP_LIST_SPACE;
-				pFMList->resize(pFMList->x(), newy, pFMList->w(), listbottom - newy);
-			}
-		}
+	const char* LineStart(int line) const { return m_data + m_lines[line]; }
 
-		parent()->redraw();
+	const char* LineEnd(int line) const
+	{
+		const char *s = m_data + m_lines[line];
+		const char *e = m_data + m_lines[line+1];
+		while (e > s && (e[-1] == '\n' || e[-1] == '\r'))
+			e--;
+		return e;
 	}
 
-	virtual void resize(int xx, int yy, int ww, int hh)
-	{
-		Fl_Group::resize(xx, yy, ww, hh);
+	int TextX() const { return x() + Fl::box_dx( box() ) + MARGIN; }
+	int TextY() const { return y() + Fl::box_dy( box() ) + MARGIN/2; }
+	int TextW() const { return w() - Fl::box_dw( box() ) - MARGIN*2 - m_scroll->w(); }
+	int TextH() const { return h() - Fl::box_dh( box() ) - MARGIN; }
 
-		if ( children() )
-			RearrangeButtons();
+	int VisibleRows() const
+	{
+		fl_font(m_font, m_size);
+		const int n = TextH() / fl_height();
+		return n > 0 ? n : 1;
 	}
 
-	string GenerateHtml()
+	// set up font and wrap width, flushes the cached row counts if the wrap width changed
+	void PrepareWrap()
 	{
-		string html;
-		int i, j;
-		char buff[1024];
-		char buff2[2048];
+		fl_font(m_font, m_size);
 
-		RefreshTagDb();
+		m_tabW = (int)fl_width(' ') * TAB_SIZE;
+		if (m_tabW < 1)
+			m_tabW = 1;
 
-		const int COLS = 3;
-		#define TABLE_COLS_STR "3"
+		const int W = TextW();
+		if (W != m_wrapW)
+		{
+			m_wrapW = W;
+			m_rows.assign(NumLines(), 0);
+		}
+	}
 
-		// color of generic text in group/category headers
-		//#define GROUP_LABEL_CLR "#FFFFFF"
-		#define GROUP_LABEL_CLR "#87C5F0"
-		#define GROUP_LABEL_CLR_DARK "#4A86AF"
-		// color of "disabled" link for already added tags
-		#define TAG_ADDED_CLR "#74ABE2"
-		#define TAG_ADDED_CLR_DARK "#386EA1"
-		// same as above but for tag categories
-		//#define CAT_ADDED_CLR "#87C5F0"
-		#define CAT_ADDED_CLR "#9BC1DB"
-		#define CAT_ADDED_CLR_DARK "#5F839B"
+	// find end of the wrapped row starting at 's' (never returns 's' unless s == e), prefers to break after a space
+	const char* RowEnd(const char *s, const char *e) const
+	{
+		const char *brk = NULL;
+		int xx = 0;
 
-		const char *header;
-		string headerstr;
-		if (!m_bTagEdit)
+		for (const char *p=s; p<e; )
 		{
-			headerstr = "<html><body bgcolor=\"";
-			headerstr.append(DARKEN_HTML() ? "#003E75\" link=\"#89A6B9\">" : "#3C78B4\" link=\"#C8E6FA\">");
-			headerstr.append(
-				"<table width=\"98%%\"><tr>"
-				"<td width=\"20%%\"><font size=\"2.7\" color=\"");
-			headerstr.append(DARKEN_HTML() ? "#000019" : "#18426C");
-			headerstr.append(
-				"\"><b>&lt;" $mid("SHIFT") "&gt; :</b> " $mid("AND filter") "</font></td>"
-				"<td width=\"2%%\"></td>"
-				"<td width=\"20%%\"><font size=\"2.7\" color=\"");
-			headerstr.append(DARKEN_HTML() ? "#000019" : "#18426C");
-			headerstr.append(
-				"\"><b>&lt;" $mid("ALT") "&gt; :</b> " $mid("NOT filter") "</font></td>"
-				"<td width=\"57%%\" align=\"right\"><b>%s</b></td>"
-				"<td width=\"1%%\"></td>"
-			"</tr></table>");
+			const char *q;
+			int cw;
+
+			if (*p == '\t')
+			{
+				q = p + 1;
+				cw = m_tabW - (xx % m_tabW);
+			}
+			else
+			{
+				int n = fl_utf8len1(*p);
+				if (n < 1 || p+n > e)
+					n = 1;
+				q = p + n;
+				cw = (int)fl_width(p, n);
+			}
+
+			if (xx + cw > m_wrapW && p > s)
+				return brk ? brk : p;
+
+			xx += cw;
+			if (*p == ' ' || *p == '\t')
+				brk = q;
+			p = q;
 		}
-		else
+
+		return e;
+	}
+
+	// number of wrapped rows of a line (requires PrepareWrap)
+	int RowCount(int line)
+	{
+		int &n = m_rows[line];
+		if (!n)
 		{
-			headerstr = "<html><body bgcolor=\"";
-			headerstr.append(DARKEN_HTML() ? "#003E75\" link=\"#89A6B9" : "#3C78B4\" link=\"#C8E6FA");
-			headerstr.append(
-				"\">"
-			"<table width=\"98%%\"><tr>"
-				"<td width=\"99%%\" align=\"right\"><b>%s</b></td>"
-				"<td width=\"1%%\"></td>"
-			"</tr></table>");
+			const char *s = LineStart(line);
+			const char *e = LineEnd(line);
+			do
+			{
+				s = RowEnd(s, e);
+				n++;
+			}
+			while (s < e);
 		}
+		return n;
+	}
 
-		header = headerstr.c_str();
-
-		const char *footer =
-			"</body></html>";
+	// wrapped row of 'line' that contains the text offset 'pos' (requires PrepareWrap)
+	int RowOfOffset(int line, int pos)
+	{
+		const char *s = LineStart(line);
+		const char *e = LineEnd(line);
+		const char *p = m_data + pos;
+		int row = 0;
+		for (s = RowEnd(s, e); s < e && s <= p; s = RowEnd(s, e))
+			row++;
+		return row;
+	}
 
-		const char *table_header =
-			"<center><table width=\"98%%\">"
-				"<tr bgcolor=\"%s\">"
-					"<td colspan=\"" TABLE_COLS_STR "\">%s</td>"
-				"</tr>"
-				"<tr>";
+	int LineOfOffset(int pos) const
+	{
+		return (int)(std::upper_bound(m_lines.begin(), m_lines.end(), pos) - m_lines.begin()) - 1;
+	}
 
-		const char *table_footer =
-				"</tr>"
-			"</table></center><br>";
+	// find the urls (same rules as TextToHtml) in a line, returns start/end offset pairs
+	void FindUrls(const char *s, const char *e, vector<int> &urls) const
+	{
+		urls.clear();
 
-		if (!m_bTagEdit)
+		while (s < e)
 		{
-			if ( g_cfg.HasTagFilters() )
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<a color=\"%s\" href=\"/*\">%s</a>", DARKEN_HTML() ? "#948700" : "#D2C62A", $("Reset Tag Filters"));
-			else
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<font color=\"%s\">%s</font>", DARKEN_HTML() ? "#25629C" : "#629FDD", $("Reset Tag Filters"));
+			if ((*s == 'h' || *s == 'H') && ((e-s > 7 && !_strnicmp(s, "http://", 7)) || (e-s > 8 && !_strnicmp(s, "https://", 8))))
+			{
+				const char *url = s;
 
-			_snprintf_s(buff, sizeof(buff), _TRUNCATE, header, buff2);
-		}
-		else
-		{
-			if ( HasTags() )
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<a color=\"%s\" href=\"/*\">%s</a>", DARKEN_HTML() ? "#948700" : "#D2C62A" , $("Remove All Tags"));
+				s += 7;
+				while (s < e && !isspace_(*s))
+					s++;
+				// strip any trailing punctuations from url
+				if (s[-1] == '.' || s[-1] == ',' || s[-1] == ':' || s[-1] == ';')
+					s--;
+
+				urls.push_back((int)(url - m_data));
+				urls.push_back((int)(s - m_data));
+			}
 			else
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<font color=\"%s\">%s</font>", DARKEN_HTML() ? "#25629C" : "#629FDD", $("Remove All Tags"));
+				s++;
+		}
+	}
 
-			_snprintf_s(buff, sizeof(buff), _TRUNCATE, header, buff2);
+	// draw text segment [s,e) (which contains no tabs) at xx
+	int DrawRun(const char *s, const char *e, int xx, int yy, int lh, BOOL bUrl, BOOL bSel)
+	{
+		const int n = (int)(e - s);
+		const int ww = (int)fl_width(s, n);
+
+		if (bSel)
+		{
+			fl_color( selection_color() );
+			fl_rectf(xx, yy, ww, lh);
 		}
-		html.append(buff);
 
-		const char *sCategory = $("Category");
+		fl_color(bSel ? fl_contrast(m_textcolor, selection_color()) : (bUrl ? m_linkcolor : m_textcolor));
+		fl_draw(s, n, xx, yy + lh - fl_descent());
 
-		// tag categories
-		for (i=0; i<(int)g_tagNameList.size();)
+		if (bUrl)
 		{
-			const char *cat = g_tagNameList[i];
-			ASSERT( strchr(cat,':') );
-			const int cat_len = strchr(cat,':') - cat + 1;
+			fl_xyline(xx, yy + lh - fl_descent() + 1, xx + ww - 1);
 
-			// determine if category should be display as a html link or not (in tag editor it's always a link,
-			// otherwise only link if not already added as a filter)
-#ifdef _WIN32
-			strncpy_s(buff, sizeof(buff), cat, cat_len);
-#else
-			memset(buff, 0, sizeof(buff));
-			strncpy(buff, cat, sizeof(buff) > (size_t)cat_len ? cat_len : sizeof(buff)-1);
-#endif
-			const int cat_fm_count = g_dbTagCountHash[KEY(buff)];
-			buff[cat_len] = '*'; buff[cat_len+1] = 0;
-			const BOOL cat_is_filtered = !m_bTagEdit && IsTagInFilterList(buff);
-			buff[cat_len-1] = 0;
-			if (!cat_is_filtered)
+			UrlHit hit = { xx, yy, ww, lh, (int)(s - m_data), n };
+			// merge with preceding part of the same url (ie. when split by find selection)
+			if ( !m_hits.empty() && m_hits.back().y == yy && m_hits.back().start + m_hits.back().len == hit.start
+				&& m_hits.back().x + m_hits.back().w == xx )
 			{
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s:</font> <a href=\"/%s:*\">%s</a></b> (%d)",
-					DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, sCategory, buff, $tag(buff), cat_fm_count);
+				m_hits.back().w += ww;
+				m_hits.back().len += n;
 			}
 			else
+				m_hits.push_back(hit);
+		}
+
+		return ww;
+	}
+
+	void DrawRow(const char *s, const char *e, int yy, int lh, const vector<int> &urls)
+	{
+		const int X = TextX();
+		const int selEnd = m_selStart + m_selLen;
+		int xx = 0;
+
+		while (s < e)
+		{
+			if (*s == '\t')
 			{
-				_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s:</font> </b><font color=\"%s\"><b>%s</b> (%d)</font>",
-					DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, sCategory, DARKEN_HTML() ? CAT_ADDED_CLR_DARK : CAT_ADDED_CLR, $tag(buff), cat_fm_count);
+				xx += m_tabW - (xx % m_tabW);
+				s++;
+				continue;
 			}
-			_snprintf_s(buff, sizeof(buff), _TRUNCATE, table_header, DARKEN_HTML() ? "#035493" : "#4C90D4" , buff2);
-			html.append(buff);
 
-			// count number of tags in current category
-			int num_in_cat = 1;
-			for (j=i+1; j<(int)g_tagNameList.size() && !strncasecmp_utf_b(g_tagNameList[j],cat,cat_len); j++, num_in_cat++);
+			const int pos = (int)(s - m_data);
 
-			const int ROWS = (num_in_cat + (COLS-1)) / COLS;
+			// end of run at next tab, url or selection boundary
+			const char *r = (const char*)memchr(s, '\t', e - s);
+			if (!r)
+				r = e;
 
-			// add (3 columns of) tags in current category
-			for (j=0; j<3; j++)
-			{
-				html.append(j ? "<td width=\"33%\">" : "<td width=\"34%\">");
-				for (int k=0; k<ROWS && num_in_cat; i++, k++, num_in_cat--)
+			BOOL bUrl = FALSE;
+			for (int i=0; i<(int)urls.size(); i+=2)
+				if (pos < urls[i+1])
 				{
-					if ( !IsTagAdded(g_tagNameList[i]) )
+					if (pos >= urls[i])
 					{
-						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b><a href=\"/%s\">%s</a></b> (%d)<br>",
-							g_tagNameList[i], $tag(g_tagNameList[i]+cat_len), g_dbTagCountHash[KEY(g_tagNameList[i])]);
+						bUrl = TRUE;
+						r = std::min(r, (const char*)m_data + urls[i+1]);
 					}
 					else
-					{
-						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<font color=\"%s\"><b>%s</b> (%d)<font><br>",
-							DARKEN_HTML() ? TAG_ADDED_CLR_DARK : TAG_ADDED_CLR, $tag(g_tagNameList[i]+cat_len), g_dbTagCountHash[KEY(g_tagNameList[i])]);
-					}
+						r = std::min(r, (const char*)m_data + urls[i]);
+					break;
+				}
 
-					html.append(buff);
+			BOOL bSel = FALSE;
+			if (m_selLen)
+			{
+				if (pos >= m_selStart && pos < selEnd)
+				{
+					bSel = TRUE;
+					r = std::min(r, (const char*)m_data + selEnd);
 				}
-				html.append("</td>");
+				else if (pos < m_selStart)
+					r = std::min(r, (const char*)m_data + m_selStart);
 			}
 
-			html.append(table_footer);
+			xx += DrawRun(s, r, X + xx, yy, lh, bUrl, bSel);
+			s = r;
 		}
+	}
 
-		// uncategorized tags
-		if ( !g_tagNameListNoCat.empty() )
-		{
-			const int ROWS = (g_tagNameListNoCat.size() + (COLS-1)) / COLS;
+	// scroll position of the last page (so that the last line ends at the bottom)
+	void GetMaxTop(int &line, int &row)
+	{
+		int rows = VisibleRows();
 
-			_snprintf_s(buff2, sizeof(buff2), _TRUNCATE, "<b><font color=\"%s\">%s</font></b>", DARKEN_HTML() ? GROUP_LABEL_CLR_DARK : GROUP_LABEL_CLR, $("Misc Tags"));
-			_snprintf_s(buff, sizeof(buff), _TRUNCATE, table_header, DARKEN_HTML() ? "#035493" : "#4C90D4" , buff2);
-			html.append(buff);
+		PrepareWrap();
 
-			i = 0;
-			for (j=0; j<3; j++)
+		for (line=NumLines()-1; line>=0; line--)
+		{
+			const int n = RowCount(line);
+			if (n >= rows)
 			{
-				html.append(j ? "<td width=\"33%\">" : "<td width=\"34%\">");
-				for (int k=0; k<ROWS && i<(int)g_tagNameListNoCat.size(); i++, k++)
-				{
-					if ( !IsTagAdded(g_tagNameListNoCat[i]) )
-					{
-						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b><a href=\"/%s\">%s</a></b> (%d)<br>",
-							g_tagNameListNoCat[i], $tag(g_tagNameListNoCat[i]), g_dbTagCountHash[KEY(g_tagNameListNoCat[i])]);
-					}
-					else
-					{
-						_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<font color=\"%s\"><b>%s</b> (%d)</font><br>",
-							DARKEN_HTML() ? TAG_ADDED_CLR_DARK : TAG_ADDED_CLR, $tag(g_tagNameListNoCat[i]), g_dbTagCountHash[KEY(g_tagNameListNoCat[i])]);
-					}
-
-					html.append(buff);
-				}
-				html.append("</td>");
+				row = n - rows;
+				return;
 			}
-
-			html.append(table_footer);
+			rows -= n;
 		}
 
-		if (g_tagNameList.empty() && g_tagNameListNoCat.empty())
-		{
-			string notags =
-			"<br><br><table width=\"98%\"><tr>"
-				"<td width=\"99%\" align=\"left\"><font color=\"";
-			notags.append(DARKEN_HTML() ? "#BEBEBE" : "#FFFFFF");
-			notags.append(
-				"\"><b>" $mid("No tags defined") ".</b></font></td>"
-				"<td width=\"1%\"></td>"
-			"</tr></table><br><br>");
+		line = 0;
+		row = 0;
+	}
 
-			html.append(notags);
+	void ClampTop()
+	{
+		if (!NumLines())
+		{
+			m_topLine = m_topRow = 0;
+			return;
 		}
 
-		html.append(footer);
+		int maxLine, maxRow;
+		GetMaxTop(maxLine, maxRow);
 
-		return html;
+		if (m_topLine > maxLine || (m_topLine == maxLine && m_topRow > maxRow))
+		{
+			m_topLine = maxLine;
+			m_topRow = maxRow;
+		}
+		else if (m_topLine < 0)
+			m_topLine = m_topRow = 0;
+		else if (m_topRow >= RowCount(m_topLine))
+			m_topRow = RowCount(m_topLine) - 1;
 	}
-};
-
 
-void Fl_FM_TagFilter_Button::OnDelete()
-{
-	((Fl_FM_TagFilter_Group*)parent())->OnTagFilterRemove( label() );
-}
+	void UpdateScrollbar()
+	{
+		const int vis = std::min(VisibleRows(), std::max(NumLines(), 1));
+		m_scroll->value(m_topLine, vis, 0, std::max(NumLines(), 1));
+	}
 
+	int HitTest(int mx, int my) const
+	{
+		for (int i=0; i<(int)m_hits.size(); i++)
+		{
+			const UrlHit &h = m_hits[i];
+			if (mx >= h.x && mx < h.x+h.w && my >= h.y && my < h.y+h.h)
+				return i;
+		}
+		return -1;
+	}
 
-//
-// Fl_FM_Tag_Group
-//
+	void OpenHit(int i)
+	{
+		const UrlHit &h = m_hits[i];
 
-class Fl_FM_Tag_Group : public Fl_FM_TagFilter_Group
-{
-protected:
-	FMEntry *m_pFM;
-	vector<string> m_taglist;
+		// a url may be split into several hits when it's wrapped, find the start of the whole url
+		vector<int> urls;
+		const int line = LineOfOffset(h.start);
+		FindUrls(LineStart(line), LineEnd(line), urls);
+		for (int j=0; j<(int)urls.size(); j+=2)
+			if (h.start >= urls[j] && h.start < urls[j+1])
+			{
+				string url(m_data + urls[j], urls[j+1] - urls[j]);
+				OpenUrlWithAssociatedApp(url.c_str(), g_cfg.browserApp.empty() ? NULL : g_cfg.browserApp.c_str());
+				break;
+			}
+	}
 
-protected:
-	virtual BOOL IsTagAdded(const char *tag) const
+	static void scroll_cb(Fl_Scrollbar *o, void *p)
 	{
-		for (int i=0; i<(int)m_taglist.size(); i++)
-			if ( !fl_utf_strcasecmp(m_taglist[i].c_str(), tag) )
-				return TRUE;
-		return FALSE;
+		Fl_FM_Text_View *v = (Fl_FM_Text_View*)p;
+		v->m_topLine = o->value();
+		v->m_topRow = 0;
+		v->ClampTop();
+		v->redraw();
 	}
 
-	virtual BOOL HasTags() const
+	virtual void draw()
 	{
-		return !m_taglist.empty();
+		if ( !(damage() & ~FL_DAMAGE_CHILD) )
+		{
+			update_child(*m_scroll);
+			return;
+		}
+
+		draw_box(box(), color());
+
+		const int X = TextX();
+		const int Y = TextY();
+		const int W = TextW();
+		const int H = TextH();
+
+		fl_push_clip(X, Y, W, H);
+
+		PrepareWrap();
+
+		const int lh = fl_height();
+		const int nlines = NumLines();
+
+		m_hits.clear();
+
+		vector<int> urls;
+		int yy = Y;
+		int line = m_topLine;
+
+		for (int row=m_topRow; line<nlines && yy<Y+H; line++, row=0)
+		{
+			const char *s = LineStart(line);
+			const char *e = LineEnd(line);
+
+			FindUrls(s, e, urls);
+
+			for (int i=0; i<row; i++)
+				s = RowEnd(s, e);
+
+			do
+			{
+				const char *r = RowEnd(s, e);
+				DrawRow(s, r, yy, lh, urls);
+				s = r;
+				yy += lh;
+			}
+			while (s < e && yy < Y+H);
+		}
+
+		m_endLine = line;
+
+		fl_pop_clip();
+
+		UpdateScrollbar();
+		draw_child(*m_scroll);
 	}
 
-	virtual void OnClickLink(const char *link)
+	virtual int handle(int e)
 	{
-		if ( !strcmp(link, "*") )
-			// special reset "command"
-			m_taglist.clear();
-		else if ( strstr(link, ":*") )
+		int i;
+
+		switch (e)
 		{
-			// put category in input field (like tag presets does)
+		case FL_FOCUS:
+		case FL_UNFOCUS:
+			return 1;
 
-			const char *s = strstr(link, ":*");
-			char buf[256];
-			int n = (int)(s-link+1);
-			memcpy(buf, link, n);
-			buf[n] = 0;
+		case FL_ENTER:
+		case FL_MOVE:
+			if (Fl::event_x() < m_scroll->x())
+			{
+				fl_cursor(HitTest(Fl::event_x(), Fl::event_y()) >= 0 ? FL_CURSOR_HAND : FL_CURSOR_DEFAULT);
+				return 1;
+			}
+			fl_cursor(FL_CURSOR_DEFAULT);
+			break;
 
-			SetAddTagInputText(buf);
-		}
-		else
-			m_taglist.push_back(link);
+		case FL_LEAVE:
+			fl_cursor(FL_CURSOR_DEFAULT);
+			break;
 
-		OnFilterChanged();
-	}
+		case FL_PUSH:
+			if (Fl::event_x() < m_scroll->x())
+			{
+				Fl::focus(this);
+				// open links on push, release events don't reliably arrive while the popup has grabbed events
+				i = HitTest(Fl::event_x(), Fl::event_y());
+				if (i >= 0)
+					OpenHit(i);
+				return 1;
+			}
+			break;
 
-	virtual int handle(int e)
-	{
-		if ( !active() )
-		{
-			switch (e)
+		case FL_MOUSEWHEEL:
+			if ( Fl::event_dy() )
 			{
-			case FL_KEYBOARD:
-			case FL_MOVE:
-			case FL_DRAG:
-			case FL_PUSH:
-			case FL_RELEASE:
-				return 0;
+				ScrollRows(Fl::event_dy() * 3);
+				return 1;
+			}
+			break;
+
+		case FL_KEYBOARD:
+			switch ( Fl::event_key() )
+			{
+			case FL_Up: ScrollRows(-1); return 1;
+			case FL_Down: ScrollRows(1); return 1;
+			case FL_Page_Up: ScrollRows(-(VisibleRows()-1)); return 1;
+			case FL_Page_Down: case ' ': ScrollRows(VisibleRows()-1); return 1;
+			case FL_Home: m_topLine = m_topRow = 0; redraw(); return 1;
+			case FL_End: m_topLine = NumLines(); ClampTop(); redraw(); return 1;
 			}
+			break;
 		}
 
-		return Fl_FM_TagFilter_Group::handle(e);
+		return Fl_Group::handle(e);
 	}
 
 public:
-	Fl_FM_Tag_Group(int X, int Y, int W, int H,const char *l=0)
-		: Fl_FM_TagFilter_Group(X,Y,W,H,l)
-	{
-		m_bTagEdit = TRUE;
-		m_pFM = NULL;
-	}
+	Fl_FM_Text_View(int X, int Y, int W, int H)
+		: Fl_Group(X,Y,W,H)
+	{
+		m_data = NULL;
+		m_len = 0;
+		m_wrapW = -1;
+		m_tabW = 1;
+		m_topLine = m_topRow = 0;
+		m_endLine = 0;
+		m_selStart = m_selLen = 0;
+
+		m_font = FL_COURIER;
+		m_size = FL_NORMAL_SIZE;
+		m_textcolor = FL_FOREGROUND_COLOR;
+		m_linkcolor = FL_BLUE;
 
-	void init(FMEntry *fm)
-	{
-		ASSERT(fm != NULL);
-		m_pFM = fm;
+		box(FL_FLAT_BOX);
+		color(FL_BACKGROUND2_COLOR);
+		selection_color(FL_SELECTION_COLOR);
 
-		// make copy of tag list (so edit can be cancelled)
-		m_taglist.clear();
-		m_taglist.reserve( m_pFM->taglist.size() );
-		for (int i=0; i<(int)m_pFM->taglist.size(); i++)
-			m_taglist.push_back(m_pFM->taglist[i]);
+		m_scroll = new Fl_Scrollbar(X+W-Fl::scrollbar_size(), Y, Fl::scrollbar_size(), H);
+		m_scroll->callback((Fl_Callback*)scroll_cb, this);
+		m_scroll->linesize(3);
 
-		Fl_FM_TagFilter_Group::init();
+		end();
 
-		OnFilterChanged();
+		// build an initial (empty) line index
+		value(NULL, 0);
 	}
 
-	virtual void OnTagFilterRemove(const char *tag)
+	virtual ~Fl_FM_Text_View()
 	{
-		ASSERT(tag != NULL);
+		delete[] m_data;
+	}
 
-		for (int i=0; i<(int)m_taglist.size(); i++)
-			if ( !fl_utf_strcasecmp(m_taglist[i].c_str(), tag) )
-			{
-				m_taglist.erase(m_taglist.begin() + i);
-				OnFilterChanged();
-				break;
-			}
+	virtual void resize(int X, int Y, int W, int H)
+	{
+		Fl_Widget::resize(X, Y, W, H);
+		m_scroll->resize(X+W-Fl::box_dx( box() )-Fl::scrollbar_size(), Y+Fl::box_dy( box() ), Fl::scrollbar_size(), H-Fl::box_dh( box() ));
+		// row counts are flushed by PrepareWrap when the wrap width changed
+		ClampTop();
 	}
 
-	virtual void OnFilterChanged()
+	// set text, takes ownership of 'data' (allocated with new[] and with at least one terminating null after 'len')
+	void value(char *data, int len)
 	{
-		// delete any existing tag buttons (the first button is our Add button and second the ellipsis label)
-		while (children() > 2)
+		delete[] m_data;
+
+		if (!data)
 		{
-			Fl_Widget *o = child(2);
-			remove(o);
-			delete o;
+			data = new char[1];
+			*data = 0;
+			len = 0;
 		}
 
-		const int maxw = w() - BORDER_WIDTH*2;
+		m_data = data;
+		m_len = len;
 
-		// create all tag buttons (their placement will be updated after)
-		for (int i=0; i<(int)m_taglist.size(); i++)
-			insert(*new Fl_FM_TagFilter_Button(x(), y(), BUTTON_HEIGHT, m_taglist[i].c_str(), 0, maxw), children());
+		m_lines.clear();
+		m_lines.reserve(len / 40 + 2);
+		m_lines.push_back(0);
 
-		RearrangeButtons();
-	}
+		for (const char *s=data, *e=data+len; s<e; )
+		{
+			const char *nl = (const char*)memchr(s, '\n', e - s);
+			if (!nl)
+				break;
+			s = nl + 1;
+			m_lines.push_back((int)(s - data));
+		}
 
-	void add_custom_tag(const char *tag)
-	{
-		if ( IsTagAdded(tag) )
-			return;
+		// sentinel (unless text ends with a newline, then there is no last empty line to display)
+		if (m_lines.back() != len || m_lines.size() == 1)
+			m_lines.push_back(len);
 
-		m_taglist.push_back(tag);
+		m_wrapW = -1;
+		m_topLine = m_topRow = 0;
+		m_selStart = m_selLen = 0;
+		m_hits.clear();
 
-		OnFilterChanged();
+		redraw();
 	}
 
-	BOOL has_changes()
+	void textfont(Fl_Font f) { m_font = f; m_wrapW = -1; }
+	void textsize(Fl_Fontsize s) { m_size = s; m_wrapW = -1; }
+	void textcolor(Fl_Color c) { m_textcolor = c; }
+	void linkcolor(Fl_Color c) { m_linkcolor = c; }
+
+	void ScrollRows(int n)
 	{
-		if (m_taglist.size() != m_pFM->taglist.size())
-			return TRUE;
+		if (!NumLines())
+			return;
 
-		for (int i=0; i<(int)m_pFM->taglist.size(); i++)
-			if ( strcmp(m_pFM->taglist[i], m_taglist[i].c_str()) )
-				return TRUE;
+		PrepareWrap();
 
-		return FALSE;
+		if (n > 0)
+		{
+			int maxLine, maxRow;
+			GetMaxTop(maxLine, maxRow);
+
+			while (n-- && (m_topLine < maxLine || (m_topLine == maxLine && m_topRow < maxRow)))
+				if (++m_topRow >= RowCount(m_topLine))
+				{
+					m_topLine++;
+					m_topRow = 0;
+				}
+		}
+		else
+		{
+			while (n++ && (m_topLine || m_topRow))
+				if (--m_topRow < 0)
+					m_topRow = RowCount(--m_topLine) - 1;
+		}
+
+		redraw();
 	}
 
-	BOOL apply_changes()
+	// UTF-8 case-insensitive compare of 'str' with the text at 's' (up to 'end'), returns the length of the
+	// matching text in bytes (which may differ from the length of 'str') or 0 if it doesn't match
+	static int MatchNoCase(const char *s, const char *end, const char *str)
 	{
-		if ( !has_changes() )
-			return FALSE;
+		const char *p = s;
 
-		string s;
-		s.reserve(2048);
-		for (int i=0; i<(int)m_taglist.size(); i++)
+		while (*str)
 		{
-			if (i)
-				s.append(",");
-			s.append( m_taglist[i].c_str() );
-		}
+			if (p >= end)
+				return 0;
 
-		m_pFM->SetTags(s.empty() ? NULL : s.c_str());
+			int l1, l2;
+			const unsigned int u1 = fl_utf8decode(p, end, &l1);
+			const unsigned int u2 = fl_utf8decode(str, NULL, &l2);
+			if (u1 != u2 && fl_tolower(u1) != fl_tolower(u2))
+				return 0;
 
-		return TRUE;
+			p += l1;
+			str += l2;
+		}
+
+		return (int)(p - s);
 	}
-};
 
+	// case-insensitive search for 'str', starting after the previous match (or from the top of the view when 'bRestart'
+	// is set), wraps around at end of text. the match is selected and scrolled into view, returns FALSE if not found
+	BOOL find(const char *str, BOOL bRestart = FALSE)
+	{
+		// (the match may be shorter in bytes than 'str' with case folding, so only an empty string is rejected early)
+		const int n = strlen(str);
+		if (!n || !m_len)
+		{
+			m_selStart = m_selLen = 0;
+			redraw();
+			return !n;
+		}
 
-//
-// FM Description Popup
-//
+		int start;
+		if (bRestart || !m_selLen)
+			start = NumLines() ? m_lines[m_topLine] : 0;
+		else
+			start = m_selStart + fl_utf8len1(m_data[m_selStart]);
 
-class Fl_FM_Descr_Popup : public Fl_FM_Html_Popup
-{
-public:
-	static FMEntry *s_pShowNext;
-	static vector<string> s_infoList;
+		int pos = -1;
+		int len = 0;
 
-protected:
-	virtual int handle(int e)
-	{
-		switch (e)
+		for (int pass=0; pass<2 && pos<0; pass++)
 		{
-		// workaround for some annoying issue probably because popup is opened in response to the context menu
-		// which messes up some internal FLTK stuff so the html view never receives move message
-		case FL_MOVE:
-			if ( child(0)->handle(e) )
-				return 1;
-			break;
+			const int from = pass ? 0 : start;
+			const int to = pass ? std::min(start + n - 1, m_len) : m_len;
 
-		case FL_KEYBOARD:
-			switch ( Fl::event_key() )
+			for (int i=from; i<to; )
 			{
-			case FL_Left:
-				// go to previous FM in list
-				{
-				FMEntry *fm = pFMList->selected();
-				int n = GetFilteredDbIndex(fm);
-				if (n > 0)
-				{
-					s_pShowNext = g_dbFiltered[n-1];
-					DeferredClose();
-				}
-				}
-				return 1;
-			case FL_Right:
-				// go to next FM in list
-				{
-				FMEntry *fm = pFMList->selected();
-				int n = GetFilteredDbIndex(fm);
-				if (n < (int)g_dbFiltered.size()-1)
+				if ( (len = MatchNoCase(m_data+i, m_data+to, str)) )
 				{
-					s_pShowNext = g_dbFiltered[n+1];
-					DeferredClose();
-				}
+					pos = i;
+					break;
 				}
-				return 1;
+
+				// advance by whole characters (invalid bytes are skipped one at a time)
+				i += fl_utf8len1(m_data[i]);
 			}
-			break;
 		}
 
-		return Fl_FM_Html_Popup::handle(e);
-	}
+		if (pos < 0)
+		{
+			m_selStart = m_selLen = 0;
+			redraw();
+			return FALSE;
+		}
 
-	static BOOL OnLink(Fl_Html_View *o, const char *url)
-	{
-		if ( _strnicmp(url, "http", 4) )
+		m_selStart = pos;
+		m_selLen = len;
+
+		// scroll to match if it's not (entirely) inside the visible lines
+		const int line = LineOfOffset(pos);
+		if (line < m_topLine || line >= m_endLine - 1)
 		{
-			Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)o->user_data2();
-			w->ReturnLink(url);
-			return TRUE;
+			PrepareWrap();
+
+			m_topLine = line;
+			m_topRow = RowOfOffset(line, pos);
+
+			// show a few rows of context above the match
+			ScrollRows(-3);
+			ClampTop();
 		}
 
-		OpenUrlWithAssociatedApp(url, g_cfg.browserApp.empty() ? NULL : g_cfg.browserApp.c_str());
+		redraw();
+		return TRUE;
+	}
+};
 
-		return FALSE;
+
+//
+// FM_Text_Popup
+//
+
+class Fl_FM_Text_Popup : public Fl_FM_Html_Popup
+{
+	enum
+	{
+		BORDER = 8
+	};
+
+protected:
+	Fl_FM_Text_View *m_view;
+	Fl_Input *m_find;
+
+protected:
+	void FindNext(BOOL bRestart)
+	{
+		const BOOL bFound = m_view->find(m_find->value(), bRestart);
+		m_find->color(bFound ? FL_BACKGROUND2_COLOR : fl_rgb_color(255,190,190));
+		m_find->redraw();
 	}
 
-	static const char *link_cb2(Fl_Widget *o, const char *url)
+	virtual int handle(int e)
 	{
-		if ( !strncmp(url, "/img/", 5) )
-			// return raw filename (ie. image file url)
-			return url+5;
-		else if ( !strncmp(url, "/info/", 6) )
+		if (e == FL_KEYBOARD)
 		{
-			// view info file
-			FMEntry *fm = pFMList->selected();
-			ASSERT(fm != NULL);
-			if (fm)
+			switch ( Fl::event_key() )
 			{
-				string &str = url[6] ? s_infoList[ atoi(url+6) ] : fm->infofile;
-
-				ASSERT( !str.empty() );
-				const char *filename = str.c_str();
-				if ( !FmOpenFileWithAssociatedApp(fm, filename) )
+			case FL_Enter:
+			case FL_KP_Enter:
+			case FL_F+3:
+				FindNext(FALSE);
+				return 1;
+			case 'f':
+				if ( Fl::event_state(FL_CTRL) )
 				{
-					fl_message_position(pMainWnd);
-					fl_alert($("Failed to view file \"%s\"."), filename);
+					Fl::focus(m_find);
+					m_find->insert_position(m_find->size(), 0);
+					return 1;
 				}
+				break;
+			case FL_Escape:
+				break;
+			default:
+				// keyboard events may arrive here first while the popup has grabbed events, pass them on to the focus
+				if (Fl::focus() && Fl::focus() != this && contains( Fl::focus() ) && Fl::focus()->handle(e))
+					return 1;
+				// scroll keys go to the text view even while find input has focus
+				if (Fl::focus() != m_view && ((Fl_Widget*)m_view)->handle(e))
+					return 1;
+				break;
 			}
-			return NULL;
-		}
-		else if ( !strncmp(url, "/tag/", 5) )
-		{
-			InvokeAddTagFilter(url+5);
-
-			// close summary after adding filter
-			Fl_FM_Html_Popup *w = (Fl_FM_Html_Popup*)((Fl_Html_View*)o)->user_data2();
-			ASSERT(w != NULL);
-			w->DeferredClose();
-
-			return NULL;
 		}
+		else if (e == FL_MOUSEWHEEL)
+			return ((Fl_Widget*)m_view)->handle(e);
 
-		return link_cb(o, url);
+		return Fl_FM_Html_Popup::handle(e);
 	}
 
-	static Fl_Image* native_image_cb(const char *name)
+	static void find_cb(Fl_Input *, void *p)
 	{
-		if ( !strcmp(name, "star") )
-			return &imgStar;
-		else if ( !strcmp(name, "starhalf") )
-			return &imgStarHalf;
-		else if ( !strcmp(name, "stargray") )
-			return &imgStarGray;
-		else if ( !strcmp(name, "completed") )
-			return &imgCheck;
-		else if ( !strcmp(name, "inprogress") )
-			return &imgProgress;
+		((Fl_FM_Text_Popup*)p)->FindNext(TRUE);
+	}
 
-		ASSERT(FALSE);
-		return NULL;
+	static void close_cb(Fl_Widget *, void *p)
+	{
+		((Fl_FM_Text_Popup*)p)->DeferredClose();
 	}
 
 public:
-	Fl_FM_Descr_Popup(int X, int Y, int W, int H)
+	Fl_FM_Text_Popup(int X, int Y, int W, int H)
 		: Fl_FM_Html_Popup(X,Y,W,H)
 	{
+		m_view = NULL;
+		m_find = NULL;
+
+		box(HTML_POPUP_BOX);
+		color( fl_themed_rgb_color(60,120,180) );
 	}
 
-	static const char* popup(Fl_Window *parent, int W, int H, const char *html)
+	// display a plain text file, takes ownership of 'data' (see Fl_FM_Text_View::value)
+	static void popup(Fl_Window *parent, int W, int H, const char *caption, char *data, int len)
 	{
-		if (!html)
-		{
-			ASSERT(FALSE);
-			return NULL;
-		}
-
-		int X = parent->x();
-		int Y = parent->y();
+		Fl_FM_Text_Popup w(parent->x(), parent->y(), W, H);
 
-		Fl_FM_Descr_Popup w(X,Y,W,H);
-
-		w.callback((Fl_Callback*)OnLink);
+		const int lh = FL_NORMAL_SIZE + 8;
+		const Fl_Color clrText = DARKEN_HTML() ? fl_rgb_color(180,180,180) : fl_rgb_color(255,255,255);
 
-		Fl_Html_View *o = new Fl_Html_View(0, 0, w.w(), w.h());
+		Fl_FM_Text_View *o = new Fl_FM_Text_View(BORDER, BORDER+lh, W-BORDER*2, H-BORDER*2-lh*2-4);
+		o->color( DARKEN_HTML() ? fl_rgb_color(0,62,117) : fl_rgb_color(60,120,180) );
+		o->textcolor(clrText);
+		o->linkcolor( DARKEN_HTML() ? fl_rgb_color(0xBD,0x8C,0x00) : fl_rgb_color(0xFF,0xCC,0x30) );
+		o->selection_color( DARKEN_HTML() ? fl_rgb_color(0x89,0xA6,0xB9) : fl_rgb_color(0xC8,0xE6,0xFA) );
+		o->value(data, len);
+		w.add(o);
 		w.resizable(o);
-
-		o->user_data2(&w);
-		o->box(HTML_POPUP_BOX);
-		o->color( fl_themed_rgb_color(60,120,180) );
-		//o->textfont(FL_HELVETICA_BOLD);
-		o->textfont(FL_HELVETICA);
-		o->textsize(FL_NORMAL_SIZE);
-		o->textcolor(DARKEN_HTML() ? fl_rgb_color(180, 180, 180) : fl_rgb_color(255,255,255));
-		o->link(link_cb2);
-		o->image_callback(native_image_cb);
-		o->include_anchor_to_cb();
-
-		o->value(html);
-
-		// shrink height to fit document if document is smaller
-		if (o->size() < o->h() - Fl::box_dh( o->box() ))
-		{
-			// bypass resize of Fl_Html_View to avoid a complete re-parse for the html code
-			o->Fl_Widget::resize(o->x(), o->y(), o->w(), o->size());
-			w.size(w.w(), o->h());
-		}
+		w.m_view = o;
+
+		Fl_Link_Button *close = new Fl_Link_Button(0, BORDER, $("Close"), fl_themed_rgb_color(255,204,48), fl_themed_rgb_color(255,255,255));
+		close->position(W - BORDER*2 - close->w(), BORDER + (lh - close->h())/2);
+		close->callback(close_cb, &w);
+		close->clear_visible_focus();
+		w.add(close);
+
+		Fl_Box *cap = new Fl_Box(BORDER*2, BORDER, close->x() - BORDER*3, lh, caption);
+		cap->labelfont(FL_HELVETICA_BOLD);
+		cap->labelsize(FL_NORMAL_SIZE);
+		cap->labelcolor(clrText);
+		cap->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE | FL_ALIGN_CLIP);
+		w.add(cap);
+
+		fl_font(FL_HELVETICA, FL_NORMAL_SIZE);
+		const int lw = (int)fl_width( $("Find:") ) + 8;
+
+		Fl_Input *find = new Fl_Input(BORDER*2 + lw, H - BORDER - lh, std::min(W/2, 300), lh, $("Find:"));
+		find->labelcolor(clrText);
+		find->when(FL_WHEN_CHANGED);
+		find->callback((Fl_Callback*)find_cb, &w);
+		w.add(find);
+		w.m_find = find;
 
 		// center to parent window
 		w.position(
@@ -10055,19 +14516,13 @@ public:
 			parent->y() + ((parent->h() - w.h()) / 2)
 			);
 
-		w.add(o);
+		Fl::focus(o);
 
 		w.do_popup();
-
-		return w.m_bClickedLink ? s_retlink : NULL;
 	}
 };
 
 
-FMEntry *Fl_FM_Descr_Popup::s_pShowNext = NULL;
-vector<string> Fl_FM_Descr_Popup::s_infoList;
-
-
 /*
 static void replace_all(string &s, const string &sFind, const string &sReplace)
 {
@@ -10214,20 +14669,55 @@ static void GetNiceNameFromGlml(FMEntry *fm)
 }
 #endif
 
-static string GenerateHtmlSummary(FMEntry *fm)
+#define LINK_CLR		"#FFCC30"
+#define LINK_CLR_DARK		"#BD8C00"
+#define CAT_LABEL_CLR		"#C8E6FA"
+#define CAT_LABEL_CLR_DARK	"#89A6B9"
+
+// extract fmthumb.jpg of an archived FM to a temp file named after the FM, so that the cached summaries of
+// several FMs can refer to their thumbnails at the same time
+static BOOL GetSummaryThumbFromArchive(FMEntry *fm, string &imgfile)
+{
+	string fname = fm->name;
+	fname += "_fmthumb.jpg";
+
+	if ( !GetTempFile(fname.c_str(), imgfile, FALSE) )
+		return FALSE;
+
+	const string t = g_sTempDir + imgfile;
+	const char *pErrMsg = NULL;
+
+	// already extracted by the batch in GenerateHtmlSummaryBody
+	const string *file;
+	if (FmGetBatchFile(fm, "fmthumb.jpg", file) && file)
+	{
+		FILE *f = fl_fopen(t.c_str(), "wb");
+		if (!f)
+			return FALSE;
+
+		const BOOL bOk = fwrite(file->data(), 1, file->size(), f) == file->size();
+		fclose(f);
+
+		return bOk;
+	}
+
+	if ( !ExtractFileFromArchive(fm->GetArchiveFilePath().c_str(), "fmthumb.jpg", t.c_str(), &pErrMsg) )
+	{
+		TRACE("Failed to extract fmthumb.jpg to \"%s\": %s", t.c_str(), pErrMsg ? pErrMsg : "unknown error");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// generate the part of the html summary that doesn't depend on the position of the FM in the list (everything
+// after the pager), 'infolist' receives the info file list that the "/info/<n>" links refer to
+static string GenerateHtmlSummaryBody(FMEntry *fm, vector<string> &infolist)
 {
 	string html;
 	char buff[1024];
 	int i;
 
-	#define LINK_CLR		"#FFCC30"
-	#define LINK_CLR_DARK		"#BD8C00"
-	#define CAT_LABEL_CLR		"#C8E6FA"
-	#define CAT_LABEL_CLR_DARK	"#89A6B9"
-
-	const char *preheader =
-		"<html><body bgcolor=\"%s\" link=\"%s\">";
-
 	const char *header =
 		"<table width=\"98%%\"><tr bgcolor=\"%s\">"
 			"<td width=\"89%%\"><font color=\"%s\"><b>%s</b></font></td>"
@@ -10238,32 +14728,6 @@ static string GenerateHtmlSummary(FMEntry *fm)
 	const char *footer =
 		"</body></html>";
 
-	if (DARKEN_HTML())
-		_snprintf_s(buff, sizeof(buff), _TRUNCATE, preheader, "#003E75", LINK_CLR_DARK);
-	else
-		_snprintf_s(buff, sizeof(buff), _TRUNCATE, preheader, "#3C78B4", LINK_CLR);
-
-	html.append(buff);
-
-#if 0
-	html.append("<br>");
-#else
-	const char *pager =
-		"<center><font face=\"courier\" size=\"2.7\" color=\"%s\">&lt;</font>"
-		"<font face=\"courier\" size=\"2.7\" color=\"%s\"> | </font>"
-		"<font face=\"courier\" size=\"2.7\" color=\"%s\">&gt;</font></center>";
-
-	const int curindex = GetFilteredDbIndex(fm);
-	const BOOL hasprev = (curindex > 0);
-	const BOOL hasnext = (curindex < (int)g_dbFiltered.size()-1);
-
-	if (DARKEN_HTML())
-		_snprintf_s(buff, sizeof(buff), _TRUNCATE, pager, hasprev ? CAT_LABEL_CLR_DARK : "#035493", "#035493", hasnext ? CAT_LABEL_CLR_DARK : "#035493");
-	else
-		_snprintf_s(buff, sizeof(buff), _TRUNCATE, pager, hasprev ? CAT_LABEL_CLR : "#4C90D4", "#4C90D4", hasnext ? CAT_LABEL_CLR : "#4C90D4");
-	html.append(buff);
-#endif
-
 	_snprintf_s(buff, sizeof(buff), _TRUNCATE, header, DARKEN_HTML() ? "#035493" : "#4C90D4", DARKEN_HTML() ? CAT_LABEL_CLR_DARK : CAT_LABEL_CLR, fm->GetFriendlyName(), $("Close"));
 	html.append(buff);
 
@@ -10271,13 +14735,17 @@ static string GenerateHtmlSummary(FMEntry *fm)
 
 	//
 
+	// existence check and extraction of the thumbnail from archive in one pass
+	static const char *thumb[] = { "fmthumb.jpg" };
+	FmBeginFileBatch(fm, thumb, 1);
+
 	if ( FmFileExists(fm, "fmthumb.jpg") )
 	{
 		if ( !fm->IsInstalled() )
 		{
 			// get fmthumb.jpg from archive
 			string imgfile;
-			if ( FmGetPhysicalFileFromArchive(fm, "fmthumb.jpg", imgfile, TRUE) )
+			if ( GetSummaryThumbFromArchive(fm, imgfile) )
 			{
 				const char *img = "<center><img src=\"/img/%s\" /></center><br><br>";
 
@@ -10296,6 +14764,8 @@ static string GenerateHtmlSummary(FMEntry *fm)
 		}
 	}
 
+	FmEndFileBatch();
+
 	// release date
 	if (fm->tmReleaseDate)
 	{
@@ -10382,7 +14852,7 @@ static string GenerateHtmlSummary(FMEntry *fm)
 		html.append("<br>");
 
 	// info file
-	vector<string> &list = Fl_FM_Descr_Popup::s_infoList;
+	vector<string> &list = infolist;
 	GetDocFiles(fm, list);
 
 	if (!fm->infofile.empty() || list.size())
@@ -10474,79 +14944,349 @@ static string GenerateHtmlSummary(FMEntry *fm)
 			bExtraSpace = TRUE;
 		}
 
-		html.append(section_header);
+		html.append(section_header);
+
+		html.append("<font color=\"");
+		html.append(DARKEN_HTML() ? CAT_LABEL_CLR_DARK : CAT_LABEL_CLR);
+		html.append("\"><u><b>");
+		html.append($("Tags"));
+		html.append(":</b></u></font><br>");
+
+		string s;
+		for (i=0; i<(int)fm->taglist.size(); i++)
+		{
+			if (i)
+				s += ", ";
+			if ( IsTagInFilterList(fm->taglist[i]) )
+			{
+				// already added to filters
+				s += "<u>";
+				s += TextToHtml(fm->taglist[i]);
+				s += "</u>";
+			}
+			else
+			{
+				// not added to filter, make a link
+				s += "<a href=\"/tag/";
+				s += fm->taglist[i];
+				s += "\">";
+				s += TextToHtml(fm->taglist[i]);
+				s += "</a>";
+			}
+		}
+		html.append(s);
+
+		//html.append("<br><br>");
+
+		html.append(section_footer);
+	}
+
+	// notes
+	if ( !fm->notes.empty() )
+	{
+		if (!bExtraSpace)
+		{
+			html.append("<br>");
+			bExtraSpace = TRUE;
+		}
+
+		html.append(section_header);
+
+		html.append("<font color=\"");
+		html.append(DARKEN_HTML() ? CAT_LABEL_CLR_DARK : CAT_LABEL_CLR);
+		html.append("\"><u><b>");
+		html.append($("Notes"));
+		html.append(":</b></u></font><br>");
+		html.append( EscapedTextToHtml( fm->notes.c_str() ) );
+		//html.append("<br><br>");
+
+		html.append(section_footer);
+	}
+
+	//
+
+	html.append("</td></tr></table>");
+
+	html.append("<table width=\"98%\"><tr bgcolor=\"");
+	html.append(DARKEN_HTML() ? "#035493" : "#4C90D4");
+	html.append(
+		"\"><td></td>"
+		"</tr></table><br>"
+		);
+
+	html.append(footer);
+
+	return html;
+}
+
+static __inline size_t HashBytes(size_t h, const void *p, size_t n)
+{
+	for (size_t i=0; i<n; i++)
+		h = 16777619U * h ^ (size_t)((const unsigned char*)p)[i];
+	return h;
+}
+
+// hash of everything in an entry (and the tag filters) that the summary body is generated from, catches changes
+// made to the entry without going through FMEntry::OnModified (like a rescan updating the info file)
+static size_t SummaryInputHash(FMEntry *fm)
+{
+	size_t h = 2166136261U;
+
+	const unsigned int flags = fm->flags & (FMEntry::FLAG_Installed|FMEntry::FLAG_Archived);
+
+	h = HashBytes(h, fm->name, strlen(fm->name) + 1);
+	h = HashBytes(h, fm->nicename.c_str(), fm->nicename.length() + 1);
+	h = HashBytes(h, fm->archive.c_str(), fm->archive.length() + 1);
+	h = HashBytes(h, fm->infofile.c_str(), fm->infofile.length() + 1);
+	h = HashBytes(h, fm->descr.c_str(), fm->descr.length() + 1);
+	h = HashBytes(h, fm->notes.c_str(), fm->notes.length() + 1);
+	h = HashBytes(h, fm->tags.c_str(), fm->tags.length() + 1);
+	h = HashBytes(h, &flags, sizeof(flags));
+	h = HashBytes(h, &fm->rating, sizeof(fm->rating));
+	h = HashBytes(h, &fm->nCompleteCount, sizeof(fm->nCompleteCount));
+	h = HashBytes(h, &fm->tmReleaseDate, sizeof(fm->tmReleaseDate));
+	h = HashBytes(h, &fm->tmLastStarted, sizeof(fm->tmLastStarted));
+	h = HashBytes(h, &fm->tmLastCompleted, sizeof(fm->tmLastCompleted));
+
+	// tags that are already in the filter list aren't links
+	for (int i=0; i<(int)fm->taglist.size(); i++)
+	{
+		const char c = IsTagInFilterList(fm->taglist[i]) ? 1 : 0;
+		h = HashBytes(h, &c, 1);
+	}
+
+	return h;
+}
+
+static time_t GetSummaryArchiveMTime(FMEntry *fm)
+{
+	time_t archiveMTime = 0;
+	if (!fm->IsInstalled() && fm->IsArchived())
+		GetFileMTimeOS(fm->GetArchiveFilePath().c_str(), archiveMTime);
+
+	return archiveMTime;
+}
+
+// returns TRUE if the cached summary body of an FM is still valid
+static BOOL IsHtmlSummaryCached(FMEntry *fm)
+{
+	const FMSummaryCache *c = fm->summary;
+
+	return c && c->gen == g_nSummaryGen && c->inputHash == SummaryInputHash(fm) && c->archiveMTime == GetSummaryArchiveMTime(fm);
+}
+
+// get the summary body of an FM, from its cache if still valid or by (re)generating it
+static const FMSummaryCache* GetHtmlSummaryBody(FMEntry *fm)
+{
+	const size_t inputHash = SummaryInputHash(fm);
+	const time_t archiveMTime = GetSummaryArchiveMTime(fm);
+
+	FMSummaryCache *c = fm->summary;
+
+	if (c)
+	{
+		c->Touch();
+
+		if (c->gen == g_nSummaryGen && c->inputHash == inputHash && c->archiveMTime == archiveMTime)
+			return c;
+
+		// archive was replaced, the cached info file list is stale too
+		if (c->archiveMTime != archiveMTime)
+			fm->flags &= ~FMEntry::FLAG_CachedInfoFiles;
+	}
+	else
+	{
+		c = fm->summary = new FMSummaryCache(fm);
+
+		// drop the least recently used summaries beyond the limit (never the new one, it's at the front)
+		while (g_nCachedSummaries > MAX_CACHED_SUMMARIES)
+			g_pSummaryLruTail->fm->DropSummary();
+	}
+
+	c->infoList.clear();
+	c->html = GenerateHtmlSummaryBody(fm, c->infoList);
+	c->gen = g_nSummaryGen;
+	c->inputHash = inputHash;
+	c->archiveMTime = archiveMTime;
+
+	return c;
+}
+
+// drop all cached summaries (when the UI language changes)
+static void ClearSummaryCache()
+{
+	while (g_pSummaryLruHead)
+		g_pSummaryLruHead->fm->DropSummary();
+
+	if (!++g_nSummaryGen)
+		g_nSummaryGen = 1;
+}
+
+static string GenerateHtmlSummary(FMEntry *fm)
+{
+	TRACE_SCOPE("GenerateHtmlSummary", fm->name);
+
+	string html;
+	char buff[1024];
+
+	const char *preheader =
+		"<html><body bgcolor=\"%s\" link=\"%s\">";
+
+	const FMSummaryCache *body = GetHtmlSummaryBody(fm);
+
+	if (DARKEN_HTML())
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, preheader, "#003E75", LINK_CLR_DARK);
+	else
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, preheader, "#3C78B4", LINK_CLR);
+
+	html.reserve(body->html.length() + 1024);
+	html.append(buff);
+
+#if 0
+	html.append("<br>");
+#else
+	const char *pager =
+		"<center><font face=\"courier\" size=\"2.7\" color=\"%s\">&lt;</font>"
+		"<font face=\"courier\" size=\"2.7\" color=\"%s\"> | </font>"
+		"<font face=\"courier\" size=\"2.7\" color=\"%s\">&gt;</font></center>";
+
+	const int curindex = GetFilteredDbIndex(fm);
+	const BOOL hasprev = (curindex > 0);
+	const BOOL hasnext = (curindex < (int)g_dbFiltered.size()-1);
+
+	if (DARKEN_HTML())
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, pager, hasprev ? CAT_LABEL_CLR_DARK : "#035493", "#035493", hasnext ? CAT_LABEL_CLR_DARK : "#035493");
+	else
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, pager, hasprev ? CAT_LABEL_CLR : "#4C90D4", "#4C90D4", hasnext ? CAT_LABEL_CLR : "#4C90D4");
+	html.append(buff);
+#endif
+
+	html.append(body->html);
+
+	Fl_FM_Descr_Popup::s_infoList = body->infoList;
+
+	return html;
+}
+
+// delay before summaries of the FMs next to the displayed one are generated, so that the popup gets drawn first
+#define SUMMARY_PREFETCH_DELAY	0.1
+
+// archive I/O needed for the summary of an archived FM (listing info files and extracting the thumbnail), done by
+// a pool task when prefetching so the UI doesn't stall on large archives
+struct SummaryPrefetchJob
+{
+	FMEntry *fm;		// only dereferenced by the main thread
+	unsigned int gen;	// g_nSummaryPrefetchGen when submitted
+	string archive;
+	vector<string> files;
+	int nFiles;
+	BOOL bThumb;
+	string thumb;		// fmthumb.jpg data
+};
+
+static void* SummaryPrefetchTask(void *p)
+{
+	SummaryPrefetchJob *job = (SummaryPrefetchJob*)p;
 
-		html.append("<font color=\"");
-		html.append(DARKEN_HTML() ? CAT_LABEL_CLR_DARK : CAT_LABEL_CLR);
-		html.append("\"><u><b>");
-		html.append($("Tags"));
-		html.append(":</b></u></font><br>");
+	TRACE_SCOPE("SummaryPrefetch", job->archive.c_str());
 
-		string s;
-		for (i=0; i<(int)fm->taglist.size(); i++)
+	job->nFiles = ListFilesInArchivePrunedMT(job->archive.c_str(), DOC_FILE_ARCHIVE_DEPTH, job->files);
+
+	for (int i=0; i<job->nFiles; i++)
+		if ( !fl_utf_strcasecmp(job->files[i].c_str(), "fmthumb.jpg") )
 		{
-			if (i)
-				s += ", ";
-			if ( IsTagInFilterList(fm->taglist[i]) )
+			void *data;
+			int len;
+			if ( ExtractFileFromArchiveMT(job->archive.c_str(), job->files[i].c_str(), data, len) )
 			{
-				// already added to filters
-				s += "<u>";
-				s += TextToHtml(fm->taglist[i]);
-				s += "</u>";
-			}
-			else
-			{
-				// not added to filter, make a link
-				s += "<a href=\"/tag/";
-				s += fm->taglist[i];
-				s += "\">";
-				s += TextToHtml(fm->taglist[i]);
-				s += "</a>";
+				job->thumb.assign((const char*)data, len);
+				job->bThumb = TRUE;
+				delete[] (char*)data;
 			}
+			break;
 		}
-		html.append(s);
 
-		//html.append("<br><br>");
+	return 0;
+}
 
-		html.append(section_footer);
-	}
+// called in main thread (as task continuation), generates the summary from the prefetched data
+static void OnSummaryPrefetchDone(void *p)
+{
+	SummaryPrefetchJob *job = (SummaryPrefetchJob*)p;
+	FMEntry *fm = job->fm;
 
-	// notes
-	if ( !fm->notes.empty() )
+	if (job->gen == g_nSummaryPrefetchGen && job->nFiles >= 0
+		&& !fm->IsInstalled() && fm->IsArchived() && fm->GetArchiveFilePath() == job->archive)
 	{
-		if (!bExtraSpace)
+		if ( !(fm->flags & FMEntry::FLAG_CachedInfoFiles) )
 		{
-			html.append("<br>");
-			bExtraSpace = TRUE;
+			vector<string> list;
+			SetArchDocFiles(fm, job->files, list);
 		}
 
-		html.append(section_header);
+		// hand the thumbnail to the FmBeginFileBatch call in GenerateHtmlSummaryBody
+		FmFileBatch *batch = new FmFileBatch;
+		batch->fm = fm;
+		batch->patterns.push_back("fmthumb.jpg");
+		if (job->bThumb)
+		{
+			batch->names.push_back("fmthumb.jpg");
+			batch->data.push_back( string() );
+			batch->data.back().swap(job->thumb);
+		}
 
-		html.append("<font color=\"");
-		html.append(DARKEN_HTML() ? CAT_LABEL_CLR_DARK : CAT_LABEL_CLR);
-		html.append("\"><u><b>");
-		html.append($("Notes"));
-		html.append(":</b></u></font><br>");
-		html.append( EscapedTextToHtml( fm->notes.c_str() ) );
-		//html.append("<br><br>");
+		delete g_pFmFilePrefetch;
+		g_pFmFilePrefetch = batch;
 
-		html.append(section_footer);
+		GetHtmlSummaryBody(fm);
+
+		delete g_pFmFilePrefetch;
+		g_pFmFilePrefetch = NULL;
 	}
 
-	//
+	delete job;
+}
 
-	html.append("</td></tr></table>");
+static void PrefetchSummary(FMEntry *fm)
+{
+	if ( IsHtmlSummaryCached(fm) )
+		return;
 
-	html.append("<table width=\"98%\"><tr bgcolor=\"");
-	html.append(DARKEN_HTML() ? "#035493" : "#4C90D4");
-	html.append(
-		"\"><td></td>"
-		"</tr></table><br>"
-		);
+	// summaries of installed FMs only need local file access, generate them right away
+	if (fm->IsInstalled() || !fm->IsArchived() || !InitArchiveSystem())
+	{
+		GetHtmlSummaryBody(fm);
+		return;
+	}
 
-	html.append(footer);
+	SummaryPrefetchJob *job = new SummaryPrefetchJob;
+	job->fm = fm;
+	job->gen = g_nSummaryPrefetchGen;
+	job->archive = fm->GetArchiveFilePath();
+	job->nFiles = -1;
+	job->bThumb = FALSE;
 
-	return html;
+	if ( !SubmitTaskOS(NULL, SummaryPrefetchTask, job, OnSummaryPrefetchDone) )
+	{
+		delete job;
+		GetHtmlSummaryBody(fm);
+	}
+}
+
+// generate (and cache) summaries of the previous and next FM in the list while a summary is being displayed,
+// making paging instant (extracting thumbnails and listing info files in archives can take a noticeable time)
+static void PrefetchNeighbourSummaries(void *p)
+{
+	FMEntry *fm = (FMEntry*)p;
+
+	const int curindex = GetFilteredDbIndex(fm);
+	if (curindex < 0)
+		return;
+
+	if (curindex < (int)g_dbFiltered.size()-1)
+		PrefetchSummary(g_dbFiltered[curindex+1]);
+	if (curindex > 0)
+		PrefetchSummary(g_dbFiltered[curindex-1]);
 }
 
 static void ViewSummary(FMEntry *fm)
@@ -10571,8 +15311,13 @@ show_popup:
 	if ( html.empty() )
 		return;
 
+	Fl::remove_timeout(PrefetchNeighbourSummaries);
+	Fl::add_timeout(SUMMARY_PREFETCH_DELAY, PrefetchNeighbourSummaries, fm);
+
 	Fl_FM_Descr_Popup::popup(pMainWnd, W, H, html.c_str());
 
+	Fl::remove_timeout(PrefetchNeighbourSummaries);
+
 	// clear doc list
 	Fl_FM_Descr_Popup::s_infoList.clear();
 	Fl_FM_Descr_Popup::s_infoList.reserve(0);
@@ -10651,6 +15396,77 @@ static const char* GenericHtmlTextPopupFull(const char *caption, const char *htm
 	return Fl_FM_Descr_Popup::popup(pMainWnd, W, H, html.c_str());
 }
 
+// display a plain text file in a popup, takes ownership of 'data' (allocated with new[] and null terminated)
+static void TextFilePopup(const char *caption, char *data, int len)
+{
+	int H = pMainWnd->h() - 40;
+	if (H >= 800)
+		H = 800;
+
+	Fl_FM_Text_Popup::popup(pMainWnd, (g_cfg.bLargeFont ? 976 : 800), H, caption, data, len);
+}
+
+// runtime performance stats for the about dialog, useful for tuning settings for a particular machine (stat names
+// come from trace.cpp in english, the same as in the stats file, and are translated here)
+static void AppendPerfStatsHtml(string &html)
+{
+	char buff[512];
+
+	_snprintf_s(buff, sizeof(buff), _TRUNCATE,
+		"<br><br><center><font color=\"%s\"><hr></font></center>"
+		"%s<br><br>"
+		"<b>%s:</b> %d<br>"
+		"<b>%s:</b> %d<br><br>",
+		DARKEN_HTML() ? "#376189" : "#719DC8", $("Performance:"), $("CPUs"), GetNumCPUsOS(), $("FMs"), (int)g_db.size());
+	html.append(buff);
+
+	for (int i=0; i<STAT_NumCounters; i++)
+	{
+		_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b>%s:</b> %.0f<br>", $(GetStatName((StatCounter)i)), (double)GetStat((StatCounter)i));
+		html.append(buff);
+	}
+
+	html.append("<br>");
+
+	for (int i=0; i<STAT_NumTimers; i++)
+	{
+		double total;
+		int count;
+		const double last = GetStatTime((StatTimer)i, &total, &count);
+
+		if (count)
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b>%s:</b> %.1f ms (%s %.1f ms, %d)<br>", $(GetStatTimeName((StatTimer)i)), last, $("avg"), total / count, count);
+		else
+			_snprintf_s(buff, sizeof(buff), _TRUNCATE, "<b>%s:</b> -<br>", $(GetStatTimeName((StatTimer)i)));
+		html.append(buff);
+	}
+
+	html.append("<br><b><a href=\"/cmd/savestats\">");
+	html.append($("Save to File..."));
+	html.append("</a></b>");
+}
+
+static void SavePerfStats()
+{
+	char fname[MAX_PATH_BUF];
+	strcpy(fname, "fmsel_stats.txt");
+
+	const char *pattern[] =
+	{
+		$("Text File"), "*.txt",
+		NULL,
+	};
+
+	if ( !FileDialog(pMainWnd, TRUE, $("Save Performance Stats"), pattern, "txt", fname, fname, sizeof(fname)) )
+		return;
+
+	if ( !DumpStats(fname) )
+	{
+		fl_message_position(pMainWnd);
+		fl_alert($("Failed to open file \"%s\" for writing."), fname);
+	}
+}
+
 // display about box (uses html popup)
 static void ViewAbout()
 {
@@ -10738,7 +15554,11 @@ static void ViewAbout()
 
 	html.append(msg);
 
-	GenericHtmlTextPopup($("About"), html.c_str(), (g_cfg.bLargeFont ? 610 : 500), (g_cfg.bLargeFont ? 610 : 500));
+	AppendPerfStatsHtml(html);
+
+	const char *ret = GenericHtmlTextPopup($("About"), html.c_str(), (g_cfg.bLargeFont ? 610 : 500), (g_cfg.bLargeFont ? 610 : 500));
+	if (ret && !strcmp(ret, "/cmd/savestats"))
+		SavePerfStats();
 }
 
 
@@ -11200,158 +16020,404 @@ public:
 };
 
 
-static Fl_Window *g_pProgressDlg = NULL;
-static Fl_Progress *g_pProgressBar = NULL;
-static volatile int g_nMaxSteps = 0;
-static volatile int g_nLastProgress = 0;
-static volatile int g_nCurProgress = 0;
-static volatile int g_nProgressResult = 0;
-static volatile BOOL g_nProgressDone;
+// a progress job is work done by a worker thread (archive extraction, backup, audio conversion) that is listed in the
+// jobs panel while it runs, jobs are created and deleted by the main thread, the worker only updates the counters
+// and checks for cancellation, so any number of jobs can be active at the same time. the counters are shared with
+// the worker (and possibly several workers of a parallel extraction), increments go through AtomicAddOS
+struct ProgressJob
+{
+	string label;
+	volatile long nMaxSteps;
+	volatile long nCurSteps;
+	volatile long nResult;
+	volatile long bDone;
+	volatile long bCancel;
+	// total size of the work in KB if known (the processed part shown in the panel is derived from the step count)
+	volatile long nTotalKB;
+	double tmStart;
+	// main thread is waiting for the job (see SetProgressForeground), the panel is modal while there are
+	// foreground jobs and escape cancels them
+	BOOL bForeground;
+
+	// jobs panel row
+	Fl_Progress *pBar;
+	Fl_Box *pInfo;
+	Fl_Button *pCancel;
+	char info[128];
+};
+
+static vector<ProgressJob*> g_progressJobs;
+static Fl_Window *g_pJobsWnd = NULL;
+
+#define JOBS_PANEL_W		320
+#define JOBS_PANEL_ROW_H	46
+
+
+// jobs panel, escape cancels the jobs the main thread is waiting for, other keys are swallowed
+class Fl_FM_Jobs_Window : public Fl_FM_Progress_Window
+{
+public:
+	Fl_FM_Jobs_Window(int W, int H, const char *l=0)
+		: Fl_FM_Progress_Window(W,H,l) {}
+
+	virtual int handle(int e)
+	{
+		if (e == FL_KEYBOARD && Fl::event_key() == FL_Escape)
+		{
+			for (int i=0; i<(int)g_progressJobs.size(); i++)
+				if (g_progressJobs[i]->bForeground)
+					CancelProgress(g_progressJobs[i]);
+			return 1;
+		}
+		return Fl_FM_Progress_Window::handle(e);
+	}
+};
 
 
 // called from worker thread to increment step count
-void StepProgress(int nSteps)
+void StepProgress(ProgressJob *job, int nSteps)
+{
+	if (job)
+		AtomicAddOS(&job->nCurSteps, nSteps);
+}
+
+// called from worker thread to change the total step count (and restart the count) when the work turns out to be
+// measured differently than the job was created with
+void SetProgressSteps(ProgressJob *job, int nSteps)
 {
-	if (g_pProgressDlg)
+	if (job && nSteps > 0)
 	{
-		g_nCurProgress += nSteps;
-		if (g_nCurProgress > g_nMaxSteps)
-			g_nCurProgress = g_nMaxSteps;
+		// (steps of other workers still on the old scale may get counted on the new one, GetJobProgress clamps,
+		// subtracting the current count rather than storing 0 keeps steps added concurrently)
+		job->nMaxSteps = nSteps;
+		AtomicAddOS(&job->nCurSteps, -job->nCurSteps);
+	}
+}
+
+// called from worker thread to set step count
+void SetProgress(ProgressJob *job, int nStep)
+{
+	if (job)
+		job->nCurSteps = nStep;
+}
 
-		const int NUM_VISUAL_STEPS = 20;
+// called from worker thread to set the total size (in bytes) of the work, for display only
+void SetProgressSize(ProgressJob *job, unsigned __int64 bytes)
+{
+	if (job)
+		job->nTotalKB = (long)(bytes >> 10);
+}
 
-		const int vistick0 = (NUM_VISUAL_STEPS * g_nLastProgress) / g_nMaxSteps;
-		const int vistick1 = (NUM_VISUAL_STEPS * g_nCurProgress) / g_nMaxSteps;
+// called from worker thread to check if the job was cancelled, the worker should then stop and call EndProgress
+BOOL IsProgressCancelled(ProgressJob *job)
+{
+	return job && job->bCancel;
+}
 
-		if (vistick0 != vistick1)
-		{
-			g_nLastProgress = g_nCurProgress;
+// called from worker thread to signal end of work (will make RunProgress(), called by main thread, return)
+void EndProgress(ProgressJob *job, int result)
+{
+	if (job)
+	{
+		job->nResult = result;
+		job->bDone = TRUE;
+		if (!g_pBatchReport)
 			Fl::awake();
-		}
 	}
 }
 
-// called from worker thread to set step count
-void SetProgress(int nStep)
+void CancelProgress(ProgressJob *job)
+{
+	if (job && !job->bCancel)
+	{
+		job->bCancel = TRUE;
+
+		if (job->pCancel)
+			job->pCancel->deactivate();
+	}
+}
+
+static void OnCancelJob(Fl_Widget *, void *p)
+{
+	CancelProgress((ProgressJob*)p);
+}
+
+static int GetJobProgress(const ProgressJob *job)
+{
+	const long n = job->nCurSteps;
+	const long nMax = job->nMaxSteps;
+	return n < 0 ? 0 : (n > nMax ? nMax : n);
+}
+
+// for the main thread to poll jobs it doesn't wait for in RunProgress
+BOOL IsProgressDone(ProgressJob *job)
+{
+	return !job || job->bDone;
+}
+
+// estimated number of bytes processed so far (0 if the total size isn't known)
+unsigned __int64 GetProgressBytes(ProgressJob *job)
+{
+	if (!job || job->nTotalKB <= 0)
+		return 0;
+
+	return (unsigned __int64)((double)GetJobProgress(job) / (double)job->nMaxSteps * (double)job->nTotalKB) << 10;
+}
+
+static void FormatJobInfo(const ProgressJob *job, char *s, int len)
 {
-	if (g_pProgressDlg)
+	if (job->bCancel)
 	{
-		g_nCurProgress = nStep;
-		if (g_nCurProgress < 0)
-			g_nCurProgress = 0;
-		if (g_nCurProgress > g_nMaxSteps)
-			g_nCurProgress = g_nMaxSteps;
+		_snprintf_s(s, len, _TRUNCATE, "%s", $("Cancelling..."));
+		return;
+	}
+
+	const double f = (double)GetJobProgress(job) / (double)job->nMaxSteps;
+	const double elapsed = (GetTimeMsOS() - job->tmStart) / 1000.0;
+
+	int n = _snprintf_s(s, len, _TRUNCATE, "%d%%", (int)(f * 100.0));
+
+	const long nTotalKB = job->nTotalKB;
+	if (nTotalKB > 0 && n >= 0)
+	{
+		char s1[64], s2[64];
+		FormatFileSizeValue(s1, (unsigned __int64)(f * (double)nTotalKB) << 10);
+		FormatFileSizeValue(s2, (unsigned __int64)nTotalKB << 10);
+		n += _snprintf_s(s+n, len-n, _TRUNCATE, "  %s / %s", s1, s2);
+	}
+
+	// estimate remaining time once there's enough progress for it to mean anything
+	if (f > 0.02 && elapsed > 1.0 && n >= 0)
+	{
+		const int eta = (int)(elapsed * (1.0 - f) / f + 0.5);
+		_snprintf_s(s+n, len-n, _TRUNCATE, $("  %d:%02d left"), eta / 60, eta % 60);
+	}
+}
+
+static void UpdateJobsPanel()
+{
+	for (int i=0; i<(int)g_progressJobs.size(); i++)
+	{
+		ProgressJob *job = g_progressJobs[i];
+		if (!job->pBar)
+			continue;
+
+		job->pBar->maximum( (float)job->nMaxSteps );
+		job->pBar->value( (float)GetJobProgress(job) );
 
-		if (g_nLastProgress != g_nCurProgress)
+		char info[sizeof(job->info)];
+		FormatJobInfo(job, info, sizeof(info));
+		if ( strcmp(info, job->info) )
 		{
-			g_nLastProgress = g_nCurProgress;
-			Fl::awake();
+			strcpy(job->info, info);
+			job->pInfo->redraw_label();
 		}
 	}
 }
 
-// called from worker thread to signal end of work (will make RunProgress(), called by main thread, return)
-void EndProgress(int result)
+static void OnJobsPanelTimer(void *)
+{
+	UpdateJobsPanel();
+
+	Fl::repeat_timeout(0.1, OnJobsPanelTimer);
+}
+
+// (re)create jobs panel with a row for each job, or remove it if there are no jobs
+static void RebuildJobsPanel()
 {
-	if (g_pProgressDlg)
+	if (g_pJobsWnd)
+	{
+		g_pJobsWnd->hide();
+
+		delete g_pJobsWnd;
+		g_pJobsWnd = NULL;
+	}
+
+	if ( g_progressJobs.empty() )
+	{
+		Fl::remove_timeout(OnJobsPanelTimer);
+		return;
+	}
+
+	Fl_Window *w = g_pJobsWnd = new Fl_FM_Jobs_Window(JOBS_PANEL_W, (int)g_progressJobs.size() * JOBS_PANEL_ROW_H + 6);
+	w->clear_border();
+	w->box(FL_UP_BOX);
+	// closing is done by finishing or cancelling the jobs
+	w->callback(NULL);
+
+	BOOL bModal = FALSE;
+
+	for (int i=0; i<(int)g_progressJobs.size(); i++)
 	{
-		g_nProgressResult = result;
-		g_nProgressDone = TRUE;
-		Fl::awake();
+		ProgressJob *job = g_progressJobs[i];
+		const int y = 8 + i * JOBS_PANEL_ROW_H;
+
+		Fl_Progress *o = job->pBar = new Fl_Progress(10, y, w->w()-20-70, 20, job->label.c_str());
+		o->labelfont(FL_HELVETICA_BOLD);
+		o->labelsize(FL_NORMAL_SIZE);
+		o->color( fl_themed_rgb_color(240,240,230) );
+		o->color2( fl_themed_rgb_color(100,170,225) );
+		o->minimum(0);
+		o->maximum( (float)job->nMaxSteps );
+		o->value( (float)GetJobProgress(job) );
+
+		Fl_Button *b = job->pCancel = new Fl_Button(w->w()-10-64, y, 64, 20, fl_cancel);
+		b->labelsize(FL_NORMAL_SIZE-1);
+		b->callback(OnCancelJob, job);
+		if (job->bCancel)
+			b->deactivate();
+
+		FormatJobInfo(job, job->info, sizeof(job->info));
+		Fl_Box *l = job->pInfo = new Fl_Box(10, y+21, w->w()-20, 16, job->info);
+		l->labelsize(FL_NORMAL_SIZE-2);
+		l->align(FL_ALIGN_INSIDE|FL_ALIGN_LEFT);
+
+		if (job->bForeground)
+			bModal = TRUE;
 	}
+
+	w->end();
+
+	if (bModal)
+		w->set_modal();
+	else
+		w->set_non_modal();
+
+	w->position(
+		pMainWnd->x() + ((pMainWnd->w() - w->w()) / 2),
+		pMainWnd->y() + ((pMainWnd->h() - w->h()) / 2)
+		);
+
+	w->show();
+
+	Fl::remove_timeout(OnJobsPanelTimer);
+	Fl::add_timeout(0.1, OnJobsPanelTimer);
 }
 
-// clean up progress window
-void TermProgress()
+// mark a job as one the main thread is waiting for (or not anymore), RunProgress does this for the job it waits for,
+// code that waits for jobs in its own loop (like the install queue) does it itself
+void SetProgressForeground(ProgressJob *job, BOOL bForeground)
 {
-	if (g_pProgressDlg)
-	{
-		g_pProgressDlg->hide();
+	if (!job || !job->bForeground == !bForeground)
+		return;
+
+	job->bForeground = bForeground;
+
+	if (job->pBar)
+		RebuildJobsPanel();
+}
+
+// remove a finished job
+void TermProgress(ProgressJob *job)
+{
+	if (!job)
+		return;
+
+	vector<ProgressJob*>::iterator it = std::find(g_progressJobs.begin(), g_progressJobs.end(), job);
+	if (it != g_progressJobs.end())
+		g_progressJobs.erase(it);
+
+	const BOOL bPanel = job->pBar != NULL;
 
-		delete (Fl_Widget*)g_pProgressDlg;
-		g_pProgressDlg = NULL;
-		g_pProgressBar = NULL;
+	delete job;
+
+	if (bPanel)
+	{
+		RebuildJobsPanel();
 
 		// make sure main window is brought to front and activated again
 		// (if the html popup was opened it can cause it to lose activation)
-		pMainWnd->show();
+		if ( g_progressJobs.empty() )
+			pMainWnd->show();
 	}
 }
 
-// run progress window (modal loop), returns value pased to EndProgress
-int RunProgress()
+// wait for a job while running the UI (or outputting progress in batch mode) and remove it, returns value passed
+// to EndProgress, 'pbCancelled' is set if the job was cancelled
+int RunProgress(ProgressJob *job, BOOL *pbCancelled)
 {
-	if (!g_pProgressDlg)
+	if (!job)
 	{
 		ASSERT(FALSE);
 		return 0;
 	}
 
-	fl_cursor(FL_CURSOR_WAIT);
+	SetProgressForeground(job, TRUE);
 
-	while (g_pProgressDlg->visible() && !g_nProgressDone)
+	if (g_pBatchReport)
 	{
-		Fl_Widget *o = Fl::readqueue();
+		// poll worker and output progress in 10% steps
+		int nLastPct = 0;
 
-		if (g_nProgressDone)
+		while (!job->bDone)
 		{
-			g_pProgressDlg->hide();
-			break;
+			WaitOS(50);
+
+			const int nPct = (int)((__int64)GetJobProgress(job) * 100 / job->nMaxSteps) / 10 * 10;
+			if (nPct > nLastPct && !job->bDone)
+			{
+				nLastPct = nPct;
+				BatchReport("  %s %d%%", job->label.c_str(), nPct);
+			}
 		}
-		else
-			g_pProgressBar->value((float)g_nCurProgress);
+	}
+	else
+	{
+		fl_cursor(FL_CURSOR_WAIT);
 
-#ifdef _WIN32
-		if (!o) Fl::wait();
-#else
-		// pump messages to keep progress bar responsive
-		if (!o) Fl::wait(50.0/1000.0);
-#endif
+		while (!job->bDone)
+		{
+			Fl_Widget *o = Fl::readqueue();
+
+			// pump messages to keep progress bar responsive
+			if (!o) Fl::wait(50.0/1000.0);
+		}
 	}
 
-	TermProgress();
+	if (pbCancelled)
+		*pbCancelled = job->bCancel;
+
+	const int result = job->nResult;
+
+	// (not waited for anymore, TermProgress rebuilds the panel anyway so don't do it twice)
+	job->bForeground = FALSE;
 
-	return g_nProgressResult;
+	TermProgress(job);
+
+	return result;
 }
 
-void InitProgress(int nSteps, const char *label)
+// register a new job and show it in the jobs panel, the job is removed by RunProgress (or TermProgress if the worker
+// couldn't be started)
+ProgressJob* InitProgress(int nSteps, const char *label)
 {
-	if (g_pProgressDlg || nSteps <= 0)
+	if (nSteps <= 0)
 	{
 		ASSERT(FALSE);
-		return;
+		return NULL;
 	}
 
-	Fl_Window *w = g_pProgressDlg = new Fl_FM_Progress_Window(250, 40);
-	ASSERT(w != NULL);
-	if (!w)
-		return;
-
-	w->clear_border();
-	w->set_modal();
-	w->box(FL_UP_BOX);
-
-	Fl_Progress *o = g_pProgressBar = new Fl_Progress(10, 10, w->w()-20, w->h()-20, label);
-	o->labelfont(FL_HELVETICA_BOLD);
-	o->labelsize(FL_NORMAL_SIZE);
-	o->color( fl_themed_rgb_color(240,240,230) );
-	o->color2( fl_themed_rgb_color(100,170,225) );
-
-	w->end();
-
-	g_nMaxSteps = nSteps;
-	g_nCurProgress = g_nLastProgress = 0;
-	g_nProgressDone = FALSE;
+	ProgressJob *job = new ProgressJob;
+	job->label = label;
+	job->nMaxSteps = nSteps;
+	job->nCurSteps = 0;
+	job->nResult = 0;
+	job->bDone = FALSE;
+	job->bCancel = FALSE;
+	job->nTotalKB = 0;
+	job->tmStart = GetTimeMsOS();
+	job->bForeground = FALSE;
+	job->pBar = NULL;
+	job->pInfo = NULL;
+	job->pCancel = NULL;
+	job->info[0] = 0;
 
-	g_pProgressBar->minimum(0);
-	g_pProgressBar->maximum((float)nSteps);
+	g_progressJobs.push_back(job);
 
-	w->position(
-		pMainWnd->x() + ((pMainWnd->w() - w->w()) / 2),
-		pMainWnd->y() + ((pMainWnd->h() - w->h()) / 2)
-		);
+	if (!g_pBatchReport)
+		RebuildJobsPanel();
 
-	w->show();
+	return job;
 }
 
 
@@ -11707,7 +16773,7 @@ invalid_date:
 		return 2;
 
 	// nice name
-	if (Trimmed( pTagEdNiceName->value() ) != fm->nicename)
+	if (Trimmed( pTagEdNiceName->value() ) != fm->nicename.c_str())
 		return 2;
 
 	// max description length (only consider this a change if pressing OK, ie. pValidationFailedOnPage != NULL,
@@ -11749,7 +16815,7 @@ invalid_date:
 	string notes = EscapeString(s);
 	if (s)
 		free(s);
-	if (fm->notes != notes)
+	if (fm->notes != notes.c_str())
 		return TRUE;
 
 	// description
@@ -11757,7 +16823,7 @@ invalid_date:
 	notes = EscapeString(s);
 	if (s)
 		free(s);
-	if (fm->descr != notes)
+	if (fm->descr != notes.c_str())
 		return TRUE;
 
 	// config
@@ -11784,7 +16850,7 @@ invalid_date:
 	}
 	if (excludeall)
 		modexclude = "*";
-	if (modexclude != fm->modexclude)
+	if (modexclude != fm->modexclude.c_str())
 		return TRUE;
 
 	return FALSE;
@@ -11858,69 +16924,360 @@ static void OnOkTagEditor(Fl_Button *, void *)
 		int m = atoi( pTagEdRelMonth->value() );
 		int d = atoi( pTagEdRelDay->value() );
 
-		struct tm t = {};
-		t.tm_year = y - 1900;
-		t.tm_mon = m - 1;
-		t.tm_mday = d;
-		t.tm_hour = 12;
-		fm->tmReleaseDate = _mkgmtime(&t);
-	}
-	else
-		fm->tmReleaseDate = 0;
+		struct tm t = {};
+		t.tm_year = y - 1900;
+		t.tm_mon = m - 1;
+		t.tm_mday = d;
+		t.tm_hour = 12;
+		fm->tmReleaseDate = _mkgmtime(&t);
+	}
+	else
+		fm->tmReleaseDate = 0;
+
+	if ( pTagEdUnverified->value() )
+		fm->flags |= FMEntry::FLAG_UnverifiedRelDate;
+	else
+		fm->flags &= ~FMEntry::FLAG_UnverifiedRelDate;
+
+	SyncHotFields(fm);
+
+	if (!g_bTagEdFakeFM)
+	{
+		if ( !g_infoFiles.empty() )
+			fm->infofile = g_mnuInfoFiles[ pTagEdInfoFile->value() ].label();
+	}
+	else
+	{
+		string s = Trimmed( pTagEdFakeInfoFile->value() );
+		if ( s.size() )
+			fm->infofile = s.c_str();
+	}
+
+	//
+	// TABPAGE_TAGS
+	//
+
+	if (pTagEdGroup->apply_changes() && !g_bTagEdFakeFM)
+		RemoveDeadTagFilters(FALSE);
+
+	//
+	// TABPAGE_DESCR
+	//
+
+	char *s = g_pDescrBuffer->text();
+	string notes = EscapeString(s);
+	if (s)
+		free(s);
+	fm->SetDescr( notes.c_str() );
+
+	//
+	// TABPAGE_NOTES
+	//
+
+	s = g_pNotesBuffer->text();
+	notes = EscapeString(s);
+	if (s)
+		free(s);
+	fm->SetNotes( notes.c_str() );
+
+	//
+	// TABPAGE_CONFIG
+	//
+
+	if  (fm->IsInstalled())
+	{
+		char fname[MAX_PATH_BUF];
+		if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "%s" DIRSEP_STR "fm.cfg", GetRootPath(), fm->name) != -1)
+			g_pConfigBuffer->savefile(fname);
+	}
+	g_bTagEdFMConfigModified = FALSE;
+
+	//
+	// TABPAGE_MODS
+	//
+
+	string modexclude;
+	bool excludeall = true;
+	for (int i = 1; i <= pTagEdMods->nitems(); i++)
+	{
+		if (!pTagEdMods->checked(i))
+		{
+			const char *text = pTagEdMods->text(i);
+			if (text && *text)
+			{
+				if (modexclude.size() > 0)
+					modexclude.append("+");
+				modexclude.append(text);
+			}
+		}
+		else if (excludeall)
+			excludeall = false;
+	}
+	if (excludeall)
+		modexclude = "*";
+	fm->SetModExclude( modexclude.c_str() );
+
+	//
+
+	if (!g_bTagEdFakeFM)
+	{
+		fm->OnModified();
+
+		if (bModified > 1)
+		{
+			if (!g_cfg.bAutoRefreshFilteredDb)
+			{
+				pFMList->refresh_rowsize(fm);
+				pFMList->redraw();
+			}
+			else
+				RefreshListControl(pFMList->selected(), FALSE);
+		}
+		else
+			pFMList->redraw();
+	}
+
+	if (g_bTagEdFakeFM)
+	{
+		// ending dialog in create FM.INI mode, save fm.ini (return dialog if that fails or save dialog is cancelled)
+		if ( !ExportFmIni(fm, TRUE) )
+		{
+			g_bTagEdFakeFMForcedHasChanges = TRUE;
+			return;
+		}
+	}
+
+	CloseTagEditor();
+}
+
+
+static void InitTagEdDialog(Fl_Window *pDlg, FMEntry *fm)
+{
+	static char sTitle[256];
+	if (*fm->name)
+	{
+		if (_snprintf_s(sTitle, sizeof(sTitle), _TRUNCATE, "%s -- %s", pDlg->label(), fm->GetFriendlyName()) == -1)
+			*sTitle = '\0';
+	}
+	else
+		strcpy(sTitle, $("Create FM.INI"));
+	pDlg->label(sTitle);
+
+	g_pTagEdFM = fm;
+
+	if (g_cfg.windowsize_taged[0] && g_cfg.windowsize_taged[0])
+	{
+		// no way to access min size in Fl_Window, so we have to manually define vals, suck!!
+		const int MINW = 540;
+		const int MINH = 180;
+		if (g_cfg.windowsize_taged[0] < MINW)
+			g_cfg.windowsize_taged[0] = MINW;
+		if (g_cfg.windowsize_taged[1] < MINH)
+			g_cfg.windowsize_taged[1] = MINH;
+
+		pDlg->size(g_cfg.windowsize_taged[0], g_cfg.windowsize_taged[1]);
+	}
+
+	// center over main window
+	pDlg->position(
+		pMainWnd->x() + ((pMainWnd->w() - pDlg->w()) / 2),
+		pMainWnd->y() + ((pMainWnd->h() - pDlg->h()) / 2)
+		);
+
+	// OS specific init of window
+	WndInitOS(pDlg);
+
+	//
+	// TABPAGE_MISC
+	//
+
+	pTagEdNiceName->maximum_size(128);
+	if ( !fm->nicename.empty() )
+		pTagEdNiceName->value( fm->nicename.c_str() );
+	pTagEdName->value(fm->name);
+	if ( !fm->archive.empty() )
+	{
+		pTagEdArchive->value( fm->archive.c_str() );
+		// deactivate control if unverified archive
+		if ( !fm->IsArchived() )
+			pTagEdArchive->deactivate();
+	}
+	else
+		pTagEdArchive->deactivate();
+
+	pTagEdRelYear->maximum_size(4);
+	pTagEdRelMonth->maximum_size(2);
+	pTagEdRelDay->maximum_size(2);
+	if (fm->tmReleaseDate)
+	{
+		struct tm *tm = gmtime(&fm->tmReleaseDate);
+
+		char s[16];
+
+		sprintf(s, "%04d", tm->tm_year + 1900);
+		pTagEdRelYear->value(s);
+
+		sprintf(s, "%02d", tm->tm_mon + 1);
+		pTagEdRelMonth->value(s);
+
+		sprintf(s, "%02d", tm->tm_mday);
+		pTagEdRelDay->value(s);
+
+		if (fm->flags & FMEntry::FLAG_UnverifiedRelDate)
+			pTagEdUnverified->value(1);
+	}
+
+	if (!g_bTagEdFakeFM)
+	{
+		// populate info file list
+
+		int nSel = 0;
+		if ( GetDocFiles(fm, g_infoFiles) )
+		{
+			if ( !fm->infofile.empty() )
+			{
+				nSel = -1;
+
+				for (int i=0; i<(int)g_infoFiles.size(); i++)
+					if ( !_stricmp(g_infoFiles[i].c_str(), fm->infofile.c_str()) )
+					{
+						nSel = i;
+						break;
+					}
+
+				// if the file no longer exists then default to the first file
+				if (nSel == -1)
+				{
+					fm->infofile = g_infoFiles[0].c_str();
+					fm->flags &= ~FMEntry::FLAG_NoInfoFile;
+					fm->OnModified();
+					nSel = 0;
+				}
+			}
+
+			const int MAX_MENU_ITEMS = g_infoFiles.size() + 1;
+			int menu_items = 0;
+			g_mnuInfoFiles = new Fl_Menu_Item[MAX_MENU_ITEMS];
+			Fl_Menu_Item *menu = g_mnuInfoFiles;
+
+			for (int i=0; i<(int)g_infoFiles.size(); i++)
+			{
+				MENU_ITEM(g_infoFiles[i].c_str(), i);
+			}
+			MENU_END();
+		}
+		else
+		{
+			const int MAX_MENU_ITEMS = 2;
+			int menu_items = 0;
+			g_mnuInfoFiles = new Fl_Menu_Item[MAX_MENU_ITEMS];
+			Fl_Menu_Item *menu = g_mnuInfoFiles;
 
-	if ( pTagEdUnverified->value() )
-		fm->flags |= FMEntry::FLAG_UnverifiedRelDate;
-	else
-		fm->flags &= ~FMEntry::FLAG_UnverifiedRelDate;
+			MENU_ITEM($("<none>"), 0);
+			MENU_END();
 
-	if (!g_bTagEdFakeFM)
-	{
-		if ( !g_infoFiles.empty() )
-			fm->infofile = g_mnuInfoFiles[ pTagEdInfoFile->value() ].label();
+			// if is installed and no info file is found but previously it had one, then clear it
+			if (fm->IsAvail() && !(fm->flags & FMEntry::FLAG_NoInfoFile))
+			{
+				fm->infofile.clear();
+				fm->flags |= FMEntry::FLAG_NoInfoFile;
+				fm->OnModified();
+			}
+		}
+		pTagEdInfoFile->menu(g_mnuInfoFiles);
+		pTagEdInfoFile->value(g_mnuInfoFiles + nSel);
+		if ((int)g_infoFiles.size() <= 1)
+			pTagEdInfoFile->deactivate();
+		if ( g_infoFiles.empty() )
+			pTagEdViewInfo->deactivate();
 	}
 	else
 	{
-		string s = Trimmed( pTagEdFakeInfoFile->value() );
-		if ( s.size() )
-			fm->infofile = s.c_str();
+		// replace pTagEdInfoFile/pTagEdViewInfo controls with simple text edit box
+		pTagEdInfoFile->deactivate();
+		pTagEdViewInfo->deactivate();
+		pTagEdInfoFile->hide();
+		pTagEdViewInfo->hide();
+
+		int X, Y, W, H;
+		X = pTagEdInfoFile->x();
+		Y = pTagEdInfoFile->y();
+		W = pTagEdViewInfo->x() + pTagEdViewInfo->w() - pTagEdInfoFile->x();
+		H = pTagEdViewInfo->h();
+
+		Fl_Input *o = pTagEdFakeInfoFile = new Fl_Input(X, Y, W, H, pTagEdInfoFile->label());
+		o->tooltip( pTagEdInfoFile->tooltip() );
+		o->labelsize( pTagEdInfoFile->labelsize() );
+		o->textsize( pTagEdInfoFile->textsize() );
+		o->align( pTagEdInfoFile->align() );
+		pTagEdInfoFile->parent()->insert(*o, pTagEdInfoFile);
 	}
 
 	//
 	// TABPAGE_TAGS
 	//
 
-	if (pTagEdGroup->apply_changes() && !g_bTagEdFakeFM)
-		RemoveDeadTagFilters(FALSE);
+	// probably way too much for tags, but at least it's not unlimited
+	pTagEdInput->maximum_size(128);
+
+	pTagEdAddTag->deactivate();
+
+	pTagEdPresets->value(g_mnuTagPresetsLabel);
+
+	pTagEdGroup->init(fm);
 
 	//
 	// TABPAGE_DESCR
 	//
 
-	char *s = g_pDescrBuffer->text();
-	string notes = EscapeString(s);
-	if (s)
-		free(s);
-	fm->SetDescr( notes.c_str() );
+	pTagEdDescr->box(FLAT_MARGIN_BOX);
+	if (g_cfg.bWrapDescrEditor)
+		pTagEdDescr->wrap_mode(1, 0);
+
+	pTagEdDescr->buffer(g_pDescrBuffer);
+	if ( !fm->descr.empty() )
+	{
+		string s = UnescapeString( fm->descr.c_str() );
+		g_pDescrBuffer->text( s.c_str() );
+	}
 
 	//
 	// TABPAGE_NOTES
 	//
 
-	s = g_pNotesBuffer->text();
-	notes = EscapeString(s);
-	if (s)
-		free(s);
-	fm->SetNotes( notes.c_str() );
+	pTagEdNotes->box(FLAT_MARGIN_BOX);
+	if (g_cfg.bWrapNotesEditor)
+		pTagEdNotes->wrap_mode(1, 0);
+
+	pTagEdNotes->buffer(g_pNotesBuffer);
+	if ( !fm->notes.empty() )
+	{
+		string s = UnescapeString( fm->notes.c_str() );
+		g_pNotesBuffer->text( s.c_str() );
+	}
 
 	//
 	// TABPAGE_CONFIG
 	//
 
+	pTagEdConfig->box(FLAT_MARGIN_BOX);
+	pTagEdConfig->wrap_mode(1, 0);
+
+	pTagEdConfig->buffer(g_pConfigBuffer);
 	if  (fm->IsInstalled())
 	{
 		char fname[MAX_PATH_BUF];
 		if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "%s" DIRSEP_STR "fm.cfg", GetRootPath(), fm->name) != -1)
-			g_pConfigBuffer->savefile(fname);
+		{
+			g_pConfigBuffer->loadfile(fname);
+#ifndef _WIN32
+			// remove trailing carriage returns
+			int pos = 0;
+			while (g_pConfigBuffer->findchar_forward(pos, '\r', &pos))
+				g_pConfigBuffer->remove(pos, pos + 1);
+#endif
+			g_pConfigBuffer->add_modify_callback(OnModifyFMConfig, &g_bTagEdFMConfigModified);
+		}
 	}
 	g_bTagEdFMConfigModified = FALSE;
 
@@ -11928,1503 +17285,1808 @@ static void OnOkTagEditor(Fl_Button *, void *)
 	// TABPAGE_MODS
 	//
 
-	string modexclude;
-	bool excludeall = true;
-	for (int i = 1; i <= pTagEdMods->nitems(); i++)
+	vector<string> modpaths = GetModPaths();
+	for (size_t i = 0; i < modpaths.size(); i++)
+		pTagEdMods->add(modpaths[i].c_str(), 1);
+	if ( !fm->modexclude.empty() )
 	{
-		if (!pTagEdMods->checked(i))
+		if (fm->modexclude == "*")
 		{
-			const char *text = pTagEdMods->text(i);
-			if (text && *text)
+			pTagEdMods->check_none();
+		}
+		else
+		{
+			vector<string> modexcludes;
+			size_t cur = 0, next;
+
+			do
 			{
-				if (modexclude.size() > 0)
-					modexclude.append("+");
-				modexclude.append(text);
+				next = fm->modexclude.find_first_of("+", cur);
+				string path = fm->modexclude.substr(cur, next - cur).c_str();
+				if (path.size() > 0)
+					modexcludes.push_back(path);
+				cur = next + 1;
+			}
+			while (next != string::npos);
+
+			for (size_t i = 0; i < modexcludes.size(); i++)
+			{
+				for (int j = 1; j <= pTagEdMods->nitems(); j++)
+				{
+					const char *text = pTagEdMods->text(j);
+					if (text && !_stricmp(modexcludes[i].c_str(), text))
+					{
+						pTagEdMods->checked(j, 0);
+						break;
+					}
+				}
 			}
 		}
-		else if (excludeall)
-			excludeall = false;
 	}
-	if (excludeall)
-		modexclude = "*";
-	fm->SetModExclude( modexclude.c_str() );
 
 	//
 
-	if (!g_bTagEdFakeFM)
+	// disable all controls that aren't relevant for standalone FM.INI creation
+	if (g_bTagEdFakeFM)
 	{
-		fm->OnModified();
+		pTagEdName->deactivate();
+		pTagEdUnverified->deactivate();
+		pTagEdMods->deactivate();
+		pTagEdNotes->deactivate();
+		pTagEdConfig->deactivate();
+	}
+#ifdef T3_SUPPORT
+	else if (g_bRunningThief3)
+	{
+		pTagEdConfig->deactivate();
+		pTagEdMods->deactivate();
+	}
+#endif
+	else if (!fm->IsInstalled())
+		pTagEdConfig->deactivate();
+}
 
-		if (bModified > 1)
-		{
-			if (!g_cfg.bAutoRefreshFilteredDb)
-			{
-				pFMList->refresh_rowsize(fm);
-				pFMList->redraw();
-			}
-			else
-				RefreshListControl(pFMList->selected(), FALSE);
-		}
-		else
-			pFMList->redraw();
+static void DoTagEditor(FMEntry *fm, int page)
+{
+	ASSERT(fm != NULL);
+
+	g_bTagEdFakeFM = !*fm->name;
+	g_bTagEdFakeFMForcedHasChanges = FALSE;
+
+	Fl_FM_TagEd_Window *pDlg = MakeTagEditor();
+	ASSERT(pDlg != NULL);
+	if (!pDlg)
+		return;
+
+	g_pNotesBuffer = new Fl_Text_Buffer;
+	g_pDescrBuffer = new Fl_Text_Buffer;
+	g_pConfigBuffer = new Fl_Text_Buffer;
+
+	InitTagEdDialog(pDlg, fm);
+
+	RefreshTagDb();
+
+	pDlg->show();
+
+	ASSERT((unsigned int)page < (unsigned int)pTagEdTabs->children());
+
+	pTagEdTabs->value( pTagEdTabs->child(page) );
+
+	if (page == TABPAGE_TAGS)
+		Fl::focus(pTagEdInput);
+
+	while ( pDlg->visible() )
+	{
+		Fl_Widget *o = Fl::readqueue();
+		if (!o) Fl::wait();
 	}
 
-	if (g_bTagEdFakeFM)
+	delete (Fl_Widget*)pDlg;
+
+	g_pTagEdFM = NULL;
+
+	if (g_pNotesBuffer)
+	{
+		delete g_pNotesBuffer;
+		g_pNotesBuffer = NULL;
+	}
+	if (g_pDescrBuffer)
+	{
+		delete g_pDescrBuffer;
+		g_pDescrBuffer = NULL;
+	}
+	if (g_pConfigBuffer)
+	{
+		delete g_pConfigBuffer;
+		g_pConfigBuffer = NULL;
+	}
+
+	if (g_mnuInfoFiles)
 	{
-		// ending dialog in create FM.INI mode, save fm.ini (return dialog if that fails or save dialog is cancelled)
-		if ( !ExportFmIni(fm, TRUE) )
-		{
-			g_bTagEdFakeFMForcedHasChanges = TRUE;
-			return;
-		}
+		delete[] g_mnuInfoFiles;
+		g_mnuInfoFiles = NULL;
 	}
+	g_infoFiles.clear();
+	g_infoFiles.reserve(0);
 
-	CloseTagEditor();
+	// make sure main window is brought to front and activated again
+	// (if the html popup was opened it can cause it to lose activation)
+	pMainWnd->show();
 }
 
 
-static void InitTagEdDialog(Fl_Window *pDlg, FMEntry *fm)
+/////////////////////////////////////////////////////////////////////
+// MAIN WINDOW
+
+static void CaptureUIState()
 {
-	static char sTitle[256];
-	if (*fm->name)
-	{
-		if (_snprintf_s(sTitle, sizeof(sTitle), _TRUNCATE, "%s -- %s", pDlg->label(), fm->GetFriendlyName()) == -1)
-			*sTitle = '\0';
-	}
-	else
-		strcpy(sTitle, $("Create FM.INI"));
-	pDlg->label(sTitle);
+	// dump window stat stuff to config
 
-	g_pTagEdFM = fm;
+	BOOL bWindowMax = MainWndIsMaximizedOS(pMainWnd);
+	BOOL bModified = g_cfg.bWindowMax != bWindowMax
+		|| g_cfg.windowpos[0] != pMainWnd->x() || g_cfg.windowpos[1] != pMainWnd->y()
+		|| g_cfg.windowsize[0] != pMainWnd->w() || g_cfg.windowsize[1] != pMainWnd->h();
 
-	if (g_cfg.windowsize_taged[0] && g_cfg.windowsize_taged[0])
+	g_cfg.bWindowMax = bWindowMax;
+
+	if (!g_cfg.bWindowMax)
 	{
-		// no way to access min size in Fl_Window, so we have to manually define vals, suck!!
-		const int MINW = 540;
-		const int MINH = 180;
-		if (g_cfg.windowsize_taged[0] < MINW)
-			g_cfg.windowsize_taged[0] = MINW;
-		if (g_cfg.windowsize_taged[1] < MINH)
-			g_cfg.windowsize_taged[1] = MINH;
+		g_cfg.windowpos[0] = pMainWnd->x();
+		g_cfg.windowpos[1] = pMainWnd->y();
 
-		pDlg->size(g_cfg.windowsize_taged[0], g_cfg.windowsize_taged[1]);
+		g_cfg.windowsize[0] = pMainWnd->w();
+		g_cfg.windowsize[1] = pMainWnd->h();
 	}
 
-	// center over main window
-	pDlg->position(
-		pMainWnd->x() + ((pMainWnd->w() - pDlg->w()) / 2),
-		pMainWnd->y() + ((pMainWnd->h() - pDlg->h()) / 2)
-		);
+	if ( pFMList->save_col_state(g_cfg.colsizes) )
+		bModified = TRUE;
 
-	// OS specific init of window
-	WndInitOS(pDlg);
+	if (bModified)
+		g_cfg.OnModified();
+}
 
-	//
-	// TABPAGE_MISC
-	//
+static void CloseMainWindow()
+{
+	if (pMainWnd->shown() && !pMainWnd->visible())
+		MainWndRestoreOS(pMainWnd);
 
-	pTagEdNiceName->maximum_size(128);
-	if ( !fm->nicename.empty() )
-		pTagEdNiceName->value( fm->nicename.c_str() );
-	pTagEdName->value(fm->name);
-	if ( !fm->archive.empty() )
-	{
-		pTagEdArchive->value( fm->archive.c_str() );
-		// deactivate control if unverified archive
-		if ( !fm->IsArchived() )
-			pTagEdArchive->deactivate();
-	}
-	else
-		pTagEdArchive->deactivate();
+	CaptureUIState();
 
-	pTagEdRelYear->maximum_size(4);
-	pTagEdRelMonth->maximum_size(2);
-	pTagEdRelDay->maximum_size(2);
-	if (fm->tmReleaseDate)
-	{
-		struct tm *tm = gmtime(&fm->tmReleaseDate);
+	pMainWnd->hide();
+}
 
-		char s[16];
 
-		sprintf(s, "%04d", tm->tm_year + 1900);
-		pTagEdRelYear->value(s);
+static void OnClose(Fl_Widget *, void *)
+{
+	CloseMainWindow();
+}
 
-		sprintf(s, "%02d", tm->tm_mon + 1);
-		pTagEdRelMonth->value(s);
+static void OnResetFilters(Fl_Button *, void *)
+{
+	g_cfg.ResetFilters();
+}
 
-		sprintf(s, "%02d", tm->tm_mday);
-		pTagEdRelDay->value(s);
+static void OnRefreshFilters(Fl_Button *, void *)
+{
+	RefreshFilteredDb();
+}
 
-		if (fm->flags & FMEntry::FLAG_UnverifiedRelDate)
-			pTagEdUnverified->value(1);
-	}
+static void DoFilterNameChanged(Fl_FM_Filter_Input *o)
+{
+	const char *val = o->value();
 
-	if (!g_bTagEdFakeFM)
-	{
-		// populate info file list
+	if (val && *val)
+		g_cfg.SetFilterName(val);
+	else
+		g_cfg.SetFilterName(NULL);
+}
 
-		int nSel = 0;
-		if ( GetDocFiles(fm, g_infoFiles) )
-		{
-			if ( !fm->infofile.empty() )
-			{
-				nSel = -1;
+static void DelayedFilterNameChange(void *p)
+{
+	DoFilterNameChanged((Fl_FM_Filter_Input*)p);
+}
 
-				for (int i=0; i<(int)g_infoFiles.size(); i++)
-					if ( !_stricmp(g_infoFiles[i].c_str(), fm->infofile.c_str()) )
-					{
-						nSel = i;
-						break;
-					}
+static void OnFilterName(Fl_FM_Filter_Input *o, void *)
+{
+	// this gets called when app is closing, avoid doing anything in that case
+	if ( !pMainWnd->visible() )
+		return;
 
-				// if the file no longer exists then default to the first file
-				if (nSel == -1)
-				{
-					fm->infofile = g_infoFiles[0].c_str();
-					fm->flags &= ~FMEntry::FLAG_NoInfoFile;
-					fm->OnModified();
-					nSel = 0;
-				}
-			}
+	Fl::remove_timeout(DelayedFilterNameChange);
 
-			const int MAX_MENU_ITEMS = g_infoFiles.size() + 1;
-			int menu_items = 0;
-			g_mnuInfoFiles = new Fl_Menu_Item[MAX_MENU_ITEMS];
-			Fl_Menu_Item *menu = g_mnuInfoFiles;
+	if ( o->callback_reason_edit() )
+	{
+		// (re-)set expiration timer
+		Fl::add_timeout(1.0, DelayedFilterNameChange, o);
+		return;
+	}
 
-			for (int i=0; i<(int)g_infoFiles.size(); i++)
-			{
-				MENU_ITEM(g_infoFiles[i].c_str(), i);
-			}
-			MENU_END();
-		}
-		else
-		{
-			const int MAX_MENU_ITEMS = 2;
-			int menu_items = 0;
-			g_mnuInfoFiles = new Fl_Menu_Item[MAX_MENU_ITEMS];
-			Fl_Menu_Item *menu = g_mnuInfoFiles;
+	DoFilterNameChanged(o);
+}
 
-			MENU_ITEM($("<none>"), 0);
-			MENU_END();
+static void OnFilterToggle(Fl_FM_Filter_Button *o, void *p)
+{
+	const BOOL bEnabled = o->value();
 
-			// if is installed and no info file is found but previously it had one, then clear it
-			if (fm->IsAvail() && !(fm->flags & FMEntry::FLAG_NoInfoFile))
-			{
-				fm->infofile.clear();
-				fm->flags |= FMEntry::FLAG_NoInfoFile;
-				fm->OnModified();
-			}
-		}
-		pTagEdInfoFile->menu(g_mnuInfoFiles);
-		pTagEdInfoFile->value(g_mnuInfoFiles + nSel);
-		if ((int)g_infoFiles.size() <= 1)
-			pTagEdInfoFile->deactivate();
-		if ( g_infoFiles.empty() )
-			pTagEdViewInfo->deactivate();
-	}
-	else
+	switch ((intptr_t)p)
 	{
-		// replace pTagEdInfoFile/pTagEdViewInfo controls with simple text edit box
-		pTagEdInfoFile->deactivate();
-		pTagEdViewInfo->deactivate();
-		pTagEdInfoFile->hide();
-		pTagEdViewInfo->hide();
+	// status not played
+	case 1: g_cfg.SetFilterShow(FSHOW_NotPlayed, bEnabled); break;
+	// status completed
+	case 2: g_cfg.SetFilterShow(FSHOW_Completed, bEnabled); break;
+	// status in progress
+	case 3: g_cfg.SetFilterShow(FSHOW_InProgress, bEnabled); break;
+	// not available
+	case 4: g_cfg.SetFilterShow(FSHOW_NotAvail, bEnabled); break;
+	// archived
+	case 5: g_cfg.SetFilterShow(FSHOW_ArchivedOnly, bEnabled); break;
+	}
+}
 
-		int X, Y, W, H;
-		X = pTagEdInfoFile->x();
-		Y = pTagEdInfoFile->y();
-		W = pTagEdViewInfo->x() + pTagEdViewInfo->w() - pTagEdInfoFile->x();
-		H = pTagEdViewInfo->h();
+static void OnFilterRating(Fl_Choice *o, void *)
+{
+	const int n = o->value();
 
-		Fl_Input *o = pTagEdFakeInfoFile = new Fl_Input(X, Y, W, H, pTagEdInfoFile->label());
-		o->tooltip( pTagEdInfoFile->tooltip() );
-		o->labelsize( pTagEdInfoFile->labelsize() );
-		o->textsize( pTagEdInfoFile->textsize() );
-		o->align( pTagEdInfoFile->align() );
-		pTagEdInfoFile->parent()->insert(*o, pTagEdInfoFile);
-	}
+	g_cfg.SetFilterRating(n - 1);
+}
 
-	//
-	// TABPAGE_TAGS
-	//
+static void OnFilterPriority(Fl_Choice *o, void *)
+{
+	const int n = o->value();
 
-	// probably way too much for tags, but at least it's not unlimited
-	pTagEdInput->maximum_size(128);
+	g_cfg.SetFilterPriority(n);
+}
+
+static void OnFilterRelFrom(Fl_FM_Filter_Input *o, void *)
+{
+	// this could get called when app is closing, avoid doing anything in that case
+	if ( !pMainWnd->visible() )
+		return;
+
+	const char *val = o->value();
+	if (val && *val)
+	{
+		g_cfg.SetFilterRelease(atoi(val), g_cfg.filtReleaseTo);
 
-	pTagEdAddTag->deactivate();
+		char s[32];
+		if (g_cfg.filtReleaseFrom >= 0)
+			sprintf(s, "%02d", g_cfg.filtReleaseFrom);
+		else
+			*s = 0;
+		pFilterRelDateFrom->value(s);
+		pFilterRelDateFrom->insert_position(pFilterRelDateFrom->size(), 0);
+	}
+	else
+		g_cfg.SetFilterRelease(-1, g_cfg.filtReleaseTo);
+}
 
-	pTagEdPresets->value(g_mnuTagPresetsLabel);
+static void OnFilterRelTo(Fl_FM_Filter_Input *o, void *)
+{
+	// this could get called when app is closing, avoid doing anything in that case
+	if ( !pMainWnd->visible() )
+		return;
 
-	pTagEdGroup->init(fm);
+	const char *val = o->value();
+	if (val && *val)
+	{
+		g_cfg.SetFilterRelease(g_cfg.filtReleaseFrom, atoi(val));
 
-	//
-	// TABPAGE_DESCR
-	//
+		char s[32];
+		if (g_cfg.filtReleaseTo >= 0)
+			sprintf(s, "%02d", g_cfg.filtReleaseTo);
+		else
+			*s = 0;
+		pFilterRelDateTo->value(s);
+		pFilterRelDateTo->insert_position(pFilterRelDateTo->size(), 0);
+	}
+	else
+		g_cfg.SetFilterRelease(g_cfg.filtReleaseFrom, -1);
+}
 
-	pTagEdDescr->box(FLAT_MARGIN_BOX);
-	if (g_cfg.bWrapDescrEditor)
-		pTagEdDescr->wrap_mode(1, 0);
+static void OnPlayOM(Fl_Button *, void *)
+{
+	g_appReturn = kSelFMRet_Cancel;
 
-	pTagEdDescr->buffer(g_pDescrBuffer);
-	if ( !fm->descr.empty() )
+	g_pFMSelData->bRunAfterGame = (g_cfg.returnAfterGame[g_bRunningEditor] == RET_ALWAYS);
+	if (g_pFMSelData->bRunAfterGame)
 	{
-		string s = UnescapeString( fm->descr.c_str() );
-		g_pDescrBuffer->text( s.c_str() );
+		g_cfg.dwLastProcessID = GetProcessIdOS();
+		g_cfg.OnModified();
 	}
 
-	//
-	// TABPAGE_NOTES
-	//
+	CloseMainWindow();
+}
 
-	pTagEdNotes->box(FLAT_MARGIN_BOX);
-	if (g_cfg.bWrapNotesEditor)
-		pTagEdNotes->wrap_mode(1, 0);
+static void PlayFM(BOOL bSetInProgress)
+{
+	FinishStartupScan();
 
-	pTagEdNotes->buffer(g_pNotesBuffer);
-	if ( !fm->notes.empty() )
+	FMEntry *fm = pFMList->selected();
+
+	if (!fm)
 	{
-		string s = UnescapeString( fm->notes.c_str() );
-		g_pNotesBuffer->text( s.c_str() );
+		fl_message_position(pMainWnd);
+		fl_message("%s", $("No FM selected."));
+		return;
 	}
 
-	//
-	// TABPAGE_CONFIG
-	//
-
-	pTagEdConfig->box(FLAT_MARGIN_BOX);
-	pTagEdConfig->wrap_mode(1, 0);
-
-	pTagEdConfig->buffer(g_pConfigBuffer);
-	if  (fm->IsInstalled())
+	if ( !fm->IsInstalled() )
 	{
-		char fname[MAX_PATH_BUF];
-		if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "%s" DIRSEP_STR "fm.cfg", GetRootPath(), fm->name) != -1)
-		{
-			g_pConfigBuffer->loadfile(fname);
-#ifndef _WIN32
-			// remove trailing carriage returns
-			int pos = 0;
-			while (g_pConfigBuffer->findchar_forward(pos, '\r', &pos))
-				g_pConfigBuffer->remove(pos, pos + 1);
-#endif
-			g_pConfigBuffer->add_modify_callback(OnModifyFMConfig, &g_bTagEdFMConfigModified);
-		}
+		// if archived then ask to do an install and start playing if successful
+		if (!fm->IsArchived() || !InstallFM(fm))
+			return;
 	}
-	g_bTagEdFMConfigModified = FALSE;
-
-	//
-	// TABPAGE_MODS
-	//
 
-	vector<string> modpaths = GetModPaths();
-	for (size_t i = 0; i < modpaths.size(); i++)
-		pTagEdMods->add(modpaths[i].c_str(), 1);
-	if ( !fm->modexclude.empty() )
+	// if g_pFMSelData->sLanguage is set it means that "fm_language" was defined in a config file, if that's the case
+	// it's treated like a forced FM language setting (mainly to allow FM authors to have an easy way to force different
+	// languages without having to change dark's language setting), it's ignored if not supported by the FM
+#ifdef T3_SUPPORT
+	if (!g_bRunningThief3)
 	{
-		if (fm->modexclude == "*")
-		{
-			pTagEdMods->check_none();
-		}
+#endif
+	if (*g_pFMSelData->sLanguage)
+	{
+		// check if the requested language is supported by the FM
+		std::list<string> langlist;
+		GetLanguages(fm, langlist);
+
+		if ( IsLanguageInList(langlist, g_pFMSelData->sLanguage) )
+			g_pFMSelData->bForceLanguage = TRUE;
 		else
 		{
-			vector<string> modexcludes;
-			size_t cur = 0, next;
-
-			do
-			{
-				next = fm->modexclude.find_first_of("+", cur);
-				string path = fm->modexclude.substr(cur, next - cur);
-				if (path.size() > 0)
-					modexcludes.push_back(path);
-				cur = next + 1;
-			}
-			while (next != string::npos);
-
-			for (size_t i = 0; i < modexcludes.size(); i++)
-			{
-				for (int j = 1; j <= pTagEdMods->nitems(); j++)
-				{
-					const char *text = pTagEdMods->text(j);
-					if (text && !_stricmp(modexcludes[i].c_str(), text))
-					{
-						pTagEdMods->checked(j, 0);
-						break;
-					}
-				}
-			}
+			// language not supported, use fallback
+			if ( !langlist.empty() )
+				strcpy_safe(g_pFMSelData->sLanguage, g_pFMSelData->nLanguageLen, langlist.front().c_str());
+			else
+				*g_pFMSelData->sLanguage = 0;
+			g_pFMSelData->bForceLanguage = FALSE;
 		}
 	}
-
-	//
-
-	// disable all controls that aren't relevant for standalone FM.INI creation
-	if (g_bTagEdFakeFM)
+	else
 	{
-		pTagEdName->deactivate();
-		pTagEdUnverified->deactivate();
-		pTagEdMods->deactivate();
-		pTagEdNotes->deactivate();
-		pTagEdConfig->deactivate();
+		// determine FM default language (used if the FM doesn't support the language set in dark by the "language" cfg var)
+		string lang;
+		if ( GetFallbackLanguage(fm, lang) )
+			strcpy_safe(g_pFMSelData->sLanguage, g_pFMSelData->nLanguageLen, lang.c_str());
+		else
+			*g_pFMSelData->sLanguage = 0;
+		g_pFMSelData->bForceLanguage = FALSE;
 	}
 #ifdef T3_SUPPORT
-	else if (g_bRunningThief3)
-	{
-		pTagEdConfig->deactivate();
-		pTagEdMods->deactivate();
 	}
 #endif
-	else if (!fm->IsInstalled())
-		pTagEdConfig->deactivate();
-}
-
-static void DoTagEditor(FMEntry *fm, int page)
-{
-	ASSERT(fm != NULL);
-
-	g_bTagEdFakeFM = !*fm->name;
-	g_bTagEdFakeFMForcedHasChanges = FALSE;
-
-	Fl_FM_TagEd_Window *pDlg = MakeTagEditor();
-	ASSERT(pDlg != NULL);
-	if (!pDlg)
-		return;
-
-	g_pNotesBuffer = new Fl_Text_Buffer;
-	g_pDescrBuffer = new Fl_Text_Buffer;
-	g_pConfigBuffer = new Fl_Text_Buffer;
 
-	InitTagEdDialog(pDlg, fm);
+	fm->OnStart(bSetInProgress);
 
-	RefreshTagDb();
+#ifdef _WIN32
+	strcpy_safe(g_pFMSelData->sName, g_pFMSelData->nMaxNameLen, DemoteStrOS(fm->name).c_str());
+#else
+	strcpy_safe(g_pFMSelData->sName, g_pFMSelData->nMaxNameLen, fm->name);
+#endif
 
-	pDlg->show();
+#ifdef T3_SUPPORT
+	if ( !fm->modexclude.empty() && !g_bRunningThief3 )
+#else
+	if ( !fm->modexclude.empty() )
+#endif
+#ifdef _WIN32
+		strcpy_safe(g_pFMSelData->sModExcludePaths, g_pFMSelData->nMaxModExcludeLen, DemoteStrOS(fm->modexclude.c_str()).c_str());
+#else
+		strcpy_safe(g_pFMSelData->sModExcludePaths, g_pFMSelData->nMaxModExcludeLen, fm->modexclude.c_str());
+#endif
 
-	ASSERT((unsigned int)page < (unsigned int)pTagEdTabs->children());
+	g_pFMSelData->bRunAfterGame = (g_cfg.returnAfterGame[g_bRunningEditor] != RET_NEVER);
+	if (g_pFMSelData->bRunAfterGame)
+		g_cfg.dwLastProcessID = GetProcessIdOS();
 
-	pTagEdTabs->value( pTagEdTabs->child(page) );
+	g_appReturn = kSelFMRet_OK;
 
-	if (page == TABPAGE_TAGS)
-		Fl::focus(pTagEdInput);
+	CloseMainWindow();
+}
 
-	while ( pDlg->visible() )
-	{
-		Fl_Widget *o = Fl::readqueue();
-		if (!o) Fl::wait();
-	}
+static void OnPlayFM(Fl_FM_Return_Button *, void *)
+{
+	PlayFM(FALSE);
+}
 
-	delete (Fl_Widget*)pDlg;
+static void OnStartFM(Fl_Button *, void *)
+{
+	PlayFM(TRUE);
+}
 
-	g_pTagEdFM = NULL;
+static void OnExit(Fl_Button *, void *)
+{
+	g_appReturn = kSelFMRet_ExitGame;
+	CloseMainWindow();
+}
 
-	if (g_pNotesBuffer)
-	{
-		delete g_pNotesBuffer;
-		g_pNotesBuffer = NULL;
-	}
-	if (g_pDescrBuffer)
-	{
-		delete g_pDescrBuffer;
-		g_pDescrBuffer = NULL;
-	}
-	if (g_pConfigBuffer)
+static void OnListSelChange(FMEntry *fm)
+{
+	if (!fm || !fm->IsAvail() || (!fm->IsInstalled() && g_sTempDir.empty()))
 	{
-		delete g_pConfigBuffer;
-		g_pConfigBuffer = NULL;
+		pBtnPlayFM->deactivate();
+		pBtnStartFM->deactivate();
 	}
-
-	if (g_mnuInfoFiles)
+	else
 	{
-		delete[] g_mnuInfoFiles;
-		g_mnuInfoFiles = NULL;
+		pBtnPlayFM->activate();
+		if (fm->status == FMEntry::STATUS_InProgress)
+			pBtnStartFM->deactivate();
+		else
+			pBtnStartFM->activate();
 	}
-	g_infoFiles.clear();
-	g_infoFiles.reserve(0);
-
-	// make sure main window is brought to front and activated again
-	// (if the html popup was opened it can cause it to lose activation)
-	pMainWnd->show();
 }
 
 
-/////////////////////////////////////////////////////////////////////
-// MAIN WINDOW
-
-static void CaptureUIState()
+static void ShowBadDirWarning()
 {
-	// dump window stat stuff to config
+	if ( g_invalidDirs.empty() )
+		return;
 
-	BOOL bWindowMax = MainWndIsMaximizedOS(pMainWnd);
-	BOOL bModified = g_cfg.bWindowMax != bWindowMax
-		|| g_cfg.windowpos[0] != pMainWnd->x() || g_cfg.windowpos[1] != pMainWnd->y()
-		|| g_cfg.windowsize[0] != pMainWnd->w() || g_cfg.windowsize[1] != pMainWnd->h();
+	int lines = (int)g_invalidDirs.size();
+	if (lines > 16)
+		lines = 16;
 
-	g_cfg.bWindowMax = bWindowMax;
+	string s;
+	s.reserve(2048);
 
-	if (!g_cfg.bWindowMax)
+	s.append($("Following FM directories were ignored due\nto exceeding the max name length of 30:\n"));
+	for (int i=0; i<lines; i++)
 	{
-		g_cfg.windowpos[0] = pMainWnd->x();
-		g_cfg.windowpos[1] = pMainWnd->y();
+		s.append("\n");
+		s.append(g_invalidDirs[i]);
+	}
 
-		g_cfg.windowsize[0] = pMainWnd->w();
-		g_cfg.windowsize[1] = pMainWnd->h();
+	if ((int)g_invalidDirs.size() > lines)
+	{
+		s.append("\n...");
 	}
 
-	if ( pFMList->save_col_state(g_cfg.colsizes) )
-		bModified = TRUE;
+	fl_message_position(pMainWnd);
+	fl_alert("%s", s.c_str());
 
-	if (bModified)
-		g_cfg.OnModified();
+	g_invalidDirs.clear();
 }
 
-static void CloseMainWindow()
+static BOOL ValidateFmPath()
 {
-	if (pMainWnd->shown() && !pMainWnd->visible())
-		MainWndRestoreOS(pMainWnd);
+	// make sure the FM path exists
 
-	CaptureUIState();
+	struct stat st = {};
 
-	pMainWnd->hide();
-}
+	if (!fl_stat(GetRootPath(), &st) && (st.st_mode & S_IFDIR))
+		return TRUE;
 
+	fl_message_position(pMainWnd);
 
-static void OnClose(Fl_Widget *, void *)
-{
-	CloseMainWindow();
-}
+	if ( !fl_choice($("The FM path \"%s\" was not found or a valid directory.\nCreate the directory?"), $("Exit"), fl_yes, NULL, GetRootPath()) )
+		return FALSE;
 
-static void OnResetFilters(Fl_Button *, void *)
-{
-	g_cfg.ResetFilters();
-}
+	if ( !MkDirParentsOS(GetRootPath()) )
+		return TRUE;
 
-static void OnRefreshFilters(Fl_Button *, void *)
-{
-	RefreshFilteredDb();
+	fl_alert($("Failed to create the FM path \"%s\", create it or configure a different path and run again."), GetRootPath());
+
+	return FALSE;
 }
 
-static void DoFilterNameChanged(Fl_FM_Filter_Input *o)
+static BOOL ValidateArchiveRepo(BOOL bFirstRun)
 {
-	const char *val = o->value();
+	if ( g_cfg.archiveRepo.empty() )
+	{
+		fl_message_position(pMainWnd);
 
-	if (val && *val)
-		g_cfg.SetFilterName(val);
-	else
-		g_cfg.SetFilterName(NULL);
-}
+		// on first run ask if user wants to configure a repo path
+		if (bFirstRun && fl_choice("%s", fl_no, fl_yes, NULL,
+			$("Would you like to configure an FM archive path now?\n\n"
+			"(If you have a directory where you keep a collection of\n"
+			"archived/zipped FMs, FMSel will be able to install FMs\n"
+			"from it.)")) )
+		{
+			ConfigArchivePath(TRUE);
 
-static void DelayedFilterNameChange(void *p)
-{
-	DoFilterNameChanged((Fl_FM_Filter_Input*)p);
-}
+			if ( g_cfg.archiveRepo.empty() )
+				return TRUE;
+		}
+		else
+		{
+			return TRUE;
+		}
+	}
 
-static void OnFilterName(Fl_FM_Filter_Input *o, void *)
-{
-	// this gets called when app is closing, avoid doing anything in that case
-	if ( !pMainWnd->visible() )
-		return;
+	// make sure that archive path is found
 
-	Fl::remove_timeout(DelayedFilterNameChange);
+	struct stat st = {};
 
-	if ( o->callback_reason_edit() )
+	fl_message_position(pMainWnd);
+
+	if (!fl_stat(g_cfg.archiveRepo.c_str(), &st) && (st.st_mode & S_IFDIR))
 	{
-		// (re-)set expiration timer
-		Fl::add_timeout(1.0, DelayedFilterNameChange, o);
-		return;
+		// check that repo path isn't the same as the FM path
+		if ( IsArchivePathSameAsFmPath( g_cfg.archiveRepo.c_str() ) )
+		{
+			fl_alert("%s", $("The archive path may not be inside the FM path, or vice versa.\nArchive support disabled. Reconfigure the archive path."));
+			return FALSE;
+		}
+
+		g_cfg.bRepoOK = TRUE;
+		return TRUE;
 	}
 
-	DoFilterNameChanged(o);
+	fl_alert($("Archive repository/collection path \"%s\" was not found or a valid directory."), g_cfg.archiveRepo.c_str());
+
+	return FALSE;
 }
 
-static void OnFilterToggle(Fl_FM_Filter_Button *o, void *p)
-{
-	const BOOL bEnabled = o->value();
 
-	switch ((intptr_t)p)
-	{
-	// status not played
-	case 1: g_cfg.SetFilterShow(FSHOW_NotPlayed, bEnabled); break;
-	// status completed
-	case 2: g_cfg.SetFilterShow(FSHOW_Completed, bEnabled); break;
-	// status in progress
-	case 3: g_cfg.SetFilterShow(FSHOW_InProgress, bEnabled); break;
-	// not available
-	case 4: g_cfg.SetFilterShow(FSHOW_NotAvail, bEnabled); break;
-	// archived
-	case 5: g_cfg.SetFilterShow(FSHOW_ArchivedOnly, bEnabled); break;
-	}
+static void InvokeAddTagFilter(const char *tag)
+{
+	pTagFilterGroup->ExternalFilterAdd(tag);
 }
 
-static void OnFilterRating(Fl_Choice *o, void *)
+static void UpdateFilterControls()
 {
-	const int n = o->value();
+	pFilterName->value( g_cfg.filtName.c_str() );
+	pFilterRating->value(g_cfg.filtMinRating + 1);
+	pFilterPrio->value(g_cfg.filtMinPrio);
+	pFilterNotPlayed->value( !!(g_cfg.filtShow & FSHOW_NotPlayed) );
+	pFilterCompleted->value( !!(g_cfg.filtShow & FSHOW_Completed) );
+	pFilterInProgress->value( !!(g_cfg.filtShow & FSHOW_InProgress) );
+	pFilterNotAvail->value( !!(g_cfg.filtShow & FSHOW_NotAvail) );
+	pFilterArchived->value( !!(g_cfg.filtShow & FSHOW_ArchivedOnly) );
 
-	g_cfg.SetFilterRating(n - 1);
+	char s[32];
+	if (g_cfg.filtReleaseFrom >= 0)
+		sprintf(s, "%02d", g_cfg.filtReleaseFrom);
+	else
+		*s = 0;
+	pFilterRelDateFrom->value(s);
+	if (g_cfg.filtReleaseTo >= 0)
+		sprintf(s, "%02d", g_cfg.filtReleaseTo);
+	else
+		*s = 0;
+	pFilterRelDateTo->value(s);
+
+	pTagFilterGroup->OnFilterChanged();
 }
 
-static void OnFilterPriority(Fl_Choice *o, void *)
+
+static void InitControls()
 {
-	const int n = o->value();
+	// set icons in priority filter combo box
+	g_mnuFiltPrio[1].image(imgPrio[0]);
+	g_mnuFiltPrio[2].image(imgPrio[1]);
+	g_mnuFiltPrio[3].image(imgPrio[2]);
 
-	g_cfg.SetFilterPriority(n);
-}
+	pTagFilterGroup->init();
 
-static void OnFilterRelFrom(Fl_FM_Filter_Input *o, void *)
-{
-	// this could get called when app is closing, avoid doing anything in that case
-	if ( !pMainWnd->visible() )
-		return;
+	UpdateFilterControls();
 
-	const char *val = o->value();
-	if (val && *val)
-	{
-		g_cfg.SetFilterRelease(atoi(val), g_cfg.filtReleaseTo);
+	pBtnPlayFM->deactivate();
+	pBtnStartFM->deactivate();
 
-		char s[32];
-		if (g_cfg.filtReleaseFrom >= 0)
-			sprintf(s, "%02d", g_cfg.filtReleaseFrom);
-		else
-			*s = 0;
-		pFilterRelDateFrom->value(s);
-		pFilterRelDateFrom->insert_position(pFilterRelDateFrom->size(), 0);
-	}
-	else
-		g_cfg.SetFilterRelease(-1, g_cfg.filtReleaseTo);
+	pFMList->post_init();
+
+	// initial selection
+	FMEntry *fm = g_cfg.lastfm.empty() ? NULL : GetFM( g_cfg.lastfm.c_str() );
+	pFMList->select(fm, TRUE);
+	OnListSelChange(fm ? fm : pFMList->selected());
 }
 
-static void OnFilterRelTo(Fl_FM_Filter_Input *o, void *)
+static void InitMainWnd()
 {
-	// this could get called when app is closing, avoid doing anything in that case
-	if ( !pMainWnd->visible() )
-		return;
+	static char sTitle[256];
+#ifdef _WIN32
+	sprintf(sTitle, "%s -- [FMSel " FMSEL_VERSION "]", PromoteStrOS(g_pFMSelData->sGameVersion).c_str());
+#else
+	sprintf(sTitle, "%s -- [FMSel " FMSEL_VERSION "]", g_pFMSelData->sGameVersion);
+#endif
+	pMainWnd->label(sTitle);
 
-	const char *val = o->value();
-	if (val && *val)
+	if (g_cfg.windowsize[0] && g_cfg.windowsize[0])
 	{
-		g_cfg.SetFilterRelease(g_cfg.filtReleaseFrom, atoi(val));
+		// no way to access min size in Fl_Window, so we have to manually define vals, suck!!
+		const int MINW = 630;
+		const int MINH = 380;
+		if (g_cfg.windowsize[0] < MINW)
+			g_cfg.windowsize[0] = MINW;
+		if (g_cfg.windowsize[1] < MINH)
+			g_cfg.windowsize[1] = MINH;
+
+		pMainWnd->size(g_cfg.windowsize[0], g_cfg.windowsize[1]);
+	}
 
-		char s[32];
-		if (g_cfg.filtReleaseTo >= 0)
-			sprintf(s, "%02d", g_cfg.filtReleaseTo);
-		else
-			*s = 0;
-		pFilterRelDateTo->value(s);
-		pFilterRelDateTo->insert_position(pFilterRelDateTo->size(), 0);
+	if (g_cfg.windowpos[0] != POS_UNDEF && g_cfg.windowpos[0] != POS_UNDEF)
+	{
+		pMainWnd->position(g_cfg.windowpos[0], g_cfg.windowpos[1]);
 	}
 	else
-		g_cfg.SetFilterRelease(g_cfg.filtReleaseFrom, -1);
-}
+	{
+		// center on desktop
+		pMainWnd->position(
+			Fl::x() + ((Fl::w() - pMainWnd->w()) / 2),
+			Fl::y() + ((Fl::h() - pMainWnd->h()) / 2)
+			);
+	}
 
-static void OnPlayOM(Fl_Button *, void *)
-{
-	g_appReturn = kSelFMRet_Cancel;
+	// do OS specific init of main window
+	MainWndInitOS(pMainWnd);
 
-	g_pFMSelData->bRunAfterGame = (g_cfg.returnAfterGame[g_bRunningEditor] == RET_ALWAYS);
-	if (g_pFMSelData->bRunAfterGame)
+	if (g_bRunningEditor)
 	{
-		g_cfg.dwLastProcessID = GetProcessIdOS();
-		g_cfg.OnModified();
+		pBtnStartFM->hide();
+		pBtnPlayFM->label($("Edit FM"));
 	}
 
-	CloseMainWindow();
+	pFMList->post_init_header();
 }
 
-static void PlayFM(BOOL bSetInProgress)
-{
-	FMEntry *fm = pFMList->selected();
 
-	if (!fm)
-	{
-		fl_message_position(pMainWnd);
-		fl_message("%s", $("No FM selected."));
-		return;
-	}
+static void InitTempCache()
+{
+	// init temp dir used to extract files from archive that can't be accessed as a mem buffer
+	// the temp dir is named ".fmsel.cache", in this function we ensure that the dir exists,
+	// and delete its contents to clear out temp files from a previous session
 
-	if ( !fm->IsInstalled() )
+	// could put it in the system temp dir, but for now we use the fmdir (for portable apps compliance)
+	const char *tmp = GetRootPath();
+	/*const char *tmp = fl_getenv("TMP");
+	if (!tmp || !fl_filename_isdir(tmp))
 	{
-		// if archived then ask to do an install and start playing if successful
-		if (!fm->IsArchived() || !InstallFM(fm))
+		tmp = fl_getenv("TEMP");
+		if (!tmp || !fl_filename_isdir(tmp))
+		{
+			TRACE("Failed to create temp dir, no valid TMP/TEMP environment var");
 			return;
-	}
+		}
+	}*/
 
-	// if g_pFMSelData->sLanguage is set it means that "fm_language" was defined in a config file, if that's the case
-	// it's treated like a forced FM language setting (mainly to allow FM authors to have an easy way to force different
-	// languages without having to change dark's language setting), it's ignored if not supported by the FM
-#ifdef T3_SUPPORT
-	if (!g_bRunningThief3)
-	{
-#endif
-	if (*g_pFMSelData->sLanguage)
-	{
-		// check if the requested language is supported by the FM
-		std::list<string> langlist;
-		GetLanguages(fm, langlist);
+	g_sTempDir = tmp;
+	if ( !isdirsep(g_sTempDir[g_sTempDir.size()-1]) )
+		g_sTempDir += DIRSEP_STR;
 
-		if ( IsLanguageInList(langlist, g_pFMSelData->sLanguage) )
-			g_pFMSelData->bForceLanguage = TRUE;
-		else
+	g_sTempDir += ".fmsel.cache" DIRSEP_STR;
+	if ( fl_filename_isdir(g_sTempDir.c_str()) )
+	{
+		// dir already existed, delete contents
+		dirent **files;
+		int nFiles = fl_filename_list(g_sTempDir.c_str(), &files, NULL);
+		if (nFiles > 0)
 		{
-			// language not supported, use fallback
-			if ( !langlist.empty() )
-				strcpy_safe(g_pFMSelData->sLanguage, g_pFMSelData->nLanguageLen, langlist.front().c_str());
-			else
-				*g_pFMSelData->sLanguage = 0;
-			g_pFMSelData->bForceLanguage = FALSE;
+			string s;
+
+			for (int i=0; i<nFiles; i++)
+			{
+				dirent *f = files[i];
+
+				int len = strlen(f->d_name);
+				if ( isdirsep(f->d_name[len-1]) )
+				{
+					// subdir (or ./ or ../)
+					if (strcmp(f->d_name, "./") && strcmp(f->d_name, "../"))
+					{
+						f->d_name[len-1] = 0;
+						s = g_sTempDir + f->d_name;
+
+						if ( DelTree( s.c_str() ) )
+						{
+							TRACE("deleted temp dir subdir: %s", s.c_str());
+						}
+						else
+						{
+							TRACE("failed to delete temp dir subdir: %s", s.c_str());
+						}
+					}
+				}
+				else
+				{
+					s = g_sTempDir + f->d_name;
+					if ( !unlink_forced( s.c_str() ) )
+					{
+						TRACE("deleted temp dir file: %s", s.c_str());
+					}
+					else
+					{
+						TRACE("failed to delete temp dir file: %s", s.c_str());
+					}
+				}
+			}
+
+			fl_filename_free_list(&files, nFiles);
 		}
 	}
 	else
 	{
-		// determine FM default language (used if the FM doesn't support the language set in dark by the "language" cfg var)
-		string lang;
-		if ( GetFallbackLanguage(fm, lang) )
-			strcpy_safe(g_pFMSelData->sLanguage, g_pFMSelData->nLanguageLen, lang.c_str());
+		// dir doesn't exist, create it
+		if ( fl_mkdir(g_sTempDir.c_str(), DEF_DIR_MODE) )
+		{
+			// failed to create
+			TRACE("Failed to create temp dir %s", g_sTempDir.c_str());
+			g_sTempDir.clear();
+		}
 		else
-			*g_pFMSelData->sLanguage = 0;
-		g_pFMSelData->bForceLanguage = FALSE;
-	}
-#ifdef T3_SUPPORT
+		{
+			TRACE("created temp dir: %s", g_sTempDir.c_str());
+		}
 	}
-#endif
-
-	fm->OnStart(bSetInProgress);
 
+	if ( !g_sTempDir.empty() )
+	{
+		// generate absolute path for temp dir
+		char fullpath[MAX_PATH_BUF];
+		fl_filename_absolute(fullpath, sizeof(fullpath), g_sTempDir.c_str());
 #ifdef _WIN32
-	strcpy_safe(g_pFMSelData->sName, g_pFMSelData->nMaxNameLen, DemoteStrOS(fm->name).c_str());
-#else
-	strcpy_safe(g_pFMSelData->sName, g_pFMSelData->nMaxNameLen, fm->name);
+		for (char *s=fullpath; *s; s++)
+			if (*s == '/')
+				*s = '\\';
 #endif
+		g_sTempDirAbs = fullpath;
+	}
+}
 
-#ifdef T3_SUPPORT
-	if ( !fm->modexclude.empty() && !g_bRunningThief3 )
-#else
-	if ( !fm->modexclude.empty() )
-#endif
-#ifdef _WIN32
-		strcpy_safe(g_pFMSelData->sModExcludePaths, g_pFMSelData->nMaxModExcludeLen, DemoteStrOS(fm->modexclude.c_str()).c_str());
-#else
-		strcpy_safe(g_pFMSelData->sModExcludePaths, g_pFMSelData->nMaxModExcludeLen, fm->modexclude.c_str());
-#endif
+void ValidateTempCache()
+{
+	if ( !g_sTempDir.empty() )
+		return;
 
-	g_pFMSelData->bRunAfterGame = (g_cfg.returnAfterGame[g_bRunningEditor] != RET_NEVER);
-	if (g_pFMSelData->bRunAfterGame)
-		g_cfg.dwLastProcessID = GetProcessIdOS();
+	// one more try to initialize the temp dir
+	InitTempCache();
 
-	g_appReturn = kSelFMRet_OK;
+	if ( !g_sTempDir.empty() )
+		return;
 
-	CloseMainWindow();
+	fl_message_position(pMainWnd);
+	fl_alert(
+		$("Failed to create the temp/cache directory \"%s%s.fmsel.cache\".\n"
+		"Some functionality like uninstalling FMs will not be available"),
+		GetRootPath(), DIRSEP_STR);
 }
 
-static void OnPlayFM(Fl_FM_Return_Button *, void *)
+
+extern int FL_NORMAL_SIZE;
+
+static void fl_imagetext_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
 {
-	PlayFM(FALSE);
+	fl_font(o->font, o->size);
+	fl_color((Fl_Color)o->color);
+	if (o->image)
+	{
+		const int imgw = o->image->w();
+		fl_draw(o->value, X+imgw, Y, W-imgw, H, (Fl_Align)(FL_ALIGN_CENTER|FL_ALIGN_INSIDE));
+		o->image->draw(X, Y+((H-o->image->h())/2));
+	}
+	else
+		fl_draw(o->value, X, Y, W, H, align);
 }
 
-static void OnStartFM(Fl_Button *, void *)
+static void fl_imagetext_measure(const Fl_Label* o, int& W, int& H)
 {
-	PlayFM(TRUE);
+	fl_font(o->font, o->size);
+	fl_measure(o->value, W, H);
+	if (o->image)
+	{
+		W += o->image->w() + 2;
+		if (o->image->h() > H)
+			H = o->image->h();
+	}
 }
 
-static void OnExit(Fl_Button *, void *)
+static void fl_radioempty_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
 {
-	g_appReturn = kSelFMRet_ExitGame;
-	CloseMainWindow();
+	fl_font(o->font, o->size);
+	fl_color((Fl_Color)o->color);
+
+	X += imgMenuRadio.w() + 2;
+
+	fl_draw(o->value, X, Y, W, H, align);
 }
 
-static void OnListSelChange(FMEntry *fm)
+static void fl_radioset_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
 {
-	if (!fm || !fm->IsAvail() || (!fm->IsInstalled() && g_sTempDir.empty()))
-	{
-		pBtnPlayFM->deactivate();
-		pBtnStartFM->deactivate();
-	}
-	else
-	{
-		pBtnPlayFM->activate();
-		if (fm->status == FMEntry::STATUS_InProgress)
-			pBtnStartFM->deactivate();
-		else
-			pBtnStartFM->activate();
-	}
+	fl_font(o->font, o->size);
+	//fl_color((Fl_Color)o->color);
+	fl_color(FL_FOREGROUND_COLOR);
+
+	imgMenuRadio.draw(X, Y+((H-imgMenuRadio.h())/2));
+	X += imgMenuRadio.w() + 2;
+
+	fl_draw(o->value, X, Y, W, H, align);
 }
 
-
-static void ShowBadDirWarning()
+static void fl_radio_measure(const Fl_Label* o, int& W, int& H)
 {
-	if ( g_invalidDirs.empty() )
-		return;
-
-	int lines = (int)g_invalidDirs.size();
-	if (lines > 16)
-		lines = 16;
+	fl_font(o->font, o->size);
+	fl_measure(o->value, W, H);
 
-	string s;
-	s.reserve(2048);
+	W += imgMenuRadio.w() + 4;
+	if (imgMenuRadio.h() > H)
+		H = imgMenuRadio.h();
+}
 
-	s.append($("Following FM directories were ignored due\nto exceeding the max name length of 30:\n"));
-	for (int i=0; i<lines; i++)
+// this is a stripped down version of fl_register_images() that registers the jpeg image type reduce dll bloat
+static Fl_Image *fl_check_images_jpeg(const char *name, uchar *header, int)
+{
+	if (memcmp(header, "\377\330\377", 3) == 0 && header[3] >= 0xc0 && header[3] <= 0xef)
 	{
-		s.append("\n");
-		s.append(g_invalidDirs[i]);
-	}
+		// (see g_pJpegLock)
+		EnterLockOS(g_pJpegLock);
+		Fl_Image *img = new Fl_JPEG_Image(name);
+		LeaveLockOS(g_pJpegLock);
 
-	if ((int)g_invalidDirs.size() > lines)
-	{
-		s.append("\n...");
+		return img;
 	}
 
-	fl_message_position(pMainWnd);
-	fl_alert("%s", s.c_str());
+	return 0;
+}
+static void fl_register_jpeg()
+{
+	Fl_Shared_Image::add_handler(fl_check_images_jpeg);
+}
 
-	g_invalidDirs.clear();
+static void draw_flatmarginbox(int x, int y, int w, int h, Fl_Color c)
+{
+	fl_color(c);
+	fl_rectf(x+3, y+3, w-6, h-6);
+	fl_color( fl_themed_rgb_color(210,210,210) );
+	fl_rect(x, y, w, h);
+	fl_color( fl_themed_rgb_color(230,230,230) );
+	fl_rect(x+1, y+1, w-2, h-2);
+	fl_rect(x+2, y+2, w-4, h-4);
 }
 
-static BOOL ValidateFmPath()
+static void InitMenuDef(Fl_Menu_Item *menu, int count)
 {
-	// make sure the FM path exists
+	if (FL_NORMAL_SIZE == 12)
+		return;
 
-	struct stat st = {};
+	for (int i=0; i<count; i++)
+	{
+		if (menu->label() && menu->labelsize() == 12)
+			menu->labelsize(FL_NORMAL_SIZE);
 
-	if (!fl_stat(GetRootPath(), &st) && (st.st_mode & S_IFDIR))
-		return TRUE;
+		menu++;
+	}
+}
 
-	fl_message_position(pMainWnd);
+static void InitFLTK()
+{
+	if (!g_pJpegLock)
+		g_pJpegLock = CreateLockOS();
 
-	if ( !fl_choice($("The FM path \"%s\" was not found or a valid directory.\nCreate the directory?"), $("Exit"), fl_yes, NULL, GetRootPath()) )
-		return FALSE;
+#ifdef LOCALIZATION_SUPPORT
+	// localize standard button labels
+	fl_no = $("No");
+	fl_yes = $("Yes");
+	fl_ok = $("OK");
+	fl_cancel = $("Cancel");
+	fl_close = $("Close");
 
-	if ( !MkDirParentsOS(GetRootPath()) )
-		return TRUE;
+	// localize misc other globals
 
-	fl_alert($("Failed to create the FM path \"%s\", create it or configure a different path and run again."), GetRootPath());
+	g_mnuTagPresetsLabel[0].label( $(g_mnuTagPresetsLabel[0].label()) );
+	_snprintf_s(TAGPRESET_CAT_CUST, sizeof(TAGPRESET_CAT_CUST), _TRUNCATE, "<%s>", $("custom"));
 
-	return FALSE;
-}
+	// copy original untranslated tag preset names
+	for (unsigned int i=0; i<sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]); i++)
+		g_tagPresetsEnglish[i] = g_mnuTagPresets[i].text;
 
-static BOOL ValidateArchiveRepo(BOOL bFirstRun)
-{
-	if ( g_cfg.archiveRepo.empty() )
+	// localize tag presets (categories are displayed in both english and localized because manual
+	// tag entry still needs to be typed in english)
+	for (unsigned int i=0; i<sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]); i++)
 	{
-		fl_message_position(pMainWnd);
+		if (!g_tagPresetsEnglish[i])
+			continue;
 
-		// on first run ask if user wants to configure a repo path
-		if (bFirstRun && fl_choice("%s", fl_no, fl_yes, NULL,
-			$("Would you like to configure an FM archive path now?\n\n"
-			"(If you have a directory where you keep a collection of\n"
-			"archived/zipped FMs, FMSel will be able to install FMs\n"
-			"from it.)")) )
+		const char *colon = strchr(g_tagPresetsEnglish[i], ':');
+		if (colon && colon != g_tagPresetsEnglish[i])
 		{
-			ConfigArchivePath(TRUE);
+			// tag category
 
-			if ( g_cfg.archiveRepo.empty() )
-				return TRUE;
-		}
-		else
-		{
-			return TRUE;
+			// get category name without colon
+			char cat[512];
+			int n = colon - g_tagPresetsEnglish[i];
+			ASSERT(n < 512);
+			memcpy(cat, g_tagPresetsEnglish[i], n);
+			cat[n] = 0;
+
+			// if localized then show both english and localized strings
+			const char *catloc = $tag(cat);
+			if (catloc != cat)
+			{
+				char s[1024];
+				sprintf(s, "%s: (%s)", catloc, g_tagPresetsEnglish[i]);
+				g_mnuTagPresets[i].text = g_tagPresetsExtraAllocated[i] = _strdup(s);
+			}
 		}
+		else if (!g_mnuTagPresets[i].user_data_ || g_mnuTagPresets[i].text != TAGPRESET_CAT_CUST)
+			// regular tag
+			g_mnuTagPresets[i].text = $tag(g_mnuTagPresets[i].text);
 	}
+#endif
 
-	// make sure that archive path is found
+	// enable FLTK thread support (needed for worker threads posting callbacks to the main thread with Fl::awake)
+	Fl::lock();
 
-	struct stat st = {};
+	Fl::visual(FL_RGB);
 
-	fl_message_position(pMainWnd);
+	fl_register_jpeg();
 
-	if (!fl_stat(g_cfg.archiveRepo.c_str(), &st) && (st.st_mode & S_IFDIR))
+#ifndef NO_FLEET
+	if (g_cfg.uicolors >= 0 && g_cfg.uicolors < fle_num_colors())
+		fle_set_colors(fle_colors_name(g_cfg.uicolors));
+#endif
+	if (g_cfg.uitheme >= 0 && g_cfg.uitheme < Fl_Scheme::num_schemes())
+		Fl::scheme(Fl_Scheme::names()[g_cfg.uitheme]);
+#ifndef NO_FLEET
+	else
 	{
-		// check that repo path isn't the same as the FM path
-		if ( IsArchivePathSameAsFmPath( g_cfg.archiveRepo.c_str() ) )
-		{
-			fl_alert("%s", $("The archive path may not be inside the FM path, or vice versa.\nArchive support disabled. Reconfigure the archive path."));
-			return FALSE;
-		}
-
-		g_cfg.bRepoOK = TRUE;
-		return TRUE;
+		int i = g_cfg.uitheme - Fl_Scheme::num_schemes();
+		if (i >= 0 && i < fle_num_schemes())
+			fle_set_scheme(fle_scheme_name(i));
 	}
+#endif
 
-	fl_alert($("Archive repository/collection path \"%s\" was not found or a valid directory."), g_cfg.archiveRepo.c_str());
+	FL_NORMAL_SIZE = g_cfg.bLargeFont ? 14 : 12;
+	fl_message_font(FL_HELVETICA, FL_NORMAL_SIZE);
+	fl_message_icon()->box(FL_FLAT_BOX);
+	fl_message_icon()->color(FL_GRAY0+20);
 
-	return FALSE;
-}
+	Fl_Tooltip::size(FL_NORMAL_SIZE);
 
+	Fl::set_labeltype(IMAGETEXT_LABEL, fl_imagetext_label, fl_imagetext_measure);
+	Fl::set_labeltype(RADIO_EMPTY_LABEL, fl_radioempty_label, fl_radio_measure);
+	Fl::set_labeltype(RADIO_SET_LABEL, fl_radioset_label, fl_radio_measure);
+	Fl_FM_Html_Popup::static_init();
+	Fl_FM_Tag_Input::static_init();
+	Fl_FM_List::static_init();
+	Fl::set_boxtype(FLAT_MARGIN_BOX, draw_flatmarginbox, 3, 3, 6, 6);
 
-static void InvokeAddTagFilter(const char *tag)
-{
-	pTagFilterGroup->ExternalFilterAdd(tag);
+	pImgPlayFMGray = imgPlayFM.copy();
+	pImgStartFMGray = imgStartFM.copy();
+	pImgCheckGray = imgCheck.copy();
+	pImgProgressGray = imgProgress.copy();
+	pImgNotAvailGray = imgNotAvail.copy();
+	pImgArchivedGray = imgArchived.copy();
+	pImgViewFileGray = imgViewFile.copy();
+	if (pImgPlayFMGray)
+		pImgPlayFMGray->inactive();
+	if (pImgStartFMGray)
+		pImgStartFMGray->inactive();
+	if (pImgCheckGray)
+		pImgCheckGray->desaturate();
+	if (pImgProgressGray)
+		pImgProgressGray->desaturate();
+	if (pImgNotAvailGray)
+		pImgNotAvailGray->desaturate();
+	if (pImgArchivedGray)
+		pImgArchivedGray->desaturate();
+	if (pImgViewFileGray)
+		pImgViewFileGray->desaturate();
+
+	InitMenuDef(g_mnuFiltRating, sizeof(g_mnuFiltRating)/sizeof(g_mnuFiltRating[0]));
+	InitMenuDef(g_mnuFiltPrio, sizeof(g_mnuFiltPrio)/sizeof(g_mnuFiltPrio[0]));
+	InitMenuDef(g_mnuTagPresets, sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]));
+	g_mnuTagPresetsLabel[0].labelsize(FL_NORMAL_SIZE-1);
 }
 
-static void UpdateFilterControls()
+static void TermFLTK()
 {
-	pFilterName->value( g_cfg.filtName.c_str() );
-	pFilterRating->value(g_cfg.filtMinRating + 1);
-	pFilterPrio->value(g_cfg.filtMinPrio);
-	pFilterNotPlayed->value( !!(g_cfg.filtShow & FSHOW_NotPlayed) );
-	pFilterCompleted->value( !!(g_cfg.filtShow & FSHOW_Completed) );
-	pFilterInProgress->value( !!(g_cfg.filtShow & FSHOW_InProgress) );
-	pFilterNotAvail->value( !!(g_cfg.filtShow & FSHOW_NotAvail) );
-	pFilterArchived->value( !!(g_cfg.filtShow & FSHOW_ArchivedOnly) );
+	if (pImgPlayFMGray)
+		delete pImgPlayFMGray;
+	if (pImgStartFMGray)
+		delete pImgStartFMGray;
+	if (pImgCheckGray)
+		delete pImgCheckGray;
+	if (pImgProgressGray)
+		delete pImgProgressGray;
+	if (pImgNotAvailGray)
+		delete pImgNotAvailGray;
+	if (pImgArchivedGray)
+		delete pImgArchivedGray;
+	if (pImgViewFileGray)
+		delete pImgViewFileGray;
 
-	char s[32];
-	if (g_cfg.filtReleaseFrom >= 0)
-		sprintf(s, "%02d", g_cfg.filtReleaseFrom);
-	else
-		*s = 0;
-	pFilterRelDateFrom->value(s);
-	if (g_cfg.filtReleaseTo >= 0)
-		sprintf(s, "%02d", g_cfg.filtReleaseTo);
-	else
-		*s = 0;
-	pFilterRelDateTo->value(s);
+	// (thumbnail workers have been stopped by TermThumbCache and TermThreadPoolOS)
+	if (g_pJpegLock)
+	{
+		DestroyLockOS(g_pJpegLock);
+		g_pJpegLock = NULL;
+	}
 
-	pTagFilterGroup->OnFilterChanged();
+	FltkTermOS();
 }
 
 
-static void InitControls()
+/////////////////////////////////////////////////////////////////////
+// STARTUP MESSAGE WINDOW
+
+Fl_Window *g_pStartupWnd = NULL;
+
+// display message window that fmsel is scanning FMs which may take a little while
+static void ShowStartupMessage()
 {
-	// set icons in priority filter combo box
-	g_mnuFiltPrio[1].image(imgPrio[0]);
-	g_mnuFiltPrio[2].image(imgPrio[1]);
-	g_mnuFiltPrio[3].image(imgPrio[2]);
+	Fl_Window *w = g_pStartupWnd = new Fl_FM_Progress_Window(250, 40, "");
+	w->clear_border();
+	w->box(FL_NO_BOX);
+
+	Fl_Box *o = new Fl_Box(0, 0, w->w(), w->h());
+	o->box(FL_UP_BOX);
+	o->labelfont(FL_HELVETICA_BOLD);
+	o->labelsize(12);
+	o->align(FL_ALIGN_CENTER);
+	o->label($("Scanning FMs..."));
 
-	pTagFilterGroup->init();
+	w->end();
 
-	UpdateFilterControls();
+	w->set_modal();
 
-	pBtnPlayFM->deactivate();
-	pBtnStartFM->deactivate();
+	// center over main window
+	w->position(
+		pMainWnd->x() + ((pMainWnd->w() - w->w()) / 2),
+		pMainWnd->y() + ((pMainWnd->h() - w->h()) / 2)
+		);
 
-	pFMList->post_init();
+	w->show();
 
-	// initial selection
-	FMEntry *fm = g_cfg.lastfm.empty() ? NULL : GetFM( g_cfg.lastfm.c_str() );
-	pFMList->select(fm, TRUE);
-	OnListSelChange(fm ? fm : pFMList->selected());
-}
+	ShowBusyCursor(TRUE);
 
-static void InitMainWnd()
-{
-	static char sTitle[256];
 #ifdef _WIN32
-	sprintf(sTitle, "%s -- [FMSel " FMSEL_VERSION "]", PromoteStrOS(g_pFMSelData->sGameVersion).c_str());
+	// pump messages so window becomes visible
+	while ( Fl::readqueue() );
+	Fl::wait(50.0/1000.0);
 #else
-	sprintf(sTitle, "%s -- [FMSel " FMSEL_VERSION "]", g_pFMSelData->sGameVersion);
+	w->wait_for_expose();
+	Fl::flush();
 #endif
-	pMainWnd->label(sTitle);
 
-	if (g_cfg.windowsize[0] && g_cfg.windowsize[0])
+	fl_cursor(FL_CURSOR_WAIT);
+}
+
+static void HideStartupMessage()
+{
+	if (g_pStartupWnd)
 	{
-		// no way to access min size in Fl_Window, so we have to manually define vals, suck!!
-		const int MINW = 630;
-		const int MINH = 380;
-		if (g_cfg.windowsize[0] < MINW)
-			g_cfg.windowsize[0] = MINW;
-		if (g_cfg.windowsize[1] < MINH)
-			g_cfg.windowsize[1] = MINH;
+		g_pStartupWnd->hide();
 
-		pMainWnd->size(g_cfg.windowsize[0], g_cfg.windowsize[1]);
-	}
+		delete (Fl_Widget*)g_pStartupWnd;
+		g_pStartupWnd = NULL;
 
-	if (g_cfg.windowpos[0] != POS_UNDEF && g_cfg.windowpos[0] != POS_UNDEF)
-	{
-		pMainWnd->position(g_cfg.windowpos[0], g_cfg.windowpos[1]);
-	}
-	else
-	{
-		// center on desktop
-		pMainWnd->position(
-			Fl::x() + ((Fl::w() - pMainWnd->w()) / 2),
-			Fl::y() + ((Fl::h() - pMainWnd->h()) / 2)
-			);
+		ShowBusyCursor(FALSE);
+
+		Fl::flush();
 	}
+}
 
-	// do OS specific init of main window
-	MainWndInitOS(pMainWnd);
 
-	if (g_bRunningEditor)
+/////////////////////////////////////////////////////////////////////
+//
+
+// localize a tag string
+const char* $tag(const char *tag)
+{
+#ifdef LOCALIZATION_SUPPORT
+	if (localization_supported && tag && *tag)
 	{
-		pBtnStartFM->hide();
-		pBtnPlayFM->label($("Edit FM"));
+		ASSERT(localization_initialized);
+
+		// tag translations have a "tag_" prefix in the localization db
+		char loc_key[1024];
+		sprintf(loc_key, LOCALIZED_TAG_PREFIX"%s", tag);
+
+		// check if translation exists, otherwise return 'tag'
+		const char *loc = $(loc_key);
+		if (loc != loc_key)
+			return loc;
 	}
+#endif
 
-	pFMList->post_init_header();
+	return tag;
 }
 
-
-static void InitTempCache()
+static void PrepareLocalization()
 {
-	// init temp dir used to extract files from archive that can't be accessed as a mem buffer
-	// the temp dir is named ".fmsel.cache", in this function we ensure that the dir exists,
-	// and delete its contents to clear out temp files from a previous session
+	InitLocalization();
 
-	// could put it in the system temp dir, but for now we use the fmdir (for portable apps compliance)
-	const char *tmp = GetRootPath();
-	/*const char *tmp = fl_getenv("TMP");
-	if (!tmp || !fl_filename_isdir(tmp))
-	{
-		tmp = fl_getenv("TEMP");
-		if (!tmp || !fl_filename_isdir(tmp))
-		{
-			TRACE("Failed to create temp dir, no valid TMP/TEMP environment var");
-			return;
-		}
-	}*/
+	// summaries cached by a previous (resident) call may be in another language
+	ClearSummaryCache();
 
-	g_sTempDir = tmp;
-	if ( !isdirsep(g_sTempDir[g_sTempDir.size()-1]) )
-		g_sTempDir += DIRSEP_STR;
+#ifdef LOCALIZATION_SUPPORT
+	// localize globals
+	TAGS_LABEL = $(TAGS_LABEL);
+	RATING_COL_LABEL = $(RATING_COL_LABEL);
+#endif
+}
 
-	g_sTempDir += ".fmsel.cache" DIRSEP_STR;
-	if ( fl_filename_isdir(g_sTempDir.c_str()) )
+static void CleanupLocalization()
+{
+#ifdef LOCALIZATION_SUPPORT
+	// delete any localization specific allocs
+	for (unsigned int i=0; i<sizeof(g_tagPresetsExtraAllocated)/sizeof(g_tagPresetsExtraAllocated[0]); i++)
 	{
-		// dir already existed, delete contents
-		dirent **files;
-		int nFiles = fl_filename_list(g_sTempDir.c_str(), &files, NULL);
-		if (nFiles > 0)
+		if (g_tagPresetsExtraAllocated[i])
 		{
-			string s;
+			free((char*)g_tagPresetsExtraAllocated[i]);
+			g_tagPresetsExtraAllocated[i] = NULL;
+		}
+	}
+#endif
 
-			for (int i=0; i<nFiles; i++)
-			{
-				dirent *f = files[i];
+	TermLocalization();
+}
 
-				int len = strlen(f->d_name);
-				if ( isdirsep(f->d_name[len-1]) )
-				{
-					// subdir (or ./ or ../)
-					if (strcmp(f->d_name, "./") && strcmp(f->d_name, "../"))
-					{
-						f->d_name[len-1] = 0;
-						s = g_sTempDir + f->d_name;
 
-						if ( DelTree( s.c_str() ) )
-						{
-							TRACE("deleted temp dir subdir: %s", s.c_str());
-						}
-						else
-						{
-							TRACE("failed to delete temp dir subdir: %s", s.c_str());
-						}
-					}
-				}
-				else
-				{
-					s = g_sTempDir + f->d_name;
-					if ( !unlink_forced( s.c_str() ) )
-					{
-						TRACE("deleted temp dir file: %s", s.c_str());
-					}
-					else
-					{
-						TRACE("failed to delete temp dir file: %s", s.c_str());
-					}
-				}
-			}
+/////////////////////////////////////////////////////////////////////
+// FM SEL API
 
-			fl_filename_free_list(&files, nFiles);
-		}
-	}
-	else
-	{
-		// dir doesn't exist, create it
-		if ( fl_mkdir(g_sTempDir.c_str(), DEF_DIR_MODE) )
-		{
-			// failed to create
-			TRACE("Failed to create temp dir %s", g_sTempDir.c_str());
-			g_sTempDir.clear();
-		}
-		else
-		{
-			TRACE("created temp dir: %s", g_sTempDir.c_str());
-		}
-	}
+static void InitSelectorData(sFMSelectorData *data)
+{
+#ifndef _WIN32
+	setlocale(LC_ALL, "");
+#endif
 
-	if ( !g_sTempDir.empty() )
-	{
-		// generate absolute path for temp dir
-		char fullpath[MAX_PATH_BUF];
-		fl_filename_absolute(fullpath, sizeof(fullpath), g_sTempDir.c_str());
-#ifdef _WIN32
-		for (char *s=fullpath; *s; s++)
-			if (*s == '/')
-				*s = '\\';
+	g_pFMSelData = data;
+	CleanDirSlashes(g_pFMSelData->sRootPath);
+
+	g_bRunningEditor = (data->sGameVersion && *data->sGameVersion) && !strncmp(data->sGameVersion, "DromEd", 6);
+	g_bRunningShock = (data->sGameVersion && *data->sGameVersion) && strstr(data->sGameVersion, "Shock");
+#ifdef T3_SUPPORT
+	g_bRunningThief3 = (data->sGameVersion && *data->sGameVersion) && !strncmp(data->sGameVersion, "Thief 3", 7);
 #endif
-		g_sTempDirAbs = fullpath;
-	}
 }
 
-void ValidateTempCache()
+static void StartTracing()
 {
-	if ( !g_sTempDir.empty() )
-		return;
+	char fname[MAX_PATH_BUF];
+	if (_snprintf_s(fname, sizeof(fname), _TRUNCATE, "%s" DIRSEP_STR "fmsel_trace.json", GetRootPath()) != -1)
+		BeginTrace(fname);
+}
 
-	// one more try to initialize the temp dir
-	InitTempCache();
+extern "C" int FMSELAPI SelectFM(sFMSelectorData *data)
+{
+	if (!data || (unsigned int)data->nStructSize < sizeof(sFMSelectorData))
+	{
+		return kSelFMRet_Cancel;
+	}
 
-	if ( !g_sTempDir.empty() )
-		return;
+	InitSelectorData(data);
 
-	fl_message_position(pMainWnd);
-	fl_alert(
-		$("Failed to create the temp/cache directory \"%s%s.fmsel.cache\".\n"
-		"Some functionality like uninstalling FMs will not be available"),
-		GetRootPath(), DIRSEP_STR);
-}
+	PrepareLocalization();
 
+	InitTempCache();
 
-extern int FL_NORMAL_SIZE;
+	// in resident mode the db from the previous call can be reused if it's for the same FM root and game, it was
+	// saved on that call's exit so it matches what LoadDb would load
+	string sResidentKey = g_pFMSelData->sRootPath;
+	sResidentKey.append("|");
+	if (data->sGameVersion)
+		sResidentKey.append(data->sGameVersion);
 
-static void fl_imagetext_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
-{
-	fl_font(o->font, o->size);
-	fl_color((Fl_Color)o->color);
-	if (o->image)
+	const BOOL bWarm = g_bResident && g_sResidentKey == sResidentKey;
+	if (!bWarm)
 	{
-		const int imgw = o->image->w();
-		fl_draw(o->value, X+imgw, Y, W-imgw, H, (Fl_Align)(FL_ALIGN_CENTER|FL_ALIGN_INSIDE));
-		o->image->draw(X, Y+((H-o->image->h())/2));
+		if (!g_sResidentKey.empty() || !g_db.empty())
+		{
+			TermDb();
+			FreeArchiveManifests();
+		}
+
+		// settings of a previous call (possibly for another FM root) must not carry over into what LoadDb reads
+		g_cfg.Reset();
+		g_bDbModified = FALSE;
 	}
-	else
-		fl_draw(o->value, X, Y, W, H, align);
-}
+	g_sResidentKey.clear();
 
-static void fl_imagetext_measure(const Fl_Label* o, int& W, int& H)
-{
-	fl_font(o->font, o->size);
-	fl_measure(o->value, W, H);
-	if (o->image)
+	const char *envTrace = fl_getenv("FMSEL_TRACE");
+	if (envTrace && *envTrace && strcmp(envTrace, "0"))
+		StartTracing();
+
+	const double tmLoadDb = GetTimeMsOS();
+
+	const BOOL bFirstTime = bWarm ? FALSE : (LoadDb() == 2);
+
+	// trace enabled by config, the LoadDb scope was missed so add it afterwards
+	if (g_cfg.bTrace && !g_bTraceEnabled)
 	{
-		W += o->image->w() + 2;
-		if (o->image->h() > H)
-			H = o->image->h();
+		StartTracing();
+		AddTraceEvent("LoadDb", NULL, tmLoadDb, GetTimeMsOS() - tmLoadDb);
 	}
-}
 
-static void fl_radioempty_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
-{
-	fl_font(o->font, o->size);
-	fl_color((Fl_Color)o->color);
+	// when running after game exit then give the old process a little time to shut down (just to be nice)
+	if (data->bExitedGame)
+		WaitForProcessExitOS(g_cfg.dwLastProcessID, 2000);
+	g_cfg.dwLastProcessID = 0;
 
-	X += imgMenuRadio.w() + 2;
+	InitFLTK();
 
-	fl_draw(o->value, X, Y, W, H, align);
-}
+	MakeWindow();
 
-static void fl_radioset_label(const Fl_Label* o, int X, int Y, int W, int H, Fl_Align align)
-{
-	fl_font(o->font, o->size);
-	//fl_color((Fl_Color)o->color);
-	fl_color(FL_FOREGROUND_COLOR);
+	if (pMainWnd)
+	{
+		InitMainWnd();
 
-	imgMenuRadio.draw(X, Y+((H-imgMenuRadio.h())/2));
-	X += imgMenuRadio.w() + 2;
+		pMainWnd->show();
 
-	fl_draw(o->value, X, Y, W, H, align);
-}
+		if (g_cfg.bWindowMax)
+			MainWndMaximizeOS(pMainWnd);
 
-static void fl_radio_measure(const Fl_Label* o, int& W, int& H)
-{
-	fl_font(o->font, o->size);
-	fl_measure(o->value, W, H);
+		if ( !ValidateFmPath() )
+		{
+			pMainWnd->hide();
+			goto abort;
+		}
 
-	W += imgMenuRadio.w() + 4;
-	if (imgMenuRadio.h() > H)
-		H = imgMenuRadio.h();
-}
+		ValidateArchiveRepo(bFirstTime);
 
-// this is a stripped down version of fl_register_images() that registers the jpeg image type reduce dll bloat
-static Fl_Image *fl_check_images_jpeg(const char *name, uchar *header, int)
-{
-	if (memcmp(header, "\377\330\377", 3) == 0 && header[3] >= 0xc0 && header[3] <= 0xef)
-		return new Fl_JPEG_Image(name);
+		ValidateTempCache();
 
-	return 0;
-}
-static void fl_register_jpeg()
-{
-	Fl_Shared_Image::add_handler(fl_check_images_jpeg);
-}
+		// with background scan enabled the list is populated from the db right away, availability is updated when
+		// the scan is done (not done on first run, when there's nothing in the db to show), a warm db in resident
+		// mode is always shown right away
+		BOOL bScanning;
+		bScanning = (g_cfg.bBackgroundScan || bWarm) && !bFirstTime && BeginStartupScan();
 
-static void draw_flatmarginbox(int x, int y, int w, int h, Fl_Color c)
-{
-	fl_color(c);
-	fl_rectf(x+3, y+3, w-6, h-6);
-	fl_color( fl_themed_rgb_color(210,210,210) );
-	fl_rect(x, y, w, h);
-	fl_color( fl_themed_rgb_color(230,230,230) );
-	fl_rect(x+1, y+1, w-2, h-2);
-	fl_rect(x+2, y+2, w-4, h-4);
-}
+		ShowBusyCursor(TRUE);
 
-static void InitMenuDef(Fl_Menu_Item *menu, int count)
-{
-	if (FL_NORMAL_SIZE == 12)
-		return;
+		if (!bScanning)
+		{
+			ShowStartupMessage();
 
-	for (int i=0; i<count; i++)
-	{
-		if (menu->label() && menu->labelsize() == 12)
-			menu->labelsize(FL_NORMAL_SIZE);
+			ScanFmDir();
+		}
+		RefreshFilteredDb(FALSE);
 
-		menu++;
-	}
-}
+		ShowBusyCursor(FALSE);
 
-static void InitFLTK()
-{
-#ifdef LOCALIZATION_SUPPORT
-	// localize standard button labels
-	fl_no = $("No");
-	fl_yes = $("Yes");
-	fl_ok = $("OK");
-	fl_cancel = $("Cancel");
-	fl_close = $("Close");
+		HideStartupMessage();
 
-	// localize misc other globals
+		InitControls();
 
-	g_mnuTagPresetsLabel[0].label( $(g_mnuTagPresetsLabel[0].label()) );
-	_snprintf_s(TAGPRESET_CAT_CUST, sizeof(TAGPRESET_CAT_CUST), _TRUNCATE, "<%s>", $("custom"));
+		if (!bScanning)
+			ShowBadDirWarning();
 
-	// copy original untranslated tag preset names
-	for (unsigned int i=0; i<sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]); i++)
-		g_tagPresetsEnglish[i] = g_mnuTagPresets[i].text;
+		InitThumbCache();
 
-	// localize tag presets (categories are displayed in both english and localized because manual
-	// tag entry still needs to be typed in english)
-	for (unsigned int i=0; i<sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]); i++)
-	{
-		if (!g_tagPresetsEnglish[i])
-			continue;
+		StartDirWatch();
 
-		const char *colon = strchr(g_tagPresetsEnglish[i], ':');
-		if (colon && colon != g_tagPresetsEnglish[i])
+		Fl::run();
+
+		StopDirWatch();
+
+		TermThumbCache();
+
+		// discard a startup scan that's still pending, the db is saved with the availability it was loaded with
+		FinishStartupScan(FALSE);
+
+		if ( !SaveDb() )
 		{
-			// tag category
+			fl_message_position(pMainWnd);
+			fl_alert("%s", $("Failed to save database (fmsel.ini). Make sure you have write access\n"
+				"to the file and FM path and that there's enough free disk space\n"
+				"before closing this dialog, otherwise any changes will be lost."));
 
-			// get category name without colon
-			char cat[512];
-			int n = colon - g_tagPresetsEnglish[i];
-			ASSERT(n < 512);
-			memcpy(cat, g_tagPresetsEnglish[i], n);
-			cat[n] = 0;
+			// do another attempt
+			SaveDb();
+		}
 
-			// if localized then show both english and localized strings
-			const char *catloc = $tag(cat);
-			if (catloc != cat)
-			{
-				char s[1024];
-				sprintf(s, "%s: (%s)", catloc, g_tagPresetsEnglish[i]);
-				g_mnuTagPresets[i].text = g_tagPresetsExtraAllocated[i] = _strdup(s);
-			}
+		if (g_bResident && !g_bDbModified)
+		{
+			CompactDbStrings();
+			g_sResidentKey = sResidentKey;
 		}
-		else if (!g_mnuTagPresets[i].user_data_ || g_mnuTagPresets[i].text != TAGPRESET_CAT_CUST)
-			// regular tag
-			g_mnuTagPresets[i].text = $tag(g_mnuTagPresets[i].text);
-	}
-#endif
+		else
+			TermDb();
 
-	Fl::visual(FL_RGB);
+abort:
+		MainWndTermOS(pMainWnd);
 
-	fl_register_jpeg();
+		delete pMainWnd;
+		pMainWnd = NULL;
+
+		if ( g_sResidentKey.empty() )
+			FreeArchiveManifests();
+		// pending task continuations are run by TermThreadPoolOS, with the window gone they must only clean up
+		TermAsyncFilter();
+		InvalidateSummaryPrefetch();
+		TermThreadPoolOS();
+		TermArchiveSystem();
+		TermFLTK();
+		CleanupLocalization();
 
-#ifndef NO_FLEET
-	if (g_cfg.uicolors >= 0 && g_cfg.uicolors < fle_num_colors())
-		fle_set_colors(fle_colors_name(g_cfg.uicolors));
-#endif
-	if (g_cfg.uitheme >= 0 && g_cfg.uitheme < Fl_Scheme::num_schemes())
-		Fl::scheme(Fl_Scheme::names()[g_cfg.uitheme]);
-#ifndef NO_FLEET
-	else
-	{
-		int i = g_cfg.uitheme - Fl_Scheme::num_schemes();
-		if (i >= 0 && i < fle_num_schemes())
-			fle_set_scheme(fle_scheme_name(i));
+		Fl::flush();
+
+		EndTrace();
+
+		return g_appReturn;
 	}
-#endif
 
-	FL_NORMAL_SIZE = g_cfg.bLargeFont ? 14 : 12;
-	fl_message_font(FL_HELVETICA, FL_NORMAL_SIZE);
-	fl_message_icon()->box(FL_FLAT_BOX);
-	fl_message_icon()->color(FL_GRAY0+20);
+	TermThreadPoolOS();
+	TermArchiveSystem();
+	TermFLTK();
+	TermLocalization();
 
-	Fl_Tooltip::size(FL_NORMAL_SIZE);
+	EndTrace();
 
-	Fl::set_labeltype(IMAGETEXT_LABEL, fl_imagetext_label, fl_imagetext_measure);
-	Fl::set_labeltype(RADIO_EMPTY_LABEL, fl_radioempty_label, fl_radio_measure);
-	Fl::set_labeltype(RADIO_SET_LABEL, fl_radioset_label, fl_radio_measure);
-	Fl_FM_Html_Popup::static_init();
-	Fl_FM_Tag_Input::static_init();
-	Fl_FM_List::static_init();
-	Fl::set_boxtype(FLAT_MARGIN_BOX, draw_flatmarginbox, 3, 3, 6, 6);
+	return kSelFMRet_Cancel;
+}
 
-	pImgPlayFMGray = imgPlayFM.copy();
-	pImgStartFMGray = imgStartFM.copy();
-	pImgCheckGray = imgCheck.copy();
-	pImgProgressGray = imgProgress.copy();
-	pImgNotAvailGray = imgNotAvail.copy();
-	pImgArchivedGray = imgArchived.copy();
-	pImgViewFileGray = imgViewFile.copy();
-	if (pImgPlayFMGray)
-		pImgPlayFMGray->inactive();
-	if (pImgStartFMGray)
-		pImgStartFMGray->inactive();
-	if (pImgCheckGray)
-		pImgCheckGray->desaturate();
-	if (pImgProgressGray)
-		pImgProgressGray->desaturate();
-	if (pImgNotAvailGray)
-		pImgNotAvailGray->desaturate();
-	if (pImgArchivedGray)
-		pImgArchivedGray->desaturate();
-	if (pImgViewFileGray)
-		pImgViewFileGray->desaturate();
+extern "C" void FMSELAPI SetFMSelResident(int bResident)
+{
+	g_bResident = !!bResident;
 
-	InitMenuDef(g_mnuFiltRating, sizeof(g_mnuFiltRating)/sizeof(g_mnuFiltRating[0]));
-	InitMenuDef(g_mnuFiltPrio, sizeof(g_mnuFiltPrio)/sizeof(g_mnuFiltPrio[0]));
-	InitMenuDef(g_mnuTagPresets, sizeof(g_mnuTagPresets)/sizeof(g_mnuTagPresets[0]));
-	g_mnuTagPresetsLabel[0].labelsize(FL_NORMAL_SIZE-1);
+	// drop anything kept from previous calls
+	if (!g_bResident && !g_sResidentKey.empty())
+	{
+		g_sResidentKey.clear();
+
+		TermDb();
+		FreeArchiveManifests();
+	}
 }
 
-static void TermFLTK()
+
+/////////////////////////////////////////////////////////////////////
+// BATCH MODE
+
+// commands that take an argument
+static BOOL BatchCmdHasArg(const char *cmd)
 {
-	if (pImgPlayFMGray)
-		delete pImgPlayFMGray;
-	if (pImgStartFMGray)
-		delete pImgStartFMGray;
-	if (pImgCheckGray)
-		delete pImgCheckGray;
-	if (pImgProgressGray)
-		delete pImgProgressGray;
-	if (pImgNotAvailGray)
-		delete pImgNotAvailGray;
-	if (pImgArchivedGray)
-		delete pImgArchivedGray;
-	if (pImgViewFileGray)
-		delete pImgViewFileGray;
+	return !strcmp(cmd, "install") || !strcmp(cmd, "uninstall") || !strcmp(cmd, "export") || !strcmp(cmd, "import");
+}
 
-	FltkTermOS();
+static BOOL IsBatchCmd(const char *cmd)
+{
+	return BatchCmdHasArg(cmd) || !strcmp(cmd, "rescan") || !strcmp(cmd, "scandates") || !strcmp(cmd, "rebuildcache");
+}
+
+// find FM for a batch install/uninstall argument, either the FM dir name or the archive name
+static FMEntry* GetBatchFM(const char *name)
+{
+	FMEntry *fm = GetFM(name);
+	if (!fm)
+		fm = FindFmFromArchiveNameOnly(name);
+	return fm;
 }
 
+// install/uninstall the FM named 'arg', or all FMs that can be installed/uninstalled if 'arg' is "*"
+// returns the number of processed FMs or -1 on failure
+static int RunBatchInstall(const char *arg, BOOL bInstall)
+{
+	vector<FMEntry*> list;
+
+	if ( !strcmp(arg, "*") )
+	{
+		for (int i=0; i<(int)g_db.size(); i++)
+		{
+			FMEntry *fm = g_db[i];
+			if (fm->IsArchived() && (bInstall ? !fm->IsInstalled() : fm->IsInstalled()))
+				list.push_back(fm);
+		}
+	}
+	else
+	{
+		FMEntry *fm = GetBatchFM(arg);
+		if (!fm)
+		{
+			BatchReport($("FM \"%s\" not found."), arg);
+			return -1;
+		}
 
-/////////////////////////////////////////////////////////////////////
-// STARTUP MESSAGE WINDOW
+		if (bInstall ? fm->IsInstalled() : !fm->IsInstalled())
+			return 0;
 
-Fl_Window *g_pStartupWnd = NULL;
+		// uninstalling is only allowed for archived FMs, same as in the UI
+		if ( !fm->IsArchived() )
+		{
+			BatchReport($("FM \"%s\" has no archive."), arg);
+			return -1;
+		}
 
-// display message window that fmsel is scanning FMs which may take a little while
-static void ShowStartupMessage()
-{
-	Fl_Window *w = g_pStartupWnd = new Fl_FM_Progress_Window(250, 40, "");
-	w->clear_border();
-	w->box(FL_NO_BOX);
+		list.push_back(fm);
+	}
 
-	Fl_Box *o = new Fl_Box(0, 0, w->w(), w->h());
-	o->box(FL_UP_BOX);
-	o->labelfont(FL_HELVETICA_BOLD);
-	o->labelsize(12);
-	o->align(FL_ALIGN_CENTER);
-	o->label($("Scanning FMs..."));
+	// several FMs go through the install queue (concurrent installs, all FMs are attempted even if some fail)
+	if (list.size() > 1)
+		return RunInstallQueue(list, bInstall) ? -1 : (int)list.size();
 
-	w->end();
+	for (int i=0; i<(int)list.size(); i++)
+	{
+		FMEntry *fm = list[i];
 
-	w->set_modal();
+		const double t = GetTimeMsOS();
 
-	// center over main window
-	w->position(
-		pMainWnd->x() + ((pMainWnd->w() - w->w()) / 2),
-		pMainWnd->y() + ((pMainWnd->h() - w->h()) / 2)
-		);
+		if ( !(bInstall ? InstallFM(fm) : UninstallFM(fm)) )
+		{
+			BatchReport("  %s: %s", fm->name, $("failed"));
+			return -1;
+		}
 
-	w->show();
+		BatchReport("  %s (%.0f ms)", fm->name, GetTimeMsOS() - t);
+	}
 
-	ShowBusyCursor(TRUE);
+	return (int)list.size();
+}
 
-#ifdef _WIN32
-	// pump messages so window becomes visible
-	while ( Fl::readqueue() );
-	Fl::wait(50.0/1000.0);
-#else
-	w->wait_for_expose();
-	Fl::flush();
-#endif
+// run a single batch command, returns the number of processed items or -1 on failure
+static int RunBatchCmd(const char *cmd, const char *arg)
+{
+	if ( !strcmp(cmd, "rescan") )
+	{
+		ScanFmDir();
+		return (int)g_db.size();
+	}
+	else if ( !strcmp(cmd, "scandates") )
+		return ScanReleaseDates(g_db);
+	else if ( !strcmp(cmd, "install") )
+		return RunBatchInstall(arg, TRUE);
+	else if ( !strcmp(cmd, "uninstall") )
+		return RunBatchInstall(arg, FALSE);
+	else if ( !strcmp(cmd, "export") )
+		return WriteBatchFmIni(arg, g_db);
+	else if ( !strcmp(cmd, "import") )
+		return ReadBatchFmIni(arg, IMP_Name|IMP_RelDate|IMP_Descr|IMP_InfoFile|IMP_Tags|IMP_ModeFillAddTags);
+	else if ( !strcmp(cmd, "rebuildcache") )
+		return RebuildThumbCache();
 
-	fl_cursor(FL_CURSOR_WAIT);
+	return -1;
 }
 
-static void HideStartupMessage()
+static BOOL ValidateBatchPaths()
 {
-	if (g_pStartupWnd)
+	struct stat st = {};
+
+	if (fl_stat(GetRootPath(), &st) || !(st.st_mode & S_IFDIR))
 	{
-		g_pStartupWnd->hide();
+		BatchReport($("The FM path \"%s\" was not found or a valid directory."), GetRootPath());
+		return FALSE;
+	}
 
-		delete (Fl_Widget*)g_pStartupWnd;
-		g_pStartupWnd = NULL;
+	// an invalid archive path only disables archive support, like at regular startup
+	if ( !g_cfg.archiveRepo.empty() )
+	{
+		if (fl_stat(g_cfg.archiveRepo.c_str(), &st) || !(st.st_mode & S_IFDIR))
+			BatchReport($("Archive repository/collection path \"%s\" was not found or a valid directory."), g_cfg.archiveRepo.c_str());
+		else if ( IsArchivePathSameAsFmPath( g_cfg.archiveRepo.c_str() ) )
+			BatchReport("%s", $("The archive path may not be inside the FM path, or vice versa.\nArchive support disabled. Reconfigure the archive path."));
+		else
+			g_cfg.bRepoOK = TRUE;
+	}
 
-		ShowBusyCursor(FALSE);
+	return TRUE;
+}
 
-		Fl::flush();
+extern "C" int FMSELAPI BatchFMSel(sFMSelectorData *data, int argc, const char **argv, void (*report)(const char *msg))
+{
+	if (!data || (unsigned int)data->nStructSize < sizeof(sFMSelectorData) || !report)
+		return 1;
+
+	// validate command line before loading anything
+	for (int i=0; i<argc; i++)
+	{
+		if ( !IsBatchCmd(argv[i]) )
+		{
+			char msg[256];
+			_snprintf_s(msg, sizeof(msg), _TRUNCATE, "unknown command \"%s\"", argv[i]);
+			report(msg);
+			return 1;
+		}
+
+		if ( BatchCmdHasArg(argv[i]) && ++i >= argc )
+		{
+			char msg[256];
+			_snprintf_s(msg, sizeof(msg), _TRUNCATE, "missing argument for \"%s\"", argv[i-1]);
+			report(msg);
+			return 1;
+		}
 	}
-}
 
+	InitSelectorData(data);
 
-/////////////////////////////////////////////////////////////////////
-//
+	PrepareLocalization();
 
-// localize a tag string
-const char* $tag(const char *tag)
-{
-#ifdef LOCALIZATION_SUPPORT
-	if (localization_supported && tag && *tag)
+	InitTempCache();
+
+	// nothing kept from a resident SelectFM call may be reused, the batch modifies the db
+	if (!g_sResidentKey.empty() || !g_db.empty())
 	{
-		ASSERT(localization_initialized);
+		TermDb();
+		FreeArchiveManifests();
+	}
+	g_sResidentKey.clear();
 
-		// tag translations have a "tag_" prefix in the localization db
-		char loc_key[1024];
-		sprintf(loc_key, LOCALIZED_TAG_PREFIX"%s", tag);
+	const char *envTrace = fl_getenv("FMSEL_TRACE");
+	if (envTrace && *envTrace && strcmp(envTrace, "0"))
+		StartTracing();
 
-		// check if translation exists, otherwise return 'tag'
-		const char *loc = $(loc_key);
-		if (loc != loc_key)
-			return loc;
+	g_pBatchReport = report;
+
+	int ret = 1;
+	double t = GetTimeMsOS();
+
+	if ( !LoadDb() )
+	{
+		BatchReport("%s", $("Failed to load database (fmsel.ini)."));
+		goto done;
 	}
-#endif
 
-	return tag;
-}
+	if ( !ValidateBatchPaths() )
+		goto done;
 
-static void PrepareLocalization()
-{
-	InitLocalization();
+	ScanFmDir();
 
-#ifdef LOCALIZATION_SUPPORT
-	// localize globals
-	TAGS_LABEL = $(TAGS_LABEL);
-	RATING_COL_LABEL = $(RATING_COL_LABEL);
-#endif
-}
+	BatchReport("load: %d FMs (%.0f ms)", (int)g_db.size(), GetTimeMsOS() - t);
 
-static void CleanupLocalization()
-{
-#ifdef LOCALIZATION_SUPPORT
-	// delete any localization specific allocs
-	for (unsigned int i=0; i<sizeof(g_tagPresetsExtraAllocated)/sizeof(g_tagPresetsExtraAllocated[0]); i++)
+	ret = 0;
+
+	for (int i=0; i<argc && !ret; i++)
 	{
-		if (g_tagPresetsExtraAllocated[i])
+		const char *cmd = argv[i];
+		const char *arg = BatchCmdHasArg(cmd) ? argv[++i] : NULL;
+
+		BatchReport("%s%s%s", cmd, arg ? " " : "", arg ? arg : "");
+
+		t = GetTimeMsOS();
+		const int n = RunBatchCmd(cmd, arg);
+
+		if (n < 0)
 		{
-			free((char*)g_tagPresetsExtraAllocated[i]);
-			g_tagPresetsExtraAllocated[i] = NULL;
+			BatchReport("%s: failed (%.0f ms)", cmd, GetTimeMsOS() - t);
+			ret = 1;
 		}
+		else
+			BatchReport("%s: ok, %d (%.0f ms)", cmd, n, GetTimeMsOS() - t);
 	}
-#endif
 
-	TermLocalization();
+	// save whatever was done, even if a command failed
+	g_bDbModified = TRUE;
+	t = GetTimeMsOS();
+	if ( !SaveDb() )
+	{
+		BatchReport("%s", $("Failed to save database (fmsel.ini)."));
+		ret = 1;
+	}
+	else
+		BatchReport("save: (%.0f ms)", GetTimeMsOS() - t);
+
+done:
+	TermDb();
+	FreeArchiveManifests();
+	TermThreadPoolOS();
+	TermArchiveSystem();
+	CleanupLocalization();
+
+	EndTrace();
+
+	g_pBatchReport = NULL;
+
+	return ret;
 }
 
 
 /////////////////////////////////////////////////////////////////////
-// FM SEL API
+// BENCHMARK
 
-extern "C" int FMSELAPI SelectFM(sFMSelectorData *data)
+#ifdef BENCH_SUPPORT
+
+extern "C" int FMSELAPI BenchFMSel(sFMSelectorData *data, const char *repo, int nInstall,
+	void (*report)(const char *bench, const char *params, double ms, int count))
 {
-	if (!data || (unsigned int)data->nStructSize < sizeof(sFMSelectorData))
+	if (!data || (unsigned int)data->nStructSize < sizeof(sFMSelectorData) || !report)
+		return 1;
+
+	InitSelectorData(data);
+
+	PrepareLocalization();
+
+	InitTempCache();
+
+	double t;
+	char params[128];
+
+	// first run, db is built by the scan
+	if (LoadDb() != 2)
 	{
-		return kSelFMRet_Cancel;
+		TermDb();
+		CleanupLocalization();
+		return 1;
 	}
 
-#ifndef _WIN32
-	setlocale(LC_ALL, "");
-#endif
+	if (repo && *repo)
+	{
+		g_cfg.archiveRepo = repo;
+		g_cfg.bRepoOK = TRUE;
+	}
 
-	g_pFMSelData = data;
-	CleanDirSlashes(g_pFMSelData->sRootPath);
+	t = GetTimeMsOS();
+	ScanFmDir();
+	report("scan_fm_dir", "db=new ", GetTimeMsOS() - t, (int)g_db.size());
 
-	g_bRunningEditor = (data->sGameVersion && *data->sGameVersion) && !strncmp(data->sGameVersion, "DromEd", 6);
-	g_bRunningShock = (data->sGameVersion && *data->sGameVersion) && strstr(data->sGameVersion, "Shock");
-#ifdef T3_SUPPORT
-	g_bRunningThief3 = (data->sGameVersion && *data->sGameVersion) && !strncmp(data->sGameVersion, "Thief 3", 7);
-#endif
+	g_bDbModified = TRUE;
+	t = GetTimeMsOS();
+	const BOOL bSaved = SaveDb();
+	report("save_db", "", GetTimeMsOS() - t, (int)g_db.size());
 
-	PrepareLocalization();
+	TermDb();
 
-	InitTempCache();
+	if (!bSaved)
+	{
+		CleanupLocalization();
+		return 1;
+	}
 
-	const BOOL bFirstTime = (LoadDb() == 2);
+	// regular startup with existing db
+	t = GetTimeMsOS();
+	LoadDb();
+	report("load_db", "", GetTimeMsOS() - t, (int)g_db.size());
 
-	// when running after game exit then give the old process a little time to shut down (just to be nice)
-	if (data->bExitedGame)
-		WaitForProcessExitOS(g_cfg.dwLastProcessID, 2000);
-	g_cfg.dwLastProcessID = 0;
+	g_cfg.bRepoOK = !g_cfg.archiveRepo.empty();
 
-	InitFLTK();
+	t = GetTimeMsOS();
+	ScanFmDir();
+	report("scan_fm_dir", "db=loaded ", GetTimeMsOS() - t, (int)g_db.size());
 
-	MakeWindow();
+	InvalidateTagDb();
+	t = GetTimeMsOS();
+	RefreshTagDb();
+	report("refresh_tag_db", "", GetTimeMsOS() - t, (int)g_dbTagCountHash.size());
 
-	if (pMainWnd)
+	// filtering in all sort modes, first without filters then with some typical ones
+	g_cfg.filtShow = FSHOW_All;
+	for (int i=SORT_None+1; i<SORT_NUM_MODES; i++)
 	{
-		InitMainWnd();
-
-		pMainWnd->show();
+		g_cfg.sortmode = i;
+		t = GetTimeMsOS();
+		RefreshFilteredDb(FALSE);
+		_snprintf_s(params, sizeof(params), _TRUNCATE, "sort=%d filter=none ", i);
+		report("refresh_filtered_db", params, GetTimeMsOS() - t, (int)g_dbFiltered.size());
+	}
 
-		if (g_cfg.bWindowMax)
-			MainWndMaximizeOS(pMainWnd);
+	static const struct
+	{
+		const char *label;
+		int show;
+		const char *name;
+		int minRating;
+	} filters[] =
+	{
+		{ "default",	FSHOW_Default,	"",		-1 },
+		{ "name",		FSHOW_All,		"fm 1",	-1 },
+		{ "rating",		FSHOW_All,		"",		5 },
+	};
 
-		if ( !ValidateFmPath() )
-		{
-			pMainWnd->hide();
-			goto abort;
-		}
+	g_cfg.sortmode = SORT_Name;
+	for (int i=0; i<(int)(sizeof(filters)/sizeof(filters[0])); i++)
+	{
+		g_cfg.filtShow = filters[i].show;
+		g_cfg.filtName = filters[i].name;
+		g_cfg.filtMinRating = filters[i].minRating;
+		t = GetTimeMsOS();
+		RefreshFilteredDb(FALSE);
+		_snprintf_s(params, sizeof(params), _TRUNCATE, "sort=%d filter=%s ", SORT_Name, filters[i].label);
+		report("refresh_filtered_db", params, GetTimeMsOS() - t, (int)g_dbFiltered.size());
+	}
 
-		ValidateArchiveRepo(bFirstTime);
+	// doc file lookup for all FMs (installed ones list dirs, archived ones open the archive)
+	int nDocs = 0;
+	t = GetTimeMsOS();
+	for (int i=0; i<(int)g_db.size(); i++)
+	{
+		vector<string> list;
+		if ( GetDocFiles(g_db[i], list) )
+			nDocs += (int)list.size();
+	}
+	report("get_doc_files", "", GetTimeMsOS() - t, nDocs);
 
-		ValidateTempCache();
+	// extraction of archived FMs into the FM root and removal of the extracted dir (the bulk of InstallFM and
+	// UninstallFM, without their UI and savegame handling parts)
+	double tmExtract = 0, tmDelTree = 0;
+	int nInstalled = 0;
+	for (int i=0; i<(int)g_db.size() && nInstalled<nInstall; i++)
+	{
+		FMEntry *fm = g_db[i];
+		if (fm->IsInstalled() || !fm->IsArchived())
+			continue;
 
-		ShowBusyCursor(TRUE);
+		const string archive = fm->GetArchiveFilePath();
+		const string dest = string(GetRootPath()) + DIRSEP_STR + fm->name;
 
-		ShowStartupMessage();
+		t = GetTimeMsOS();
+		const int ret = ExtractFullArchive(archive.c_str(), dest.c_str(), NULL);
+		tmExtract += GetTimeMsOS() - t;
 
-		ScanFmDir();
-		RefreshFilteredDb(FALSE);
+		t = GetTimeMsOS();
+		DelTree(dest);
+		tmDelTree += GetTimeMsOS() - t;
 
-		ShowBusyCursor(FALSE);
+		if (!ret)
+			break;
 
-		HideStartupMessage();
+		nInstalled++;
+	}
+	report("extract_full_archive", "", tmExtract, nInstalled);
+	report("del_tree", "", tmDelTree, nInstalled);
 
-		InitControls();
+	TermDb();
 
-		ShowBadDirWarning();
+	// hot field filtering on its own with synthetic dbs larger than any real FM collection
+	static const int dbSizes[] = { 10000, 100000 };
+	const int FILTER_PASSES = 20;
 
-		Fl::run();
+	for (int k=0; k<(int)(sizeof(dbSizes)/sizeof(dbSizes[0])); k++)
+	{
+		unsigned int seed = 12345;
 
-		if ( !SaveDb() )
+		for (int i=0; i<dbSizes[k]; i++)
 		{
-			fl_message_position(pMainWnd);
-			fl_alert("%s", $("Failed to save database (fmsel.ini). Make sure you have write access\n"
-				"to the file and FM path and that there's enough free disk space\n"
-				"before closing this dialog, otherwise any changes will be lost."));
+			seed = seed * 1103515245 + 12345;
+			const unsigned int r = seed >> 8;
 
-			// do another attempt
-			SaveDb();
+			char name[32];
+			_snprintf_s(name, sizeof(name), _TRUNCATE, "synthfm_%d", i);
+
+			FMEntry *fm = new FMEntry;
+			fm->InitName(name);
+			fm->flags = (r & 1) ? FMEntry::FLAG_Installed : FMEntry::FLAG_Archived;
+			if (!(r & 6))
+				fm->flags |= FMEntry::FLAG_Installed | FMEntry::FLAG_Archived;
+			fm->status = (r >> 3) % 3;
+			fm->nCompleteCount = (fm->status == FMEntry::STATUS_Completed || ((r >> 5) & 1)) ? 1 : 0;
+			fm->rating = (int)((r >> 6) % 12) - 1;
+			fm->priority = (r >> 10) & 3;
+			fm->tmReleaseDate = 946684800 + (time_t)((r >> 12) % 700) * 86400 * 10;
+
+			AddDbEntry(fm, KEY(fm->name));
 		}
-		TermDb();
 
-abort:
-		MainWndTermOS(pMainWnd);
+		vector<unsigned char> mask;
 
-		delete pMainWnd;
+		InvalidateHotFields();
+		t = GetTimeMsOS();
+		RebuildHotFields();
+		_snprintf_s(params, sizeof(params), _TRUNCATE, "db=%d ", dbSizes[k]);
+		report("rebuild_hot_fields", params, GetTimeMsOS() - t, (int)g_db.size());
 
-		TermArchiveSystem();
-		TermFLTK();
-		CleanupLocalization();
+		for (int i=0; i<(int)(sizeof(filters)/sizeof(filters[0])); i++)
+		{
+			g_cfg.filtShow = filters[i].show;
+			g_cfg.filtMinRating = filters[i].minRating;
 
-		Fl::flush();
+			int nVisible = 0;
+			t = GetTimeMsOS();
+			for (int j=0; j<FILTER_PASSES; j++)
+				FilterHotFields(mask);
+			const double ms = (GetTimeMsOS() - t) / FILTER_PASSES;
 
-		return g_appReturn;
-	}
+			for (int j=0; j<(int)mask.size(); j++)
+				nVisible += mask[j];
+
+			_snprintf_s(params, sizeof(params), _TRUNCATE, "db=%d filter=%s ", dbSizes[k], filters[i].label);
+			report("filter_hot_fields", params, ms, nVisible);
+		}
 
+		TermDb();
+	}
+	FreeArchiveManifests();
+	TermThreadPoolOS();
 	TermArchiveSystem();
-	TermFLTK();
-	TermLocalization();
+	CleanupLocalization();
 
-	return kSelFMRet_Cancel;
+	return 0;
+}
+
+extern "C" int FMSELAPI BenchGlmlToHtml(const char *glml, int len, double *ms,
+	void (*result)(const char *html, int len, void *ctxt), void *ctxt)
+{
+#ifdef GLML_SUPPORT
+	const double t = GetTimeMsOS();
+	const string html = GlmlTextToHtml(glml, len);
+	*ms = GetTimeMsOS() - t;
+
+	result(html.c_str(), (int)html.length(), ctxt);
+
+	return 0;
+#else
+	return 1;
+#endif
 }
+
+#endif // BENCH_SUPPORT
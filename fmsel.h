@@ -111,4 +111,51 @@ extern "C"
 #endif
 int FMSELAPI SelectFM(sFMSelectorData *data);
 
+// resident mode for a host process that calls SelectFM repeatedly (like the fmsel_launch server), when enabled the
+// FM database and archive caches are kept in memory between calls with the same FM root path and game, so the list
+// can be shown without reloading fmsel.ini (the FM dir is then re-scanned in the background)
+#ifdef __cplusplus
+extern "C"
+#endif
+void FMSELAPI SetFMSelResident(int bResident);
+
+// headless batch mode, loads the FM database for 'data' (set up like for SelectFM) and runs the commands in 'argv'
+// in order without creating any windows, progress and timings are passed line by line to 'report', questions that
+// would normally be shown in a dialog are answered with a safe default, the db is saved when done
+// commands:
+//   rescan              re-scan the FM dir
+//   scandates           scan release dates of FMs that don't have one (like AutoScanReleaseDates)
+//   install <name|*>    install FM by dir or archive name, or all archived FMs that aren't installed (several at a
+//                       time, a failed FM doesn't stop the others)
+//   uninstall <name|*>  uninstall FM by dir or archive name, or all installed archived FMs
+//   export <file>       export FM data to a batch fm.ini
+//   import <file>       import FM data from a batch fm.ini (fills empty fields and adds tags)
+//   rebuildcache        regenerate the thumbnail cache (uses all CPUs)
+// returns non-zero if anything failed
+#ifdef __cplusplus
+extern "C"
+#endif
+int FMSELAPI BatchFMSel(sFMSelectorData *data, int argc, const char **argv, void (*report)(const char *msg));
+
+#ifdef BENCH_SUPPORT
+// only available in builds with benchmarks enabled, used by fmsel_bench to time the db, scan and filter code paths
+// without any UI ('data' is set up like for SelectFM, the FM root must not contain an fmsel.ini), 'repo' is an
+// optional archive repo path, 'nInstall' the number of archived FMs to install and uninstall, each timed step is
+// passed to 'report' (with 'params' being either empty or a list of space-terminated key=value pairs)
+// returns non-zero on failure
+#ifdef __cplusplus
+extern "C"
+#endif
+int FMSELAPI BenchFMSel(sFMSelectorData *data, const char *repo, int nInstall,
+	void (*report)(const char *bench, const char *params, double ms, int count));
+
+// convert 'len' bytes of glml text with the readme converter, the html is passed to 'result' and the time the
+// conversion took is returned in 'ms', returns non-zero if the library was built without GLML_SUPPORT
+#ifdef __cplusplus
+extern "C"
+#endif
+int FMSELAPI BenchGlmlToHtml(const char *glml, int len, double *ms,
+	void (*result)(const char *html, int len, void *ctxt), void *ctxt);
+#endif
+
 #endif // _FMSEL_H_
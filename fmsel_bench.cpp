@@ -0,0 +1,522 @@
+/* FMSel is free software; you can redistribute it and/or modify
+ * it under the terms of the FLTK License.
+ *
+ * FMSel is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * FLTK License for more details.
+ *
+ * You should have received a copy of the FLTK License along with
+ * FMSel.
+ */
+
+/*
+ * FMSel Benchmarks
+ * Times FMSel code paths on synthetic data, without any UI.
+ *
+ * Results are printed one per line as "<bench> <key>=<value> ..." so they can
+ * be collected by scripts and compared between builds.
+ *
+ * The benchmarks call into the FMSel library, which exports BenchFMSel and
+ * BenchGlmlToHtml in builds with benchmarks enabled (BENCH_SUPPORT). The
+ * db/scan/filter benchmarks run on a synthetic FM root and archive repo that
+ * is generated in a scratch dir (-dir).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "fmsel.h"
+
+#ifdef _WIN32
+#define DIRSEP '\\'
+#define DIRSEP_STR "\\"
+#else
+#define DIRSEP '/'
+#define DIRSEP_STR "/"
+#endif
+
+using std::string;
+
+
+static double NowMS()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// GLML
+
+#ifdef GLML_SUPPORT
+
+// reference implementation of the previous GlmlToHtml conversion (one find/replace pass per tag), used to verify
+// the output of the single pass converter and as a baseline for timing
+static void GlobalReplace(string &str, const string &search, const string &repl)
+{
+	size_t pos = 0;
+	while ((pos = str.find(search, pos)) != string::npos)
+		str.replace(pos, search.size(), repl);
+}
+
+static string LegacyGlmlToHtml(string html)
+{
+	static const char *tags[][2] =
+	{
+		{ "[GLNL]", "<br>" }, { "[GLCENTER]", "<center>" }, { "[/GLCENTER]", "</center>" },
+		{ "[GLTITLE]", "<h1>" }, { "[/GLTITLE]", "</h1>" }, { "[GLSUBTITLE]", "<h2>" }, { "[/GLSUBTITLE]", "</h2>" },
+		{ "[GLWARNINGS]", "<b>" }, { "[/GLWARNINGS]", "</b>" }, { "[GLLINE]", "<hr><br><br>" },
+		{ "[GLLANGUAGE]", "<p>" }, { "[/GLLANGUAGE]", "</p>" },
+		{ "[GLAUTHOR]", "" }, { "[/GLAUTHOR]", "" }, { "[GLFMINFO]", "" }, { "[/GLFMINFO]", "" },
+		{ "[GLBRIEFING]", "" }, { "[/GLBRIEFING]", "" }, { "[GLFMSTRUCTURE]", "" }, { "[/GLFMSTRUCTURE]", "" },
+		{ "[GLBUILD]", "" }, { "[/GLBUILD]", "" }, { "[GLINFO]", "" }, { "[/GLINFO]", "" },
+		{ "[GLLOADING]", "" }, { "[/GLLOADING]", "" }, { "[GLCOPYRIGHT]", "" }, { "[/GLCOPYRIGHT]", "" },
+	};
+
+	for (size_t i = 0; i < sizeof(tags)/sizeof(tags[0]); i++)
+		GlobalReplace(html, tags[i][0], tags[i][1]);
+
+	return html;
+}
+
+// generate a synthetic glml readme of (at least) 'size' bytes
+static string MakeGlml(size_t size)
+{
+	static const char *words[] = { "the", "mission", "[1]", "guard", "key", "a[b]", "tower", "loot", "[GLFOO]", "door" };
+
+	string s;
+	s.reserve(size + 4096);
+
+	s += "[GLTITLE]Synthetic Mission[/GLTITLE][GLNL][GLAUTHOR]Someone[/GLAUTHOR][GLNL][GLLINE]";
+
+	unsigned int seed = 1;
+	while (s.size() < size)
+	{
+		s += "[GLSUBTITLE]Section[/GLSUBTITLE][GLNL][GLBRIEFING]";
+
+		for (int line = 0; line < 20; line++)
+		{
+			for (int w = 0; w < 12; w++)
+			{
+				seed = seed * 1103515245 + 12345;
+				s += words[(seed >> 16) % (sizeof(words)/sizeof(words[0]))];
+				s += ' ';
+			}
+			s += "[GLNL]\r\n";
+		}
+
+		s += "[/GLBRIEFING][GLCENTER][GLWARNINGS]Warning[/GLWARNINGS][/GLCENTER][GLNL][GLLINE]";
+	}
+
+	return s;
+}
+
+static void OnGlmlHtml(const char *html, int len, void *ctxt)
+{
+	((string*)ctxt)->assign(html, len);
+}
+
+static int BenchGlml(int maxMB)
+{
+	int errors = 0;
+
+	for (int mb = 1; mb <= maxMB; mb *= 2)
+	{
+		const string glml = MakeGlml((size_t)mb << 20);
+
+		string html;
+		double ms = 0;
+		if ( BenchGlmlToHtml(glml.c_str(), (int)glml.size(), &ms, OnGlmlHtml, &html) )
+		{
+			fprintf(stderr, "glml conversion not supported by library\n");
+			return 1;
+		}
+
+		printf("glml_to_html size=%u ms=%.2f mb_per_s=%.1f\n", (unsigned int)glml.size(), ms, ms > 0 ? glml.size() / (ms * 1000.0) : 0.0);
+
+		// the legacy conversion is quadratic, only compare against it on the smaller sizes
+		if (mb <= 2)
+		{
+			const double t = NowMS();
+			const string ref = LegacyGlmlToHtml(glml);
+			const double ref_ms = NowMS() - t;
+
+			const int ok = (ref == html);
+			if (!ok)
+				errors++;
+
+			printf("glml_to_html_legacy size=%u ms=%.2f match=%d\n", (unsigned int)glml.size(), ref_ms, ok);
+		}
+	}
+
+	return errors;
+}
+
+#endif // GLML_SUPPORT
+
+
+/////////////////////////////////////////////////////////////////////
+// DB / scan / filter
+
+// create dir 'path' and any missing parent dirs
+static void MkDirs(const string &path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+		if (i == path.size() || path[i] == DIRSEP)
+		{
+#ifdef _WIN32
+			_mkdir(path.substr(0, i).c_str());
+#else
+			mkdir(path.substr(0, i).c_str(), 0755);
+#endif
+		}
+}
+
+static bool WriteFile(const string &fname, const string &data)
+{
+	FILE *f = fopen(fname.c_str(), "wb");
+	if (!f)
+		return false;
+
+	const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	return fclose(f) == 0 && ok;
+}
+
+static uint32_t Crc32(const string &data)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (unsigned char c : data)
+	{
+		crc ^= c;
+		for (int k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+static void Put16(string &s, unsigned int v)
+{
+	s += (char)(v & 0xFF);
+	s += (char)((v >> 8) & 0xFF);
+}
+
+static void Put32(string &s, uint32_t v)
+{
+	Put16(s, v & 0xFFFF);
+	Put16(s, v >> 16);
+}
+
+static void Put64(string &s, uint64_t v)
+{
+	Put32(s, (uint32_t)v);
+	Put32(s, (uint32_t)(v >> 32));
+}
+
+// write a zip archive with uncompressed ("stored") entries, 'files' holds name/data pairs
+static bool WriteZip(const string &fname, const std::vector<std::pair<string, string>> &files)
+{
+	string zip, cdir;
+
+	for (const auto &file : files)
+	{
+		const uint32_t crc = Crc32(file.second);
+		const uint32_t offset = (uint32_t)zip.size();
+
+		// local file header
+		Put32(zip, 0x04034B50);
+		Put16(zip, 20); Put16(zip, 0); Put16(zip, 0);	// version, flags, method
+		Put16(zip, 0); Put16(zip, 0x21);				// time, date (1980-01-01)
+		Put32(zip, crc);
+		Put32(zip, (uint32_t)file.second.size());
+		Put32(zip, (uint32_t)file.second.size());
+		Put16(zip, (unsigned int)file.first.size());
+		Put16(zip, 0);
+		zip += file.first;
+		zip += file.second;
+
+		// central dir entry
+		Put32(cdir, 0x02014B50);
+		Put16(cdir, 20); Put16(cdir, 20); Put16(cdir, 0); Put16(cdir, 0);
+		Put16(cdir, 0); Put16(cdir, 0x21);
+		Put32(cdir, crc);
+		Put32(cdir, (uint32_t)file.second.size());
+		Put32(cdir, (uint32_t)file.second.size());
+		Put16(cdir, (unsigned int)file.first.size());
+		Put16(cdir, 0); Put16(cdir, 0); Put16(cdir, 0); Put16(cdir, 0);	// extra, comment, disk, int attr
+		Put32(cdir, 0);													// ext attr
+		Put32(cdir, offset);
+		cdir += file.first;
+	}
+
+	const uint32_t cdirOffset = (uint32_t)zip.size();
+	zip += cdir;
+
+	// end of central dir
+	Put32(zip, 0x06054B50);
+	Put16(zip, 0); Put16(zip, 0);
+	Put16(zip, (unsigned int)files.size());
+	Put16(zip, (unsigned int)files.size());
+	Put32(zip, (uint32_t)cdir.size());
+	Put32(zip, cdirOffset);
+	Put16(zip, 0);
+
+	return WriteFile(fname, zip);
+}
+
+// 7z variable length number, the count of leading 1 bits in the first byte is the number of extra (little endian)
+// bytes that follow, the remaining bits of the first byte are the high part of the value
+static void Put7zNumber(string &s, uint64_t v)
+{
+	int n = 0;
+	while (n < 8 && v >= ((uint64_t)1 << (8*n + 7 - n)))
+		n++;
+
+	s += (char)(((0xFF00 >> n) & 0xFF) | (n < 8 ? (unsigned int)(v >> (8*n)) : 0));
+	for (int i = 0; i < n; i++)
+		s += (char)((v >> (8*i)) & 0xFF);
+}
+
+// write a solid 7z archive with all files in a single folder using the "copy" coder, 'files' holds name/data pairs
+// (decoding is trivial, but the archive lib goes through the same solid folder extraction as with real 7z archives)
+static bool Write7z(const string &fname, const std::vector<std::pair<string, string>> &files)
+{
+	string packed;
+	for (const auto &file : files)
+		packed += file.second;
+
+	string hdr;
+	hdr += (char)0x01;					// header
+	hdr += (char)0x04;					// main streams info
+
+	hdr += (char)0x06;					// pack info
+	Put7zNumber(hdr, 0);				// pack pos
+	Put7zNumber(hdr, 1);				// pack streams
+	hdr += (char)0x09;					// sizes
+	Put7zNumber(hdr, packed.size());
+	hdr += (char)0x00;
+
+	hdr += (char)0x07;					// unpack info
+	hdr += (char)0x0B;					// folders
+	Put7zNumber(hdr, 1);
+	hdr += (char)0x00;					// not external
+	Put7zNumber(hdr, 1);				// coders
+	hdr += (char)0x01;					// simple coder with 1 byte id
+	hdr += (char)0x00;					// copy
+	hdr += (char)0x0C;					// coder unpack sizes
+	Put7zNumber(hdr, packed.size());
+	hdr += (char)0x00;
+
+	hdr += (char)0x08;					// substreams info
+	hdr += (char)0x0D;					// unpack streams in folder
+	Put7zNumber(hdr, files.size());
+	hdr += (char)0x09;					// sizes (all but the last)
+	for (size_t i = 0; i + 1 < files.size(); i++)
+		Put7zNumber(hdr, files[i].second.size());
+	hdr += (char)0x0A;					// CRCs
+	hdr += (char)0x01;					// all defined
+	for (const auto &file : files)
+		Put32(hdr, Crc32(file.second));
+	hdr += (char)0x00;
+
+	hdr += (char)0x00;					// end of streams info
+
+	string names;
+	names += (char)0x00;				// not external
+	for (const auto &file : files)
+	{
+		for (unsigned char c : file.first)
+			Put16(names, c);
+		Put16(names, 0);
+	}
+
+	hdr += (char)0x05;					// files info
+	Put7zNumber(hdr, files.size());
+	hdr += (char)0x11;					// names
+	Put7zNumber(hdr, names.size());
+	hdr += names;
+	hdr += (char)0x00;
+	hdr += (char)0x00;					// end of header
+
+	string start;
+	Put64(start, packed.size());		// next header offset
+	Put64(start, hdr.size());
+	Put32(start, Crc32(hdr));
+
+	string sz("7z\xBC\xAF\x27\x1C\x00\x04", 8);
+	Put32(sz, Crc32(start));
+	sz += start;
+	sz += packed;
+	sz += hdr;
+
+	return WriteFile(fname, sz);
+}
+
+// files of a synthetic FM: fm.ini, readmes, a mission file and a few sounds
+static std::vector<std::pair<string, string>> MakeFmFiles(int n)
+{
+	static const char *genres[] = { "mystery", "horror", "heist", "city", "mansion" };
+
+	char buf[512];
+	std::vector<std::pair<string, string>> files;
+
+	snprintf(buf, sizeof(buf), "NiceName=Bench FM %04d\r\nTags=author:author%d genre:%s length:medium\r\n"
+		"Descr=Synthetic FM for benchmarking\r\nInfoFile=readme.txt\r\n", n, n % 97, genres[n % 5]);
+	files.push_back(std::make_pair("fm.ini", string(buf)));
+
+	string readme;
+	while (readme.size() < 4096)
+		readme += "This is a synthetic readme for a benchmark FM. Sneak in, steal the loot, get out.\r\n";
+	files.push_back(std::make_pair("readme.txt", readme));
+	files.push_back(std::make_pair("notes.txt", readme.substr(0, 1024)));
+
+	files.push_back(std::make_pair("miss20.mis", string(64 * 1024, (char)n)));
+
+	for (int i = 0; i < 4; i++)
+	{
+		snprintf(buf, sizeof(buf), "snd/amb%d.wav", i);
+		files.push_back(std::make_pair(string(buf), string(16 * 1024, (char)i)));
+	}
+
+	return files;
+}
+
+static bool MakeSyntheticData(const string &dir, int nDirs, int nArchives)
+{
+	const string root = dir + DIRSEP_STR "fms";
+	const string repo = dir + DIRSEP_STR "archives";
+
+	MkDirs(root);
+	MkDirs(repo + DIRSEP_STR "sub");
+
+	// start out with a fresh db
+	remove((root + DIRSEP_STR "fmsel.ini").c_str());
+
+	char name[64];
+
+	for (int i = 0; i < nDirs; i++)
+	{
+		snprintf(name, sizeof(name), "bench_fm_%04d", i);
+		const string fmdir = root + DIRSEP_STR + name;
+
+		MkDirs(fmdir + DIRSEP_STR "snd");
+
+		for (const auto &file : MakeFmFiles(i))
+		{
+			string fname = file.first;
+			for (auto &c : fname)
+				if (c == '/') c = DIRSEP;
+			if ( !WriteFile(fmdir + DIRSEP_STR + fname, file.second) )
+				return false;
+		}
+	}
+
+	for (int i = 0; i < nArchives; i++)
+	{
+		// every fourth archive goes into a repo subdir, every other one is a (solid) 7z
+		const bool b7z = (i & 1) != 0;
+		snprintf(name, sizeof(name), "%sbench_arc_%04d.%s", (i & 3) ? "" : "sub" DIRSEP_STR, i, b7z ? "7z" : "zip");
+		const string fname = repo + DIRSEP_STR + name;
+		if ( !(b7z ? Write7z(fname, MakeFmFiles(nDirs + i)) : WriteZip(fname, MakeFmFiles(nDirs + i))) )
+			return false;
+	}
+
+	return true;
+}
+
+static void Report(const char *bench, const char *params, double ms, int count)
+{
+	printf("%s %sms=%.2f count=%d\n", bench, params, ms, count);
+}
+
+static int BenchDb(const string &dir, int nDirs, int nArchives, int nInstall)
+{
+	double t = NowMS();
+	if ( !MakeSyntheticData(dir, nDirs, nArchives) )
+	{
+		fprintf(stderr, "failed to generate synthetic data in %s\n", dir.c_str());
+		return 1;
+	}
+	printf("generate_data dirs=%d archives=%d ms=%.2f\n", nDirs, nArchives, NowMS() - t);
+
+	string root = dir + DIRSEP_STR "fms";
+	const string repo = dir + DIRSEP_STR "archives";
+
+	std::vector<char> rootBuf(root.begin(), root.end());
+	rootBuf.resize(4096);
+	char name[128] = "", modExclude[4096] = "", lang[64] = "";
+
+	sFMSelectorData data = {};
+	data.nStructSize = sizeof(data);
+	data.sGameVersion = "Thief 2 Final 1.27";
+	data.sRootPath = rootBuf.data();
+	data.nMaxRootLen = (int)rootBuf.size();
+	data.sName = name;
+	data.nMaxNameLen = sizeof(name);
+	data.sModExcludePaths = modExclude;
+	data.nMaxModExcludeLen = sizeof(modExclude);
+	data.sLanguage = lang;
+	data.nLanguageLen = sizeof(lang);
+	data.sModPaths = "";
+	data.sUberModPaths = "";
+
+	if ( BenchFMSel(&data, repo.c_str(), nInstall, Report) )
+	{
+		fprintf(stderr, "db benchmark failed\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// main
+
+int main(int argc, char **argv)
+{
+	int errors = 0;
+	int maxMB = 16;
+	int nDirs = 500;
+	int nArchives = 500;
+	int nInstall = 20;
+	string dir = "fmsel_bench_data";
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-mb") && i+1 < argc)
+			maxMB = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-dirs") && i+1 < argc)
+			nDirs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-archives") && i+1 < argc)
+			nArchives = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-install") && i+1 < argc)
+			nInstall = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-dir") && i+1 < argc)
+			dir = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-mb <max glml size in MB>] [-dirs <FM dirs>] [-archives <FM archives>]"
+				" [-install <FMs to install>] [-dir <scratch dir for synthetic data>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+#ifdef GLML_SUPPORT
+	errors += BenchGlml(maxMB);
+#else
+	(void)maxMB;
+#endif
+	errors += BenchDb(dir, nDirs, nArchives, nInstall);
+
+	return errors ? 1 : 0;
+}
@@ -7,6 +7,20 @@
  * data. However, it also serves as a utility to allow outside programs (e.g.
  * Wine) to interact with FMSel transparently, even being able to receive
  * the modified data contents through a pipe.
+ *
+ * On POSIX systems it can also run as a resident server on a local socket,
+ * keeping FMSel loaded (along with its FM database and archive caches) between
+ * launches. Launches with --connect hand their parameters to the server,
+ * which shows the selector and sends the modified data back, so relaunching
+ * after a game exits doesn't have to reload and rescan everything. If no
+ * server is listening, the launch is done locally as usual. A socket path
+ * without a directory is placed in $XDG_RUNTIME_DIR, the socket is only
+ * accessible to its owner and connections from other users are rejected.
+ *
+ * With --batch it runs maintenance jobs (rescans, release date scans, FM
+ * installs and uninstalls, batch fm.ini export/import, cache rebuilds) on an
+ * FM library without showing any windows, printing progress and timings to
+ * stdout.
  */
 
 #ifdef _WIN32
@@ -18,10 +32,18 @@
 #include <windows.h>
 #define getcwd _getcwd
 #else
+#ifdef __linux__
+#define _GNU_SOURCE // struct ucred
+#endif
 #ifndef _POSIX_C_SOURCE
-#define _POSIX_C_SOURCE 1
+#define _POSIX_C_SOURCE 200112L
 #endif
 #include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #endif
 #include <stdint.h>
@@ -37,12 +59,18 @@
 
 // return codes
 #define FMSEL_L_RET_ERR -2 // must not be in eFMSelReturn
+#define FMSEL_L_RET_NO_SERVER -3 // no resident server, must not be in eFMSelReturn
+
+// resident mode
+#define FMSEL_L_MAX_FWD_ARGS 10 // parameters forwarded to the server (all but PipePID)
+#define FMSEL_L_MAX_REQUEST (1 << 16) // max size of a request sent to the server
 
 // prototypes
-int StartFMSel(const char *game, const char *rootPath, const char *lang,
-	const char *exited, const int rootLen, const int nameLen,
-	const int modExcludeLen, const int langLen, const char *modPaths,
-	const char *uberModPaths,
+int CheckArgs(const int argc, const char **argv);
+void ShowUsage(const char *name);
+int InitData(sFMSelectorData *data, const int argc, const char **argv);
+void FreeData(sFMSelectorData *data);
+int StartFMSel(const int argc, const char **argv,
 #ifdef _WIN32
 	const unsigned long pipeFD
 #else
@@ -50,10 +78,25 @@ int StartFMSel(const char *game, const char *rootPath, const char *lang,
 #endif
 );
 void ShowError(const char *message, const int fatal);
+int RunBatch(const int argc, const char **argv);
+void BatchReport(const char *msg);
+size_t GetDataSize(const sFMSelectorData *data);
+uint8_t *SerializeData(const sFMSelectorData *data);
 #ifdef _WIN32
 void WriteDataToPipe(const sFMSelectorData *data, const HANDLE pipeFD);
+void WriteBufferToPipe(const uint8_t *buf, const size_t bufSize,
+	const HANDLE pipeFD);
 #else
 void WriteDataToPipe(const sFMSelectorData *data, const int pipeFD);
+void WriteBufferToPipe(const uint8_t *buf, const size_t bufSize,
+	const int pipeFD);
+int GetSocketAddr(const char *sockPath, struct sockaddr_un *addr);
+int IsPeerSameUser(const int conn);
+int RunResident(const char *sockPath);
+void HandleResidentRequest(const int conn);
+int ConnectResident(const char *sockPath, const int argc, const char **argv);
+int ReadAll(const int fd, void *buf, const size_t size);
+int WriteAll(const int fd, const void *buf, const size_t size);
 #endif
 
 /*
@@ -61,29 +104,52 @@ void WriteDataToPipe(const sFMSelectorData *data, const int pipeFD);
  * Entry point.
  * Returns FMSel's exit code on success and FMSEL_L_RET_ERR on failure.
  */
-int main(const int argc, const char **argv)
+int main(int argc, const char **argv)
 {
+	const char *name = argv[0];
+	// Run batch commands without UI.
+	if (argc >= 2 && !strcmp(argv[1], "--batch"))
+	{
+		if (argc < 6)
+		{
+			ShowUsage(name);
+			return FMSEL_L_RET_ERR;
+		}
+		return RunBatch(argc - 1, argv + 1);
+	}
+#ifndef _WIN32
+	// Run as resident server.
+	if (argc >= 2 && !strcmp(argv[1], "--resident"))
+	{
+		if (3 != argc)
+		{
+			ShowUsage(name);
+			return FMSEL_L_RET_ERR;
+		}
+		return RunResident(argv[2]);
+	}
+	// Try handing the launch to a resident server, run locally if there is none.
+	if (argc >= 3 && !strcmp(argv[1], "--connect"))
+	{
+		const char *sockPath = argv[2];
+		argc -= 2;
+		argv += 2;
+		if (CheckArgs(argc, argv))
+		{
+			const int ret = ConnectResident(sockPath, argc, argv);
+			if (FMSEL_L_RET_NO_SERVER != ret)
+				return ret;
+		}
+	}
+#endif
 	// Check parameter count.
-	if ((1 != argc && 4 != argc && 5 != argc && 9 != argc && 11 != argc
-			&& 12 != argc)
-		|| (argc >= 5 && strcmp(argv[4], "true") && strcmp(argv[4], "false")))
+	if (!CheckArgs(argc, argv))
 	{
-		printf("Usage:\n\t%s [GameVersion RootPath Language ["
-			" ExitedGame(true,false) [ MaxRootLen MaxNameLen MaxModExcludeLen"
-			" LanguageLen [ ModPaths UberModPaths [ PipePID ] ] ] ] ]\n\n",
-			argv[0]);
+		ShowUsage(name);
 		return FMSEL_L_RET_ERR;
 	}
-	// Establish defaults and start FMSel.
-	const int strsSet = argc >= 4;
-	const int sizesSet = argc >= 9;
-	const int pathsSet = argc >= 11;
-	return StartFMSel(strsSet ? argv[1] : "(No Game Running)",
-		strsSet ? argv[2] : NULL, strsSet ? argv[3] : "english",
-		argc >= 5 ? argv[4] : "false", sizesSet ? atoi(argv[5]) : PATH_MAX,
-		sizesSet ? atoi(argv[6]) : 1 << 7, sizesSet ? atoi(argv[7]) : PATH_MAX,
-		sizesSet ? atoi(argv[8]) : 1 << 6, pathsSet ? argv[9] : "",
-		pathsSet ? argv[10] : "",
+	// Start FMSel.
+	return StartFMSel(argc, argv,
 #ifdef _WIN32
 		12 == argc ? strtoul(argv[11], NULL, 0) : 0
 #else
@@ -93,67 +159,127 @@ int main(const int argc, const char **argv)
 }
 
 /*
- * StartFMSel:
- * Prepares the FM data structure and starts the FM selector.
- * Returns FMSel's exit code on success and FMSEL_L_RET_ERR on failure.
+ * CheckArgs:
+ * Check the parameter count and values (argv[0] is ignored).
+ * Returns non-zero if valid.
  */
-int StartFMSel(const char *game, const char *rootPath, const char *lang,
-	const char *exited, const int rootLen, const int nameLen,
-	const int modExcludeLen, const int langLen, const char *modPaths,
-	const char *uberModPaths,
-#ifdef _WIN32
-	const unsigned long pipeFD
-#else
-	const int pipeFD
+int CheckArgs(const int argc, const char **argv)
+{
+	return !((1 != argc && 4 != argc && 5 != argc && 9 != argc && 11 != argc
+			&& 12 != argc)
+		|| (argc >= 5 && strcmp(argv[4], "true") && strcmp(argv[4], "false")));
+}
+
+/*
+ * ShowUsage:
+ * Print the command line usage.
+ */
+void ShowUsage(const char *name)
+{
+	printf("Usage:\n\t%s [GameVersion RootPath Language ["
+		" ExitedGame(true,false) [ MaxRootLen MaxNameLen MaxModExcludeLen"
+		" LanguageLen [ ModPaths UberModPaths [ PipePID ] ] ] ] ]\n",
+		name);
+	printf("\t%s --batch GameVersion RootPath Language command [ argument ]"
+		" [ command [ argument ] ... ]\n", name);
+#ifndef _WIN32
+	printf("\t%s --resident SocketPath\n"
+		"\t%s --connect SocketPath [ parameters as above ]\n",
+		name, name);
 #endif
-)
+	printf("\nBatch commands:\n"
+		"\trescan, scandates, install Name|*, uninstall Name|*,"
+		" export File, import File, rebuildcache\n");
+	printf("\n");
+}
+
+/*
+ * InitData:
+ * Prepares the FM data structure from the parameters, filling in defaults
+ * for the ones not set.
+ * Returns non-zero on success, the data must then be freed with FreeData.
+ */
+int InitData(sFMSelectorData *data, const int argc, const char **argv)
 {
+	// Establish defaults.
+	const int strsSet = argc >= 4;
+	const int sizesSet = argc >= 9;
+	const int pathsSet = argc >= 11;
+	const int rootLen = sizesSet ? atoi(argv[5]) : PATH_MAX;
+	const int nameLen = sizesSet ? atoi(argv[6]) : 1 << 7;
+	const int modExcludeLen = sizesSet ? atoi(argv[7]) : PATH_MAX;
+	const int langLen = sizesSet ? atoi(argv[8]) : 1 << 6;
+	const char *rootPath = strsSet ? argv[2] : NULL;
 	// Check size lengths.
 	if (rootLen <= 0 || nameLen <= 0 || modExcludeLen <= 0 || langLen <= 0)
 	{
 		ShowError("Provided string sizes are invalid or too small.",
 			FMSEL_L_ERR_FATAL);
-		return FMSEL_L_RET_ERR;
+		return 0;
 	}
 	// Construct FMSel data.
-	sFMSelectorData data;
-	data.nStructSize = sizeof(sFMSelectorData);
-	data.sGameVersion = game;
-	data.sRootPath = calloc(rootLen, sizeof(char));
-	data.nMaxRootLen = rootLen;
-	data.sName = calloc(nameLen, sizeof(char));
-	data.nMaxNameLen = nameLen;
-	data.bExitedGame = strcmp(exited, "true") ? 0 : 1;
-	data.bRunAfterGame = 0;
-	data.sModExcludePaths = calloc(modExcludeLen, sizeof(char));
-	data.nMaxModExcludeLen = modExcludeLen;
-	data.sLanguage = calloc(langLen, sizeof(char));
-	data.nLanguageLen = langLen;
-	data.bForceLanguage = 0;
-	data.sModPaths = modPaths;
-	data.sUberModPaths = uberModPaths;
+	data->nStructSize = sizeof(sFMSelectorData);
+	data->sGameVersion = strsSet ? argv[1] : "(No Game Running)";
+	data->sRootPath = calloc(rootLen, sizeof(char));
+	data->nMaxRootLen = rootLen;
+	data->sName = calloc(nameLen, sizeof(char));
+	data->nMaxNameLen = nameLen;
+	data->bExitedGame = (argc >= 5 && !strcmp(argv[4], "true")) ? 1 : 0;
+	data->bRunAfterGame = 0;
+	data->sModExcludePaths = calloc(modExcludeLen, sizeof(char));
+	data->nMaxModExcludeLen = modExcludeLen;
+	data->sLanguage = calloc(langLen, sizeof(char));
+	data->nLanguageLen = langLen;
+	data->bForceLanguage = 0;
+	data->sModPaths = pathsSet ? argv[9] : "";
+	data->sUberModPaths = pathsSet ? argv[10] : "";
 	// Check allocated buffers.
-	if (NULL == data.sRootPath || NULL == data.sName
-		|| NULL == data.sModExcludePaths || NULL == data.sLanguage)
+	if (NULL == data->sRootPath || NULL == data->sName
+		|| NULL == data->sModExcludePaths || NULL == data->sLanguage)
 	{
 		ShowError("Could not allocate memory for FMSel state.",
 			FMSEL_L_ERR_FATAL);
-		if (NULL != data.sRootPath)
-			free(data.sRootPath);
-		if (NULL != data.sName)
-			free(data.sName);
-		if (NULL != data.sModExcludePaths)
-			free(data.sModExcludePaths);
-		if (NULL != data.sLanguage)
-			free(data.sLanguage);
-		return FMSEL_L_RET_ERR;
+		FreeData(data);
+		return 0;
 	}
 	// Copy strings to buffers.
 	if (NULL != rootPath)
-		strncpy(data.sRootPath, rootPath, data.nMaxRootLen - 1);
+		strncpy(data->sRootPath, rootPath, data->nMaxRootLen - 1);
 	else
-		getcwd(data.sRootPath, data.nMaxRootLen);
-	strncpy(data.sLanguage, lang, data.nLanguageLen - 1);
+		getcwd(data->sRootPath, data->nMaxRootLen);
+	strncpy(data->sLanguage, strsSet ? argv[3] : "english",
+		data->nLanguageLen - 1);
+	return 1;
+}
+
+/*
+ * FreeData:
+ * Free the buffers of an FM data structure prepared by InitData.
+ */
+void FreeData(sFMSelectorData *data)
+{
+	free(data->sRootPath);
+	free(data->sName);
+	free(data->sModExcludePaths);
+	free(data->sLanguage);
+}
+
+/*
+ * StartFMSel:
+ * Prepares the FM data structure and starts the FM selector.
+ * Returns FMSel's exit code on success and FMSEL_L_RET_ERR on failure.
+ */
+int StartFMSel(const int argc, const char **argv,
+#ifdef _WIN32
+	const unsigned long pipeFD
+#else
+	const int pipeFD
+#endif
+)
+{
+	sFMSelectorData data;
+	if (!InitData(&data, argc, argv))
+		return FMSEL_L_RET_ERR;
 	// Start FMSel and retrieve the error code.
 	const int ret = SelectFM(&data);
 	// Pipe resulting configuration back to specified PID.
@@ -165,10 +291,7 @@ int StartFMSel(const char *game, const char *rootPath, const char *lang,
 		WriteDataToPipe(&data, pipeFD);
 #endif
 	// Free buffers.
-	free(data.sRootPath);
-	free(data.sName);
-	free(data.sModExcludePaths);
-	free(data.sLanguage);
+	FreeData(&data);
 	// Return with FMSel's error code.
 	return ret;
 }
@@ -193,6 +316,71 @@ void ShowError(const char *message, const int fatal)
 #endif
 }
 
+/*
+ * RunBatch:
+ * Prepares the FM data structure from the first three parameters and runs
+ * the remaining ones as batch commands.
+ * Returns 0 if all commands succeeded and FMSEL_L_RET_ERR on failure.
+ */
+int RunBatch(const int argc, const char **argv)
+{
+	sFMSelectorData data;
+	if (!InitData(&data, 4, argv))
+		return FMSEL_L_RET_ERR;
+	const int ret = BatchFMSel(&data, argc - 4, argv + 4, BatchReport);
+	FreeData(&data);
+	return ret ? FMSEL_L_RET_ERR : 0;
+}
+
+/*
+ * BatchReport:
+ * Print a progress line from a batch run.
+ */
+void BatchReport(const char *msg)
+{
+	printf("%s\n", msg);
+	fflush(stdout);
+}
+
+/*
+ * GetDataSize:
+ * Returns the size of the relevant (non-constant) data in the sFMSelectorData
+ * structure when serialized with SerializeData.
+ */
+size_t GetDataSize(const sFMSelectorData *data)
+{
+	return data->nMaxRootLen + data->nMaxNameLen + data->nMaxModExcludeLen
+		+ data->nLanguageLen + (3 * sizeof(int));
+}
+
+/*
+ * SerializeData:
+ * Serialize the relevant (non-constant) data in the sFMSelectorData structure
+ * into a buffer of GetDataSize bytes.
+ * Returns the buffer, which must be freed by the caller, or NULL on failure.
+ */
+uint8_t *SerializeData(const sFMSelectorData *data)
+{
+	uint8_t *buf, *bufPtr;
+	if (NULL == (buf = calloc(GetDataSize(data), 1)))
+		return NULL;
+	bufPtr = buf;
+	strcpy((char *) bufPtr, data->sRootPath);
+	bufPtr += data->nMaxRootLen * sizeof(char);
+	strcpy((char *) bufPtr, data->sName);
+	bufPtr += data->nMaxNameLen * sizeof(char);
+	strcpy((char *) bufPtr, data->sModExcludePaths);
+	bufPtr += data->nMaxModExcludeLen * sizeof(char);
+	strcpy((char *) bufPtr, data->sLanguage);
+	bufPtr += data->nLanguageLen * sizeof(char);
+	*((int *) bufPtr) = data->bExitedGame;
+	bufPtr += sizeof(int);
+	*((int *) bufPtr) = data->bRunAfterGame;
+	bufPtr += sizeof(int);
+	*((int *) bufPtr) = data->bForceLanguage;
+	return buf;
+}
+
 /*
  * WriteDataToPipe:
  * Write the relevant (non-constant) data in the sFMSelectorData structure
@@ -206,25 +394,28 @@ void WriteDataToPipe(const sFMSelectorData *data, const HANDLE pipeFD)
 void WriteDataToPipe(const sFMSelectorData *data, const int pipeFD)
 #endif
 {
-	const size_t bufSize = data->nMaxRootLen + data->nMaxNameLen
-		+ data->nMaxModExcludeLen + data->nLanguageLen + (3 * sizeof(int));
-	uint8_t *buf, *bufPtr;
-	if (NULL != (buf = calloc(bufSize, 1)))
-	{
-		bufPtr = buf;
-		strcpy((char *) bufPtr, data->sRootPath);
-		bufPtr += data->nMaxRootLen * sizeof(char);
-		strcpy((char *) bufPtr, data->sName);
-		bufPtr += data->nMaxNameLen * sizeof(char);
-		strcpy((char *) bufPtr, data->sModExcludePaths);
-		bufPtr += data->nMaxModExcludeLen * sizeof(char);
-		strcpy((char *) bufPtr, data->sLanguage);
-		bufPtr += data->nLanguageLen * sizeof(char);
-		*((int *) bufPtr) = data->bExitedGame;
-		bufPtr += sizeof(int);
-		*((int *) bufPtr) = data->bRunAfterGame;
-		bufPtr += sizeof(int);
-		*((int *) bufPtr) = data->bForceLanguage;
+	uint8_t *buf = SerializeData(data);
+	if (NULL == buf)
+		ShowError("Could not allocate output buffer.", FMSEL_L_ERR_WARN);
+	WriteBufferToPipe(buf, GetDataSize(data), pipeFD);
+	free(buf);
+}
+
+/*
+ * WriteBufferToPipe:
+ * Write serialized data to the write end of a pipe and close it.
+ * Nothing is written if buf is NULL.
+ */
+#ifdef _WIN32
+void WriteBufferToPipe(const uint8_t *buf, const size_t bufSize,
+	const HANDLE pipeFD)
+#else
+void WriteBufferToPipe(const uint8_t *buf, const size_t bufSize,
+	const int pipeFD)
+#endif
+{
+	if (NULL != buf)
+	{
 #ifdef _WIN32
 		DWORD bytesWritten;
 		if (!WriteFile(pipeFD, buf, bufSize, &bytesWritten, NULL)
@@ -233,10 +424,7 @@ void WriteDataToPipe(const sFMSelectorData *data, const int pipeFD)
 		if (bufSize != (size_t) write(pipeFD, buf, bufSize))
 #endif
 			ShowError("Full data not written to pipe.", FMSEL_L_ERR_WARN);
-		free(buf);
 	}
-	else
-		ShowError("Could not allocate output buffer.", FMSEL_L_ERR_WARN);
 #ifdef _WIN32
 	if (!CloseHandle(pipeFD))
 #else
@@ -245,3 +433,256 @@ void WriteDataToPipe(const sFMSelectorData *data, const int pipeFD)
 		ShowError("Could not close write end of pipe.", FMSEL_L_ERR_WARN);
 }
 
+#ifndef _WIN32
+/*
+ * GetSocketAddr:
+ * Fill in the address of the resident server's socket. A sockPath without
+ * a directory is placed in $XDG_RUNTIME_DIR (a private per-user directory)
+ * if that is set.
+ * Returns non-zero on success.
+ */
+int GetSocketAddr(const char *sockPath, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	const char *runDir = getenv("XDG_RUNTIME_DIR");
+	int len;
+	if (NULL == strchr(sockPath, '/') && NULL != runDir && *runDir)
+		len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s",
+			runDir, sockPath);
+	else
+		len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s",
+			sockPath);
+	return len > 0 && (size_t) len < sizeof(addr->sun_path);
+}
+
+/*
+ * IsPeerSameUser:
+ * Check that the process at the other end of a connection runs as the
+ * same user as this one.
+ * Returns non-zero if it does.
+ */
+int IsPeerSameUser(const int conn)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return 0 == getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len)
+		&& cred.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return 0 == getpeereid(conn, &uid, &gid) && uid == getuid();
+#endif
+}
+
+/*
+ * RunResident:
+ * Run as resident server, listening on a local socket at sockPath and
+ * showing the FM selector for each launch request that is received.
+ * Requests are a 32-bit size followed by the launch parameters as
+ * NUL-terminated strings, responses are FMSel's 32-bit exit code, a 32-bit
+ * size and the serialized data. Only the owner can connect to the socket.
+ * Only returns on failure, with FMSEL_L_RET_ERR.
+ */
+int RunResident(const char *sockPath)
+{
+	struct sockaddr_un addr;
+	if (!GetSocketAddr(sockPath, &addr))
+	{
+		ShowError("Socket path is too long.", FMSEL_L_ERR_FATAL);
+		return FMSEL_L_RET_ERR;
+	}
+	const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == sock)
+	{
+		ShowError("Could not create socket.", FMSEL_L_ERR_FATAL);
+		return FMSEL_L_RET_ERR;
+	}
+	// Remove a stale socket left by a previous server, but never anything
+	// that isn't a socket of this user.
+	struct stat st;
+	if (0 == lstat(addr.sun_path, &st))
+	{
+		if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid())
+		{
+			ShowError("Socket path is in use by another file or user.",
+				FMSEL_L_ERR_FATAL);
+			close(sock);
+			return FMSEL_L_RET_ERR;
+		}
+		unlink(addr.sun_path);
+	}
+	// Create the socket with owner-only access (0600).
+	const mode_t oldMask = umask(0177);
+	const int bound = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+	umask(oldMask);
+	if (-1 == bound || -1 == listen(sock, 1))
+	{
+		ShowError("Could not listen on socket.", FMSEL_L_ERR_FATAL);
+		close(sock);
+		return FMSEL_L_RET_ERR;
+	}
+	// Don't die when a client goes away before reading the response.
+	signal(SIGPIPE, SIG_IGN);
+	// Keep the FM database and caches between requests.
+	SetFMSelResident(1);
+	// Serve requests one at a time.
+	for (;;)
+	{
+		const int conn = accept(sock, NULL, NULL);
+		if (-1 == conn)
+			continue;
+		if (IsPeerSameUser(conn))
+			HandleResidentRequest(conn);
+		close(conn);
+	}
+}
+
+/*
+ * HandleResidentRequest:
+ * Read a launch request from a connection, show the FM selector and send
+ * the result back.
+ */
+void HandleResidentRequest(const int conn)
+{
+	uint32_t reqSize;
+	if (!ReadAll(conn, &reqSize, sizeof(reqSize))
+		|| reqSize > FMSEL_L_MAX_REQUEST)
+		return;
+	char *req = malloc(reqSize + 1);
+	if (NULL == req)
+		return;
+	if (!ReadAll(conn, req, reqSize))
+	{
+		free(req);
+		return;
+	}
+	req[reqSize] = '\0';
+	// Split request into parameters.
+	const char *argv[FMSEL_L_MAX_FWD_ARGS + 1];
+	int argc = 0;
+	argv[argc++] = "fmsel_launch";
+	for (const char *p = req; p < req + reqSize
+		&& argc <= FMSEL_L_MAX_FWD_ARGS; p += strlen(p) + 1)
+		argv[argc++] = p;
+	// Start FMSel.
+	int32_t ret = FMSEL_L_RET_ERR;
+	uint8_t *buf = NULL;
+	uint32_t bufSize = 0;
+	sFMSelectorData data;
+	if (CheckArgs(argc, argv) && InitData(&data, argc, argv))
+	{
+		ret = SelectFM(&data);
+		if (NULL != (buf = SerializeData(&data)))
+			bufSize = GetDataSize(&data);
+		FreeData(&data);
+	}
+	// Send result.
+	if (!WriteAll(conn, &ret, sizeof(ret))
+		|| !WriteAll(conn, &bufSize, sizeof(bufSize))
+		|| !WriteAll(conn, buf, bufSize))
+		ShowError("Full data not written to socket.", FMSEL_L_ERR_WARN);
+	free(buf);
+	free(req);
+}
+
+/*
+ * ConnectResident:
+ * Hand a launch to the resident server listening at sockPath and pipe the
+ * result back if a PipePID was specified.
+ * Returns FMSel's exit code on success, FMSEL_L_RET_NO_SERVER if no server
+ * of this user could be connected to and FMSEL_L_RET_ERR if the request
+ * failed (the launch may already have been shown by the server then).
+ */
+int ConnectResident(const char *sockPath, const int argc, const char **argv)
+{
+	struct sockaddr_un addr;
+	if (!GetSocketAddr(sockPath, &addr))
+		return FMSEL_L_RET_NO_SERVER;
+	const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == sock)
+		return FMSEL_L_RET_NO_SERVER;
+	if (-1 == connect(sock, (struct sockaddr *) &addr, sizeof(addr))
+		|| !IsPeerSameUser(sock))
+	{
+		close(sock);
+		return FMSEL_L_RET_NO_SERVER;
+	}
+	// Build request from all parameters but PipePID.
+	const int fwdArgs = argc - 1 < FMSEL_L_MAX_FWD_ARGS
+		? argc - 1 : FMSEL_L_MAX_FWD_ARGS;
+	uint32_t reqSize = 0;
+	for (int i = 1; i <= fwdArgs; i++)
+		reqSize += strlen(argv[i]) + 1;
+	char *req = malloc(reqSize + 1);
+	if (NULL == req)
+	{
+		close(sock);
+		return FMSEL_L_RET_ERR;
+	}
+	char *reqPtr = req;
+	for (int i = 1; i <= fwdArgs; i++)
+	{
+		strcpy(reqPtr, argv[i]);
+		reqPtr += strlen(argv[i]) + 1;
+	}
+	// Send request and wait for the result.
+	int32_t ret = FMSEL_L_RET_ERR;
+	uint32_t bufSize = 0;
+	uint8_t *buf = NULL;
+	if (!WriteAll(sock, &reqSize, sizeof(reqSize))
+		|| !WriteAll(sock, req, reqSize)
+		|| !ReadAll(sock, &ret, sizeof(ret))
+		|| !ReadAll(sock, &bufSize, sizeof(bufSize))
+		|| FMSEL_L_RET_ERR == ret
+		|| NULL == (buf = malloc(bufSize))
+		|| !ReadAll(sock, buf, bufSize))
+		ret = FMSEL_L_RET_ERR;
+	free(req);
+	close(sock);
+	if (FMSEL_L_RET_ERR == ret)
+		ShowError("Request to resident server failed.", FMSEL_L_ERR_WARN);
+	// Pipe resulting configuration back to specified PID.
+	if (FMSEL_L_RET_ERR != ret && 12 == argc)
+		WriteBufferToPipe(buf, bufSize, atoi(argv[11]));
+	free(buf);
+	return ret;
+}
+
+/*
+ * ReadAll:
+ * Read exactly size bytes from fd.
+ * Returns non-zero on success.
+ */
+int ReadAll(const int fd, void *buf, const size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		const ssize_t n = read(fd, (uint8_t *) buf + done, size - done);
+		if (n <= 0)
+			return 0;
+		done += n;
+	}
+	return 1;
+}
+
+/*
+ * WriteAll:
+ * Write exactly size bytes to fd.
+ * Returns non-zero on success.
+ */
+int WriteAll(const int fd, const void *buf, const size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		const ssize_t n = write(fd, (const uint8_t *) buf + done, size - done);
+		if (n <= 0)
+			return 0;
+		done += n;
+	}
+	return 1;
+}
+#endif
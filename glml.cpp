@@ -14,24 +14,98 @@
 
 #include "glml.h"
 #include "os.h"
+#include "dbgutil.h"
+#include <string.h>
 #include <fstream>
+#include <vector>
 #include <algorithm>
 
 
 using std::string;
 
 
-// replace every occurrence of a string within the range [start_pos, end_pos)
-static void GlobalReplace(string &str, const string &search, const string &repl, size_t start_pos = 0, size_t end_pos = string::npos)
+// glml tags (name without the brackets) and their html counterpart, an empty string means the tag is just removed.
+// the table is shared by the converter and GlmlGetTitle
+struct GlmlTag
 {
-	size_t pos = start_pos;
-	while (true)
+	const char *name;
+	const char *html;
+};
+
+static const GlmlTag g_glmlTags[] =
+{
+	// gl-tags which have a 1:1 html counterpart
+	{ "GLNL",            "<br>" },
+	{ "GLCENTER",        "<center>" },
+	{ "/GLCENTER",       "</center>" },
+	{ "GLTITLE",         "<h1>" },
+	{ "/GLTITLE",        "</h1>" },
+	{ "GLSUBTITLE",      "<h2>" },
+	{ "/GLSUBTITLE",     "</h2>" },
+	{ "GLWARNINGS",      "<b>" },
+	{ "/GLWARNINGS",     "</b>" },
+	{ "GLLINE",          "<hr><br><br>" },
+	{ "GLLANGUAGE",      "<p>" },
+	{ "/GLLANGUAGE",     "</p>" },
+
+	// tags without a counterpart
+	{ "GLAUTHOR",        "" },
+	{ "/GLAUTHOR",       "" },
+	{ "GLFMINFO",        "" },
+	{ "/GLFMINFO",       "" },
+	{ "GLBRIEFING",      "" },
+	{ "/GLBRIEFING",     "" },
+	{ "GLFMSTRUCTURE",   "" },
+	{ "/GLFMSTRUCTURE",  "" },
+	{ "GLBUILD",         "" },
+	{ "/GLBUILD",        "" },
+	{ "GLINFO",          "" },
+	{ "/GLINFO",         "" },
+	{ "GLLOADING",       "" },
+	{ "/GLLOADING",      "" },
+	{ "GLCOPYRIGHT",     "" },
+	{ "/GLCOPYRIGHT",    "" },
+};
+
+#define NUM_GLML_TAGS (sizeof(g_glmlTags)/sizeof(g_glmlTags[0]))
+
+
+// length of the longest tag name in g_glmlTags
+static size_t CalcMaxGlmlTagLen()
+{
+	size_t maxlen = 0;
+	for (size_t i = 0; i < NUM_GLML_TAGS; i++)
+		maxlen = std::max(maxlen, strlen(g_glmlTags[i].name));
+
+	return maxlen;
+}
+
+static const size_t g_nMaxGlmlTagLen = CalcMaxGlmlTagLen();
+
+// look up the tag name in [s, s+len) (without brackets)
+static const GlmlTag* FindGlmlTag(const char *s, size_t len)
+{
+	// every tag starts with "GL" or "/GL"
+	if (len < 3 || (*s != 'G' && *s != '/'))
+		return NULL;
+
+	for (size_t i = 0; i < NUM_GLML_TAGS; i++)
 	{
-		pos = str.find(search, pos);
-		if (pos >= end_pos)
-			break;
-		str.replace(pos, search.size(), repl);
+		const char *name = g_glmlTags[i].name;
+		if (!strncmp(name, s, len) && !name[len])
+			return &g_glmlTags[i];
 	}
+
+	return NULL;
+}
+
+// bracketed text of a tag in g_glmlTags
+static string GlmlTagText(const char *name)
+{
+	const GlmlTag *tag = FindGlmlTag(name, strlen(name));
+	ASSERT(tag != NULL);
+
+	return string("[") + (tag ? tag->name : name) + "]";
 }
 
 bool IsGlmlFile(const string &filename)
@@ -46,61 +120,75 @@ bool IsGlmlFile(const string &filename)
 	return ext == "glml";
 }
 
+string GlmlTextToHtml(const char *glml, size_t len)
+{
+	string html;
+
+	// the output is about the size of the input, with a bit of headroom for tags that expand
+	html.reserve(len + len / 16 + 64);
+
+	const char *s = glml;		// start of text not yet copied to output
+	const char *p = glml;		// search position
+	const char *e = glml + len;
+
+	while (p < e)
+	{
+		const char *open = (const char*)memchr(p, '[', e - p);
+		if (!open)
+			break;
+
+		const char *name = open + 1;
+		const char *close = (const char*)memchr(name, ']', std::min((size_t)(e - name), g_nMaxGlmlTagLen + 1));
+		const GlmlTag *tag = close ? FindGlmlTag(name, close - name) : NULL;
+
+		if (tag)
+		{
+			html.append(s, open - s);
+			html.append(tag->html);
+			s = p = close + 1;
+		}
+		else
+			// not a known tag, keep it as regular text
+			p = name;
+	}
+
+	html.append(s, e - s);
+
+	return html;
+}
+
 string GlmlToHtml(const string &filename, const string &dirname)
 {
 	if (!IsGlmlFile(filename))
 		return "";
 
-	// read the file into a string for conversion
+	// read the file into a buffer for conversion
 #ifdef _WIN32
 	string fl = dirname + "\\" + filename;
-	std::ifstream ifs(WidenStrOS(fl.c_str()).c_str());
+	std::ifstream ifs(WidenStrOS(fl.c_str()).c_str(), std::ios::in | std::ios::binary);
 #else
 	string fl = dirname + "/" + filename;
-	std::ifstream ifs(fl.c_str());
+	std::ifstream ifs(fl.c_str(), std::ios::in | std::ios::binary);
 #endif
-	string html((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-
-	// first replace gl-tags which have a 1:1 html counterpart
-	GlobalReplace(html, "[GLNL]",        "<br>");
-	GlobalReplace(html, "[GLCENTER]",    "<center>");
-	GlobalReplace(html, "[/GLCENTER]",   "</center>");
-	GlobalReplace(html, "[GLTITLE]",     "<h1>");
-	GlobalReplace(html, "[/GLTITLE]",    "</h1>");
-	GlobalReplace(html, "[GLSUBTITLE]",  "<h2>");
-	GlobalReplace(html, "[/GLSUBTITLE]", "</h2>");
-	GlobalReplace(html, "[GLWARNINGS]",  "<b>");
-	GlobalReplace(html, "[/GLWARNINGS]", "</b>");
-	GlobalReplace(html, "[GLLINE]",      "<hr><br><br>");
-	GlobalReplace(html, "[GLLANGUAGE]",  "<p>");
-	GlobalReplace(html, "[/GLLANGUAGE]", "</p>");
-
-	// just remove every remaining tag
-	GlobalReplace(html, "[GLAUTHOR]",       "");
-	GlobalReplace(html, "[/GLAUTHOR]",      "");
-	GlobalReplace(html, "[GLFMINFO]",       "");
-	GlobalReplace(html, "[/GLFMINFO]",      "");
-	GlobalReplace(html, "[GLBRIEFING]",     "");
-	GlobalReplace(html, "[/GLBRIEFING]",    "");
-	GlobalReplace(html, "[GLFMSTRUCTURE]",  "");
-	GlobalReplace(html, "[/GLFMSTRUCTURE]", "");
-	GlobalReplace(html, "[GLBUILD]",        "");
-	GlobalReplace(html, "[/GLBUILD]",       "");
-	GlobalReplace(html, "[GLINFO]",         "");
-	GlobalReplace(html, "[/GLINFO]",        "");
-	GlobalReplace(html, "[GLLOADING]",      "");
-	GlobalReplace(html, "[/GLLOADING]",     "");
-	GlobalReplace(html, "[GLCOPYRIGHT]",    "");
-	GlobalReplace(html, "[/GLCOPYRIGHT]",   "");
+	if (!ifs)
+		return "";
 
-	return html;
+	ifs.seekg(0, std::ios::end);
+	const std::streamoff len = ifs.tellg();
+	ifs.seekg(0, std::ios::beg);
+	if (len <= 0)
+		return "";
+
+	std::vector<char> data((size_t)len);
+	ifs.read(&data[0], len);
+
+	return GlmlTextToHtml(&data[0], (size_t)ifs.gcount());
 }
 
 string GlmlGetTitle(const string &file)
 {
-	// todo: define tags centrally
-	static const string title_start_tag = "[GLTITLE]";
-	static const string title_end_tag = "[/GLTITLE]";
+	static const string title_start_tag = GlmlTagText("GLTITLE");
+	static const string title_end_tag = GlmlTagText("/GLTITLE");
 
 	size_t title_start = file.find(title_start_tag);
 	if (title_start == string::npos)
@@ -21,6 +21,9 @@ bool IsGlmlFile(const std::string &filename);
 // ad-hoc conversion of a garrettloader proprietary 'glml' file into simple html
 std::string GlmlToHtml(const std::string &filename, const std::string &dirname);
 
+// convert glml text already in memory, in a single pass
+std::string GlmlTextToHtml(const char *glml, size_t len);
+
 // extract the fm title from a glml file-in-a-string
 std::string GlmlGetTitle(const std::string &file);
 
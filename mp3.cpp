@@ -16,6 +16,7 @@
 #include "mp3.h"
 #include "os.h"
 #include "lang.h"
+#include "trace.h"
 
 #pragma pack(8)
 #define DR_WAV_IMPLEMENTATION
@@ -82,6 +83,7 @@ static bool DecompressMp3(drmp3 *dec, drwav *wav)
 
 bool ConvertMp3File(const char *name, const char *wavname)
 {
+	TRACE_SCOPE("ConvertMp3File", name);
 	if (!name || !wavname)
 		return false;
 
@@ -124,6 +126,9 @@ bool ConvertMp3File(const char *name, const char *wavname)
 	drwav_uninit(&wav);
 	drmp3_uninit(&dec);
 
+	if (success)
+		AddStat(STAT_ConvertedMp3);
+
 	return success;
 }
 
@@ -169,6 +174,7 @@ static bool DecompressOgg(OggVorbis_File *vf, drwav *wav)
 
 bool ConvertOggFile(const char *name, const char *wavname)
 {
+	TRACE_SCOPE("ConvertOggFile", name);
 	if (!name || !wavname)
 		return false;
 
@@ -198,6 +204,9 @@ bool ConvertOggFile(const char *name, const char *wavname)
 	drwav_uninit(&wav);
 	ov_clear(&vf);
 
+	if (result)
+		AddStat(STAT_ConvertedOgg);
+
 	return result;
 }
 
@@ -241,6 +250,7 @@ static bool DecompressOpus(OggOpusFile *of, drwav *wav)
 
 bool ConvertOpusFile(const char *name, const char *wavname)
 {
+	TRACE_SCOPE("ConvertOpusFile", name);
 	if (!name || !wavname)
 		return false;
 
@@ -269,6 +279,9 @@ bool ConvertOpusFile(const char *name, const char *wavname)
 	drwav_uninit(&wav);
 	op_free(of);
 
+	if (success)
+		AddStat(STAT_ConvertedOpus);
+
 	return success;
 }
 
@@ -358,6 +371,7 @@ static void FlacError(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatu
 
 bool ConvertFlacFile(const char *name, const char *wavname)
 {
+	TRACE_SCOPE("ConvertFlacFile", name);
 	if (!name || !wavname)
 		return false;
 
@@ -488,6 +502,9 @@ bool ConvertFlacFile(const char *name, const char *wavname)
 	FLAC__stream_decoder_finish(dec);
 	FLAC__stream_decoder_delete(dec);
 
+	if (success)
+		AddStat(STAT_ConvertedFlac);
+
 	return success;
 }
 
@@ -30,11 +30,24 @@
 #include <utime.h>
 #include <dlfcn.h>
 #endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
 #include <string>
+#include <deque>
 #include <FL/Fl_File_Chooser.H>
 #include <FL/fl_utf8.h>
 #include "lang.h"
 #include "os.h"
+#include "trace.h"
+
+// thread local storage class specifier (C++11 thread_local isn't available with older compilers)
+#ifdef _MSC_VER
+#define THREAD_LOCAL_OS __declspec(thread)
+#else
+#define THREAD_LOCAL_OS __thread
+#endif
 
 
 #ifdef _WIN32
@@ -412,13 +425,82 @@ BOOL GetFreeDiskSpaceOS(const char *path, unsigned __int64 &freeMB)
 	return TRUE;
 }
 
+// TRUE in threads started by CreateThreadOS and in pool workers
+static THREAD_LOCAL_OS BOOL t_bWorkerThread = FALSE;
+
+BOOL IsMainThreadOS()
+{
+	return !t_bWorkerThread;
+}
+
+// thread start wrapper, flags the thread as a worker and (while tracing) makes the thread's whole run time show
+// up in the trace
+struct ThreadStart
+{
+	void* (*f)(void*);
+	void *p;
+};
+
+static void* ThreadProc(void *p)
+{
+	const ThreadStart ts = *(ThreadStart*)p;
+	delete (ThreadStart*)p;
+
+	t_bWorkerThread = TRUE;
+
+	TRACE_SCOPE("Thread");
+
+	return ts.f(ts.p);
+}
+
 BOOL CreateThreadOS(void* (*f)(void*), void *p)
 {
+	ThreadStart *ts = new ThreadStart;
+	ts->f = f;
+	ts->p = p;
+
 #ifdef _WIN32
-	return _beginthread((void(__cdecl*)(void*))f, 0, p) != 0;
+	if (_beginthread((void(__cdecl*)(void*))ThreadProc, 0, ts) != (uintptr_t)-1)
+		return TRUE;
 #else
 	pthread_t t;
-	return pthread_create(&t, 0, f, p) == 0;
+	if ( !pthread_create(&t, 0, ThreadProc, ts) )
+	{
+		pthread_detach(t);
+		return TRUE;
+	}
+#endif
+
+	delete ts;
+	return FALSE;
+}
+
+int GetNumCPUsOS()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	const int n = (int) si.dwNumberOfProcessors;
+#else
+	const int n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n > 0 ? n : 1;
+}
+
+double GetTimeMsOS()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq = {};
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return (double)t.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
 #endif
 }
 
@@ -653,6 +735,629 @@ BOOL MkDirParentsOS(const char *dir)
 	return fl_mkdir(tmp, DEF_DIR_MODE);
 }
 
+// dir watcher, uses inotify on Linux and polls the modification time of the dirs otherwise (or if inotify fails)
+
+#define DIR_WATCH_POLL_MS 2000
+
+struct DirWatchOS
+{
+	std::vector<std::string> dirs;
+	void (*f)(void*, int);
+	void *p;
+
+	std::vector<time_t> mtimes;
+#ifdef __linux__
+	int fd;
+	std::vector<int> wds;
+#endif
+
+	volatile BOOL bStop;
+	volatile BOOL bDone;
+};
+
+static time_t GetDirMTime(const char *dir)
+{
+	struct stat st = {};
+	return fl_stat(dir, &st) ? 0 : st.st_mtime;
+}
+
+static void* DirWatchThread(void *p)
+{
+	DirWatchOS *w = (DirWatchOS*)p;
+
+#ifdef __linux__
+	if (w->fd != -1)
+	{
+		char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+		while (!w->bStop)
+		{
+			struct pollfd pfd = { w->fd, POLLIN, 0 };
+			if (poll(&pfd, 1, 200) <= 0)
+				continue;
+
+			const ssize_t len = read(w->fd, buf, sizeof(buf));
+			if (len <= 0)
+				continue;
+
+			for (const char *ptr = buf; ptr < buf + len; )
+			{
+				const struct inotify_event *ev = (const struct inotify_event*)ptr;
+				ptr += sizeof(struct inotify_event) + ev->len;
+
+				// the event queue overflowed (wd is -1), events were lost so every dir may have changed
+				if (ev->mask & IN_Q_OVERFLOW)
+				{
+					for (size_t i=0; i<w->wds.size(); i++)
+						w->f(w->p, (int)i);
+					continue;
+				}
+
+				// files only count once they're completely written (or moved into place), so a file that's
+				// still being downloaded/copied isn't picked up half-done
+				if ((ev->mask & IN_CREATE) && !(ev->mask & IN_ISDIR))
+					continue;
+
+				for (size_t i=0; i<w->wds.size(); i++)
+				{
+					if (w->wds[i] == ev->wd)
+					{
+						w->f(w->p, (int)i);
+						break;
+					}
+				}
+			}
+		}
+
+		w->bDone = TRUE;
+		return 0;
+	}
+#endif
+
+	while (!w->bStop)
+	{
+		for (size_t i=0; i<w->dirs.size() && !w->bStop; i++)
+		{
+			const time_t tm = GetDirMTime( w->dirs[i].c_str() );
+			if (tm != w->mtimes[i])
+			{
+				w->mtimes[i] = tm;
+				w->f(w->p, (int)i);
+			}
+		}
+
+		for (int t=0; t<DIR_WATCH_POLL_MS && !w->bStop; t+=200)
+			WaitOS(200);
+	}
+
+	w->bDone = TRUE;
+	return 0;
+}
+
+void* StartDirWatchOS(const std::vector<std::string> &dirs, void (*f)(void*, int), void *p)
+{
+	DirWatchOS *w = new DirWatchOS;
+	w->dirs = dirs;
+	w->f = f;
+	w->p = p;
+	w->bStop = FALSE;
+	w->bDone = FALSE;
+
+	for (size_t i=0; i<dirs.size(); i++)
+		w->mtimes.push_back( GetDirMTime(dirs[i].c_str()) );
+
+#ifdef __linux__
+	w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w->fd != -1)
+	{
+		for (size_t i=0; i<dirs.size(); i++)
+		{
+			const int wd = inotify_add_watch(w->fd, dirs[i].c_str(),
+				IN_CREATE|IN_CLOSE_WRITE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR);
+			if (wd == -1)
+			{
+				// fall back to polling (probably hit the max_user_watches limit)
+				close(w->fd);
+				w->fd = -1;
+				break;
+			}
+			w->wds.push_back(wd);
+		}
+	}
+#endif
+
+	if ( !CreateThreadOS(DirWatchThread, w) )
+	{
+#ifdef __linux__
+		if (w->fd != -1)
+			close(w->fd);
+#endif
+		delete w;
+		return NULL;
+	}
+
+	return w;
+}
+
+void StopDirWatchOS(void *handle)
+{
+	DirWatchOS *w = (DirWatchOS*)handle;
+	if (!w)
+		return;
+
+	w->bStop = TRUE;
+	while (!w->bDone)
+		WaitOS(10);
+
+#ifdef __linux__
+	if (w->fd != -1)
+		close(w->fd);
+#endif
+	delete w;
+}
+
+// thread pool, a fixed set of workers (one per CPU) each with its own task queue, a worker runs the newest task from
+// its own queue and when that's empty takes the oldest one from another worker's queue
+
+long AtomicAddOS(volatile long *p, long n)
+{
+#ifdef _WIN32
+	return InterlockedExchangeAdd(p, n) + n;
+#else
+	return __sync_add_and_fetch(p, n);
+#endif
+}
+
+class PoolLock
+{
+public:
+#ifdef _WIN32
+	PoolLock() { InitializeCriticalSection(&m_cs); }
+	~PoolLock() { DeleteCriticalSection(&m_cs); }
+
+	void Lock() { EnterCriticalSection(&m_cs); }
+	void Unlock() { LeaveCriticalSection(&m_cs); }
+
+private:
+	CRITICAL_SECTION m_cs;
+#else
+	PoolLock() { pthread_mutex_init(&m_mutex, NULL); }
+	~PoolLock() { pthread_mutex_destroy(&m_mutex); }
+
+	void Lock() { pthread_mutex_lock(&m_mutex); }
+	void Unlock() { pthread_mutex_unlock(&m_mutex); }
+
+private:
+	pthread_mutex_t m_mutex;
+#endif
+};
+
+struct LockOS
+{
+	PoolLock lock;
+};
+
+LockOS* CreateLockOS()
+{
+	return new LockOS;
+}
+
+void DestroyLockOS(LockOS *lock)
+{
+	delete lock;
+}
+
+void EnterLockOS(LockOS *lock)
+{
+	lock->lock.Lock();
+}
+
+void LeaveLockOS(LockOS *lock)
+{
+	lock->lock.Unlock();
+}
+
+// counting semaphore
+class PoolSignal
+{
+public:
+#ifdef _WIN32
+	PoolSignal() { m_sem = CreateSemaphore(NULL, 0, 0x7fffffff, NULL); }
+	~PoolSignal() { CloseHandle(m_sem); }
+
+	void Post() { ReleaseSemaphore(m_sem, 1, NULL); }
+
+	// wait for a post for up to 'ms' milliseconds (or forever if -1), returns FALSE on timeout
+	BOOL Wait(int ms = -1) { return WaitForSingleObject(m_sem, ms < 0 ? INFINITE : (DWORD)ms) == WAIT_OBJECT_0; }
+
+private:
+	HANDLE m_sem;
+#else
+	PoolSignal() : m_count(0) { pthread_mutex_init(&m_mutex, NULL); pthread_cond_init(&m_cond, NULL); }
+	~PoolSignal() { pthread_cond_destroy(&m_cond); pthread_mutex_destroy(&m_mutex); }
+
+	void Post()
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_count++;
+		pthread_cond_signal(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	BOOL Wait(int ms = -1)
+	{
+		struct timespec ts;
+		if (ms >= 0)
+		{
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += ms / 1000;
+			ts.tv_nsec += (ms % 1000) * 1000000L;
+			if (ts.tv_nsec >= 1000000000L)
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+		}
+
+		pthread_mutex_lock(&m_mutex);
+		while (!m_count)
+		{
+			if (ms < 0)
+				pthread_cond_wait(&m_cond, &m_mutex);
+			else if (pthread_cond_timedwait(&m_cond, &m_mutex, &ts))
+				break;
+		}
+		const BOOL bPosted = m_count > 0;
+		if (bPosted)
+			m_count--;
+		pthread_mutex_unlock(&m_mutex);
+
+		return bPosted;
+	}
+
+private:
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	int m_count;
+#endif
+};
+
+struct TaskGroupOS
+{
+	volatile long nPending;
+	volatile long bCancel;
+	// posted each time a task of the group has finished
+	PoolSignal finished;
+	PoolLock lock;
+};
+
+struct PoolTask
+{
+	void* (*f)(void*);
+	void *p;
+	void (*done)(void*);
+	TaskGroupOS *group;
+};
+
+struct PoolWorker
+{
+	std::deque<PoolTask> tasks;
+	PoolLock lock;
+#ifdef _WIN32
+	HANDLE hThread;
+	DWORD id;
+#else
+	pthread_t thread;
+#endif
+};
+
+static PoolLock g_poolLock;
+static PoolWorker *g_pPoolWorkers = NULL;
+static int g_nPoolWorkers = 0;
+static volatile long g_nPoolNext = 0;
+static volatile BOOL g_bPoolQuit = FALSE;
+// posted once per queued task (and once per worker on shutdown)
+static PoolSignal *g_pPoolWake = NULL;
+// finished tasks whose continuation hasn't been called yet, run by RunPoolContinuations on the main thread
+static std::vector<PoolTask> g_poolDone;
+static PoolLock g_poolDoneLock;
+// pool worker index of the thread, -1 if it's not a pool thread
+static THREAD_LOCAL_OS int t_nPoolWorker = -1;
+
+// returns the pool worker index of the calling thread or -1 if it's not a pool thread
+static int GetCurPoolWorker()
+{
+	return t_nPoolWorker;
+}
+
+// call the continuations of finished tasks (main thread only), through Fl::awake or when the pool is terminated
+static void RunPoolContinuations(void *)
+{
+	std::vector<PoolTask> done;
+
+	g_poolDoneLock.Lock();
+	done.swap(g_poolDone);
+	g_poolDoneLock.Unlock();
+
+	for (size_t i=0; i<done.size(); i++)
+		done[i].done(done[i].p);
+}
+
+// take a task, newest from worker 'w' own queue first and else the oldest from any other queue (if 'group' is set
+// then only tasks of that group are taken), returns FALSE if there are none
+static BOOL TakePoolTask(int w, TaskGroupOS *group, PoolTask &task)
+{
+	for (int i=0; i<g_nPoolWorkers; i++)
+	{
+		PoolWorker &q = g_pPoolWorkers[(w + i) % g_nPoolWorkers];
+		const BOOL bOwn = !i && w >= 0;
+
+		q.lock.Lock();
+		if (!group)
+		{
+			if ( !q.tasks.empty() )
+			{
+				if (bOwn)
+				{
+					task = q.tasks.back();
+					q.tasks.pop_back();
+				}
+				else
+				{
+					task = q.tasks.front();
+					q.tasks.pop_front();
+				}
+				q.lock.Unlock();
+				return TRUE;
+			}
+		}
+		else
+		{
+			for (std::deque<PoolTask>::iterator it=q.tasks.begin(); it!=q.tasks.end(); it++)
+				if (it->group == group)
+				{
+					task = *it;
+					q.tasks.erase(it);
+					q.lock.Unlock();
+					return TRUE;
+				}
+		}
+		q.lock.Unlock();
+	}
+
+	return FALSE;
+}
+
+static void RunPoolTask(const PoolTask &task)
+{
+	TaskGroupOS *g = task.group;
+
+	// tasks of a cancelled group that haven't started yet are skipped, the continuation is still called so it can
+	// clean up after it
+	if (!g || !g->bCancel)
+	{
+		TRACE_SCOPE("Task");
+		task.f(task.p);
+	}
+
+	// continuations are queued and the main thread woken up once per batch, so if it doesn't get to them (the
+	// FLTK loop ended) they don't pile up in the awake queue and TermThreadPoolOS can still run them
+	if (task.done)
+	{
+		g_poolDoneLock.Lock();
+		const BOOL bWake = g_poolDone.empty();
+		g_poolDone.push_back(task);
+		g_poolDoneLock.Unlock();
+
+		if (bWake)
+			Fl::awake(RunPoolContinuations, NULL);
+	}
+
+	if (g)
+	{
+		g->lock.Lock();
+		g->nPending--;
+		g->finished.Post();
+		g->lock.Unlock();
+	}
+}
+
+#ifdef _WIN32
+static unsigned __stdcall PoolWorkerThread(void *p)
+#else
+static void* PoolWorkerThread(void *p)
+#endif
+{
+	const int w = (int)(size_t)p;
+
+	t_bWorkerThread = TRUE;
+	t_nPoolWorker = w;
+
+	for (;;)
+	{
+		g_pPoolWake->Wait();
+
+		PoolTask task;
+		if ( TakePoolTask(w, NULL, task) )
+			RunPoolTask(task);
+		else if (g_bPoolQuit)
+			break;
+	}
+
+	return 0;
+}
+
+// start worker threads if not already running (called with 'g_poolLock' held)
+static BOOL InitThreadPool()
+{
+	if (g_pPoolWorkers)
+		return TRUE;
+
+	const int n = GetNumCPUsOS() > 2 ? GetNumCPUsOS() : 2;
+
+	g_pPoolWake = new PoolSignal;
+	g_pPoolWorkers = new PoolWorker[n];
+	g_bPoolQuit = FALSE;
+
+	for (int i=0; i<n; i++)
+	{
+		PoolWorker &w = g_pPoolWorkers[i];
+#ifdef _WIN32
+		unsigned int id;
+		w.hThread = (HANDLE)_beginthreadex(NULL, 0, PoolWorkerThread, (void*)(size_t)i, 0, &id);
+		w.id = id;
+		if (!w.hThread)
+#else
+		if ( pthread_create(&w.thread, 0, PoolWorkerThread, (void*)(size_t)i) )
+#endif
+			break;
+
+		g_nPoolWorkers++;
+	}
+
+	if (!g_nPoolWorkers)
+	{
+		delete[] g_pPoolWorkers;
+		delete g_pPoolWake;
+		g_pPoolWorkers = NULL;
+		g_pPoolWake = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void TermThreadPoolOS()
+{
+	g_poolLock.Lock();
+	const BOOL bRunning = g_pPoolWorkers && !g_bPoolQuit;
+	g_bPoolQuit = TRUE;
+	g_poolLock.Unlock();
+
+	if (!bRunning)
+		return;
+
+	// workers finish what's still queued before exiting (not holding the lock, tasks may still try to submit and
+	// will then run their work inline)
+	for (int i=0; i<g_nPoolWorkers; i++)
+		g_pPoolWake->Post();
+
+	for (int i=0; i<g_nPoolWorkers; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(g_pPoolWorkers[i].hThread, INFINITE);
+		CloseHandle(g_pPoolWorkers[i].hThread);
+#else
+		pthread_join(g_pPoolWorkers[i].thread, NULL);
+#endif
+	}
+
+	g_poolLock.Lock();
+	delete[] g_pPoolWorkers;
+	delete g_pPoolWake;
+	g_pPoolWorkers = NULL;
+	g_pPoolWake = NULL;
+	g_nPoolWorkers = 0;
+	g_poolLock.Unlock();
+
+	// continuations the FLTK loop didn't get to (so their jobs get cleaned up)
+	RunPoolContinuations(NULL);
+}
+
+BOOL SubmitTaskOS(TaskGroupOS *group, void* (*f)(void*), void *p, void (*done)(void*))
+{
+	// without a shown window there's no FLTK loop (Fl::run has returned or was never called, like in batch mode)
+	// that would run the continuation, the caller does the work inline instead
+	if (done && IsMainThreadOS() && !Fl::first_window())
+		return FALSE;
+
+	g_poolLock.Lock();
+
+	if (g_pPoolWorkers && g_bPoolQuit)
+	{
+		g_poolLock.Unlock();
+		return FALSE;
+	}
+
+	if ( !InitThreadPool() )
+	{
+		g_poolLock.Unlock();
+		return FALSE;
+	}
+
+	PoolTask task = { f, p, done, group };
+
+	if (group)
+		AtomicAddOS(&group->nPending, 1);
+
+	// tasks spawned by a pool task go to that worker's own queue, others are spread over all workers
+	int w = GetCurPoolWorker();
+	if (w < 0)
+		w = (int)((unsigned long)AtomicAddOS(&g_nPoolNext, 1) % (unsigned long)g_nPoolWorkers);
+
+	PoolWorker &q = g_pPoolWorkers[w];
+	q.lock.Lock();
+	q.tasks.push_back(task);
+	q.lock.Unlock();
+
+	g_pPoolWake->Post();
+
+	g_poolLock.Unlock();
+
+	return TRUE;
+}
+
+TaskGroupOS* CreateTaskGroupOS()
+{
+	TaskGroupOS *g = new TaskGroupOS;
+	g->nPending = 0;
+	g->bCancel = FALSE;
+	return g;
+}
+
+void DestroyTaskGroupOS(TaskGroupOS *group)
+{
+	JoinTaskGroupOS(group);
+
+	// make sure the last finishing task is done with the group
+	group->lock.Lock();
+	group->lock.Unlock();
+
+	delete group;
+}
+
+void CancelTaskGroupOS(TaskGroupOS *group)
+{
+	group->bCancel = TRUE;
+}
+
+BOOL IsTaskGroupCancelledOS(TaskGroupOS *group)
+{
+	return group->bCancel;
+}
+
+BOOL WaitTaskGroupOS(TaskGroupOS *group, int ms)
+{
+	if (!group->nPending)
+		return TRUE;
+
+	// rather than just waiting help out with the group's queued tasks, which also avoids a deadlock when the
+	// waiting thread is a pool worker itself
+	PoolTask task;
+	if ( TakePoolTask(GetCurPoolWorker(), group, task) )
+		RunPoolTask(task);
+	else
+		group->finished.Wait(ms);
+
+	return !group->nPending;
+}
+
+void JoinTaskGroupOS(TaskGroupOS *group)
+{
+	while ( !WaitTaskGroupOS(group, -1) )
+		;
+}
+
 std::wstring WidenStrOS(const char *s)
 {
 	const unsigned int size_w = fl_utf8towc(s, strlen(s), NULL, 0);
@@ -17,6 +17,7 @@
 
 #include <time.h>
 #include <string>
+#include <vector>
 
 #define DEF_DIR_MODE 0755
 #ifdef _WIN32
@@ -54,6 +55,11 @@ BOOL OpenUrlWithAssociatedApp(const char *url, const char *custombrowser = 0);
 BOOL FileDialog(Fl_Window *parent, BOOL bSave, const char *title, const char **pattern, const char *defext, const char *initial, char *result, int len, BOOL bOpenNoExist = 0);
 BOOL GetFreeDiskSpaceOS(const char *path, unsigned __int64 &freeMB);
 BOOL CreateThreadOS(void* (*f)(void*), void *p);
+// returns FALSE when called from a thread started by CreateThreadOS or from a thread pool worker
+BOOL IsMainThreadOS();
+int GetNumCPUsOS();
+// monotonic time in milliseconds (for timing, the starting point is undefined)
+double GetTimeMsOS();
 BOOL GetFileMTimeOS(const char *fname, time_t &tm);
 BOOL GetFileSizeAndMTimeOS(const char *fname, unsigned __int64 &sz, time_t &tm);
 BOOL CloneFileMTimeOS(const char *srcfile, const char *dstfile);
@@ -67,6 +73,40 @@ BOOL GetFmselModulePathOS(char *buf, int len);
 
 BOOL MkDirParentsOS(const char *dir);
 
+// watch dirs for added/removed/renamed entries (not recursive), 'f' is called from a worker thread with the index of
+// the dir that changed, returns a handle for StopDirWatchOS (or NULL on failure)
+void* StartDirWatchOS(const std::vector<std::string> &dirs, void (*f)(void*, int), void *p);
+void StopDirWatchOS(void *handle);
+
+// atomically add 'n' to '*p', returns the new value
+long AtomicAddOS(volatile long *p, long n);
+
+// plain (non-recursive) mutex for data shared with worker threads
+struct LockOS;
+LockOS* CreateLockOS();
+void DestroyLockOS(LockOS *lock);
+void EnterLockOS(LockOS *lock);
+void LeaveLockOS(LockOS *lock);
+
+// thread pool for short lived work, the workers are started with the first task and stopped by TermThreadPoolOS
+// (which waits for queued tasks to finish and calls their pending continuations), tasks are grouped so they can be waited on and cancelled together
+struct TaskGroupOS;
+TaskGroupOS* CreateTaskGroupOS();
+// joins the group before deleting it
+void DestroyTaskGroupOS(TaskGroupOS *group);
+// queue 'f' to be run on a worker with 'p', 'group' may be NULL, when 'f' has returned 'done' (if set) is called
+// with 'p' on the main thread through Fl::awake (or by TermThreadPoolOS if the FLTK loop didn't get to it), returns
+// FALSE if the pool couldn't be started or if 'done' is set and no FLTK loop is running (no window is shown), the
+// caller has to do the work inline then
+BOOL SubmitTaskOS(TaskGroupOS *group, void* (*f)(void*), void *p, void (*done)(void*) = 0);
+// tasks in the group that haven't started yet are skipped, running ones can check IsTaskGroupCancelledOS
+void CancelTaskGroupOS(TaskGroupOS *group);
+BOOL IsTaskGroupCancelledOS(TaskGroupOS *group);
+// wait up to 'ms' milliseconds (-1 for no limit) for a task in the group to finish, returns TRUE when all are done
+BOOL WaitTaskGroupOS(TaskGroupOS *group, int ms);
+void JoinTaskGroupOS(TaskGroupOS *group);
+void TermThreadPoolOS();
+
 std::wstring WidenStrOS(const char *s);
 std::string NarrowStrOS(const wchar_t *s_w);
 std::string DemoteStrOS(const char *s);
@@ -0,0 +1,342 @@
+/* FMSel is free software; you can redistribute it and/or modify
+ * it under the terms of the FLTK License.
+ *
+ * FMSel is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * FLTK License for more details.
+ *
+ * You should have received a copy of the FLTK License along with
+ * FMSel.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <FL/fl_utf8.h>
+#include "trace.h"
+
+
+// max number of collected events, anything beyond that is dropped (to keep memory use in check if tracing is
+// left enabled for a long session)
+#define MAX_TRACE_EVENTS 1000000
+
+struct TraceEvent
+{
+	const char *name;
+	std::string detail;
+	double start;
+	double dur;
+	int tid;
+};
+
+volatile BOOL g_bTraceEnabled = FALSE;
+
+static std::vector<TraceEvent> g_traceEvents;
+// OS thread IDs, indexed by trace thread ID (0 is the thread that started tracing)
+static std::vector<unsigned long> g_traceThreads;
+static std::string g_sTraceFile;
+static double g_traceStart = 0;
+
+class TraceLock
+{
+public:
+#ifdef _WIN32
+	TraceLock() { InitializeCriticalSection(&m_cs); }
+	~TraceLock() { DeleteCriticalSection(&m_cs); }
+
+	void Lock() { EnterCriticalSection(&m_cs); }
+	void Unlock() { LeaveCriticalSection(&m_cs); }
+
+private:
+	CRITICAL_SECTION m_cs;
+#else
+	TraceLock() { pthread_mutex_init(&m_mutex, NULL); }
+	~TraceLock() { pthread_mutex_destroy(&m_mutex); }
+
+	void Lock() { pthread_mutex_lock(&m_mutex); }
+	void Unlock() { pthread_mutex_unlock(&m_mutex); }
+
+private:
+	pthread_mutex_t m_mutex;
+#endif
+};
+
+static TraceLock g_traceLock;
+
+static void LockTrace()
+{
+	g_traceLock.Lock();
+}
+
+static void UnlockTrace()
+{
+	g_traceLock.Unlock();
+}
+
+static unsigned long GetThreadIdOS()
+{
+#ifdef _WIN32
+	return GetCurrentThreadId();
+#else
+	return (unsigned long)pthread_self();
+#endif
+}
+
+// get trace thread ID of calling thread (trace must be locked)
+static int GetTraceThreadId()
+{
+	const unsigned long id = GetThreadIdOS();
+
+	for (int i=0; i<(int)g_traceThreads.size(); i++)
+		if (g_traceThreads[i] == id)
+			return i;
+
+	g_traceThreads.push_back(id);
+	return (int)g_traceThreads.size() - 1;
+}
+
+void BeginTrace(const char *fname)
+{
+	LockTrace();
+
+	g_traceEvents.clear();
+	g_traceEvents.reserve(4096);
+	g_traceThreads.clear();
+	g_sTraceFile = fname;
+	g_traceStart = GetTimeMsOS();
+
+	// make the calling thread the main thread
+	GetTraceThreadId();
+
+	g_bTraceEnabled = TRUE;
+
+	UnlockTrace();
+}
+
+void AddTraceEvent(const char *name, const char *detail, double startms, double durms)
+{
+	LockTrace();
+
+	if (g_bTraceEnabled && g_traceEvents.size() < MAX_TRACE_EVENTS)
+	{
+		g_traceEvents.push_back(TraceEvent());
+
+		TraceEvent &ev = g_traceEvents.back();
+		ev.name = name;
+		if (detail)
+			ev.detail = detail;
+		ev.start = startms;
+		ev.dur = durms;
+		ev.tid = GetTraceThreadId();
+	}
+
+	UnlockTrace();
+}
+
+static void WriteJsonString(FILE *f, const char *s)
+{
+	fputc('"', f);
+
+	for (; *s; s++)
+	{
+		const unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+
+	fputc('"', f);
+}
+
+BOOL EndTrace()
+{
+	if (!g_bTraceEnabled)
+		return TRUE;
+
+	LockTrace();
+
+	g_bTraceEnabled = FALSE;
+
+	BOOL bRet = FALSE;
+
+	FILE *f = fl_fopen(g_sTraceFile.c_str(), "w");
+	if (f)
+	{
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+		for (int i=0; i<(int)g_traceThreads.size(); i++)
+		{
+			fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}},\n",
+				i, i ? "worker" : "main", i);
+		}
+
+		for (size_t i=0; i<g_traceEvents.size(); i++)
+		{
+			const TraceEvent &ev = g_traceEvents[i];
+
+			fprintf(f, "{\"name\":");
+			WriteJsonString(f, ev.name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+				ev.tid, (ev.start - g_traceStart) * 1000.0, ev.dur * 1000.0);
+			if ( !ev.detail.empty() )
+			{
+				fprintf(f, ",\"args\":{\"detail\":");
+				WriteJsonString(f, ev.detail.c_str());
+				fprintf(f, "}");
+			}
+			fprintf(f, "},\n");
+		}
+
+		// (closing event to avoid having to deal with trailing commas)
+		fprintf(f, "{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.1f}\n]}\n",
+			(GetTimeMsOS() - g_traceStart) * 1000.0);
+
+		bRet = !ferror(f);
+		if (fclose(f))
+			bRet = FALSE;
+	}
+
+	g_traceEvents.clear();
+	std::vector<TraceEvent>().swap(g_traceEvents);
+	g_traceThreads.clear();
+
+	UnlockTrace();
+
+	return bRet;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// STATS
+
+struct StatTime
+{
+	double last;
+	double total;
+	int count;
+};
+
+static unsigned __int64 g_statCounters[STAT_NumCounters];
+static StatTime g_statTimers[STAT_NumTimers];
+static TraceLock g_statLock;
+
+// stat names are english, the about dialog passes them through $() (so they need entries in the lang files)
+static const char *g_statNames[STAT_NumCounters] =
+{
+	"Archive reader opens",
+	"Archive reader cache hits",
+	"Files extracted",
+	"Bytes extracted",
+	"MP3 files converted",
+	"OGG files converted",
+	"Opus files converted",
+	"FLAC files converted",
+};
+
+static const char *g_statTimeNames[STAT_NumTimers] =
+{
+	"DB load",
+	"DB save",
+	"FM scan",
+	"Filter",
+	"Sort",
+	"HTML format",
+};
+
+void AddStat(StatCounter id, unsigned __int64 n)
+{
+	g_statLock.Lock();
+	g_statCounters[id] += n;
+	g_statLock.Unlock();
+}
+
+unsigned __int64 GetStat(StatCounter id)
+{
+	g_statLock.Lock();
+	const unsigned __int64 n = g_statCounters[id];
+	g_statLock.Unlock();
+
+	return n;
+}
+
+void AddStatTime(StatTimer id, double ms)
+{
+	g_statLock.Lock();
+	StatTime &t = g_statTimers[id];
+	t.last = ms;
+	t.total += ms;
+	t.count++;
+	g_statLock.Unlock();
+}
+
+double GetStatTime(StatTimer id, double *pTotal, int *pCount)
+{
+	g_statLock.Lock();
+	const StatTime t = g_statTimers[id];
+	g_statLock.Unlock();
+
+	if (pTotal)
+		*pTotal = t.total;
+	if (pCount)
+		*pCount = t.count;
+
+	return t.last;
+}
+
+const char* GetStatName(StatCounter id)
+{
+	return g_statNames[id];
+}
+
+const char* GetStatTimeName(StatTimer id)
+{
+	return g_statTimeNames[id];
+}
+
+void ResetStats()
+{
+	g_statLock.Lock();
+	memset(g_statCounters, 0, sizeof(g_statCounters));
+	memset(g_statTimers, 0, sizeof(g_statTimers));
+	g_statLock.Unlock();
+}
+
+BOOL DumpStats(const char *fname)
+{
+	FILE *f = fl_fopen(fname, "w");
+	if (!f)
+		return FALSE;
+
+	fprintf(f, "CPUs: %d\n\n", GetNumCPUsOS());
+
+	for (int i=0; i<STAT_NumCounters; i++)
+		fprintf(f, "%s: %.0f\n", g_statNames[i], (double)GetStat((StatCounter)i));
+
+	fprintf(f, "\n");
+
+	for (int i=0; i<STAT_NumTimers; i++)
+	{
+		double total;
+		int count;
+		const double last = GetStatTime((StatTimer)i, &total, &count);
+
+		fprintf(f, "%s: last %.1f ms, avg %.1f ms, count %d\n", g_statTimeNames[i], last, count ? total / count : 0.0, count);
+	}
+
+	BOOL bRet = !ferror(f);
+	if (fclose(f))
+		bRet = FALSE;
+
+	return bRet;
+}
@@ -0,0 +1,118 @@
+/* FMSel is free software; you can redistribute it and/or modify
+ * it under the terms of the FLTK License.
+ *
+ * FMSel is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * FLTK License for more details.
+ *
+ * You should have received a copy of the FLTK License along with
+ * FMSel.
+ */
+
+#pragma once
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "os.h"
+
+// performance tracing, timed scopes are collected and written as a Chrome trace event file (JSON), which can be
+// viewed with chrome://tracing or ui.perfetto.dev
+// when tracing isn't enabled a TRACE_SCOPE only costs a flag check, so they can be left in release builds
+
+extern volatile BOOL g_bTraceEnabled;
+
+// start collecting trace events (from all threads), they're written to 'fname' when tracing is ended
+void BeginTrace(const char *fname);
+// stop tracing and write the trace file, returns FALSE if it couldn't be written
+BOOL EndTrace();
+
+// add a complete event for the calling thread, 'name' must be a static string, 'detail' is optional (and copied),
+// times are from GetTimeMsOS
+void AddTraceEvent(const char *name, const char *detail, double startms, double durms);
+
+// times the scope it's declared in, 'detail' must stay valid until the end of the scope
+class TraceScope
+{
+public:
+	TraceScope(const char *name, const char *detail = NULL) : m_name(g_bTraceEnabled ? name : NULL), m_detail(detail)
+	{
+		if (m_name)
+			m_start = GetTimeMsOS();
+	}
+
+	~TraceScope()
+	{
+		if (m_name)
+			AddTraceEvent(m_name, m_detail, m_start, GetTimeMsOS() - m_start);
+	}
+
+private:
+	const char *m_name;
+	const char *m_detail;
+	double m_start;
+};
+
+#define TRACE_SCOPE_CAT2(_a, _b) _a##_b
+#define TRACE_SCOPE_CAT(_a, _b) TRACE_SCOPE_CAT2(_a, _b)
+// TRACE_SCOPE(name) or TRACE_SCOPE(name, detail)
+#define TRACE_SCOPE(...) TraceScope TRACE_SCOPE_CAT(_trace_scope_, __LINE__)(__VA_ARGS__)
+
+
+// runtime statistics, unlike trace events these are always collected (they're only updated per operation, not in
+// inner loops), shown in the About dialog and can be dumped to a text file
+
+enum StatCounter
+{
+	STAT_ArchiveOpens,
+	STAT_ArchiveCacheHits,
+	STAT_FilesExtracted,
+	STAT_BytesExtracted,
+	STAT_ConvertedMp3,
+	STAT_ConvertedOgg,
+	STAT_ConvertedOpus,
+	STAT_ConvertedFlac,
+
+	STAT_NumCounters
+};
+
+enum StatTimer
+{
+	STAT_DbLoad,
+	STAT_DbSave,
+	STAT_FmScan,
+	STAT_Filter,
+	STAT_Sort,
+	STAT_HtmlFormat,
+
+	STAT_NumTimers
+};
+
+void AddStat(StatCounter id, unsigned __int64 n = 1);
+unsigned __int64 GetStat(StatCounter id);
+// record a duration (in ms) for a timer, the last duration, total and count are kept
+void AddStatTime(StatTimer id, double ms);
+// returns the last recorded duration, 'pTotal' and 'pCount' optionally receive the total and number of durations
+double GetStatTime(StatTimer id, double *pTotal = NULL, int *pCount = NULL);
+const char* GetStatName(StatCounter id);
+const char* GetStatTimeName(StatTimer id);
+void ResetStats();
+// write all stats to a text file, returns FALSE if it couldn't be written
+BOOL DumpStats(const char *fname);
+
+// times the scope it's declared in and records it for a stat timer
+class StatTimeScope
+{
+public:
+	StatTimeScope(StatTimer id) : m_id(id), m_start(GetTimeMsOS()) {}
+	~StatTimeScope() { AddStatTime(m_id, GetTimeMsOS() - m_start); }
+
+private:
+	StatTimer m_id;
+	double m_start;
+};
+
+#define STAT_TIME_SCOPE(_id) StatTimeScope TRACE_SCOPE_CAT(_stat_scope_, __LINE__)(_id)
+
+#endif // _TRACE_H_